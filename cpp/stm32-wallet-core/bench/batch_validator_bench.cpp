@@ -0,0 +1,204 @@
+// Throughput of BatchValidator replaying a sync storm on 1, 2, 4, ... threads.
+//
+//   offline_wallet_batch_validator_bench [--uploads N] [--per-upload N] [--verify-rounds N] [--max-threads N]
+//
+// Every merchant uploads a full chunk of signed transactions at once. The
+// stand-in verifier hashes the digest --verify-rounds times (well under a
+// microsecond each), so the default 128 lands near what an Ed25519
+// verification costs on a server core. Each run must give the same answers
+// as the single-threaded one.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "offline_wallet/batch_validator.hpp"
+#include "offline_wallet/sha256.hpp"
+
+namespace {
+
+constexpr std::uint64_t kNow = 1'700'000'000;
+constexpr int kPayers = 512;
+
+// Valid signatures are "<public key>/<digest>"; checking one costs `rounds`
+// SHA-256 compressions on top of the comparison.
+class CostlyVerifier : public offline_wallet::SignatureProvider {
+ public:
+  explicit CostlyVerifier(std::size_t rounds) : rounds_(rounds) {}
+
+  std::string Sign(const std::string& message, const std::string& key_id) override { return key_id + "/" + message; }
+
+  bool Verify(const std::string& signature, const std::string& message, const std::string& public_key) override {
+    offline_wallet::Sha256Digest state = offline_wallet::Sha256::Hash(message.data(), message.size());
+    for (std::size_t i = 0; i < rounds_; ++i) {
+      state = offline_wallet::Sha256::Hash(state.data(), state.size());
+    }
+    sink_ ^= state[0];
+    return signature.size() == public_key.size() + 1 + message.size() &&
+           signature.compare(0, public_key.size(), public_key) == 0 &&
+           signature.compare(public_key.size() + 1, std::string::npos, message) == 0;
+  }
+
+ private:
+  std::size_t rounds_;
+  std::uint8_t sink_ = 0;
+};
+
+class CostlyVerifierFactory : public offline_wallet::BatchVerifierFactory {
+ public:
+  explicit CostlyVerifierFactory(std::size_t rounds) : rounds_(rounds) {}
+
+  std::unique_ptr<offline_wallet::SignatureProvider> Create(std::size_t /*worker*/) override {
+    return std::make_unique<CostlyVerifier>(rounds_);
+  }
+
+ private:
+  std::size_t rounds_;
+};
+
+struct Storm {
+  std::vector<offline_wallet::SyncBatch> batches;
+  std::vector<offline_wallet::BatchTransaction> transactions;
+};
+
+Storm MakeStorm(std::size_t uploads, std::size_t per_upload) {
+  Storm storm;
+  for (std::size_t u = 0; u < uploads; ++u) {
+    offline_wallet::SyncBatch batch;
+    batch.merchant_device_id = "merchant-device-" + std::to_string(u);
+    batch.submitted_at_epoch_seconds = kNow;
+    batch.first = storm.transactions.size();
+    batch.count = per_upload;
+    for (std::size_t i = 0; i < per_upload; ++i) {
+      const std::string id = std::to_string(u) + "-" + std::to_string(i);
+      const std::string payer = "payer-" + std::to_string((u * per_upload + i) % kPayers);
+      offline_wallet::BatchTransaction input;
+      offline_wallet::LocalTransaction& tx = input.tx;
+      tx.tx_id = "tx-" + id;
+      tx.idempotency_key = "merchant:tx-" + id;
+      tx.merchant_intent_id = "mi-" + id;
+      tx.payer_authorization_id = "pa-" + id;
+      tx.merchant_account_id = "merchant-" + std::to_string(u);
+      tx.payer_account_id = payer;
+      tx.merchant_device_id = batch.merchant_device_id;
+      tx.payer_device_id = payer + "-device";
+      tx.amount_cents = static_cast<std::int32_t>(100 + i % 900);
+      tx.merchant_nonce = "mn-" + id;
+      tx.payer_nonce = "pn-" + id;
+      tx.intent_issued_at_epoch_seconds = kNow - 60;
+      tx.authorized_at_epoch_seconds = kNow - 50;
+      tx.expires_at_epoch_seconds = kNow + 30;
+      const std::string digest = offline_wallet::SyncDigestHex(input);
+      tx.merchant_signature = "merchant-key-" + std::to_string(u) + "/" + digest;
+      // Every 97th payer signature is forged, so the run exercises rejections.
+      tx.payer_signature = payer + (i % 97 == 0 ? "-forged/" : "-key/") + digest;
+      storm.transactions.push_back(std::move(input));
+    }
+    storm.batches.push_back(std::move(batch));
+  }
+  return storm;
+}
+
+void Seed(std::size_t uploads, offline_wallet::BatchValidator* validator) {
+  offline_wallet::BatchAccount account;
+  offline_wallet::BatchDevice device;
+  device.last_sync_at_epoch_seconds = kNow - 3'600;
+  for (std::size_t u = 0; u < uploads; ++u) {
+    device.account_id = "merchant-" + std::to_string(u);
+    device.public_key = "merchant-key-" + std::to_string(u);
+    validator->AddAccount(device.account_id, account);
+    validator->AddDevice("merchant-device-" + std::to_string(u), device);
+  }
+  account.available_cents = 10'000'000;
+  for (int p = 0; p < kPayers; ++p) {
+    device.account_id = "payer-" + std::to_string(p);
+    device.public_key = device.account_id + "-key";
+    validator->AddAccount(device.account_id, account);
+    validator->AddDevice(device.account_id + "-device", device);
+  }
+}
+
+bool SameResults(const std::vector<offline_wallet::SyncResult>& a, const std::vector<offline_wallet::SyncResult>& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const auto& x, const auto& y) {
+           return x.tx_id == y.tx_id && x.status == y.status && x.reason == y.reason;
+         });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t uploads = 64;
+  std::size_t per_upload = 1'000;
+  std::size_t rounds = 128;
+  std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::size_t value = std::strtoull(argv[i + 1], nullptr, 10);
+    if (std::strcmp(argv[i], "--uploads") == 0) {
+      uploads = value;
+    } else if (std::strcmp(argv[i], "--per-upload") == 0) {
+      per_upload = value;
+    } else if (std::strcmp(argv[i], "--verify-rounds") == 0) {
+      rounds = value;
+    } else if (std::strcmp(argv[i], "--max-threads") == 0) {
+      max_threads = value;
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--uploads N] [--per-upload N] [--verify-rounds N] [--max-threads N]\n";
+      return 2;
+    }
+  }
+  if (uploads == 0 || per_upload == 0 || max_threads == 0) {
+    std::cerr << "arguments must be positive\n";
+    return 2;
+  }
+
+  const Storm storm = MakeStorm(uploads, per_upload);
+  std::cout << "hardware threads: " << std::thread::hardware_concurrency() << ", uploads: " << uploads
+            << ", transactions: " << storm.transactions.size() << ", verify rounds: " << rounds << "\n";
+  std::cout << "threads  transactions/s  speedup  efficiency  accepted\n";
+  std::vector<offline_wallet::SyncResult> first;
+  double single = 0;
+  for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+    CostlyVerifierFactory factory(rounds);
+    offline_wallet::BatchValidator validator(offline_wallet::BatchPolicy{}, threads, &factory);
+    Seed(uploads, &validator);
+    std::vector<offline_wallet::SyncResult> results;
+    results.reserve(storm.transactions.size());
+    const auto start = std::chrono::steady_clock::now();
+    validator.Validate(storm.batches, storm.transactions, kNow, &results);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (threads == 1) {
+      first = results;
+    } else if (!SameResults(first, results)) {
+      std::cerr << "results differ at " << threads << " threads\n";
+      return 1;
+    }
+    const std::size_t accepted = static_cast<std::size_t>(
+        std::count_if(results.begin(), results.end(), [](const offline_wallet::SyncResult& result) {
+          return result.status == offline_wallet::SyncResultStatus::kAccepted;
+        }));
+    const double rate = static_cast<double>(results.size()) / seconds;
+    if (threads == 1) {
+      single = rate;
+    }
+    std::cout << std::setw(7) << threads << std::setw(16) << std::fixed << std::setprecision(0) << rate
+              << std::setw(8) << std::setprecision(2) << rate / single << "x" << std::setw(11)
+              << std::setprecision(0) << 100.0 * rate / single / static_cast<double>(threads) << "%"
+              << std::setw(10) << accepted << "\n";
+    if (threads == max_threads) {
+      break;
+    }
+    if (threads * 2 > max_threads) {
+      threads = max_threads / 2;  // Always finish on max_threads.
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,173 @@
+// Boot-to-ready time against journal size.
+//
+//   offline_wallet_boot_bench [--tail N]
+//
+// For journals of 1k to 32k sales, times what a terminal does before it can
+// accept the next payment: mount the FlashJournal and rebuild the
+// SpendTracker. "full" is Mount() plus Rebuild(), reading every record;
+// "checkpoint" is BootCheckpoint::Recover() from a checkpoint written N
+// records (default 128) before the reboot, reading the image and the tail.
+// Bytes read from flash are counted alongside host time, since on the device
+// the flash bus, not the CPU, sets the pace.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/boot_checkpoint.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/snapshot_store.hpp"
+#include "offline_wallet/spend_tracker.hpp"
+
+namespace {
+
+using BenchClock = std::chrono::steady_clock;
+
+constexpr std::uint64_t kNow = 1'700'050'000;
+constexpr std::size_t kSectorSize = 64 * 1024;
+constexpr std::size_t kMaxRecords = 33000;
+constexpr std::size_t kSnapshotSectors = 16;
+
+class ReadCountingBlockDevice : public offline_wallet::BlockDevice {
+ public:
+  explicit ReadCountingBlockDevice(offline_wallet::BlockDevice* inner) : inner_(inner) {}
+
+  std::size_t SectorSize() const override { return inner_->SectorSize(); }
+  std::size_t SectorCount() const override { return inner_->SectorCount(); }
+  std::size_t ProgramSize() const override { return inner_->ProgramSize(); }
+  bool Read(std::size_t address, std::uint8_t* out, std::size_t size) const override {
+    bytes_read_ += size;
+    return inner_->Read(address, out, size);
+  }
+  bool Program(std::size_t address, const std::uint8_t* data, std::size_t size) override {
+    return inner_->Program(address, data, size);
+  }
+  bool Erase(std::size_t sector) override { return inner_->Erase(sector); }
+  bool Sync() override { return inner_->Sync(); }
+
+  std::uint64_t bytes_read() const { return bytes_read_; }
+
+ private:
+  offline_wallet::BlockDevice* inner_;
+  mutable std::uint64_t bytes_read_ = 0;
+};
+
+offline_wallet::FlashJournalOptions JournalOptions() {
+  offline_wallet::FlashJournalOptions options;
+  options.max_records = kMaxRecords;
+  return options;
+}
+
+offline_wallet::LocalTransaction MakeTransaction(std::size_t n) {
+  offline_wallet::LocalTransaction tx;
+  tx.tx_id = "tx-" + std::to_string(n);
+  tx.idempotency_key = "merchant-1:" + std::string(tx.tx_id);
+  tx.merchant_account_id = "merchant-1";
+  tx.payer_account_id = "payer-" + std::to_string(n % 97);
+  tx.merchant_device_id = "pos-1";
+  tx.amount_cents = static_cast<std::int64_t>(100 + n % 5000);
+  tx.state = offline_wallet::TransactionState::kPendingSync;
+  tx.created_at_epoch_seconds = kNow - 80000 + n % 80000;
+  tx.merchant_signature = std::string(64, 'm');
+  tx.payer_signature = std::string(64, 'p');
+  return tx;
+}
+
+struct BootCost {
+  double ms = 0;
+  std::uint64_t bytes_read = 0;
+  std::uint64_t replayed = 0;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t tail = 128;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--tail") == 0 && i + 1 < argc) {
+      tail = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      std::fprintf(stderr, "usage: %s [--tail N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::printf("%8s %12s %14s %10s %14s %14s %10s\n", "records", "full_ms", "full_bytes", "full_recs",
+              "checkpoint_ms", "checkpoint_b", "tail_recs");
+  for (std::size_t records = 1000; records <= 32000; records *= 2) {
+    if (records + tail > kMaxRecords) {
+      std::fprintf(stderr, "tail too long\n");
+      return 2;
+    }
+    // About 250 bytes a record on flash, with room to spare.
+    const std::size_t journal_sectors = (records + tail) * 300 / kSectorSize + 8;
+    offline_wallet::RamBlockDevice ram(kSectorSize, journal_sectors + kSnapshotSectors);
+    ReadCountingBlockDevice flash(&ram);
+    offline_wallet::BlockDeviceRegion journal_flash(&flash, 0, journal_sectors);
+    offline_wallet::BlockDeviceRegion snapshot_flash(&flash, journal_sectors, kSnapshotSectors);
+    {
+      offline_wallet::FlashJournal journal(&journal_flash, JournalOptions());
+      offline_wallet::SnapshotStore store(&snapshot_flash);
+      offline_wallet::SpendTracker tracker;
+      offline_wallet::BootCheckpoint checkpoint(&journal, &store, nullptr, &tracker);
+      if (checkpoint.Recover(kNow) == offline_wallet::BootRecovery::kFailed) {
+        std::fprintf(stderr, "mount failed\n");
+        return 1;
+      }
+      for (std::size_t n = 0; n < records + tail; ++n) {
+        if (n == records && !checkpoint.WriteCheckpoint()) {
+          std::fprintf(stderr, "checkpoint failed\n");
+          return 1;
+        }
+        const offline_wallet::LocalTransaction tx = MakeTransaction(n);
+        if (!journal.Save(tx)) {
+          std::fprintf(stderr, "save failed at %zu\n", n);
+          return 1;
+        }
+        tracker.Count(tx, kNow);
+      }
+    }
+
+    BootCost full;
+    {
+      const std::uint64_t read_before = flash.bytes_read();
+      const auto begin = BenchClock::now();
+      offline_wallet::FlashJournal journal(&journal_flash, JournalOptions());
+      offline_wallet::SpendTracker tracker;
+      if (!journal.Mount() || !tracker.Rebuild(journal, kNow)) {
+        std::fprintf(stderr, "full mount failed\n");
+        return 1;
+      }
+      full.ms = std::chrono::duration<double, std::milli>(BenchClock::now() - begin).count();
+      full.bytes_read = flash.bytes_read() - read_before;
+      full.replayed = journal.stats().replayed_records;
+    }
+
+    BootCost fast;
+    {
+      const std::uint64_t read_before = flash.bytes_read();
+      const auto begin = BenchClock::now();
+      offline_wallet::FlashJournal journal(&journal_flash, JournalOptions());
+      offline_wallet::SnapshotStore store(&snapshot_flash);
+      offline_wallet::SpendTracker tracker;
+      offline_wallet::BootCheckpoint checkpoint(&journal, &store, nullptr, &tracker);
+      if (checkpoint.Recover(kNow) != offline_wallet::BootRecovery::kFromCheckpoint) {
+        std::fprintf(stderr, "checkpoint recovery failed\n");
+        return 1;
+      }
+      fast.ms = std::chrono::duration<double, std::milli>(BenchClock::now() - begin).count();
+      fast.bytes_read = flash.bytes_read() - read_before;
+      fast.replayed = checkpoint.replayed_records();
+    }
+
+    std::printf("%8zu %12.2f %14llu %10llu %14.2f %14llu %10llu\n", records + tail, full.ms,
+                static_cast<unsigned long long>(full.bytes_read), static_cast<unsigned long long>(full.replayed),
+                fast.ms, static_cast<unsigned long long>(fast.bytes_read),
+                static_cast<unsigned long long>(fast.replayed));
+  }
+  return 0;
+}
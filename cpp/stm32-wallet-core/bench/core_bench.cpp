@@ -0,0 +1,523 @@
+// Handshake micro-benchmarks for OfflineEngine and FixedOfflineEngine.
+//
+//   offline_wallet_core_bench [--iterations N] [--json PATH]
+//
+// Each engine call is timed on its own, and a second pass times the full
+// intent/authorization/acceptance round. Allocations are counted by replacing
+// the global operator new. Providers and journals are cheap in-memory stand-ins
+// that reuse their storage, so the numbers are dominated by the engine itself.
+// --json writes one object per benchmark for diffing across commits.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/fixed_offline_engine.hpp"
+#include "offline_wallet/handshake_arena.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+std::uint64_t g_allocations = 0;
+std::uint64_t g_allocated_bytes = 0;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  ++g_allocations;
+  g_allocated_bytes += size;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+// std::pmr::new_delete_resource() allocates through the aligned form.
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  ++g_allocations;
+  g_allocated_bytes += size;
+  const auto align = static_cast<std::size_t>(alignment);
+  if (void* ptr = std::aligned_alloc(align, (size / align + 1) * align)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t /*size*/) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t /*alignment*/) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t /*size*/, std::align_val_t /*alignment*/) noexcept { std::free(ptr); }
+
+namespace {
+
+using BenchClock = std::chrono::steady_clock;
+using offline_wallet::testing::FnvDigest;
+using offline_wallet::testing::ManualClock;
+
+constexpr char kHex[] = "0123456789abcdef";
+constexpr std::uint64_t kNow = 1'700'000'000;
+constexpr int kWarmupRounds = 1'000;
+
+// Largest arena footprint of one handshake call in std.round_arena.
+std::size_t g_arena_peak_bytes = 0;
+
+std::uint8_t NextSeedByte(std::uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return static_cast<std::uint8_t>(*state >> 24);
+}
+
+class BenchSignatureProvider : public offline_wallet::SignatureProvider {
+ public:
+  std::string Sign(const std::string& message, const std::string& key_id) override {
+    char digest[16];
+    FnvDigest(key_id.data(), key_id.size(), message.data(), message.size(), digest);
+    return std::string(digest, sizeof(digest));
+  }
+
+  bool Verify(const std::string& signature,
+              const std::string& message,
+              const std::string& public_key_or_id) override {
+    return signature == Sign(message, public_key_or_id);
+  }
+};
+
+class BenchRandomProvider : public offline_wallet::RandomProvider {
+ public:
+  std::string NextHex(std::size_t bytes) override {
+    std::string out(bytes * 2, '0');
+    for (std::size_t i = 0; i < bytes; ++i) {
+      const std::uint8_t byte = NextSeedByte(&state_);
+      out[2 * i] = kHex[byte >> 4];
+      out[2 * i + 1] = kHex[byte & 0x0F];
+    }
+    return out;
+  }
+
+ private:
+  std::uint32_t state_ = 7;
+};
+
+class BenchFixedSignatureProvider : public offline_wallet::FixedSignatureProvider {
+ public:
+  bool Sign(const char* message,
+            std::size_t message_size,
+            const offline_wallet::FixedKeyId& key_id,
+            offline_wallet::FixedSignature* signature_out) override {
+    char digest[16];
+    FnvDigest(key_id.data(), key_id.size(), message, message_size, digest);
+    return signature_out->Assign(digest, sizeof(digest));
+  }
+
+  bool Verify(const offline_wallet::FixedSignature& signature,
+              const char* message,
+              std::size_t message_size,
+              const offline_wallet::FixedKeyId& public_key_or_id) override {
+    char digest[16];
+    FnvDigest(public_key_or_id.data(), public_key_or_id.size(), message, message_size, digest);
+    return signature.Equals(digest, sizeof(digest));
+  }
+};
+
+class BenchFixedRandomProvider : public offline_wallet::FixedRandomProvider {
+ public:
+  void NextBytes(std::uint8_t* out, std::size_t size) override {
+    for (std::size_t i = 0; i < size; ++i) {
+      out[i] = NextSeedByte(&state_);
+    }
+  }
+
+ private:
+  std::uint32_t state_ = 7;
+};
+
+// Keeps the last few transactions in place, overwriting the oldest, so the
+// journal neither grows nor allocates once its rows have warmed up.
+template <typename Base, typename Transaction, typename Id, typename Reason>
+class RingJournal : public Base {
+ public:
+  bool Save(const Transaction& tx) override {
+    std::size_t slot = Find(tx.tx_id);
+    if (slot == kSlots) {
+      slot = next_++ % kSlots;
+    }
+    rows_[slot] = tx;
+    return true;
+  }
+
+  bool Load(const Id& tx_id, Transaction* tx_out) const override {
+    const std::size_t slot = Find(tx_id);
+    if (slot == kSlots || tx_out == nullptr) {
+      return false;
+    }
+    *tx_out = rows_[slot];
+    return true;
+  }
+
+  bool UpdateState(const Id& tx_id, offline_wallet::TransactionState state, const Reason& reason) override {
+    const std::size_t slot = Find(tx_id);
+    if (slot == kSlots) {
+      return false;
+    }
+    rows_[slot].state = state;
+    rows_[slot].failure_reason = reason;
+    return true;
+  }
+
+ private:
+  static constexpr std::size_t kSlots = 4;
+
+  template <typename Key>
+  std::size_t Find(const Key& tx_id) const {
+    for (std::size_t slot = 0; slot < kSlots; ++slot) {
+      const auto& row_id = rows_[slot].tx_id;
+      if (row_id.size() == tx_id.size() && std::memcmp(row_id.data(), tx_id.data(), tx_id.size()) == 0) {
+        return slot;
+      }
+    }
+    return kSlots;
+  }
+
+  Transaction rows_[kSlots];
+  std::size_t next_ = 0;
+};
+
+using BenchJournal = RingJournal<offline_wallet::TransactionJournal,
+                                 offline_wallet::LocalTransaction,
+                                 std::string,
+                                 std::string>;
+using BenchFixedJournal = RingJournal<offline_wallet::FixedTransactionJournal,
+                                      offline_wallet::FixedLocalTransaction,
+                                      offline_wallet::FixedId,
+                                      offline_wallet::FixedReason>;
+
+struct Series {
+  const char* name = "";
+  std::vector<std::uint64_t> samples_ns;
+  std::uint64_t allocations = 0;
+  std::uint64_t allocated_bytes = 0;
+};
+
+struct Summary {
+  const char* name = "";
+  std::uint64_t operations = 0;
+  std::uint64_t p50_ns = 0;
+  std::uint64_t p99_ns = 0;
+  double ops_per_second = 0;
+  double allocations_per_op = 0;
+  double bytes_per_op = 0;
+};
+
+// Runs `fn` once and appends its latency and allocation counts to `series`.
+// The sample vector is reserved up front, so bookkeeping never allocates
+// inside the measured window.
+template <typename Fn>
+bool Measure(Series* series, Fn&& fn) {
+  const std::uint64_t allocations = g_allocations;
+  const std::uint64_t bytes = g_allocated_bytes;
+  const auto begin = BenchClock::now();
+  const bool ok = fn();
+  const auto end = BenchClock::now();
+  series->allocations += g_allocations - allocations;
+  series->allocated_bytes += g_allocated_bytes - bytes;
+  series->samples_ns.push_back(
+      static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+  return ok;
+}
+
+std::uint64_t Percentile(const std::vector<std::uint64_t>& sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const auto rank = static_cast<std::size_t>(percentile / 100.0 * static_cast<double>(sorted.size()) + 0.5);
+  return sorted[std::min(std::max<std::size_t>(rank, 1), sorted.size()) - 1];
+}
+
+Summary Summarize(const Series& series) {
+  Summary summary;
+  summary.name = series.name;
+  std::vector<std::uint64_t> sorted = series.samples_ns;
+  std::sort(sorted.begin(), sorted.end());
+  std::uint64_t total_ns = 0;
+  for (std::uint64_t sample : sorted) {
+    total_ns += sample;
+  }
+  const double operations = static_cast<double>(sorted.size());
+  summary.operations = sorted.size();
+  summary.p50_ns = Percentile(sorted, 50);
+  summary.p99_ns = Percentile(sorted, 99);
+  summary.ops_per_second = total_ns == 0 ? 0 : operations * 1e9 / static_cast<double>(total_ns);
+  summary.allocations_per_op = operations == 0 ? 0 : static_cast<double>(series.allocations) / operations;
+  summary.bytes_per_op = operations == 0 ? 0 : static_cast<double>(series.allocated_bytes) / operations;
+  return summary;
+}
+
+// Each engine runs `iterations` rounds timing every call, then `iterations`
+// rounds timed end to end. Returns false if any call fails.
+bool RunStdEngine(int iterations, std::vector<Series>* out) {
+  BenchSignatureProvider signature;
+  BenchRandomProvider random;
+  ManualClock clock(kNow);
+  BenchJournal merchant_journal;
+  BenchJournal payer_journal;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                             &payer_journal);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  const auto intent_step = [&] {
+    return merchant_engine.BuildMerchantIntent(merchant, 1'250, "CNY", &intent, &tx).status ==
+           offline_wallet::HandshakeStatus::kOk;
+  };
+  const auto authorization_step = [&] {
+    return payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx).status ==
+           offline_wallet::HandshakeStatus::kOk;
+  };
+  const auto accept_step = [&] {
+    return merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx).status ==
+           offline_wallet::HandshakeStatus::kOk;
+  };
+
+  for (int i = 0; i < kWarmupRounds; ++i) {
+    if (!intent_step() || !authorization_step() || !accept_step()) {
+      return false;
+    }
+  }
+
+  Series intent_series{"std.build_merchant_intent", {}, 0, 0};
+  Series authorization_series{"std.build_payer_authorization", {}, 0, 0};
+  Series accept_series{"std.accept_authorization", {}, 0, 0};
+  Series round_series{"std.round", {}, 0, 0};
+  for (Series* series : {&intent_series, &authorization_series, &accept_series, &round_series}) {
+    series->samples_ns.reserve(static_cast<std::size_t>(iterations));
+  }
+  for (int i = 0; i < iterations; ++i) {
+    if (!Measure(&intent_series, intent_step) || !Measure(&authorization_series, authorization_step) ||
+        !Measure(&accept_series, accept_step)) {
+      return false;
+    }
+  }
+  for (int i = 0; i < iterations; ++i) {
+    if (!Measure(&round_series, [&] { return intent_step() && authorization_step() && accept_step(); })) {
+      return false;
+    }
+  }
+  out->push_back(std::move(intent_series));
+  out->push_back(std::move(authorization_series));
+  out->push_back(std::move(accept_series));
+  out->push_back(std::move(round_series));
+
+  // BuildMerchantIntent drawing its IDs from a pool refilled between sales.
+  offline_wallet::IntentPool pool(&random, &merchant_journal, 1);
+  merchant_engine.SetIntentPool(&pool);
+  Series pooled_series{"std.build_merchant_intent_pooled", {}, 0, 0};
+  pooled_series.samples_ns.reserve(static_cast<std::size_t>(iterations));
+  for (int i = 0; i < iterations; ++i) {
+    pool.Refill();
+    if (!Measure(&pooled_series, intent_step) || !authorization_step() || !accept_step()) {
+      return false;
+    }
+  }
+  merchant_engine.SetIntentPool(nullptr);
+  out->push_back(std::move(pooled_series));
+
+  // AcceptAuthorization folding receipts into a ReceiptChain; p99 includes
+  // the checkpoint signature taken every 64 receipts.
+  offline_wallet::ReceiptChain chain;
+  merchant_engine.SetReceiptChain(&chain);
+  Series chained_series{"std.accept_authorization_chained", {}, 0, 0};
+  chained_series.samples_ns.reserve(static_cast<std::size_t>(iterations));
+  for (int i = 0; i < iterations; ++i) {
+    if (!intent_step() || !authorization_step() || !Measure(&chained_series, accept_step)) {
+      return false;
+    }
+  }
+  merchant_engine.SetReceiptChain(nullptr);
+  out->push_back(std::move(chained_series));
+
+  // The same round with each engine's scratch models in a HandshakeArena.
+  alignas(std::max_align_t) static unsigned char merchant_buffer[4096];
+  alignas(std::max_align_t) static unsigned char payer_buffer[4096];
+  offline_wallet::HandshakeArena merchant_arena(merchant_buffer, sizeof(merchant_buffer));
+  offline_wallet::HandshakeArena payer_arena(payer_buffer, sizeof(payer_buffer));
+  merchant_engine.SetHandshakeArena(&merchant_arena);
+  payer_engine.SetHandshakeArena(&payer_arena);
+  Series arena_series{"std.round_arena", {}, 0, 0};
+  arena_series.samples_ns.reserve(static_cast<std::size_t>(iterations));
+  for (int i = 0; i < iterations; ++i) {
+    if (!Measure(&arena_series, [&] { return intent_step() && authorization_step() && accept_step(); })) {
+      return false;
+    }
+  }
+  merchant_engine.SetHandshakeArena(nullptr);
+  payer_engine.SetHandshakeArena(nullptr);
+  g_arena_peak_bytes = std::max(merchant_arena.peak().bytes, payer_arena.peak().bytes);
+  out->push_back(std::move(arena_series));
+
+#if OFFLINE_WALLET_TRACING
+  // The same round with a counters sink attached, to price the trace hooks.
+  offline_wallet::TraceCounters counters(&offline_wallet::HostTraceTicks);
+  merchant_engine.SetTraceSink(&counters);
+  payer_engine.SetTraceSink(&counters);
+  Series traced_series{"std.round_traced", {}, 0, 0};
+  traced_series.samples_ns.reserve(static_cast<std::size_t>(iterations));
+  for (int i = 0; i < iterations; ++i) {
+    if (!Measure(&traced_series, [&] { return intent_step() && authorization_step() && accept_step(); })) {
+      return false;
+    }
+  }
+  out->push_back(std::move(traced_series));
+#endif
+  return true;
+}
+
+bool RunFixedEngine(int iterations, std::vector<Series>* out) {
+  BenchFixedSignatureProvider signature;
+  BenchFixedRandomProvider random;
+  ManualClock clock(kNow);
+  BenchFixedJournal merchant_journal;
+  BenchFixedJournal payer_journal;
+  offline_wallet::FixedOfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                                     &merchant_journal);
+  offline_wallet::FixedOfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                                  &payer_journal);
+  offline_wallet::FixedDeviceContext merchant;
+  merchant.account_id = "merchant-1";
+  merchant.device_id = "merchant-device-1";
+  merchant.signing_key_id = "m-key";
+  merchant.local_counter = 2;
+  offline_wallet::FixedDeviceContext payer;
+  payer.account_id = "payer-1";
+  payer.device_id = "payer-device-1";
+  payer.signing_key_id = "p-key";
+  payer.local_counter = 9;
+  const offline_wallet::FixedCurrency currency{"CNY"};
+
+  offline_wallet::FixedPaymentIntent intent;
+  offline_wallet::FixedPaymentAuthorization authorization;
+  offline_wallet::FixedPaymentReceipt receipt;
+  offline_wallet::FixedLocalTransaction tx;
+  const auto intent_step = [&] {
+    return merchant_engine.BuildMerchantIntent(merchant, 1'250, currency, &intent, &tx).status ==
+           offline_wallet::HandshakeStatus::kOk;
+  };
+  const auto authorization_step = [&] {
+    return payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx).status ==
+           offline_wallet::HandshakeStatus::kOk;
+  };
+  const auto accept_step = [&] {
+    return merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx).status ==
+           offline_wallet::HandshakeStatus::kOk;
+  };
+
+  for (int i = 0; i < kWarmupRounds; ++i) {
+    if (!intent_step() || !authorization_step() || !accept_step()) {
+      return false;
+    }
+  }
+
+  Series intent_series{"fixed.build_merchant_intent", {}, 0, 0};
+  Series authorization_series{"fixed.build_payer_authorization", {}, 0, 0};
+  Series accept_series{"fixed.accept_authorization", {}, 0, 0};
+  Series round_series{"fixed.round", {}, 0, 0};
+  for (Series* series : {&intent_series, &authorization_series, &accept_series, &round_series}) {
+    series->samples_ns.reserve(static_cast<std::size_t>(iterations));
+  }
+  for (int i = 0; i < iterations; ++i) {
+    if (!Measure(&intent_series, intent_step) || !Measure(&authorization_series, authorization_step) ||
+        !Measure(&accept_series, accept_step)) {
+      return false;
+    }
+  }
+  for (int i = 0; i < iterations; ++i) {
+    if (!Measure(&round_series, [&] { return intent_step() && authorization_step() && accept_step(); })) {
+      return false;
+    }
+  }
+  out->push_back(std::move(intent_series));
+  out->push_back(std::move(authorization_series));
+  out->push_back(std::move(accept_series));
+  out->push_back(std::move(round_series));
+  return true;
+}
+
+void PrintTable(const std::vector<Summary>& summaries) {
+  std::printf("%-34s %10s %10s %14s %12s %12s\n", "benchmark", "p50_ns", "p99_ns", "ops_per_sec",
+              "allocs/op", "bytes/op");
+  for (const Summary& summary : summaries) {
+    std::printf("%-34s %10llu %10llu %14.0f %12.2f %12.1f\n", summary.name,
+                static_cast<unsigned long long>(summary.p50_ns),
+                static_cast<unsigned long long>(summary.p99_ns), summary.ops_per_second,
+                summary.allocations_per_op, summary.bytes_per_op);
+  }
+}
+
+bool WriteJson(const char* path, int iterations, const std::vector<Summary>& summaries) {
+  std::FILE* file = std::fopen(path, "w");
+  if (file == nullptr) {
+    return false;
+  }
+  std::fprintf(file, "{\n  \"suite\": \"offline_wallet_core_bench\",\n  \"iterations\": %d,\n", iterations);
+  std::fprintf(file, "  \"benchmarks\": [\n");
+  for (std::size_t i = 0; i < summaries.size(); ++i) {
+    const Summary& summary = summaries[i];
+    std::fprintf(file,
+                 "    {\"name\": \"%s\", \"operations\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+                 "\"ops_per_second\": %.1f, \"allocations_per_op\": %.3f, \"bytes_per_op\": %.1f}%s\n",
+                 summary.name, static_cast<unsigned long long>(summary.operations),
+                 static_cast<unsigned long long>(summary.p50_ns),
+                 static_cast<unsigned long long>(summary.p99_ns), summary.ops_per_second,
+                 summary.allocations_per_op, summary.bytes_per_op, i + 1 == summaries.size() ? "" : ",");
+  }
+  std::fprintf(file, "  ]\n}\n");
+  return std::fclose(file) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int iterations = 20'000;
+  const char* json_path = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::max(std::atoi(argv[++i]), 1);
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      std::fprintf(stderr, "usage: %s [--iterations N] [--json PATH]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<Series> series;
+  if (!RunStdEngine(iterations, &series) || !RunFixedEngine(iterations, &series)) {
+    std::fprintf(stderr, "handshake failed during benchmark\n");
+    return 1;
+  }
+  std::vector<Summary> summaries;
+  for (const Series& entry : series) {
+    summaries.push_back(Summarize(entry));
+  }
+
+  PrintTable(summaries);
+  std::printf("\nstd.round_arena peak arena bytes per call: %zu\n", g_arena_peak_bytes);
+  if (json_path != nullptr && !WriteJson(json_path, iterations, summaries)) {
+    std::fprintf(stderr, "cannot write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
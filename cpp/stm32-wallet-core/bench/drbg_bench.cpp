@@ -0,0 +1,189 @@
+// What random ids and nonces cost, per draw and per handshake.
+//
+//   offline_wallet_drbg_bench [--iterations N]
+//
+// Times one 8-byte id drawn as an allocated NextHex() string, written with
+// FillHex() into a caller buffer, and as raw NextBytes(), all from
+// ChaChaDrbg, plus the raw generator throughput. Then runs full
+// intent/authorization/acceptance rounds between two OfflineEngines whose
+// signer and journal cost next to nothing, once with a provider that hands
+// out a fresh string per call (the pre-DRBG shape) and once with ChaChaDrbg,
+// so the difference is what id generation adds to a handshake.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "offline_wallet/chacha_drbg.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using BenchClock = std::chrono::steady_clock;
+using offline_wallet::testing::ManualClock;
+
+double NsSince(BenchClock::time_point begin, std::size_t operations) {
+  return std::chrono::duration<double, std::nano>(BenchClock::now() - begin).count() /
+         static_cast<double>(operations);
+}
+
+offline_wallet::ChaCha20Key BenchSeed() {
+  offline_wallet::ChaCha20Key seed{};
+  seed[0] = 0x42;
+  return seed;
+}
+
+// Builds a new hex string per call from a 64-bit LCG, as the test and
+// firmware providers did before FillHex().
+class StringRandomProvider : public offline_wallet::RandomProvider {
+ public:
+  std::string NextHex(std::size_t bytes) override {
+    static constexpr char kHex[] = "0123456789abcdef";
+    std::string out;
+    for (std::size_t i = 0; i < bytes * 2; ++i) {
+      state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+      out.push_back(kHex[state_ >> 60]);
+    }
+    return out;
+  }
+
+ private:
+  std::uint64_t state_ = 1;
+};
+
+class EchoSignatureProvider : public offline_wallet::SignatureProvider {
+ public:
+  std::string Sign(const std::string& /*message*/, const std::string& key_id) override { return key_id; }
+  bool Verify(const std::string& signature,
+              const std::string& /*message*/,
+              const std::string& public_key_or_id) override {
+    return signature == public_key_or_id;
+  }
+};
+
+// Keeps only the newest record so the journal stays out of the timing.
+class LastRecordJournal : public offline_wallet::TransactionJournal {
+ public:
+  bool Save(const offline_wallet::LocalTransaction& tx) override {
+    last_ = tx;
+    return true;
+  }
+  bool Load(const std::string& tx_id, offline_wallet::LocalTransaction* tx_out) const override {
+    if (std::string_view(last_.tx_id) != tx_id) {
+      return false;
+    }
+    *tx_out = last_;
+    return true;
+  }
+  bool UpdateState(const std::string& tx_id,
+                   offline_wallet::TransactionState state,
+                   const std::string& reason) override {
+    if (std::string_view(last_.tx_id) != tx_id) {
+      return false;
+    }
+    last_.state = state;
+    last_.failure_reason = reason;
+    return true;
+  }
+
+ private:
+  offline_wallet::LocalTransaction last_;
+};
+
+double HandshakeNs(offline_wallet::RandomProvider* random, std::size_t iterations) {
+  EchoSignatureProvider signer;
+  ManualClock clock;
+  LastRecordJournal merchant_journal;
+  LastRecordJournal payer_journal;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signer, random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signer, random, &clock,
+                                             &payer_journal);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "merchant-device-1", 1};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "payer-device-1", 1};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  const auto begin = BenchClock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    if (merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx).status !=
+            offline_wallet::HandshakeStatus::kOk ||
+        payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx).status !=
+            offline_wallet::HandshakeStatus::kOk ||
+        merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx).status !=
+            offline_wallet::HandshakeStatus::kOk) {
+      std::fprintf(stderr, "handshake failed\n");
+      std::exit(1);
+    }
+  }
+  return NsSince(begin, iterations);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t iterations = 200'000;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      std::fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (iterations == 0) {
+    std::fprintf(stderr, "iterations must be positive\n");
+    return 2;
+  }
+
+  offline_wallet::ChaChaDrbg drbg(BenchSeed());
+  std::size_t sink = 0;
+  auto begin = BenchClock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    sink += static_cast<unsigned char>(drbg.NextHex(8)[0]);
+  }
+  std::printf("%-24s %10.1f ns\n", "id_next_hex_string", NsSince(begin, iterations));
+
+  char hex[16];
+  begin = BenchClock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    sink += drbg.FillHex(8, hex) + static_cast<unsigned char>(hex[0]);
+  }
+  std::printf("%-24s %10.1f ns\n", "id_fill_hex", NsSince(begin, iterations));
+
+  std::uint8_t bytes[8];
+  begin = BenchClock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    drbg.NextBytes(bytes, sizeof(bytes));
+    sink += bytes[0];
+  }
+  std::printf("%-24s %10.1f ns\n", "id_next_bytes", NsSince(begin, iterations));
+
+  static std::uint8_t block[4096];
+  const std::size_t blocks = iterations / 64 + 1;
+  begin = BenchClock::now();
+  for (std::size_t i = 0; i < blocks; ++i) {
+    drbg.NextBytes(block, sizeof(block));
+    sink += block[i % sizeof(block)];
+  }
+  const double seconds = NsSince(begin, 1) / 1e9;
+  std::printf("%-24s %10.1f MB/s\n", "throughput", static_cast<double>(blocks * sizeof(block)) / seconds / 1e6);
+
+  // Six ids and nonces per round.
+  const std::size_t handshakes = iterations / 10 + 1;
+  StringRandomProvider strings;
+  const double string_ns = HandshakeNs(&strings, handshakes);
+  offline_wallet::ChaChaDrbg handshake_drbg(BenchSeed());
+  const double drbg_ns = HandshakeNs(&handshake_drbg, handshakes);
+  std::printf("\n%-24s %10.1f ns\n%-24s %10.1f ns\n", "handshake_string_ids", string_ns, "handshake_drbg_ids",
+              drbg_ns);
+  return sink == 0 ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+// What Ed25519 costs per operation and per handshake.
+//
+//   offline_wallet_ed25519_bench [--iterations N]
+//
+// Times the one-off fixed-base table build, key expansion, signing, and
+// single verification, then batch verification at growing batch sizes
+// (per signature, against the single cost), and finally a full
+// intent/authorization/acceptance round between two OfflineEngines signing
+// with Ed25519SignatureProvider, with and without peer verification.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/ed25519.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using BenchClock = std::chrono::steady_clock;
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+
+double NsSince(BenchClock::time_point begin, std::size_t operations) {
+  return std::chrono::duration<double, std::nano>(BenchClock::now() - begin).count() /
+         static_cast<double>(operations);
+}
+
+offline_wallet::Ed25519Seed SeedFor(std::size_t n) {
+  offline_wallet::Ed25519Seed seed{};
+  for (int byte = 0; byte < 8; ++byte) {
+    seed[static_cast<std::size_t>(byte)] = static_cast<std::uint8_t>(n >> (8 * byte));
+  }
+  seed[31] = 0xA5;
+  return seed;
+}
+
+// A handshake-sized message: the fields the engine signs for an intent.
+std::string MessageFor(std::size_t n) {
+  return "tx-" + std::to_string(n) + "|mi-" + std::to_string(n) + "|500|CNY|mn-" + std::to_string(n) +
+         "|1|1700000030";
+}
+
+double HandshakeNs(std::size_t iterations, bool verify) {
+  offline_wallet::Ed25519SignatureProvider merchant_signer;
+  offline_wallet::Ed25519SignatureProvider payer_signer;
+  merchant_signer.AddSigningKey("m-key", SeedFor(1));
+  payer_signer.AddSigningKey("p-key", SeedFor(2));
+  offline_wallet::Ed25519PublicKey key;
+  merchant_signer.FindPublicKey("m-key", &key);
+  payer_signer.AddPublicKey("merchant-device-1", key);
+  payer_signer.FindPublicKey("p-key", &key);
+  merchant_signer.AddPublicKey("payer-device-1", key);
+  ManualClock clock;
+  CounterRandomProvider random;
+  TestJournal merchant_journal;
+  TestJournal payer_journal;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &merchant_signer, &random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &payer_signer, &random, &clock,
+                                             &payer_journal);
+  merchant_engine.SetVerifyPeerSignatures(verify);
+  payer_engine.SetVerifyPeerSignatures(verify);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 1};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 1};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  const auto begin = BenchClock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    if (merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx).status !=
+            offline_wallet::HandshakeStatus::kOk ||
+        payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx).status !=
+            offline_wallet::HandshakeStatus::kOk ||
+        merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx).status !=
+            offline_wallet::HandshakeStatus::kOk) {
+      std::fprintf(stderr, "handshake failed\n");
+      std::exit(1);
+    }
+  }
+  return NsSince(begin, iterations);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t iterations = 200;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      std::fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (iterations == 0) {
+    std::fprintf(stderr, "iterations must be positive\n");
+    return 2;
+  }
+
+  auto begin = BenchClock::now();
+  offline_wallet::Ed25519Precompute();
+  std::printf("%-24s %12.0f ns (once)\n", "fixed_base_table", NsSince(begin, 1));
+
+  constexpr std::size_t kMaxBatch = 256;
+  std::vector<offline_wallet::Ed25519SigningKey> keys(kMaxBatch);
+  std::vector<std::string> messages(kMaxBatch);
+  std::vector<offline_wallet::Ed25519Signature> signatures(kMaxBatch);
+  begin = BenchClock::now();
+  for (std::size_t i = 0; i < kMaxBatch; ++i) {
+    offline_wallet::Ed25519ExpandSeed(SeedFor(i), &keys[i]);
+  }
+  std::printf("%-24s %12.0f ns\n", "expand_seed", NsSince(begin, kMaxBatch));
+
+  for (std::size_t i = 0; i < kMaxBatch; ++i) {
+    messages[i] = MessageFor(i);
+  }
+  begin = BenchClock::now();
+  for (std::size_t round = 0; round < iterations; ++round) {
+    const std::size_t i = round % kMaxBatch;
+    offline_wallet::Ed25519Sign(keys[i], messages[i].data(), messages[i].size(), &signatures[i]);
+  }
+  std::printf("%-24s %12.0f ns\n", "sign", NsSince(begin, iterations));
+  for (std::size_t i = 0; i < kMaxBatch; ++i) {
+    offline_wallet::Ed25519Sign(keys[i], messages[i].data(), messages[i].size(), &signatures[i]);
+  }
+
+  std::size_t valid = 0;
+  begin = BenchClock::now();
+  for (std::size_t round = 0; round < iterations; ++round) {
+    const std::size_t i = round % kMaxBatch;
+    valid += offline_wallet::Ed25519Verify(keys[i].public_key, messages[i].data(), messages[i].size(),
+                                           signatures[i]);
+  }
+  const double single_ns = NsSince(begin, iterations);
+  std::printf("%-24s %12.0f ns\n", "verify", single_ns);
+  if (valid != iterations) {
+    std::fprintf(stderr, "verification failed\n");
+    return 1;
+  }
+
+  std::vector<offline_wallet::Ed25519BatchItem> items(kMaxBatch);
+  for (std::size_t i = 0; i < kMaxBatch; ++i) {
+    items[i] = {&keys[i].public_key, messages[i].data(), messages[i].size(), &signatures[i]};
+  }
+  std::printf("\n%6s %16s %10s\n", "batch", "ns_per_sig", "speedup");
+  for (std::size_t batch = 1; batch <= kMaxBatch; batch *= 4) {
+    const std::size_t rounds = std::max<std::size_t>(1, iterations / batch);
+    begin = BenchClock::now();
+    for (std::size_t round = 0; round < rounds; ++round) {
+      if (!offline_wallet::Ed25519VerifyBatch(items.data(), batch, nullptr)) {
+        std::fprintf(stderr, "batch verification failed\n");
+        return 1;
+      }
+    }
+    const double per_signature = NsSince(begin, rounds * batch);
+    std::printf("%6zu %16.0f %9.2fx\n", batch, per_signature, single_ns / per_signature);
+  }
+
+  // Three signatures per round either way; verification adds two checks.
+  const std::size_t handshakes = std::max<std::size_t>(1, iterations / 4);
+  const double plain_ns = HandshakeNs(handshakes, false);
+  const double verified_ns = HandshakeNs(handshakes, true);
+  std::printf("\n%-24s %12.0f ns\n%-24s %12.0f ns\n", "handshake_sign_only", plain_ns, "handshake_verified",
+              verified_ns);
+  return 0;
+}
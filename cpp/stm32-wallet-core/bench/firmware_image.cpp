@@ -0,0 +1,201 @@
+// Minimal firmware-style image running the heap-free handshake, built twice
+// with -fno-exceptions -fno-rtti: once over the virtual provider interfaces
+// (FixedOfflineEngine) and once with OFFLINE_WALLET_STATIC_DISPATCH=1 over
+// concrete providers (StaticOfflineEngine with a StaticRiskPolicy). Compare
+// the two executables with `size`, and the cycles per handshake they print.
+//
+// Cycles come from rdtsc on x86-64 (-1 on other hosts); on target read
+// DWT->CYCCNT around the same loop instead.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "offline_wallet/byte_codec.hpp"
+#include "offline_wallet/fixed_offline_engine.hpp"
+#include "offline_wallet/static_offline_engine.hpp"
+
+#ifndef OFFLINE_WALLET_STATIC_DISPATCH
+#define OFFLINE_WALLET_STATIC_DISPATCH 0
+#endif
+
+namespace {
+
+constexpr std::uint64_t kNow = 1'700'000'000;
+constexpr int kWarmupRounds = 1'000;
+constexpr int kRounds = 100'000;
+
+#if OFFLINE_WALLET_STATIC_DISPATCH
+#define OFFLINE_WALLET_OVERRIDE
+struct SignerBase {};
+struct RandomBase {};
+struct ClockBase {};
+struct JournalBase {};
+#else
+#define OFFLINE_WALLET_OVERRIDE override
+using SignerBase = offline_wallet::FixedSignatureProvider;
+using RandomBase = offline_wallet::FixedRandomProvider;
+using ClockBase = offline_wallet::ClockProvider;
+using JournalBase = offline_wallet::FixedTransactionJournal;
+#endif
+
+// FNV-1a keyed digest standing in for the device's signing primitive.
+class Signer final : public SignerBase {
+ public:
+  bool Sign(const char* message,
+            std::size_t message_size,
+            const offline_wallet::FixedKeyId& key_id,
+            offline_wallet::FixedSignature* signature_out) OFFLINE_WALLET_OVERRIDE {
+    char digest[16];
+    Digest(key_id, message, message_size, digest);
+    return signature_out->Assign(digest, sizeof(digest));
+  }
+
+  bool Verify(const offline_wallet::FixedSignature& signature,
+              const char* message,
+              std::size_t message_size,
+              const offline_wallet::FixedKeyId& public_key_or_id) OFFLINE_WALLET_OVERRIDE {
+    char digest[16];
+    Digest(public_key_or_id, message, message_size, digest);
+    return signature.Equals(digest, sizeof(digest));
+  }
+
+ private:
+  static void Digest(const offline_wallet::FixedKeyId& key, const char* message, std::size_t size, char out[16]) {
+    constexpr char kHex[] = "0123456789abcdef";
+    std::uint64_t hash = offline_wallet::Fnv1a(message, size, offline_wallet::Fnv1a(key.data(), key.size()));
+    for (int i = 15; i >= 0; --i) {
+      out[i] = kHex[hash & 0x0F];
+      hash >>= 4;
+    }
+  }
+};
+
+class Random final : public RandomBase {
+ public:
+  bool Ready() OFFLINE_WALLET_OVERRIDE { return true; }
+
+  void NextBytes(std::uint8_t* out, std::size_t size) OFFLINE_WALLET_OVERRIDE {
+    for (std::size_t i = 0; i < size; ++i) {
+      state_ = state_ * 1664525u + 1013904223u;
+      out[i] = static_cast<std::uint8_t>(state_ >> 24);
+    }
+  }
+
+ private:
+  std::uint32_t state_ = 1;
+};
+
+class Clock final : public ClockBase {
+ public:
+  std::uint64_t NowUnixSeconds() const OFFLINE_WALLET_OVERRIDE { return kNow; }
+};
+
+// Keeps only the latest transaction, like a RAM staging slot in front of flash.
+class Journal final : public JournalBase {
+ public:
+  bool Save(const offline_wallet::FixedLocalTransaction& tx) OFFLINE_WALLET_OVERRIDE {
+    slot_ = tx;
+    return true;
+  }
+
+  bool Load(const offline_wallet::FixedId& tx_id,
+            offline_wallet::FixedLocalTransaction* tx_out) const OFFLINE_WALLET_OVERRIDE {
+    if (!(slot_.tx_id == tx_id)) {
+      return false;
+    }
+    *tx_out = slot_;
+    return true;
+  }
+
+  bool UpdateState(const offline_wallet::FixedId& tx_id,
+                   offline_wallet::TransactionState state,
+                   const offline_wallet::FixedReason& reason) OFFLINE_WALLET_OVERRIDE {
+    if (!(slot_.tx_id == tx_id)) {
+      return false;
+    }
+    slot_.state = state;
+    slot_.failure_reason = reason;
+    return true;
+  }
+
+ private:
+  offline_wallet::FixedLocalTransaction slot_;
+};
+
+#if OFFLINE_WALLET_STATIC_DISPATCH
+using Policy = offline_wallet::StaticRiskPolicy<50'000>;
+using Engine = offline_wallet::StaticOfflineEngine<Signer, Random, Clock, Journal, Policy>;
+constexpr const char* kVariant = "static";
+#else
+using Policy = offline_wallet::RiskPolicy;
+using Engine = offline_wallet::FixedOfflineEngine;
+constexpr const char* kVariant = "virtual";
+#endif
+
+Signer g_signer;
+Random g_random;
+Clock g_clock;
+Journal g_journal;
+offline_wallet::FixedPaymentIntent g_intent;
+offline_wallet::FixedPaymentAuthorization g_authorization;
+offline_wallet::FixedPaymentReceipt g_receipt;
+offline_wallet::FixedLocalTransaction g_tx;
+
+std::uint64_t ReadCycles() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+bool RunHandshake(Engine* engine,
+                  const offline_wallet::FixedDeviceContext& merchant,
+                  const offline_wallet::FixedDeviceContext& payer) {
+  return engine->BuildMerchantIntent(merchant, 1'250, "CNY", &g_intent, &g_tx).status ==
+             offline_wallet::HandshakeStatus::kOk &&
+         engine->BuildPayerAuthorization(payer, g_intent, &g_authorization, &g_tx).status ==
+             offline_wallet::HandshakeStatus::kOk &&
+         engine->AcceptAuthorization(merchant, g_authorization, &g_receipt, &g_tx).status ==
+             offline_wallet::HandshakeStatus::kOk;
+}
+
+}  // namespace
+
+int main() {
+  Engine engine(Policy{}, &g_signer, &g_random, &g_clock, &g_journal);
+  offline_wallet::FixedDeviceContext merchant;
+  merchant.account_id = "merchant-1";
+  merchant.device_id = "merchant-device-1";
+  merchant.signing_key_id = "merchant-key";
+  offline_wallet::FixedDeviceContext payer;
+  payer.account_id = "payer-1";
+  payer.device_id = "payer-device-1";
+  payer.signing_key_id = "payer-key";
+
+  for (int i = 0; i < kWarmupRounds; ++i) {
+    if (!RunHandshake(&engine, merchant, payer)) {
+      return 1;
+    }
+  }
+  const auto begin = std::chrono::steady_clock::now();
+  const std::uint64_t begin_cycles = ReadCycles();
+  for (int i = 0; i < kRounds; ++i) {
+    if (!RunHandshake(&engine, merchant, payer)) {
+      return 1;
+    }
+  }
+  const std::uint64_t cycles = ReadCycles() - begin_cycles;
+  const double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+
+  std::printf("%-8s %12s %18s\n", "variant", "ns_per_round", "cycles_per_round");
+  std::printf("%-8s %12.1f %18.0f\n", kVariant, nanos / kRounds,
+              cycles != 0 ? static_cast<double>(cycles) / kRounds : -1.0);
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Decode time per camera frame for an authorization-sized symbol (ECC M),
+// upright and rotated, at QVGA and VGA. Frames are rendered once up front
+// with light noise and the decoder is reused, as in a camera loop.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "offline_wallet/qr_decoder.hpp"
+#include "offline_wallet/qr_encoder.hpp"
+
+namespace {
+
+offline_wallet::QrEncoder g_encoder;
+std::uint8_t g_bitmap[offline_wallet::kQrMaxBitmapBytes];
+std::uint8_t g_payload[offline_wallet::kQrMaxCodewords];
+
+// Nearest-module rendering of the symbol centred in the frame.
+std::vector<std::uint8_t> RenderFrame(const offline_wallet::QrSymbolInfo& info,
+                                      int width,
+                                      int height,
+                                      double module_pixels,
+                                      double angle_degrees) {
+  const double radians = angle_degrees * 3.14159265358979323846 / 180.0;
+  const double c = std::cos(radians);
+  const double s = std::sin(radians);
+  std::vector<std::uint8_t> pixels(static_cast<std::size_t>(width) * static_cast<std::size_t>(height));
+  std::uint32_t seed = 1;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const double dx = x + 0.5 - width / 2.0;
+      const double dy = y + 0.5 - height / 2.0;
+      const double mx = (c * dx + s * dy) / module_pixels + info.size / 2.0;
+      const double my = (-s * dx + c * dy) / module_pixels + info.size / 2.0;
+      const bool dark = mx >= 0 && my >= 0 && mx < info.size && my < info.size &&
+                        offline_wallet::QrBitmapModule(
+                            g_bitmap, info.stride, static_cast<int>(mx), static_cast<int>(my));
+      seed = seed * 1664525u + 1013904223u;
+      pixels[static_cast<std::size_t>(y) * width + x] =
+          static_cast<std::uint8_t>((dark ? 40 : 200) + static_cast<int>(seed >> 28));
+    }
+  }
+  return pixels;
+}
+
+double MillisPerDecode(offline_wallet::QrDecoder* decoder,
+                       const offline_wallet::QrFrame& frame,
+                       int iterations) {
+  const auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    std::size_t size = 0;
+    if (decoder->Decode(frame, g_payload, sizeof(g_payload), &size) != offline_wallet::QrDecodeStatus::kOk) {
+      return -1;
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+}  // namespace
+
+int main() {
+  // About the size of a wire-encoded PaymentAuthorization with UUID ids.
+  std::vector<std::uint8_t> payload(160);
+  std::uint32_t seed = 7;
+  for (auto& byte : payload) {
+    seed = seed * 1664525u + 1013904223u;
+    byte = static_cast<std::uint8_t>(seed >> 24);
+  }
+  offline_wallet::QrSymbolInfo info;
+  if (g_encoder.Encode(payload.data(), payload.size(), offline_wallet::QrEncodeOptions{}, g_bitmap,
+                       sizeof(g_bitmap), &info) != offline_wallet::QrStatus::kOk) {
+    return 1;
+  }
+
+  offline_wallet::QrDecoder decoder;
+  std::printf("%10s %8s %8s %12s %10s\n", "frame", "version", "angle", "ms_per_frame", "fps");
+  struct Case {
+    int width;
+    int height;
+    double module_pixels;
+  };
+  for (const Case& frame_case : {Case{320, 240, 3.0}, Case{640, 480, 5.0}}) {
+    for (double angle : {0.0, 30.0}) {
+      const std::vector<std::uint8_t> pixels =
+          RenderFrame(info, frame_case.width, frame_case.height, frame_case.module_pixels, angle);
+      const offline_wallet::QrFrame frame{pixels.data(), frame_case.width, frame_case.height,
+                                          static_cast<std::size_t>(frame_case.width)};
+      const double millis = MillisPerDecode(&decoder, frame, 200);
+      if (millis < 0) {
+        return 1;
+      }
+      std::printf("%6dx%-3d %8d %8.0f %12.3f %10.0f\n",
+                  frame_case.width,
+                  frame_case.height,
+                  info.version,
+                  angle,
+                  millis,
+                  1000.0 / millis);
+    }
+  }
+  return 0;
+}
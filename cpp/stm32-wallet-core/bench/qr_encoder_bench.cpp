@@ -0,0 +1,62 @@
+// Encode time per QR version at ECC level M with a payload filling the
+// symbol, with automatic mask selection (all eight masks scored) and with a
+// forced mask, which isolates the cost of the penalty evaluator.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "offline_wallet/qr_encoder.hpp"
+
+namespace {
+
+offline_wallet::QrEncoder g_encoder;  // static storage, as on the device
+std::uint8_t g_bitmap[offline_wallet::kQrMaxBitmapBytes];
+
+double MicrosPerEncode(const std::vector<std::uint8_t>& payload,
+                       const offline_wallet::QrEncodeOptions& options,
+                       int iterations) {
+  const auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    if (g_encoder.Encode(payload.data(), payload.size(), options, g_bitmap, sizeof(g_bitmap)) !=
+        offline_wallet::QrStatus::kOk) {
+      return -1;
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+}  // namespace
+
+int main() {
+  std::printf("%8s %6s %14s %14s %14s\n", "version", "size", "payload_bytes", "us_auto_mask",
+              "us_fixed_mask");
+  for (int version = 1; version <= offline_wallet::kQrMaxVersion; ++version) {
+    std::vector<std::uint8_t> payload(
+        offline_wallet::QrByteCapacity(version, offline_wallet::QrEcc::kMedium));
+    std::uint32_t seed = static_cast<std::uint32_t>(version);
+    for (auto& byte : payload) {
+      seed = seed * 1664525u + 1013904223u;
+      byte = static_cast<std::uint8_t>(seed >> 24);
+    }
+    offline_wallet::QrEncodeOptions options;
+    options.min_version = version;
+    options.max_version = version;
+    const int iterations = 40'000 / (version * version) + 20;
+    const double automatic = MicrosPerEncode(payload, options, iterations);
+    options.mask = 0;
+    const double fixed = MicrosPerEncode(payload, options, iterations);
+    if (automatic < 0 || fixed < 0) {
+      return 1;
+    }
+    std::printf("%8d %6d %14zu %14.1f %14.1f\n",
+                version,
+                offline_wallet::QrSymbolSize(version),
+                payload.size(),
+                automatic,
+                fixed);
+  }
+  return 0;
+}
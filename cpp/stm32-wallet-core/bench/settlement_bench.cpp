@@ -0,0 +1,179 @@
+// End-of-day report cost over a day of sales.
+//
+//   offline_wallet_settlement_bench [--rows N]
+//
+// Fills a FlashJournal wrapped in a SettlementIndex with N sales spread over
+// 24 hours, 500 payers and two currencies, then times the reports a shift
+// close prints: totals by state, by hour, by payer and by currency. The
+// baseline pulls every full record back out of the journal with ForEach()
+// and aggregates those; the index answers from its columns alone. Persist()
+// and Restore() against a SnapshotStore are timed too, since they bound the
+// idle-loop and boot cost of keeping the index.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/settlement_index.hpp"
+#include "offline_wallet/snapshot_store.hpp"
+
+namespace {
+
+using BenchClock = std::chrono::steady_clock;
+
+constexpr std::uint64_t kDayStart = 1'700'006'400;
+constexpr int kReps = 20;
+
+double MsSince(BenchClock::time_point begin, int reps) {
+  return std::chrono::duration<double, std::milli>(BenchClock::now() - begin).count() / reps;
+}
+
+// The same four reports, built from full records.
+class ReportVisitor : public offline_wallet::JournalVisitor {
+ public:
+  void Visit(const offline_wallet::LocalTransaction& tx) override {
+    if (tx.currency != "CNY") {
+      return;
+    }
+    const std::size_t state = static_cast<std::size_t>(tx.state);
+    by_state[state].amount_cents += tx.amount_cents;
+    ++by_state[state].count;
+    const std::size_t hour = tx.created_at_epoch_seconds / 3600 % 24;
+    by_hour[hour].amount_cents += tx.amount_cents;
+    ++by_hour[hour].count;
+    auto& payer = by_payer[std::string(tx.payer_account_id)];
+    payer.amount_cents += tx.amount_cents;
+    ++payer.count;
+  }
+
+  std::array<offline_wallet::SettlementTotals, offline_wallet::kTransactionStateCount> by_state{};
+  std::array<offline_wallet::SettlementTotals, 24> by_hour{};
+  std::map<std::string, offline_wallet::SettlementTotals> by_payer;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t rows = 50000;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+      rows = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      std::fprintf(stderr, "usage: %s [--rows N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (rows == 0) {
+    std::fprintf(stderr, "rows must be positive\n");
+    return 2;
+  }
+
+  // About 400 bytes a record on flash, with a quarter to spare.
+  const std::size_t sector_size = 64 * 1024;
+  offline_wallet::RamBlockDevice flash(sector_size, rows * 500 / sector_size + 8);
+  offline_wallet::FlashJournalOptions journal_options;
+  journal_options.max_records = rows;
+  offline_wallet::FlashJournal journal(&flash, journal_options);
+  offline_wallet::SettlementIndexOptions index_options;
+  index_options.max_rows = rows;
+  offline_wallet::SettlementIndex index(&journal, index_options);
+  if (!journal.Mount()) {
+    std::fprintf(stderr, "mount failed\n");
+    return 1;
+  }
+
+  offline_wallet::LocalTransaction tx;
+  tx.merchant_account_id = "merchant-1";
+  tx.merchant_device_id = "pos-1";
+  tx.payer_device_id = "phone";
+  tx.merchant_signature = std::string(128, 'm');
+  tx.payer_signature = std::string(128, 'p');
+  std::uint64_t state = 1;
+  for (std::size_t i = 0; i < rows; ++i) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    tx.tx_id = "tx-" + std::to_string(i);
+    tx.idempotency_key = "merchant-1:" + std::string(tx.tx_id);
+    tx.payer_account_id = "payer-" + std::to_string((state >> 33) % 500);
+    tx.currency = (state >> 20 & 15) == 0 ? "USD" : "CNY";
+    tx.amount_cents = static_cast<std::int64_t>(100 + (state >> 40 & 0xFFFF));
+    tx.state = (state >> 28 & 7) < 5 ? offline_wallet::TransactionState::kPendingSync
+                                     : offline_wallet::TransactionState::kSynced;
+    tx.created_at_epoch_seconds = kDayStart + i * 86400 / rows;
+    if (!index.Save(tx)) {
+      std::fprintf(stderr, "save failed at row %zu\n", i);
+      return 1;
+    }
+  }
+
+  offline_wallet::SettlementFilter filter;
+  filter.currency = "CNY";
+  std::printf("%-24s %10zu\n", "rows", index.stats().rows);
+
+  std::int64_t checksum = 0;
+  auto begin = BenchClock::now();
+  for (int rep = 0; rep < kReps; ++rep) {
+    ReportVisitor visitor;
+    journal.ForEach(&visitor);
+    checksum += visitor.by_state[0].amount_cents + static_cast<std::int64_t>(visitor.by_payer.size());
+  }
+  std::printf("%-24s %10.3f ms\n", "full_record_scan", MsSince(begin, kReps));
+
+  begin = BenchClock::now();
+  for (int rep = 0; rep < kReps; ++rep) {
+    checksum += index.Total(filter).amount_cents;
+  }
+  std::printf("%-24s %10.3f ms\n", "index_total", MsSince(begin, kReps));
+
+  begin = BenchClock::now();
+  for (int rep = 0; rep < kReps; ++rep) {
+    checksum += index.TotalsByState(filter)[0].amount_cents;
+  }
+  std::printf("%-24s %10.3f ms\n", "index_by_state", MsSince(begin, kReps));
+
+  begin = BenchClock::now();
+  for (int rep = 0; rep < kReps; ++rep) {
+    checksum += index.TotalsByHour(filter)[12].amount_cents;
+  }
+  std::printf("%-24s %10.3f ms\n", "index_by_hour", MsSince(begin, kReps));
+
+  std::vector<offline_wallet::SettlementGroup> groups;
+  begin = BenchClock::now();
+  for (int rep = 0; rep < kReps; ++rep) {
+    index.TotalsByPayer(filter, &groups);
+    checksum += static_cast<std::int64_t>(groups.size());
+  }
+  std::printf("%-24s %10.3f ms\n", "index_by_payer", MsSince(begin, kReps));
+
+  offline_wallet::SettlementFilter all_currencies;
+  begin = BenchClock::now();
+  for (int rep = 0; rep < kReps; ++rep) {
+    index.TotalsByCurrency(all_currencies, &groups);
+    checksum += static_cast<std::int64_t>(groups.size());
+  }
+  std::printf("%-24s %10.3f ms\n", "index_by_currency", MsSince(begin, kReps));
+
+  offline_wallet::RamBlockDevice snapshot_flash(sector_size, 2 * (rows * 32 / sector_size + 1));
+  offline_wallet::SnapshotStore store(&snapshot_flash);
+  begin = BenchClock::now();
+  if (!index.Persist(&store)) {
+    std::fprintf(stderr, "persist failed\n");
+    return 1;
+  }
+  std::printf("\n%-24s %10.3f ms\n", "persist", MsSince(begin, 1));
+  begin = BenchClock::now();
+  if (!index.Restore(store)) {
+    std::fprintf(stderr, "restore failed\n");
+    return 1;
+  }
+  std::printf("%-24s %10.3f ms\n", "restore", MsSince(begin, 1));
+  std::printf("%-24s %10zu\n", "checksum", static_cast<std::size_t>(checksum) % 1000);
+  return 0;
+}
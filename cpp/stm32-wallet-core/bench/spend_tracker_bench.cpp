@@ -0,0 +1,47 @@
+// Cost of one daily-limit check (SpendInWindow + Add) as payment history grows.
+// A journal scan would grow linearly; the tracker should stay flat.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/spend_tracker.hpp"
+
+namespace {
+
+constexpr std::uint64_t kStart = 1'700'000'000;
+constexpr int kPayers = 100;
+constexpr int kChecks = 200'000;
+
+}  // namespace
+
+int main() {
+  std::vector<std::string> payers;
+  for (int payer = 0; payer < kPayers; ++payer) {
+    payers.push_back("payer-" + std::to_string(payer));
+  }
+
+  std::printf("%12s %14s\n", "history", "ns_per_check");
+  std::int64_t sink = 0;
+  for (std::uint64_t history = 1'000; history <= 1'000'000; history *= 10) {
+    offline_wallet::SpendTracker tracker;
+    // One payment every 30 seconds, spread over the payers.
+    std::uint64_t now = kStart;
+    for (std::uint64_t i = 0; i < history; ++i, now += 30) {
+      tracker.Add(payers[i % kPayers], 100, now, now);
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < kChecks; ++i, now += 30) {
+      const std::string& payer = payers[static_cast<std::size_t>(i) % kPayers];
+      sink += tracker.SpendInWindow(payer, now);
+      tracker.Add(payer, 100, now, now);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - begin;
+    const double ns = std::chrono::duration<double, std::nano>(elapsed).count() / kChecks;
+    std::printf("%12llu %14.1f\n", static_cast<unsigned long long>(history), ns);
+  }
+  return sink == 0 ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+// Cost per acknowledged transaction when backend sync results are applied with
+// one UpdateState() per row versus one UpdateStates() per result set. On flash
+// the syncs dominate (each waits out a program cycle), so they are counted
+// alongside host time and programmed bytes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/flash_journal.hpp"
+
+namespace {
+
+constexpr int kAcks = 512;
+
+struct Cost {
+  double ns = 0;
+  double syncs = 0;
+  double bytes = 0;
+};
+
+Cost Run(std::size_t batch, bool bulk) {
+  offline_wallet::RamBlockDevice ram(4096, 96);
+  offline_wallet::FaultInjectingBlockDevice device(&ram);  // Never armed; counts bytes.
+  offline_wallet::FlashJournal journal(&device);
+  if (!journal.Mount()) {
+    return {};
+  }
+  std::vector<offline_wallet::StateUpdate> updates;
+  for (int i = 0; i < kAcks; ++i) {
+    offline_wallet::LocalTransaction tx;
+    tx.tx_id = "tx-" + std::to_string(i);
+    tx.idempotency_key = "merchant-1:" + std::string(tx.tx_id);
+    tx.merchant_account_id = "merchant-1";
+    tx.payer_account_id = "payer-1";
+    tx.amount_cents = 500;
+    tx.currency = "CNY";
+    tx.merchant_signature = std::string(64, 'm');
+    tx.payer_signature = std::string(64, 'p');
+    tx.state = offline_wallet::TransactionState::kPendingSync;
+    journal.Save(tx);
+    updates.push_back({std::string(tx.tx_id), offline_wallet::TransactionState::kSynced, ""});
+  }
+
+  const std::uint64_t syncs = ram.sync_calls();
+  const std::uint64_t bytes = device.bytes_written();
+  const auto begin = std::chrono::steady_clock::now();
+  for (std::size_t first = 0; first < updates.size(); first += batch) {
+    const std::size_t count = std::min(batch, updates.size() - first);
+    if (bulk) {
+      journal.UpdateStates(updates.data() + first, count);
+    } else {
+      for (std::size_t i = first; i < first + count; ++i) {
+        journal.UpdateState(updates[i].tx_id, updates[i].state, updates[i].reason);
+      }
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+
+  Cost cost;
+  cost.ns = std::chrono::duration<double, std::nano>(elapsed).count() / kAcks;
+  cost.syncs = static_cast<double>(ram.sync_calls() - syncs) / kAcks;
+  cost.bytes = static_cast<double>(device.bytes_written() - bytes) / kAcks;
+  return cost;
+}
+
+}  // namespace
+
+int main() {
+  std::printf("%6s %14s %14s %14s %14s %14s %14s\n", "batch", "each_ns", "each_syncs", "each_bytes",
+              "bulk_ns", "bulk_syncs", "bulk_bytes");
+  for (std::size_t batch = 1; batch <= 256; batch *= 4) {
+    const Cost each = Run(batch, false);
+    const Cost bulk = Run(batch, true);
+    std::printf("%6zu %14.1f %14.3f %14.1f %14.1f %14.3f %14.1f\n", batch, each.ns, each.syncs, each.bytes,
+                bulk.ns, bulk.syncs, bulk.bytes);
+  }
+  return 0;
+}
@@ -0,0 +1,223 @@
+// Replays sync uploads through BatchValidator and prints the backend's answer
+// for every transaction, one JSON object per line, in upload order.
+//
+//   offline_wallet_batch_validate --registry FILE [--threads N] [--now ISO] [--binary] [UPLOADS]
+//
+// UPLOADS (stdin when absent) holds OfflineSyncInput documents, one per line,
+// or with --binary the wire format of ParseSyncUploadsBinary(). The registry
+// lists what the backend already knows, one entry per line:
+//
+//   account <account_id> <available_cents> [frozen] [no_wallet]
+//   device <device_id> <account_id> <public_key> <last_sync_at ISO> [inactive]
+//
+// Signatures are checked the way the backend's BasicSignatureVerifier does
+// until the platform verifier is wired in.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "offline_wallet/batch_input.hpp"
+#include "offline_wallet/batch_validator.hpp"
+#include "offline_wallet/iso_time.hpp"
+
+namespace {
+
+// Mirrors the backend's placeholder: accepts any plausible-looking signature.
+class BasicSignatureVerifier : public offline_wallet::SignatureProvider {
+ public:
+  std::string Sign(const std::string& /*message*/, const std::string& /*key_id*/) override { return {}; }
+
+  bool Verify(const std::string& signature,
+              const std::string& message,
+              const std::string& public_key_or_id) override {
+    return public_key_or_id.size() > 16 && signature.size() > 16 && message.size() > 8;
+  }
+};
+
+class BasicVerifierFactory : public offline_wallet::BatchVerifierFactory {
+ public:
+  std::unique_ptr<offline_wallet::SignatureProvider> Create(std::size_t /*worker*/) override {
+    return std::make_unique<BasicSignatureVerifier>();
+  }
+};
+
+bool LoadRegistry(const char* path, offline_wallet::BatchValidator* validator) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "cannot open " << path << "\n";
+    return false;
+  }
+  std::string line;
+  for (std::size_t number = 1; std::getline(in, line); ++number) {
+    std::istringstream fields(line);
+    std::string kind;
+    if (!(fields >> kind) || kind[0] == '#') {
+      continue;
+    }
+    std::string id;
+    std::string flag;
+    if (kind == "account") {
+      offline_wallet::BatchAccount account;
+      if (fields >> id >> account.available_cents) {
+        while (fields >> flag) {
+          account.active = account.active && flag != "frozen";
+          account.wallet = account.wallet && flag != "no_wallet";
+        }
+        validator->AddAccount(id, account);
+        continue;
+      }
+    } else if (kind == "device") {
+      offline_wallet::BatchDevice device;
+      std::string last_sync;
+      if (fields >> id >> device.account_id >> device.public_key >> last_sync &&
+          offline_wallet::ParseIsoTimestamp(last_sync, &device.last_sync_at_epoch_seconds)) {
+        while (fields >> flag) {
+          device.active = device.active && flag != "inactive";
+        }
+        validator->AddDevice(id, device);
+        continue;
+      }
+    }
+    std::cerr << path << ":" << number << ": bad registry entry\n";
+    return false;
+  }
+  return true;
+}
+
+bool LoadUploads(std::istream& in,
+                 bool binary,
+                 std::vector<offline_wallet::SyncBatch>* batches,
+                 std::vector<offline_wallet::BatchTransaction>* transactions) {
+  if (binary) {
+    const std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!offline_wallet::ParseSyncUploadsBinary(data.data(), data.size(), batches, transactions)) {
+      std::cerr << "malformed binary uploads\n";
+      return false;
+    }
+    return true;
+  }
+  std::string line;
+  for (std::size_t number = 1; std::getline(in, line); ++number) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    if (!offline_wallet::ParseSyncUploadJson(line, batches, transactions)) {
+      std::cerr << "upload " << number << ": malformed OfflineSyncInput\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+void PrintJsonString(const std::string& value) {
+  std::cout << '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      std::cout << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      static constexpr char kHex[] = "0123456789abcdef";
+      std::cout << "\\u00" << kHex[c >> 4] << kHex[c & 0x0F];
+    } else {
+      std::cout << c;
+    }
+  }
+  std::cout << '"';
+}
+
+const char* StatusName(offline_wallet::SyncResultStatus status) {
+  switch (status) {
+    case offline_wallet::SyncResultStatus::kAccepted:
+      return "accepted";
+    case offline_wallet::SyncResultStatus::kRejected:
+      return "rejected";
+    case offline_wallet::SyncResultStatus::kDuplicate:
+      return "duplicate";
+  }
+  return "rejected";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* registry = nullptr;
+  const char* uploads = nullptr;
+  std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::uint64_t now = static_cast<std::uint64_t>(std::time(nullptr));
+  bool binary = false;
+  bool usage = false;
+  for (int i = 1; i < argc && !usage; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--binary") == 0) {
+      binary = true;
+    } else if (std::strcmp(argv[i], "--registry") == 0 && has_value) {
+      registry = argv[++i];
+    } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+      threads = std::strtoull(argv[++i], nullptr, 10);
+      usage = threads == 0;
+    } else if (std::strcmp(argv[i], "--now") == 0 && has_value) {
+      usage = !offline_wallet::ParseIsoTimestamp(argv[++i], &now);
+    } else if (argv[i][0] != '-' && uploads == nullptr) {
+      uploads = argv[i];
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || registry == nullptr) {
+    std::cerr << "usage: " << argv[0] << " --registry FILE [--threads N] [--now ISO] [--binary] [UPLOADS]\n";
+    return 2;
+  }
+
+  BasicVerifierFactory factory;
+  offline_wallet::BatchValidator validator(offline_wallet::BatchPolicy{}, threads, &factory);
+  if (!LoadRegistry(registry, &validator)) {
+    return 2;
+  }
+  std::vector<offline_wallet::SyncBatch> batches;
+  std::vector<offline_wallet::BatchTransaction> transactions;
+  std::ifstream file;
+  if (uploads != nullptr) {
+    file.open(uploads, binary ? std::ios::binary : std::ios::in);
+    if (!file) {
+      std::cerr << "cannot open " << uploads << "\n";
+      return 2;
+    }
+  }
+  if (!LoadUploads(uploads != nullptr ? file : std::cin, binary, &batches, &transactions)) {
+    return 1;
+  }
+
+  std::vector<offline_wallet::SyncResult> results;
+  results.reserve(transactions.size());
+  const auto start = std::chrono::steady_clock::now();
+  validator.Validate(batches, transactions, now, &results);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::size_t counts[3] = {};
+  for (const offline_wallet::SyncResult& result : results) {
+    ++counts[static_cast<int>(result.status)];
+    std::cout << "{\"txId\":";
+    PrintJsonString(result.tx_id);
+    std::cout << ",\"status\":\"" << StatusName(result.status) << '"';
+    if (!result.reason.empty()) {
+      std::cout << ",\"reason\":";
+      PrintJsonString(result.reason);
+    }
+    std::cout << "}\n";
+  }
+  std::cerr << batches.size() << " uploads, " << results.size() << " transactions on " << validator.worker_count()
+            << " threads in " << seconds * 1'000 << " ms: " << counts[0] << " accepted, " << counts[1]
+            << " rejected, " << counts[2] << " duplicate\n";
+  return 0;
+}
@@ -0,0 +1,271 @@
+// Multi-lane checkout hub soak: full offline handshakes on 1, 2, 4, ... threads
+// against one sharded merchant journal, reporting throughput per thread count.
+//
+//   offline_wallet_hub_soak [--handshakes N] [--shards N] [--max-threads N]
+//
+// Each thread owns one MultiLaneEngine lane on the merchant hub and one on the
+// payer side. Afterwards every journal row is checked; a lost or torn record
+// fails the run.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "offline_wallet/multi_lane_engine.hpp"
+#include "offline_wallet/sharded_journal.hpp"
+
+namespace {
+
+// Streams the message through a few FNV-1a rounds; a stand-in whose cost is
+// linear in the message, like a real hash-then-sign provider.
+class DemoStreamingSigner : public offline_wallet::StreamingSignatureProvider {
+ public:
+  void BeginSign(const std::string& key_id) override { Reset(key_id); }
+  void BeginVerify(const std::string& public_key_or_id) override { Reset(public_key_or_id); }
+
+  void Update(const char* data, std::size_t size) override {
+    for (int round = 0; round < 8; ++round) {
+      for (std::size_t i = 0; i < size; ++i) {
+        hash_ = (hash_ ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+      }
+    }
+  }
+
+  void FinishSign(std::string* signature_out) override { *signature_out = std::to_string(hash_); }
+  bool FinishVerify(const std::string& signature) override { return signature == std::to_string(hash_); }
+
+ private:
+  void Reset(const std::string& key) {
+    hash_ = 1469598103934665603ULL;
+    Update(key.data(), key.size());
+  }
+
+  std::uint64_t hash_ = 0;
+};
+
+class DemoRandomProvider : public offline_wallet::RandomProvider {
+ public:
+  explicit DemoRandomProvider(std::uint64_t seed) : state_(seed) {}
+
+  std::string NextHex(std::size_t bytes) override {
+    static constexpr char kHex[] = "0123456789abcdef";
+    std::string out(bytes * 2, '0');
+    for (char& c : out) {
+      state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+      c = kHex[(state_ >> 59) & 0x0F];
+    }
+    return out;
+  }
+
+ private:
+  std::uint64_t state_;
+};
+
+class DemoProviderFactory : public offline_wallet::LaneProviderFactory {
+ public:
+  explicit DemoProviderFactory(std::uint64_t seed) : seed_(seed) {}
+
+  offline_wallet::LaneProviders Create(std::size_t lane) override {
+    offline_wallet::LaneProviders providers;
+    providers.streaming_signer = std::make_unique<DemoStreamingSigner>();
+    providers.random = std::make_unique<DemoRandomProvider>(seed_ ^ (0x9E3779B97F4A7C15ULL * (lane + 1)));
+    return providers;
+  }
+
+ private:
+  std::uint64_t seed_;
+};
+
+class DemoClockProvider : public offline_wallet::ClockProvider {
+ public:
+  std::uint64_t NowUnixSeconds() const override { return 1'700'000'000; }
+};
+
+class InMemoryJournal : public offline_wallet::TransactionJournal {
+ public:
+  bool Save(const offline_wallet::LocalTransaction& tx) override {
+    rows_[tx.tx_id] = tx;
+    return true;
+  }
+
+  bool Load(const std::string& tx_id, offline_wallet::LocalTransaction* tx_out) const override {
+    auto it = rows_.find(tx_id);
+    if (it == rows_.end() || tx_out == nullptr) {
+      return false;
+    }
+    *tx_out = it->second;
+    return true;
+  }
+
+  bool UpdateState(const std::string& tx_id,
+                   offline_wallet::TransactionState state,
+                   const std::string& reason) override {
+    auto it = rows_.find(tx_id);
+    if (it == rows_.end()) {
+      return false;
+    }
+    it->second.state = state;
+    it->second.failure_reason = reason;
+    return true;
+  }
+
+  bool ForEach(offline_wallet::JournalVisitor* visitor) const override {
+    for (const auto& row : rows_) {
+      visitor->Visit(row.second);
+    }
+    return true;
+  }
+
+ private:
+  std::unordered_map<std::string, offline_wallet::LocalTransaction> rows_;
+};
+
+class RowChecker : public offline_wallet::JournalVisitor {
+ public:
+  void Visit(const offline_wallet::LocalTransaction& tx) override {
+    ++rows;
+    if (tx.state != offline_wallet::TransactionState::kPendingSync || tx.payer_authorization_id.empty() ||
+        std::string(tx.idempotency_key) != "merchant:" + std::string(tx.tx_id)) {
+      ++bad_rows;
+    }
+  }
+
+  std::size_t rows = 0;
+  std::size_t bad_rows = 0;
+};
+
+struct RunResult {
+  double seconds = 0;
+  std::size_t failures = 0;
+  std::size_t rows = 0;
+  std::size_t bad_rows = 0;
+};
+
+RunResult Run(std::size_t threads, std::size_t handshakes_per_thread, std::size_t shard_count) {
+  std::vector<std::unique_ptr<InMemoryJournal>> merchant_shards;
+  std::vector<std::unique_ptr<InMemoryJournal>> payer_shards;
+  std::vector<offline_wallet::TransactionJournal*> merchant_parts;
+  std::vector<offline_wallet::TransactionJournal*> payer_parts;
+  for (std::size_t i = 0; i < shard_count; ++i) {
+    merchant_shards.push_back(std::make_unique<InMemoryJournal>());
+    payer_shards.push_back(std::make_unique<InMemoryJournal>());
+    merchant_parts.push_back(merchant_shards.back().get());
+    payer_parts.push_back(payer_shards.back().get());
+  }
+  offline_wallet::ShardedJournal merchant_journal(merchant_parts);
+  offline_wallet::ShardedJournal payer_journal(payer_parts);
+  DemoClockProvider clock;
+  DemoProviderFactory merchant_factory(0x5EED0001);
+  DemoProviderFactory payer_factory(0x5EED0002);
+  const offline_wallet::RiskPolicy policy;
+  offline_wallet::MultiLaneEngine merchant_hub(policy, threads, &merchant_factory, &clock, &merchant_journal);
+  offline_wallet::MultiLaneEngine payer_hub(policy, threads, &payer_factory, &clock, &payer_journal);
+
+  std::vector<std::size_t> failures(threads, 0);
+  std::vector<std::thread> workers;
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      offline_wallet::DeviceContext merchant;
+      merchant.account_id = "merchant-account-1";
+      merchant.device_id = "lane-" + std::to_string(t);
+      merchant.signing_key_id = "merchant-key";
+      offline_wallet::DeviceContext payer;
+      payer.account_id = "payer-account-" + std::to_string(t);
+      payer.device_id = "payer-device-" + std::to_string(t);
+      payer.signing_key_id = "payer-key";
+      offline_wallet::OfflineEngine& merchant_engine = merchant_hub.lane(t);
+      offline_wallet::OfflineEngine& payer_engine = payer_hub.lane(t);
+      offline_wallet::PaymentIntent intent;
+      offline_wallet::PaymentAuthorization authorization;
+      offline_wallet::PaymentReceipt receipt;
+      offline_wallet::LocalTransaction tx;
+      for (std::size_t i = 0; i < handshakes_per_thread; ++i) {
+        const auto amount = static_cast<std::int32_t>(100 + i % 5'000);
+        if (merchant_engine.BuildMerchantIntent(merchant, amount, "CNY", &intent, &tx).status !=
+                offline_wallet::HandshakeStatus::kOk ||
+            payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx).status !=
+                offline_wallet::HandshakeStatus::kOk ||
+            merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx).status !=
+                offline_wallet::HandshakeStatus::kOk) {
+          ++failures[t];
+        }
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  RunResult result;
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for (std::size_t failed : failures) {
+    result.failures += failed;
+  }
+  RowChecker checker;
+  merchant_journal.ForEach(&checker);
+  result.rows = checker.rows;
+  result.bad_rows = checker.bad_rows;
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t handshakes = 20'000;
+  std::size_t shards = 64;
+  std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::size_t value = std::strtoull(argv[i + 1], nullptr, 10);
+    if (std::strcmp(argv[i], "--handshakes") == 0) {
+      handshakes = value;
+    } else if (std::strcmp(argv[i], "--shards") == 0) {
+      shards = value;
+    } else if (std::strcmp(argv[i], "--max-threads") == 0) {
+      max_threads = value;
+    } else {
+      std::cerr << "usage: " << argv[0] << " [--handshakes N] [--shards N] [--max-threads N]\n";
+      return 2;
+    }
+  }
+  if (handshakes == 0 || shards == 0 || max_threads == 0) {
+    std::cerr << "arguments must be positive\n";
+    return 2;
+  }
+
+  std::cout << "hardware threads: " << std::thread::hardware_concurrency() << ", shards: " << shards
+            << ", handshakes per thread: " << handshakes << "\n";
+  std::cout << "threads  handshakes/s  speedup  efficiency\n";
+  double single = 0;
+  for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+    const RunResult result = Run(threads, handshakes, shards);
+    const std::size_t expected = threads * handshakes;
+    if (result.failures != 0 || result.rows != expected || result.bad_rows != 0) {
+      std::cerr << "soak failed at " << threads << " threads: " << result.failures << " failed handshakes, "
+                << result.rows << "/" << expected << " rows, " << result.bad_rows << " bad rows\n";
+      return 1;
+    }
+    const double rate = static_cast<double>(expected) / result.seconds;
+    if (threads == 1) {
+      single = rate;
+    }
+    std::cout << std::setw(7) << threads << std::setw(14) << std::fixed << std::setprecision(0) << rate
+              << std::setw(8) << std::setprecision(2) << rate / single << "x" << std::setw(11)
+              << std::setprecision(0) << 100.0 * rate / single / static_cast<double>(threads) << "%\n";
+    if (threads == max_threads) {
+      break;
+    }
+    if (threads * 2 > max_threads) {
+      threads = max_threads / 2;  // Always finish on max_threads.
+    }
+  }
+  return 0;
+}
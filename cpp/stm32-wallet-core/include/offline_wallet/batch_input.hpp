@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/batch_validator.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+// Readers for the uploads BatchValidator replays. Each appends one SyncBatch
+// per upload, with its transactions, or appends nothing and returns false
+// when the input is malformed.
+
+// One OfflineSyncInput JSON document, as SyncExporter writes it and the
+// backend's sync endpoint takes it; a sync storm is one per NDJSON line.
+// Unknown keys are skipped. Timestamps must be ISO-8601 UTC ("...Z").
+bool ParseSyncUploadJson(std::string_view json,
+                         std::vector<SyncBatch>* batches,
+                         std::vector<BatchTransaction>* transactions);
+
+// Binary uploads, back to back, with the wire codec's varints:
+//
+//   [tx_count][submitted_at][device_id_size][merchant_device_id]
+//   tx_count x [record_size][EncodeLocalTransaction() record]
+//
+// The records carry the journal's sync tail; the digest then covers the
+// canonical ISO form of their timestamps.
+bool ParseSyncUploadsBinary(const std::uint8_t* data,
+                            std::size_t size,
+                            std::vector<SyncBatch>* batches,
+                            std::vector<BatchTransaction>* transactions);
+bool AppendSyncUploadBinary(const std::string& merchant_device_id,
+                            std::uint64_t submitted_at_epoch_seconds,
+                            const LocalTransaction* transactions,
+                            std::size_t count,
+                            std::vector<std::uint8_t>* out);
+
+}  // namespace offline_wallet
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+#include "offline_wallet/sync_exporter.hpp"
+
+namespace offline_wallet {
+
+// One uploaded transaction. The backend digests the three timestamps exactly
+// as uploaded; an empty text stands for the canonical ISO form of the epoch
+// field, which is what SyncExporter sends.
+struct BatchTransaction {
+  LocalTransaction tx;
+  std::string intent_issued_at;
+  std::string authorization_issued_at;
+  std::string expires_at;
+};
+
+// One OfflineSyncInput: the `count` transactions starting at `first`.
+struct SyncBatch {
+  std::string merchant_device_id;
+  std::uint64_t submitted_at_epoch_seconds = 0;
+  std::size_t first = 0;
+  std::size_t count = 0;
+};
+
+struct BatchPolicy {
+  RiskPolicy risk;
+  std::size_t max_unsynced_per_merchant = 1'000;
+  std::uint64_t max_sync_age_seconds = 48 * 3'600;
+};
+
+struct BatchAccount {
+  bool active = true;
+  // False when the account has no wallet row (wallet_missing).
+  bool wallet = true;
+  std::int64_t available_cents = 0;
+};
+
+struct BatchDevice {
+  std::string account_id;
+  std::string public_key;
+  bool active = true;
+  std::uint64_t last_sync_at_epoch_seconds = 0;
+};
+
+// Creates the signature verifier of each worker. Workers never share one.
+class BatchVerifierFactory {
+ public:
+  virtual ~BatchVerifierFactory() = default;
+  virtual std::unique_ptr<SignatureProvider> Create(std::size_t worker) = 0;
+};
+
+// Hex SHA-256 both device signatures cover: the backend's digest() over
+// txId|merchantIntentId|payerAuthorizationId|amountCents|currency|
+// merchantNonce|payerNonce|intentIssuedAt|authorizationIssuedAt|expiresAt.
+std::string SyncDigestHex(const BatchTransaction& tx);
+
+// Native replay of the backend's OfflineTransactionSyncService.sync() over
+// many uploads, for load tests and reconciliation runs.
+//
+// Validate() answers every transaction exactly as the backend would have,
+// processing the uploads one after the other in order. Checks that need only
+// the transaction and the (read-only) accounts and devices run in parallel on
+// the workers: identity and device status, amount policy, sync freshness,
+// clock skew, expiry, and the digest with both signature verifications,
+// which dominate the cost. A sequential pass then walks the transactions in
+// upload order for everything order-dependent: duplicate tx_ids and
+// idempotency keys (earlier rows of the same run included), the per-payer
+// daily limit and wallet balances. Transactions whose tx_id was stored before
+// the run skip the parallel checks, since they can only come out duplicate.
+//
+// Seeded state (accounts, devices, stored rows) must not change during
+// Validate(); the validator updates it with the outcome, so consecutive runs
+// continue where the previous one stopped.
+class BatchValidator {
+ public:
+  // Validate() uses `workers` threads, the calling one included.
+  BatchValidator(BatchPolicy policy, std::size_t workers, BatchVerifierFactory* factory);
+
+  ~BatchValidator();
+
+  BatchValidator(const BatchValidator&) = delete;
+  BatchValidator& operator=(const BatchValidator&) = delete;
+
+  void AddAccount(std::string account_id, BatchAccount account);
+  void AddDevice(std::string device_id, BatchDevice device);
+  // A row the backend already stores; kRejected rows do not count against
+  // the daily limit.
+  void AddStoredTransaction(const LocalTransaction& tx);
+
+  // Appends one result per transaction of `batches`, in upload order.
+  // `now_epoch_seconds` is the backend clock the sync freshness is taken on.
+  void Validate(const std::vector<SyncBatch>& batches,
+                const std::vector<BatchTransaction>& transactions,
+                std::uint64_t now_epoch_seconds,
+                std::vector<SyncResult>* results_out);
+
+  std::size_t worker_count() const { return workers_.size(); }
+  const BatchAccount* account(const std::string& account_id) const;
+
+ private:
+  struct Worker;
+  struct Item {
+    std::size_t batch = 0;
+    std::size_t tx = 0;
+  };
+
+  void CheckItems(Worker* worker,
+                  const std::vector<SyncBatch>& batches,
+                  const std::vector<BatchTransaction>& transactions);
+  const char* Check(Worker* worker, const SyncBatch& batch, bool stale, const BatchTransaction& tx) const;
+  void Settle(const std::vector<SyncBatch>& batches,
+              const std::vector<BatchTransaction>& transactions,
+              std::vector<SyncResult>* results_out);
+  const char* Apply(const LocalTransaction& tx, const char* checked, SyncResultStatus* status_out);
+  void Store(const LocalTransaction& tx, bool rejected);
+
+  BatchPolicy policy_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::unordered_map<std::string, BatchAccount> accounts_;
+  std::unordered_map<std::string, BatchDevice> devices_;
+  std::unordered_set<std::string> tx_ids_;
+  std::unordered_set<std::string> idempotency_keys_;
+  // Non-rejected cents per payer account and UTC day ("account|day").
+  std::unordered_map<std::string, std::int64_t> daily_spent_;
+  std::string settle_key_;
+
+  // Per Validate() call: the verdict on each upload as a whole (nullptr when
+  // its transactions are checked one by one), whether its merchant's last
+  // sync was stale, the transactions in upload order, and what the parallel
+  // checks found for each (nullptr when they all passed).
+  std::vector<const char*> batch_reasons_;
+  std::vector<std::uint8_t> batch_stale_;
+  std::vector<Item> items_;
+  std::vector<const char*> item_reasons_;
+  std::atomic<std::size_t> next_item_{0};
+};
+
+}  // namespace offline_wallet
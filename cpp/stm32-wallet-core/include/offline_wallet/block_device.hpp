@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace offline_wallet {
+
+// NOR-flash style storage: erase sets a whole sector to 0xFF, programming can
+// only clear bits, and a write is durable once Sync() returns. Addresses are
+// absolute byte offsets; Program never crosses a sector boundary.
+class BlockDevice {
+ public:
+  virtual ~BlockDevice() = default;
+  virtual std::size_t SectorSize() const = 0;
+  virtual std::size_t SectorCount() const = 0;
+  // Smallest programmable unit; writes start and end on multiples of it.
+  virtual std::size_t ProgramSize() const { return 1; }
+  virtual bool Read(std::size_t address, std::uint8_t* out, std::size_t size) const = 0;
+  virtual bool Program(std::size_t address, const std::uint8_t* data, std::size_t size) = 0;
+  virtual bool Erase(std::size_t sector) = 0;
+  virtual bool Sync() { return true; }
+};
+
+// RAM-backed device with flash semantics and wear counters, for tests and
+// host benchmarks.
+class RamBlockDevice : public BlockDevice {
+ public:
+  RamBlockDevice(std::size_t sector_size, std::size_t sector_count, std::size_t program_size = 8);
+
+  std::size_t SectorSize() const override { return sector_size_; }
+  std::size_t SectorCount() const override { return sector_count_; }
+  std::size_t ProgramSize() const override { return program_size_; }
+  bool Read(std::size_t address, std::uint8_t* out, std::size_t size) const override;
+  bool Program(std::size_t address, const std::uint8_t* data, std::size_t size) override;
+  bool Erase(std::size_t sector) override;
+  bool Sync() override;
+
+  std::uint32_t EraseCount(std::size_t sector) const { return erase_counts_[sector]; }
+  std::uint64_t program_calls() const { return program_calls_; }
+  std::uint64_t sync_calls() const { return sync_calls_; }
+  std::vector<std::uint8_t>& bytes() { return bytes_; }
+
+ private:
+  std::size_t sector_size_;
+  std::size_t sector_count_;
+  std::size_t program_size_;
+  std::vector<std::uint8_t> bytes_;
+  std::vector<std::uint32_t> erase_counts_;
+  std::uint64_t program_calls_ = 0;
+  std::uint64_t sync_calls_ = 0;
+};
+
+// File-backed flash simulator. The image persists across runs so recovery can
+// be exercised on a workstation; a missing file is created fully erased.
+class FileBlockDevice : public BlockDevice {
+ public:
+  FileBlockDevice(std::string path, std::size_t sector_size, std::size_t sector_count,
+                  std::size_t program_size = 8);
+  ~FileBlockDevice() override;
+
+  FileBlockDevice(const FileBlockDevice&) = delete;
+  FileBlockDevice& operator=(const FileBlockDevice&) = delete;
+
+  bool IsOpen() const { return file_ != nullptr; }
+
+  std::size_t SectorSize() const override { return sector_size_; }
+  std::size_t SectorCount() const override { return sector_count_; }
+  std::size_t ProgramSize() const override { return program_size_; }
+  bool Read(std::size_t address, std::uint8_t* out, std::size_t size) const override;
+  bool Program(std::size_t address, const std::uint8_t* data, std::size_t size) override;
+  bool Erase(std::size_t sector) override;
+  bool Sync() override;
+
+ private:
+  std::string path_;
+  std::size_t sector_size_;
+  std::size_t sector_count_;
+  std::size_t program_size_;
+  std::FILE* file_ = nullptr;
+};
+
+// A run of whole sectors of another device, addressed from zero, so that a
+// FlashJournal and a SnapshotStore can share one flash part.
+class BlockDeviceRegion : public BlockDevice {
+ public:
+  BlockDeviceRegion(BlockDevice* inner, std::size_t first_sector, std::size_t sector_count)
+      : inner_(inner), first_sector_(first_sector), sector_count_(sector_count) {}
+
+  std::size_t SectorSize() const override { return inner_->SectorSize(); }
+  std::size_t SectorCount() const override { return sector_count_; }
+  std::size_t ProgramSize() const override { return inner_->ProgramSize(); }
+  bool Read(std::size_t address, std::uint8_t* out, std::size_t size) const override;
+  bool Program(std::size_t address, const std::uint8_t* data, std::size_t size) override;
+  bool Erase(std::size_t sector) override;
+  bool Sync() override { return inner_->Sync(); }
+
+ private:
+  BlockDevice* inner_;
+  std::size_t first_sector_;
+  std::size_t sector_count_;
+};
+
+// Wraps another device and cuts power once a byte budget is spent: the
+// program or erase that crosses it lands only partially, and every later call
+// fails as if the MCU had browned out. Programs tear after a byte prefix;
+// erases reset a prefix of the sector and leave the old tail in place.
+class FaultInjectingBlockDevice : public BlockDevice {
+ public:
+  explicit FaultInjectingBlockDevice(BlockDevice* inner) : inner_(inner) {}
+
+  // Power fails after `bytes_until_cut` more programmed or erased bytes.
+  void ArmPowerCut(std::uint64_t bytes_until_cut);
+  void Disarm() { armed_ = false; }
+  bool powered() const { return powered_; }
+  // Programmed plus erased bytes since construction; a dry run of a workload
+  // gives the range of cut points worth injecting.
+  std::uint64_t bytes_written() const { return bytes_written_; }
+
+  std::size_t SectorSize() const override { return inner_->SectorSize(); }
+  std::size_t SectorCount() const override { return inner_->SectorCount(); }
+  std::size_t ProgramSize() const override { return inner_->ProgramSize(); }
+  bool Read(std::size_t address, std::uint8_t* out, std::size_t size) const override;
+  bool Program(std::size_t address, const std::uint8_t* data, std::size_t size) override;
+  bool Erase(std::size_t sector) override;
+  bool Sync() override { return powered_ && inner_->Sync(); }
+
+ private:
+  // Bytes of the next `size`-byte write that land before the cut.
+  std::size_t Budget(std::size_t size);
+
+  BlockDevice* inner_;
+  bool armed_ = false;
+  bool powered_ = true;
+  std::uint64_t remaining_ = 0;
+  std::uint64_t bytes_written_ = 0;
+};
+
+}  // namespace offline_wallet
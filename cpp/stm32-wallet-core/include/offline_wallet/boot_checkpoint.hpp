@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/snapshot_store.hpp"
+#include "offline_wallet/spend_tracker.hpp"
+#include "offline_wallet/sync_exporter.hpp"
+
+namespace offline_wallet {
+
+struct BootCheckpointOptions {
+  // CheckpointDue() turns true once the journal has appended this many
+  // records since the last checkpoint; it bounds the tail a boot replays.
+  std::uint64_t checkpoint_records = 256;
+};
+
+enum class BootRecovery {
+  kFailed,
+  // Checkpoint loaded; only the log tail after it was read.
+  kFromCheckpoint,
+  // No usable checkpoint; the whole log was replayed.
+  kFullReplay,
+};
+
+// Boot-time state of the payment path, kept in one SnapshotStore image so a
+// reboot does not replay the whole journal.
+//
+// A checkpoint holds the FlashJournal index and sector state, the
+// SyncExporter cursor, and the SpendTracker's per-payer windows, written
+// atomically together. Recover() mounts the journal from it and replays only
+// the records written since, counting transactions new in the tail into the
+// tracker; without a valid checkpoint it falls back to Mount(), Rebuild(),
+// and a cursor of 0 (the backend answers resent records as duplicates).
+// A sale written and then dropped by compaction between the checkpoint and
+// the reboot is missing from the tracker, as it would be after Rebuild();
+// keep checkpoint_records well below what compaction turns over. The
+// exporter and tracker are optional. Not thread-safe.
+class BootCheckpoint {
+ public:
+  BootCheckpoint(FlashJournal* journal,
+                 SnapshotStore* store,
+                 SyncExporter* exporter = nullptr,
+                 SpendTracker* tracker = nullptr,
+                 BootCheckpointOptions options = {});
+
+  // Call once at boot, instead of FlashJournal::Mount().
+  BootRecovery Recover(std::uint64_t now);
+
+  // Background maintenance: call WriteCheckpoint() from the idle loop when
+  // due. Also due after a full replay and once the exporter's cursor moved.
+  bool CheckpointDue() const;
+  bool WriteCheckpoint();
+
+  // Records read from the log by the last Recover().
+  std::uint64_t replayed_records() const { return replayed_records_; }
+
+ private:
+  bool RecoverFromCheckpoint(std::uint64_t now);
+
+  FlashJournal* journal_;
+  SnapshotStore* store_;
+  SyncExporter* exporter_;
+  SpendTracker* tracker_;
+  BootCheckpointOptions options_;
+  // journal_->stats().appended_records and the cursor at the last
+  // checkpoint or mount.
+  std::uint64_t checkpointed_records_ = 0;
+  std::uint64_t checkpointed_cursor_ = 0;
+  bool due_ = false;
+  std::uint64_t replayed_records_ = 0;
+  std::vector<std::uint8_t> image_;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace offline_wallet {
+
+// Internal helpers shared by the flash images and the hashed indexes; not part
+// of the engine API.
+
+// Little-endian field access; every on-flash format uses this byte order.
+inline void Put32(std::uint8_t* out, std::uint32_t value) {
+  out[0] = static_cast<std::uint8_t>(value);
+  out[1] = static_cast<std::uint8_t>(value >> 8);
+  out[2] = static_cast<std::uint8_t>(value >> 16);
+  out[3] = static_cast<std::uint8_t>(value >> 24);
+}
+
+inline std::uint32_t Get32(const std::uint8_t* in) {
+  return static_cast<std::uint32_t>(in[0]) | static_cast<std::uint32_t>(in[1]) << 8 |
+         static_cast<std::uint32_t>(in[2]) << 16 | static_cast<std::uint32_t>(in[3]) << 24;
+}
+
+inline void Put64(std::uint8_t* out, std::uint64_t value) {
+  Put32(out, static_cast<std::uint32_t>(value));
+  Put32(out + 4, static_cast<std::uint32_t>(value >> 32));
+}
+
+inline std::uint64_t Get64(const std::uint8_t* in) {
+  return static_cast<std::uint64_t>(Get32(in)) | static_cast<std::uint64_t>(Get32(in + 4)) << 32;
+}
+
+// 64-bit FNV-1a. Pass the previous result as `hash` to hash data that arrives
+// in pieces.
+constexpr std::uint64_t kFnv1aOffsetBasis = 1469598103934665603ULL;
+
+inline std::uint64_t Fnv1a(const void* data, std::size_t size, std::uint64_t hash = kFnv1aOffsetBasis) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The key the journal, the settlement index and the shard router use for a
+// transaction. Stored in checkpoint images, so it must not change.
+inline std::uint64_t HashTxId(std::string_view tx_id) { return Fnv1a(tx_id.data(), tx_id.size()); }
+
+}  // namespace offline_wallet
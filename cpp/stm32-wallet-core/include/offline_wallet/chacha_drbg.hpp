@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "offline_wallet/fixed_interfaces.hpp"
+#include "offline_wallet/interfaces.hpp"
+
+namespace offline_wallet {
+
+using ChaCha20Key = std::array<std::uint8_t, 32>;
+using ChaCha20Nonce = std::array<std::uint8_t, 12>;
+using ChaCha20Block = std::array<std::uint8_t, 64>;
+
+// One ChaCha20 block (RFC 8439, section 2.3).
+void ChaCha20Generate(const ChaCha20Key& key,
+                      std::uint32_t counter,
+                      const ChaCha20Nonce& nonce,
+                      ChaCha20Block* block_out);
+
+// Where fresh seed material comes from, e.g. the STM32 RNG peripheral.
+class EntropySource {
+ public:
+  virtual ~EntropySource() = default;
+  // Fills `size` bytes; false when the source is not ready or failed its
+  // health test.
+  virtual bool Gather(std::uint8_t* out, std::size_t size) = 0;
+};
+
+struct ChaChaDrbgOptions {
+  // Output served between reseeds from the entropy source; 0 never reseeds
+  // on its own. A handshake draws 40 bytes.
+  std::uint64_t reseed_interval_bytes = 64 * 1024;
+};
+
+// Random provider over ChaCha20 with fast key erasure: each refill runs eight
+// blocks, keeps the first 32 bytes as the next key, and serves the rest from
+// a buffer that is wiped as it is read, so neither the key nor earlier output
+// can be recovered from the state. Draws are a memcpy out of the buffer, and
+// FillHex() encodes straight into the caller's storage, so ids and nonces
+// cost no allocation. Not thread-safe.
+class ChaChaDrbg : public RandomProvider, public FixedRandomProvider {
+ public:
+  static constexpr std::size_t kBufferBlocks = 8;
+
+  // Reproducible stream for tests and benchmarks: the same seed always
+  // yields the same bytes, however the draws are split.
+  explicit ChaChaDrbg(const ChaCha20Key& seed);
+  // Seeds from `entropy` (not owned) and reseeds every
+  // options.reseed_interval_bytes. If the first gather fails, seeded() stays
+  // false and every draw retries it. Until one succeeds the generator fails
+  // closed: NextBytes() writes zeros, FillHex() and NextHex() return nothing
+  // and Ready() is false, so no output ever comes from the all-zero key.
+  explicit ChaChaDrbg(EntropySource* entropy, ChaChaDrbgOptions options = {});
+  ~ChaChaDrbg() override;
+
+  ChaChaDrbg(const ChaChaDrbg&) = delete;
+  ChaChaDrbg& operator=(const ChaChaDrbg&) = delete;
+
+  void NextBytes(std::uint8_t* out, std::size_t size) override;
+  std::size_t FillHex(std::size_t bytes, char* hex_out) override;
+  std::string NextHex(std::size_t bytes) override;
+  // Retries the seed when there is none yet; true once seeded.
+  bool Ready() override;
+
+  // Hashes 32 bytes from the entropy source into the key and drops the
+  // buffered output. Returns false, keeping the current key, when there is
+  // no source or it failed.
+  bool Reseed();
+  // Hashes caller bytes into the key, e.g. a device serial at boot.
+  void Mix(const void* data, std::size_t size);
+
+  bool seeded() const { return seeded_; }
+  std::uint64_t reseed_count() const { return reseed_count_; }
+  std::uint64_t reseed_failures() const { return reseed_failures_; }
+
+ private:
+  void Rekey(const void* data, std::size_t size);
+  void Refill();
+
+  EntropySource* entropy_ = nullptr;
+  ChaChaDrbgOptions options_;
+  ChaCha20Key key_{};
+  std::array<std::uint8_t, kBufferBlocks * 64> buffer_{};
+  std::size_t position_ = 0;
+  std::uint64_t bytes_since_reseed_ = 0;
+  std::uint64_t reseed_count_ = 0;
+  std::uint64_t reseed_failures_ = 0;
+  bool seeded_ = false;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace offline_wallet {
+
+// CRC-32 (IEEE 802.3, reflected, table driven). Pass the previous result as
+// `crc` to checksum data that arrives in pieces; start from 0.
+std::uint32_t Crc32(const void* data, std::size_t size, std::uint32_t crc = 0);
+
+}  // namespace offline_wallet
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "offline_wallet/interfaces.hpp"
+
+namespace offline_wallet {
+
+using Ed25519Seed = std::array<std::uint8_t, 32>;
+using Ed25519PublicKey = std::array<std::uint8_t, 32>;
+using Ed25519Signature = std::array<std::uint8_t, 64>;
+
+// A seed expanded once: the clamped secret scalar, the nonce prefix, and the
+// public key, so that signing costs one fixed-base multiplication and two
+// SHA-512 passes over the message.
+struct Ed25519SigningKey {
+  std::array<std::uint8_t, 32> scalar{};
+  std::array<std::uint8_t, 32> prefix{};
+  Ed25519PublicKey public_key{};
+};
+
+// Ed25519 (RFC 8032), portable C++. Signing multiplies the base point with a
+// 30 KB table of precomputed multiples, built on first use and selected in
+// constant time. Verification is cofactored ([8][S]B = [8]R + [8][k]A) and
+// variable time, so single and batch verification accept exactly the same
+// signatures; non-canonical S, A, or R encodings are rejected.
+void Ed25519ExpandSeed(const Ed25519Seed& seed, Ed25519SigningKey* key_out);
+void Ed25519Sign(const Ed25519SigningKey& key,
+                 const void* message,
+                 std::size_t size,
+                 Ed25519Signature* signature_out);
+bool Ed25519Verify(const Ed25519PublicKey& public_key,
+                   const void* message,
+                   std::size_t size,
+                   const Ed25519Signature& signature);
+
+// Builds the fixed-base table now rather than in the first Sign; call it at
+// boot to keep the first handshake fast.
+void Ed25519Precompute();
+
+struct Ed25519BatchItem {
+  const Ed25519PublicKey* public_key = nullptr;
+  const void* message = nullptr;
+  std::size_t message_size = 0;
+  const Ed25519Signature* signature = nullptr;
+};
+
+// Checks all signatures with one random linear combination, sharing the
+// doublings between them. Returns true when every item is valid. Otherwise
+// the items are re-checked one by one to find the bad ones, and valid_out
+// (may be null; `count` entries) marks each item.
+bool Ed25519VerifyBatch(const Ed25519BatchItem* items, std::size_t count, bool* valid_out);
+
+// SignatureProvider over Ed25519 with lowercase hex signatures. Sign() takes
+// the id of a signing key; Verify() takes a name registered with
+// AddPublicKey() (or a signing key id), or the key itself as 64 hex digits.
+// Not thread-safe.
+class Ed25519SignatureProvider : public SignatureProvider {
+ public:
+  void AddSigningKey(const std::string& key_id, const Ed25519Seed& seed);
+  // Peers' keys, usually by device id; the engine verifies with the sender's
+  // device id when verification is on.
+  void AddPublicKey(const std::string& name, const Ed25519PublicKey& public_key);
+  bool FindPublicKey(std::string_view public_key_or_id, Ed25519PublicKey* public_key_out) const;
+
+  // Returns an empty signature for an unknown key id.
+  std::string Sign(const std::string& message, const std::string& key_id) override;
+  bool Verify(const std::string& signature,
+              const std::string& message,
+              const std::string& public_key_or_id) override;
+
+  struct Check {
+    std::string_view signature;
+    std::string_view message;
+    std::string_view public_key_or_id;
+  };
+
+  // Ed25519VerifyBatch over `count` checks; ones with an unknown key or a
+  // malformed signature are invalid.
+  bool VerifyBatch(const Check* checks, std::size_t count, bool* valid_out) const;
+
+ private:
+  std::unordered_map<std::string, Ed25519SigningKey> signing_keys_;
+  std::unordered_map<std::string, Ed25519PublicKey> public_keys_;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/fixed_models.hpp"
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+struct ExpirySweeperOptions {
+  // Intents tracked at once. Answered intents keep their entry until it comes
+  // due, so allow for every intent issued within one TTL plus grace.
+  std::size_t max_tracked = 256;
+  // Seconds past expires_at_epoch_seconds before a record is marked, so an
+  // authorization scanned at the deadline can still be accepted.
+  std::uint32_t grace_seconds = 60;
+  // Due entries handled by one Tick(); the rest wait for the next tick.
+  std::size_t max_due_per_tick = 16;
+};
+
+struct ExpirySweeperStats {
+  std::size_t tracked = 0;
+  std::uint64_t expired = 0;   // Records moved to kExpired.
+  std::uint64_t answered = 0;  // Due entries whose record had moved on or was gone.
+  std::uint64_t refused = 0;   // Track() calls refused: full, or tx_id too long.
+};
+
+// Moves merchant intents nobody answered from kInitiated to kExpired.
+//
+// Deadlines sit in a two-level timer wheel: 256 one-second slots, then 256
+// slots of 256 seconds, about 18 hours in all; later deadlines park in the
+// farthest slot and are re-filed when it comes round. Tick() advances the
+// wheel to the clock and touches only the entries that came due, so a sweep
+// costs O(expired) however long the journal is; a clock jump of more than
+// 256 seconds re-files every tracked entry once. A due record is marked only
+// while it is still kInitiated, so answered intents need no cancellation.
+// FlashJournal compaction then drops the kExpired records and their index
+// slots. Call Tick() from the idle loop about once a second on the engine's
+// thread; the sweeper is not synchronized.
+class ExpirySweeper {
+ public:
+  ExpirySweeper(TransactionJournal* journal, const ClockProvider* clock, ExpirySweeperOptions options = {});
+
+  // Starts tracking a persisted intent. Returns false when the sweeper is
+  // full or the tx_id is longer than a FixedId.
+  bool Track(const PaymentIntent& intent);
+  bool Track(std::string_view tx_id, std::uint64_t expires_at_epoch_seconds);
+
+  // Advances to the clock's time and handles due entries, at most
+  // max_due_per_tick of them. Returns how many records became kExpired.
+  std::size_t Tick();
+
+  // Boot-time rebuild in one pass over the journal: tracks every kInitiated
+  // record, which expires intent_ttl_seconds after its creation.
+  bool Rebuild(const RiskPolicy& policy);
+
+  void Clear();
+  const ExpirySweeperStats& stats() const { return stats_; }
+  // Entries that came due and still wait for a Tick() with budget left.
+  bool HasDue() const { return due_ != kNone; }
+  std::size_t MemoryBytes() const;
+
+ private:
+  static constexpr std::uint32_t kSlotBits = 8;
+  static constexpr std::uint32_t kSlots = 1u << kSlotBits;
+  static constexpr std::uint32_t kNone = 0xFFFFFFFFu;
+
+  struct Entry {
+    FixedId tx_id;
+    std::uint64_t due_at = 0;
+    std::uint32_t next = kNone;
+  };
+
+  void Advance(std::uint64_t now);
+  void File(std::uint32_t index);
+  // Pushes every entry of `*head` back through File().
+  void Refile(std::uint32_t* head);
+  void Release(std::uint32_t index);
+
+  TransactionJournal* journal_;
+  const ClockProvider* clock_;
+  ExpirySweeperOptions options_;
+  std::vector<Entry> entries_;
+  std::uint32_t free_ = kNone;
+  std::uint32_t near_[kSlots];
+  std::uint32_t far_[kSlots];
+  std::uint32_t due_ = kNone;
+  // Every deadline at or before now_ has reached due_.
+  std::uint64_t now_;
+  ExpirySweeperStats stats_;
+  std::string tx_id_scratch_;
+  LocalTransaction tx_scratch_;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "offline_wallet/fixed_models.hpp"
+#include "offline_wallet/interfaces.hpp"
+
+namespace offline_wallet {
+
+// Heap-free counterparts of the provider interfaces. Every output is written
+// into caller-owned storage; ClockProvider is shared with the std::string API.
+
+class FixedSignatureProvider {
+ public:
+  virtual ~FixedSignatureProvider() = default;
+  virtual bool Sign(const char* message,
+                    std::size_t message_size,
+                    const FixedKeyId& key_id,
+                    FixedSignature* signature_out) = 0;
+  virtual bool Verify(const FixedSignature& signature,
+                      const char* message,
+                      std::size_t message_size,
+                      const FixedKeyId& public_key_or_id) = 0;
+};
+
+class FixedRandomProvider {
+ public:
+  virtual ~FixedRandomProvider() = default;
+  virtual void NextBytes(std::uint8_t* out, std::size_t size) = 0;
+  // See RandomProvider::Ready.
+  virtual bool Ready() { return true; }
+};
+
+class FixedTransactionJournal {
+ public:
+  virtual ~FixedTransactionJournal() = default;
+  virtual bool Save(const FixedLocalTransaction& tx) = 0;
+  virtual bool Load(const FixedId& tx_id, FixedLocalTransaction* tx_out) const = 0;
+  virtual bool UpdateState(const FixedId& tx_id, TransactionState state, const FixedReason& reason) = 0;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "offline_wallet/fixed_string.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+// Field capacities for the heap-free model layer. IDs cover the engine's
+// "tx-"/"mi-"/"pa-"/"r-" + 16 hex keys as well as 36-char backend UUIDs.
+constexpr std::size_t kFixedIdCapacity = 40;
+constexpr std::size_t kFixedKeyIdCapacity = 32;
+constexpr std::size_t kFixedNonceCapacity = 32;
+constexpr std::size_t kFixedCurrencyCapacity = 3;
+constexpr std::size_t kFixedSignatureCapacity = 128;
+constexpr std::size_t kFixedReasonCapacity = 48;
+constexpr std::size_t kFixedIdempotencyKeyCapacity = 96;
+
+using FixedId = FixedString<kFixedIdCapacity>;
+using FixedKeyId = FixedString<kFixedKeyIdCapacity>;
+using FixedNonce = FixedString<kFixedNonceCapacity>;
+using FixedCurrency = FixedString<kFixedCurrencyCapacity>;
+using FixedSignature = FixedString<kFixedSignatureCapacity>;
+using FixedReason = FixedString<kFixedReasonCapacity>;
+using FixedIdempotencyKey = FixedString<kFixedIdempotencyKeyCapacity>;
+
+// Worst-case footprint of each struct. The structs hold no pointers, so these
+// bounds are also the exact RAM/flash cost of one instance on any target.
+constexpr std::size_t kFixedDeviceContextMaxBytes = 160;
+constexpr std::size_t kFixedPaymentIntentMaxBytes = 384;
+constexpr std::size_t kFixedPaymentAuthorizationMaxBytes = 416;
+constexpr std::size_t kFixedPaymentReceiptMaxBytes = 336;
+constexpr std::size_t kFixedLocalTransactionMaxBytes = 576;
+
+struct FixedDeviceContext {
+  FixedId account_id;
+  FixedId device_id;
+  FixedKeyId signing_key_id;
+  std::uint32_t local_counter = 0;
+};
+
+struct FixedPaymentIntent {
+  FixedId tx_id;
+  FixedId merchant_intent_id;
+  FixedId merchant_account_id;
+  FixedId merchant_device_id;
+  std::int32_t amount_cents = 0;
+  FixedCurrency currency = "CNY";
+  FixedNonce merchant_nonce;
+  std::uint32_t merchant_counter = 0;
+  std::uint64_t issued_at_epoch_seconds = 0;
+  std::uint64_t expires_at_epoch_seconds = 0;
+  FixedSignature merchant_signature;
+};
+
+struct FixedPaymentAuthorization {
+  FixedId tx_id;
+  FixedId merchant_intent_id;
+  FixedId payer_authorization_id;
+  FixedId payer_account_id;
+  FixedId payer_device_id;
+  std::int32_t amount_cents = 0;
+  FixedCurrency currency = "CNY";
+  FixedNonce payer_nonce;
+  std::uint32_t payer_counter = 0;
+  std::uint64_t authorized_at_epoch_seconds = 0;
+  FixedSignature payer_signature;
+};
+
+struct FixedPaymentReceipt {
+  FixedId tx_id;
+  FixedId receipt_id;
+  FixedId merchant_account_id;
+  FixedId payer_account_id;
+  std::int32_t amount_cents = 0;
+  FixedCurrency currency = "CNY";
+  TransactionState status = TransactionState::kPendingSync;
+  std::uint64_t created_at_epoch_seconds = 0;
+  FixedSignature merchant_signature;
+};
+
+struct FixedLocalTransaction {
+  FixedId tx_id;
+  FixedId merchant_account_id;
+  FixedId payer_account_id;
+  FixedId merchant_device_id;
+  FixedId payer_device_id;
+  std::int32_t amount_cents = 0;
+  FixedCurrency currency = "CNY";
+  FixedId merchant_intent_id;
+  FixedId payer_authorization_id;
+  FixedNonce merchant_nonce;
+  FixedNonce payer_nonce;
+  std::uint32_t merchant_counter = 0;
+  std::uint32_t payer_counter = 0;
+  TransactionState state = TransactionState::kInitiated;
+  FixedReason failure_reason;
+  std::uint64_t created_at_epoch_seconds = 0;
+  std::uint64_t updated_at_epoch_seconds = 0;
+  FixedIdempotencyKey idempotency_key;
+};
+
+static_assert(sizeof(FixedDeviceContext) <= kFixedDeviceContextMaxBytes, "FixedDeviceContext budget");
+static_assert(sizeof(FixedPaymentIntent) <= kFixedPaymentIntentMaxBytes, "FixedPaymentIntent budget");
+static_assert(sizeof(FixedPaymentAuthorization) <= kFixedPaymentAuthorizationMaxBytes,
+              "FixedPaymentAuthorization budget");
+static_assert(sizeof(FixedPaymentReceipt) <= kFixedPaymentReceiptMaxBytes, "FixedPaymentReceipt budget");
+static_assert(sizeof(FixedLocalTransaction) <= kFixedLocalTransactionMaxBytes,
+              "FixedLocalTransaction budget");
+
+// Adapters between the std::pmr::string models and the fixed-capacity layer.
+// ToFixed returns false (leaving the output partially written) when a field
+// exceeds its capacity; FromFixed always succeeds. LocalTransaction's sequence
+// and sync evidence, and PaymentReceipt's chain position, have no fixed
+// counterpart and are not copied.
+bool ToFixed(const DeviceContext& in, FixedDeviceContext* out);
+bool ToFixed(const PaymentIntent& in, FixedPaymentIntent* out);
+bool ToFixed(const PaymentAuthorization& in, FixedPaymentAuthorization* out);
+bool ToFixed(const PaymentReceipt& in, FixedPaymentReceipt* out);
+bool ToFixed(const LocalTransaction& in, FixedLocalTransaction* out);
+
+void FromFixed(const FixedDeviceContext& in, DeviceContext* out);
+void FromFixed(const FixedPaymentIntent& in, PaymentIntent* out);
+void FromFixed(const FixedPaymentAuthorization& in, PaymentAuthorization* out);
+void FromFixed(const FixedPaymentReceipt& in, PaymentReceipt* out);
+void FromFixed(const FixedLocalTransaction& in, LocalTransaction* out);
+
+}  // namespace offline_wallet
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "offline_wallet/fixed_interfaces.hpp"
+#include "offline_wallet/static_offline_engine.hpp"
+
+namespace offline_wallet {
+
+extern template class StaticOfflineEngine<FixedSignatureProvider,
+                                          FixedRandomProvider,
+                                          ClockProvider,
+                                          FixedTransactionJournal>;
+
+// Heap-free twin of OfflineEngine. Same policy checks, state transitions and
+// signature message layout, but all models are fixed-capacity and every
+// temporary lives on the stack, so a full handshake performs no allocation.
+// Providers are reached through the Fixed* interfaces; see
+// StaticOfflineEngine for the statically dispatched variant.
+class FixedOfflineEngine : public StaticOfflineEngine<FixedSignatureProvider,
+                                                      FixedRandomProvider,
+                                                      ClockProvider,
+                                                      FixedTransactionJournal> {
+ public:
+  using StaticOfflineEngine::StaticOfflineEngine;
+};
+
+}  // namespace offline_wallet
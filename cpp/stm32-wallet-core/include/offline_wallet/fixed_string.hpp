@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace offline_wallet {
+
+// Inline, NUL-terminated string with a compile-time capacity. Never touches the
+// heap; writes that do not fit are rejected and leave the value unchanged.
+template <std::size_t Capacity>
+class FixedString {
+ public:
+  static_assert(Capacity > 0 && Capacity < 65'535, "unsupported FixedString capacity");
+
+  using SizeType = std::conditional_t<(Capacity < 256), std::uint8_t, std::uint16_t>;
+
+  static constexpr std::size_t kCapacity = Capacity;
+
+  FixedString() { data_[0] = '\0'; }
+
+  // Truncates on overflow; intended for literals such as the default currency.
+  FixedString(const char* text) {  // NOLINT(google-explicit-constructor)
+    data_[0] = '\0';
+    const std::size_t length = std::strlen(text);
+    Assign(text, length < Capacity ? length : Capacity);
+  }
+
+  bool Assign(const char* text, std::size_t length) {
+    if (length > Capacity) {
+      return false;
+    }
+    std::memmove(data_, text, length);
+    data_[length] = '\0';
+    size_ = static_cast<SizeType>(length);
+    return true;
+  }
+
+  template <std::size_t OtherCapacity>
+  bool Assign(const FixedString<OtherCapacity>& other) {
+    return Assign(other.data(), other.size());
+  }
+
+  bool Append(const char* text, std::size_t length) {
+    if (length > Capacity - size_) {
+      return false;
+    }
+    std::memcpy(data_ + size_, text, length);
+    size_ = static_cast<SizeType>(size_ + length);
+    data_[size_] = '\0';
+    return true;
+  }
+
+  template <std::size_t OtherCapacity>
+  bool Append(const FixedString<OtherCapacity>& other) {
+    return Append(other.data(), other.size());
+  }
+
+  bool Append(char c) { return Append(&c, 1); }
+
+  void clear() {
+    size_ = 0;
+    data_[0] = '\0';
+  }
+
+  const char* data() const { return data_; }
+  const char* c_str() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  bool Equals(const char* text, std::size_t length) const {
+    return length == size_ && std::memcmp(data_, text, length) == 0;
+  }
+
+  template <std::size_t OtherCapacity>
+  bool operator==(const FixedString<OtherCapacity>& other) const {
+    return Equals(other.data(), other.size());
+  }
+
+  template <std::size_t OtherCapacity>
+  bool operator!=(const FixedString<OtherCapacity>& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  char data_[Capacity + 1];
+  SizeType size_ = 0;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+struct FlashJournalOptions {
+  // Capacity of the in-RAM tx_id index (12 bytes per slot, two slots per record).
+  std::size_t max_records = 1024;
+  // Sectors that ordinary appends never consume, so compaction always has room
+  // to relocate live records.
+  std::size_t reserve_sectors = 1;
+  // NeedsCompaction() turns true once free sectors drop to this count, or
+  // free index slots to compaction_free_records, so that kSynced and kExpired
+  // records give their slots back before the index fills up.
+  std::size_t compaction_free_sectors = 2;
+  std::size_t compaction_free_records = 16;
+  // Distinct transactions held in RAM by an open batch; staging one more
+  // flushes the batch early.
+  std::size_t max_staged_records = 4;
+};
+
+struct FlashJournalStats {
+  std::size_t live_records = 0;
+  std::size_t free_sectors = 0;
+  std::uint32_t min_erase_count = 0;
+  std::uint32_t max_erase_count = 0;
+  std::uint64_t appended_records = 0;
+  std::uint64_t committed_batches = 0;
+  std::uint64_t compacted_sectors = 0;
+  std::uint64_t dropped_records = 0;
+  // Records the last mount read back from the log.
+  std::uint64_t replayed_records = 0;
+};
+
+// Told about each record MountFromCheckpoint() replays from the log tail.
+class JournalTailVisitor {
+ public:
+  virtual ~JournalTailVisitor() = default;
+  // `known` is true when the journal already held a version of the
+  // transaction, from the checkpoint or earlier in the tail.
+  virtual void Visit(const LocalTransaction& tx, bool known) = 0;
+};
+
+// Append-only, CRC-framed transaction log over a BlockDevice.
+//
+// Every Save appends one record to the head sector with a single program and
+// sync; nothing is rewritten in place. A RAM index maps a 64-bit hash of each
+// tx_id to the address of its newest record. The hash only picks the probe
+// sequence: a slot whose hash matches is confirmed by reading its record's
+// tx_id, so ids that collide (FNV-1a is easy to collide on purpose, and peers
+// choose tx_ids) get slots of their own. Sectors are recycled
+// oldest-first by compaction, which relocates live records into a fresh
+// target sector and drops those already kSynced or kExpired; the erased sector
+// with the lowest erase count becomes the next head, spreading wear. Mount()
+// replays the log after a reboot, ignoring any record torn by power loss and
+// discarding a compaction target whose victim was never erased.
+//
+// Staged records are kept in RAM, newest version per tx_id only, and
+// CommitBatch() writes them as one group closed by a commit frame that carries
+// the group's CRC, again with a single program and sync. Mount() applies a
+// group only if its commit frame checks out. A group that outgrows a sector is
+// split, and each part commits atomically on its own. Save() with a batch open
+// commits the staged records together with the new one.
+//
+// Every write stamps LocalTransaction::sequence, strictly increasing across
+// reboots. Opening a sector raises the counter to the sector's sequence times
+// 2^32, so Mount() can resume above every record ever written even after
+// compaction dropped the newest ones; relocation keeps a record's sequence.
+//
+// Mount() reads every record, so boot time grows with the log. A checkpoint
+// (AppendCheckpoint()) captures the index and per-sector state instead;
+// MountFromCheckpoint() reloads it and reads only what was written after it:
+// the rest of the checkpoint's head sector and any sector opened since.
+// Sectors are matched by sequence and erase count, so index entries into a
+// sector recycled since the checkpoint are dropped, or replaced by the
+// relocated copy when compaction moved the record.
+class FlashJournal : public TransactionJournal {
+ public:
+  explicit FlashJournal(BlockDevice* device, FlashJournalOptions options = {});
+
+  // Rebuilds the index from flash, formatting a blank or foreign device.
+  bool Mount();
+  // Erases every sector, preserving erase counts that are still readable.
+  bool Format();
+
+  // Appends a checkpoint image of the mounted journal to `image_out`. Staged
+  // records are not part of it.
+  void AppendCheckpoint(std::vector<std::uint8_t>* image_out) const;
+  // Mounts from a checkpoint image plus the log written after it. Returns
+  // false when the image is malformed or does not match the device; the
+  // journal must then be mounted with Mount().
+  bool MountFromCheckpoint(const std::uint8_t* image, std::size_t size, JournalTailVisitor* tail = nullptr);
+
+  bool Save(const LocalTransaction& tx) override;
+  bool Load(const std::string& tx_id, LocalTransaction* tx_out) const override;
+  bool UpdateState(const std::string& tx_id, TransactionState state, const std::string& reason) override;
+
+  bool BeginBatch() override;
+  bool Stage(const LocalTransaction& tx) override;
+  bool CommitBatch() override;
+  void AbortBatch() override;
+  // Encodes the changed records straight into commit groups, with one
+  // program and sync per sector's worth and none of the staging limits.
+  bool UpdateStates(const StateUpdate* updates, std::size_t count) override;
+  bool ForEach(JournalVisitor* visitor) const override;
+  // Compacts until `records` appends of the largest size seen so far can open
+  // every sector they need without falling back to foreground compaction.
+  bool Reserve(std::size_t records) override;
+
+  // Background maintenance: call from the idle loop while it returns true.
+  bool NeedsCompaction() const;
+  // Recycles the oldest sector. Returns false when there was nothing to do.
+  bool CompactStep();
+
+  FlashJournalStats stats() const;
+
+ private:
+  struct SectorInfo {
+    bool used = false;
+    std::uint32_t sequence = 0;
+    std::uint32_t erase_count = 0;
+    std::size_t write_offset = 0;
+    // Superseded or droppable records; drives victim selection.
+    std::uint32_t reclaimable = 0;
+  };
+
+  enum class RecordRead {
+    kOk,
+    kBlank,
+    kCorrupt,
+  };
+
+  struct PendingRecord {
+    std::uint64_t hash;
+    std::uint32_t address;
+    bool droppable;
+    // Index slot of the version it supersedes; kept by UpdateStates() only.
+    std::size_t slot;
+  };
+
+  bool Initialize();
+  bool FormatSectors();
+  // Reads every sector header, recycling torn sectors and unfinished
+  // compaction targets; formats a device that carries no journal.
+  bool ReadSectorHeaders();
+  // Sectors in use, oldest first.
+  std::vector<std::size_t> SectorsBySequence() const;
+  // Makes the newest sector the head and resumes the sequence counters.
+  void AdoptHead();
+  bool AppendRecord(const std::uint8_t* record,
+                    std::size_t record_size,
+                    bool for_compaction,
+                    std::uint32_t* address_out);
+  bool OpenHeadSector(std::uint32_t victim_sequence);
+  bool RecycleSector(std::size_t sector);
+  // Replays the records from `offset` on; `tail` sees each one applied.
+  bool ScanSector(std::size_t sector, std::size_t offset, JournalTailVisitor* tail);
+  std::size_t FreeSectorCount() const;
+  std::size_t PickVictim() const;
+  std::size_t RecordSize(std::size_t payload_size) const;
+  bool FlushStaged();
+  bool AppendGroup(std::size_t first, std::size_t count, std::size_t group_size);
+  bool AppendUpdateGroup(std::size_t run_size, std::uint32_t run_crc);
+  bool CommitGroup(std::size_t run_size, std::size_t count, std::uint32_t run_crc, std::uint32_t* address_out);
+  void SealRecord(std::uint8_t* record, std::size_t payload_size, std::uint8_t kind) const;
+  bool EncodeRecord(const LocalTransaction& tx, std::uint64_t sequence, std::uint8_t kind, std::size_t* size_out);
+  RecordRead ReadRawRecord(std::size_t address,
+                           std::size_t limit,
+                           std::size_t* payload_size_out,
+                           std::uint8_t* kind_out) const;
+  bool ReadRecord(std::uint32_t address, LocalTransaction* tx_out) const;
+
+  // Slot of the newest record of `tx_id`; reads each record whose hash
+  // matches. `tx_out` receives the record found.
+  std::size_t FindSlot(std::uint64_t hash, std::string_view tx_id, LocalTransaction* tx_out = nullptr) const;
+  // Slot that points at `address`; needs no flash read.
+  std::size_t FindSlotAt(std::uint64_t hash, std::uint32_t address) const;
+  // Points `slot` (from FindSlot) at `address`, or takes a new slot when it
+  // is kNoSlot. A slot compaction tombstoned in between is taken back.
+  bool IndexPut(std::size_t slot, std::uint64_t hash, std::uint32_t address);
+  void IndexErase(std::size_t slot);
+
+  BlockDevice* device_;
+  FlashJournalOptions options_;
+  std::size_t align_ = 1;
+  std::vector<SectorInfo> sectors_;
+  std::size_t head_ = 0;
+  bool has_head_ = false;
+  std::uint32_t next_sequence_ = 1;
+  std::uint64_t next_record_sequence_ = 1;
+  std::size_t largest_record_ = 0;
+
+  std::vector<std::uint64_t> index_hashes_;
+  std::vector<std::uint32_t> index_addresses_;
+  std::size_t index_live_ = 0;
+  std::size_t index_tombstones_ = 0;
+
+  bool batch_open_ = false;
+  std::vector<LocalTransaction> staged_;
+  std::vector<std::size_t> staged_sizes_;
+  // Records of the update group being built; addresses are offsets into group_.
+  std::vector<PendingRecord> updated_;
+
+  std::vector<std::uint8_t> scratch_;
+  std::vector<std::uint8_t> group_;
+  mutable std::vector<std::uint8_t> read_scratch_;
+  FlashJournalStats stats_;
+};
+
+}  // namespace offline_wallet
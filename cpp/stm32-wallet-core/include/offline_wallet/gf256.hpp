@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace offline_wallet {
+
+// GF(2^8) arithmetic over the QR code field polynomial x^8 + x^4 + x^3 + x^2 + 1
+// (0x11D), backed by exp/log tables built at compile time, and systematic
+// Reed-Solomon encoding with generator polynomials precomputed for every
+// degree a QR block uses, plus Berlekamp-Massey error correction.
+constexpr std::size_t kReedSolomonMaxDegree = 30;
+
+std::uint8_t Gf256Multiply(std::uint8_t a, std::uint8_t b);
+// `b` must be non-zero.
+std::uint8_t Gf256Divide(std::uint8_t a, std::uint8_t b);
+// alpha^power, for any power.
+std::uint8_t Gf256Exp(std::size_t power);
+// Discrete log of a non-zero `value`.
+std::uint8_t Gf256Log(std::uint8_t value);
+
+// Writes the `degree` parity bytes for `data` to `parity_out`. Returns false
+// unless 1 <= degree <= kReedSolomonMaxDegree.
+bool ReedSolomonEncode(const std::uint8_t* data,
+                       std::size_t size,
+                       std::size_t degree,
+                       std::uint8_t* parity_out);
+
+// Corrects, in place, up to degree / 2 wrong bytes of a codeword (data
+// followed by the `degree` parity bytes ReedSolomonEncode wrote; at most 255
+// bytes in all). Returns false when the errors are beyond correction and
+// leaves the codeword untouched. `corrected_out`, when set, receives the
+// number of bytes fixed. Uses no memory beyond a few stack arrays.
+bool ReedSolomonCorrect(std::uint8_t* codeword,
+                        std::size_t size,
+                        std::size_t degree,
+                        std::size_t* corrected_out = nullptr);
+
+}  // namespace offline_wallet
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace offline_wallet {
+
+// Memory drawn from a HandshakeArena between two resets.
+struct ArenaUsage {
+  std::size_t bytes = 0;  // Including alignment padding.
+  std::size_t allocations = 0;
+  std::size_t overflow_bytes = 0;  // Part of `bytes` taken from the upstream resource.
+};
+
+// Receives the usage of every handshake as its arena is reset; record the
+// largest `bytes` per terminal model to size the buffer.
+class ArenaListener {
+ public:
+  virtual ~ArenaListener() = default;
+  virtual void OnReset(const ArenaUsage& usage) = 0;
+};
+
+// Monotonic memory resource for the scratch models of one handshake.
+//
+// Allocations bump a pointer through the caller's buffer and deallocation is
+// a no-op; Reset() reclaims everything at once, so a device that runs for
+// months never fragments its heap. Requests that no longer fit go to
+// `upstream` (counted as overflow) and are returned to it by Reset(). Pass a
+// null_memory_resource() upstream to make overflow fail instead. Not
+// thread-safe; use one arena per engine.
+class HandshakeArena : public std::pmr::memory_resource {
+ public:
+  HandshakeArena(void* buffer,
+                 std::size_t size,
+                 std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+  // Reports the usage since the last reset to the listener, then rewinds.
+  void Reset();
+
+  // Optional; not owned.
+  void SetListener(ArenaListener* listener) { listener_ = listener; }
+
+  const ArenaUsage& usage() const { return usage_; }
+  // The reset interval with the most bytes since construction.
+  const ArenaUsage& peak() const { return peak_; }
+  std::size_t capacity() const { return size_; }
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void* /*ptr*/, std::size_t /*bytes*/, std::size_t /*alignment*/) override {}
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+  unsigned char* buffer_;
+  std::size_t size_;
+  std::size_t offset_ = 0;
+  std::pmr::monotonic_buffer_resource overflow_;
+  ArenaUsage usage_;
+  ArenaUsage peak_;
+  ArenaListener* listener_ = nullptr;
+};
+
+}  // namespace offline_wallet
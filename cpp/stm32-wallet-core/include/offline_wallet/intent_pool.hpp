@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+// Pre-generated intent identifiers for OfflineEngine::SetIntentPool.
+//
+// Refill() draws the tx_id, merchant intent ID and merchant nonce of up to
+// `depth` future intents from the random provider and asks the journal to
+// Reserve() room for as many records, so BuildMerchantIntent only has to sign
+// and append once the amount is known. Nothing beyond the IDs can be signed
+// ahead: the signature covers the amount and expiry. Call Refill() from the
+// idle loop on the engine's thread; the pool is not synchronized. An empty
+// pool makes the engine fall back to generating IDs inline.
+class IntentPool {
+ public:
+  IntentPool(RandomProvider* random_provider, TransactionJournal* journal, std::size_t depth);
+
+  // Adds at most `budget` entries and returns how many were added; none
+  // while the random provider is not Ready().
+  std::size_t Refill(std::size_t budget = std::numeric_limits<std::size_t>::max());
+
+  // Moves the oldest entry into the intent's tx_id, merchant_intent_id and
+  // merchant_nonce. Returns false when the pool is empty.
+  bool Take(PaymentIntent* intent);
+
+  bool NeedsRefill() const { return count_ < entries_.size(); }
+  std::size_t size() const { return count_; }
+  std::size_t depth() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    std::string tx_id;
+    std::string merchant_intent_id;
+    std::string merchant_nonce;
+  };
+
+  RandomProvider* random_provider_;
+  TransactionJournal* journal_;
+  std::vector<Entry> entries_;
+  std::size_t first_ = 0;
+  std::size_t count_ = 0;
+};
+
+}  // namespace offline_wallet
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <string>
+#include <string_view>
 
 #include "offline_wallet/models.hpp"
 
@@ -20,6 +23,20 @@ class RandomProvider {
  public:
   virtual ~RandomProvider() = default;
   virtual std::string NextHex(std::size_t bytes) = 0;
+
+  // Writes at most 2 * bytes hex digits to hex_out and returns how many. The
+  // default copies NextHex(); providers override it to skip the allocation.
+  virtual std::size_t FillHex(std::size_t bytes, char* hex_out) {
+    const std::string hex = NextHex(bytes);
+    const std::size_t size = std::min(hex.size(), 2 * bytes);
+    std::memcpy(hex_out, hex.data(), size);
+    return size;
+  }
+
+  // False while the provider has nothing safe to draw from, e.g. a DRBG
+  // whose entropy source has not come up yet. The engine refuses handshakes
+  // until it holds.
+  virtual bool Ready() { return true; }
 };
 
 class ClockProvider {
@@ -28,6 +45,19 @@ class ClockProvider {
   virtual std::uint64_t NowUnixSeconds() const = 0;
 };
 
+class JournalVisitor {
+ public:
+  virtual ~JournalVisitor() = default;
+  virtual void Visit(const LocalTransaction& tx) = 0;
+};
+
+// One entry of a bulk state change, e.g. a backend sync result.
+struct StateUpdate {
+  std::string tx_id;
+  TransactionState state = TransactionState::kSynced;
+  std::string reason;
+};
+
 class TransactionJournal {
  public:
   virtual ~TransactionJournal() = default;
@@ -36,6 +66,55 @@ class TransactionJournal {
   virtual bool UpdateState(const std::string& tx_id,
                            TransactionState state,
                            const std::string& reason) = 0;
+
+  // Group commit. Records staged after BeginBatch() are visible to Load() at
+  // once but become durable only at CommitBatch(), all together or not at
+  // all. The defaults write each staged record through, so every journal
+  // accepts the calls; override them to coalesce flash writes.
+  virtual bool BeginBatch() { return true; }
+  virtual bool Stage(const LocalTransaction& tx) { return Save(tx); }
+  virtual bool CommitBatch() { return true; }
+  // Forgets staged records that were never committed.
+  virtual void AbortBatch() {}
+
+  // Applies `count` state changes as one group commit. Unknown tx_ids and
+  // records already in the requested state and reason are skipped, so a
+  // result set can be applied again after a failure. Returns false when a
+  // write failed.
+  virtual bool UpdateStates(const StateUpdate* updates, std::size_t count) {
+    if (!BeginBatch()) {
+      return false;
+    }
+    LocalTransaction tx;
+    for (std::size_t i = 0; i < count; ++i) {
+      if (!Load(updates[i].tx_id, &tx) ||
+          (tx.state == updates[i].state && std::string_view(tx.failure_reason) == updates[i].reason)) {
+        continue;
+      }
+      tx.state = updates[i].state;
+      tx.failure_reason = updates[i].reason;
+      if (!Stage(tx)) {
+        AbortBatch();
+        return false;
+      }
+    }
+    return CommitBatch();
+  }
+
+  // Idle-time preparation for `records` upcoming appends, so that they do no
+  // maintenance work (such as compaction) on the critical path. Returns false
+  // when that much room cannot be secured; appends may still succeed.
+  virtual bool Reserve(std::size_t records) {
+    (void)records;
+    return true;
+  }
+
+  // Streams the newest version of every stored transaction once, in no
+  // particular order. Returns false when the journal cannot enumerate.
+  virtual bool ForEach(JournalVisitor* visitor) const {
+    (void)visitor;
+    return false;
+  }
 };
 
 }  // namespace offline_wallet
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace offline_wallet {
+
+// ISO-8601 UTC the way JavaScript's Date.prototype.toISOString() prints it,
+// e.g. 2023-11-14T22:13:20.000Z, which is what the backend stores.
+constexpr std::size_t kIsoTimestampSize = 24;
+
+// Writes exactly kIsoTimestampSize characters, without a terminator.
+void FormatIsoTimestamp(std::uint64_t epoch_seconds, char* out);
+// Accepts YYYY-MM-DDTHH:MM:SS with an optional fraction and a Z suffix, from
+// 1970 on; the fraction is dropped.
+bool ParseIsoTimestamp(std::string_view text, std::uint64_t* epoch_seconds_out);
+
+}  // namespace offline_wallet
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace offline_wallet {
 
@@ -21,72 +24,212 @@ struct RiskPolicy {
   std::uint32_t intent_ttl_seconds = 30;
 };
 
+// A std::pmr::string that still converts to and compares with std::string,
+// so code written against the former std::string fields (map keys,
+// `const std::string&` parameters) keeps compiling. The conversion copies to
+// the heap; hot paths should read the field as a std::string_view instead.
+class ModelString : public std::pmr::string {
+ public:
+  using std::pmr::string::basic_string;
+  using std::pmr::string::operator=;
+
+  ModelString() = default;
+  ModelString(const ModelString&) = default;
+  ModelString(ModelString&&) = default;
+  ModelString(const ModelString& other, const allocator_type& alloc) : std::pmr::string(other, alloc) {}
+  ModelString& operator=(const ModelString&) = default;
+  ModelString& operator=(ModelString&&) = default;
+
+  operator std::string() const { return std::string(data(), size()); }
+
+  // Templates so that only an exact std::string picks these; everything else
+  // keeps using the std::basic_string comparisons.
+  template <typename String, typename = std::enable_if_t<std::is_same_v<String, std::string>>>
+  friend bool operator==(const ModelString& lhs, const String& rhs) {
+    return std::string_view(lhs) == std::string_view(rhs);
+  }
+  template <typename String, typename = std::enable_if_t<std::is_same_v<String, std::string>>>
+  friend bool operator==(const String& lhs, const ModelString& rhs) {
+    return std::string_view(lhs) == std::string_view(rhs);
+  }
+  template <typename String, typename = std::enable_if_t<std::is_same_v<String, std::string>>>
+  friend bool operator!=(const ModelString& lhs, const String& rhs) {
+    return std::string_view(lhs) != std::string_view(rhs);
+  }
+  template <typename String, typename = std::enable_if_t<std::is_same_v<String, std::string>>>
+  friend bool operator!=(const String& lhs, const ModelString& rhs) {
+    return std::string_view(lhs) != std::string_view(rhs);
+  }
+};
+
+// Text fields are ModelString. Default-constructed models allocate from
+// std::pmr::get_default_resource() (the global heap unless changed); the
+// handshake models also take an allocator that places every field in one
+// resource. Copies made without an allocator go to the default resource, so a
+// model copied out of an arena never points into it.
 struct DeviceContext {
-  std::string account_id;
-  std::string device_id;
-  std::string signing_key_id;
+  ModelString account_id;
+  ModelString device_id;
+  ModelString signing_key_id;
   std::uint32_t local_counter = 0;
 };
 
 struct PaymentIntent {
-  std::string tx_id;
-  std::string merchant_intent_id;
-  std::string merchant_account_id;
-  std::string merchant_device_id;
+  using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+  PaymentIntent() = default;
+  explicit PaymentIntent(allocator_type alloc)
+      : tx_id(alloc),
+        merchant_intent_id(alloc),
+        merchant_account_id(alloc),
+        merchant_device_id(alloc),
+        currency("CNY", alloc),
+        merchant_nonce(alloc),
+        merchant_signature(alloc) {}
+  PaymentIntent(const PaymentIntent& other, allocator_type alloc) : PaymentIntent(alloc) {
+    *this = other;
+  }
+  PaymentIntent(const PaymentIntent&) = default;
+  PaymentIntent(PaymentIntent&&) = default;
+  PaymentIntent& operator=(const PaymentIntent&) = default;
+  PaymentIntent& operator=(PaymentIntent&&) = default;
+
+  ModelString tx_id;
+  ModelString merchant_intent_id;
+  ModelString merchant_account_id;
+  ModelString merchant_device_id;
   std::int32_t amount_cents = 0;
-  std::string currency = "CNY";
-  std::string merchant_nonce;
+  ModelString currency = "CNY";
+  ModelString merchant_nonce;
   std::uint32_t merchant_counter = 0;
   std::uint64_t issued_at_epoch_seconds = 0;
   std::uint64_t expires_at_epoch_seconds = 0;
-  std::string merchant_signature;
+  ModelString merchant_signature;
 };
 
 struct PaymentAuthorization {
-  std::string tx_id;
-  std::string merchant_intent_id;
-  std::string payer_authorization_id;
-  std::string payer_account_id;
-  std::string payer_device_id;
+  using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+  PaymentAuthorization() = default;
+  explicit PaymentAuthorization(allocator_type alloc)
+      : tx_id(alloc),
+        merchant_intent_id(alloc),
+        payer_authorization_id(alloc),
+        payer_account_id(alloc),
+        payer_device_id(alloc),
+        currency("CNY", alloc),
+        payer_nonce(alloc),
+        payer_signature(alloc) {}
+  PaymentAuthorization(const PaymentAuthorization& other, allocator_type alloc) : PaymentAuthorization(alloc) {
+    *this = other;
+  }
+  PaymentAuthorization(const PaymentAuthorization&) = default;
+  PaymentAuthorization(PaymentAuthorization&&) = default;
+  PaymentAuthorization& operator=(const PaymentAuthorization&) = default;
+  PaymentAuthorization& operator=(PaymentAuthorization&&) = default;
+
+  ModelString tx_id;
+  ModelString merchant_intent_id;
+  ModelString payer_authorization_id;
+  ModelString payer_account_id;
+  ModelString payer_device_id;
   std::int32_t amount_cents = 0;
-  std::string currency = "CNY";
-  std::string payer_nonce;
+  ModelString currency = "CNY";
+  ModelString payer_nonce;
   std::uint32_t payer_counter = 0;
   std::uint64_t authorized_at_epoch_seconds = 0;
-  std::string payer_signature;
+  ModelString payer_signature;
 };
 
 struct PaymentReceipt {
-  std::string tx_id;
-  std::string receipt_id;
-  std::string merchant_account_id;
-  std::string payer_account_id;
+  using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+  PaymentReceipt() = default;
+  explicit PaymentReceipt(allocator_type alloc)
+      : tx_id(alloc),
+        receipt_id(alloc),
+        merchant_account_id(alloc),
+        payer_account_id(alloc),
+        currency("CNY", alloc),
+        merchant_signature(alloc) {}
+  PaymentReceipt(const PaymentReceipt& other, allocator_type alloc) : PaymentReceipt(alloc) {
+    *this = other;
+  }
+  PaymentReceipt(const PaymentReceipt&) = default;
+  PaymentReceipt(PaymentReceipt&&) = default;
+  PaymentReceipt& operator=(const PaymentReceipt&) = default;
+  PaymentReceipt& operator=(PaymentReceipt&&) = default;
+
+  ModelString tx_id;
+  ModelString receipt_id;
+  ModelString merchant_account_id;
+  ModelString payer_account_id;
   std::int32_t amount_cents = 0;
-  std::string currency = "CNY";
+  ModelString currency = "CNY";
   TransactionState status = TransactionState::kPendingSync;
   std::uint64_t created_at_epoch_seconds = 0;
-  std::string merchant_signature;
+  ModelString merchant_signature;
+  // Position in the merchant's ReceiptChain when the receipt is covered by a
+  // signed checkpoint instead of merchant_signature; 0 otherwise.
+  // FixedPaymentReceipt does not carry it.
+  std::uint64_t chain_position = 0;
 };
 
 struct LocalTransaction {
-  std::string tx_id;
-  std::string merchant_account_id;
-  std::string payer_account_id;
-  std::string merchant_device_id;
-  std::string payer_device_id;
+  using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+  LocalTransaction() = default;
+  explicit LocalTransaction(allocator_type alloc)
+      : tx_id(alloc),
+        merchant_account_id(alloc),
+        payer_account_id(alloc),
+        merchant_device_id(alloc),
+        payer_device_id(alloc),
+        currency("CNY", alloc),
+        merchant_intent_id(alloc),
+        payer_authorization_id(alloc),
+        merchant_nonce(alloc),
+        payer_nonce(alloc),
+        failure_reason(alloc),
+        idempotency_key(alloc),
+        merchant_signature(alloc),
+        payer_signature(alloc) {}
+  LocalTransaction(const LocalTransaction& other, allocator_type alloc) : LocalTransaction(alloc) {
+    *this = other;
+  }
+  LocalTransaction(const LocalTransaction&) = default;
+  LocalTransaction(LocalTransaction&&) = default;
+  LocalTransaction& operator=(const LocalTransaction&) = default;
+  LocalTransaction& operator=(LocalTransaction&&) = default;
+
+  ModelString tx_id;
+  ModelString merchant_account_id;
+  ModelString payer_account_id;
+  ModelString merchant_device_id;
+  ModelString payer_device_id;
   std::int32_t amount_cents = 0;
-  std::string currency = "CNY";
-  std::string merchant_intent_id;
-  std::string payer_authorization_id;
-  std::string merchant_nonce;
-  std::string payer_nonce;
+  ModelString currency = "CNY";
+  ModelString merchant_intent_id;
+  ModelString payer_authorization_id;
+  ModelString merchant_nonce;
+  ModelString payer_nonce;
   std::uint32_t merchant_counter = 0;
   std::uint32_t payer_counter = 0;
   TransactionState state = TransactionState::kInitiated;
-  std::string failure_reason;
+  ModelString failure_reason;
   std::uint64_t created_at_epoch_seconds = 0;
   std::uint64_t updated_at_epoch_seconds = 0;
-  std::string idempotency_key;
+  ModelString idempotency_key;
+  // Position in the journal's write order, stamped over the caller's value on
+  // every write by journals that keep one (FlashJournal); 0 otherwise.
+  std::uint64_t sequence = 0;
+  // Handshake evidence the backend re-checks at sync. FixedLocalTransaction
+  // does not carry these fields.
+  std::uint64_t intent_issued_at_epoch_seconds = 0;
+  std::uint64_t authorized_at_epoch_seconds = 0;
+  std::uint64_t expires_at_epoch_seconds = 0;
+  ModelString merchant_signature;
+  ModelString payer_signature;
 };
 
 }  // namespace offline_wallet
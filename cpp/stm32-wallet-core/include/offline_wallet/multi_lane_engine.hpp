@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/signature_stream.hpp"
+
+namespace offline_wallet {
+
+// The signing and random contexts of one lane. Set exactly one of the two
+// signers.
+struct LaneProviders {
+  std::unique_ptr<SignatureProvider> signer;
+  std::unique_ptr<StreamingSignatureProvider> streaming_signer;
+  std::unique_ptr<RandomProvider> random;
+};
+
+// Creates the providers of each lane. Lanes never share them, so they need
+// no locking, but their random streams must be independent.
+class LaneProviderFactory {
+ public:
+  virtual ~LaneProviderFactory() = default;
+  virtual LaneProviders Create(std::size_t lane) = 0;
+};
+
+// OfflineEngine for hubs where one process serves many checkout lanes.
+//
+// Each lane is an OfflineEngine with its own signer and random provider,
+// driven by one thread at a time; different lanes run in parallel without
+// taking any lock of their own. What the lanes share must be thread-safe: the
+// clock, and the journal, typically a ShardedJournal so that only handshakes
+// whose tx_ids hash to the same shard ever wait for each other. Optional
+// collaborators (replay filter, spend tracker, intent pool, arena, trace
+// sink) are not synchronized; attach them per lane through lane().
+class MultiLaneEngine {
+ public:
+  MultiLaneEngine(RiskPolicy policy,
+                  std::size_t lanes,
+                  LaneProviderFactory* factory,
+                  ClockProvider* clock_provider,
+                  TransactionJournal* journal);
+
+  MultiLaneEngine(const MultiLaneEngine&) = delete;
+  MultiLaneEngine& operator=(const MultiLaneEngine&) = delete;
+
+  OfflineEngine& lane(std::size_t index) { return *lanes_[index].engine; }
+  std::size_t lane_count() const { return lanes_.size(); }
+
+ private:
+  struct Lane {
+    LaneProviders providers;
+    std::unique_ptr<OfflineEngine> engine;
+  };
+
+  std::vector<Lane> lanes_;
+};
+
+}  // namespace offline_wallet
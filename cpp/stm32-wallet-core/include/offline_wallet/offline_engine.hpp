@@ -1,9 +1,19 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
+#include "offline_wallet/expiry_sweeper.hpp"
+#include "offline_wallet/handshake_arena.hpp"
+#include "offline_wallet/intent_pool.hpp"
 #include "offline_wallet/interfaces.hpp"
 #include "offline_wallet/models.hpp"
+#include "offline_wallet/receipt_chain.hpp"
+#include "offline_wallet/replay_filter.hpp"
+#include "offline_wallet/signature_stream.hpp"
+#include "offline_wallet/spend_tracker.hpp"
+#include "offline_wallet/trace.hpp"
 
 namespace offline_wallet {
 
@@ -15,6 +25,9 @@ enum class HandshakeStatus {
   kJournalFailure,
   kUnknownTransaction,
   kMismatch,
+  kReplayDetected,
+  kSignatureInvalid,
+  kRandomUnavailable,
 };
 
 struct HandshakeResult {
@@ -22,6 +35,88 @@ struct HandshakeResult {
   std::string message;
 };
 
+class OfflineEngine;
+
+// What a HandshakeSession needs from its caller before it can continue.
+enum class SessionWait {
+  kNone,          // Not started, or finished; see result().
+  kSignature,     // Sign message() with key_id(), then call CompleteSignature().
+  kJournalWrite,  // Save record() to the journal, then call CompleteJournalWrite().
+};
+
+// One handshake run step by step by the OfflineEngine::Start* calls.
+//
+// Instead of blocking on the signer or the journal, the session stops and
+// reports what it waits for. The caller hands that work to a crypto
+// accelerator or a flash task and reports the completion, which runs the
+// handshake up to its next wait; in between, a cooperative scheduler is free
+// to scan, refresh the display, or advance other sessions. Sessions are not
+// movable, must not outlive their engine, and are abandoned when destroyed or
+// restarted mid-handshake.
+class HandshakeSession {
+ public:
+  HandshakeSession() = default;
+  ~HandshakeSession();
+  HandshakeSession(const HandshakeSession&) = delete;
+  HandshakeSession& operator=(const HandshakeSession&) = delete;
+
+  SessionWait wait() const { return wait_; }
+  bool done() const { return step_ == Step::kDone; }
+
+  // While waiting for a signature: the bytes the blocking calls stream into
+  // their signer, and the key to sign them with.
+  const std::string& message() const { return message_; }
+  const std::string& key_id() const { return key_id_; }
+  // While waiting for a journal write: the row to save.
+  const LocalTransaction& record() const { return tx_; }
+
+  // Each returns false, changing nothing, when the session is not waiting for
+  // that completion.
+  bool CompleteSignature(const std::string& signature);
+  bool CompleteJournalWrite(bool persisted);
+
+  // Valid once done(). A merchant intent fills intent() and transaction(), a
+  // payer authorization authorization() and transaction(), and an acceptance
+  // receipt() and transaction().
+  const HandshakeResult& result() const { return result_; }
+  const PaymentIntent& intent() const { return intent_; }
+  const PaymentAuthorization& authorization() const { return authorization_; }
+  const PaymentReceipt& receipt() const { return receipt_; }
+  const LocalTransaction& transaction() const { return tx_; }
+
+ private:
+  friend class OfflineEngine;
+
+  enum class Step {
+    kIdle,
+    kSignIntent,
+    kWriteIntent,
+    kSignAuthorization,
+    kWriteAuthorization,
+    kWriteAcceptance,
+    kSignReceipt,
+    kDone,
+  };
+
+  OfflineEngine* engine_ = nullptr;
+  HandshakeSession* next_in_flight_ = nullptr;
+  bool in_flight_ = false;
+  Step step_ = Step::kIdle;
+  SessionWait wait_ = SessionWait::kNone;
+  std::uint64_t now_ = 0;
+  // Passed the daily-limit check but not yet in the spend tracker.
+  std::int64_t pending_spend_cents_ = 0;
+  DeviceContext device_;
+  PaymentIntent intent_;
+  PaymentAuthorization authorization_;
+  PaymentReceipt receipt_;
+  LocalTransaction tx_;
+  std::string message_;
+  std::string key_id_;
+  std::string signature_;
+  HandshakeResult result_;
+};
+
 class OfflineEngine {
  public:
   OfflineEngine(RiskPolicy policy,
@@ -30,6 +125,77 @@ class OfflineEngine {
                 ClockProvider* clock_provider,
                 TransactionJournal* journal);
 
+  // Signs through an incremental provider; fields are streamed into it
+  // without building an intermediate message.
+  OfflineEngine(RiskPolicy policy,
+                StreamingSignatureProvider* signature_provider,
+                RandomProvider* random_provider,
+                ClockProvider* clock_provider,
+                TransactionJournal* journal);
+
+  // Merchant-side group commit. The intent record is staged instead of saved,
+  // and AcceptAuthorization commits it together with the acceptance, so a sale
+  // costs one durable journal write. A power loss in between only forgets an
+  // unanswered intent; no receipt is returned before the commit succeeds. A
+  // rejected acceptance commits the staged intent alone, and a failed write
+  // aborts the batch, so none stays open under the next sale.
+  void SetGroupCommit(bool enabled) { group_commit_ = enabled; }
+
+  // Peer signature checks. BuildPayerAuthorization then verifies the
+  // merchant signature against intent.merchant_device_id, and
+  // AcceptAuthorization the payer signature against
+  // authorization.payer_device_id, both through the signer's verify call, so
+  // the provider must resolve device ids to public keys (see
+  // Ed25519SignatureProvider::AddPublicKey). A bad signature fails the call
+  // with kSignatureInvalid before anything is persisted.
+  void SetVerifyPeerSignatures(bool enabled) { verify_peer_signatures_ = enabled; }
+
+  // Optional; when set, AcceptAuthorization refuses replayed payer
+  // authorizations before touching the journal. Not owned.
+  void SetReplayFilter(ReplayFilter* filter) { replay_filter_ = filter; }
+
+  // Optional; when set, BuildPayerAuthorization and AcceptAuthorization
+  // enforce RiskPolicy::max_per_day_per_payer_cents and record each persisted
+  // payment. Not owned.
+  void SetSpendTracker(SpendTracker* tracker) { spend_tracker_ = tracker; }
+
+  // Optional; every persisted merchant intent is tracked so that the sweeper
+  // can expire it if it is never answered. Not owned.
+  void SetExpirySweeper(ExpirySweeper* sweeper) { expiry_sweeper_ = sweeper; }
+
+  // Optional; BuildMerchantIntent takes pre-generated IDs from the pool while
+  // it has any. The pool must draw from this engine's RandomProvider. Not owned.
+  void SetIntentPool(IntentPool* pool) { intent_pool_ = pool; }
+
+  // Optional; receipts are then folded into the chain instead of signed one
+  // by one: each gets a chain_position and no merchant_signature, and
+  // AcceptAuthorization signs a checkpoint whenever the chain has one due.
+  // Not owned.
+  void SetReceiptChain(ReceiptChain* chain) { receipt_chain_ = chain; }
+
+  // Signs the receipts still open in the chain. Call it from the idle loop
+  // when ReceiptChain::CheckpointDue() (the step-wise calls never sign
+  // checkpoints) and before a planned power-down. Returns false when there
+  // is no chain or nothing to sign.
+  bool SealReceiptCheckpoint(const DeviceContext& merchant);
+
+  // Optional; receives begin/end events for each handshake call and for the
+  // signing, random, and journal calls inside it. Not owned. Does nothing
+  // when built with OFFLINE_WALLET_TRACING=0.
+  void SetTraceSink(TraceSink* sink) {
+#if OFFLINE_WALLET_TRACING
+    trace_sink_ = sink;
+#else
+    (void)sink;
+#endif
+  }
+
+  // Optional; the models each handshake call builds before copying them to
+  // the caller come from this arena, which the call resets on return, so a
+  // handshake touches the global heap only inside the providers. Outputs
+  // keep their own allocators. Not owned.
+  void SetHandshakeArena(HandshakeArena* arena) { arena_ = arena; }
+
   HandshakeResult BuildMerchantIntent(const DeviceContext& merchant,
                                       std::int32_t amount_cents,
                                       const std::string& currency,
@@ -46,15 +212,121 @@ class OfflineEngine {
                                       PaymentReceipt* receipt_out,
                                       LocalTransaction* tx_out);
 
+  // Step-wise variants of the calls above; see HandshakeSession. Each returns
+  // with `session` waiting for its first signature or journal write, or
+  // already done when a check fails. Records are written as plain saves:
+  // group commit and the arena apply to the blocking calls only. Replay and
+  // daily-limit checks, in both forms, also count sessions still in flight.
+  void StartMerchantIntent(const DeviceContext& merchant,
+                           std::int32_t amount_cents,
+                           const std::string& currency,
+                           HandshakeSession* session);
+  void StartPayerAuthorization(const DeviceContext& payer,
+                               const PaymentIntent& intent,
+                               HandshakeSession* session);
+  void StartAcceptAuthorization(const DeviceContext& merchant,
+                                const PaymentAuthorization& authorization,
+                                HandshakeSession* session);
+
  private:
-  std::string BuildIntentSignatureMessage(const PaymentIntent& intent) const;
-  std::string BuildAuthorizationSignatureMessage(const PaymentAuthorization& authorization) const;
+  friend class HandshakeSession;
+
+  HandshakeResult DoBuildMerchantIntent(const DeviceContext& merchant,
+                                        std::int32_t amount_cents,
+                                        const std::string& currency,
+                                        PaymentIntent* intent_out,
+                                        LocalTransaction* tx_out);
+  HandshakeResult DoBuildPayerAuthorization(const DeviceContext& payer,
+                                            const PaymentIntent& intent,
+                                            PaymentAuthorization* authorization_out,
+                                            LocalTransaction* tx_out);
+  HandshakeResult DoAcceptAuthorization(const DeviceContext& merchant,
+                                        const PaymentAuthorization& authorization,
+                                        PaymentReceipt* receipt_out,
+                                        LocalTransaction* tx_out);
+  // Phases shared by the blocking and the step-wise calls.
+  HandshakeResult PrepareIntent(const DeviceContext& merchant,
+                                std::int32_t amount_cents,
+                                const std::string& currency,
+                                PaymentIntent* intent);
+  void BuildIntentRecord(const DeviceContext& merchant, const PaymentIntent& intent, LocalTransaction* tx);
+  HandshakeResult PrepareAuthorization(const DeviceContext& payer,
+                                       const PaymentIntent& intent,
+                                       PaymentAuthorization* authorization);
+  void BuildAuthorizationRecord(const PaymentIntent& intent,
+                                const PaymentAuthorization& authorization,
+                                LocalTransaction* tx);
+  // Loads the merchant row into `tx` and updates it for acceptance.
+  HandshakeResult PrepareAcceptance(const PaymentAuthorization& authorization,
+                                    LocalTransaction* tx,
+                                    std::uint64_t* now_out);
+  void RecordAcceptance(const PaymentAuthorization& authorization, std::uint64_t now);
+  void BuildReceipt(const DeviceContext& merchant,
+                    const PaymentAuthorization& authorization,
+                    std::uint64_t now,
+                    PaymentReceipt* receipt);
+  std::int64_t InFlightSpend(std::string_view payer_account_id) const;
+  bool AcceptanceInFlight(std::string_view tx_id) const;
+
+  // Session bookkeeping for the Start* calls.
+  void BeginSession(HandshakeSession* session);
+  void AwaitSignature(HandshakeSession* session,
+                      HandshakeSession::Step step,
+                      const std::pmr::string& key_id);
+  void AwaitJournalWrite(HandshakeSession* session, HandshakeSession::Step step);
+  void ResumeAfterSignature(HandshakeSession* session);
+  void ResumeAfterJournalWrite(HandshakeSession* session, bool persisted);
+  void FinishSession(HandshakeSession* session, HandshakeResult result);
+  void Link(HandshakeSession* session);
+  void Unlink(HandshakeSession* session);
+
+  // Writes prefix plus 16 random hex digits into key_out's storage.
+  void NextKey(const char* prefix, std::pmr::string* key_out);
+  void SignIntent(const PaymentIntent& intent,
+                  const std::pmr::string& key_id,
+                  std::pmr::string* signature_out);
+  void SignAuthorization(const PaymentAuthorization& authorization,
+                         const std::pmr::string& key_id,
+                         std::pmr::string* signature_out);
+  void SignReceipt(const PaymentReceipt& receipt,
+                   const std::pmr::string& payer_authorization_id,
+                   const std::pmr::string& key_id,
+                   std::pmr::string* signature_out);
+  bool VerifyIntent(const PaymentIntent& intent);
+  bool VerifyAuthorization(const PaymentAuthorization& authorization);
+  void AppendToReceiptChain(const PaymentAuthorization& authorization, PaymentReceipt* receipt);
+  // Starts a signature with the key in key_scratch_.
+  StreamingSignatureProvider* BeginSign(const std::pmr::string& key_id);
+  void FinishSign(StreamingSignatureProvider* signer, std::pmr::string* signature_out);
+  StreamingSignatureProvider* BeginVerify(const std::pmr::string& device_id);
+  bool FinishVerify(StreamingSignatureProvider* verifier, const std::pmr::string& signature);
+  StreamingSignatureProvider* Signer();
+  std::pmr::memory_resource* ScratchResource();
+  void ResetArena();
 
   RiskPolicy policy_;
-  SignatureProvider* signature_provider_;
+  SignatureProviderBridge signature_bridge_;
+  StreamingSignatureProvider* streaming_signer_;
   RandomProvider* random_provider_;
   ClockProvider* clock_provider_;
   TransactionJournal* journal_;
+  bool group_commit_ = false;
+  bool verify_peer_signatures_ = false;
+  ReplayFilter* replay_filter_ = nullptr;
+  SpendTracker* spend_tracker_ = nullptr;
+  IntentPool* intent_pool_ = nullptr;
+  ExpirySweeper* expiry_sweeper_ = nullptr;
+  ReceiptChain* receipt_chain_ = nullptr;
+  ReceiptCheckpoint checkpoint_scratch_;
+  HandshakeArena* arena_ = nullptr;
+  HandshakeSession* in_flight_ = nullptr;
+  // Provider-facing copies; they keep their capacity between handshakes.
+  std::string key_scratch_;
+  std::string tx_id_scratch_;
+  std::string signature_scratch_;
+#if OFFLINE_WALLET_TRACING
+  TraceSink* trace_sink_ = nullptr;
+#endif
 };
 
 }  // namespace offline_wallet
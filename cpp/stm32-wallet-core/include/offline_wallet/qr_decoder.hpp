@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "offline_wallet/fixed_models.hpp"
+#include "offline_wallet/models.hpp"
+#include "offline_wallet/qr_symbol.hpp"
+
+namespace offline_wallet {
+
+// 8-bit luma frame, rows `stride` bytes apart (stride >= width).
+struct QrFrame {
+  const std::uint8_t* pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  std::size_t stride = 0;
+};
+
+struct QrDecoderOptions {
+  // Largest frame Decode accepts; all buffers are sized for it up front.
+  int max_width = 640;
+  int max_height = 480;
+  // Rows scanned for finder patterns: every `row_step`-th, halved
+  // automatically while nothing is found.
+  int row_step = 2;
+};
+
+enum class QrDecodeStatus {
+  kOk,
+  kInvalidArgument,
+  kFrameTooLarge,
+  // No three finder patterns forming a symbol.
+  kNotFound,
+  kFormatUnreadable,
+  kUncorrectable,
+  // A segment other than byte mode (ECI, numeric, kanji, ...).
+  kUnsupportedMode,
+  kBufferTooSmall,
+  // The symbol decoded but is not the expected wire message.
+  kWrongPayload,
+};
+
+struct QrDecodeInfo {
+  int version = 0;
+  QrEcc ecc = QrEcc::kMedium;
+  int mask = 0;
+  // Codeword bytes repaired by Reed-Solomon across all blocks.
+  std::size_t corrected_bytes = 0;
+};
+
+// QR model 2 decoder for grayscale camera frames, the cashier side of the
+// handshake: DecodeAuthorization turns a frame showing the payer's
+// authorization QR into the PaymentAuthorization OfflineEngine and
+// FixedOfflineEngine accept.
+//
+// Pipeline: block-adaptive binarization (midrange of the 8x8 block extremes
+// over 5x5 blocks, robust to uneven lighting and blur), 1:1:3:1:1 finder
+// search with vertical/horizontal cross-checks, orientation from the three
+// finder centres (any in-plane rotation), module sampling through a
+// homography anchored on the finders and the bottom-right alignment pattern,
+// BCH format/version recovery, and per-block Reed-Solomon correction. Only
+// the one alignment pattern is used, so strong perspective on large versions
+// is not tracked; hold the payer screen roughly parallel to the camera.
+//
+// Every buffer is allocated once by the constructor and reused for each
+// frame; the per-pixel passes are branch-free loops over contiguous rows so
+// the compiler can vectorize them. Not thread-safe.
+class QrDecoder {
+ public:
+  explicit QrDecoder(const QrDecoderOptions& options = {});
+
+  // Writes the byte-mode payload of the symbol in `frame`.
+  QrDecodeStatus Decode(const QrFrame& frame,
+                        std::uint8_t* payload,
+                        std::size_t capacity,
+                        std::size_t* size_out,
+                        QrDecodeInfo* info_out = nullptr);
+
+  // Decode followed by wire_codec DecodeAuthorization.
+  QrDecodeStatus DecodeAuthorization(const QrFrame& frame,
+                                     PaymentAuthorization* authorization_out,
+                                     QrDecodeInfo* info_out = nullptr);
+  QrDecodeStatus DecodeAuthorization(const QrFrame& frame,
+                                     FixedPaymentAuthorization* authorization_out,
+                                     QrDecodeInfo* info_out = nullptr);
+
+ private:
+  struct Point {
+    float x = 0;
+    float y = 0;
+  };
+
+  struct Finder {
+    Point centre;
+    float module_size = 0;
+    int hits = 0;
+  };
+
+  static constexpr int kBlockSize = 8;
+  static constexpr int kMaxFinders = 32;
+
+  void Binarize(const QrFrame& frame);
+  bool Dark(int x, int y) const { return binary_[static_cast<std::size_t>(y) * width_ + x] != 0; }
+  void FindFinders(int row_step);
+  bool CheckFinder(const int* runs, int x_end, int y);
+  float CrossCheckVertical(int x, int y, int max_run, int total) const;
+  float CrossCheckHorizontal(int x, int y, int max_run, int total) const;
+  bool SelectFinders(Point* top_left, Point* top_right, Point* bottom_left, float* module_size) const;
+  bool FindAlignment(const Point& estimate, float module_size, Point* centre) const;
+  float CrossCheckAlignment(int x, int y, int dx, int dy, float module_size) const;
+  bool SampleGrid(const Point& top_left, const Point& top_right, const Point& bottom_left, int version);
+  int ReadVersion(int size) const;
+  QrDecodeStatus ReadSymbol(int version,
+                            std::uint8_t* payload,
+                            std::size_t capacity,
+                            std::size_t* size_out,
+                            QrDecodeInfo* info);
+
+  QrDecoderOptions options_;
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<std::uint8_t> binary_;         // 1 = dark, one byte per pixel
+  std::vector<std::uint8_t> block_min_;      // per 8x8 block
+  std::vector<std::uint8_t> block_max_;
+  std::vector<std::uint8_t> column_min_;     // per column, one block row
+  std::vector<std::uint8_t> column_max_;
+  std::vector<std::uint8_t> row_threshold_;  // per pixel, current row
+  Finder finders_[kMaxFinders];
+  int finder_count_ = 0;
+  std::vector<std::uint8_t> grid_;           // sampled modules, QR bitmap layout
+  std::vector<std::uint8_t> function_;       // function-pattern modules, same layout
+  int function_version_ = 0;
+  std::vector<std::uint8_t> codewords_;      // de-interleaved blocks
+  std::vector<std::uint8_t> payload_;        // DecodeAuthorization scratch
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "offline_wallet/qr_symbol.hpp"
+
+namespace offline_wallet {
+
+constexpr int kQrAutoMask = -1;
+
+struct QrEncodeOptions {
+  QrEcc ecc = QrEcc::kMedium;
+  // The smallest version in [min_version, max_version] that fits is used.
+  int min_version = kQrMinVersion;
+  int max_version = kQrMaxVersion;
+  // 0-7 forces a data mask; kQrAutoMask picks the lowest-penalty one.
+  int mask = kQrAutoMask;
+};
+
+struct QrSymbolInfo {
+  int version = 0;
+  int size = 0;
+  QrEcc ecc = QrEcc::kMedium;
+  int mask = 0;
+  std::size_t stride = 0;
+  // ISO/IEC 18004 7.8.3 penalty score of the emitted symbol.
+  std::uint32_t penalty = 0;
+};
+
+enum class QrStatus {
+  kOk,
+  kInvalidArgument,
+  kDataTooLong,
+  kBufferTooSmall,
+};
+
+// Byte-mode QR encoder writing a module bitmap (see qr_symbol.hpp) into a
+// caller buffer; kQrMaxBitmapBytes always suffices.
+//
+// Never allocates: the encoder object is the whole workspace (about 12 KiB:
+// two 177x192-bit module planes plus the codeword buffer), so give it static
+// storage on a microcontroller and reuse it. Rows are kept as 64-bit words so
+// masking is three XORs per row and the mask penalty rules are evaluated with
+// shifts and popcounts instead of per-module scans. Not thread-safe.
+class QrEncoder {
+ public:
+  QrStatus Encode(const std::uint8_t* payload,
+                  std::size_t size,
+                  const QrEncodeOptions& options,
+                  std::uint8_t* bitmap,
+                  std::size_t capacity,
+                  QrSymbolInfo* info_out = nullptr);
+
+ private:
+  static constexpr int kRowWords = 3;
+
+  void WriteDataCodewords(const std::uint8_t* payload,
+                          std::size_t size,
+                          int version,
+                          std::size_t data_codewords);
+  void WriteParity(const QrBlockLayout& layout);
+  void DrawFunctionPatterns(int version, int size);
+  void DrawFormat(QrEcc ecc, int mask, int size);
+  void SetFunctionModule(int x, int y, bool dark);
+  void PlaceCodewords(const QrBlockLayout& layout, int size);
+  void ApplyMask(int mask, int size);
+  std::uint32_t Penalty(int size) const;
+
+  std::uint64_t modules_[kQrMaxSize][kRowWords];
+  // Function-pattern modules, plus every bit past the symbol edge.
+  std::uint64_t function_[kQrMaxSize][kRowWords];
+  std::uint8_t codewords_[kQrMaxCodewords];
+};
+
+}  // namespace offline_wallet
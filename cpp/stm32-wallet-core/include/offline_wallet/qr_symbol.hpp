@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace offline_wallet {
+
+// QR Code model 2 (ISO/IEC 18004) symbol geometry and code tables shared by
+// the encoder and decoder.
+//
+// Symbols travel as 1-bit module bitmaps: row-major, dark = 1, the leftmost
+// module in the most significant bit, rows QrBitmapStride(size) bytes apart,
+// no quiet zone.
+enum class QrEcc : std::uint8_t {
+  kLow,
+  kMedium,
+  kQuartile,
+  kHigh,
+};
+
+constexpr int kQrMinVersion = 1;
+constexpr int kQrMaxVersion = 40;
+constexpr int kQrMaxSize = 177;
+constexpr std::size_t kQrMaxCodewords = 3706;
+constexpr int kQrMaxAlignmentPositions = 7;
+constexpr int kQrMaskCount = 8;
+
+constexpr int QrSymbolSize(int version) { return 4 * version + 17; }
+constexpr std::size_t QrBitmapStride(int size) { return (static_cast<std::size_t>(size) + 7) / 8; }
+constexpr std::size_t QrBitmapBytes(int version) {
+  return QrBitmapStride(QrSymbolSize(version)) * static_cast<std::size_t>(QrSymbolSize(version));
+}
+constexpr std::size_t kQrMaxBitmapBytes = QrBitmapBytes(kQrMaxVersion);
+
+inline bool QrBitmapModule(const std::uint8_t* bitmap, std::size_t stride, int x, int y) {
+  return (bitmap[static_cast<std::size_t>(y) * stride + static_cast<std::size_t>(x) / 8] >> (7 - x % 8)) & 1;
+}
+
+// Codeword split of one version/ECC level. The first `short_blocks` blocks
+// carry `short_block_data` data codewords and the rest one more; every block
+// has `ecc_per_block` parity codewords.
+struct QrBlockLayout {
+  std::size_t total_codewords = 0;
+  std::size_t data_codewords = 0;
+  std::size_t ecc_per_block = 0;
+  std::size_t blocks = 0;
+  std::size_t short_blocks = 0;
+  std::size_t short_block_data = 0;
+};
+
+// `version` must be within [kQrMinVersion, kQrMaxVersion].
+QrBlockLayout QrLayout(int version, QrEcc ecc);
+
+// Largest byte-mode payload of a single-segment symbol.
+std::size_t QrByteCapacity(int version, QrEcc ecc);
+
+// Writes the alignment pattern centre coordinates (shared by both axes) and
+// returns their count; 0 for version 1.
+int QrAlignmentPositions(int version, int positions_out[kQrMaxAlignmentPositions]);
+
+// 15-bit format information, BCH-protected and masked with 0x5412.
+std::uint16_t QrFormatBits(QrEcc ecc, int mask);
+
+// 18-bit version information for versions 7 and up; 0 below.
+std::uint32_t QrVersionBits(int version);
+
+// Whether data mask `mask` inverts the module at column x, row y.
+constexpr bool QrMaskBit(int mask, int x, int y) {
+  switch (mask) {
+    case 0:
+      return (x + y) % 2 == 0;
+    case 1:
+      return y % 2 == 0;
+    case 2:
+      return x % 3 == 0;
+    case 3:
+      return (x + y) % 3 == 0;
+    case 4:
+      return (x / 3 + y / 2) % 2 == 0;
+    case 5:
+      return x * y % 2 + x * y % 3 == 0;
+    case 6:
+      return (x * y % 2 + x * y % 3) % 2 == 0;
+    case 7:
+      return ((x + y) % 2 + x * y % 3) % 2 == 0;
+    default:
+      return false;
+  }
+}
+
+}  // namespace offline_wallet
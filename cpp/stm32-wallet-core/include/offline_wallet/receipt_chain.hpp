@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/models.hpp"
+#include "offline_wallet/sha256.hpp"
+#include "offline_wallet/signature_stream.hpp"
+
+namespace offline_wallet {
+
+struct ReceiptChainOptions {
+  // CheckpointDue() turns true once the open checkpoint holds this many
+  // receipts, or once its first receipt is max_checkpoint_age_seconds old.
+  std::size_t checkpoint_receipts = 64;
+  std::uint64_t max_checkpoint_age_seconds = 300;
+};
+
+// A signed commitment to a run of receipts. The signature covers
+// WriteCheckpointFields(): sequence, first_position, count, and the hex root
+// and previous digests.
+struct ReceiptCheckpoint {
+  std::uint64_t sequence = 0;
+  // Chain position of the first receipt covered; positions start at 1.
+  std::uint64_t first_position = 0;
+  std::uint32_t count = 0;
+  // Merkle root over the covered receipts' leaves.
+  Sha256Digest root{};
+  // CheckpointDigest() of the checkpoint before; all zero for the first.
+  Sha256Digest previous{};
+  std::string signature;
+};
+
+// Siblings from the receipt's leaf up to its checkpoint root. Levels where
+// the node has no sibling (the last node of an odd level) contribute none.
+struct ReceiptProof {
+  std::uint64_t position = 0;
+  std::uint64_t checkpoint = 0;
+  std::vector<Sha256Digest> path;
+};
+
+// Merkle accumulator that stands in for per-receipt signatures.
+//
+// Each receipt contributes a leaf, SHA-256(0x00 || the bytes its merchant
+// signature would cover), to the open checkpoint. CloseCheckpoint() computes
+// the root over the open leaves (RFC 6962 tree shape, interior nodes
+// SHA-256(0x01 || left || right)) and links it to the previous checkpoint's
+// digest, so the merchant signs once per checkpoint instead of once per
+// receipt, and dropping, reordering or editing any receipt or checkpoint
+// breaks a root or a link. The payer or the backend checks a receipt with its
+// ReceiptProof against a checkpoint whose signature it has verified.
+//
+// Proofs are served for the receipts of the last signed checkpoint only;
+// fetch them, e.g. into the sync upload, before the next one is signed.
+// Receipts still open when the device resets are never covered, so seal the
+// open checkpoint before a planned power-down.
+class ReceiptChain {
+ public:
+  explicit ReceiptChain(ReceiptChainOptions options = {});
+
+  // Continues after `last`, e.g. the last checkpoint persisted before a reboot.
+  void Restore(const ReceiptCheckpoint& last);
+
+  // Adds a receipt to the open checkpoint and returns its chain position.
+  std::uint64_t Append(const Sha256Digest& leaf, std::uint64_t now);
+  bool CheckpointDue(std::uint64_t now) const;
+  std::size_t open_receipts() const { return open_.size(); }
+
+  // Fills everything but the signature for the open receipts, which then
+  // await SignCheckpoint(); receipts appended meanwhile open the next
+  // checkpoint. False when nothing is open or a checkpoint already awaits
+  // its signature.
+  bool CloseCheckpoint(ReceiptCheckpoint* checkpoint_out);
+  // Completes the closed checkpoint, which becomes last_checkpoint().
+  bool SignCheckpoint(std::string signature);
+
+  const ReceiptCheckpoint& last_checkpoint() const { return last_; }
+  bool Prove(std::uint64_t position, ReceiptProof* proof_out) const;
+
+ private:
+  Sha256Digest Root(const std::vector<Sha256Digest>& leaves);
+
+  ReceiptChainOptions options_;
+  std::uint64_t next_position_ = 1;
+  std::uint64_t open_since_ = 0;
+  std::vector<Sha256Digest> open_;
+  bool closing_ = false;
+  ReceiptCheckpoint closed_;
+  std::vector<Sha256Digest> closed_leaves_;
+  ReceiptCheckpoint last_;
+  std::vector<Sha256Digest> last_leaves_;
+  mutable std::vector<Sha256Digest> level_;
+};
+
+// Leaf for a receipt; the same bytes the per-receipt merchant signature covers.
+Sha256Digest ReceiptLeaf(const PaymentReceipt& receipt, std::string_view payer_authorization_id);
+void WriteCheckpointFields(const ReceiptCheckpoint& checkpoint, StreamingSignatureProvider* sink);
+// Links the next checkpoint to this one; SHA-256 of WriteCheckpointFields().
+Sha256Digest CheckpointDigest(const ReceiptCheckpoint& checkpoint);
+// Recomputes `checkpoint.root` from the receipt's leaf and `proof`. The
+// checkpoint's signature must be verified separately, over
+// WriteCheckpointFields() with the merchant's key.
+bool VerifyReceiptProof(const Sha256Digest& leaf, const ReceiptProof& proof, const ReceiptCheckpoint& checkpoint);
+
+}  // namespace offline_wallet
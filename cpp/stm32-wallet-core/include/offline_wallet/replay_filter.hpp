@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "offline_wallet/fixed_models.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+struct ReplayFilterOptions {
+  // Each of the two Bloom generations gets this many bytes. With n accepted
+  // authorizations per window the false-replay rate is about
+  // (1 - e^(-k*n/m))^k for m = 8 * bloom_bytes bits.
+  std::size_t bloom_bytes = 2048;
+  std::uint32_t hash_count = 4;
+  // Payer devices whose counter high-water mark is tracked (16 bytes each,
+  // four-way set associative with LRU eviction).
+  std::size_t device_slots = 64;
+  // Counters this far below a device's high-water mark are refused outright.
+  std::uint32_t max_counter_lag = 64;
+};
+
+enum class ReplayVerdict {
+  kFresh,
+  kReplayed,
+  kCounterRegressed,
+  kOutsideWindow,
+};
+
+// Fixed-memory replay detector for payer authorizations, keyed on
+// (payer_device_id, payer_counter, payer_nonce).
+//
+// An authorization is only admissible within intent_ttl + 2 * max_clock_skew
+// of its authorized_at timestamp, so the filter only has to remember that
+// window: two Bloom generations rotate once per window, and anything older is
+// refused as kOutsideWindow. Per-device counter high-water marks additionally
+// refuse counters far behind the newest one seen. Check and Record are O(1);
+// all memory is reserved at construction. A Bloom false positive refuses a
+// genuine authorization, never admits a replay.
+class ReplayFilter {
+ public:
+  explicit ReplayFilter(const RiskPolicy& policy, ReplayFilterOptions options = {});
+
+  ReplayVerdict Check(const PaymentAuthorization& authorization, std::uint64_t now) const;
+  ReplayVerdict Check(const FixedPaymentAuthorization& authorization, std::uint64_t now) const;
+
+  // Remembers an accepted authorization; call once it is durably persisted.
+  void Record(const PaymentAuthorization& authorization, std::uint64_t now);
+  void Record(const FixedPaymentAuthorization& authorization, std::uint64_t now);
+
+  void Clear();
+  std::size_t MemoryBytes() const;
+  std::uint64_t window_seconds() const { return window_seconds_; }
+
+ private:
+  struct DeviceSlot {
+    std::uint64_t device_hash = 0;  // 0 marks an empty slot.
+    std::uint32_t high_water = 0;
+    std::uint32_t last_used = 0;
+  };
+
+  struct Key {
+    std::uint64_t device_hash;
+    std::uint64_t entry_hash;
+    std::uint32_t counter;
+    std::uint64_t authorized_at;
+  };
+
+  static Key MakeKey(const char* device_id,
+                     std::size_t device_id_size,
+                     std::uint32_t counter,
+                     const char* nonce,
+                     std::size_t nonce_size,
+                     std::uint64_t authorized_at);
+
+  ReplayVerdict CheckKey(const Key& key, std::uint64_t now) const;
+  void RecordKey(const Key& key, std::uint64_t now);
+  bool BloomContains(std::size_t generation, std::uint64_t entry_hash) const;
+  void BloomInsert(std::size_t generation, std::uint64_t entry_hash);
+  const DeviceSlot* FindDevice(std::uint64_t device_hash) const;
+
+  std::uint64_t window_seconds_;
+  std::uint64_t max_future_seconds_;
+  ReplayFilterOptions options_;
+  std::size_t bloom_bits_;
+  std::vector<std::uint64_t> bloom_words_;  // Both generations, back to back.
+  std::size_t current_ = 0;
+  std::uint64_t generation_started_ = 0;
+  bool started_ = false;
+  std::vector<DeviceSlot> devices_;
+  std::uint32_t clock_ = 0;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+#include "offline_wallet/snapshot_store.hpp"
+
+namespace offline_wallet {
+
+constexpr std::size_t kTransactionStateCount = 6;
+
+struct SettlementIndexOptions {
+  // Rows kept; once full, new transactions are counted in
+  // SettlementIndexStats::unindexed until Trim() makes room. The tx_id table
+  // takes 8 bytes per row up front; the columns grow as rows arrive.
+  std::size_t max_rows = 32768;
+};
+
+// Which rows a report covers. Times are created_at_epoch_seconds, kept as
+// 32-bit seconds (good until 2106).
+struct SettlementFilter {
+  std::uint64_t from_epoch_seconds = 0;  // Inclusive.
+  std::uint64_t to_epoch_seconds = std::numeric_limits<std::uint64_t>::max();  // Exclusive.
+  // Bit (1 << TransactionState) per state to include.
+  std::uint32_t state_mask = (1u << kTransactionStateCount) - 1;
+  // Empty for every currency. Totals across currencies are only meaningful
+  // per currency, so reports usually set it.
+  std::string_view currency;
+  // Shifts timestamps to local time for TotalsByHour().
+  std::int32_t utc_offset_seconds = 0;
+};
+
+struct SettlementTotals {
+  std::int64_t amount_cents = 0;
+  std::uint64_t count = 0;
+};
+
+struct SettlementGroup {
+  // Payer account id or currency; points into the index and stays valid
+  // until the next Restore() or Clear().
+  std::string_view key;
+  SettlementTotals totals;
+};
+
+struct SettlementIndexStats {
+  std::size_t rows = 0;
+  std::size_t payers = 0;
+  std::uint64_t unindexed = 0;
+};
+
+// Columnar side index of the journal for shift-close and end-of-day reports.
+//
+// Wraps a TransactionJournal and keeps one row per transaction in parallel
+// arrays: amount, state, creation time, and interned payer and currency ids
+// (about 22 bytes a row). Every successful Save, committed batch, and state
+// update is mirrored into the row, so reports are tight loops over the arrays
+// that never read a record back. Rows outlive the journal's own copies:
+// compaction may drop kSynced records, but the day's totals still count them
+// until Trim().
+//
+// Persist() writes the arrays to a SnapshotStore, e.g. a BlockDeviceRegion
+// next to the journal's. At boot, Restore() reloads them and CatchUp() merges
+// whatever the journal wrote after the last Persist(). Not thread-safe.
+class SettlementIndex : public TransactionJournal {
+ public:
+  explicit SettlementIndex(TransactionJournal* journal, SettlementIndexOptions options = {});
+
+  bool Save(const LocalTransaction& tx) override;
+  bool Load(const std::string& tx_id, LocalTransaction* tx_out) const override;
+  bool UpdateState(const std::string& tx_id, TransactionState state, const std::string& reason) override;
+  bool BeginBatch() override;
+  bool Stage(const LocalTransaction& tx) override;
+  bool CommitBatch() override;
+  void AbortBatch() override;
+  bool UpdateStates(const StateUpdate* updates, std::size_t count) override;
+  bool Reserve(std::size_t records) override;
+  bool ForEach(JournalVisitor* visitor) const override;
+
+  // Adds or refreshes a row for every transaction the journal holds.
+  bool CatchUp();
+  bool Persist(SnapshotStore* store);
+  // Replaces the rows with the stored image. Returns false, leaving the index
+  // empty, when there is none, it is malformed, or it exceeds max_rows.
+  bool Restore(const SnapshotStore& store);
+  // Drops rows created before `epoch_seconds`, e.g. once a day is closed.
+  void Trim(std::uint64_t epoch_seconds);
+  void Clear();
+
+  SettlementTotals Total(const SettlementFilter& filter) const;
+  std::array<SettlementTotals, kTransactionStateCount> TotalsByState(const SettlementFilter& filter) const;
+  std::array<SettlementTotals, 24> TotalsByHour(const SettlementFilter& filter) const;
+  // Groups with no matching rows are left out.
+  void TotalsByCurrency(const SettlementFilter& filter, std::vector<SettlementGroup>* groups_out) const;
+  void TotalsByPayer(const SettlementFilter& filter, std::vector<SettlementGroup>* groups_out) const;
+
+  SettlementIndexStats stats() const;
+
+ private:
+  // Interned strings with stable storage for the lookup keys.
+  struct Dictionary {
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, std::uint32_t> ids;
+
+    std::uint32_t Intern(std::string_view name);
+    void Clear();
+  };
+
+  struct Row {
+    std::uint64_t hash = 0;
+    std::int32_t amount_cents = 0;
+    std::uint32_t created_at = 0;
+    std::uint32_t payer = 0;
+    std::uint8_t state = 0;
+    std::uint8_t currency = 0;
+  };
+
+  // Interns the row's strings; false when the currency table is full.
+  bool MakeRow(const LocalTransaction& tx, Row* row_out);
+  void PutRow(const Row& row);
+  void Upsert(const LocalTransaction& tx);
+  void SetState(std::string_view tx_id, TransactionState state);
+  void ApplyStaged();
+  // Re-reads transactions from the journal after a write that may have
+  // landed only in part.
+  void Reconcile(std::string_view tx_id);
+  void ReconcileStaged();
+  // Row holding `hash`, or the empty slot where it would go, as a slot index.
+  std::size_t FindSlot(std::uint64_t hash) const;
+  void RebuildSlots();
+  // Marks the rows `filter` covers in selected_; false when none can match.
+  bool Select(const SettlementFilter& filter) const;
+
+  TransactionJournal* journal_;
+  SettlementIndexOptions options_;
+
+  std::vector<std::uint64_t> hashes_;
+  std::vector<std::int32_t> amounts_;
+  std::vector<std::uint32_t> created_at_;
+  std::vector<std::uint32_t> payers_;
+  std::vector<std::uint8_t> states_;
+  std::vector<std::uint8_t> currencies_;
+  // Open-addressed tx_id hash -> row + 1; 0 marks an empty slot.
+  std::vector<std::uint32_t> slots_;
+
+  Dictionary payer_names_;
+  Dictionary currency_names_;
+  // Rows of the open batch; the id strings are reused across batches.
+  std::vector<Row> staged_rows_;
+  std::vector<std::string> staged_ids_;
+  std::size_t staged_count_ = 0;
+  std::uint64_t unindexed_ = 0;
+  std::vector<std::uint8_t> image_;
+  mutable std::vector<std::uint8_t> selected_;
+  mutable std::vector<SettlementTotals> group_totals_;
+};
+
+}  // namespace offline_wallet
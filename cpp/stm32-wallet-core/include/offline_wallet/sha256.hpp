@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace offline_wallet {
+
+using Sha256Digest = std::array<std::uint8_t, 32>;
+
+// SHA-256 (FIPS 180-4), incremental. Portable C; on parts with a hash
+// accelerator, feed the same bytes to the peripheral instead.
+class Sha256 {
+ public:
+  Sha256() { Reset(); }
+
+  void Reset();
+  void Update(const void* data, std::size_t size);
+  // Pads and writes the digest; Reset() before reusing the object.
+  void Finish(Sha256Digest* digest_out);
+
+  static Sha256Digest Hash(const void* data, std::size_t size);
+
+ private:
+  void Compress(const std::uint8_t* block);
+
+  std::array<std::uint32_t, 8> state_;
+  std::array<std::uint8_t, 64> block_;
+  std::size_t block_size_ = 0;
+  std::uint64_t total_bytes_ = 0;
+};
+
+}  // namespace offline_wallet
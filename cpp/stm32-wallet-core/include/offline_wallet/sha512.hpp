@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace offline_wallet {
+
+using Sha512Digest = std::array<std::uint8_t, 64>;
+
+// SHA-512 (FIPS 180-4), incremental; the hash inside Ed25519.
+class Sha512 {
+ public:
+  Sha512() { Reset(); }
+
+  void Reset();
+  void Update(const void* data, std::size_t size);
+  // Pads and writes the digest; Reset() before reusing the object.
+  void Finish(Sha512Digest* digest_out);
+
+  static Sha512Digest Hash(const void* data, std::size_t size);
+
+ private:
+  void Compress(const std::uint8_t* block);
+
+  std::array<std::uint64_t, 8> state_;
+  std::array<std::uint8_t, 128> block_;
+  std::size_t block_size_ = 0;
+  std::uint64_t total_bytes_ = 0;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+// Thread-safe TransactionJournal over independent journals partitioned by a
+// hash of tx_id.
+//
+// Every transaction lives in exactly one shard, and each shard has its own
+// lock, so threads serving different transactions rarely contend and no call
+// holds more than one lock except ForEach and Reserve, which visit the shards
+// in turn. Group commit falls back to the TransactionJournal defaults (each
+// staged record is saved at once): a batch spanning two handshake calls would
+// otherwise pin its shard's lock between them. The shards are not owned and
+// must not be used directly while the ShardedJournal is.
+class ShardedJournal : public TransactionJournal {
+ public:
+  explicit ShardedJournal(const std::vector<TransactionJournal*>& shards);
+
+  bool Save(const LocalTransaction& tx) override;
+  bool Load(const std::string& tx_id, LocalTransaction* tx_out) const override;
+  bool UpdateState(const std::string& tx_id, TransactionState state, const std::string& reason) override;
+  // Asks every shard for room for `records`, since any of them may get them all.
+  bool Reserve(std::size_t records) override;
+  bool ForEach(JournalVisitor* visitor) const override;
+
+  std::size_t ShardOf(std::string_view tx_id) const;
+  std::size_t shard_count() const { return shard_count_; }
+
+ private:
+  // One cache line per lock, so neighbouring shards do not share one.
+  struct alignas(64) Shard {
+    TransactionJournal* journal = nullptr;
+    mutable std::mutex mutex;
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  std::size_t shard_count_;
+};
+
+}  // namespace offline_wallet
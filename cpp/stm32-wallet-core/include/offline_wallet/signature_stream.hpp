@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "offline_wallet/interfaces.hpp"
+
+namespace offline_wallet {
+
+// Incremental (init/update/final) signer. The engine feeds message fields
+// straight into the active context, so no signature message is materialized.
+// One operation is in flight at a time; Begin* resets any previous state.
+class StreamingSignatureProvider {
+ public:
+  virtual ~StreamingSignatureProvider() = default;
+  virtual void BeginSign(const std::string& key_id) = 0;
+  virtual void BeginVerify(const std::string& public_key_or_id) = 0;
+  virtual void Update(const char* data, std::size_t size) = 0;
+  // Writes into the caller's string so its capacity can be reused.
+  virtual void FinishSign(std::string* signature_out) = 0;
+  virtual bool FinishVerify(const std::string& signature) = 0;
+};
+
+// Canonical field encoding: fields joined by '|', integers in base 10 with a
+// leading '-' for negatives. This is byte-for-byte the historical
+// ostringstream layout, so signatures stay compatible with existing verifiers.
+class SignatureFieldWriter {
+ public:
+  explicit SignatureFieldWriter(StreamingSignatureProvider* signer) : signer_(signer) {}
+
+  SignatureFieldWriter& Field(std::string_view value);
+  SignatureFieldWriter& Field(const char* value);
+  SignatureFieldWriter& Field(std::uint64_t value);
+  SignatureFieldWriter& Field(std::int64_t value);
+  SignatureFieldWriter& Field(std::uint32_t value) { return Field(static_cast<std::uint64_t>(value)); }
+  SignatureFieldWriter& Field(std::int32_t value) { return Field(static_cast<std::int64_t>(value)); }
+
+ private:
+  void Separator();
+
+  StreamingSignatureProvider* signer_;
+  bool first_ = true;
+};
+
+// Adapts a whole-message SignatureProvider to the streaming interface. The
+// message buffer is a member that keeps its capacity between handshakes, so
+// after warm-up the bridge itself allocates nothing.
+class SignatureProviderBridge : public StreamingSignatureProvider {
+ public:
+  explicit SignatureProviderBridge(SignatureProvider* provider) : provider_(provider) {}
+
+  void BeginSign(const std::string& key_id) override;
+  void BeginVerify(const std::string& public_key_or_id) override;
+  void Update(const char* data, std::size_t size) override;
+  void FinishSign(std::string* signature_out) override;
+  bool FinishVerify(const std::string& signature) override;
+
+ private:
+  SignatureProvider* provider_;
+  std::string key_;
+  std::string message_;
+};
+
+}  // namespace offline_wallet
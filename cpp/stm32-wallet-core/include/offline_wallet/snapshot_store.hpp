@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+
+namespace offline_wallet {
+
+// Atomically replaced blob on a BlockDevice, for state that is cheaper to
+// reload than to rebuild (index images and the like).
+//
+// The device is split into two slots of SectorCount() / 2 sectors. Write()
+// erases the slot not holding the current image, programs the payload, syncs,
+// and only then programs the 16-byte slot header ([magic][generation][size]
+// [crc32 over header and payload]) and syncs again. A power cut anywhere
+// leaves either the old image or the new one readable, never a mix; Read()
+// takes the valid slot with the higher generation.
+class SnapshotStore {
+ public:
+  explicit SnapshotStore(BlockDevice* device);
+
+  // Largest payload a slot holds.
+  std::size_t Capacity() const;
+
+  bool Write(const std::uint8_t* data, std::size_t size);
+  // Loads the newest valid image; false when there is none.
+  bool Read(std::vector<std::uint8_t>* data_out) const;
+
+  // Of the image last read or written; 0 before either.
+  std::uint32_t generation() const { return generation_; }
+
+ private:
+  struct SlotHeader {
+    std::uint32_t generation = 0;
+    std::uint32_t size = 0;
+    std::uint32_t crc = 0;
+  };
+
+  bool ReadHeader(std::size_t slot, SlotHeader* header_out) const;
+  bool ReadPayload(std::size_t slot, const SlotHeader& header, std::vector<std::uint8_t>* data_out) const;
+  // Slot holding the newest valid image, or kNoSlot.
+  std::size_t FindCurrent(std::vector<std::uint8_t>* data_out) const;
+  std::size_t SlotBase(std::size_t slot) const { return slot * slot_sectors_ * device_->SectorSize(); }
+
+  BlockDevice* device_;
+  std::size_t slot_sectors_;
+  mutable std::uint32_t generation_ = 0;
+  mutable std::vector<std::uint8_t> scratch_;
+};
+
+}  // namespace offline_wallet
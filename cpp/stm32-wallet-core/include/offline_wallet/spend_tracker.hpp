@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/fixed_models.hpp"
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+struct SpendTrackerOptions {
+  // Payers tracked at once (four-way set associative, LRU eviction).
+  std::size_t payer_slots = 128;
+  // The rolling window is bucket_count * bucket_seconds; the default tracks
+  // the last 24 hours at one-hour granularity.
+  std::uint32_t bucket_count = 24;
+  std::uint32_t bucket_seconds = 3600;
+};
+
+// Rolling per-payer spend totals for RiskPolicy::max_per_day_per_payer_cents.
+//
+// Each tracked payer owns a ring of time buckets plus a running total, so a
+// check is a table probe and at most bucket_count bucket expiries no matter
+// how much history the journal holds. Evicting a payer forgets its history;
+// size payer_slots for the payers a device sees within one window. A device
+// that both authorizes and accepts the same payment counts it twice.
+class SpendTracker {
+ public:
+  explicit SpendTracker(SpendTrackerOptions options = {});
+
+  // Spend recorded for the payer within the window ending at `now`.
+  std::int64_t SpendInWindow(std::string_view payer_account_id, std::uint64_t now) const;
+  std::int64_t SpendInWindow(const FixedId& payer_account_id, std::uint64_t now) const;
+
+  // Adds a payment made at `at`; payments already outside the window ending
+  // at `now` are ignored.
+  void Add(std::string_view payer_account_id,
+           std::int64_t amount_cents,
+           std::uint64_t at,
+           std::uint64_t now);
+  void Add(const FixedId& payer_account_id, std::int64_t amount_cents, std::uint64_t at, std::uint64_t now);
+
+  // Boot-time rebuild in one streaming pass over the journal. Authorized,
+  // pending-sync and synced payments count at their creation time.
+  bool Rebuild(const TransactionJournal& journal, std::uint64_t now);
+  // Adds one journal record the way Rebuild() counts it.
+  void Count(const LocalTransaction& tx, std::uint64_t now);
+
+  // Appends the tracked payers to `image_out`, e.g. for a BootCheckpoint.
+  void AppendImage(std::vector<std::uint8_t>* image_out) const;
+  // Replaces the state with an image from a tracker with the same options.
+  // Returns false, leaving the tracker empty, when it does not fit.
+  bool RestoreImage(const std::uint8_t* image, std::size_t size);
+
+  void Clear();
+  std::size_t MemoryBytes() const;
+
+ private:
+  struct PayerSlot {
+    std::uint64_t payer_hash = 0;  // 0 marks an empty slot.
+    std::uint64_t newest_bucket = 0;
+    std::int64_t total = 0;
+    std::uint32_t last_used = 0;
+  };
+
+  std::int64_t SpendForHash(std::uint64_t payer_hash, std::uint64_t now) const;
+  void AddForHash(std::uint64_t payer_hash, std::int64_t amount_cents, std::uint64_t at, std::uint64_t now);
+  void Advance(std::size_t slot, std::uint64_t bucket);
+  std::size_t SetBase(std::uint64_t payer_hash) const;
+
+  SpendTrackerOptions options_;
+  std::vector<PayerSlot> slots_;
+  std::vector<std::int32_t> buckets_;  // bucket_count per slot.
+  std::uint32_t clock_ = 0;
+};
+
+}  // namespace offline_wallet
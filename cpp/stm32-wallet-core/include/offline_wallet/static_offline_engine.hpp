@@ -0,0 +1,378 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "offline_wallet/fixed_models.hpp"
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/replay_filter.hpp"
+#include "offline_wallet/spend_tracker.hpp"
+
+namespace offline_wallet {
+
+// Random bytes behind every generated ID and nonce (16 hex characters).
+constexpr std::size_t kFixedRandomIdBytes = 8;
+
+// Upper bound of a pipe-joined signature message built on the stack.
+constexpr std::size_t kFixedSignatureMessageCapacity = 256;
+
+using FixedSignatureMessage = FixedString<kFixedSignatureMessageCapacity>;
+
+struct FixedHandshakeResult {
+  HandshakeStatus status = HandshakeStatus::kOk;
+  const char* message = "ok";  // Static string, never owned.
+};
+
+// RiskPolicy fixed at compile time. Pass an instance where the engine takes
+// its policy; the limits fold into the checks as immediates.
+template <std::int32_t MaxPerTransactionCents,
+          std::int32_t MaxPerDayPerPayerCents = 50'000,
+          std::uint32_t MaxClockSkewSeconds = 300,
+          std::uint32_t IntentTtlSeconds = 30>
+struct StaticRiskPolicy {
+  static constexpr std::int32_t max_per_transaction_cents = MaxPerTransactionCents;
+  static constexpr std::int32_t max_per_day_per_payer_cents = MaxPerDayPerPayerCents;
+  static constexpr std::uint32_t max_clock_skew_seconds = MaxClockSkewSeconds;
+  static constexpr std::uint32_t intent_ttl_seconds = IntentTtlSeconds;
+};
+
+namespace fixed_engine_detail {
+
+// Signature message layouts shared by every instantiation; false when the
+// message exceeds its capacity.
+bool BuildIntentSignatureMessage(const FixedPaymentIntent& intent, FixedSignatureMessage* out);
+bool BuildAuthorizationSignatureMessage(const FixedPaymentAuthorization& authorization,
+                                        FixedSignatureMessage* out);
+bool BuildReceiptSignatureMessage(const FixedPaymentReceipt& receipt,
+                                  const FixedId& payer_authorization_id,
+                                  FixedSignatureMessage* out);
+
+// Appends `size` bytes as lowercase hex.
+template <std::size_t Capacity>
+bool AppendHex(const std::uint8_t* bytes, std::size_t size, FixedString<Capacity>* out) {
+  constexpr char kHexDigits[] = "0123456789abcdef";
+  for (std::size_t i = 0; i < size; ++i) {
+    const char pair[2] = {kHexDigits[bytes[i] >> 4], kHexDigits[bytes[i] & 0x0F]};
+    if (!out->Append(pair, sizeof(pair))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace fixed_engine_detail
+
+// Heap-free handshake engine bound to its collaborators at compile time.
+// Signer, Random, Clock and Journal are any types with the member functions
+// of FixedSignatureProvider, FixedRandomProvider (Ready() included),
+// ClockProvider and FixedTransactionJournal; they need not derive from those
+// interfaces, so with concrete (or `final`) types every provider call is
+// direct and can be inlined, and no vtable or RTTI is needed. Policy is
+// RiskPolicy (limits chosen at run time) or a StaticRiskPolicy.
+//
+// FixedOfflineEngine is the instantiation over the virtual interfaces, so
+// both share this one implementation. Builds with -fno-exceptions -fno-rtti.
+template <typename Signer, typename Random, typename Clock, typename Journal, typename Policy = RiskPolicy>
+class StaticOfflineEngine {
+ public:
+  StaticOfflineEngine(Policy policy, Signer* signature_provider, Random* random_provider, Clock* clock_provider,
+                      Journal* journal)
+      : policy_(policy),
+        signature_provider_(signature_provider),
+        random_provider_(random_provider),
+        clock_provider_(clock_provider),
+        journal_(journal) {}
+
+  // See OfflineEngine::SetReplayFilter.
+  void SetReplayFilter(ReplayFilter* filter) { replay_filter_ = filter; }
+  // See OfflineEngine::SetSpendTracker.
+  void SetSpendTracker(SpendTracker* tracker) { spend_tracker_ = tracker; }
+
+  FixedHandshakeResult BuildMerchantIntent(const FixedDeviceContext& merchant,
+                                           std::int32_t amount_cents,
+                                           const FixedCurrency& currency,
+                                           FixedPaymentIntent* intent_out,
+                                           FixedLocalTransaction* tx_out);
+
+  FixedHandshakeResult BuildPayerAuthorization(const FixedDeviceContext& payer,
+                                               const FixedPaymentIntent& intent,
+                                               FixedPaymentAuthorization* authorization_out,
+                                               FixedLocalTransaction* tx_out);
+
+  FixedHandshakeResult AcceptAuthorization(const FixedDeviceContext& merchant,
+                                           const FixedPaymentAuthorization& authorization,
+                                           FixedPaymentReceipt* receipt_out,
+                                           FixedLocalTransaction* tx_out);
+
+ private:
+  bool BuildKey(const char* prefix, FixedId* key_out);
+
+  Policy policy_;
+  Signer* signature_provider_;
+  Random* random_provider_;
+  Clock* clock_provider_;
+  Journal* journal_;
+  ReplayFilter* replay_filter_ = nullptr;
+  SpendTracker* spend_tracker_ = nullptr;
+};
+
+template <typename Signer, typename Random, typename Clock, typename Journal, typename Policy>
+FixedHandshakeResult StaticOfflineEngine<Signer, Random, Clock, Journal, Policy>::BuildMerchantIntent(
+    const FixedDeviceContext& merchant,
+    std::int32_t amount_cents,
+    const FixedCurrency& currency,
+    FixedPaymentIntent* intent_out,
+    FixedLocalTransaction* tx_out) {
+  if (!intent_out || !tx_out) {
+    return {HandshakeStatus::kInvalidInput, "output pointer is null"};
+  }
+
+  if (amount_cents <= 0 || amount_cents > policy_.max_per_transaction_cents) {
+    return {HandshakeStatus::kPolicyDenied, "amount violates policy"};
+  }
+  if (!random_provider_->Ready()) {
+    return {HandshakeStatus::kRandomUnavailable, "random provider not seeded"};
+  }
+
+  const auto now = clock_provider_->NowUnixSeconds();
+  FixedPaymentIntent intent{};
+  if (!BuildKey("tx-", &intent.tx_id) || !BuildKey("mi-", &intent.merchant_intent_id)) {
+    return {HandshakeStatus::kInvalidInput, "generated key exceeds capacity"};
+  }
+  std::uint8_t nonce[kFixedRandomIdBytes];
+  random_provider_->NextBytes(nonce, sizeof(nonce));
+  fixed_engine_detail::AppendHex(nonce, sizeof(nonce), &intent.merchant_nonce);
+  intent.merchant_account_id = merchant.account_id;
+  intent.merchant_device_id = merchant.device_id;
+  intent.amount_cents = amount_cents;
+  intent.currency = currency;
+  intent.merchant_counter = merchant.local_counter;
+  intent.issued_at_epoch_seconds = now;
+  intent.expires_at_epoch_seconds = now + policy_.intent_ttl_seconds;
+
+  FixedSignatureMessage message;
+  if (!fixed_engine_detail::BuildIntentSignatureMessage(intent, &message)) {
+    return {HandshakeStatus::kInvalidInput, "signature message exceeds capacity"};
+  }
+  if (!signature_provider_->Sign(message.data(), message.size(), merchant.signing_key_id,
+                                 &intent.merchant_signature)) {
+    return {HandshakeStatus::kInvalidInput, "signing failed"};
+  }
+
+  FixedLocalTransaction tx{};
+  tx.tx_id = intent.tx_id;
+  tx.merchant_account_id = merchant.account_id;
+  tx.merchant_device_id = merchant.device_id;
+  tx.amount_cents = amount_cents;
+  tx.currency = currency;
+  tx.merchant_intent_id = intent.merchant_intent_id;
+  tx.merchant_nonce = intent.merchant_nonce;
+  tx.merchant_counter = intent.merchant_counter;
+  tx.state = TransactionState::kInitiated;
+  tx.created_at_epoch_seconds = now;
+  tx.updated_at_epoch_seconds = now;
+  tx.idempotency_key = "merchant:";
+  tx.idempotency_key.Append(intent.tx_id);
+
+  if (!journal_->Save(tx)) {
+    return {HandshakeStatus::kJournalFailure, "failed to persist local transaction"};
+  }
+
+  *intent_out = intent;
+  *tx_out = tx;
+  return {HandshakeStatus::kOk, "ok"};
+}
+
+template <typename Signer, typename Random, typename Clock, typename Journal, typename Policy>
+FixedHandshakeResult StaticOfflineEngine<Signer, Random, Clock, Journal, Policy>::BuildPayerAuthorization(
+    const FixedDeviceContext& payer,
+    const FixedPaymentIntent& intent,
+    FixedPaymentAuthorization* authorization_out,
+    FixedLocalTransaction* tx_out) {
+  if (!authorization_out || !tx_out) {
+    return {HandshakeStatus::kInvalidInput, "output pointer is null"};
+  }
+
+  const auto now = clock_provider_->NowUnixSeconds();
+  if (intent.expires_at_epoch_seconds < now) {
+    return {HandshakeStatus::kExpired, "intent expired"};
+  }
+
+  if (intent.amount_cents <= 0 || intent.amount_cents > policy_.max_per_transaction_cents) {
+    return {HandshakeStatus::kPolicyDenied, "amount violates policy"};
+  }
+
+  const std::uint64_t skew = now > intent.issued_at_epoch_seconds
+                                 ? now - intent.issued_at_epoch_seconds
+                                 : intent.issued_at_epoch_seconds - now;
+  if (skew > policy_.max_clock_skew_seconds) {
+    return {HandshakeStatus::kPolicyDenied, "clock skew exceeded"};
+  }
+  if (spend_tracker_ != nullptr &&
+      spend_tracker_->SpendInWindow(payer.account_id, now) + intent.amount_cents >
+          policy_.max_per_day_per_payer_cents) {
+    return {HandshakeStatus::kPolicyDenied, "daily limit exceeded"};
+  }
+  if (!random_provider_->Ready()) {
+    return {HandshakeStatus::kRandomUnavailable, "random provider not seeded"};
+  }
+
+  FixedPaymentAuthorization authorization{};
+  authorization.tx_id = intent.tx_id;
+  authorization.merchant_intent_id = intent.merchant_intent_id;
+  if (!BuildKey("pa-", &authorization.payer_authorization_id)) {
+    return {HandshakeStatus::kInvalidInput, "generated key exceeds capacity"};
+  }
+  std::uint8_t nonce[kFixedRandomIdBytes];
+  random_provider_->NextBytes(nonce, sizeof(nonce));
+  fixed_engine_detail::AppendHex(nonce, sizeof(nonce), &authorization.payer_nonce);
+  authorization.payer_account_id = payer.account_id;
+  authorization.payer_device_id = payer.device_id;
+  authorization.amount_cents = intent.amount_cents;
+  authorization.currency = intent.currency;
+  authorization.payer_counter = payer.local_counter;
+  authorization.authorized_at_epoch_seconds = now;
+
+  FixedSignatureMessage message;
+  if (!fixed_engine_detail::BuildAuthorizationSignatureMessage(authorization, &message)) {
+    return {HandshakeStatus::kInvalidInput, "signature message exceeds capacity"};
+  }
+  if (!signature_provider_->Sign(message.data(), message.size(), payer.signing_key_id,
+                                 &authorization.payer_signature)) {
+    return {HandshakeStatus::kInvalidInput, "signing failed"};
+  }
+
+  FixedLocalTransaction tx{};
+  tx.tx_id = authorization.tx_id;
+  tx.merchant_account_id = intent.merchant_account_id;
+  tx.payer_account_id = payer.account_id;
+  tx.merchant_device_id = intent.merchant_device_id;
+  tx.payer_device_id = payer.device_id;
+  tx.amount_cents = intent.amount_cents;
+  tx.currency = intent.currency;
+  tx.merchant_intent_id = intent.merchant_intent_id;
+  tx.payer_authorization_id = authorization.payer_authorization_id;
+  tx.merchant_nonce = intent.merchant_nonce;
+  tx.payer_nonce = authorization.payer_nonce;
+  tx.merchant_counter = intent.merchant_counter;
+  tx.payer_counter = authorization.payer_counter;
+  tx.state = TransactionState::kAuthorized;
+  tx.created_at_epoch_seconds = now;
+  tx.updated_at_epoch_seconds = now;
+  tx.idempotency_key = "payer:";
+  if (!tx.idempotency_key.Append(tx.tx_id) || !tx.idempotency_key.Append(':') ||
+      !tx.idempotency_key.Append(tx.payer_authorization_id)) {
+    return {HandshakeStatus::kInvalidInput, "idempotency key exceeds capacity"};
+  }
+
+  if (!journal_->Save(tx)) {
+    return {HandshakeStatus::kJournalFailure, "failed to persist payer transaction"};
+  }
+  if (spend_tracker_ != nullptr) {
+    spend_tracker_->Add(payer.account_id, intent.amount_cents, now, now);
+  }
+
+  *authorization_out = authorization;
+  *tx_out = tx;
+  return {HandshakeStatus::kOk, "ok"};
+}
+
+template <typename Signer, typename Random, typename Clock, typename Journal, typename Policy>
+FixedHandshakeResult StaticOfflineEngine<Signer, Random, Clock, Journal, Policy>::AcceptAuthorization(
+    const FixedDeviceContext& merchant,
+    const FixedPaymentAuthorization& authorization,
+    FixedPaymentReceipt* receipt_out,
+    FixedLocalTransaction* tx_out) {
+  if (!receipt_out || !tx_out) {
+    return {HandshakeStatus::kInvalidInput, "output pointer is null"};
+  }
+
+  FixedLocalTransaction tx{};
+  if (!journal_->Load(authorization.tx_id, &tx)) {
+    return {HandshakeStatus::kUnknownTransaction, "merchant transaction not found"};
+  }
+
+  if (tx.merchant_intent_id != authorization.merchant_intent_id ||
+      tx.amount_cents != authorization.amount_cents || tx.currency != authorization.currency) {
+    return {HandshakeStatus::kMismatch, "authorization does not match intent"};
+  }
+
+  const std::uint64_t now = clock_provider_->NowUnixSeconds();
+  if (replay_filter_ != nullptr) {
+    switch (replay_filter_->Check(authorization, now)) {
+      case ReplayVerdict::kFresh:
+        break;
+      case ReplayVerdict::kReplayed:
+        return {HandshakeStatus::kReplayDetected, "authorization replayed"};
+      case ReplayVerdict::kCounterRegressed:
+        return {HandshakeStatus::kReplayDetected, "payer counter regressed"};
+      case ReplayVerdict::kOutsideWindow:
+        return {HandshakeStatus::kExpired, "authorization outside replay window"};
+    }
+  }
+  if (spend_tracker_ != nullptr &&
+      spend_tracker_->SpendInWindow(authorization.payer_account_id, now) + authorization.amount_cents >
+          policy_.max_per_day_per_payer_cents) {
+    return {HandshakeStatus::kPolicyDenied, "daily limit exceeded"};
+  }
+  // The receipt id is drawn after the acceptance is persisted; refuse now.
+  if (!random_provider_->Ready()) {
+    return {HandshakeStatus::kRandomUnavailable, "random provider not seeded"};
+  }
+
+  tx.payer_account_id = authorization.payer_account_id;
+  tx.payer_device_id = authorization.payer_device_id;
+  tx.payer_authorization_id = authorization.payer_authorization_id;
+  tx.payer_nonce = authorization.payer_nonce;
+  tx.payer_counter = authorization.payer_counter;
+  tx.state = TransactionState::kPendingSync;
+  tx.updated_at_epoch_seconds = now;
+
+  if (!journal_->Save(tx)) {
+    return {HandshakeStatus::kJournalFailure, "failed to persist merchant acceptance"};
+  }
+  if (replay_filter_ != nullptr) {
+    replay_filter_->Record(authorization, now);
+  }
+  if (spend_tracker_ != nullptr) {
+    spend_tracker_->Add(authorization.payer_account_id, authorization.amount_cents, now, now);
+  }
+
+  FixedPaymentReceipt receipt{};
+  receipt.tx_id = authorization.tx_id;
+  if (!BuildKey("r-", &receipt.receipt_id)) {
+    return {HandshakeStatus::kInvalidInput, "generated key exceeds capacity"};
+  }
+  receipt.merchant_account_id = merchant.account_id;
+  receipt.payer_account_id = authorization.payer_account_id;
+  receipt.amount_cents = authorization.amount_cents;
+  receipt.currency = authorization.currency;
+  receipt.status = TransactionState::kPendingSync;
+  receipt.created_at_epoch_seconds = now;
+
+  FixedSignatureMessage message;
+  if (!fixed_engine_detail::BuildReceiptSignatureMessage(receipt, authorization.payer_authorization_id,
+                                                         &message)) {
+    return {HandshakeStatus::kInvalidInput, "signature message exceeds capacity"};
+  }
+  if (!signature_provider_->Sign(message.data(), message.size(), merchant.signing_key_id,
+                                 &receipt.merchant_signature)) {
+    return {HandshakeStatus::kInvalidInput, "signing failed"};
+  }
+
+  *receipt_out = receipt;
+  *tx_out = tx;
+  return {HandshakeStatus::kOk, "ok"};
+}
+
+template <typename Signer, typename Random, typename Clock, typename Journal, typename Policy>
+bool StaticOfflineEngine<Signer, Random, Clock, Journal, Policy>::BuildKey(const char* prefix, FixedId* key_out) {
+  std::uint8_t random[kFixedRandomIdBytes];
+  random_provider_->NextBytes(random, sizeof(random));
+  key_out->clear();
+  return key_out->Append(prefix, std::strlen(prefix)) &&
+         fixed_engine_detail::AppendHex(random, sizeof(random), key_out);
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+struct SyncExportOptions {
+  // Transactions per chunk. Keep it well under the backend's
+  // maxUnsyncedPerMerchant, which rejects a whole batch above it.
+  std::size_t max_transactions = 16;
+};
+
+enum class SyncExportStatus {
+  kOk,
+  kNothingPending,
+  kBufferTooSmall,
+  kJournalFailure,
+};
+
+struct SyncChunk {
+  std::size_t transactions = 0;
+  std::size_t bytes = 0;
+  // Highest sequence uploaded so far once the backend has answered this chunk.
+  std::uint64_t last_sequence = 0;
+};
+
+// Per-transaction answer of the backend's sync endpoint.
+enum class SyncResultStatus {
+  kAccepted,
+  kRejected,
+  kDuplicate,
+};
+
+struct SyncResult {
+  std::string tx_id;
+  SyncResultStatus status = SyncResultStatus::kAccepted;
+  std::string reason;
+};
+
+// Incremental upload of kPendingSync records, oldest write first, as JSON
+// documents in the backend's OfflineSyncInput shape:
+//
+//   {"merchantDeviceId":..,"submittedAt":..,"transactions":[{"txId":..},..]}
+//
+// The cursor is the highest LocalTransaction::sequence the backend has
+// answered for; only pending records written after it are read out, so a sync
+// costs what changed since the last one rather than the whole journal. Until
+// Acknowledge(), NextChunk() keeps returning the same records, so a chunk cut
+// off by a flaky link is simply sent again (the backend answers repeats as
+// duplicates) and a long backlog resumes at the first unanswered chunk.
+// Persist cursor() after each Acknowledge() and Seek() to it at boot; a
+// BootCheckpoint does both.
+//
+// ApplyResults() records the backend's answer and acknowledges in one step:
+// accepted and duplicate rows become kSynced, which compaction may drop, and
+// rejected rows kRejected with the backend's reason.
+//
+// Records with sequence 0 come from journals that do not stamp one; they are
+// sent on every sync until their state leaves kPendingSync.
+class SyncExporter {
+ public:
+  SyncExporter(TransactionJournal* journal,
+               const ClockProvider* clock,
+               std::string merchant_device_id,
+               SyncExportOptions options = {});
+
+  void Seek(std::uint64_t acknowledged_sequence) { cursor_ = acknowledged_sequence; }
+  std::uint64_t cursor() const { return cursor_; }
+
+  // Writes the next chunk into `buffer` (not NUL-terminated) with one pass
+  // over the journal. A chunk ends early rather than overflow `capacity`;
+  // kBufferTooSmall means not even one transaction fits.
+  SyncExportStatus NextChunk(char* buffer, std::size_t capacity, SyncChunk* chunk_out);
+  void Acknowledge(const SyncChunk& chunk);
+  // Applies the results with one TransactionJournal::UpdateStates() call and
+  // acknowledges `chunk` once it succeeded. On kJournalFailure the cursor
+  // stays put and the same results may be applied again.
+  SyncExportStatus ApplyResults(const SyncChunk& chunk, const SyncResult* results, std::size_t count);
+
+ private:
+  TransactionJournal* journal_;
+  const ClockProvider* clock_;
+  std::string merchant_device_id_;
+  SyncExportOptions options_;
+  std::uint64_t cursor_ = 0;
+  std::vector<LocalTransaction> selected_;
+  std::vector<StateUpdate> updates_;
+};
+
+}  // namespace offline_wallet
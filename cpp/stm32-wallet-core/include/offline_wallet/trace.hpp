@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Set to 0 (CMake option OFFLINE_WALLET_TRACING=OFF) to compile every trace
+// hook out of the engine; SetTraceSink() then does nothing.
+#ifndef OFFLINE_WALLET_TRACING
+#define OFFLINE_WALLET_TRACING 1
+#endif
+
+#if OFFLINE_WALLET_TRACING
+#define OFFLINE_WALLET_TRACE_BEGIN(sink, stage) \
+  do {                                          \
+    if ((sink) != nullptr) {                    \
+      (sink)->OnBegin(stage);                   \
+    }                                           \
+  } while (0)
+#define OFFLINE_WALLET_TRACE_END(sink, stage, status)        \
+  do {                                                       \
+    if ((sink) != nullptr) {                                 \
+      (sink)->OnEnd(stage, static_cast<std::int32_t>(status)); \
+    }                                                        \
+  } while (0)
+#else
+#define OFFLINE_WALLET_TRACE_BEGIN(sink, stage) ((void)0)
+#define OFFLINE_WALLET_TRACE_END(sink, stage, status) ((void)0)
+#endif
+
+namespace offline_wallet {
+
+// Handshake entry points, and the provider calls made inside them.
+enum class TraceStage : std::uint8_t {
+  kBuildMerchantIntent,
+  kBuildPayerAuthorization,
+  kAcceptAuthorization,
+  kSign,
+  kRandom,
+  kJournalLoad,
+  kJournalWrite,
+  kVerify,
+};
+
+constexpr std::size_t kTraceStageCount = 8;
+
+const char* TraceStageName(TraceStage stage);
+
+// Receives properly nested begin/end pairs from the engine's thread. End
+// statuses are 0 on success; handshake stages report their HandshakeStatus,
+// provider stages report 1 on failure.
+class TraceSink {
+ public:
+  virtual ~TraceSink() = default;
+  virtual void OnBegin(TraceStage stage) = 0;
+  virtual void OnEnd(TraceStage stage, std::int32_t status) = 0;
+};
+
+// Free-running tick counter; wraparound is fine, spans are unsigned
+// differences. On Cortex-M, return DWT->CYCCNT.
+using TraceClock = std::uint32_t (*)();
+
+// steady_clock nanoseconds truncated to 32 bits, for host builds.
+std::uint32_t HostTraceTicks();
+
+struct TraceEvent {
+  std::uint32_t ticks = 0;
+  TraceStage stage = TraceStage::kBuildMerchantIntent;
+  bool end = false;
+  std::int32_t status = 0;
+};
+
+// Lock-free single-producer/single-consumer event ring. The engine produces;
+// a UART or logging task (or an ISR) drains with Pop(). A full ring drops new
+// events and counts them instead of blocking the handshake.
+template <std::size_t Capacity>
+class TraceRing : public TraceSink {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+ public:
+  explicit TraceRing(TraceClock clock) : clock_(clock) {}
+
+  void OnBegin(TraceStage stage) override { Push(TraceEvent{clock_(), stage, false, 0}); }
+  void OnEnd(TraceStage stage, std::int32_t status) override { Push(TraceEvent{clock_(), stage, true, status}); }
+
+  bool Pop(TraceEvent* event_out) {
+    const std::uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *event_out = events_[tail & (Capacity - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  std::uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  void Push(const TraceEvent& event) {
+    const std::uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == Capacity) {
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return;
+    }
+    events_[head & (Capacity - 1)] = event;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  TraceClock clock_;
+  TraceEvent events_[Capacity];
+  std::atomic<std::uint32_t> head_{0};
+  std::atomic<std::uint32_t> tail_{0};
+  std::atomic<std::uint32_t> dropped_{0};
+};
+
+// Log2 duration buckets: bucket b counts spans of [2^(b-1), 2^b) ticks, the
+// last one everything longer.
+constexpr std::size_t kTraceHistogramBuckets = 24;
+
+struct TraceStageStats {
+  std::uint32_t count = 0;
+  std::uint32_t failures = 0;
+  std::uint64_t total_ticks = 0;
+  // Total minus the spans of stages nested inside; for handshake stages this
+  // is the time spent in the engine itself.
+  std::uint64_t self_ticks = 0;
+  std::uint32_t max_ticks = 0;
+  std::uint32_t histogram[kTraceHistogramBuckets] = {};
+};
+
+// Aggregates spans per stage without allocating. Optionally forwards every
+// event to `next`, e.g. a TraceRing, so one engine can feed both.
+class TraceCounters : public TraceSink {
+ public:
+  explicit TraceCounters(TraceClock clock, TraceSink* next = nullptr);
+
+  void OnBegin(TraceStage stage) override;
+  void OnEnd(TraceStage stage, std::int32_t status) override;
+
+  const TraceStageStats& stats(TraceStage stage) const;
+  void Reset();
+
+  // Writes one text line per stage that has run into `out` (always
+  // NUL-terminated when capacity > 0) and returns the length written, ready
+  // for a debug UART or a file.
+  std::size_t Format(char* out, std::size_t capacity) const;
+
+ private:
+  static constexpr std::size_t kMaxDepth = 8;
+
+  struct OpenSpan {
+    TraceStage stage;
+    std::uint32_t start;
+    std::uint64_t child_ticks;
+  };
+
+  TraceClock clock_;
+  TraceSink* next_;
+  TraceStageStats stats_[kTraceStageCount];
+  OpenSpan open_[kMaxDepth];
+  std::size_t depth_ = 0;
+};
+
+}  // namespace offline_wallet
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "offline_wallet/fixed_models.hpp"
+#include "offline_wallet/models.hpp"
+
+namespace offline_wallet {
+
+// Compact binary QR payload format.
+//
+//   [version:u8][type:u8][fields...]
+//
+// Integers are LEB128 varints (amounts zig-zagged, intent expiry stored as a
+// delta from issue time). Text fields carry a varint header (length << 2 | mode)
+// so lowercase hex keys travel as raw bytes with their well-known prefix
+// ("tx-", "mi-", "pa-", "r-") implied, canonical UUIDs as 16 bytes, and
+// anything else verbatim. Currency is a fixed three-byte code.
+constexpr std::uint8_t kWireFormatVersion = 1;
+
+enum class WireMessageType : std::uint8_t {
+  kIntent = 1,
+  kAuthorization = 2,
+  kReceipt = 3,
+  // Journal record encoding; shares the field rules but never leaves the device.
+  kLocalTransaction = 4,
+};
+
+enum class WireStatus {
+  kOk,
+  kBufferTooSmall,
+  kInvalidField,
+  kTruncated,
+  kUnsupportedVersion,
+  kWrongType,
+  kMalformed,
+};
+
+constexpr std::size_t kWireHeaderBytes = 2;
+constexpr std::size_t kWireMaxVarint32Bytes = 5;
+constexpr std::size_t kWireMaxVarint64Bytes = 10;
+constexpr std::size_t kWireCurrencyBytes = 3;
+
+// Worst-case encoded size of a text field whose decoded form is at most
+// `capacity` characters (header varint plus verbatim bytes).
+constexpr std::size_t WireTextMaxBytes(std::size_t capacity) { return kWireMaxVarint32Bytes + capacity; }
+
+// Worst-case encodings of the fixed-capacity models; a buffer this large
+// never yields kBufferTooSmall. LocalTransaction adds a sync tail (sequence,
+// handshake times and both signatures) that FixedLocalTransaction omits. A
+// PaymentReceipt covered by a ReceiptChain adds its chain position instead of
+// a signature, so it stays within kWireReceiptMaxBytes.
+constexpr std::size_t kWireIntentMaxBytes =
+    kWireHeaderBytes + 4 * WireTextMaxBytes(kFixedIdCapacity) + kWireMaxVarint32Bytes + kWireCurrencyBytes +
+    WireTextMaxBytes(kFixedNonceCapacity) + kWireMaxVarint32Bytes + 2 * kWireMaxVarint64Bytes +
+    WireTextMaxBytes(kFixedSignatureCapacity);
+constexpr std::size_t kWireAuthorizationMaxBytes =
+    kWireHeaderBytes + 5 * WireTextMaxBytes(kFixedIdCapacity) + kWireMaxVarint32Bytes + kWireCurrencyBytes +
+    WireTextMaxBytes(kFixedNonceCapacity) + kWireMaxVarint32Bytes + kWireMaxVarint64Bytes +
+    WireTextMaxBytes(kFixedSignatureCapacity);
+constexpr std::size_t kWireReceiptMaxBytes = kWireHeaderBytes + 4 * WireTextMaxBytes(kFixedIdCapacity) +
+                                             kWireMaxVarint32Bytes + kWireCurrencyBytes + 1 +
+                                             kWireMaxVarint64Bytes + WireTextMaxBytes(kFixedSignatureCapacity);
+constexpr std::size_t kWireLocalTransactionMaxBytes =
+    kWireHeaderBytes + 7 * WireTextMaxBytes(kFixedIdCapacity) + kWireMaxVarint32Bytes + kWireCurrencyBytes +
+    2 * WireTextMaxBytes(kFixedNonceCapacity) + 2 * kWireMaxVarint32Bytes + 1 +
+    WireTextMaxBytes(kFixedReasonCapacity) + 2 * kWireMaxVarint64Bytes +
+    WireTextMaxBytes(kFixedIdempotencyKeyCapacity);
+
+// Reads the header without decoding the body, so a scanner can dispatch.
+WireStatus PeekWireMessageType(const std::uint8_t* buffer, std::size_t size, WireMessageType* type_out);
+
+WireStatus EncodeIntent(const PaymentIntent& intent,
+                        std::uint8_t* buffer,
+                        std::size_t capacity,
+                        std::size_t* written_out);
+WireStatus EncodeAuthorization(const PaymentAuthorization& authorization,
+                               std::uint8_t* buffer,
+                               std::size_t capacity,
+                               std::size_t* written_out);
+WireStatus EncodeReceipt(const PaymentReceipt& receipt,
+                         std::uint8_t* buffer,
+                         std::size_t capacity,
+                         std::size_t* written_out);
+
+WireStatus DecodeIntent(const std::uint8_t* buffer, std::size_t size, PaymentIntent* intent_out);
+WireStatus DecodeAuthorization(const std::uint8_t* buffer,
+                               std::size_t size,
+                               PaymentAuthorization* authorization_out);
+WireStatus DecodeReceipt(const std::uint8_t* buffer, std::size_t size, PaymentReceipt* receipt_out);
+
+WireStatus EncodeLocalTransaction(const LocalTransaction& tx,
+                                  std::uint8_t* buffer,
+                                  std::size_t capacity,
+                                  std::size_t* written_out);
+// Encodes `sequence` in place of tx.sequence, so a journal can stamp a record
+// without copying it.
+WireStatus EncodeLocalTransaction(const LocalTransaction& tx,
+                                  std::uint64_t sequence,
+                                  std::uint8_t* buffer,
+                                  std::size_t capacity,
+                                  std::size_t* written_out);
+WireStatus DecodeLocalTransaction(const std::uint8_t* buffer, std::size_t size, LocalTransaction* tx_out);
+
+// Heap-free overloads for the fixed-capacity models. Decoding fails with
+// kInvalidField when a field would not fit its FixedString.
+WireStatus EncodeIntent(const FixedPaymentIntent& intent,
+                        std::uint8_t* buffer,
+                        std::size_t capacity,
+                        std::size_t* written_out);
+WireStatus EncodeAuthorization(const FixedPaymentAuthorization& authorization,
+                               std::uint8_t* buffer,
+                               std::size_t capacity,
+                               std::size_t* written_out);
+WireStatus EncodeReceipt(const FixedPaymentReceipt& receipt,
+                         std::uint8_t* buffer,
+                         std::size_t capacity,
+                         std::size_t* written_out);
+
+WireStatus DecodeIntent(const std::uint8_t* buffer, std::size_t size, FixedPaymentIntent* intent_out);
+WireStatus DecodeAuthorization(const std::uint8_t* buffer,
+                               std::size_t size,
+                               FixedPaymentAuthorization* authorization_out);
+WireStatus DecodeReceipt(const std::uint8_t* buffer, std::size_t size, FixedPaymentReceipt* receipt_out);
+
+WireStatus EncodeLocalTransaction(const FixedLocalTransaction& tx,
+                                  std::uint8_t* buffer,
+                                  std::size_t capacity,
+                                  std::size_t* written_out);
+WireStatus DecodeLocalTransaction(const std::uint8_t* buffer, std::size_t size, FixedLocalTransaction* tx_out);
+
+}  // namespace offline_wallet
@@ -0,0 +1,442 @@
+#include "offline_wallet/batch_input.hpp"
+
+#include <cctype>
+#include <limits>
+#include <utility>
+
+#include "offline_wallet/iso_time.hpp"
+#include "offline_wallet/wire_codec.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// Just enough JSON for OfflineSyncInput: objects, arrays, strings and
+// integers, with anything else under an unknown key skipped.
+class JsonReader {
+ public:
+  explicit JsonReader(std::string_view text) : text_(text) {}
+
+  bool Consume(char c) {
+    SkipSpace();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  bool Peek(char c) {
+    SkipSpace();
+    return pos_ < text_.size() && text_[pos_] == c;
+  }
+
+  bool AtEnd() {
+    SkipSpace();
+    return pos_ == text_.size();
+  }
+
+  bool String(std::string* out) {
+    if (!Consume('"')) {
+      return false;
+    }
+    out->clear();
+    while (pos_ < text_.size()) {
+      const char c = text_[pos_++];
+      if (c == '"') {
+        return true;
+      }
+      if (static_cast<unsigned char>(c) < 0x20) {
+        return false;
+      }
+      if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+      if (pos_ == text_.size()) {
+        return false;
+      }
+      const char escape = text_[pos_++];
+      if (escape == 'u') {
+        if (!CodePoint(out)) {
+          return false;
+        }
+        continue;
+      }
+      // Escape letters, each followed by the character it stands for.
+      static constexpr std::string_view kEscapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
+      std::size_t at = 0;
+      while (at < kEscapes.size() && kEscapes[at] != escape) {
+        at += 2;
+      }
+      if (at == kEscapes.size()) {
+        return false;
+      }
+      out->push_back(kEscapes[at + 1]);
+    }
+    return false;
+  }
+
+  bool Integer(std::int64_t* value_out) {
+    SkipSpace();
+    const bool negative = pos_ < text_.size() && text_[pos_] == '-';
+    pos_ += negative ? 1 : 0;
+    std::int64_t value = 0;
+    std::size_t digits = 0;
+    for (; pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9'; ++pos_, ++digits) {
+      if (value > (std::numeric_limits<std::int64_t>::max() - 9) / 10) {
+        return false;
+      }
+      value = value * 10 + (text_[pos_] - '0');
+    }
+    // Fractions and exponents never appear in the fields read as integers.
+    if (digits == 0 || (pos_ < text_.size() && (text_[pos_] == '.' || text_[pos_] == 'e' || text_[pos_] == 'E'))) {
+      return false;
+    }
+    *value_out = negative ? -value : value;
+    return true;
+  }
+
+  bool SkipValue(int depth = 0) {
+    if (depth > 32) {
+      return false;
+    }
+    SkipSpace();
+    if (Peek('"')) {
+      return String(&skipped_);
+    }
+    if (Consume('{')) {
+      if (Consume('}')) {
+        return true;
+      }
+      do {
+        if (!String(&skipped_) || !Consume(':') || !SkipValue(depth + 1)) {
+          return false;
+        }
+      } while (Consume(','));
+      return Consume('}');
+    }
+    if (Consume('[')) {
+      if (Consume(']')) {
+        return true;
+      }
+      do {
+        if (!SkipValue(depth + 1)) {
+          return false;
+        }
+      } while (Consume(','));
+      return Consume(']');
+    }
+    const std::size_t start = pos_;
+    while (pos_ < text_.size() && (std::isalnum(static_cast<unsigned char>(text_[pos_])) != 0 ||
+                                   text_[pos_] == '-' || text_[pos_] == '+' || text_[pos_] == '.')) {
+      ++pos_;
+    }
+    return pos_ > start;
+  }
+
+ private:
+  void SkipSpace() {
+    while (pos_ < text_.size() &&
+           (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+      ++pos_;
+    }
+  }
+
+  bool Hex4(std::uint32_t* value_out) {
+    if (text_.size() - pos_ < 4) {
+      return false;
+    }
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = text_[pos_++];
+      const int digit = c >= '0' && c <= '9'   ? c - '0'
+                        : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                        : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                               : -1;
+      if (digit < 0) {
+        return false;
+      }
+      value = value << 4 | static_cast<std::uint32_t>(digit);
+    }
+    *value_out = value;
+    return true;
+  }
+
+  // Decodes \uXXXX (and a following low surrogate) to UTF-8.
+  bool CodePoint(std::string* out) {
+    std::uint32_t code = 0;
+    if (!Hex4(&code)) {
+      return false;
+    }
+    if (code >= 0xD800 && code < 0xDC00) {
+      std::uint32_t low = 0;
+      if (text_.substr(pos_, 2) != "\\u" || (pos_ += 2, !Hex4(&low)) || low < 0xDC00 || low >= 0xE000) {
+        return false;
+      }
+      code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    } else if (code >= 0xDC00 && code < 0xE000) {
+      return false;
+    }
+    if (code < 0x80) {
+      out->push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+      out->push_back(static_cast<char>(0xC0 | code >> 6));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+      out->push_back(static_cast<char>(0xE0 | code >> 12));
+      out->push_back(static_cast<char>(0x80 | (code >> 6 & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+      out->push_back(static_cast<char>(0xF0 | code >> 18));
+      out->push_back(static_cast<char>(0x80 | (code >> 12 & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code >> 6 & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+    return true;
+  }
+
+  std::string_view text_;
+  std::size_t pos_ = 0;
+  std::string skipped_;
+};
+
+template <typename Int>
+bool ReadInteger(JsonReader* json, Int* value_out) {
+  std::int64_t value = 0;
+  if (!json->Integer(&value) || value < static_cast<std::int64_t>(std::numeric_limits<Int>::min()) ||
+      static_cast<std::uint64_t>(value) > static_cast<std::uint64_t>(std::numeric_limits<Int>::max())) {
+    return false;
+  }
+  *value_out = static_cast<Int>(value);
+  return true;
+}
+
+bool ReadText(JsonReader* json, std::string* scratch, std::pmr::string* out) {
+  if (!json->String(scratch)) {
+    return false;
+  }
+  out->assign(scratch->data(), scratch->size());
+  return true;
+}
+
+bool ReadTimestamp(JsonReader* json, std::string* text_out, std::uint64_t* epoch_seconds_out) {
+  return json->String(text_out) && ParseIsoTimestamp(*text_out, epoch_seconds_out);
+}
+
+bool ReadTransaction(JsonReader* json, BatchTransaction* out) {
+  LocalTransaction& tx = out->tx;
+  tx.state = TransactionState::kPendingSync;
+  std::string key;
+  std::string value;
+  bool amount = false;
+  bool intent_issued_at = false;
+  bool authorization_issued_at = false;
+  bool expires_at = false;
+  if (!json->Consume('{')) {
+    return false;
+  }
+  if (!json->Peek('}')) {
+    do {
+      if (!json->String(&key) || !json->Consume(':')) {
+        return false;
+      }
+      bool ok = true;
+      if (key == "txId") {
+        ok = ReadText(json, &value, &tx.tx_id);
+      } else if (key == "idempotencyKey") {
+        ok = ReadText(json, &value, &tx.idempotency_key);
+      } else if (key == "merchantIntentId") {
+        ok = ReadText(json, &value, &tx.merchant_intent_id);
+      } else if (key == "payerAuthorizationId") {
+        ok = ReadText(json, &value, &tx.payer_authorization_id);
+      } else if (key == "merchantAccountId") {
+        ok = ReadText(json, &value, &tx.merchant_account_id);
+      } else if (key == "payerAccountId") {
+        ok = ReadText(json, &value, &tx.payer_account_id);
+      } else if (key == "merchantDeviceId") {
+        ok = ReadText(json, &value, &tx.merchant_device_id);
+      } else if (key == "payerDeviceId") {
+        ok = ReadText(json, &value, &tx.payer_device_id);
+      } else if (key == "amountCents") {
+        ok = amount = ReadInteger(json, &tx.amount_cents);
+      } else if (key == "currency") {
+        ok = ReadText(json, &value, &tx.currency);
+      } else if (key == "merchantNonce") {
+        ok = ReadText(json, &value, &tx.merchant_nonce);
+      } else if (key == "payerNonce") {
+        ok = ReadText(json, &value, &tx.payer_nonce);
+      } else if (key == "merchantCounter") {
+        ok = ReadInteger(json, &tx.merchant_counter);
+      } else if (key == "payerCounter") {
+        ok = ReadInteger(json, &tx.payer_counter);
+      } else if (key == "intentIssuedAt") {
+        ok = intent_issued_at = ReadTimestamp(json, &out->intent_issued_at, &tx.intent_issued_at_epoch_seconds);
+      } else if (key == "authorizationIssuedAt") {
+        ok = authorization_issued_at =
+            ReadTimestamp(json, &out->authorization_issued_at, &tx.authorized_at_epoch_seconds);
+      } else if (key == "expiresAt") {
+        ok = expires_at = ReadTimestamp(json, &out->expires_at, &tx.expires_at_epoch_seconds);
+      } else if (key == "merchantSignature") {
+        ok = ReadText(json, &value, &tx.merchant_signature);
+      } else if (key == "payerSignature") {
+        ok = ReadText(json, &value, &tx.payer_signature);
+      } else {
+        ok = json->SkipValue();
+      }
+      if (!ok) {
+        return false;
+      }
+    } while (json->Consume(','));
+  }
+  // The digest would need these in the backend's exact spelling.
+  return json->Consume('}') && amount && intent_issued_at && authorization_issued_at && expires_at;
+}
+
+bool ReadVarint(const std::uint8_t* data, std::size_t size, std::size_t* offset, std::uint64_t* value_out) {
+  std::uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64 && *offset < size; shift += 7) {
+    const std::uint8_t byte = data[(*offset)++];
+    value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *value_out = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+void AppendVarint(std::uint64_t value, std::vector<std::uint8_t>* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<std::uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<std::uint8_t>(value));
+}
+
+// Drops whatever a failed parse appended.
+bool Rollback(std::vector<SyncBatch>* batches,
+              std::size_t batch_count,
+              std::vector<BatchTransaction>* transactions,
+              std::size_t transaction_count) {
+  batches->resize(batch_count);
+  transactions->resize(transaction_count);
+  return false;
+}
+
+}  // namespace
+
+bool ParseSyncUploadJson(std::string_view json_text,
+                         std::vector<SyncBatch>* batches,
+                         std::vector<BatchTransaction>* transactions) {
+  const std::size_t batch_count = batches->size();
+  const std::size_t transaction_count = transactions->size();
+  JsonReader json(json_text);
+  SyncBatch batch;
+  batch.first = transactions->size();
+  std::string key;
+  std::string submitted_at;
+  bool device = false;
+  bool submitted = false;
+  bool listed = false;
+  if (!json.Consume('{')) {
+    return false;
+  }
+  if (!json.Peek('}')) {
+    do {
+      if (!json.String(&key) || !json.Consume(':')) {
+        return Rollback(batches, batch_count, transactions, transaction_count);
+      }
+      bool ok = true;
+      if (key == "merchantDeviceId") {
+        ok = device = json.String(&batch.merchant_device_id);
+      } else if (key == "submittedAt") {
+        ok = submitted = json.String(&submitted_at) &&
+                         ParseIsoTimestamp(submitted_at, &batch.submitted_at_epoch_seconds);
+      } else if (key == "transactions" && !listed) {
+        ok = listed = json.Consume('[');
+        if (ok && !json.Consume(']')) {
+          do {
+            transactions->emplace_back();
+            ok = ReadTransaction(&json, &transactions->back());
+          } while (ok && json.Consume(','));
+          ok = ok && json.Consume(']');
+        }
+      } else {
+        ok = json.SkipValue();
+      }
+      if (!ok) {
+        return Rollback(batches, batch_count, transactions, transaction_count);
+      }
+    } while (json.Consume(','));
+  }
+  if (!json.Consume('}') || !json.AtEnd() || !device || !submitted || !listed) {
+    return Rollback(batches, batch_count, transactions, transaction_count);
+  }
+  batch.count = transactions->size() - batch.first;
+  batches->push_back(std::move(batch));
+  return true;
+}
+
+bool ParseSyncUploadsBinary(const std::uint8_t* data,
+                            std::size_t size,
+                            std::vector<SyncBatch>* batches,
+                            std::vector<BatchTransaction>* transactions) {
+  const std::size_t batch_count = batches->size();
+  const std::size_t transaction_count = transactions->size();
+  std::size_t offset = 0;
+  while (offset < size) {
+    SyncBatch batch;
+    std::uint64_t count = 0;
+    std::uint64_t device_size = 0;
+    if (!ReadVarint(data, size, &offset, &count) ||
+        !ReadVarint(data, size, &offset, &batch.submitted_at_epoch_seconds) ||
+        !ReadVarint(data, size, &offset, &device_size) || device_size > size - offset) {
+      return Rollback(batches, batch_count, transactions, transaction_count);
+    }
+    batch.merchant_device_id.assign(reinterpret_cast<const char*>(data + offset), device_size);
+    offset += device_size;
+    batch.first = transactions->size();
+    batch.count = count;
+    for (std::uint64_t i = 0; i < count; ++i) {
+      std::uint64_t record_size = 0;
+      if (!ReadVarint(data, size, &offset, &record_size) || record_size > size - offset) {
+        return Rollback(batches, batch_count, transactions, transaction_count);
+      }
+      transactions->emplace_back();
+      if (DecodeLocalTransaction(data + offset, record_size, &transactions->back().tx) != WireStatus::kOk) {
+        return Rollback(batches, batch_count, transactions, transaction_count);
+      }
+      offset += record_size;
+    }
+    batches->push_back(std::move(batch));
+  }
+  return true;
+}
+
+bool AppendSyncUploadBinary(const std::string& merchant_device_id,
+                            std::uint64_t submitted_at_epoch_seconds,
+                            const LocalTransaction* transactions,
+                            std::size_t count,
+                            std::vector<std::uint8_t>* out) {
+  const std::size_t start = out->size();
+  AppendVarint(count, out);
+  AppendVarint(submitted_at_epoch_seconds, out);
+  AppendVarint(merchant_device_id.size(), out);
+  out->insert(out->end(), merchant_device_id.begin(), merchant_device_id.end());
+  // Signatures make records outgrow kWireLocalTransactionMaxBytes; this is
+  // FlashJournal's record limit.
+  std::vector<std::uint8_t> record(0xFFFE);
+  for (std::size_t i = 0; i < count; ++i) {
+    std::size_t written = 0;
+    if (EncodeLocalTransaction(transactions[i], record.data(), record.size(), &written) != WireStatus::kOk) {
+      out->resize(start);
+      return false;
+    }
+    AppendVarint(written, out);
+    out->insert(out->end(), record.begin(), record.begin() + static_cast<std::ptrdiff_t>(written));
+  }
+  return true;
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,297 @@
+#include "offline_wallet/batch_validator.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "offline_wallet/iso_time.hpp"
+#include "offline_wallet/sha256.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// Items a worker claims at a time; large enough to keep the shared counter
+// cold, small enough to balance uploads with uneven signature costs.
+constexpr std::size_t kItemsPerClaim = 32;
+
+void AppendTimestamp(const std::string& text, std::uint64_t epoch_seconds, std::string* out) {
+  if (!text.empty()) {
+    out->append(text);
+    return;
+  }
+  char iso[kIsoTimestampSize];
+  FormatIsoTimestamp(epoch_seconds, iso);
+  out->append(iso, sizeof(iso));
+}
+
+void DigestHex(const BatchTransaction& input, std::string* text, std::string* hex_out) {
+  const LocalTransaction& tx = input.tx;
+  char amount[16];
+  const auto amount_end = std::to_chars(amount, amount + sizeof(amount), tx.amount_cents).ptr;
+  text->clear();
+  text->append(tx.tx_id).append(1, '|');
+  text->append(tx.merchant_intent_id).append(1, '|');
+  text->append(tx.payer_authorization_id).append(1, '|');
+  text->append(amount, static_cast<std::size_t>(amount_end - amount)).append(1, '|');
+  text->append(tx.currency).append(1, '|');
+  text->append(tx.merchant_nonce).append(1, '|');
+  text->append(tx.payer_nonce).append(1, '|');
+  AppendTimestamp(input.intent_issued_at, tx.intent_issued_at_epoch_seconds, text);
+  text->append(1, '|');
+  AppendTimestamp(input.authorization_issued_at, tx.authorized_at_epoch_seconds, text);
+  text->append(1, '|');
+  AppendTimestamp(input.expires_at, tx.expires_at_epoch_seconds, text);
+
+  static constexpr char kHex[] = "0123456789abcdef";
+  const Sha256Digest digest = Sha256::Hash(text->data(), text->size());
+  hex_out->resize(2 * digest.size());
+  for (std::size_t i = 0; i < digest.size(); ++i) {
+    (*hex_out)[2 * i] = kHex[digest[i] >> 4];
+    (*hex_out)[2 * i + 1] = kHex[digest[i] & 0x0F];
+  }
+}
+
+const std::string& Key(const std::pmr::string& value, std::string* scratch) {
+  scratch->assign(value.data(), value.size());
+  return *scratch;
+}
+
+// The backend sums a payer's rows whose authorizationIssuedAt falls on the
+// same UTC date.
+const std::string& DailyKey(const LocalTransaction& tx, std::string* scratch) {
+  char day[24];
+  const auto day_end = std::to_chars(day, day + sizeof(day), tx.authorized_at_epoch_seconds / 86'400).ptr;
+  scratch->assign(tx.payer_account_id.data(), tx.payer_account_id.size());
+  scratch->append(1, '|').append(day, static_cast<std::size_t>(day_end - day));
+  return *scratch;
+}
+
+}  // namespace
+
+// A worker's verifier and scratch strings, reused across transactions.
+struct BatchValidator::Worker {
+  std::unique_ptr<SignatureProvider> verifier;
+  std::string key;
+  std::string text;
+  std::string digest;
+  std::string signature;
+};
+
+std::string SyncDigestHex(const BatchTransaction& tx) {
+  std::string text;
+  std::string hex;
+  DigestHex(tx, &text, &hex);
+  return hex;
+}
+
+BatchValidator::BatchValidator(BatchPolicy policy, std::size_t workers, BatchVerifierFactory* factory)
+    : policy_(policy) {
+  workers = std::max<std::size_t>(workers, 1);
+  workers_.reserve(workers);
+  for (std::size_t i = 0; i < workers; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+    workers_.back()->verifier = factory->Create(i);
+  }
+}
+
+BatchValidator::~BatchValidator() = default;
+
+void BatchValidator::AddAccount(std::string account_id, BatchAccount account) {
+  accounts_[std::move(account_id)] = account;
+}
+
+void BatchValidator::AddDevice(std::string device_id, BatchDevice device) {
+  devices_[std::move(device_id)] = std::move(device);
+}
+
+void BatchValidator::AddStoredTransaction(const LocalTransaction& tx) {
+  Store(tx, tx.state == TransactionState::kRejected);
+}
+
+const BatchAccount* BatchValidator::account(const std::string& account_id) const {
+  const auto it = accounts_.find(account_id);
+  return it == accounts_.end() ? nullptr : &it->second;
+}
+
+void BatchValidator::Validate(const std::vector<SyncBatch>& batches,
+                              const std::vector<BatchTransaction>& transactions,
+                              std::uint64_t now_epoch_seconds,
+                              std::vector<SyncResult>* results_out) {
+  // Upload-level checks come first and in order: each accepted upload moves
+  // its merchant's lastSyncAt, which the next upload's freshness check reads.
+  batch_reasons_.assign(batches.size(), nullptr);
+  batch_stale_.assign(batches.size(), 0);
+  items_.clear();
+  for (std::size_t b = 0; b < batches.size(); ++b) {
+    const SyncBatch& batch = batches[b];
+    const auto device = devices_.find(batch.merchant_device_id);
+    if (device == devices_.end() || !device->second.active) {
+      batch_reasons_[b] = "merchant_device_inactive";
+      continue;
+    }
+    if (batch.count > policy_.max_unsynced_per_merchant) {
+      batch_reasons_[b] = "unsynced_limit_exceeded";
+      continue;
+    }
+    const std::uint64_t last_sync = device->second.last_sync_at_epoch_seconds;
+    batch_stale_[b] = now_epoch_seconds > last_sync && now_epoch_seconds - last_sync > policy_.max_sync_age_seconds;
+    device->second.last_sync_at_epoch_seconds = batch.submitted_at_epoch_seconds;
+    for (std::size_t i = batch.first; i < batch.first + batch.count; ++i) {
+      items_.push_back(Item{b, i});
+    }
+  }
+
+  item_reasons_.assign(items_.size(), nullptr);
+  next_item_.store(0, std::memory_order_relaxed);
+  const std::size_t helpers = std::min(workers_.size(), items_.size() / kItemsPerClaim + 1) - 1;
+  std::vector<std::thread> threads;
+  threads.reserve(helpers);
+  for (std::size_t w = 1; w <= helpers; ++w) {
+    threads.emplace_back([this, w, &batches, &transactions] { CheckItems(workers_[w].get(), batches, transactions); });
+  }
+  CheckItems(workers_[0].get(), batches, transactions);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  Settle(batches, transactions, results_out);
+}
+
+void BatchValidator::CheckItems(Worker* worker,
+                                const std::vector<SyncBatch>& batches,
+                                const std::vector<BatchTransaction>& transactions) {
+  for (;;) {
+    const std::size_t first = next_item_.fetch_add(kItemsPerClaim, std::memory_order_relaxed);
+    if (first >= items_.size()) {
+      return;
+    }
+    const std::size_t last = std::min(first + kItemsPerClaim, items_.size());
+    for (std::size_t i = first; i < last; ++i) {
+      const BatchTransaction& tx = transactions[items_[i].tx];
+      if (tx_ids_.count(Key(tx.tx.tx_id, &worker->key)) != 0 ||
+          idempotency_keys_.count(Key(tx.tx.idempotency_key, &worker->key)) != 0) {
+        continue;  // Settle() answers duplicate whatever the checks say.
+      }
+      item_reasons_[i] = Check(worker, batches[items_[i].batch], batch_stale_[items_[i].batch] != 0, tx);
+    }
+  }
+}
+
+const char* BatchValidator::Check(Worker* worker,
+                                  const SyncBatch& batch,
+                                  bool stale,
+                                  const BatchTransaction& input) const {
+  const LocalTransaction& tx = input.tx;
+  const BatchDevice& merchant_device = devices_.find(batch.merchant_device_id)->second;
+  const auto merchant_account = accounts_.find(Key(tx.merchant_account_id, &worker->key));
+  const auto payer_account = accounts_.find(Key(tx.payer_account_id, &worker->key));
+  const auto payer_device = devices_.find(Key(tx.payer_device_id, &worker->key));
+  if (merchant_account == accounts_.end() || payer_account == accounts_.end() || payer_device == devices_.end()) {
+    return "unknown_identity";
+  }
+  if (!merchant_account->second.active || !payer_account->second.active) {
+    return "account_frozen";
+  }
+  if (!payer_device->second.active) {
+    return "payer_device_inactive";
+  }
+  if (std::string_view(tx.merchant_device_id) != batch.merchant_device_id ||
+      std::string_view(tx.merchant_account_id) != merchant_device.account_id) {
+    return "merchant_device_mismatch";
+  }
+  if (tx.amount_cents <= 0 || tx.amount_cents > policy_.risk.max_per_transaction_cents) {
+    return "tx_amount_out_of_policy";
+  }
+  if (stale) {
+    return "merchant_sync_stale";
+  }
+  const std::uint64_t authorized_at = tx.authorized_at_epoch_seconds;
+  const std::uint64_t submitted_at = batch.submitted_at_epoch_seconds;
+  const std::uint64_t skew = authorized_at > submitted_at ? authorized_at - submitted_at : submitted_at - authorized_at;
+  if (skew > policy_.risk.max_clock_skew_seconds) {
+    return "clock_skew_exceeded";
+  }
+  if (tx.expires_at_epoch_seconds < submitted_at) {
+    return "intent_expired";
+  }
+
+  // The backend verifies both signatures before deciding, and so do we.
+  DigestHex(input, &worker->text, &worker->digest);
+  const bool merchant_ok = worker->verifier->Verify(Key(tx.merchant_signature, &worker->signature), worker->digest,
+                                                    merchant_device.public_key);
+  const bool payer_ok = worker->verifier->Verify(Key(tx.payer_signature, &worker->signature), worker->digest,
+                                                 payer_device->second.public_key);
+  if (!merchant_ok || !payer_ok) {
+    return "signature_invalid";
+  }
+  return nullptr;
+}
+
+void BatchValidator::Settle(const std::vector<SyncBatch>& batches,
+                            const std::vector<BatchTransaction>& transactions,
+                            std::vector<SyncResult>* results_out) {
+  std::size_t item = 0;
+  for (std::size_t b = 0; b < batches.size(); ++b) {
+    const SyncBatch& batch = batches[b];
+    for (std::size_t i = batch.first; i < batch.first + batch.count; ++i) {
+      const LocalTransaction& tx = transactions[i].tx;
+      SyncResult result;
+      result.tx_id.assign(tx.tx_id.data(), tx.tx_id.size());
+      result.status = SyncResultStatus::kRejected;
+      const char* reason = batch_reasons_[b];
+      if (reason == nullptr) {
+        reason = Apply(tx, item_reasons_[item++], &result.status);
+      }
+      if (reason != nullptr) {
+        result.reason = reason;
+      }
+      results_out->push_back(std::move(result));
+    }
+  }
+}
+
+const char* BatchValidator::Apply(const LocalTransaction& tx, const char* checked, SyncResultStatus* status_out) {
+  if (tx_ids_.count(Key(tx.tx_id, &settle_key_)) != 0) {
+    *status_out = SyncResultStatus::kDuplicate;
+    return "tx_id_seen";
+  }
+  if (idempotency_keys_.count(Key(tx.idempotency_key, &settle_key_)) != 0) {
+    *status_out = SyncResultStatus::kDuplicate;
+    return "idempotency_key_seen";
+  }
+  if (checked != nullptr) {
+    return checked;
+  }
+  const auto spent = daily_spent_.find(DailyKey(tx, &settle_key_));
+  if ((spent == daily_spent_.end() ? 0 : spent->second) + tx.amount_cents > policy_.risk.max_per_day_per_payer_cents) {
+    return "daily_limit_exceeded";
+  }
+  // Check() found both accounts.
+  BatchAccount& payer = accounts_.find(Key(tx.payer_account_id, &settle_key_))->second;
+  BatchAccount& merchant = accounts_.find(Key(tx.merchant_account_id, &settle_key_))->second;
+  if (!payer.wallet || !merchant.wallet) {
+    return "wallet_missing";
+  }
+  if (payer.available_cents < tx.amount_cents) {
+    Store(tx, true);
+    return "insufficient_funds";
+  }
+  payer.available_cents -= tx.amount_cents;
+  merchant.available_cents += tx.amount_cents;
+  Store(tx, false);
+  *status_out = SyncResultStatus::kAccepted;
+  return nullptr;
+}
+
+void BatchValidator::Store(const LocalTransaction& tx, bool rejected) {
+  tx_ids_.emplace(tx.tx_id.data(), tx.tx_id.size());
+  idempotency_keys_.emplace(tx.idempotency_key.data(), tx.idempotency_key.size());
+  if (!rejected) {
+    daily_spent_[DailyKey(tx, &settle_key_)] += tx.amount_cents;
+  }
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,212 @@
+#include "offline_wallet/block_device.hpp"
+
+#include <cstring>
+#include <utility>
+
+namespace offline_wallet {
+
+namespace {
+
+bool InRange(std::size_t address, std::size_t size, std::size_t total) {
+  return address <= total && size <= total - address;
+}
+
+bool WithinOneSector(std::size_t address, std::size_t size, std::size_t sector_size) {
+  return size == 0 || address / sector_size == (address + size - 1) / sector_size;
+}
+
+}  // namespace
+
+RamBlockDevice::RamBlockDevice(std::size_t sector_size, std::size_t sector_count, std::size_t program_size)
+    : sector_size_(sector_size),
+      sector_count_(sector_count),
+      program_size_(program_size),
+      bytes_(sector_size * sector_count, 0xFF),
+      erase_counts_(sector_count, 0) {}
+
+bool RamBlockDevice::Read(std::size_t address, std::uint8_t* out, std::size_t size) const {
+  if (!InRange(address, size, bytes_.size())) {
+    return false;
+  }
+  std::memcpy(out, bytes_.data() + address, size);
+  return true;
+}
+
+bool RamBlockDevice::Program(std::size_t address, const std::uint8_t* data, std::size_t size) {
+  if (!InRange(address, size, bytes_.size()) || !WithinOneSector(address, size, sector_size_) ||
+      address % program_size_ != 0 || size % program_size_ != 0) {
+    return false;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    bytes_[address + i] &= data[i];
+  }
+  ++program_calls_;
+  return true;
+}
+
+bool RamBlockDevice::Erase(std::size_t sector) {
+  if (sector >= sector_count_) {
+    return false;
+  }
+  std::memset(bytes_.data() + sector * sector_size_, 0xFF, sector_size_);
+  ++erase_counts_[sector];
+  return true;
+}
+
+bool RamBlockDevice::Sync() {
+  ++sync_calls_;
+  return true;
+}
+
+FileBlockDevice::FileBlockDevice(std::string path,
+                                 std::size_t sector_size,
+                                 std::size_t sector_count,
+                                 std::size_t program_size)
+    : path_(std::move(path)),
+      sector_size_(sector_size),
+      sector_count_(sector_count),
+      program_size_(program_size) {
+  file_ = std::fopen(path_.c_str(), "r+b");
+  if (file_ != nullptr) {
+    return;
+  }
+  file_ = std::fopen(path_.c_str(), "w+b");
+  if (file_ == nullptr) {
+    return;
+  }
+  for (std::size_t sector = 0; sector < sector_count_; ++sector) {
+    if (!Erase(sector)) {
+      std::fclose(file_);
+      file_ = nullptr;
+      return;
+    }
+  }
+  Sync();
+}
+
+FileBlockDevice::~FileBlockDevice() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+  }
+}
+
+bool FileBlockDevice::Read(std::size_t address, std::uint8_t* out, std::size_t size) const {
+  if (file_ == nullptr || !InRange(address, size, sector_size_ * sector_count_)) {
+    return false;
+  }
+  return std::fseek(file_, static_cast<long>(address), SEEK_SET) == 0 &&
+         std::fread(out, 1, size, file_) == size;
+}
+
+bool FileBlockDevice::Program(std::size_t address, const std::uint8_t* data, std::size_t size) {
+  if (!WithinOneSector(address, size, sector_size_) || address % program_size_ != 0 ||
+      size % program_size_ != 0) {
+    return false;
+  }
+  std::vector<std::uint8_t> merged(size);
+  if (!Read(address, merged.data(), size)) {
+    return false;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    merged[i] &= data[i];
+  }
+  return std::fseek(file_, static_cast<long>(address), SEEK_SET) == 0 &&
+         std::fwrite(merged.data(), 1, size, file_) == size;
+}
+
+bool FileBlockDevice::Erase(std::size_t sector) {
+  if (file_ == nullptr || sector >= sector_count_) {
+    return false;
+  }
+  const std::vector<std::uint8_t> erased(sector_size_, 0xFF);
+  return std::fseek(file_, static_cast<long>(sector * sector_size_), SEEK_SET) == 0 &&
+         std::fwrite(erased.data(), 1, erased.size(), file_) == erased.size();
+}
+
+bool FileBlockDevice::Sync() { return file_ != nullptr && std::fflush(file_) == 0; }
+
+void FaultInjectingBlockDevice::ArmPowerCut(std::uint64_t bytes_until_cut) {
+  armed_ = true;
+  powered_ = true;
+  remaining_ = bytes_until_cut;
+}
+
+bool BlockDeviceRegion::Read(std::size_t address, std::uint8_t* out, std::size_t size) const {
+  return InRange(address, size, sector_count_ * SectorSize()) &&
+         inner_->Read(first_sector_ * SectorSize() + address, out, size);
+}
+
+bool BlockDeviceRegion::Program(std::size_t address, const std::uint8_t* data, std::size_t size) {
+  return InRange(address, size, sector_count_ * SectorSize()) &&
+         inner_->Program(first_sector_ * SectorSize() + address, data, size);
+}
+
+bool BlockDeviceRegion::Erase(std::size_t sector) {
+  return sector < sector_count_ && inner_->Erase(first_sector_ + sector);
+}
+
+bool FaultInjectingBlockDevice::Read(std::size_t address, std::uint8_t* out, std::size_t size) const {
+  return powered_ && inner_->Read(address, out, size);
+}
+
+bool FaultInjectingBlockDevice::Program(std::size_t address, const std::uint8_t* data, std::size_t size) {
+  if (!powered_) {
+    return false;
+  }
+  const std::size_t landed = Budget(size);
+  if (landed == size) {
+    return inner_->Program(address, data, size);
+  }
+
+  // Round the torn prefix up to whole program units; bits past the cut stay
+  // erased because programming 0xFF leaves NOR cells untouched.
+  const std::size_t unit = inner_->ProgramSize();
+  const std::size_t span = (landed + unit - 1) / unit * unit;
+  if (span == 0) {
+    return false;
+  }
+  // Only `landed` bytes come from the caller; `span` may run past its buffer.
+  std::vector<std::uint8_t> torn(span, 0xFF);
+  std::memcpy(torn.data(), data, landed);
+  inner_->Program(address, torn.data(), span);
+  return false;
+}
+
+bool FaultInjectingBlockDevice::Erase(std::size_t sector) {
+  if (!powered_) {
+    return false;
+  }
+  const std::size_t sector_size = inner_->SectorSize();
+  const std::size_t landed = Budget(sector_size);
+  if (landed == sector_size) {
+    return inner_->Erase(sector);
+  }
+
+  // Only the first `landed` bytes (in whole program units) were reset.
+  const std::size_t unit = inner_->ProgramSize();
+  const std::size_t keep_from = (landed + unit - 1) / unit * unit;
+  const std::size_t base = sector * sector_size;
+  std::vector<std::uint8_t> old(sector_size);
+  if (keep_from == 0 || !inner_->Read(base, old.data(), sector_size) || !inner_->Erase(sector)) {
+    return false;
+  }
+  if (keep_from < sector_size) {
+    inner_->Program(base + keep_from, old.data() + keep_from, sector_size - keep_from);
+  }
+  return false;
+}
+
+std::size_t FaultInjectingBlockDevice::Budget(std::size_t size) {
+  if (!armed_ || remaining_ >= size) {
+    remaining_ -= armed_ ? size : 0;
+    bytes_written_ += size;
+    return size;
+  }
+  const std::size_t landed = static_cast<std::size_t>(remaining_);
+  bytes_written_ += landed;
+  remaining_ = 0;
+  powered_ = false;
+  return landed;
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,117 @@
+#include "offline_wallet/boot_checkpoint.hpp"
+
+#include "offline_wallet/byte_codec.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// Image: [magic][export cursor:u64][journal size][journal checkpoint]
+// [tracker size][tracker image]; a tracker size of 0 means none was saved.
+constexpr std::uint32_t kBootMagic = 0x3142574F;  // "OWB1"
+constexpr std::size_t kBootHeaderSize = 16;
+
+// Counts transactions first seen in the log tail; the checkpointed tracker
+// already holds the rest.
+class TailSpendCounter : public JournalTailVisitor {
+ public:
+  TailSpendCounter(SpendTracker* tracker, std::uint64_t now) : tracker_(tracker), now_(now) {}
+
+  void Visit(const LocalTransaction& tx, bool known) override {
+    if (!known) {
+      tracker_->Count(tx, now_);
+    }
+  }
+
+ private:
+  SpendTracker* tracker_;
+  std::uint64_t now_;
+};
+
+}  // namespace
+
+BootCheckpoint::BootCheckpoint(FlashJournal* journal,
+                               SnapshotStore* store,
+                               SyncExporter* exporter,
+                               SpendTracker* tracker,
+                               BootCheckpointOptions options)
+    : journal_(journal), store_(store), exporter_(exporter), tracker_(tracker), options_(options) {}
+
+BootRecovery BootCheckpoint::Recover(std::uint64_t now) {
+  BootRecovery recovery = BootRecovery::kFromCheckpoint;
+  if (!RecoverFromCheckpoint(now)) {
+    if (!journal_->Mount() || (tracker_ != nullptr && !tracker_->Rebuild(*journal_, now))) {
+      return BootRecovery::kFailed;
+    }
+    if (exporter_ != nullptr) {
+      exporter_->Seek(0);
+    }
+    recovery = BootRecovery::kFullReplay;
+  }
+  const FlashJournalStats stats = journal_->stats();
+  replayed_records_ = stats.replayed_records;
+  checkpointed_records_ = stats.appended_records;
+  checkpointed_cursor_ = exporter_ != nullptr ? exporter_->cursor() : 0;
+  due_ = recovery == BootRecovery::kFullReplay;
+  return recovery;
+}
+
+bool BootCheckpoint::CheckpointDue() const {
+  return due_ || journal_->stats().appended_records - checkpointed_records_ >= options_.checkpoint_records ||
+         (exporter_ != nullptr && exporter_->cursor() != checkpointed_cursor_);
+}
+
+bool BootCheckpoint::WriteCheckpoint() {
+  const std::uint64_t cursor = exporter_ != nullptr ? exporter_->cursor() : 0;
+  image_.assign(kBootHeaderSize, 0);
+  Put32(image_.data(), kBootMagic);
+  Put64(image_.data() + 4, cursor);
+  journal_->AppendCheckpoint(&image_);
+  Put32(image_.data() + 12, static_cast<std::uint32_t>(image_.size() - kBootHeaderSize));
+
+  const std::size_t tracker_offset = image_.size();
+  image_.resize(tracker_offset + 4);
+  if (tracker_ != nullptr) {
+    tracker_->AppendImage(&image_);
+  }
+  Put32(image_.data() + tracker_offset, static_cast<std::uint32_t>(image_.size() - tracker_offset - 4));
+
+  if (!store_->Write(image_.data(), image_.size())) {
+    return false;
+  }
+  checkpointed_records_ = journal_->stats().appended_records;
+  checkpointed_cursor_ = cursor;
+  due_ = false;
+  return true;
+}
+
+bool BootCheckpoint::RecoverFromCheckpoint(std::uint64_t now) {
+  if (!store_->Read(&image_) || image_.size() < kBootHeaderSize + 4 || Get32(image_.data()) != kBootMagic) {
+    return false;
+  }
+  const std::size_t journal_size = Get32(image_.data() + 12);
+  if (journal_size > image_.size() - kBootHeaderSize - 4) {
+    return false;
+  }
+  const std::uint8_t* tracker_image = image_.data() + kBootHeaderSize + journal_size + 4;
+  const std::size_t tracker_size = Get32(tracker_image - 4);
+  if (tracker_size != image_.size() - kBootHeaderSize - journal_size - 4) {
+    return false;
+  }
+
+  // The tracker goes first so the tail is counted on top of its windows.
+  if (tracker_ != nullptr && !tracker_->RestoreImage(tracker_image, tracker_size)) {
+    return false;
+  }
+  TailSpendCounter counter(tracker_, now);
+  if (!journal_->MountFromCheckpoint(image_.data() + kBootHeaderSize, journal_size,
+                                     tracker_ != nullptr ? &counter : nullptr)) {
+    return false;
+  }
+  if (exporter_ != nullptr) {
+    exporter_->Seek(Get64(image_.data() + 4));
+  }
+  return true;
+}
+
+}  // namespace offline_wallet
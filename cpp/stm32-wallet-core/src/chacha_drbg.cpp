@@ -0,0 +1,211 @@
+#include "offline_wallet/chacha_drbg.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "offline_wallet/sha256.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+constexpr std::uint32_t Rotl(std::uint32_t value, int bits) { return value << bits | value >> (32 - bits); }
+
+std::uint32_t Load32(const std::uint8_t* bytes) {
+  return static_cast<std::uint32_t>(bytes[0]) | static_cast<std::uint32_t>(bytes[1]) << 8 |
+         static_cast<std::uint32_t>(bytes[2]) << 16 | static_cast<std::uint32_t>(bytes[3]) << 24;
+}
+
+void Store32(std::uint32_t value, std::uint8_t* bytes) {
+  bytes[0] = static_cast<std::uint8_t>(value);
+  bytes[1] = static_cast<std::uint8_t>(value >> 8);
+  bytes[2] = static_cast<std::uint8_t>(value >> 16);
+  bytes[3] = static_cast<std::uint8_t>(value >> 24);
+}
+
+void QuarterRound(std::uint32_t* x, int a, int b, int c, int d) {
+  x[a] += x[b];
+  x[d] = Rotl(x[d] ^ x[a], 16);
+  x[c] += x[d];
+  x[b] = Rotl(x[b] ^ x[c], 12);
+  x[a] += x[b];
+  x[d] = Rotl(x[d] ^ x[a], 8);
+  x[c] += x[d];
+  x[b] = Rotl(x[b] ^ x[c], 7);
+}
+
+// Runs the 20 rounds over `input` (RFC 8439 state layout) into 64 bytes of
+// keystream; `x` is scratch the caller wipes.
+void Block(const std::uint32_t* input, std::uint32_t* x, std::uint8_t* out) {
+  std::memcpy(x, input, 16 * sizeof(std::uint32_t));
+  for (int round = 0; round < 10; ++round) {
+    QuarterRound(x, 0, 4, 8, 12);
+    QuarterRound(x, 1, 5, 9, 13);
+    QuarterRound(x, 2, 6, 10, 14);
+    QuarterRound(x, 3, 7, 11, 15);
+    QuarterRound(x, 0, 5, 10, 15);
+    QuarterRound(x, 1, 6, 11, 12);
+    QuarterRound(x, 2, 7, 8, 13);
+    QuarterRound(x, 3, 4, 9, 14);
+  }
+  for (int i = 0; i < 16; ++i) {
+    Store32(x[i] + input[i], out + 4 * i);
+  }
+}
+
+void LoadState(const ChaCha20Key& key, std::uint32_t counter, const std::uint8_t* nonce, std::uint32_t* state) {
+  state[0] = 0x61707865;
+  state[1] = 0x3320646e;
+  state[2] = 0x79622d32;
+  state[3] = 0x6b206574;
+  for (int i = 0; i < 8; ++i) {
+    state[4 + i] = Load32(key.data() + 4 * i);
+  }
+  state[12] = counter;
+  for (int i = 0; i < 3; ++i) {
+    state[13 + i] = Load32(nonce + 4 * i);
+  }
+}
+
+// Key material on the stack must not outlive the call; volatile keeps the
+// stores. Member buffers are cleared with memset, which is never elided.
+void Wipe(void* data, std::size_t size) {
+  volatile auto* bytes = static_cast<volatile std::uint8_t*>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    bytes[i] = 0;
+  }
+}
+
+}  // namespace
+
+void ChaCha20Generate(const ChaCha20Key& key,
+                      std::uint32_t counter,
+                      const ChaCha20Nonce& nonce,
+                      ChaCha20Block* block_out) {
+  std::uint32_t state[16];
+  std::uint32_t x[16];
+  LoadState(key, counter, nonce.data(), state);
+  Block(state, x, block_out->data());
+  Wipe(x, sizeof(x));
+  Wipe(state, sizeof(state));
+}
+
+ChaChaDrbg::ChaChaDrbg(const ChaCha20Key& seed) : key_(seed), position_(buffer_.size()), seeded_(true) {}
+
+ChaChaDrbg::ChaChaDrbg(EntropySource* entropy, ChaChaDrbgOptions options)
+    : entropy_(entropy), options_(options), position_(buffer_.size()) {
+  Reseed();
+}
+
+ChaChaDrbg::~ChaChaDrbg() {
+  Wipe(key_.data(), key_.size());
+  Wipe(buffer_.data(), buffer_.size());
+}
+
+void ChaChaDrbg::NextBytes(std::uint8_t* out, std::size_t size) {
+  if (!Ready()) {
+    std::memset(out, 0, size);
+    return;
+  }
+  while (size > 0) {
+    if (position_ == buffer_.size()) {
+      Refill();
+    }
+    const std::size_t take = std::min(size, buffer_.size() - position_);
+    std::memcpy(out, buffer_.data() + position_, take);
+    std::memset(buffer_.data() + position_, 0, take);
+    position_ += take;
+    bytes_since_reseed_ += take;
+    out += take;
+    size -= take;
+  }
+}
+
+std::size_t ChaChaDrbg::FillHex(std::size_t bytes, char* hex_out) {
+  if (!Ready()) {
+    return 0;
+  }
+  std::uint8_t chunk[32];
+  for (std::size_t done = 0; done < bytes;) {
+    const std::size_t take = std::min(bytes - done, sizeof(chunk));
+    NextBytes(chunk, take);
+    for (std::size_t i = 0; i < take; ++i) {
+      hex_out[2 * (done + i)] = kHexDigits[chunk[i] >> 4];
+      hex_out[2 * (done + i) + 1] = kHexDigits[chunk[i] & 0x0F];
+    }
+    done += take;
+  }
+  Wipe(chunk, sizeof(chunk));
+  return 2 * bytes;
+}
+
+std::string ChaChaDrbg::NextHex(std::size_t bytes) {
+  std::string hex(2 * bytes, '0');
+  hex.resize(FillHex(bytes, hex.data()));
+  return hex;
+}
+
+bool ChaChaDrbg::Ready() {
+  if (!seeded_) {
+    Reseed();
+  }
+  return seeded_;
+}
+
+bool ChaChaDrbg::Reseed() {
+  if (entropy_ == nullptr) {
+    return false;
+  }
+  std::uint8_t entropy[32];
+  if (!entropy_->Gather(entropy, sizeof(entropy))) {
+    ++reseed_failures_;
+    return false;
+  }
+  Rekey(entropy, sizeof(entropy));
+  Wipe(entropy, sizeof(entropy));
+  seeded_ = true;
+  bytes_since_reseed_ = 0;
+  ++reseed_count_;
+  return true;
+}
+
+void ChaChaDrbg::Mix(const void* data, std::size_t size) { Rekey(data, size); }
+
+void ChaChaDrbg::Rekey(const void* data, std::size_t size) {
+  Sha256 hash;
+  hash.Update(key_.data(), key_.size());
+  hash.Update(data, size);
+  Sha256Digest digest;
+  hash.Finish(&digest);
+  std::memcpy(key_.data(), digest.data(), key_.size());
+  Wipe(digest.data(), digest.size());
+  std::memset(buffer_.data(), 0, buffer_.size());
+  position_ = buffer_.size();
+}
+
+// Only reached once seeded; a failed periodic reseed keeps the current key.
+void ChaChaDrbg::Refill() {
+  if (entropy_ != nullptr && options_.reseed_interval_bytes != 0 &&
+      bytes_since_reseed_ >= options_.reseed_interval_bytes) {
+    Reseed();
+  }
+  // Each refill has a fresh key, so the nonce stays zero and the counter
+  // restarts.
+  static constexpr std::uint8_t kNonce[12] = {};
+  std::uint32_t state[16];
+  std::uint32_t x[16];
+  LoadState(key_, 0, kNonce, state);
+  for (std::size_t i = 0; i < kBufferBlocks; ++i) {
+    state[12] = static_cast<std::uint32_t>(i);
+    Block(state, x, buffer_.data() + 64 * i);
+  }
+  Wipe(x, sizeof(x));
+  Wipe(state, sizeof(state));
+  std::memcpy(key_.data(), buffer_.data(), key_.size());
+  std::memset(buffer_.data(), 0, key_.size());
+  position_ = key_.size();
+}
+
+}  // namespace offline_wallet
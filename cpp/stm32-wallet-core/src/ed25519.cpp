@@ -0,0 +1,880 @@
+#include "offline_wallet/ed25519.hpp"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "offline_wallet/sha512.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// GF(2^255 - 19) in radix 2^25.5: ten signed limbs of 26, 25, 26, ... bits.
+// Products are reduced back to |limb| <= 2^25; one unreduced Add or Sub may
+// feed a Mul (limbs below 2^27 keep the 64-bit sums from overflowing).
+
+struct Fe {
+  std::int32_t v[10];
+};
+
+constexpr int LimbBits(int i) { return (i & 1) != 0 ? 25 : 26; }
+
+Fe FeFromInt(std::int32_t value) {
+  Fe f{};
+  f.v[0] = value;
+  return f;
+}
+
+Fe Add(const Fe& f, const Fe& g) {
+  Fe h;
+  for (int i = 0; i < 10; ++i) {
+    h.v[i] = f.v[i] + g.v[i];
+  }
+  return h;
+}
+
+Fe Sub(const Fe& f, const Fe& g) {
+  Fe h;
+  for (int i = 0; i < 10; ++i) {
+    h.v[i] = f.v[i] - g.v[i];
+  }
+  return h;
+}
+
+Fe Neg(const Fe& f) {
+  Fe h;
+  for (int i = 0; i < 10; ++i) {
+    h.v[i] = -f.v[i];
+  }
+  return h;
+}
+
+void CarryLimb(std::int64_t* h, int i) {
+  const int bits = LimbBits(i);
+  const std::int64_t carry = (h[i] + (std::int64_t{1} << (bits - 1))) >> bits;
+  h[i] -= carry * (std::int64_t{1} << bits);
+  if (i == 9) {
+    h[0] += carry * 19;
+  } else {
+    h[i + 1] += carry;
+  }
+}
+
+// Two interleaved carry chains, which halves the dependency depth.
+Fe Carry(std::int64_t* h) {
+  static constexpr int kOrder[] = {0, 4, 1, 5, 2, 6, 3, 7, 4, 8, 9, 0};
+  for (int i : kOrder) {
+    CarryLimb(h, i);
+  }
+  Fe f;
+  for (int i = 0; i < 10; ++i) {
+    f.v[i] = static_cast<std::int32_t>(h[i]);
+  }
+  return f;
+}
+
+// Brings a sum or difference back to reduced limbs.
+Fe Weak(const Fe& f) {
+  std::int64_t h[10];
+  for (int i = 0; i < 10; ++i) {
+    h[i] = f.v[i];
+  }
+  return Carry(h);
+}
+
+// Limb i sits at bit ceil(25.5 i): a product of two odd limbs overshoots by
+// one bit, and anything past 2^255 wraps around times 19. Written out term by
+// term; the loop form is about twice as slow.
+Fe Mul(const Fe& f, const Fe& g) {
+  const std::int64_t f0 = f.v[0], f1 = f.v[1], f2 = f.v[2], f3 = f.v[3], f4 = f.v[4];
+  const std::int64_t f5 = f.v[5], f6 = f.v[6], f7 = f.v[7], f8 = f.v[8], f9 = f.v[9];
+  const std::int64_t g0 = g.v[0], g1 = g.v[1], g2 = g.v[2], g3 = g.v[3], g4 = g.v[4];
+  const std::int64_t g5 = g.v[5], g6 = g.v[6], g7 = g.v[7], g8 = g.v[8], g9 = g.v[9];
+  const std::int64_t f1_2 = 2 * f1, f3_2 = 2 * f3, f5_2 = 2 * f5, f7_2 = 2 * f7, f9_2 = 2 * f9;
+  const std::int64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4, g5_19 = 19 * g5;
+  const std::int64_t g6_19 = 19 * g6, g7_19 = 19 * g7, g8_19 = 19 * g8, g9_19 = 19 * g9;
+  std::int64_t h[10];
+  h[0] = f0 * g0 + f1_2 * g9_19 + f2 * g8_19 + f3_2 * g7_19 + f4 * g6_19 + f5_2 * g5_19 + f6 * g4_19 + f7_2 * g3_19 +
+         f8 * g2_19 + f9_2 * g1_19;
+  h[1] = f0 * g1 + f1 * g0 + f2 * g9_19 + f3 * g8_19 + f4 * g7_19 + f5 * g6_19 + f6 * g5_19 + f7 * g4_19 + f8 * g3_19 +
+         f9 * g2_19;
+  h[2] = f0 * g2 + f1_2 * g1 + f2 * g0 + f3_2 * g9_19 + f4 * g8_19 + f5_2 * g7_19 + f6 * g6_19 + f7_2 * g5_19 +
+         f8 * g4_19 + f9_2 * g3_19;
+  h[3] = f0 * g3 + f1 * g2 + f2 * g1 + f3 * g0 + f4 * g9_19 + f5 * g8_19 + f6 * g7_19 + f7 * g6_19 + f8 * g5_19 +
+         f9 * g4_19;
+  h[4] = f0 * g4 + f1_2 * g3 + f2 * g2 + f3_2 * g1 + f4 * g0 + f5_2 * g9_19 + f6 * g8_19 + f7_2 * g7_19 + f8 * g6_19 +
+         f9_2 * g5_19;
+  h[5] = f0 * g5 + f1 * g4 + f2 * g3 + f3 * g2 + f4 * g1 + f5 * g0 + f6 * g9_19 + f7 * g8_19 + f8 * g7_19 + f9 * g6_19;
+  h[6] = f0 * g6 + f1_2 * g5 + f2 * g4 + f3_2 * g3 + f4 * g2 + f5_2 * g1 + f6 * g0 + f7_2 * g9_19 + f8 * g8_19 +
+         f9_2 * g7_19;
+  h[7] = f0 * g7 + f1 * g6 + f2 * g5 + f3 * g4 + f4 * g3 + f5 * g2 + f6 * g1 + f7 * g0 + f8 * g9_19 + f9 * g8_19;
+  h[8] = f0 * g8 + f1_2 * g7 + f2 * g6 + f3_2 * g5 + f4 * g4 + f5_2 * g3 + f6 * g2 + f7_2 * g1 + f8 * g0 +
+         f9_2 * g9_19;
+  h[9] = f0 * g9 + f1 * g8 + f2 * g7 + f3 * g6 + f4 * g5 + f5 * g4 + f6 * g3 + f7 * g2 + f8 * g1 + f9 * g0;
+  return Carry(h);
+}
+
+Fe Sq(const Fe& f) {
+  const std::int64_t f0 = f.v[0], f1 = f.v[1], f2 = f.v[2], f3 = f.v[3], f4 = f.v[4];
+  const std::int64_t f5 = f.v[5], f6 = f.v[6], f7 = f.v[7], f8 = f.v[8], f9 = f.v[9];
+  const std::int64_t f1_2 = 2 * f1, f2_2 = 2 * f2, f3_2 = 2 * f3, f4_2 = 2 * f4, f5_2 = 2 * f5, f6_2 = 2 * f6;
+  const std::int64_t f7_2 = 2 * f7, f8_2 = 2 * f8, f9_2 = 2 * f9;
+  const std::int64_t f3_4 = 4 * f3, f5_4 = 4 * f5, f7_4 = 4 * f7;
+  const std::int64_t f6_19 = 19 * f6, f8_19 = 19 * f8;
+  const std::int64_t f5_38 = 38 * f5, f6_38 = 38 * f6, f7_38 = 38 * f7, f8_38 = 38 * f8, f9_38 = 38 * f9;
+  const std::int64_t f7_76 = 76 * f7, f9_76 = 76 * f9;
+  std::int64_t h[10];
+  h[0] = f0 * f0 + f1 * f9_76 + f2 * f8_38 + f3 * f7_76 + f4 * f6_38 + f5 * f5_38;
+  h[1] = f0 * f1_2 + f2 * f9_38 + f3 * f8_38 + f4 * f7_38 + f5 * f6_38;
+  h[2] = f0 * f2_2 + f1 * f1_2 + f3 * f9_76 + f4 * f8_38 + f5 * f7_76 + f6 * f6_19;
+  h[3] = f0 * f3_2 + f1 * f2_2 + f4 * f9_38 + f5 * f8_38 + f6 * f7_38;
+  h[4] = f0 * f4_2 + f1 * f3_4 + f2 * f2 + f5 * f9_76 + f6 * f8_38 + f7 * f7_38;
+  h[5] = f0 * f5_2 + f1 * f4_2 + f2 * f3_2 + f6 * f9_38 + f7 * f8_38;
+  h[6] = f0 * f6_2 + f1 * f5_4 + f2 * f4_2 + f3 * f3_2 + f7 * f9_76 + f8 * f8_19;
+  h[7] = f0 * f7_2 + f1 * f6_2 + f2 * f5_2 + f3 * f4_2 + f8 * f9_38;
+  h[8] = f0 * f8_2 + f1 * f7_4 + f2 * f6_2 + f3 * f5_4 + f4 * f4 + f9 * f9_38;
+  h[9] = f0 * f9_2 + f1 * f8_2 + f2 * f7_2 + f3 * f6_2 + f4 * f5_2;
+  return Carry(h);
+}
+
+Fe SqTimes(Fe f, int count) {
+  for (int i = 0; i < count; ++i) {
+    f = Sq(f);
+  }
+  return f;
+}
+
+// z^(2^250 - 1), the common prefix of the inversion and square-root chains;
+// also returns z^11 for the inversion.
+Fe Pow2250Minus1(const Fe& z, Fe* z11_out) {
+  const Fe z2 = Sq(z);
+  const Fe z9 = Mul(SqTimes(z2, 2), z);
+  const Fe z11 = Mul(z9, z2);
+  const Fe z_5_0 = Mul(Sq(z11), z9);
+  const Fe z_10_0 = Mul(SqTimes(z_5_0, 5), z_5_0);
+  const Fe z_20_0 = Mul(SqTimes(z_10_0, 10), z_10_0);
+  const Fe z_40_0 = Mul(SqTimes(z_20_0, 20), z_20_0);
+  const Fe z_50_0 = Mul(SqTimes(z_40_0, 10), z_10_0);
+  const Fe z_100_0 = Mul(SqTimes(z_50_0, 50), z_50_0);
+  const Fe z_200_0 = Mul(SqTimes(z_100_0, 100), z_100_0);
+  if (z11_out != nullptr) {
+    *z11_out = z11;
+  }
+  return Mul(SqTimes(z_200_0, 50), z_50_0);
+}
+
+// z^(p - 2) = z^(2^255 - 21).
+Fe Invert(const Fe& z) {
+  Fe z11;
+  const Fe z_250_0 = Pow2250Minus1(z, &z11);
+  return Mul(SqTimes(z_250_0, 5), z11);
+}
+
+// z^((p - 5) / 8) = z^(2^252 - 3).
+Fe Pow22523(const Fe& z) { return Mul(SqTimes(Pow2250Minus1(z, nullptr), 2), z); }
+
+void ToBytes(const Fe& f, std::uint8_t* out) {
+  const Fe reduced = Weak(f);
+  std::int64_t h[10];
+  for (int i = 0; i < 10; ++i) {
+    h[i] = reduced.v[i];
+  }
+  // q = 1 exactly when the value is at least p; subtracting p is then adding
+  // 19 and dropping bit 255.
+  std::int64_t q = (19 * h[9] + (std::int64_t{1} << 24)) >> 25;
+  for (int i = 0; i < 10; ++i) {
+    q = (h[i] + q) >> LimbBits(i);
+  }
+  h[0] += 19 * q;
+  for (int i = 0; i < 10; ++i) {
+    const std::int64_t carry = h[i] >> LimbBits(i);
+    h[i] -= carry * (std::int64_t{1} << LimbBits(i));
+    if (i < 9) {
+      h[i + 1] += carry;
+    }
+  }
+  std::uint64_t acc = 0;
+  int acc_bits = 0;
+  std::size_t used = 0;
+  for (int i = 0; i < 10; ++i) {
+    acc |= static_cast<std::uint64_t>(h[i]) << acc_bits;
+    acc_bits += LimbBits(i);
+    for (; acc_bits >= 8; acc_bits -= 8, acc >>= 8) {
+      out[used++] = static_cast<std::uint8_t>(acc);
+    }
+  }
+  out[used] = static_cast<std::uint8_t>(acc);
+}
+
+// Ignores bit 255.
+Fe FromBytes(const std::uint8_t* in) {
+  Fe f;
+  int position = 0;
+  for (int i = 0; i < 10; ++i) {
+    std::uint64_t acc = 0;
+    for (int byte = 0; byte < 5 && position / 8 + byte < 32; ++byte) {
+      acc |= static_cast<std::uint64_t>(in[position / 8 + byte]) << (8 * byte);
+    }
+    f.v[i] = static_cast<std::int32_t>((acc >> (position % 8)) & ((std::uint64_t{1} << LimbBits(i)) - 1));
+    position += LimbBits(i);
+  }
+  return Weak(f);
+}
+
+bool IsZero(const Fe& f) {
+  std::uint8_t bytes[32];
+  ToBytes(f, bytes);
+  std::uint8_t any = 0;
+  for (std::uint8_t byte : bytes) {
+    any |= byte;
+  }
+  return any == 0;
+}
+
+bool IsNegative(const Fe& f) {
+  std::uint8_t bytes[32];
+  ToBytes(f, bytes);
+  return (bytes[0] & 1) != 0;
+}
+
+bool Equal(const Fe& f, const Fe& g) { return IsZero(Sub(f, g)); }
+
+// f = g when `flag` is 1, without branching on it.
+void Cmov(Fe* f, const Fe& g, std::uint32_t flag) {
+  const std::int32_t mask = -static_cast<std::int32_t>(flag);
+  for (int i = 0; i < 10; ++i) {
+    f->v[i] ^= (f->v[i] ^ g.v[i]) & mask;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Points on -x^2 + y^2 = 1 + d x^2 y^2 in extended coordinates (x = X/Z,
+// y = Y/Z, xy = T/Z), with the a = -1 formulas of Hisil et al.
+
+struct Point {
+  Fe x, y, z, t;
+};
+
+// Ready to be added: (Y + X, Y - X, Z, 2dT).
+struct Cached {
+  Fe y_plus_x, y_minus_x, z, t2d;
+};
+
+// Affine and ready to be added: (y + x, y - x, 2dxy).
+struct Niels {
+  Fe y_plus_x, y_minus_x, xy2d;
+};
+
+Point Identity() { return {FeFromInt(0), FeFromInt(1), FeFromInt(1), FeFromInt(0)}; }
+
+Point Double(const Point& p) {
+  const Fe a = Sq(p.x);
+  const Fe b = Sq(p.y);
+  const Fe zz = Sq(p.z);
+  const Fe c = Add(zz, zz);
+  const Fe e = Sub(Sub(Sq(Add(p.x, p.y)), a), b);
+  const Fe g = Sub(b, a);
+  const Fe f = Weak(Sub(g, c));
+  const Fe h = Neg(Add(a, b));
+  return {Mul(e, f), Mul(g, h), Mul(f, g), Mul(e, h)};
+}
+
+// p + q, or p - q when `subtract`.
+Point AddCached(const Point& p, const Cached& q, bool subtract) {
+  const Fe a = Mul(Sub(p.y, p.x), subtract ? q.y_plus_x : q.y_minus_x);
+  const Fe b = Mul(Add(p.y, p.x), subtract ? q.y_minus_x : q.y_plus_x);
+  const Fe c = Mul(p.t, q.t2d);
+  const Fe zz = Mul(p.z, q.z);
+  const Fe d = Add(zz, zz);
+  const Fe e = Sub(b, a);
+  const Fe f = subtract ? Add(d, c) : Sub(d, c);
+  const Fe g = subtract ? Sub(d, c) : Add(d, c);
+  const Fe h = Add(b, a);
+  return {Mul(e, f), Mul(g, h), Mul(f, g), Mul(e, h)};
+}
+
+Point AddNiels(const Point& p, const Niels& q) {
+  const Fe a = Mul(Sub(p.y, p.x), q.y_minus_x);
+  const Fe b = Mul(Add(p.y, p.x), q.y_plus_x);
+  const Fe c = Mul(p.t, q.xy2d);
+  const Fe d = Add(p.z, p.z);
+  const Fe e = Sub(b, a);
+  const Fe f = Sub(d, c);
+  const Fe g = Add(d, c);
+  const Fe h = Add(b, a);
+  return {Mul(e, f), Mul(g, h), Mul(f, g), Mul(e, h)};
+}
+
+Point NegatePoint(const Point& p) { return {Neg(p.x), p.y, p.z, Neg(p.t)}; }
+
+bool IsIdentity(const Point& p) { return IsZero(p.x) && Equal(p.y, p.z); }
+
+void EncodePoint(const Point& p, std::uint8_t* out) {
+  const Fe z_inverse = Invert(p.z);
+  const Fe x = Mul(p.x, z_inverse);
+  ToBytes(Mul(p.y, z_inverse), out);
+  out[31] ^= static_cast<std::uint8_t>(IsNegative(x) ? 0x80 : 0);
+}
+
+struct Tables {
+  Tables();
+
+  Fe d;
+  Fe d2;
+  Fe sqrt_minus_one;
+  Point base;
+  // base_table[i][j] = (j + 1) 256^i B.
+  Niels base_table[32][8];
+  // base_odd[j] = (2j + 1) B.
+  Cached base_odd[8];
+};
+
+const Tables& GetTables() {
+  static const Tables tables;
+  return tables;
+}
+
+Cached ToCached(const Point& p, const Fe& d2) {
+  return {Weak(Add(p.y, p.x)), Weak(Sub(p.y, p.x)), p.z, Mul(p.t, d2)};
+}
+
+Niels ToNiels(const Point& p, const Fe& d2) {
+  const Fe z_inverse = Invert(p.z);
+  const Fe x = Mul(p.x, z_inverse);
+  const Fe y = Mul(p.y, z_inverse);
+  return {Weak(Add(y, x)), Weak(Sub(y, x)), Mul(Mul(x, y), d2)};
+}
+
+// RFC 8032 5.1.3, against explicit constants so that Tables can use it to
+// derive the base point.
+bool DecodePoint(const std::uint8_t* in, const Fe& d, const Fe& sqrt_minus_one, Point* point_out) {
+  // y must be below p = 2^255 - 19.
+  bool all_ones = (in[31] & 0x7F) == 0x7F && in[0] >= 0xED;
+  for (int i = 1; i < 31 && all_ones; ++i) {
+    all_ones = in[i] == 0xFF;
+  }
+  if (all_ones) {
+    return false;
+  }
+  const Fe y = FromBytes(in);
+  const Fe yy = Sq(y);
+  const Fe u = Sub(yy, FeFromInt(1));
+  const Fe v = Add(Mul(yy, d), FeFromInt(1));
+  // x = u v^3 (u v^7)^((p - 5) / 8)
+  const Fe v3 = Mul(Sq(v), v);
+  const Fe uv7 = Mul(Mul(Sq(v3), v), u);
+  Fe x = Mul(Mul(u, v3), Pow22523(uv7));
+  const Fe vxx = Mul(Sq(x), v);
+  if (!Equal(vxx, u)) {
+    if (!Equal(vxx, Neg(u))) {
+      return false;
+    }
+    x = Mul(x, sqrt_minus_one);
+  }
+  const bool sign = (in[31] & 0x80) != 0;
+  if (sign && IsZero(x)) {
+    return false;
+  }
+  if (IsNegative(x) != sign) {
+    x = Neg(x);
+  }
+  *point_out = {x, y, FeFromInt(1), Mul(x, y)};
+  return true;
+}
+
+Tables::Tables() {
+  d = Mul(FeFromInt(-121665), Invert(FeFromInt(121666)));
+  d2 = Weak(Add(d, d));
+  // 2^((p - 1) / 4) = (2^((p - 5) / 8))^2 2
+  sqrt_minus_one = Mul(Sq(Pow22523(FeFromInt(2))), FeFromInt(2));
+  // B has y = 4/5 and even x.
+  std::uint8_t encoded[32];
+  ToBytes(Mul(FeFromInt(4), Invert(FeFromInt(5))), encoded);
+  DecodePoint(encoded, d, sqrt_minus_one, &base);
+
+  Point row = base;
+  for (auto& entries : base_table) {
+    Point multiple = row;
+    const Cached step = ToCached(row, d2);
+    for (Niels& entry : entries) {
+      entry = ToNiels(multiple, d2);
+      multiple = AddCached(multiple, step, false);
+    }
+    for (int i = 0; i < 8; ++i) {
+      row = Double(row);
+    }
+  }
+
+  const Cached twice = ToCached(Double(base), d2);
+  Point odd = base;
+  for (Cached& entry : base_odd) {
+    entry = ToCached(odd, d2);
+    odd = AddCached(odd, twice, false);
+  }
+}
+
+// (|digit| 256^position) B, negated for a negative digit, in constant time.
+Niels SelectBase(const Tables& tables, int position, std::int8_t digit) {
+  const std::uint32_t negative = static_cast<std::uint8_t>(digit) >> 7;
+  const std::uint32_t magnitude = static_cast<std::uint32_t>(digit - (-static_cast<int>(negative) & digit) * 2);
+  Niels selected = {FeFromInt(1), FeFromInt(1), FeFromInt(0)};
+  for (std::uint32_t j = 1; j <= 8; ++j) {
+    const Niels& entry = tables.base_table[position][j - 1];
+    const std::uint32_t equal = ((magnitude ^ j) - 1) >> 31;
+    Cmov(&selected.y_plus_x, entry.y_plus_x, equal);
+    Cmov(&selected.y_minus_x, entry.y_minus_x, equal);
+    Cmov(&selected.xy2d, entry.xy2d, equal);
+  }
+  const Niels minus = {selected.y_minus_x, selected.y_plus_x, Neg(selected.xy2d)};
+  Cmov(&selected.y_plus_x, minus.y_plus_x, negative);
+  Cmov(&selected.y_minus_x, minus.y_minus_x, negative);
+  Cmov(&selected.xy2d, minus.xy2d, negative);
+  return selected;
+}
+
+// [a]B for a < 2^255, with signed radix-16 digits: sum e_i 16^i with
+// -8 <= e_i <= 8, taking the odd digits first and multiplying by 16 once.
+Point ScalarMultBase(const std::uint8_t* a) {
+  const Tables& tables = GetTables();
+  std::int8_t e[64];
+  for (int i = 0; i < 32; ++i) {
+    e[2 * i] = static_cast<std::int8_t>(a[i] & 15);
+    e[2 * i + 1] = static_cast<std::int8_t>(a[i] >> 4);
+  }
+  std::int8_t carry = 0;
+  for (int i = 0; i < 63; ++i) {
+    e[i] = static_cast<std::int8_t>(e[i] + carry);
+    carry = static_cast<std::int8_t>((e[i] + 8) >> 4);
+    e[i] = static_cast<std::int8_t>(e[i] - carry * 16);
+  }
+  e[63] = static_cast<std::int8_t>(e[63] + carry);
+
+  Point h = Identity();
+  for (int i = 1; i < 64; i += 2) {
+    h = AddNiels(h, SelectBase(tables, i / 2, e[i]));
+  }
+  for (int i = 0; i < 4; ++i) {
+    h = Double(h);
+  }
+  for (int i = 0; i < 64; i += 2) {
+    h = AddNiels(h, SelectBase(tables, i / 2, e[i]));
+  }
+  return h;
+}
+
+// ---------------------------------------------------------------------------
+// Scalars modulo L = 2^252 + 27742317777372353535851937790883648493, as
+// 32 little-endian bytes.
+
+using Scalar = std::array<std::uint8_t, 32>;
+
+constexpr std::int64_t kOrder[32] = {0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+                                     0xa2, 0xde, 0xf9, 0xde, 0x14, 0,    0,    0,    0,    0,    0,
+                                     0,    0,    0,    0,    0,    0,    0,    0,    0,    0x10};
+
+// Reduces 64 signed byte-sized limbs (products of two scalars fit) mod L.
+Scalar ModOrder(std::int64_t* x) {
+  for (int i = 63; i >= 32; --i) {
+    std::int64_t carry = 0;
+    int j = i - 32;
+    for (; j < i - 12; ++j) {
+      x[j] += carry - 16 * x[i] * kOrder[j - (i - 32)];
+      carry = (x[j] + 128) >> 8;
+      x[j] -= carry * 256;
+    }
+    x[j] += carry;
+    x[i] = 0;
+  }
+  std::int64_t carry = 0;
+  for (int j = 0; j < 32; ++j) {
+    x[j] += carry - (x[31] >> 4) * kOrder[j];
+    carry = x[j] >> 8;
+    x[j] &= 255;
+  }
+  for (int j = 0; j < 32; ++j) {
+    x[j] -= carry * kOrder[j];
+  }
+  Scalar r;
+  for (int i = 0; i < 32; ++i) {
+    x[i + 1] += x[i] >> 8;
+    r[static_cast<std::size_t>(i)] = static_cast<std::uint8_t>(x[i] & 255);
+  }
+  return r;
+}
+
+Scalar ReduceDigest(const Sha512Digest& digest) {
+  std::int64_t x[64];
+  for (int i = 0; i < 64; ++i) {
+    x[i] = digest[static_cast<std::size_t>(i)];
+  }
+  return ModOrder(x);
+}
+
+// a b + c mod L.
+Scalar MulAdd(const std::uint8_t* a, const std::uint8_t* b, const std::uint8_t* c) {
+  std::int64_t x[64] = {};
+  for (int i = 0; i < 32; ++i) {
+    x[i] = c[i];
+  }
+  for (int i = 0; i < 32; ++i) {
+    for (int j = 0; j < 32; ++j) {
+      x[i + j] += static_cast<std::int64_t>(a[i]) * b[j];
+    }
+  }
+  return ModOrder(x);
+}
+
+bool IsCanonicalScalar(const std::uint8_t* s) {
+  for (int i = 31; i >= 0; --i) {
+    if (s[i] != kOrder[i]) {
+      return s[i] < kOrder[i];
+    }
+  }
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// Variable-time multi-scalar multiplication for verification.
+
+// Signed sliding window: digits in {0, +-1, +-3, ..., +-15}, mostly zero.
+void Slide(const std::uint8_t* a, std::int8_t* r) {
+  for (int i = 0; i < 256; ++i) {
+    r[i] = static_cast<std::int8_t>(1 & (a[i >> 3] >> (i & 7)));
+  }
+  for (int i = 0; i < 256; ++i) {
+    if (r[i] == 0) {
+      continue;
+    }
+    for (int b = 1; b <= 6 && i + b < 256; ++b) {
+      if (r[i + b] == 0) {
+        continue;
+      }
+      if (r[i] + (r[i + b] << b) <= 15) {
+        r[i] = static_cast<std::int8_t>(r[i] + (r[i + b] << b));
+        r[i + b] = 0;
+      } else if (r[i] - (r[i + b] << b) >= -15) {
+        r[i] = static_cast<std::int8_t>(r[i] - (r[i + b] << b));
+        for (int k = i + b; k < 256; ++k) {
+          if (r[k] == 0) {
+            r[k] = 1;
+            break;
+          }
+          r[k] = 0;
+        }
+      } else {
+        break;
+      }
+    }
+  }
+}
+
+struct Term {
+  std::int8_t digits[256];
+  Cached odd[8];  // (2j + 1) P
+};
+
+void PrepareTerm(const std::uint8_t* scalar, const Point& point, const Fe& d2, Term* term) {
+  Slide(scalar, term->digits);
+  const Cached twice = ToCached(Double(point), d2);
+  Point odd = point;
+  for (Cached& entry : term->odd) {
+    entry = ToCached(odd, d2);
+    odd = AddCached(odd, twice, false);
+  }
+}
+
+Point AddDigit(const Point& p, const Cached* odd, std::int8_t digit) {
+  if (digit > 0) {
+    return AddCached(p, odd[digit / 2], false);
+  }
+  if (digit < 0) {
+    return AddCached(p, odd[-digit / 2], true);
+  }
+  return p;
+}
+
+// [base_scalar]B + sum [scalar_i]P_i, sharing one chain of doublings.
+Point MultiScalarMult(const std::uint8_t* base_scalar, const Term* terms, std::size_t count) {
+  const Tables& tables = GetTables();
+  std::int8_t base_digits[256];
+  Slide(base_scalar, base_digits);
+  int top = 255;
+  for (; top >= 0; --top) {
+    bool any = base_digits[top] != 0;
+    for (std::size_t i = 0; i < count && !any; ++i) {
+      any = terms[i].digits[top] != 0;
+    }
+    if (any) {
+      break;
+    }
+  }
+  Point acc = Identity();
+  for (int bit = top; bit >= 0; --bit) {
+    acc = Double(acc);
+    acc = AddDigit(acc, tables.base_odd, base_digits[bit]);
+    for (std::size_t i = 0; i < count; ++i) {
+      acc = AddDigit(acc, terms[i].odd, terms[i].digits[bit]);
+    }
+  }
+  return acc;
+}
+
+bool IsSmallOrder(Point p) {
+  for (int i = 0; i < 3; ++i) {
+    p = Double(p);
+  }
+  return IsIdentity(p);
+}
+
+// The decoded parts of one signature and its challenge k = H(R || A || M).
+struct Parsed {
+  Point minus_a;
+  Point minus_r;
+  Scalar s;
+  Scalar k;
+};
+
+bool Parse(const Ed25519PublicKey& public_key,
+           const void* message,
+           std::size_t size,
+           const Ed25519Signature& signature,
+           Parsed* parsed) {
+  const Tables& tables = GetTables();
+  Point a;
+  Point r;
+  if (!IsCanonicalScalar(signature.data() + 32) ||
+      !DecodePoint(public_key.data(), tables.d, tables.sqrt_minus_one, &a) ||
+      !DecodePoint(signature.data(), tables.d, tables.sqrt_minus_one, &r)) {
+    return false;
+  }
+  parsed->minus_a = NegatePoint(a);
+  parsed->minus_r = NegatePoint(r);
+  std::memcpy(parsed->s.data(), signature.data() + 32, 32);
+  Sha512 hash;
+  hash.Update(signature.data(), 32);
+  hash.Update(public_key.data(), public_key.size());
+  hash.Update(message, size);
+  Sha512Digest digest;
+  hash.Finish(&digest);
+  parsed->k = ReduceDigest(digest);
+  return true;
+}
+
+// [8]([S]B - [k]A - R) = 0
+bool CheckParsed(const Parsed& parsed) {
+  Term term;
+  PrepareTerm(parsed.k.data(), parsed.minus_a, GetTables().d2, &term);
+  const Point sum = MultiScalarMult(parsed.s.data(), &term, 1);
+  return IsSmallOrder(AddCached(sum, ToCached(parsed.minus_r, GetTables().d2), false));
+}
+
+bool ParseHex(std::string_view hex, std::uint8_t* out, std::size_t size) {
+  if (hex.size() != 2 * size) {
+    return false;
+  }
+  for (std::size_t i = 0; i < hex.size(); ++i) {
+    const char c = hex[i];
+    int nibble;
+    if (c >= '0' && c <= '9') {
+      nibble = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      nibble = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      nibble = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    out[i / 2] = static_cast<std::uint8_t>(i % 2 == 0 ? nibble << 4 : out[i / 2] | nibble);
+  }
+  return true;
+}
+
+}  // namespace
+
+void Ed25519ExpandSeed(const Ed25519Seed& seed, Ed25519SigningKey* key_out) {
+  const Sha512Digest digest = Sha512::Hash(seed.data(), seed.size());
+  std::memcpy(key_out->scalar.data(), digest.data(), 32);
+  std::memcpy(key_out->prefix.data(), digest.data() + 32, 32);
+  key_out->scalar[0] &= 248;
+  key_out->scalar[31] &= 127;
+  key_out->scalar[31] |= 64;
+  EncodePoint(ScalarMultBase(key_out->scalar.data()), key_out->public_key.data());
+}
+
+void Ed25519Sign(const Ed25519SigningKey& key,
+                 const void* message,
+                 std::size_t size,
+                 Ed25519Signature* signature_out) {
+  Sha512 hash;
+  hash.Update(key.prefix.data(), key.prefix.size());
+  hash.Update(message, size);
+  Sha512Digest digest;
+  hash.Finish(&digest);
+  const Scalar r = ReduceDigest(digest);
+  EncodePoint(ScalarMultBase(r.data()), signature_out->data());
+
+  hash.Reset();
+  hash.Update(signature_out->data(), 32);
+  hash.Update(key.public_key.data(), key.public_key.size());
+  hash.Update(message, size);
+  hash.Finish(&digest);
+  const Scalar k = ReduceDigest(digest);
+  const Scalar s = MulAdd(k.data(), key.scalar.data(), r.data());
+  std::memcpy(signature_out->data() + 32, s.data(), s.size());
+}
+
+bool Ed25519Verify(const Ed25519PublicKey& public_key,
+                   const void* message,
+                   std::size_t size,
+                   const Ed25519Signature& signature) {
+  Parsed parsed;
+  return Parse(public_key, message, size, signature, &parsed) && CheckParsed(parsed);
+}
+
+void Ed25519Precompute() { GetTables(); }
+
+bool Ed25519VerifyBatch(const Ed25519BatchItem* items, std::size_t count, bool* valid_out) {
+  const Tables& tables = GetTables();
+  std::vector<Parsed> parsed(count);
+  std::vector<bool> parsed_ok(count);
+  // The weights z_i come from a hash over the whole batch, so a forger who
+  // does not know them in advance cannot make errors cancel out.
+  Sha512 seed_hash;
+  bool all_parsed = true;
+  for (std::size_t i = 0; i < count; ++i) {
+    parsed_ok[i] =
+        Parse(*items[i].public_key, items[i].message, items[i].message_size, *items[i].signature, &parsed[i]);
+    all_parsed = all_parsed && parsed_ok[i];
+    seed_hash.Update(items[i].signature->data(), items[i].signature->size());
+    seed_hash.Update(items[i].public_key->data(), items[i].public_key->size());
+    seed_hash.Update(parsed[i].k.data(), parsed[i].k.size());
+  }
+  Sha512Digest seed;
+  seed_hash.Finish(&seed);
+
+  // [sum z_i S_i]B - sum [z_i]R_i - sum [z_i k_i]A_i, times the cofactor.
+  std::vector<Term> terms;
+  terms.reserve(2 * count);
+  Scalar base_scalar{};
+  const Scalar zero{};
+  for (std::size_t i = 0; i < count; ++i) {
+    if (!parsed_ok[i]) {
+      continue;
+    }
+    Sha512 weight_hash;
+    weight_hash.Update(seed.data(), seed.size());
+    std::uint8_t index[8];
+    for (int byte = 0; byte < 8; ++byte) {
+      index[byte] = static_cast<std::uint8_t>(static_cast<std::uint64_t>(i) >> (8 * byte));
+    }
+    weight_hash.Update(index, sizeof(index));
+    Sha512Digest weight_digest;
+    weight_hash.Finish(&weight_digest);
+    Scalar z{};
+    std::memcpy(z.data(), weight_digest.data(), 16);  // 128-bit weights
+    z[0] |= 1;
+
+    base_scalar = MulAdd(z.data(), parsed[i].s.data(), base_scalar.data());
+    terms.emplace_back();
+    PrepareTerm(z.data(), parsed[i].minus_r, tables.d2, &terms.back());
+    const Scalar zk = MulAdd(z.data(), parsed[i].k.data(), zero.data());
+    terms.emplace_back();
+    PrepareTerm(zk.data(), parsed[i].minus_a, tables.d2, &terms.back());
+  }
+  if (all_parsed &&
+      IsSmallOrder(MultiScalarMult(base_scalar.data(), terms.data(), terms.size()))) {
+    if (valid_out != nullptr) {
+      for (std::size_t i = 0; i < count; ++i) {
+        valid_out[i] = true;
+      }
+    }
+    return true;
+  }
+  bool all_valid = true;
+  for (std::size_t i = 0; i < count; ++i) {
+    const bool valid = parsed_ok[i] && CheckParsed(parsed[i]);
+    all_valid = all_valid && valid;
+    if (valid_out != nullptr) {
+      valid_out[i] = valid;
+    }
+  }
+  return all_valid;
+}
+
+void Ed25519SignatureProvider::AddSigningKey(const std::string& key_id, const Ed25519Seed& seed) {
+  Ed25519ExpandSeed(seed, &signing_keys_[key_id]);
+}
+
+void Ed25519SignatureProvider::AddPublicKey(const std::string& name, const Ed25519PublicKey& public_key) {
+  public_keys_[name] = public_key;
+}
+
+bool Ed25519SignatureProvider::FindPublicKey(std::string_view public_key_or_id,
+                                             Ed25519PublicKey* public_key_out) const {
+  const std::string name(public_key_or_id);
+  if (const auto peer = public_keys_.find(name); peer != public_keys_.end()) {
+    *public_key_out = peer->second;
+    return true;
+  }
+  if (const auto own = signing_keys_.find(name); own != signing_keys_.end()) {
+    *public_key_out = own->second.public_key;
+    return true;
+  }
+  return ParseHex(public_key_or_id, public_key_out->data(), public_key_out->size());
+}
+
+std::string Ed25519SignatureProvider::Sign(const std::string& message, const std::string& key_id) {
+  const auto key = signing_keys_.find(key_id);
+  if (key == signing_keys_.end()) {
+    return {};
+  }
+  Ed25519Signature signature;
+  Ed25519Sign(key->second, message.data(), message.size(), &signature);
+  static constexpr char kHexDigits[] = "0123456789abcdef";
+  std::string hex(2 * signature.size(), '0');
+  for (std::size_t i = 0; i < signature.size(); ++i) {
+    hex[2 * i] = kHexDigits[signature[i] >> 4];
+    hex[2 * i + 1] = kHexDigits[signature[i] & 0x0F];
+  }
+  return hex;
+}
+
+bool Ed25519SignatureProvider::Verify(const std::string& signature,
+                                      const std::string& message,
+                                      const std::string& public_key_or_id) {
+  Ed25519PublicKey public_key;
+  Ed25519Signature raw;
+  return FindPublicKey(public_key_or_id, &public_key) && ParseHex(signature, raw.data(), raw.size()) &&
+         Ed25519Verify(public_key, message.data(), message.size(), raw);
+}
+
+bool Ed25519SignatureProvider::VerifyBatch(const Check* checks, std::size_t count, bool* valid_out) const {
+  std::vector<Ed25519PublicKey> public_keys(count);
+  std::vector<Ed25519Signature> signatures(count);
+  std::vector<Ed25519BatchItem> items;
+  std::vector<std::size_t> positions;
+  items.reserve(count);
+  positions.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    if (valid_out != nullptr) {
+      valid_out[i] = false;
+    }
+    if (FindPublicKey(checks[i].public_key_or_id, &public_keys[i]) &&
+        ParseHex(checks[i].signature, signatures[i].data(), signatures[i].size())) {
+      items.push_back({&public_keys[i], checks[i].message.data(), checks[i].message.size(), &signatures[i]});
+      positions.push_back(i);
+    }
+  }
+  std::unique_ptr<bool[]> item_valid(new bool[items.size()]);
+  const bool all_valid = Ed25519VerifyBatch(items.data(), items.size(), item_valid.get());
+  if (valid_out != nullptr) {
+    for (std::size_t i = 0; i < items.size(); ++i) {
+      valid_out[positions[i]] = item_valid[i];
+    }
+  }
+  return all_valid && items.size() == count;
+}
+
+}  // namespace offline_wallet
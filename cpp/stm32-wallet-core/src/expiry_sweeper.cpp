@@ -0,0 +1,157 @@
+#include "offline_wallet/expiry_sweeper.hpp"
+
+#include <algorithm>
+
+namespace offline_wallet {
+
+namespace {
+
+class RebuildVisitor : public JournalVisitor {
+ public:
+  RebuildVisitor(ExpirySweeper* sweeper, std::uint32_t intent_ttl_seconds)
+      : sweeper_(sweeper), intent_ttl_seconds_(intent_ttl_seconds) {}
+
+  void Visit(const LocalTransaction& tx) override {
+    if (tx.state == TransactionState::kInitiated) {
+      sweeper_->Track(tx.tx_id, tx.created_at_epoch_seconds + intent_ttl_seconds_);
+    }
+  }
+
+ private:
+  ExpirySweeper* sweeper_;
+  std::uint32_t intent_ttl_seconds_;
+};
+
+}  // namespace
+
+ExpirySweeper::ExpirySweeper(TransactionJournal* journal,
+                             const ClockProvider* clock,
+                             ExpirySweeperOptions options)
+    : journal_(journal),
+      clock_(clock),
+      options_(options),
+      entries_(std::max<std::size_t>(options.max_tracked, 1)),
+      now_(clock->NowUnixSeconds()) {
+  Clear();
+}
+
+bool ExpirySweeper::Track(const PaymentIntent& intent) {
+  return Track(intent.tx_id, intent.expires_at_epoch_seconds);
+}
+
+bool ExpirySweeper::Track(std::string_view tx_id, std::uint64_t expires_at_epoch_seconds) {
+  if (free_ == kNone) {
+    ++stats_.refused;
+    return false;
+  }
+  const std::uint32_t index = free_;
+  Entry& entry = entries_[index];
+  if (!entry.tx_id.Assign(tx_id.data(), tx_id.size())) {
+    ++stats_.refused;
+    return false;
+  }
+  free_ = entry.next;
+  entry.due_at = expires_at_epoch_seconds + options_.grace_seconds;
+  ++stats_.tracked;
+  File(index);
+  return true;
+}
+
+std::size_t ExpirySweeper::Tick() {
+  Advance(clock_->NowUnixSeconds());
+
+  std::size_t expired = 0;
+  for (std::size_t handled = 0; handled < options_.max_due_per_tick && due_ != kNone; ++handled) {
+    const std::uint32_t index = due_;
+    const Entry& entry = entries_[index];
+    tx_id_scratch_.assign(entry.tx_id.data(), entry.tx_id.size());
+    if (!journal_->Load(tx_id_scratch_, &tx_scratch_) || tx_scratch_.state != TransactionState::kInitiated) {
+      ++stats_.answered;
+    } else if (journal_->UpdateState(tx_id_scratch_, TransactionState::kExpired, "intent expired")) {
+      ++stats_.expired;
+      ++expired;
+    } else {
+      break;  // Journal full or failing; retry on the next tick.
+    }
+    due_ = entry.next;
+    Release(index);
+  }
+  return expired;
+}
+
+bool ExpirySweeper::Rebuild(const RiskPolicy& policy) {
+  Clear();
+  RebuildVisitor visitor(this, policy.intent_ttl_seconds);
+  return journal_->ForEach(&visitor);
+}
+
+void ExpirySweeper::Clear() {
+  for (std::size_t i = 0; i < entries_.size(); ++i) {
+    entries_[i].next = i + 1 < entries_.size() ? static_cast<std::uint32_t>(i + 1) : kNone;
+  }
+  free_ = 0;
+  std::fill(std::begin(near_), std::end(near_), kNone);
+  std::fill(std::begin(far_), std::end(far_), kNone);
+  due_ = kNone;
+  stats_.tracked = 0;
+}
+
+std::size_t ExpirySweeper::MemoryBytes() const { return sizeof(*this) + entries_.size() * sizeof(Entry); }
+
+void ExpirySweeper::Advance(std::uint64_t now) {
+  if (now <= now_) {
+    return;  // The clock stood still or was set back.
+  }
+  if (now - now_ > kSlots) {
+    // Rather than step through every second, pull all entries and re-file
+    // them against the new time.
+    now_ = now;
+    for (std::uint32_t slot = 0; slot < kSlots; ++slot) {
+      Refile(&near_[slot]);
+      Refile(&far_[slot]);
+    }
+    return;
+  }
+  while (now_ < now) {
+    ++now_;
+    if ((now_ & (kSlots - 1)) == 0) {
+      Refile(&far_[(now_ >> kSlotBits) & (kSlots - 1)]);
+    }
+    Refile(&near_[now_ & (kSlots - 1)]);
+  }
+}
+
+void ExpirySweeper::File(std::uint32_t index) {
+  Entry& entry = entries_[index];
+  std::uint32_t* head = &due_;
+  if (entry.due_at > now_) {
+    const std::uint64_t block = entry.due_at >> kSlotBits;
+    const std::uint64_t now_block = now_ >> kSlotBits;
+    if (block == now_block) {
+      head = &near_[entry.due_at & (kSlots - 1)];
+    } else {
+      // Past the horizon, park in the farthest block and re-file from there.
+      head = &far_[std::min(block, now_block + kSlots - 1) & (kSlots - 1)];
+    }
+  }
+  entry.next = *head;
+  *head = index;
+}
+
+void ExpirySweeper::Refile(std::uint32_t* head) {
+  std::uint32_t index = *head;
+  *head = kNone;
+  while (index != kNone) {
+    const std::uint32_t next = entries_[index].next;
+    File(index);
+    index = next;
+  }
+}
+
+void ExpirySweeper::Release(std::uint32_t index) {
+  entries_[index].next = free_;
+  free_ = index;
+  --stats_.tracked;
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,143 @@
+#include "offline_wallet/fixed_models.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+template <std::size_t Capacity>
+bool Copy(const std::pmr::string& in, FixedString<Capacity>* out) {
+  return out->Assign(in.data(), in.size());
+}
+
+template <std::size_t Capacity>
+void Copy(const FixedString<Capacity>& in, std::pmr::string* out) {
+  out->assign(in.data(), in.size());
+}
+
+}  // namespace
+
+bool ToFixed(const DeviceContext& in, FixedDeviceContext* out) {
+  out->local_counter = in.local_counter;
+  return Copy(in.account_id, &out->account_id) && Copy(in.device_id, &out->device_id) &&
+         Copy(in.signing_key_id, &out->signing_key_id);
+}
+
+bool ToFixed(const PaymentIntent& in, FixedPaymentIntent* out) {
+  out->amount_cents = in.amount_cents;
+  out->merchant_counter = in.merchant_counter;
+  out->issued_at_epoch_seconds = in.issued_at_epoch_seconds;
+  out->expires_at_epoch_seconds = in.expires_at_epoch_seconds;
+  return Copy(in.tx_id, &out->tx_id) && Copy(in.merchant_intent_id, &out->merchant_intent_id) &&
+         Copy(in.merchant_account_id, &out->merchant_account_id) &&
+         Copy(in.merchant_device_id, &out->merchant_device_id) && Copy(in.currency, &out->currency) &&
+         Copy(in.merchant_nonce, &out->merchant_nonce) &&
+         Copy(in.merchant_signature, &out->merchant_signature);
+}
+
+bool ToFixed(const PaymentAuthorization& in, FixedPaymentAuthorization* out) {
+  out->amount_cents = in.amount_cents;
+  out->payer_counter = in.payer_counter;
+  out->authorized_at_epoch_seconds = in.authorized_at_epoch_seconds;
+  return Copy(in.tx_id, &out->tx_id) && Copy(in.merchant_intent_id, &out->merchant_intent_id) &&
+         Copy(in.payer_authorization_id, &out->payer_authorization_id) &&
+         Copy(in.payer_account_id, &out->payer_account_id) && Copy(in.payer_device_id, &out->payer_device_id) &&
+         Copy(in.currency, &out->currency) && Copy(in.payer_nonce, &out->payer_nonce) &&
+         Copy(in.payer_signature, &out->payer_signature);
+}
+
+bool ToFixed(const PaymentReceipt& in, FixedPaymentReceipt* out) {
+  out->amount_cents = in.amount_cents;
+  out->status = in.status;
+  out->created_at_epoch_seconds = in.created_at_epoch_seconds;
+  return Copy(in.tx_id, &out->tx_id) && Copy(in.receipt_id, &out->receipt_id) &&
+         Copy(in.merchant_account_id, &out->merchant_account_id) &&
+         Copy(in.payer_account_id, &out->payer_account_id) && Copy(in.currency, &out->currency) &&
+         Copy(in.merchant_signature, &out->merchant_signature);
+}
+
+bool ToFixed(const LocalTransaction& in, FixedLocalTransaction* out) {
+  out->amount_cents = in.amount_cents;
+  out->merchant_counter = in.merchant_counter;
+  out->payer_counter = in.payer_counter;
+  out->state = in.state;
+  out->created_at_epoch_seconds = in.created_at_epoch_seconds;
+  out->updated_at_epoch_seconds = in.updated_at_epoch_seconds;
+  return Copy(in.tx_id, &out->tx_id) && Copy(in.merchant_account_id, &out->merchant_account_id) &&
+         Copy(in.payer_account_id, &out->payer_account_id) &&
+         Copy(in.merchant_device_id, &out->merchant_device_id) &&
+         Copy(in.payer_device_id, &out->payer_device_id) && Copy(in.currency, &out->currency) &&
+         Copy(in.merchant_intent_id, &out->merchant_intent_id) &&
+         Copy(in.payer_authorization_id, &out->payer_authorization_id) &&
+         Copy(in.merchant_nonce, &out->merchant_nonce) && Copy(in.payer_nonce, &out->payer_nonce) &&
+         Copy(in.failure_reason, &out->failure_reason) && Copy(in.idempotency_key, &out->idempotency_key);
+}
+
+void FromFixed(const FixedDeviceContext& in, DeviceContext* out) {
+  Copy(in.account_id, &out->account_id);
+  Copy(in.device_id, &out->device_id);
+  Copy(in.signing_key_id, &out->signing_key_id);
+  out->local_counter = in.local_counter;
+}
+
+void FromFixed(const FixedPaymentIntent& in, PaymentIntent* out) {
+  Copy(in.tx_id, &out->tx_id);
+  Copy(in.merchant_intent_id, &out->merchant_intent_id);
+  Copy(in.merchant_account_id, &out->merchant_account_id);
+  Copy(in.merchant_device_id, &out->merchant_device_id);
+  out->amount_cents = in.amount_cents;
+  Copy(in.currency, &out->currency);
+  Copy(in.merchant_nonce, &out->merchant_nonce);
+  out->merchant_counter = in.merchant_counter;
+  out->issued_at_epoch_seconds = in.issued_at_epoch_seconds;
+  out->expires_at_epoch_seconds = in.expires_at_epoch_seconds;
+  Copy(in.merchant_signature, &out->merchant_signature);
+}
+
+void FromFixed(const FixedPaymentAuthorization& in, PaymentAuthorization* out) {
+  Copy(in.tx_id, &out->tx_id);
+  Copy(in.merchant_intent_id, &out->merchant_intent_id);
+  Copy(in.payer_authorization_id, &out->payer_authorization_id);
+  Copy(in.payer_account_id, &out->payer_account_id);
+  Copy(in.payer_device_id, &out->payer_device_id);
+  out->amount_cents = in.amount_cents;
+  Copy(in.currency, &out->currency);
+  Copy(in.payer_nonce, &out->payer_nonce);
+  out->payer_counter = in.payer_counter;
+  out->authorized_at_epoch_seconds = in.authorized_at_epoch_seconds;
+  Copy(in.payer_signature, &out->payer_signature);
+}
+
+void FromFixed(const FixedPaymentReceipt& in, PaymentReceipt* out) {
+  Copy(in.tx_id, &out->tx_id);
+  Copy(in.receipt_id, &out->receipt_id);
+  Copy(in.merchant_account_id, &out->merchant_account_id);
+  Copy(in.payer_account_id, &out->payer_account_id);
+  out->amount_cents = in.amount_cents;
+  Copy(in.currency, &out->currency);
+  out->status = in.status;
+  out->created_at_epoch_seconds = in.created_at_epoch_seconds;
+  Copy(in.merchant_signature, &out->merchant_signature);
+}
+
+void FromFixed(const FixedLocalTransaction& in, LocalTransaction* out) {
+  Copy(in.tx_id, &out->tx_id);
+  Copy(in.merchant_account_id, &out->merchant_account_id);
+  Copy(in.payer_account_id, &out->payer_account_id);
+  Copy(in.merchant_device_id, &out->merchant_device_id);
+  Copy(in.payer_device_id, &out->payer_device_id);
+  out->amount_cents = in.amount_cents;
+  Copy(in.currency, &out->currency);
+  Copy(in.merchant_intent_id, &out->merchant_intent_id);
+  Copy(in.payer_authorization_id, &out->payer_authorization_id);
+  Copy(in.merchant_nonce, &out->merchant_nonce);
+  Copy(in.payer_nonce, &out->payer_nonce);
+  out->merchant_counter = in.merchant_counter;
+  out->payer_counter = in.payer_counter;
+  out->state = in.state;
+  Copy(in.failure_reason, &out->failure_reason);
+  out->created_at_epoch_seconds = in.created_at_epoch_seconds;
+  out->updated_at_epoch_seconds = in.updated_at_epoch_seconds;
+  Copy(in.idempotency_key, &out->idempotency_key);
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,64 @@
+#include "offline_wallet/fixed_offline_engine.hpp"
+
+#include <cstring>
+
+namespace offline_wallet {
+
+namespace {
+
+bool AppendLiteral(const char* text, FixedSignatureMessage* out) {
+  return out->Append(text, std::strlen(text));
+}
+
+bool AppendUnsigned(std::uint64_t value, FixedSignatureMessage* out) {
+  char digits[20];
+  std::size_t length = 0;
+  do {
+    digits[sizeof(digits) - 1 - length] = static_cast<char>('0' + value % 10);
+    value /= 10;
+    ++length;
+  } while (value != 0);
+  return out->Append(digits + sizeof(digits) - length, length);
+}
+
+bool AppendSigned(std::int64_t value, FixedSignatureMessage* out) {
+  if (value < 0) {
+    return out->Append('-') && AppendUnsigned(static_cast<std::uint64_t>(-(value + 1)) + 1, out);
+  }
+  return AppendUnsigned(static_cast<std::uint64_t>(value), out);
+}
+
+}  // namespace
+
+namespace fixed_engine_detail {
+
+bool BuildIntentSignatureMessage(const FixedPaymentIntent& intent, FixedSignatureMessage* out) {
+  return out->Append(intent.tx_id) && out->Append('|') && out->Append(intent.merchant_intent_id) &&
+         out->Append('|') && AppendSigned(intent.amount_cents, out) && out->Append('|') &&
+         out->Append(intent.currency) && out->Append('|') && out->Append(intent.merchant_nonce) &&
+         out->Append('|') && AppendUnsigned(intent.merchant_counter, out) && out->Append('|') &&
+         AppendUnsigned(intent.expires_at_epoch_seconds, out);
+}
+
+bool BuildAuthorizationSignatureMessage(const FixedPaymentAuthorization& authorization,
+                                        FixedSignatureMessage* out) {
+  return out->Append(authorization.tx_id) && out->Append('|') &&
+         out->Append(authorization.merchant_intent_id) && out->Append('|') &&
+         AppendSigned(authorization.amount_cents, out) && out->Append('|') &&
+         out->Append(authorization.currency) && out->Append('|') && out->Append(authorization.payer_nonce) &&
+         out->Append('|') && AppendUnsigned(authorization.payer_counter, out) && out->Append('|') &&
+         AppendUnsigned(authorization.authorized_at_epoch_seconds, out);
+}
+
+bool BuildReceiptSignatureMessage(const FixedPaymentReceipt& receipt,
+                                  const FixedId& payer_authorization_id,
+                                  FixedSignatureMessage* out) {
+  return out->Append(receipt.tx_id) && out->Append('|') && out->Append(payer_authorization_id) &&
+         AppendLiteral("|pending_sync", out);
+}
+
+}  // namespace fixed_engine_detail
+
+template class StaticOfflineEngine<FixedSignatureProvider, FixedRandomProvider, ClockProvider, FixedTransactionJournal>;
+
+}  // namespace offline_wallet
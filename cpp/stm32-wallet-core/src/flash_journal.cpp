@@ -0,0 +1,1106 @@
+#include "offline_wallet/flash_journal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+#include "offline_wallet/byte_codec.hpp"
+#include "offline_wallet/crc32.hpp"
+#include "offline_wallet/wire_codec.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// Sector layout: a 16-byte erase stamp written right after every erase, a
+// 16-byte sequence block written when the sector becomes the log head (it
+// also names the victim when the sector was opened by compaction), then
+// records. Each record is [length:u16][kind:u8][~kind:u8][crc32:u32][payload]
+// padded with 0xFF to the device program size. A committed group is a run of
+// kRecordBatch records followed by a kRecordCommit frame whose payload is
+// [count:u32][crc32 of the run's raw bytes:u32].
+constexpr std::uint32_t kSectorMagic = 0x314A574F;  // "OWJ1"
+constexpr std::size_t kSequenceBlockOffset = 16;
+constexpr std::size_t kSectorHeaderSize = 32;
+constexpr std::size_t kRecordHeaderSize = 8;
+constexpr std::size_t kMaxRecordPayload = 0xFFFE;
+constexpr std::uint8_t kRecordPut = 0x01;
+constexpr std::uint8_t kRecordBatch = 0x02;
+constexpr std::uint8_t kRecordCommit = 0x03;
+constexpr std::size_t kCommitPayloadSize = 8;
+
+constexpr std::uint32_t kIndexEmpty = 0xFFFFFFFF;
+constexpr std::uint32_t kIndexTombstone = 0xFFFFFFFE;
+constexpr std::size_t kNoSlot = static_cast<std::size_t>(-1);
+constexpr std::size_t kNoSector = static_cast<std::size_t>(-1);
+constexpr std::uint32_t kNoVictim = 0xFFFFFFFF;
+
+// Checkpoint image: [magic][sector count][sector size][index entries:u32]
+// [next record sequence:u64], then per sector [sequence][erase count]
+// [write offset][reclaimable] (write offset 0 for a sector not in use), then
+// per index entry [tx_id hash:u64][address:u32].
+constexpr std::uint32_t kCheckpointMagic = 0x314B574F;  // "OWK1"
+constexpr std::size_t kCheckpointHeaderSize = 24;
+constexpr std::size_t kCheckpointSectorSize = 16;
+constexpr std::size_t kCheckpointEntrySize = 12;
+
+// Static wear levelling kicks in once erase counts drift this far apart.
+constexpr std::uint32_t kWearSpreadLimit = 8;
+
+bool IsBlank(const std::uint8_t* bytes, std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    if (bytes[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Also reports as known the transactions whose checkpointed record sat in a
+// sector recycled since: compaction either relocated them into the tail or
+// dropped them.
+class RecycledAwareVisitor : public JournalTailVisitor {
+ public:
+  RecycledAwareVisitor(JournalTailVisitor* tail, const std::vector<std::uint64_t>* recycled)
+      : tail_(tail), recycled_(recycled) {}
+
+  void Visit(const LocalTransaction& tx, bool known) override {
+    tail_->Visit(tx, known || std::binary_search(recycled_->begin(), recycled_->end(), HashTxId(tx.tx_id)));
+  }
+
+ private:
+  JournalTailVisitor* tail_;
+  const std::vector<std::uint64_t>* recycled_;
+};
+
+bool IsDroppable(TransactionState state) {
+  return state == TransactionState::kSynced || state == TransactionState::kExpired;
+}
+
+// Lowest record sequence handed out once a sector with this sequence opens.
+std::uint64_t RecordSequenceFloor(std::uint32_t sector_sequence) {
+  return static_cast<std::uint64_t>(sector_sequence) << 32;
+}
+
+std::uint32_t SequenceCrc(std::uint32_t sequence, std::uint32_t victim_sequence, std::uint32_t erase_count) {
+  std::uint8_t bytes[12];
+  Put32(bytes, sequence);
+  Put32(bytes + 4, victim_sequence);
+  Put32(bytes + 8, erase_count);
+  return Crc32(bytes, sizeof(bytes));
+}
+
+}  // namespace
+
+FlashJournal::FlashJournal(BlockDevice* device, FlashJournalOptions options)
+    : device_(device), options_(options) {}
+
+bool FlashJournal::Mount() {
+  if (!Initialize() || !ReadSectorHeaders()) {
+    return false;
+  }
+  for (std::size_t sector : SectorsBySequence()) {
+    if (!ScanSector(sector, kSectorHeaderSize, nullptr)) {
+      return false;
+    }
+  }
+  AdoptHead();
+  return true;
+}
+
+bool FlashJournal::Format() { return Initialize() && FormatSectors(); }
+
+void FlashJournal::AppendCheckpoint(std::vector<std::uint8_t>* image_out) const {
+  const std::size_t start = image_out->size();
+  image_out->resize(start + kCheckpointHeaderSize + sectors_.size() * kCheckpointSectorSize +
+                    index_live_ * kCheckpointEntrySize);
+  std::uint8_t* out = image_out->data() + start;
+  Put32(out, kCheckpointMagic);
+  Put32(out + 4, static_cast<std::uint32_t>(sectors_.size()));
+  Put32(out + 8, static_cast<std::uint32_t>(sectors_.empty() ? 0 : device_->SectorSize()));
+  Put32(out + 12, static_cast<std::uint32_t>(index_live_));
+  Put64(out + 16, next_record_sequence_);
+  out += kCheckpointHeaderSize;
+  for (const SectorInfo& info : sectors_) {
+    Put32(out, info.sequence);
+    Put32(out + 4, info.erase_count);
+    Put32(out + 8, info.used ? static_cast<std::uint32_t>(info.write_offset) : 0);
+    Put32(out + 12, info.reclaimable);
+    out += kCheckpointSectorSize;
+  }
+  for (std::size_t slot = 0; slot < index_addresses_.size(); ++slot) {
+    const std::uint32_t address = index_addresses_[slot];
+    if (address != kIndexEmpty && address != kIndexTombstone) {
+      Put64(out, index_hashes_[slot]);
+      Put32(out + 8, address);
+      out += kCheckpointEntrySize;
+    }
+  }
+}
+
+bool FlashJournal::MountFromCheckpoint(const std::uint8_t* image, std::size_t size, JournalTailVisitor* tail) {
+  if (image == nullptr || size < kCheckpointHeaderSize || !Initialize()) {
+    return false;
+  }
+  const std::size_t count = sectors_.size();
+  const std::size_t sector_size = device_->SectorSize();
+  const std::size_t entries = Get32(image + 12);
+  if (Get32(image) != kCheckpointMagic || Get32(image + 4) != count || Get32(image + 8) != sector_size ||
+      entries > options_.max_records ||
+      size != kCheckpointHeaderSize + count * kCheckpointSectorSize + entries * kCheckpointEntrySize ||
+      !ReadSectorHeaders()) {
+    return false;
+  }
+
+  // A sector still holds what the checkpoint saw if it is in use under the
+  // same sequence and erase count; anything else was recycled since.
+  const std::uint8_t* saved = image + kCheckpointHeaderSize;
+  std::vector<std::size_t> saved_offsets(count, 0);
+  std::vector<bool> kept(count, false);
+  for (std::size_t sector = 0; sector < count; ++sector, saved += kCheckpointSectorSize) {
+    const std::size_t write_offset = Get32(saved + 8);
+    if (write_offset == 0) {
+      continue;
+    }
+    if (write_offset < kSectorHeaderSize || write_offset > sector_size) {
+      return false;
+    }
+    saved_offsets[sector] = write_offset;
+    SectorInfo& info = sectors_[sector];
+    if (info.used && info.sequence == Get32(saved) && info.erase_count == Get32(saved + 4)) {
+      kept[sector] = true;
+      info.write_offset = write_offset;
+      info.reclaimable = Get32(saved + 12);
+    }
+  }
+  std::vector<std::uint64_t> recycled;
+  for (std::size_t entry = 0; entry < entries; ++entry, saved += kCheckpointEntrySize) {
+    const std::uint64_t hash = Get64(saved);
+    const std::uint32_t address = Get32(saved + 8);
+    const std::size_t sector = address / sector_size;
+    if (sector >= count || address % sector_size < kSectorHeaderSize ||
+        address % sector_size >= saved_offsets[sector]) {
+      return false;
+    }
+    if (!kept[sector]) {
+      recycled.push_back(hash);
+    } else if (!IndexPut(kNoSlot, hash, address)) {
+      return false;
+    }
+  }
+  next_record_sequence_ = std::max<std::uint64_t>(Get64(image + 16), 1);
+
+  // Kept sectors resume where the checkpoint left off, which for all but
+  // its head is the end of their records.
+  std::sort(recycled.begin(), recycled.end());
+  RecycledAwareVisitor tail_visitor(tail, &recycled);
+  for (std::size_t sector : SectorsBySequence()) {
+    if (!ScanSector(sector, kept[sector] ? sectors_[sector].write_offset : kSectorHeaderSize,
+                    tail != nullptr ? &tail_visitor : nullptr)) {
+      return false;
+    }
+  }
+  AdoptHead();
+  return true;
+}
+
+bool FlashJournal::Save(const LocalTransaction& tx) {
+  if (batch_open_) {
+    return Stage(tx) && FlushStaged();
+  }
+  const std::uint64_t sequence = next_record_sequence_;
+  std::size_t record_size = 0;
+  if (sectors_.empty() || !EncodeRecord(tx, sequence, kRecordPut, &record_size)) {
+    return false;
+  }
+  const std::uint64_t hash = HashTxId(tx.tx_id);
+  const std::size_t slot = FindSlot(hash, tx.tx_id);
+  if (slot == kNoSlot && index_live_ >= options_.max_records) {
+    return false;
+  }
+
+  std::uint32_t address = 0;
+  if (!AppendRecord(scratch_.data(), record_size, false, &address)) {
+    return false;
+  }
+  next_record_sequence_ = std::max(next_record_sequence_, sequence + 1);
+  ++stats_.appended_records;
+  if (IsDroppable(tx.state)) {
+    ++sectors_[head_].reclaimable;
+  }
+  return IndexPut(slot, hash, address);
+}
+
+bool FlashJournal::Load(const std::string& tx_id, LocalTransaction* tx_out) const {
+  if (tx_out == nullptr || sectors_.empty()) {
+    return false;
+  }
+  for (const LocalTransaction& staged : staged_) {
+    if (std::string_view(staged.tx_id) == tx_id) {
+      *tx_out = staged;
+      return true;
+    }
+  }
+  LocalTransaction tx;
+  if (FindSlot(HashTxId(tx_id), tx_id, &tx) == kNoSlot) {
+    return false;
+  }
+  *tx_out = std::move(tx);
+  return true;
+}
+
+bool FlashJournal::UpdateState(const std::string& tx_id, TransactionState state, const std::string& reason) {
+  LocalTransaction tx;
+  if (!Load(tx_id, &tx)) {
+    return false;
+  }
+  tx.state = state;
+  tx.failure_reason = reason;
+  return Save(tx);
+}
+
+bool FlashJournal::BeginBatch() {
+  if (sectors_.empty()) {
+    return false;
+  }
+  batch_open_ = true;
+  return true;
+}
+
+bool FlashJournal::Stage(const LocalTransaction& tx) {
+  if (!batch_open_) {
+    return Save(tx);
+  }
+  // Staged records take their sequence now, so the group encodes to the
+  // sizes recorded here.
+  const std::uint64_t sequence = next_record_sequence_;
+  std::size_t record_size = 0;
+  if (!EncodeRecord(tx, sequence, kRecordBatch, &record_size) ||
+      record_size + RecordSize(kCommitPayloadSize) > group_.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < staged_.size(); ++i) {
+    if (staged_[i].tx_id == tx.tx_id) {
+      staged_[i] = tx;
+      staged_[i].sequence = sequence;
+      staged_sizes_[i] = record_size;
+      ++next_record_sequence_;
+      return true;
+    }
+  }
+  if (staged_.size() >= options_.max_staged_records && !FlushStaged()) {
+    return false;
+  }
+
+  std::size_t new_records = FindSlot(HashTxId(tx.tx_id), tx.tx_id) == kNoSlot ? 1 : 0;
+  for (const LocalTransaction& staged : staged_) {
+    new_records += FindSlot(HashTxId(staged.tx_id), staged.tx_id) == kNoSlot ? 1 : 0;
+  }
+  if (index_live_ + new_records > options_.max_records) {
+    return false;
+  }
+  staged_.push_back(tx);
+  staged_.back().sequence = sequence;
+  staged_sizes_.push_back(record_size);
+  ++next_record_sequence_;
+  return true;
+}
+
+bool FlashJournal::CommitBatch() {
+  const bool ok = FlushStaged();
+  batch_open_ = false;
+  return ok;
+}
+
+void FlashJournal::AbortBatch() {
+  staged_.clear();
+  staged_sizes_.clear();
+  batch_open_ = false;
+}
+
+bool FlashJournal::UpdateStates(const StateUpdate* updates, std::size_t count) {
+  if (sectors_.empty() || (count > 0 && updates == nullptr)) {
+    return false;
+  }
+  // Staged versions are newer than flash; write them first so none is lost.
+  if (batch_open_ && !FlushStaged()) {
+    return false;
+  }
+  const std::size_t commit_size = RecordSize(kCommitPayloadSize);
+  std::size_t run_size = 0;
+  std::uint32_t run_crc = 0;
+  updated_.clear();
+  LocalTransaction tx;
+  for (std::size_t i = 0; i < count; ++i) {
+    const StateUpdate& update = updates[i];
+    const std::uint64_t hash = HashTxId(update.tx_id);
+    const std::size_t slot = FindSlot(hash, update.tx_id, &tx);
+    if (slot == kNoSlot || (tx.state == update.state && std::string_view(tx.failure_reason) == update.reason)) {
+      continue;
+    }
+    tx.state = update.state;
+    tx.failure_reason = update.reason;
+    std::size_t record_size = 0;
+    if (!EncodeRecord(tx, next_record_sequence_, kRecordBatch, &record_size) ||
+        record_size + commit_size > group_.size()) {
+      return false;
+    }
+    if (run_size + record_size + commit_size > group_.size()) {
+      // The group in progress is complete; it is still in group_, while the
+      // next record waits in scratch_.
+      if (!AppendUpdateGroup(run_size, run_crc)) {
+        return false;
+      }
+      run_size = 0;
+      run_crc = 0;
+    }
+    ++next_record_sequence_;
+    std::memcpy(group_.data() + run_size, scratch_.data(), record_size);
+    run_crc = Crc32(group_.data() + run_size, record_size, run_crc);
+    updated_.push_back({hash, static_cast<std::uint32_t>(run_size), IsDroppable(tx.state), slot});
+    run_size += record_size;
+  }
+  return updated_.empty() || AppendUpdateGroup(run_size, run_crc);
+}
+
+bool FlashJournal::ForEach(JournalVisitor* visitor) const {
+  if (visitor == nullptr || sectors_.empty()) {
+    return false;
+  }
+  for (const LocalTransaction& staged : staged_) {
+    visitor->Visit(staged);
+  }
+  LocalTransaction tx;
+  for (std::size_t slot = 0; slot < index_addresses_.size(); ++slot) {
+    const std::uint32_t address = index_addresses_[slot];
+    if (address == kIndexEmpty || address == kIndexTombstone || !ReadRecord(address, &tx)) {
+      continue;
+    }
+    bool superseded = false;
+    for (const LocalTransaction& staged : staged_) {
+      superseded = superseded || staged.tx_id == tx.tx_id;
+    }
+    if (!superseded) {
+      visitor->Visit(tx);
+    }
+  }
+  return true;
+}
+
+bool FlashJournal::NeedsCompaction() const {
+  if (sectors_.empty()) {
+    return false;
+  }
+  if (FreeSectorCount() <= options_.compaction_free_sectors) {
+    return PickVictim() != kNoSector;
+  }
+  if (index_live_ + options_.compaction_free_records < options_.max_records) {
+    return false;
+  }
+  // Under index pressure only the oldest sector can give slots back, so stop
+  // once it holds nothing to drop instead of cycling live records around.
+  std::size_t oldest = kNoSector;
+  for (std::size_t sector = 0; sector < sectors_.size(); ++sector) {
+    const SectorInfo& info = sectors_[sector];
+    if (info.used && !(has_head_ && sector == head_) &&
+        (oldest == kNoSector || info.sequence < sectors_[oldest].sequence)) {
+      oldest = sector;
+    }
+  }
+  return oldest != kNoSector && sectors_[oldest].reclaimable > 0 && PickVictim() == oldest;
+}
+
+bool FlashJournal::CompactStep() {
+  const std::size_t victim = PickVictim();
+  if (victim == kNoSector) {
+    return false;
+  }
+
+  // Only the oldest sector may drop records: an older version of a dropped
+  // transaction elsewhere in the log would otherwise resurface at Mount().
+  bool oldest = true;
+  for (std::size_t sector = 0; sector < sectors_.size(); ++sector) {
+    if (sectors_[sector].used && sectors_[sector].sequence < sectors_[victim].sequence) {
+      oldest = false;
+    }
+  }
+
+  // Live records move to a freshly opened target sector that names the
+  // victim, so Mount() can tell an interrupted compaction from a finished one.
+  // A victim with nothing left to move is simply erased.
+  const std::size_t base = victim * device_->SectorSize();
+  bool relocating = false;
+  for (int pass = 0; pass < 2; ++pass) {
+    std::size_t offset = kSectorHeaderSize;
+    while (offset + kRecordHeaderSize <= sectors_[victim].write_offset) {
+      std::size_t payload_size = 0;
+      std::uint8_t kind = 0;
+      if (ReadRawRecord(base + offset, device_->SectorSize() - offset, &payload_size, &kind) !=
+          RecordRead::kOk) {
+        break;
+      }
+      const std::size_t record_size = RecordSize(payload_size);
+      LocalTransaction tx;
+      const std::uint8_t* payload = read_scratch_.data() + kRecordHeaderSize;
+      if (kind == kRecordCommit || DecodeLocalTransaction(payload, payload_size, &tx) != WireStatus::kOk) {
+        offset += record_size;
+        continue;
+      }
+      const std::size_t slot = FindSlotAt(HashTxId(tx.tx_id), static_cast<std::uint32_t>(base + offset));
+      const bool live = slot != kNoSlot;
+      const bool drop = oldest && IsDroppable(tx.state);
+      if (pass == 0) {
+        relocating = relocating || (live && !drop);
+      } else if (live) {
+        if (drop) {
+          IndexErase(slot);
+          ++stats_.dropped_records;
+        } else {
+          // Relocated group members stand alone, so they become plain records.
+          SealRecord(read_scratch_.data(), payload_size, kRecordPut);
+          std::uint32_t address = 0;
+          if (!AppendRecord(read_scratch_.data(), record_size, true, &address)) {
+            return false;
+          }
+          ++stats_.appended_records;
+          sectors_[head_].reclaimable += IsDroppable(tx.state) ? 1 : 0;
+          index_addresses_[slot] = address;
+        }
+      }
+      offset += record_size;
+    }
+    if (pass == 0 && relocating && !OpenHeadSector(sectors_[victim].sequence)) {
+      return false;
+    }
+  }
+
+  if (!RecycleSector(victim)) {
+    return false;
+  }
+  ++stats_.compacted_sectors;
+  return true;
+}
+
+bool FlashJournal::Reserve(std::size_t records) {
+  if (sectors_.empty()) {
+    return false;
+  }
+  const std::size_t sector_size = device_->SectorSize();
+  const std::size_t capacity = sector_size - kSectorHeaderSize;
+  const std::size_t bytes = records * std::max(largest_record_, RecordSize(0));
+  const std::size_t head_room = has_head_ ? sector_size - sectors_[head_].write_offset : 0;
+  const std::size_t needed = bytes <= head_room ? 0 : (bytes - head_room + capacity - 1) / capacity;
+  // Each sector the appends open must find more than reserve_sectors free.
+  for (std::size_t attempt = 0;
+       attempt < sectors_.size() && FreeSectorCount() < options_.reserve_sectors + needed; ++attempt) {
+    if (!CompactStep()) {
+      break;
+    }
+  }
+  return FreeSectorCount() >= options_.reserve_sectors + needed;
+}
+
+FlashJournalStats FlashJournal::stats() const {
+  FlashJournalStats stats = stats_;
+  stats.live_records = index_live_;
+  stats.free_sectors = FreeSectorCount();
+  if (!sectors_.empty()) {
+    stats.min_erase_count = sectors_[0].erase_count;
+    stats.max_erase_count = sectors_[0].erase_count;
+    for (const SectorInfo& info : sectors_) {
+      stats.min_erase_count = std::min(stats.min_erase_count, info.erase_count);
+      stats.max_erase_count = std::max(stats.max_erase_count, info.erase_count);
+    }
+  }
+  return stats;
+}
+
+bool FlashJournal::AppendRecord(const std::uint8_t* record,
+                                std::size_t record_size,
+                                bool for_compaction,
+                                std::uint32_t* address_out) {
+  const std::size_t sector_size = device_->SectorSize();
+  if (record_size > sector_size - kSectorHeaderSize) {
+    return false;
+  }
+  const auto head_fits = [&] {
+    return has_head_ && sectors_[head_].write_offset + record_size <= sector_size;
+  };
+  if (!head_fits()) {
+    // Compaction targets are sized for their victim and never spill over.
+    if (for_compaction) {
+      return false;
+    }
+    // Foreground fallback when the idle loop has not kept up. Compaction may
+    // leave room in its target sector, which then serves as the head.
+    for (std::size_t attempt = 0; attempt < sectors_.size() && FreeSectorCount() <= options_.reserve_sectors;
+         ++attempt) {
+      if (!CompactStep() || head_fits()) {
+        break;
+      }
+    }
+    if (!head_fits()) {
+      if (FreeSectorCount() <= options_.reserve_sectors || !OpenHeadSector(kNoVictim)) {
+        return false;
+      }
+    }
+  }
+
+  SectorInfo& head = sectors_[head_];
+  const std::size_t address = head_ * sector_size + head.write_offset;
+  if (!device_->Program(address, record, record_size) || !device_->Sync()) {
+    head.write_offset = sector_size;  // Torn region; never append behind it.
+    ++head.reclaimable;
+    return false;
+  }
+  head.write_offset += record_size;
+  *address_out = static_cast<std::uint32_t>(address);
+  return true;
+}
+
+bool FlashJournal::FlushStaged() {
+  // Pack staged records into groups that each fit one sector.
+  const std::size_t commit_size = RecordSize(kCommitPayloadSize);
+  bool ok = true;
+  std::size_t first = 0;
+  std::size_t group_size = commit_size;
+  for (std::size_t i = 0; i < staged_.size() && ok; ++i) {
+    if (group_size + staged_sizes_[i] > group_.size()) {
+      ok = AppendGroup(first, i - first, group_size);
+      first = i;
+      group_size = commit_size;
+    }
+    group_size += staged_sizes_[i];
+  }
+  if (ok && first < staged_.size()) {
+    ok = AppendGroup(first, staged_.size() - first, group_size);
+  }
+  staged_.clear();
+  staged_sizes_.clear();
+  return ok;
+}
+
+bool FlashJournal::AppendGroup(std::size_t first, std::size_t count, std::size_t group_size) {
+  std::size_t offset = 0;
+  std::uint32_t crc = 0;
+  for (std::size_t i = first; i < first + count; ++i) {
+    std::size_t record_size = 0;
+    if (!EncodeRecord(staged_[i], staged_[i].sequence, kRecordBatch, &record_size)) {
+      return false;
+    }
+    std::memcpy(group_.data() + offset, scratch_.data(), record_size);
+    crc = Crc32(group_.data() + offset, record_size, crc);
+    offset += record_size;
+  }
+  std::uint32_t address = 0;
+  if (offset + RecordSize(kCommitPayloadSize) != group_size || !CommitGroup(offset, count, crc, &address)) {
+    return false;
+  }
+  for (std::size_t i = first; i < first + count; ++i) {
+    sectors_[head_].reclaimable += IsDroppable(staged_[i].state) ? 1 : 0;
+    const std::uint64_t hash = HashTxId(staged_[i].tx_id);
+    if (!IndexPut(FindSlot(hash, staged_[i].tx_id), hash, address)) {
+      return false;
+    }
+    address += static_cast<std::uint32_t>(staged_sizes_[i]);
+  }
+  return true;
+}
+
+bool FlashJournal::AppendUpdateGroup(std::size_t run_size, std::uint32_t run_crc) {
+  std::uint32_t address = 0;
+  if (!CommitGroup(run_size, updated_.size(), run_crc, &address)) {
+    return false;
+  }
+  for (const PendingRecord& record : updated_) {
+    sectors_[head_].reclaimable += record.droppable ? 1 : 0;
+    if (!IndexPut(record.slot, record.hash, address + record.address)) {
+      return false;
+    }
+  }
+  updated_.clear();
+  return true;
+}
+
+// Closes the `count` records at the start of group_ with a commit frame and
+// appends the group with one program and sync.
+bool FlashJournal::CommitGroup(std::size_t run_size,
+                               std::size_t count,
+                               std::uint32_t run_crc,
+                               std::uint32_t* address_out) {
+  std::uint8_t* commit = group_.data() + run_size;
+  Put32(commit + kRecordHeaderSize, static_cast<std::uint32_t>(count));
+  Put32(commit + kRecordHeaderSize + 4, run_crc);
+  SealRecord(commit, kCommitPayloadSize, kRecordCommit);
+  if (!AppendRecord(group_.data(), run_size + RecordSize(kCommitPayloadSize), false, address_out)) {
+    return false;
+  }
+  stats_.appended_records += count;
+  ++stats_.committed_batches;
+  return true;
+}
+
+bool FlashJournal::OpenHeadSector(std::uint32_t victim_sequence) {
+  std::size_t chosen = kNoSector;
+  for (std::size_t step = 1; step <= sectors_.size(); ++step) {
+    const std::size_t sector = (head_ + step) % sectors_.size();
+    if (!sectors_[sector].used &&
+        (chosen == kNoSector || sectors_[sector].erase_count < sectors_[chosen].erase_count)) {
+      chosen = sector;
+    }
+  }
+  if (chosen == kNoSector) {
+    return false;
+  }
+
+  SectorInfo& info = sectors_[chosen];
+  std::uint8_t block[16];
+  std::memset(block, 0xFF, sizeof(block));
+  Put32(block, next_sequence_);
+  Put32(block + 4, victim_sequence);
+  Put32(block + 8, SequenceCrc(next_sequence_, victim_sequence, info.erase_count));
+  if (!device_->Program(chosen * device_->SectorSize() + kSequenceBlockOffset, block, sizeof(block)) ||
+      !device_->Sync()) {
+    return false;
+  }
+  info.used = true;
+  info.sequence = next_sequence_++;
+  next_record_sequence_ = std::max(next_record_sequence_, RecordSequenceFloor(info.sequence));
+  info.write_offset = kSectorHeaderSize;
+  info.reclaimable = 0;
+  head_ = chosen;
+  has_head_ = true;
+  return true;
+}
+
+bool FlashJournal::RecycleSector(std::size_t sector) {
+  SectorInfo& info = sectors_[sector];
+  if (!device_->Erase(sector)) {
+    return false;
+  }
+  const std::uint32_t erase_count = info.erase_count + 1;
+  info = SectorInfo{};
+  info.erase_count = erase_count;
+  if (has_head_ && head_ == sector) {
+    has_head_ = false;
+  }
+
+  std::uint8_t stamp[16];
+  std::memset(stamp, 0xFF, sizeof(stamp));
+  Put32(stamp, kSectorMagic);
+  Put32(stamp + 4, erase_count);
+  Put32(stamp + 8, Crc32(stamp, 8));
+  return device_->Program(sector * device_->SectorSize(), stamp, sizeof(stamp)) && device_->Sync();
+}
+
+bool FlashJournal::ScanSector(std::size_t sector, std::size_t offset, JournalTailVisitor* tail) {
+  const std::size_t sector_size = device_->SectorSize();
+  const std::size_t base = sector * sector_size;
+  SectorInfo& info = sectors_[sector];
+  const auto apply = [this, &info, tail](const PendingRecord& record, std::string_view tx_id) {
+    info.reclaimable += record.droppable ? 1 : 0;
+    const std::size_t slot = FindSlot(record.hash, tx_id);
+    const bool known = slot != kNoSlot;
+    if (!IndexPut(slot, record.hash, record.address)) {
+      return false;
+    }
+    LocalTransaction tx;
+    if (tail != nullptr && ReadRecord(record.address, &tx)) {
+      tail->Visit(tx, known);
+    }
+    return true;
+  };
+
+  std::vector<PendingRecord> pending;
+  std::vector<std::string> pending_ids;
+  std::uint32_t group_crc = 0;
+  while (offset + kRecordHeaderSize <= sector_size) {
+    std::size_t payload_size = 0;
+    std::uint8_t kind = 0;
+    const RecordRead read = ReadRawRecord(base + offset, sector_size - offset, &payload_size, &kind);
+    if (read == RecordRead::kBlank) {
+      break;
+    }
+    if (read == RecordRead::kCorrupt) {
+      offset = sector_size;  // Torn by power loss; the rest of the sector is unusable.
+      ++info.reclaimable;    // Compaction wins it back.
+      break;
+    }
+    const std::size_t record_size = RecordSize(payload_size);
+    const std::uint8_t* payload = read_scratch_.data() + kRecordHeaderSize;
+    LocalTransaction tx;
+    if (kind == kRecordCommit) {
+      if (payload_size == kCommitPayloadSize && Get32(payload) == pending.size() &&
+          Get32(payload + 4) == group_crc) {
+        for (std::size_t i = 0; i < pending.size(); ++i) {
+          if (!apply(pending[i], pending_ids[i])) {
+            return false;
+          }
+        }
+      }
+      pending.clear();
+      pending_ids.clear();
+      group_crc = 0;
+    } else if (DecodeLocalTransaction(payload, payload_size, &tx) == WireStatus::kOk) {
+      ++stats_.replayed_records;
+      next_record_sequence_ = std::max(next_record_sequence_, tx.sequence + 1);
+      const PendingRecord record{HashTxId(tx.tx_id), static_cast<std::uint32_t>(base + offset),
+                                 IsDroppable(tx.state), kNoSlot};
+      if (kind == kRecordBatch) {
+        pending.push_back(record);
+        pending_ids.emplace_back(tx.tx_id);
+        group_crc = Crc32(read_scratch_.data(), record_size, group_crc);
+      } else if (!apply(record, tx.tx_id)) {
+        return false;
+      }
+    }
+    offset += record_size;
+  }
+  if (!pending.empty()) {
+    // A group lost its commit frame to power failure; never append behind it.
+    offset = sector_size;
+    ++info.reclaimable;
+  }
+  info.write_offset = std::min(offset, sector_size);
+  return true;
+}
+
+bool FlashJournal::Initialize() {
+  if (!device_ || device_->SectorCount() < 3 || device_->ProgramSize() == 0 ||
+      kSequenceBlockOffset % device_->ProgramSize() != 0 ||
+      device_->SectorSize() <= kSectorHeaderSize + kRecordHeaderSize) {
+    return false;
+  }
+
+  align_ = device_->ProgramSize();
+  const std::size_t record_limit = std::min(device_->SectorSize() - kSectorHeaderSize,
+                                            kRecordHeaderSize + kMaxRecordPayload);
+  scratch_.assign(record_limit, 0xFF);
+  group_.assign(device_->SectorSize() - kSectorHeaderSize, 0xFF);
+  read_scratch_.assign(record_limit, 0xFF);
+  batch_open_ = false;
+  staged_.clear();
+  staged_sizes_.clear();
+  updated_.clear();
+
+  std::size_t index_capacity = 8;
+  while (index_capacity < options_.max_records * 2) {
+    index_capacity <<= 1;
+  }
+  index_hashes_.assign(index_capacity, 0);
+  index_addresses_.assign(index_capacity, kIndexEmpty);
+  index_live_ = 0;
+  index_tombstones_ = 0;
+
+  sectors_.assign(device_->SectorCount(), SectorInfo{});
+  stats_ = FlashJournalStats{};
+  head_ = 0;
+  has_head_ = false;
+  next_sequence_ = 1;
+  next_record_sequence_ = 1;
+  return true;
+}
+
+bool FlashJournal::ReadSectorHeaders() {
+  const std::size_t count = sectors_.size();
+  std::vector<bool> stamped(count, false);
+  std::vector<bool> torn(count, false);
+  std::vector<std::uint32_t> victims(count, kNoVictim);
+  std::uint32_t max_erase_count = 0;
+  bool any_stamped = false;
+
+  for (std::size_t sector = 0; sector < count; ++sector) {
+    std::uint8_t header[kSectorHeaderSize];
+    if (!device_->Read(sector * device_->SectorSize(), header, sizeof(header))) {
+      return false;
+    }
+    if (Get32(header) != kSectorMagic || Get32(header + 8) != Crc32(header, 8)) {
+      continue;
+    }
+    stamped[sector] = true;
+    any_stamped = true;
+    SectorInfo& info = sectors_[sector];
+    info.erase_count = Get32(header + 4);
+    max_erase_count = std::max(max_erase_count, info.erase_count);
+
+    const std::uint8_t* sequence_block = header + kSequenceBlockOffset;
+    if (IsBlank(sequence_block, 16)) {
+      continue;
+    }
+    const std::uint32_t sequence = Get32(sequence_block);
+    const std::uint32_t victim = Get32(sequence_block + 4);
+    if (Get32(sequence_block + 8) != SequenceCrc(sequence, victim, info.erase_count)) {
+      torn[sector] = true;
+      continue;
+    }
+    info.used = true;
+    info.sequence = sequence;
+    victims[sector] = victim;
+  }
+
+  // A compaction target whose victim was never erased holds nothing but
+  // copies of live records, possibly torn; drop it and let compaction rerun.
+  for (std::size_t target = 0; target < count; ++target) {
+    for (std::size_t sector = 0; sector < count && victims[target] != kNoVictim; ++sector) {
+      if (sectors_[sector].used && sectors_[sector].sequence == victims[target]) {
+        torn[target] = true;
+        sectors_[target].used = false;
+        victims[target] = kNoVictim;
+      }
+    }
+  }
+
+  if (!any_stamped) {
+    return FormatSectors();
+  }
+
+  for (std::size_t sector = 0; sector < count; ++sector) {
+    if (!stamped[sector] || torn[sector]) {
+      sectors_[sector].erase_count = stamped[sector] ? sectors_[sector].erase_count : max_erase_count;
+      if (!RecycleSector(sector)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+std::vector<std::size_t> FlashJournal::SectorsBySequence() const {
+  std::vector<std::size_t> order;
+  for (std::size_t sector = 0; sector < sectors_.size(); ++sector) {
+    if (sectors_[sector].used) {
+      order.push_back(sector);
+    }
+  }
+  std::sort(order.begin(), order.end(),
+            [this](std::size_t a, std::size_t b) { return sectors_[a].sequence < sectors_[b].sequence; });
+  return order;
+}
+
+void FlashJournal::AdoptHead() {
+  const std::vector<std::size_t> order = SectorsBySequence();
+  if (order.empty()) {
+    return;
+  }
+  head_ = order.back();
+  has_head_ = true;
+  next_sequence_ = sectors_[head_].sequence + 1;
+  next_record_sequence_ = std::max(next_record_sequence_, RecordSequenceFloor(sectors_[head_].sequence));
+}
+
+bool FlashJournal::FormatSectors() {
+  for (std::size_t sector = 0; sector < sectors_.size(); ++sector) {
+    std::uint8_t stamp[16];
+    std::uint32_t erase_count = 0;
+    if (device_->Read(sector * device_->SectorSize(), stamp, sizeof(stamp)) && Get32(stamp) == kSectorMagic &&
+        Get32(stamp + 8) == Crc32(stamp, 8)) {
+      erase_count = Get32(stamp + 4);
+    }
+    sectors_[sector].erase_count = erase_count;
+    if (!RecycleSector(sector)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::size_t FlashJournal::FreeSectorCount() const {
+  std::size_t free = 0;
+  for (const SectorInfo& info : sectors_) {
+    free += info.used ? 0 : 1;
+  }
+  return free;
+}
+
+std::size_t FlashJournal::PickVictim() const {
+  // Recycle oldest-first while any sector holds reclaimable records; when wear
+  // has drifted, move the coldest sector's static data instead. A head left
+  // full by a torn write takes no more appends and competes like the rest.
+  std::size_t oldest = kNoSector;
+  std::size_t coldest = kNoSector;
+  std::uint32_t max_erase_count = 0;
+  bool reclaimable = false;
+  for (std::size_t sector = 0; sector < sectors_.size(); ++sector) {
+    const SectorInfo& info = sectors_[sector];
+    max_erase_count = std::max(max_erase_count, info.erase_count);
+    if (!info.used || (has_head_ && sector == head_ && info.write_offset < device_->SectorSize())) {
+      continue;
+    }
+    if (coldest == kNoSector || info.erase_count < sectors_[coldest].erase_count) {
+      coldest = sector;
+    }
+    if (oldest == kNoSector || info.sequence < sectors_[oldest].sequence) {
+      oldest = sector;
+    }
+    reclaimable = reclaimable || info.reclaimable > 0;
+  }
+  if (coldest != kNoSector && max_erase_count - sectors_[coldest].erase_count >= kWearSpreadLimit) {
+    return coldest;
+  }
+  return reclaimable ? oldest : kNoSector;
+}
+
+std::size_t FlashJournal::RecordSize(std::size_t payload_size) const {
+  const std::size_t raw = kRecordHeaderSize + payload_size;
+  return (raw + align_ - 1) / align_ * align_;
+}
+
+void FlashJournal::SealRecord(std::uint8_t* record, std::size_t payload_size, std::uint8_t kind) const {
+  record[0] = static_cast<std::uint8_t>(payload_size);
+  record[1] = static_cast<std::uint8_t>(payload_size >> 8);
+  record[2] = kind;
+  record[3] = static_cast<std::uint8_t>(~kind);
+  const std::uint32_t crc = Crc32(record, 4);
+  Put32(record + 4, Crc32(record + kRecordHeaderSize, payload_size, crc));
+  std::memset(record + kRecordHeaderSize + payload_size, 0xFF,
+              RecordSize(payload_size) - kRecordHeaderSize - payload_size);
+}
+
+bool FlashJournal::EncodeRecord(const LocalTransaction& tx,
+                                std::uint64_t sequence,
+                                std::uint8_t kind,
+                                std::size_t* size_out) {
+  std::size_t payload_size = 0;
+  if (EncodeLocalTransaction(tx, sequence, scratch_.data() + kRecordHeaderSize,
+                             scratch_.size() - kRecordHeaderSize, &payload_size) != WireStatus::kOk) {
+    return false;
+  }
+  const std::size_t record_size = RecordSize(payload_size);
+  if (record_size > scratch_.size()) {
+    return false;
+  }
+  SealRecord(scratch_.data(), payload_size, kind);
+  largest_record_ = std::max(largest_record_, record_size);
+  *size_out = record_size;
+  return true;
+}
+
+FlashJournal::RecordRead FlashJournal::ReadRawRecord(std::size_t address,
+                                                     std::size_t limit,
+                                                     std::size_t* payload_size_out,
+                                                     std::uint8_t* kind_out) const {
+  std::uint8_t* header = read_scratch_.data();
+  if (limit < kRecordHeaderSize || !device_->Read(address, header, kRecordHeaderSize)) {
+    return RecordRead::kCorrupt;
+  }
+  if (IsBlank(header, kRecordHeaderSize)) {
+    return RecordRead::kBlank;
+  }
+  const std::size_t payload_size =
+      static_cast<std::size_t>(header[0]) | static_cast<std::size_t>(header[1]) << 8;
+  const std::uint8_t kind = header[2];
+  if (kind != static_cast<std::uint8_t>(~header[3]) || kind < kRecordPut || kind > kRecordCommit ||
+      RecordSize(payload_size) > limit || RecordSize(payload_size) > read_scratch_.size()) {
+    return RecordRead::kCorrupt;
+  }
+  const std::size_t padded = RecordSize(payload_size) - kRecordHeaderSize;
+  if (!device_->Read(address + kRecordHeaderSize, header + kRecordHeaderSize, padded)) {
+    return RecordRead::kCorrupt;
+  }
+  const std::uint32_t crc = Crc32(header + kRecordHeaderSize, payload_size, Crc32(header, 4));
+  if (crc != Get32(header + 4)) {
+    return RecordRead::kCorrupt;
+  }
+  *payload_size_out = payload_size;
+  *kind_out = kind;
+  return RecordRead::kOk;
+}
+
+bool FlashJournal::ReadRecord(std::uint32_t address, LocalTransaction* tx_out) const {
+  const std::size_t sector_size = device_->SectorSize();
+  std::size_t payload_size = 0;
+  std::uint8_t kind = 0;
+  if (ReadRawRecord(address, sector_size - address % sector_size, &payload_size, &kind) != RecordRead::kOk ||
+      kind == kRecordCommit) {
+    return false;
+  }
+  return DecodeLocalTransaction(read_scratch_.data() + kRecordHeaderSize, payload_size, tx_out) ==
+         WireStatus::kOk;
+}
+
+std::size_t FlashJournal::FindSlot(std::uint64_t hash, std::string_view tx_id, LocalTransaction* tx_out) const {
+  LocalTransaction tx;
+  LocalTransaction* candidate = tx_out != nullptr ? tx_out : &tx;
+  const std::size_t mask = index_addresses_.size() - 1;
+  for (std::size_t probe = 0, slot = hash & mask; probe <= mask; ++probe, slot = (slot + 1) & mask) {
+    const std::uint32_t address = index_addresses_[slot];
+    if (address == kIndexEmpty) {
+      return kNoSlot;
+    }
+    if (address != kIndexTombstone && index_hashes_[slot] == hash && ReadRecord(address, candidate) &&
+        std::string_view(candidate->tx_id) == tx_id) {
+      return slot;
+    }
+  }
+  return kNoSlot;
+}
+
+std::size_t FlashJournal::FindSlotAt(std::uint64_t hash, std::uint32_t address) const {
+  const std::size_t mask = index_addresses_.size() - 1;
+  for (std::size_t probe = 0, slot = hash & mask; probe <= mask; ++probe, slot = (slot + 1) & mask) {
+    if (index_addresses_[slot] == kIndexEmpty) {
+      return kNoSlot;
+    }
+    if (index_addresses_[slot] == address && index_hashes_[slot] == hash) {
+      return slot;
+    }
+  }
+  return kNoSlot;
+}
+
+bool FlashJournal::IndexPut(std::size_t slot, std::uint64_t hash, std::uint32_t address) {
+  if (slot != kNoSlot) {
+    if (index_addresses_[slot] == kIndexTombstone) {
+      // Compaction dropped the old version since the slot was found; the
+      // slot still sits on this hash's probe sequence.
+      --index_tombstones_;
+      ++index_live_;
+    } else {
+      ++sectors_[index_addresses_[slot] / device_->SectorSize()].reclaimable;
+    }
+    index_hashes_[slot] = hash;
+    index_addresses_[slot] = address;
+    return true;
+  }
+  if (index_live_ >= options_.max_records) {
+    return false;
+  }
+  if ((index_live_ + index_tombstones_ + 1) * 4 > index_addresses_.size() * 3) {
+    // Too many tombstones: rebuild the probe sequences in place.
+    std::vector<std::uint64_t> hashes;
+    std::vector<std::uint32_t> addresses;
+    hashes.swap(index_hashes_);
+    addresses.swap(index_addresses_);
+    index_hashes_.assign(hashes.size(), 0);
+    index_addresses_.assign(addresses.size(), kIndexEmpty);
+    index_live_ = 0;
+    index_tombstones_ = 0;
+    for (std::size_t slot = 0; slot < addresses.size(); ++slot) {
+      if (addresses[slot] != kIndexEmpty && addresses[slot] != kIndexTombstone) {
+        IndexPut(kNoSlot, hashes[slot], addresses[slot]);
+      }
+    }
+  }
+
+  const std::size_t mask = index_addresses_.size() - 1;
+  for (std::size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    const std::uint32_t current = index_addresses_[slot];
+    if (current == kIndexEmpty || current == kIndexTombstone) {
+      index_tombstones_ -= current == kIndexTombstone ? 1 : 0;
+      index_hashes_[slot] = hash;
+      index_addresses_[slot] = address;
+      ++index_live_;
+      return true;
+    }
+  }
+}
+
+void FlashJournal::IndexErase(std::size_t slot) {
+  index_addresses_[slot] = kIndexTombstone;
+  --index_live_;
+  ++index_tombstones_;
+}
+
+}  // namespace offline_wallet
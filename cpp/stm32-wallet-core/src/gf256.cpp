@@ -0,0 +1,218 @@
+#include "offline_wallet/gf256.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace offline_wallet {
+
+namespace {
+
+struct FieldTables {
+  // exp is doubled so that exp[log a + log b] needs no reduction.
+  std::array<std::uint8_t, 512> exp{};
+  std::array<std::uint8_t, 256> log{};
+};
+
+constexpr FieldTables BuildFieldTables() {
+  FieldTables tables{};
+  unsigned value = 1;
+  for (std::size_t i = 0; i < 255; ++i) {
+    tables.exp[i] = static_cast<std::uint8_t>(value);
+    tables.log[value] = static_cast<std::uint8_t>(i);
+    value <<= 1;
+    if (value & 0x100) {
+      value ^= 0x11D;
+    }
+  }
+  for (std::size_t i = 255; i < tables.exp.size(); ++i) {
+    tables.exp[i] = tables.exp[i - 255];
+  }
+  return tables;
+}
+
+constexpr FieldTables kField = BuildFieldTables();
+
+constexpr std::uint8_t Multiply(std::uint8_t a, std::uint8_t b) {
+  return a == 0 || b == 0 ? 0 : kField.exp[kField.log[a] + kField.log[b]];
+}
+
+// Generator of degree d is prod_{i<d} (x - alpha^i); row d holds its d
+// non-leading coefficients, highest power first, as logs (coefficients are
+// never zero).
+using GeneratorTable =
+    std::array<std::array<std::uint8_t, kReedSolomonMaxDegree>, kReedSolomonMaxDegree + 1>;
+
+constexpr GeneratorTable BuildGenerators() {
+  GeneratorTable logs{};
+  for (std::size_t degree = 1; degree <= kReedSolomonMaxDegree; ++degree) {
+    std::array<std::uint8_t, kReedSolomonMaxDegree + 1> poly{};  // poly[0] is x^degree.
+    poly[0] = 1;
+    for (std::size_t i = 0; i < degree; ++i) {
+      const std::uint8_t root = kField.exp[i];
+      for (std::size_t j = i + 1; j > 0; --j) {
+        poly[j] = static_cast<std::uint8_t>(poly[j] ^ Multiply(poly[j - 1], root));
+      }
+    }
+    for (std::size_t j = 0; j < degree; ++j) {
+      logs[degree][j] = kField.log[poly[j + 1]];
+    }
+  }
+  return logs;
+}
+
+constexpr GeneratorTable kGeneratorLogs = BuildGenerators();
+
+}  // namespace
+
+std::uint8_t Gf256Multiply(std::uint8_t a, std::uint8_t b) { return Multiply(a, b); }
+
+std::uint8_t Gf256Divide(std::uint8_t a, std::uint8_t b) {
+  return a == 0 ? 0 : kField.exp[kField.log[a] + 255 - kField.log[b]];
+}
+
+std::uint8_t Gf256Exp(std::size_t power) { return kField.exp[power % 255]; }
+
+std::uint8_t Gf256Log(std::uint8_t value) { return kField.log[value]; }
+
+bool ReedSolomonEncode(const std::uint8_t* data,
+                       std::size_t size,
+                       std::size_t degree,
+                       std::uint8_t* parity_out) {
+  if (degree == 0 || degree > kReedSolomonMaxDegree) {
+    return false;
+  }
+  const std::uint8_t* generator = kGeneratorLogs[degree].data();
+  std::memset(parity_out, 0, degree);
+  for (std::size_t i = 0; i < size; ++i) {
+    const std::uint8_t factor = data[i] ^ parity_out[0];
+    std::memmove(parity_out, parity_out + 1, degree - 1);
+    parity_out[degree - 1] = 0;
+    if (factor == 0) {
+      continue;
+    }
+    const std::size_t factor_log = kField.log[factor];
+    for (std::size_t j = 0; j < degree; ++j) {
+      parity_out[j] ^= kField.exp[factor_log + generator[j]];
+    }
+  }
+  return true;
+}
+
+bool ReedSolomonCorrect(std::uint8_t* codeword,
+                        std::size_t size,
+                        std::size_t degree,
+                        std::size_t* corrected_out) {
+  if (corrected_out != nullptr) {
+    *corrected_out = 0;
+  }
+  if (degree == 0 || degree > kReedSolomonMaxDegree || size <= degree || size > 255) {
+    return false;
+  }
+
+  // Syndromes S_i = c(alpha^i), the generator's roots.
+  std::uint8_t syndromes[kReedSolomonMaxDegree] = {};
+  bool clean = true;
+  for (std::size_t i = 0; i < degree; ++i) {
+    std::uint8_t value = 0;
+    for (std::size_t j = 0; j < size; ++j) {
+      value = static_cast<std::uint8_t>((value == 0 ? 0 : kField.exp[kField.log[value] + i]) ^ codeword[j]);
+    }
+    syndromes[i] = value;
+    clean = clean && value == 0;
+  }
+  if (clean) {
+    return true;
+  }
+
+  // Berlekamp-Massey: error locator lambda, coefficients lowest power first.
+  std::uint8_t lambda[kReedSolomonMaxDegree + 1] = {1};
+  std::uint8_t previous[kReedSolomonMaxDegree + 1] = {1};
+  std::size_t errors = 0;
+  std::size_t shift = 1;
+  std::uint8_t previous_discrepancy = 1;
+  for (std::size_t n = 0; n < degree; ++n) {
+    std::uint8_t discrepancy = syndromes[n];
+    for (std::size_t i = 1; i <= errors; ++i) {
+      discrepancy ^= Multiply(lambda[i], syndromes[n - i]);
+    }
+    if (discrepancy == 0) {
+      ++shift;
+      continue;
+    }
+    const std::uint8_t scale = Gf256Divide(discrepancy, previous_discrepancy);
+    std::uint8_t saved[kReedSolomonMaxDegree + 1];
+    std::memcpy(saved, lambda, sizeof(lambda));
+    for (std::size_t i = 0; i + shift <= degree; ++i) {
+      lambda[i + shift] ^= Multiply(scale, previous[i]);
+    }
+    if (2 * errors <= n) {
+      errors = n + 1 - errors;
+      std::memcpy(previous, saved, sizeof(previous));
+      previous_discrepancy = discrepancy;
+      shift = 1;
+    } else {
+      ++shift;
+    }
+  }
+  if (2 * errors > degree) {
+    return false;
+  }
+
+  // Chien search over the positions actually present, then Forney:
+  // e = X * omega(X^-1) / lambda'(X^-1), omega = S * lambda mod x^degree.
+  std::uint8_t omega[kReedSolomonMaxDegree] = {};
+  for (std::size_t i = 0; i < degree; ++i) {
+    for (std::size_t k = 0; k <= i && k <= errors; ++k) {
+      omega[i] ^= Multiply(syndromes[i - k], lambda[k]);
+    }
+  }
+  std::size_t positions[kReedSolomonMaxDegree / 2];
+  std::uint8_t magnitudes[kReedSolomonMaxDegree / 2];
+  std::size_t found = 0;
+  for (std::size_t j = 0; j < size; ++j) {
+    const std::size_t power = size - 1 - j;
+    const std::size_t inverse_log = (255 - power) % 255;
+    std::uint8_t value = 0;
+    for (std::size_t i = 0; i <= errors; ++i) {
+      if (lambda[i] != 0) {
+        value ^= kField.exp[(kField.log[lambda[i]] + inverse_log * i) % 255];
+      }
+    }
+    if (value != 0) {
+      continue;
+    }
+    if (found == errors) {
+      return false;
+    }
+    std::uint8_t numerator = 0;
+    for (std::size_t i = 0; i < degree; ++i) {
+      if (omega[i] != 0) {
+        numerator ^= kField.exp[(kField.log[omega[i]] + inverse_log * i) % 255];
+      }
+    }
+    std::uint8_t denominator = 0;
+    for (std::size_t i = 1; i <= errors; i += 2) {
+      if (lambda[i] != 0) {
+        denominator ^= kField.exp[(kField.log[lambda[i]] + inverse_log * (i - 1)) % 255];
+      }
+    }
+    if (denominator == 0) {
+      return false;
+    }
+    positions[found] = j;
+    magnitudes[found] = Multiply(Gf256Exp(power), Gf256Divide(numerator, denominator));
+    ++found;
+  }
+  if (found != errors) {
+    return false;
+  }
+  for (std::size_t i = 0; i < found; ++i) {
+    codeword[positions[i]] ^= magnitudes[i];
+  }
+  if (corrected_out != nullptr) {
+    *corrected_out = found;
+  }
+  return true;
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,44 @@
+#include "offline_wallet/handshake_arena.hpp"
+
+#include <cstdint>
+
+namespace offline_wallet {
+
+HandshakeArena::HandshakeArena(void* buffer, std::size_t size, std::pmr::memory_resource* upstream)
+    : buffer_(static_cast<unsigned char*>(buffer)),
+      size_(buffer == nullptr ? 0 : size),
+      overflow_(upstream) {}
+
+void HandshakeArena::Reset() {
+  if (listener_ != nullptr) {
+    listener_->OnReset(usage_);
+  }
+  if (usage_.bytes > peak_.bytes) {
+    peak_ = usage_;
+  }
+  if (usage_.overflow_bytes > 0) {
+    overflow_.release();
+  }
+  offset_ = 0;
+  usage_ = {};
+}
+
+void* HandshakeArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+  const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(buffer_);
+  const std::uintptr_t mask = static_cast<std::uintptr_t>(alignment) - 1;
+  const std::uintptr_t aligned = (base + offset_ + mask) & ~mask;
+  const std::size_t end = static_cast<std::size_t>(aligned - base) + bytes;
+  if (buffer_ != nullptr && end <= size_) {
+    ++usage_.allocations;
+    usage_.bytes += end - offset_;
+    offset_ = end;
+    return buffer_ + (aligned - base);
+  }
+  void* ptr = overflow_.allocate(bytes, alignment);
+  ++usage_.allocations;
+  usage_.bytes += bytes;
+  usage_.overflow_bytes += bytes;
+  return ptr;
+}
+
+}  // namespace offline_wallet
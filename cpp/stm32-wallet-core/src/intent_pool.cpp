@@ -0,0 +1,54 @@
+#include "offline_wallet/intent_pool.hpp"
+
+#include <utility>
+
+namespace offline_wallet {
+
+namespace {
+
+void FillKey(RandomProvider* random_provider, const char* prefix, std::string* key_out) {
+  char hex[16];
+  const std::size_t size = random_provider->FillHex(8, hex);
+  key_out->assign(prefix);
+  key_out->append(hex, size);
+}
+
+}  // namespace
+
+IntentPool::IntentPool(RandomProvider* random_provider, TransactionJournal* journal, std::size_t depth)
+    : random_provider_(random_provider), journal_(journal), entries_(depth) {}
+
+std::size_t IntentPool::Refill(std::size_t budget) {
+  if (!random_provider_->Ready()) {
+    return 0;
+  }
+  std::size_t added = 0;
+  while (added < budget && count_ < entries_.size()) {
+    // Same draw order and prefixes as the engine's inline path.
+    Entry& entry = entries_[(first_ + count_) % entries_.size()];
+    FillKey(random_provider_, "tx-", &entry.tx_id);
+    FillKey(random_provider_, "mi-", &entry.merchant_intent_id);
+    FillKey(random_provider_, "", &entry.merchant_nonce);
+    ++count_;
+    ++added;
+  }
+  if (journal_ != nullptr && count_ > 0) {
+    journal_->Reserve(count_);
+  }
+  return added;
+}
+
+bool IntentPool::Take(PaymentIntent* intent) {
+  if (count_ == 0) {
+    return false;
+  }
+  Entry& entry = entries_[first_];
+  intent->tx_id = std::move(entry.tx_id);
+  intent->merchant_intent_id = std::move(entry.merchant_intent_id);
+  intent->merchant_nonce = std::move(entry.merchant_nonce);
+  first_ = (first_ + 1) % entries_.size();
+  --count_;
+  return true;
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,84 @@
+#include "offline_wallet/iso_time.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// Days between 1970-01-01 and a civil date, and back (Howard Hinnant's algorithms).
+std::int64_t DaysFromCivil(std::int64_t year, std::uint32_t month, std::uint32_t day) {
+  year -= month <= 2 ? 1 : 0;
+  const std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+  const auto yoe = static_cast<std::uint32_t>(year - era * 400);
+  const std::uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const std::uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146'097 + static_cast<std::int64_t>(doe) - 719'468;
+}
+
+bool Digits(std::string_view text, std::size_t at, std::size_t width, std::uint32_t* value_out) {
+  std::uint32_t value = 0;
+  for (std::size_t i = at; i < at + width; ++i) {
+    if (text[i] < '0' || text[i] > '9') {
+      return false;
+    }
+    value = value * 10 + static_cast<std::uint32_t>(text[i] - '0');
+  }
+  *value_out = value;
+  return true;
+}
+
+}  // namespace
+
+void FormatIsoTimestamp(std::uint64_t epoch_seconds, char* out) {
+  const std::uint64_t z = epoch_seconds / 86'400 + 719'468;
+  const std::uint64_t era = z / 146'097;
+  const std::uint64_t doe = z - era * 146'097;
+  const std::uint64_t yoe = (doe - doe / 1'460 + doe / 36'524 - doe / 146'096) / 365;
+  const std::uint64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const std::uint64_t mp = (5 * doy + 2) / 153;
+  const std::uint64_t day = doy - (153 * mp + 2) / 5 + 1;
+  const std::uint64_t month = mp < 10 ? mp + 3 : mp - 9;
+  const std::uint64_t year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+  const std::uint64_t seconds = epoch_seconds % 86'400;
+
+  constexpr char kTemplate[] = "0000-00-00T00:00:00.000Z";
+  for (std::size_t i = 0; i < kIsoTimestampSize; ++i) {
+    out[i] = kTemplate[i];
+  }
+  const auto put = [out](std::size_t at, std::size_t width, std::uint64_t value) {
+    for (std::size_t i = width; i > 0; --i, value /= 10) {
+      out[at + i - 1] = static_cast<char>('0' + value % 10);
+    }
+  };
+  put(0, 4, year);
+  put(5, 2, month);
+  put(8, 2, day);
+  put(11, 2, seconds / 3'600);
+  put(14, 2, seconds / 60 % 60);
+  put(17, 2, seconds % 60);
+}
+
+bool ParseIsoTimestamp(std::string_view text, std::uint64_t* epoch_seconds_out) {
+  std::uint32_t year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+  if (text.size() < 20 || text[4] != '-' || text[7] != '-' || text[10] != 'T' || text[13] != ':' ||
+      text[16] != ':' || text.back() != 'Z' || !Digits(text, 0, 4, &year) || !Digits(text, 5, 2, &month) ||
+      !Digits(text, 8, 2, &day) || !Digits(text, 11, 2, &hour) || !Digits(text, 14, 2, &minute) ||
+      !Digits(text, 17, 2, &second)) {
+    return false;
+  }
+  if (text.size() > 20) {
+    std::uint32_t fraction = 0;
+    if (text[19] != '.' || text.size() == 21 || text.size() > 30 ||
+        !Digits(text, 20, text.size() - 21, &fraction)) {
+      return false;
+    }
+  }
+  if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 ||
+      second > 59) {
+    return false;
+  }
+  const std::int64_t days = DaysFromCivil(year, month, day);
+  *epoch_seconds_out = static_cast<std::uint64_t>(days) * 86'400 + hour * 3'600 + minute * 60 + second;
+  return true;
+}
+
+}  // namespace offline_wallet
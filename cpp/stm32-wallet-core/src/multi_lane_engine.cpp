@@ -0,0 +1,27 @@
+#include "offline_wallet/multi_lane_engine.hpp"
+
+#include <utility>
+
+namespace offline_wallet {
+
+MultiLaneEngine::MultiLaneEngine(RiskPolicy policy,
+                                 std::size_t lanes,
+                                 LaneProviderFactory* factory,
+                                 ClockProvider* clock_provider,
+                                 TransactionJournal* journal) {
+  lanes_.reserve(lanes);
+  for (std::size_t i = 0; i < lanes; ++i) {
+    Lane lane;
+    lane.providers = factory->Create(i);
+    if (lane.providers.streaming_signer) {
+      lane.engine = std::make_unique<OfflineEngine>(policy, lane.providers.streaming_signer.get(),
+                                                    lane.providers.random.get(), clock_provider, journal);
+    } else {
+      lane.engine = std::make_unique<OfflineEngine>(policy, lane.providers.signer.get(),
+                                                    lane.providers.random.get(), clock_provider, journal);
+    }
+    lanes_.push_back(std::move(lane));
+  }
+}
+
+}  // namespace offline_wallet
@@ -1,24 +1,101 @@
 #include "offline_wallet/offline_engine.hpp"
 
-#include <sstream>
+#include <utility>
 
 namespace offline_wallet {
 
 namespace {
 
-std::string BuildKey(const std::string& prefix, const std::string& random_hex) {
-  return prefix + random_hex;
+constexpr std::size_t kRandomIdBytes = 8;
+
+// Collects the signed bytes for a session to hand to its caller.
+class MessageRecorder : public StreamingSignatureProvider {
+ public:
+  explicit MessageRecorder(std::string* message) : message_(message) { message_->clear(); }
+
+  void BeginSign(const std::string& /*key_id*/) override {}
+  void BeginVerify(const std::string& /*public_key_or_id*/) override {}
+  void Update(const char* data, std::size_t size) override { message_->append(data, size); }
+  void FinishSign(std::string* /*signature_out*/) override {}
+  bool FinishVerify(const std::string& /*signature*/) override { return false; }
+
+ private:
+  std::string* message_;
+};
+
+void WriteIntentFields(const PaymentIntent& intent, StreamingSignatureProvider* sink) {
+  SignatureFieldWriter(sink)
+      .Field(intent.tx_id)
+      .Field(intent.merchant_intent_id)
+      .Field(intent.amount_cents)
+      .Field(intent.currency)
+      .Field(intent.merchant_nonce)
+      .Field(intent.merchant_counter)
+      .Field(intent.expires_at_epoch_seconds);
+}
+
+void WriteAuthorizationFields(const PaymentAuthorization& authorization, StreamingSignatureProvider* sink) {
+  SignatureFieldWriter(sink)
+      .Field(authorization.tx_id)
+      .Field(authorization.merchant_intent_id)
+      .Field(authorization.amount_cents)
+      .Field(authorization.currency)
+      .Field(authorization.payer_nonce)
+      .Field(authorization.payer_counter)
+      .Field(authorization.authorized_at_epoch_seconds);
+}
+
+void WriteReceiptFields(const PaymentReceipt& receipt,
+                        const std::pmr::string& payer_authorization_id,
+                        StreamingSignatureProvider* sink) {
+  SignatureFieldWriter(sink).Field(receipt.tx_id).Field(payer_authorization_id).Field("pending_sync");
 }
 
 }  // namespace
 
+HandshakeSession::~HandshakeSession() {
+  if (engine_ != nullptr) {
+    engine_->Unlink(this);
+  }
+}
+
+bool HandshakeSession::CompleteSignature(const std::string& signature) {
+  if (wait_ != SessionWait::kSignature) {
+    return false;
+  }
+  signature_ = signature;
+  engine_->ResumeAfterSignature(this);
+  return true;
+}
+
+bool HandshakeSession::CompleteJournalWrite(bool persisted) {
+  if (wait_ != SessionWait::kJournalWrite) {
+    return false;
+  }
+  engine_->ResumeAfterJournalWrite(this, persisted);
+  return true;
+}
+
 OfflineEngine::OfflineEngine(RiskPolicy policy,
                              SignatureProvider* signature_provider,
                              RandomProvider* random_provider,
                              ClockProvider* clock_provider,
                              TransactionJournal* journal)
     : policy_(policy),
-      signature_provider_(signature_provider),
+      signature_bridge_(signature_provider),
+      streaming_signer_(nullptr),
+      random_provider_(random_provider),
+      clock_provider_(clock_provider),
+      journal_(journal) {}
+
+OfflineEngine::OfflineEngine(RiskPolicy policy,
+                             StreamingSignatureProvider* signature_provider,
+                             RandomProvider* random_provider,
+                             ClockProvider* clock_provider,
+                             TransactionJournal* journal)
+    : policy_(policy),
+      signature_bridge_(nullptr),
+      streaming_signer_(signature_provider),
       random_provider_(random_provider),
       clock_provider_(clock_provider),
       journal_(journal) {}
@@ -28,60 +105,252 @@ HandshakeResult OfflineEngine::BuildMerchantIntent(const DeviceContext& merchant
                                                    const std::string& currency,
                                                    PaymentIntent* intent_out,
                                                    LocalTransaction* tx_out) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kBuildMerchantIntent);
+  HandshakeResult result = DoBuildMerchantIntent(merchant, amount_cents, currency, intent_out, tx_out);
+  ResetArena();
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kBuildMerchantIntent, result.status);
+  return result;
+}
+
+HandshakeResult OfflineEngine::DoBuildMerchantIntent(const DeviceContext& merchant,
+                                                     std::int32_t amount_cents,
+                                                     const std::string& currency,
+                                                     PaymentIntent* intent_out,
+                                                     LocalTransaction* tx_out) {
   if (!intent_out || !tx_out) {
     return {HandshakeStatus::kInvalidInput, "output pointer is null"};
   }
 
-  if (amount_cents <= 0 || amount_cents > policy_.max_per_transaction_cents) {
-    return {HandshakeStatus::kPolicyDenied, "amount violates policy"};
+  PaymentIntent intent(ScratchResource());
+  HandshakeResult result = PrepareIntent(merchant, amount_cents, currency, &intent);
+  if (result.status != HandshakeStatus::kOk) {
+    return result;
   }
+  SignIntent(intent, merchant.signing_key_id, &intent.merchant_signature);
 
-  const auto now = clock_provider_->NowUnixSeconds();
-  PaymentIntent intent{};
-  intent.tx_id = BuildKey("tx-", random_provider_->NextHex(8));
-  intent.merchant_intent_id = BuildKey("mi-", random_provider_->NextHex(8));
-  intent.merchant_account_id = merchant.account_id;
-  intent.merchant_device_id = merchant.device_id;
-  intent.amount_cents = amount_cents;
-  intent.currency = currency;
-  intent.merchant_nonce = random_provider_->NextHex(8);
-  intent.merchant_counter = merchant.local_counter;
-  intent.issued_at_epoch_seconds = now;
-  intent.expires_at_epoch_seconds = now + policy_.intent_ttl_seconds;
-  intent.merchant_signature =
-      signature_provider_->Sign(BuildIntentSignatureMessage(intent), merchant.signing_key_id);
-
-  LocalTransaction tx{};
-  tx.tx_id = intent.tx_id;
-  tx.merchant_account_id = merchant.account_id;
-  tx.merchant_device_id = merchant.device_id;
-  tx.amount_cents = amount_cents;
-  tx.currency = currency;
-  tx.merchant_intent_id = intent.merchant_intent_id;
-  tx.merchant_nonce = intent.merchant_nonce;
-  tx.merchant_counter = intent.merchant_counter;
-  tx.state = TransactionState::kInitiated;
-  tx.created_at_epoch_seconds = now;
-  tx.updated_at_epoch_seconds = now;
-  tx.idempotency_key = BuildKey("merchant:", intent.tx_id);
-
-  if (!journal_->Save(tx)) {
+  LocalTransaction tx(ScratchResource());
+  BuildIntentRecord(merchant, intent, &tx);
+
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kJournalWrite);
+  const bool persisted =
+      group_commit_ ? journal_->BeginBatch() && journal_->Stage(tx) : journal_->Save(tx);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kJournalWrite, !persisted);
+  if (!persisted) {
     return {HandshakeStatus::kJournalFailure, "failed to persist local transaction"};
   }
+  if (expiry_sweeper_ != nullptr) {
+    expiry_sweeper_->Track(intent);
+  }
 
   *intent_out = intent;
   *tx_out = tx;
-  return {HandshakeStatus::kOk, "ok"};
+  return result;
 }
 
 HandshakeResult OfflineEngine::BuildPayerAuthorization(const DeviceContext& payer,
                                                        const PaymentIntent& intent,
                                                        PaymentAuthorization* authorization_out,
                                                        LocalTransaction* tx_out) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kBuildPayerAuthorization);
+  HandshakeResult result = DoBuildPayerAuthorization(payer, intent, authorization_out, tx_out);
+  ResetArena();
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kBuildPayerAuthorization, result.status);
+  return result;
+}
+
+HandshakeResult OfflineEngine::DoBuildPayerAuthorization(const DeviceContext& payer,
+                                                         const PaymentIntent& intent,
+                                                         PaymentAuthorization* authorization_out,
+                                                         LocalTransaction* tx_out) {
   if (!authorization_out || !tx_out) {
     return {HandshakeStatus::kInvalidInput, "output pointer is null"};
   }
 
+  PaymentAuthorization authorization(ScratchResource());
+  HandshakeResult result = PrepareAuthorization(payer, intent, &authorization);
+  if (result.status != HandshakeStatus::kOk) {
+    return result;
+  }
+  SignAuthorization(authorization, payer.signing_key_id, &authorization.payer_signature);
+
+  LocalTransaction tx(ScratchResource());
+  BuildAuthorizationRecord(intent, authorization, &tx);
+
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kJournalWrite);
+  const bool persisted = journal_->Save(tx);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kJournalWrite, !persisted);
+  if (!persisted) {
+    return {HandshakeStatus::kJournalFailure, "failed to persist payer transaction"};
+  }
+  if (spend_tracker_ != nullptr) {
+    const auto now = authorization.authorized_at_epoch_seconds;
+    spend_tracker_->Add(payer.account_id, intent.amount_cents, now, now);
+  }
+
+  *authorization_out = authorization;
+  *tx_out = tx;
+  return result;
+}
+
+HandshakeResult OfflineEngine::AcceptAuthorization(const DeviceContext& merchant,
+                                                   const PaymentAuthorization& authorization,
+                                                   PaymentReceipt* receipt_out,
+                                                   LocalTransaction* tx_out) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kAcceptAuthorization);
+  HandshakeResult result = DoAcceptAuthorization(merchant, authorization, receipt_out, tx_out);
+  ResetArena();
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kAcceptAuthorization, result.status);
+  return result;
+}
+
+HandshakeResult OfflineEngine::DoAcceptAuthorization(const DeviceContext& merchant,
+                                                     const PaymentAuthorization& authorization,
+                                                     PaymentReceipt* receipt_out,
+                                                     LocalTransaction* tx_out) {
+  if (!receipt_out || !tx_out) {
+    return {HandshakeStatus::kInvalidInput, "output pointer is null"};
+  }
+
+  LocalTransaction tx(ScratchResource());
+  std::uint64_t now = 0;
+  HandshakeResult result = PrepareAcceptance(authorization, &tx, &now);
+  if (result.status != HandshakeStatus::kOk) {
+    // The staged intent can still be answered; commit it on its own so the
+    // batch does not stay open under the next sale.
+    if (group_commit_ && !journal_->CommitBatch()) {
+      journal_->AbortBatch();
+    }
+    return result;
+  }
+
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kJournalWrite);
+  const bool persisted =
+      group_commit_ ? journal_->Stage(tx) && journal_->CommitBatch() : journal_->Save(tx);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kJournalWrite, !persisted);
+  if (!persisted) {
+    if (group_commit_) {
+      journal_->AbortBatch();
+    }
+    return {HandshakeStatus::kJournalFailure, "failed to persist merchant acceptance"};
+  }
+  RecordAcceptance(authorization, now);
+
+  PaymentReceipt receipt(ScratchResource());
+  BuildReceipt(merchant, authorization, now, &receipt);
+  if (receipt_chain_ != nullptr) {
+    AppendToReceiptChain(authorization, &receipt);
+    if (receipt_chain_->CheckpointDue(receipt.created_at_epoch_seconds)) {
+      SealReceiptCheckpoint(merchant);
+    }
+  } else {
+    SignReceipt(receipt, authorization.payer_authorization_id, merchant.signing_key_id,
+                &receipt.merchant_signature);
+  }
+
+  *receipt_out = receipt;
+  *tx_out = tx;
+  return result;
+}
+
+void OfflineEngine::StartMerchantIntent(const DeviceContext& merchant,
+                                        std::int32_t amount_cents,
+                                        const std::string& currency,
+                                        HandshakeSession* session) {
+  BeginSession(session);
+  session->device_ = merchant;
+  HandshakeResult result = PrepareIntent(merchant, amount_cents, currency, &session->intent_);
+  if (result.status != HandshakeStatus::kOk) {
+    FinishSession(session, std::move(result));
+    return;
+  }
+  MessageRecorder recorder(&session->message_);
+  WriteIntentFields(session->intent_, &recorder);
+  AwaitSignature(session, HandshakeSession::Step::kSignIntent, merchant.signing_key_id);
+}
+
+void OfflineEngine::StartPayerAuthorization(const DeviceContext& payer,
+                                            const PaymentIntent& intent,
+                                            HandshakeSession* session) {
+  BeginSession(session);
+  session->device_ = payer;
+  session->intent_ = intent;
+  HandshakeResult result = PrepareAuthorization(payer, intent, &session->authorization_);
+  if (result.status != HandshakeStatus::kOk) {
+    FinishSession(session, std::move(result));
+    return;
+  }
+  session->pending_spend_cents_ = intent.amount_cents;
+  MessageRecorder recorder(&session->message_);
+  WriteAuthorizationFields(session->authorization_, &recorder);
+  AwaitSignature(session, HandshakeSession::Step::kSignAuthorization, payer.signing_key_id);
+}
+
+void OfflineEngine::StartAcceptAuthorization(const DeviceContext& merchant,
+                                             const PaymentAuthorization& authorization,
+                                             HandshakeSession* session) {
+  BeginSession(session);
+  session->device_ = merchant;
+  session->authorization_ = authorization;
+  HandshakeResult result = PrepareAcceptance(authorization, &session->tx_, &session->now_);
+  if (result.status != HandshakeStatus::kOk) {
+    FinishSession(session, std::move(result));
+    return;
+  }
+  session->pending_spend_cents_ = authorization.amount_cents;
+  AwaitJournalWrite(session, HandshakeSession::Step::kWriteAcceptance);
+}
+
+HandshakeResult OfflineEngine::PrepareIntent(const DeviceContext& merchant,
+                                             std::int32_t amount_cents,
+                                             const std::string& currency,
+                                             PaymentIntent* intent) {
+  if (amount_cents <= 0 || amount_cents > policy_.max_per_transaction_cents) {
+    return {HandshakeStatus::kPolicyDenied, "amount violates policy"};
+  }
+  if (!random_provider_->Ready()) {
+    return {HandshakeStatus::kRandomUnavailable, "random provider not seeded"};
+  }
+
+  const auto now = clock_provider_->NowUnixSeconds();
+  if (intent_pool_ == nullptr || !intent_pool_->Take(intent)) {
+    NextKey("tx-", &intent->tx_id);
+    NextKey("mi-", &intent->merchant_intent_id);
+    NextKey("", &intent->merchant_nonce);
+  }
+  intent->merchant_account_id = merchant.account_id;
+  intent->merchant_device_id = merchant.device_id;
+  intent->amount_cents = amount_cents;
+  intent->currency = currency;
+  intent->merchant_counter = merchant.local_counter;
+  intent->issued_at_epoch_seconds = now;
+  intent->expires_at_epoch_seconds = now + policy_.intent_ttl_seconds;
+  return {HandshakeStatus::kOk, "ok"};
+}
+
+void OfflineEngine::BuildIntentRecord(const DeviceContext& merchant,
+                                      const PaymentIntent& intent,
+                                      LocalTransaction* tx) {
+  tx->tx_id = intent.tx_id;
+  tx->merchant_account_id = merchant.account_id;
+  tx->merchant_device_id = merchant.device_id;
+  tx->amount_cents = intent.amount_cents;
+  tx->currency = intent.currency;
+  tx->merchant_intent_id = intent.merchant_intent_id;
+  tx->merchant_nonce = intent.merchant_nonce;
+  tx->merchant_counter = intent.merchant_counter;
+  tx->state = TransactionState::kInitiated;
+  tx->created_at_epoch_seconds = intent.issued_at_epoch_seconds;
+  tx->updated_at_epoch_seconds = intent.issued_at_epoch_seconds;
+  tx->idempotency_key.assign("merchant:");
+  tx->idempotency_key.append(intent.tx_id);
+  tx->intent_issued_at_epoch_seconds = intent.issued_at_epoch_seconds;
+  tx->expires_at_epoch_seconds = intent.expires_at_epoch_seconds;
+  tx->merchant_signature = intent.merchant_signature;
+}
+
+HandshakeResult OfflineEngine::PrepareAuthorization(const DeviceContext& payer,
+                                                    const PaymentIntent& intent,
+                                                    PaymentAuthorization* authorization) {
   const auto now = clock_provider_->NowUnixSeconds();
   if (intent.expires_at_epoch_seconds < now) {
     return {HandshakeStatus::kExpired, "intent expired"};
@@ -97,113 +366,414 @@ HandshakeResult OfflineEngine::BuildPayerAuthorization(const DeviceContext& paye
   if (skew > policy_.max_clock_skew_seconds) {
     return {HandshakeStatus::kPolicyDenied, "clock skew exceeded"};
   }
-
-  PaymentAuthorization authorization{};
-  authorization.tx_id = intent.tx_id;
-  authorization.merchant_intent_id = intent.merchant_intent_id;
-  authorization.payer_authorization_id = BuildKey("pa-", random_provider_->NextHex(8));
-  authorization.payer_account_id = payer.account_id;
-  authorization.payer_device_id = payer.device_id;
-  authorization.amount_cents = intent.amount_cents;
-  authorization.currency = intent.currency;
-  authorization.payer_nonce = random_provider_->NextHex(8);
-  authorization.payer_counter = payer.local_counter;
-  authorization.authorized_at_epoch_seconds = now;
-  authorization.payer_signature =
-      signature_provider_->Sign(BuildAuthorizationSignatureMessage(authorization), payer.signing_key_id);
-
-  LocalTransaction tx{};
-  tx.tx_id = authorization.tx_id;
-  tx.merchant_account_id = intent.merchant_account_id;
-  tx.payer_account_id = payer.account_id;
-  tx.merchant_device_id = intent.merchant_device_id;
-  tx.payer_device_id = payer.device_id;
-  tx.amount_cents = intent.amount_cents;
-  tx.currency = intent.currency;
-  tx.merchant_intent_id = intent.merchant_intent_id;
-  tx.payer_authorization_id = authorization.payer_authorization_id;
-  tx.merchant_nonce = intent.merchant_nonce;
-  tx.payer_nonce = authorization.payer_nonce;
-  tx.merchant_counter = intent.merchant_counter;
-  tx.payer_counter = authorization.payer_counter;
-  tx.state = TransactionState::kAuthorized;
-  tx.created_at_epoch_seconds = now;
-  tx.updated_at_epoch_seconds = now;
-  tx.idempotency_key = BuildKey("payer:", tx.tx_id + ":" + tx.payer_authorization_id);
-
-  if (!journal_->Save(tx)) {
-    return {HandshakeStatus::kJournalFailure, "failed to persist payer transaction"};
+  if (spend_tracker_ != nullptr &&
+      spend_tracker_->SpendInWindow(payer.account_id, now) + InFlightSpend(payer.account_id) +
+              intent.amount_cents >
+          policy_.max_per_day_per_payer_cents) {
+    return {HandshakeStatus::kPolicyDenied, "daily limit exceeded"};
+  }
+  if (verify_peer_signatures_ && !VerifyIntent(intent)) {
+    return {HandshakeStatus::kSignatureInvalid, "merchant signature invalid"};
+  }
+  if (!random_provider_->Ready()) {
+    return {HandshakeStatus::kRandomUnavailable, "random provider not seeded"};
   }
 
-  *authorization_out = authorization;
-  *tx_out = tx;
+  authorization->tx_id = intent.tx_id;
+  authorization->merchant_intent_id = intent.merchant_intent_id;
+  NextKey("pa-", &authorization->payer_authorization_id);
+  authorization->payer_account_id = payer.account_id;
+  authorization->payer_device_id = payer.device_id;
+  authorization->amount_cents = intent.amount_cents;
+  authorization->currency = intent.currency;
+  NextKey("", &authorization->payer_nonce);
+  authorization->payer_counter = payer.local_counter;
+  authorization->authorized_at_epoch_seconds = now;
   return {HandshakeStatus::kOk, "ok"};
 }
 
-HandshakeResult OfflineEngine::AcceptAuthorization(const DeviceContext& merchant,
-                                                   const PaymentAuthorization& authorization,
-                                                   PaymentReceipt* receipt_out,
-                                                   LocalTransaction* tx_out) {
-  if (!receipt_out || !tx_out) {
-    return {HandshakeStatus::kInvalidInput, "output pointer is null"};
-  }
+void OfflineEngine::BuildAuthorizationRecord(const PaymentIntent& intent,
+                                             const PaymentAuthorization& authorization,
+                                             LocalTransaction* tx) {
+  tx->tx_id = authorization.tx_id;
+  tx->merchant_account_id = intent.merchant_account_id;
+  tx->payer_account_id = authorization.payer_account_id;
+  tx->merchant_device_id = intent.merchant_device_id;
+  tx->payer_device_id = authorization.payer_device_id;
+  tx->amount_cents = intent.amount_cents;
+  tx->currency = intent.currency;
+  tx->merchant_intent_id = intent.merchant_intent_id;
+  tx->payer_authorization_id = authorization.payer_authorization_id;
+  tx->merchant_nonce = intent.merchant_nonce;
+  tx->payer_nonce = authorization.payer_nonce;
+  tx->merchant_counter = intent.merchant_counter;
+  tx->payer_counter = authorization.payer_counter;
+  tx->state = TransactionState::kAuthorized;
+  tx->created_at_epoch_seconds = authorization.authorized_at_epoch_seconds;
+  tx->updated_at_epoch_seconds = authorization.authorized_at_epoch_seconds;
+  tx->idempotency_key.assign("payer:");
+  tx->idempotency_key.append(tx->tx_id).append(":").append(tx->payer_authorization_id);
+  tx->intent_issued_at_epoch_seconds = intent.issued_at_epoch_seconds;
+  tx->authorized_at_epoch_seconds = authorization.authorized_at_epoch_seconds;
+  tx->expires_at_epoch_seconds = intent.expires_at_epoch_seconds;
+  tx->merchant_signature = intent.merchant_signature;
+  tx->payer_signature = authorization.payer_signature;
+}
 
-  LocalTransaction tx{};
-  if (!journal_->Load(authorization.tx_id, &tx)) {
+HandshakeResult OfflineEngine::PrepareAcceptance(const PaymentAuthorization& authorization,
+                                                 LocalTransaction* tx,
+                                                 std::uint64_t* now_out) {
+  tx_id_scratch_.assign(authorization.tx_id.data(), authorization.tx_id.size());
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kJournalLoad);
+  const bool loaded = journal_->Load(tx_id_scratch_, tx);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kJournalLoad, !loaded);
+  if (!loaded) {
     return {HandshakeStatus::kUnknownTransaction, "merchant transaction not found"};
   }
 
-  if (tx.merchant_intent_id != authorization.merchant_intent_id ||
-      tx.amount_cents != authorization.amount_cents || tx.currency != authorization.currency) {
+  if (tx->merchant_intent_id != authorization.merchant_intent_id ||
+      tx->amount_cents != authorization.amount_cents || tx->currency != authorization.currency) {
     return {HandshakeStatus::kMismatch, "authorization does not match intent"};
   }
+  if (tx->state == TransactionState::kExpired) {
+    return {HandshakeStatus::kExpired, "intent expired"};
+  }
+  if (AcceptanceInFlight(authorization.tx_id)) {
+    return {HandshakeStatus::kReplayDetected, "authorization already being accepted"};
+  }
+
+  const auto now = clock_provider_->NowUnixSeconds();
+  if (replay_filter_ != nullptr) {
+    switch (replay_filter_->Check(authorization, now)) {
+      case ReplayVerdict::kFresh:
+        break;
+      case ReplayVerdict::kReplayed:
+        return {HandshakeStatus::kReplayDetected, "authorization replayed"};
+      case ReplayVerdict::kCounterRegressed:
+        return {HandshakeStatus::kReplayDetected, "payer counter regressed"};
+      case ReplayVerdict::kOutsideWindow:
+        return {HandshakeStatus::kExpired, "authorization outside replay window"};
+    }
+  }
+  if (spend_tracker_ != nullptr &&
+      spend_tracker_->SpendInWindow(authorization.payer_account_id, now) +
+              InFlightSpend(authorization.payer_account_id) + authorization.amount_cents >
+          policy_.max_per_day_per_payer_cents) {
+    return {HandshakeStatus::kPolicyDenied, "daily limit exceeded"};
+  }
+  if (verify_peer_signatures_ && !VerifyAuthorization(authorization)) {
+    return {HandshakeStatus::kSignatureInvalid, "payer signature invalid"};
+  }
+  // The receipt id is drawn after the acceptance is persisted; refuse now.
+  if (!random_provider_->Ready()) {
+    return {HandshakeStatus::kRandomUnavailable, "random provider not seeded"};
+  }
 
-  tx.payer_account_id = authorization.payer_account_id;
-  tx.payer_device_id = authorization.payer_device_id;
-  tx.payer_authorization_id = authorization.payer_authorization_id;
-  tx.payer_nonce = authorization.payer_nonce;
-  tx.payer_counter = authorization.payer_counter;
-  tx.state = TransactionState::kPendingSync;
-  tx.updated_at_epoch_seconds = clock_provider_->NowUnixSeconds();
+  tx->payer_account_id = authorization.payer_account_id;
+  tx->payer_device_id = authorization.payer_device_id;
+  tx->payer_authorization_id = authorization.payer_authorization_id;
+  tx->payer_nonce = authorization.payer_nonce;
+  tx->payer_counter = authorization.payer_counter;
+  tx->authorized_at_epoch_seconds = authorization.authorized_at_epoch_seconds;
+  tx->payer_signature = authorization.payer_signature;
+  tx->state = TransactionState::kPendingSync;
+  tx->updated_at_epoch_seconds = now;
+  *now_out = now;
+  return {HandshakeStatus::kOk, "ok"};
+}
 
-  if (!journal_->Save(tx)) {
-    return {HandshakeStatus::kJournalFailure, "failed to persist merchant acceptance"};
+void OfflineEngine::RecordAcceptance(const PaymentAuthorization& authorization, std::uint64_t now) {
+  if (replay_filter_ != nullptr) {
+    replay_filter_->Record(authorization, now);
+  }
+  if (spend_tracker_ != nullptr) {
+    spend_tracker_->Add(authorization.payer_account_id, authorization.amount_cents, now, now);
   }
+}
 
-  PaymentReceipt receipt{};
-  receipt.tx_id = authorization.tx_id;
-  receipt.receipt_id = BuildKey("r-", random_provider_->NextHex(8));
-  receipt.merchant_account_id = merchant.account_id;
-  receipt.payer_account_id = authorization.payer_account_id;
-  receipt.amount_cents = authorization.amount_cents;
-  receipt.currency = authorization.currency;
-  receipt.status = TransactionState::kPendingSync;
-  receipt.created_at_epoch_seconds = clock_provider_->NowUnixSeconds();
+void OfflineEngine::BuildReceipt(const DeviceContext& merchant,
+                                 const PaymentAuthorization& authorization,
+                                 std::uint64_t now,
+                                 PaymentReceipt* receipt) {
+  receipt->tx_id = authorization.tx_id;
+  NextKey("r-", &receipt->receipt_id);
+  receipt->merchant_account_id = merchant.account_id;
+  receipt->payer_account_id = authorization.payer_account_id;
+  receipt->amount_cents = authorization.amount_cents;
+  receipt->currency = authorization.currency;
+  receipt->status = TransactionState::kPendingSync;
+  receipt->created_at_epoch_seconds = now;
+  receipt->chain_position = 0;
+}
 
-  std::ostringstream message;
-  message << receipt.tx_id << "|" << authorization.payer_authorization_id << "|pending_sync";
-  receipt.merchant_signature = signature_provider_->Sign(message.str(), merchant.signing_key_id);
+std::int64_t OfflineEngine::InFlightSpend(std::string_view payer_account_id) const {
+  std::int64_t cents = 0;
+  for (const HandshakeSession* session = in_flight_; session != nullptr; session = session->next_in_flight_) {
+    if (session->pending_spend_cents_ != 0 &&
+        std::string_view(session->authorization_.payer_account_id) == payer_account_id) {
+      cents += session->pending_spend_cents_;
+    }
+  }
+  return cents;
+}
 
-  *receipt_out = receipt;
-  *tx_out = tx;
-  return {HandshakeStatus::kOk, "ok"};
+bool OfflineEngine::AcceptanceInFlight(std::string_view tx_id) const {
+  for (const HandshakeSession* session = in_flight_; session != nullptr; session = session->next_in_flight_) {
+    if ((session->step_ == HandshakeSession::Step::kWriteAcceptance ||
+         session->step_ == HandshakeSession::Step::kSignReceipt) &&
+        std::string_view(session->authorization_.tx_id) == tx_id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void OfflineEngine::BeginSession(HandshakeSession* session) {
+  if (session->engine_ != nullptr) {
+    session->engine_->Unlink(session);
+  }
+  session->engine_ = this;
+  session->step_ = HandshakeSession::Step::kIdle;
+  session->wait_ = SessionWait::kNone;
+  session->now_ = 0;
+  session->pending_spend_cents_ = 0;
+  session->result_ = {};
+  // The models are overwritten by the Start* call, which may be reading its
+  // input from this session's previous outputs.
 }
 
-std::string OfflineEngine::BuildIntentSignatureMessage(const PaymentIntent& intent) const {
-  std::ostringstream stream;
-  stream << intent.tx_id << "|" << intent.merchant_intent_id << "|" << intent.amount_cents << "|"
-         << intent.currency << "|" << intent.merchant_nonce << "|" << intent.merchant_counter << "|"
-         << intent.expires_at_epoch_seconds;
-  return stream.str();
+void OfflineEngine::AwaitSignature(HandshakeSession* session,
+                                   HandshakeSession::Step step,
+                                   const std::pmr::string& key_id) {
+  Link(session);
+  session->key_id_.assign(key_id.data(), key_id.size());
+  session->step_ = step;
+  session->wait_ = SessionWait::kSignature;
+}
+
+void OfflineEngine::AwaitJournalWrite(HandshakeSession* session, HandshakeSession::Step step) {
+  Link(session);
+  session->step_ = step;
+  session->wait_ = SessionWait::kJournalWrite;
+}
+
+void OfflineEngine::ResumeAfterSignature(HandshakeSession* session) {
+  const std::string& signature = session->signature_;
+  switch (session->step_) {
+    case HandshakeSession::Step::kSignIntent:
+      session->intent_.merchant_signature.assign(signature.data(), signature.size());
+      BuildIntentRecord(session->device_, session->intent_, &session->tx_);
+      AwaitJournalWrite(session, HandshakeSession::Step::kWriteIntent);
+      return;
+    case HandshakeSession::Step::kSignAuthorization:
+      session->authorization_.payer_signature.assign(signature.data(), signature.size());
+      BuildAuthorizationRecord(session->intent_, session->authorization_, &session->tx_);
+      AwaitJournalWrite(session, HandshakeSession::Step::kWriteAuthorization);
+      return;
+    case HandshakeSession::Step::kSignReceipt:
+      session->receipt_.merchant_signature.assign(signature.data(), signature.size());
+      FinishSession(session, {HandshakeStatus::kOk, "ok"});
+      return;
+    default:
+      return;
+  }
 }
 
-std::string OfflineEngine::BuildAuthorizationSignatureMessage(
-    const PaymentAuthorization& authorization) const {
-  std::ostringstream stream;
-  stream << authorization.tx_id << "|" << authorization.merchant_intent_id << "|"
-         << authorization.amount_cents << "|" << authorization.currency << "|" << authorization.payer_nonce
-         << "|" << authorization.payer_counter << "|" << authorization.authorized_at_epoch_seconds;
-  return stream.str();
+void OfflineEngine::ResumeAfterJournalWrite(HandshakeSession* session, bool persisted) {
+  switch (session->step_) {
+    case HandshakeSession::Step::kWriteIntent:
+      if (!persisted) {
+        FinishSession(session, {HandshakeStatus::kJournalFailure, "failed to persist local transaction"});
+        return;
+      }
+      if (expiry_sweeper_ != nullptr) {
+        expiry_sweeper_->Track(session->intent_);
+      }
+      FinishSession(session, {HandshakeStatus::kOk, "ok"});
+      return;
+    case HandshakeSession::Step::kWriteAuthorization: {
+      if (!persisted) {
+        FinishSession(session, {HandshakeStatus::kJournalFailure, "failed to persist payer transaction"});
+        return;
+      }
+      session->pending_spend_cents_ = 0;
+      if (spend_tracker_ != nullptr) {
+        const auto now = session->authorization_.authorized_at_epoch_seconds;
+        spend_tracker_->Add(session->device_.account_id, session->intent_.amount_cents, now, now);
+      }
+      FinishSession(session, {HandshakeStatus::kOk, "ok"});
+      return;
+    }
+    case HandshakeSession::Step::kWriteAcceptance:
+      if (!persisted) {
+        FinishSession(session, {HandshakeStatus::kJournalFailure, "failed to persist merchant acceptance"});
+        return;
+      }
+      session->pending_spend_cents_ = 0;
+      RecordAcceptance(session->authorization_, session->now_);
+      BuildReceipt(session->device_, session->authorization_, session->now_, &session->receipt_);
+      if (receipt_chain_ != nullptr) {
+        AppendToReceiptChain(session->authorization_, &session->receipt_);
+        FinishSession(session, {HandshakeStatus::kOk, "ok"});
+        return;
+      }
+      {
+        MessageRecorder recorder(&session->message_);
+        WriteReceiptFields(session->receipt_, session->authorization_.payer_authorization_id, &recorder);
+      }
+      AwaitSignature(session, HandshakeSession::Step::kSignReceipt, session->device_.signing_key_id);
+      return;
+    default:
+      return;
+  }
+}
+
+void OfflineEngine::FinishSession(HandshakeSession* session, HandshakeResult result) {
+  Unlink(session);
+  session->step_ = HandshakeSession::Step::kDone;
+  session->wait_ = SessionWait::kNone;
+  session->pending_spend_cents_ = 0;
+  session->result_ = std::move(result);
+}
+
+void OfflineEngine::Link(HandshakeSession* session) {
+  if (session->in_flight_) {
+    return;
+  }
+  session->next_in_flight_ = in_flight_;
+  in_flight_ = session;
+  session->in_flight_ = true;
+}
+
+void OfflineEngine::Unlink(HandshakeSession* session) {
+  if (!session->in_flight_) {
+    return;
+  }
+  for (HandshakeSession** link = &in_flight_; *link != nullptr; link = &(*link)->next_in_flight_) {
+    if (*link == session) {
+      *link = session->next_in_flight_;
+      break;
+    }
+  }
+  session->next_in_flight_ = nullptr;
+  session->in_flight_ = false;
+}
+
+void OfflineEngine::NextKey(const char* prefix, std::pmr::string* key_out) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kRandom);
+  char hex[2 * kRandomIdBytes];
+  const std::size_t size = random_provider_->FillHex(kRandomIdBytes, hex);
+  key_out->assign(prefix);
+  key_out->append(hex, size);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kRandom, 0);
+}
+
+void OfflineEngine::SignIntent(const PaymentIntent& intent,
+                               const std::pmr::string& key_id,
+                               std::pmr::string* signature_out) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kSign);
+  StreamingSignatureProvider* signer = BeginSign(key_id);
+  WriteIntentFields(intent, signer);
+  FinishSign(signer, signature_out);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kSign, 0);
+}
+
+void OfflineEngine::SignAuthorization(const PaymentAuthorization& authorization,
+                                      const std::pmr::string& key_id,
+                                      std::pmr::string* signature_out) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kSign);
+  StreamingSignatureProvider* signer = BeginSign(key_id);
+  WriteAuthorizationFields(authorization, signer);
+  FinishSign(signer, signature_out);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kSign, 0);
+}
+
+void OfflineEngine::SignReceipt(const PaymentReceipt& receipt,
+                                const std::pmr::string& payer_authorization_id,
+                                const std::pmr::string& key_id,
+                                std::pmr::string* signature_out) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kSign);
+  StreamingSignatureProvider* signer = BeginSign(key_id);
+  WriteReceiptFields(receipt, payer_authorization_id, signer);
+  FinishSign(signer, signature_out);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kSign, 0);
+}
+
+bool OfflineEngine::SealReceiptCheckpoint(const DeviceContext& merchant) {
+  if (receipt_chain_ == nullptr || !receipt_chain_->CloseCheckpoint(&checkpoint_scratch_)) {
+    return false;
+  }
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kSign);
+  StreamingSignatureProvider* signer = BeginSign(merchant.signing_key_id);
+  WriteCheckpointFields(checkpoint_scratch_, signer);
+  signer->FinishSign(&signature_scratch_);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kSign, 0);
+  return receipt_chain_->SignCheckpoint(signature_scratch_);
+}
+
+bool OfflineEngine::VerifyIntent(const PaymentIntent& intent) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kVerify);
+  StreamingSignatureProvider* verifier = BeginVerify(intent.merchant_device_id);
+  WriteIntentFields(intent, verifier);
+  const bool valid = FinishVerify(verifier, intent.merchant_signature);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kVerify, !valid);
+  return valid;
+}
+
+bool OfflineEngine::VerifyAuthorization(const PaymentAuthorization& authorization) {
+  OFFLINE_WALLET_TRACE_BEGIN(trace_sink_, TraceStage::kVerify);
+  StreamingSignatureProvider* verifier = BeginVerify(authorization.payer_device_id);
+  WriteAuthorizationFields(authorization, verifier);
+  const bool valid = FinishVerify(verifier, authorization.payer_signature);
+  OFFLINE_WALLET_TRACE_END(trace_sink_, TraceStage::kVerify, !valid);
+  return valid;
+}
+
+void OfflineEngine::AppendToReceiptChain(const PaymentAuthorization& authorization, PaymentReceipt* receipt) {
+  receipt->merchant_signature.clear();
+  receipt->chain_position = receipt_chain_->Append(ReceiptLeaf(*receipt, authorization.payer_authorization_id),
+                                                   receipt->created_at_epoch_seconds);
+}
+
+StreamingSignatureProvider* OfflineEngine::BeginSign(const std::pmr::string& key_id) {
+  StreamingSignatureProvider* signer = Signer();
+  key_scratch_.assign(key_id.data(), key_id.size());
+  signer->BeginSign(key_scratch_);
+  return signer;
+}
+
+void OfflineEngine::FinishSign(StreamingSignatureProvider* signer, std::pmr::string* signature_out) {
+  signer->FinishSign(&signature_scratch_);
+  signature_out->assign(signature_scratch_.data(), signature_scratch_.size());
+}
+
+StreamingSignatureProvider* OfflineEngine::BeginVerify(const std::pmr::string& device_id) {
+  StreamingSignatureProvider* verifier = Signer();
+  key_scratch_.assign(device_id.data(), device_id.size());
+  verifier->BeginVerify(key_scratch_);
+  return verifier;
+}
+
+bool OfflineEngine::FinishVerify(StreamingSignatureProvider* verifier, const std::pmr::string& signature) {
+  signature_scratch_.assign(signature.data(), signature.size());
+  return verifier->FinishVerify(signature_scratch_);
+}
+
+StreamingSignatureProvider* OfflineEngine::Signer() {
+  return streaming_signer_ ? streaming_signer_ : &signature_bridge_;
+}
+
+std::pmr::memory_resource* OfflineEngine::ScratchResource() {
+  if (arena_ != nullptr) {
+    return arena_;
+  }
+  return std::pmr::get_default_resource();
+}
+
+void OfflineEngine::ResetArena() {
+  if (arena_ != nullptr) {
+    arena_->Reset();
+  }
 }
 
 }  // namespace offline_wallet
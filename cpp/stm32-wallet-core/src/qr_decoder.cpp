@@ -0,0 +1,825 @@
+#include "offline_wallet/qr_decoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "offline_wallet/gf256.hpp"
+#include "offline_wallet/wire_codec.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// Neighbourhoods whose range is below this are flat background rather than
+// modules; thresholding them at the midrange would only split the noise.
+constexpr int kMinBlockContrast = 24;
+// Block neighbourhood behind each threshold: (2r+1)^2 blocks.
+constexpr int kThresholdRadius = 2;
+// Format and version codes are accepted within this Hamming distance.
+constexpr int kMaxCodeDistance = 3;
+
+int BitDistance(std::uint32_t a, std::uint32_t b) {
+  int distance = 0;
+  for (std::uint32_t diff = a ^ b; diff != 0; diff &= diff - 1) {
+    ++distance;
+  }
+  return distance;
+}
+
+void SetModule(std::uint8_t* bitmap, std::size_t stride, int x, int y) {
+  bitmap[static_cast<std::size_t>(y) * stride + static_cast<std::size_t>(x) / 8] |=
+      static_cast<std::uint8_t>(0x80 >> (x % 8));
+}
+
+void MarkArea(std::uint8_t* bitmap, std::size_t stride, int x0, int y0, int width, int height) {
+  for (int y = y0; y < y0 + height; ++y) {
+    for (int x = x0; x < x0 + width; ++x) {
+      SetModule(bitmap, stride, x, y);
+    }
+  }
+}
+
+// Finder patterns with separators and format areas, timing, alignment
+// patterns, and version areas.
+void MarkFunctionModules(int version, std::uint8_t* bitmap) {
+  const int size = QrSymbolSize(version);
+  const std::size_t stride = QrBitmapStride(size);
+  std::memset(bitmap, 0, stride * static_cast<std::size_t>(size));
+  MarkArea(bitmap, stride, 0, 0, 9, 9);
+  MarkArea(bitmap, stride, size - 8, 0, 8, 9);
+  MarkArea(bitmap, stride, 0, size - 8, 9, 8);
+  MarkArea(bitmap, stride, 6, 0, 1, size);
+  MarkArea(bitmap, stride, 0, 6, size, 1);
+  int positions[kQrMaxAlignmentPositions];
+  const int count = QrAlignmentPositions(version, positions);
+  for (int i = 0; i < count; ++i) {
+    for (int j = 0; j < count; ++j) {
+      if (!((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0))) {
+        MarkArea(bitmap, stride, positions[i] - 2, positions[j] - 2, 5, 5);
+      }
+    }
+  }
+  if (version >= 7) {
+    MarkArea(bitmap, stride, size - 11, 0, 3, 6);
+    MarkArea(bitmap, stride, 0, size - 11, 6, 3);
+  }
+}
+
+// 1:1:3:1:1 within half a module per run (1.5 for the centre).
+bool FinderRatio(const int* runs) {
+  int total = 0;
+  for (int i = 0; i < 5; ++i) {
+    if (runs[i] == 0) {
+      return false;
+    }
+    total += runs[i];
+  }
+  if (total < 7) {
+    return false;
+  }
+  const float module = static_cast<float>(total) / 7.0f;
+  const float variance = module / 2.0f;
+  return std::fabs(module - static_cast<float>(runs[0])) < variance &&
+         std::fabs(module - static_cast<float>(runs[1])) < variance &&
+         std::fabs(3.0f * module - static_cast<float>(runs[2])) < 3.0f * variance &&
+         std::fabs(module - static_cast<float>(runs[3])) < variance &&
+         std::fabs(module - static_cast<float>(runs[4])) < variance;
+}
+
+float CentreFromEnd(const int* runs, int end) {
+  return static_cast<float>(end - runs[4] - runs[3]) - static_cast<float>(runs[2]) / 2.0f;
+}
+
+float Distance(float ax, float ay, float bx, float by) {
+  return std::sqrt((ax - bx) * (ax - bx) + (ay - by) * (ay - by));
+}
+
+// Row-major 3x3 homography: (x, y, w) = H (u, v, 1).
+using Homography = std::array<float, 9>;
+
+// Maps the unit square corners (0,0), (1,0), (1,1), (0,1) onto the
+// quadrilateral (x[i], y[i]); false when it is degenerate.
+bool SquareToQuad(const float* x, const float* y, Homography* out) {
+  const float dx1 = x[1] - x[2];
+  const float dx2 = x[3] - x[2];
+  const float dx3 = x[0] - x[1] + x[2] - x[3];
+  const float dy1 = y[1] - y[2];
+  const float dy2 = y[3] - y[2];
+  const float dy3 = y[0] - y[1] + y[2] - y[3];
+  const float denominator = dx1 * dy2 - dx2 * dy1;
+  if (std::fabs(denominator) < 1e-6f) {
+    return false;
+  }
+  const float g = (dx3 * dy2 - dx2 * dy3) / denominator;
+  const float h = (dx1 * dy3 - dx3 * dy1) / denominator;
+  *out = {x[1] - x[0] + g * x[1], x[3] - x[0] + h * x[3], x[0],
+          y[1] - y[0] + g * y[1], y[3] - y[0] + h * y[3], y[0],
+          g,                      h,                      1.0f};
+  return true;
+}
+
+// Adjugate: the inverse up to scale, which a homography does not care about.
+Homography Adjugate(const Homography& m) {
+  return {m[4] * m[8] - m[5] * m[7], m[2] * m[7] - m[1] * m[8], m[1] * m[5] - m[2] * m[4],
+          m[5] * m[6] - m[3] * m[8], m[0] * m[8] - m[2] * m[6], m[2] * m[3] - m[0] * m[5],
+          m[3] * m[7] - m[4] * m[6], m[1] * m[6] - m[0] * m[7], m[0] * m[4] - m[1] * m[3]};
+}
+
+Homography Multiply(const Homography& a, const Homography& b) {
+  Homography product{};
+  for (int row = 0; row < 3; ++row) {
+    for (int column = 0; column < 3; ++column) {
+      for (int k = 0; k < 3; ++k) {
+        product[row * 3 + column] += a[row * 3 + k] * b[k * 3 + column];
+      }
+    }
+  }
+  return product;
+}
+
+// Alignment runs are one module each, give or take binarization jitter.
+bool AlignmentRun(int run, float module_size) {
+  return std::fabs(static_cast<float>(run) - module_size) < module_size / 2.0f + 1.0f;
+}
+
+}  // namespace
+
+QrDecoder::QrDecoder(const QrDecoderOptions& options)
+    : options_(options),
+      binary_(static_cast<std::size_t>(options.max_width) * static_cast<std::size_t>(options.max_height)),
+      block_min_(static_cast<std::size_t>((options.max_width + kBlockSize - 1) / kBlockSize) *
+                 static_cast<std::size_t>((options.max_height + kBlockSize - 1) / kBlockSize)),
+      block_max_(block_min_.size()),
+      column_min_(static_cast<std::size_t>(options.max_width)),
+      column_max_(static_cast<std::size_t>(options.max_width)),
+      row_threshold_(static_cast<std::size_t>(options.max_width)),
+      grid_(kQrMaxBitmapBytes),
+      function_(kQrMaxBitmapBytes),
+      codewords_(kQrMaxCodewords),
+      payload_(kQrMaxCodewords) {}
+
+QrDecodeStatus QrDecoder::Decode(const QrFrame& frame,
+                                 std::uint8_t* payload,
+                                 std::size_t capacity,
+                                 std::size_t* size_out,
+                                 QrDecodeInfo* info_out) {
+  if (frame.pixels == nullptr || frame.width < QrSymbolSize(kQrMinVersion) ||
+      frame.height < QrSymbolSize(kQrMinVersion) || frame.stride < static_cast<std::size_t>(frame.width) ||
+      (payload == nullptr && capacity > 0) || size_out == nullptr) {
+    return QrDecodeStatus::kInvalidArgument;
+  }
+  if (frame.width > options_.max_width || frame.height > options_.max_height) {
+    return QrDecodeStatus::kFrameTooLarge;
+  }
+  Binarize(frame);
+
+  QrDecodeInfo info;
+  QrDecodeStatus status = QrDecodeStatus::kNotFound;
+  for (int step = std::max(1, options_.row_step);; step /= 2) {
+    FindFinders(step);
+    Point top_left;
+    Point top_right;
+    Point bottom_left;
+    float module_size = 0;
+    if (SelectFinders(&top_left, &top_right, &bottom_left, &module_size)) {
+      // Finder centres sit 3.5 modules in from the edges: size - 7 modules apart.
+      const float span = (Distance(top_left.x, top_left.y, top_right.x, top_right.y) +
+                          Distance(top_left.x, top_left.y, bottom_left.x, bottom_left.y)) /
+                         (2.0f * module_size);
+      const int estimate = static_cast<int>(std::lround((span + 7.0f - 17.0f) / 4.0f));
+      for (int version : {estimate, estimate - 1, estimate + 1}) {
+        if (version < kQrMinVersion || version > kQrMaxVersion ||
+            !SampleGrid(top_left, top_right, bottom_left, version)) {
+          continue;
+        }
+        if (version >= 7) {
+          const int read = ReadVersion(QrSymbolSize(version));
+          if (read != 0 && read != version) {
+            version = read;
+            if (!SampleGrid(top_left, top_right, bottom_left, version)) {
+              continue;
+            }
+          }
+        }
+        status = ReadSymbol(version, payload, capacity, size_out, &info);
+        if (status == QrDecodeStatus::kOk || status == QrDecodeStatus::kBufferTooSmall ||
+            status == QrDecodeStatus::kUnsupportedMode) {
+          if (info_out != nullptr) {
+            *info_out = info;
+          }
+          return status;
+        }
+      }
+    }
+    if (step == 1) {
+      break;
+    }
+  }
+  return status;
+}
+
+QrDecodeStatus QrDecoder::DecodeAuthorization(const QrFrame& frame,
+                                              PaymentAuthorization* authorization_out,
+                                              QrDecodeInfo* info_out) {
+  std::size_t size = 0;
+  const QrDecodeStatus status = Decode(frame, payload_.data(), payload_.size(), &size, info_out);
+  if (status != QrDecodeStatus::kOk) {
+    return status;
+  }
+  return offline_wallet::DecodeAuthorization(payload_.data(), size, authorization_out) == WireStatus::kOk
+             ? QrDecodeStatus::kOk
+             : QrDecodeStatus::kWrongPayload;
+}
+
+QrDecodeStatus QrDecoder::DecodeAuthorization(const QrFrame& frame,
+                                              FixedPaymentAuthorization* authorization_out,
+                                              QrDecodeInfo* info_out) {
+  std::size_t size = 0;
+  const QrDecodeStatus status = Decode(frame, payload_.data(), payload_.size(), &size, info_out);
+  if (status != QrDecodeStatus::kOk) {
+    return status;
+  }
+  return offline_wallet::DecodeAuthorization(payload_.data(), size, authorization_out) == WireStatus::kOk
+             ? QrDecodeStatus::kOk
+             : QrDecodeStatus::kWrongPayload;
+}
+
+void QrDecoder::Binarize(const QrFrame& frame) {
+  width_ = frame.width;
+  height_ = frame.height;
+  const int blocks_wide = (width_ + kBlockSize - 1) / kBlockSize;
+  const int blocks_high = (height_ + kBlockSize - 1) / kBlockSize;
+  const std::size_t width = static_cast<std::size_t>(width_);
+  std::uint8_t* minimum = column_min_.data();
+  std::uint8_t* maximum = column_max_.data();
+
+  // Per-block range, reduced a block row at a time column-wise. Edge blocks
+  // are shifted inwards so every block covers 8x8 pixels.
+  for (int by = 0; by < blocks_high; ++by) {
+    const int y0 = std::min(by * kBlockSize, height_ - kBlockSize);
+    std::fill(minimum, minimum + width, std::uint8_t{255});
+    std::fill(maximum, maximum + width, std::uint8_t{0});
+    for (int row = 0; row < kBlockSize; ++row) {
+      const std::uint8_t* pixels = frame.pixels + static_cast<std::size_t>(y0 + row) * frame.stride;
+      for (std::size_t x = 0; x < width; ++x) {
+        minimum[x] = std::min(minimum[x], pixels[x]);
+        maximum[x] = std::max(maximum[x], pixels[x]);
+      }
+    }
+    const std::size_t offset = static_cast<std::size_t>(by) * blocks_wide;
+    for (int bx = 0; bx < blocks_wide; ++bx) {
+      const int x0 = std::min(bx * kBlockSize, width_ - kBlockSize);
+      block_min_[offset + bx] = *std::min_element(minimum + x0, minimum + x0 + kBlockSize);
+      block_max_[offset + bx] = *std::max_element(maximum + x0, maximum + x0 + kBlockSize);
+    }
+  }
+
+  // Threshold each pixel at the midrange of the surrounding 5x5 blocks. A
+  // blurred edge crosses the midrange where the sharp edge was, whatever the
+  // mix of light and dark around it, so module widths survive defocus.
+  for (int by = 0; by < blocks_high; ++by) {
+    const int top = std::max(0, by - kThresholdRadius);
+    const int bottom = std::min(blocks_high - 1, by + kThresholdRadius);
+    for (int bx = 0; bx < blocks_wide; ++bx) {
+      const int left = std::max(0, bx - kThresholdRadius);
+      const int right = std::min(blocks_wide - 1, bx + kThresholdRadius);
+      int low = 255;
+      int high = 0;
+      for (int y = top; y <= bottom; ++y) {
+        const std::size_t offset = static_cast<std::size_t>(y) * blocks_wide;
+        for (int x = left; x <= right; ++x) {
+          low = std::min<int>(low, block_min_[offset + x]);
+          high = std::max<int>(high, block_max_[offset + x]);
+        }
+      }
+      // Flat neighbourhood: paper or screen background, keep it light.
+      const int threshold = high - low <= kMinBlockContrast ? low / 2 : (low + high) / 2;
+      const int x_end = std::min(width_, (bx + 1) * kBlockSize);
+      std::fill(row_threshold_.begin() + bx * kBlockSize, row_threshold_.begin() + x_end,
+                static_cast<std::uint8_t>(threshold));
+    }
+    const int y_end = std::min(height_, (by + 1) * kBlockSize);
+    const std::uint8_t* thresholds = row_threshold_.data();
+    for (int y = by * kBlockSize; y < y_end; ++y) {
+      const std::uint8_t* pixels = frame.pixels + static_cast<std::size_t>(y) * frame.stride;
+      std::uint8_t* out = binary_.data() + static_cast<std::size_t>(y) * width;
+      for (std::size_t x = 0; x < width; ++x) {
+        out[x] = static_cast<std::uint8_t>(pixels[x] <= thresholds[x]);
+      }
+    }
+  }
+}
+
+void QrDecoder::FindFinders(int row_step) {
+  finder_count_ = 0;
+  for (int y = row_step / 2; y < height_; y += row_step) {
+    int runs[5] = {0, 0, 0, 0, 0};
+    int state = 0;
+    for (int x = 0; x < width_; ++x) {
+      if (Dark(x, y)) {
+        if (state & 1) {
+          ++state;
+        }
+        ++runs[state];
+      } else if (state & 1) {
+        ++runs[state];
+      } else if (state < 4) {
+        ++runs[++state];
+      } else if (FinderRatio(runs) && CheckFinder(runs, x, y)) {
+        std::fill(runs, runs + 5, 0);
+        state = 0;
+      } else {
+        runs[0] = runs[2];
+        runs[1] = runs[3];
+        runs[2] = runs[4];
+        runs[3] = 1;
+        runs[4] = 0;
+        state = 3;
+      }
+    }
+    if (state == 4 && FinderRatio(runs)) {
+      CheckFinder(runs, width_, y);
+    }
+  }
+}
+
+bool QrDecoder::CheckFinder(const int* runs, int x_end, int y) {
+  const int total = runs[0] + runs[1] + runs[2] + runs[3] + runs[4];
+  float centre_x = CentreFromEnd(runs, x_end);
+  const float centre_y = CrossCheckVertical(static_cast<int>(centre_x), y, runs[2], total);
+  if (centre_y < 0) {
+    return false;
+  }
+  centre_x = CrossCheckHorizontal(static_cast<int>(centre_x), static_cast<int>(centre_y), runs[2], total);
+  if (centre_x < 0) {
+    return false;
+  }
+  const float module_size = static_cast<float>(total) / 7.0f;
+  for (int i = 0; i < finder_count_; ++i) {
+    Finder& finder = finders_[i];
+    if (std::fabs(finder.centre.x - centre_x) <= module_size &&
+        std::fabs(finder.centre.y - centre_y) <= module_size &&
+        std::fabs(finder.module_size - module_size) <= std::max(1.0f, finder.module_size)) {
+      const float weight = static_cast<float>(finder.hits);
+      finder.centre.x = (finder.centre.x * weight + centre_x) / (weight + 1);
+      finder.centre.y = (finder.centre.y * weight + centre_y) / (weight + 1);
+      finder.module_size = (finder.module_size * weight + module_size) / (weight + 1);
+      ++finder.hits;
+      return true;
+    }
+  }
+  if (finder_count_ < kMaxFinders) {
+    finders_[finder_count_++] = Finder{Point{centre_x, centre_y}, module_size, 1};
+  }
+  return true;
+}
+
+float QrDecoder::CrossCheckVertical(int x, int y, int max_run, int total) const {
+  int runs[5] = {0, 0, 0, 0, 0};
+  int i = y;
+  for (; i >= 0 && Dark(x, i); --i) {
+    ++runs[2];
+  }
+  for (; i >= 0 && !Dark(x, i) && runs[1] <= max_run; --i) {
+    ++runs[1];
+  }
+  for (; i >= 0 && Dark(x, i) && runs[0] <= max_run; --i) {
+    ++runs[0];
+  }
+  if (i < 0 && runs[0] == 0) {
+    return -1;
+  }
+  for (i = y + 1; i < height_ && Dark(x, i); ++i) {
+    ++runs[2];
+  }
+  for (; i < height_ && !Dark(x, i) && runs[3] <= max_run; ++i) {
+    ++runs[3];
+  }
+  for (; i < height_ && Dark(x, i) && runs[4] <= max_run; ++i) {
+    ++runs[4];
+  }
+  const int cross_total = runs[0] + runs[1] + runs[2] + runs[3] + runs[4];
+  if (5 * std::abs(cross_total - total) >= 2 * total || !FinderRatio(runs)) {
+    return -1;
+  }
+  return CentreFromEnd(runs, i);
+}
+
+float QrDecoder::CrossCheckHorizontal(int x, int y, int max_run, int total) const {
+  int runs[5] = {0, 0, 0, 0, 0};
+  int i = x;
+  for (; i >= 0 && Dark(i, y); --i) {
+    ++runs[2];
+  }
+  for (; i >= 0 && !Dark(i, y) && runs[1] <= max_run; --i) {
+    ++runs[1];
+  }
+  for (; i >= 0 && Dark(i, y) && runs[0] <= max_run; --i) {
+    ++runs[0];
+  }
+  if (i < 0 && runs[0] == 0) {
+    return -1;
+  }
+  for (i = x + 1; i < width_ && Dark(i, y); ++i) {
+    ++runs[2];
+  }
+  for (; i < width_ && !Dark(i, y) && runs[3] <= max_run; ++i) {
+    ++runs[3];
+  }
+  for (; i < width_ && Dark(i, y) && runs[4] <= max_run; ++i) {
+    ++runs[4];
+  }
+  const int cross_total = runs[0] + runs[1] + runs[2] + runs[3] + runs[4];
+  if (5 * std::abs(cross_total - total) >= total || !FinderRatio(runs)) {
+    return -1;
+  }
+  return CentreFromEnd(runs, i);
+}
+
+// Picks the three candidates closest to an isosceles right triangle with
+// matching module sizes and sorts them by corner.
+bool QrDecoder::SelectFinders(Point* top_left,
+                              Point* top_right,
+                              Point* bottom_left,
+                              float* module_size) const {
+  float best_score = 0.25f;
+  int best[3] = {-1, -1, -1};
+  for (int a = 0; a < finder_count_; ++a) {
+    for (int b = a + 1; b < finder_count_; ++b) {
+      for (int c = b + 1; c < finder_count_; ++c) {
+        const Finder* f[3] = {&finders_[a], &finders_[b], &finders_[c]};
+        const float smallest = std::min({f[0]->module_size, f[1]->module_size, f[2]->module_size});
+        const float largest = std::max({f[0]->module_size, f[1]->module_size, f[2]->module_size});
+        if (largest > 1.4f * smallest) {
+          continue;
+        }
+        // Squared side lengths opposite each vertex.
+        float sides[3];
+        for (int i = 0; i < 3; ++i) {
+          const Point& p = f[(i + 1) % 3]->centre;
+          const Point& q = f[(i + 2) % 3]->centre;
+          sides[i] = (p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y);
+        }
+        const int corner = sides[0] >= sides[1] && sides[0] >= sides[2] ? 0 : sides[1] >= sides[2] ? 1 : 2;
+        const float leg1 = sides[(corner + 1) % 3];
+        const float leg2 = sides[(corner + 2) % 3];
+        const float mean_module = (smallest + largest) / 2.0f;
+        // Version 1 spans 14 modules; axis-measured sizes read up to sqrt(2)
+        // large on rotated symbols.
+        const float min_leg = 14.0f * mean_module * 0.55f;
+        if (leg1 < min_leg * min_leg || leg2 < min_leg * min_leg) {
+          continue;
+        }
+        const float score = std::fabs(leg1 - leg2) / std::max(leg1, leg2) +
+                            std::fabs(sides[corner] - leg1 - leg2) / sides[corner];
+        if (score < best_score) {
+          best_score = score;
+          best[0] = corner == 0 ? a : corner == 1 ? b : c;
+          best[1] = corner == 0 ? b : a;
+          best[2] = corner == 2 ? b : c;
+        }
+      }
+    }
+  }
+  if (best[0] < 0) {
+    return false;
+  }
+  const Finder& corner = finders_[best[0]];
+  const Finder* first = &finders_[best[1]];
+  const Finder* second = &finders_[best[2]];
+  // With y pointing down, (top_right - top_left) x (bottom_left - top_left) > 0.
+  const float cross = (first->centre.x - corner.centre.x) * (second->centre.y - corner.centre.y) -
+                      (first->centre.y - corner.centre.y) * (second->centre.x - corner.centre.x);
+  if (cross < 0) {
+    std::swap(first, second);
+  }
+  *top_left = corner.centre;
+  *top_right = first->centre;
+  *bottom_left = second->centre;
+  // Finder runs are measured along the pixel axes, which stretches them by
+  // 1 / max(|cos|, |sin|) of the symbol's rotation.
+  const float dx = first->centre.x - corner.centre.x;
+  const float dy = first->centre.y - corner.centre.y;
+  const float axis_scale = std::max(std::fabs(dx), std::fabs(dy)) / std::sqrt(dx * dx + dy * dy);
+  *module_size = axis_scale * (corner.module_size + first->module_size + second->module_size) / 3.0f;
+  return true;
+}
+
+// Looks for the 1:1:1:1:1 dark/light rings of an alignment pattern within a
+// few modules of `estimate`, keeping the candidate closest to it.
+bool QrDecoder::FindAlignment(const Point& estimate, float module_size, Point* centre) const {
+  const int radius = static_cast<int>(std::ceil(4.0f * module_size));
+  const int x0 = std::max(1, static_cast<int>(estimate.x) - radius);
+  const int x1 = std::min(width_ - 1, static_cast<int>(estimate.x) + radius);
+  const int y0 = std::max(1, static_cast<int>(estimate.y) - radius);
+  const int y1 = std::min(height_ - 1, static_cast<int>(estimate.y) + radius);
+  float best_distance = static_cast<float>(radius);
+  bool found = false;
+  for (int y = y0; y < y1; ++y) {
+    for (int x = x0; x < x1; ++x) {
+      if (!Dark(x, y) || Dark(x - 1, y)) {
+        continue;
+      }
+      int run = 1;
+      while (x + run < x1 && Dark(x + run, y)) {
+        ++run;
+      }
+      if (!AlignmentRun(run, module_size)) {
+        continue;
+      }
+      float cx = CrossCheckAlignment(x + run / 2, y, 1, 0, module_size);
+      if (cx < 0) {
+        continue;
+      }
+      const float cy = CrossCheckAlignment(static_cast<int>(cx), y, 0, 1, module_size);
+      if (cy < 0) {
+        continue;
+      }
+      cx = CrossCheckAlignment(static_cast<int>(cx), static_cast<int>(cy), 1, 0, module_size);
+      if (cx < 0) {
+        continue;
+      }
+      const float distance = Distance(cx, cy, estimate.x, estimate.y);
+      if (distance < best_distance) {
+        best_distance = distance;
+        *centre = Point{cx, cy};
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+// Measures the five runs through (x, y) along (dx, dy); returns the centre
+// coordinate along that axis, or -1.
+float QrDecoder::CrossCheckAlignment(int x, int y, int dx, int dy, float module_size) const {
+  const int limit = static_cast<int>(2.0f * module_size) + 2;
+  auto inside = [&](int i) {
+    const int px = x + i * dx;
+    const int py = y + i * dy;
+    return px >= 0 && py >= 0 && px < width_ && py < height_;
+  };
+  auto dark = [&](int i) { return Dark(x + i * dx, y + i * dy); };
+  if (!dark(0)) {
+    return -1;
+  }
+  int runs[5] = {0, 0, 0, 0, 0};
+  int i = 0;
+  for (; inside(i) && dark(i) && runs[2] <= limit; --i) {
+    ++runs[2];
+  }
+  for (; inside(i) && !dark(i) && runs[1] <= limit; --i) {
+    ++runs[1];
+  }
+  for (; inside(i) && dark(i) && runs[0] <= limit; --i) {
+    ++runs[0];
+  }
+  const int start = i + runs[0] + runs[1] + 1;
+  for (i = 1; inside(i) && dark(i) && runs[2] <= limit; ++i) {
+    ++runs[2];
+  }
+  for (; inside(i) && !dark(i) && runs[3] <= limit; ++i) {
+    ++runs[3];
+  }
+  for (; inside(i) && dark(i) && runs[4] <= limit; ++i) {
+    ++runs[4];
+  }
+  // The outer ring only has to be there; it merges with neighbouring data.
+  if (runs[0] == 0 || runs[4] == 0 || !AlignmentRun(runs[1], module_size) ||
+      !AlignmentRun(runs[2], module_size) || !AlignmentRun(runs[3], module_size)) {
+    return -1;
+  }
+  const float origin = static_cast<float>(dx != 0 ? x : y);
+  return origin + static_cast<float>(start) + static_cast<float>(runs[2]) / 2.0f;
+}
+
+bool QrDecoder::SampleGrid(const Point& top_left,
+                           const Point& top_right,
+                           const Point& bottom_left,
+                           int version) {
+  const int size = QrSymbolSize(version);
+  const std::size_t stride = QrBitmapStride(size);
+  const float span = static_cast<float>(size - 7);
+  const float far = static_cast<float>(size) - 3.5f;
+
+  // Module space to image: finder centres sit at (3.5, 3.5) and 3.5 in from
+  // the other corners. From version 2 the bottom-right alignment centre,
+  // (size - 6.5, size - 6.5), pins the fourth corner and absorbs perspective
+  // and the drift of extrapolating three finder centres; without it the map
+  // is the affine parallelogram.
+  Point corner{top_right.x + bottom_left.x - top_left.x, top_right.y + bottom_left.y - top_left.y};
+  float corner_module = far;
+  if (version >= 2) {
+    // Alignment runs are measured along the pixel axes, like finder runs.
+    const float ux = (top_right.x - top_left.x) / span;
+    const float uy = (top_right.y - top_left.y) / span;
+    const float module_size = (ux * ux + uy * uy) / std::max(std::fabs(ux), std::fabs(uy));
+    const float vx = (bottom_left.x - top_left.x) / span;
+    const float vy = (bottom_left.y - top_left.y) / span;
+    const Point estimate{corner.x - 3.0f * (ux + vx), corner.y - 3.0f * (uy + vy)};
+    if (FindAlignment(estimate, module_size, &corner)) {
+      corner_module = static_cast<float>(size) - 6.5f;
+    }
+  }
+  const float module_x[4] = {3.5f, far, corner_module, 3.5f};
+  const float module_y[4] = {3.5f, 3.5f, corner_module, far};
+  const float image_x[4] = {top_left.x, top_right.x, corner.x, bottom_left.x};
+  const float image_y[4] = {top_left.y, top_right.y, corner.y, bottom_left.y};
+  Homography to_square;
+  Homography to_image;
+  if (!SquareToQuad(module_x, module_y, &to_square) || !SquareToQuad(image_x, image_y, &to_image)) {
+    return false;
+  }
+  const Homography h = Multiply(to_image, Adjugate(to_square));
+
+  std::memset(grid_.data(), 0, stride * static_cast<std::size_t>(size));
+  for (int y = 0; y < size; ++y) {
+    // Homogeneous coordinates are linear along a row: step by column 0.
+    const float v = static_cast<float>(y) + 0.5f;
+    float x_h = 0.5f * h[0] + v * h[1] + h[2];
+    float y_h = 0.5f * h[3] + v * h[4] + h[5];
+    float w_h = 0.5f * h[6] + v * h[7] + h[8];
+    std::uint8_t* row = grid_.data() + static_cast<std::size_t>(y) * stride;
+    for (int x = 0; x < size; ++x, x_h += h[0], y_h += h[3], w_h += h[6]) {
+      if (w_h <= 0) {
+        return false;
+      }
+      const int ix = static_cast<int>(std::floor(x_h / w_h));
+      const int iy = static_cast<int>(std::floor(y_h / w_h));
+      if (ix < 0 || iy < 0 || ix >= width_ || iy >= height_) {
+        return false;
+      }
+      row[x / 8] |= static_cast<std::uint8_t>(Dark(ix, iy) << (7 - x % 8));
+    }
+  }
+  return true;
+}
+
+// Version information from whichever copy is closer to a valid code; 0 when
+// neither is.
+int QrDecoder::ReadVersion(int size) const {
+  const std::size_t stride = QrBitmapStride(size);
+  std::uint32_t top_right = 0;
+  std::uint32_t bottom_left = 0;
+  for (int i = 0; i < 18; ++i) {
+    const int along = size - 11 + i % 3;
+    top_right |= static_cast<std::uint32_t>(QrBitmapModule(grid_.data(), stride, along, i / 3)) << i;
+    bottom_left |= static_cast<std::uint32_t>(QrBitmapModule(grid_.data(), stride, i / 3, along)) << i;
+  }
+  int best = 0;
+  int best_distance = kMaxCodeDistance + 1;
+  for (int version = 7; version <= kQrMaxVersion; ++version) {
+    const std::uint32_t code = QrVersionBits(version);
+    const int distance = std::min(BitDistance(code, top_right), BitDistance(code, bottom_left));
+    if (distance < best_distance) {
+      best = version;
+      best_distance = distance;
+    }
+  }
+  return best;
+}
+
+QrDecodeStatus QrDecoder::ReadSymbol(int version,
+                                     std::uint8_t* payload,
+                                     std::size_t capacity,
+                                     std::size_t* size_out,
+                                     QrDecodeInfo* info) {
+  const int size = QrSymbolSize(version);
+  const std::size_t stride = QrBitmapStride(size);
+  const std::uint8_t* grid = grid_.data();
+
+  // Format information: nearest valid code over both copies.
+  std::uint32_t first = 0;
+  std::uint32_t second = 0;
+  static constexpr int kFirstCopy[15][2] = {{8, 0}, {8, 1}, {8, 2}, {8, 3}, {8, 4}, {8, 5}, {8, 7}, {8, 8},
+                                            {7, 8}, {5, 8}, {4, 8}, {3, 8}, {2, 8}, {1, 8}, {0, 8}};
+  for (int i = 0; i < 15; ++i) {
+    const bool copy1 = QrBitmapModule(grid, stride, kFirstCopy[i][0], kFirstCopy[i][1]);
+    const bool copy2 = i < 8 ? QrBitmapModule(grid, stride, size - 1 - i, 8)
+                             : QrBitmapModule(grid, stride, 8, size - 15 + i);
+    first |= static_cast<std::uint32_t>(copy1) << i;
+    second |= static_cast<std::uint32_t>(copy2) << i;
+  }
+  int best_distance = kMaxCodeDistance + 1;
+  for (QrEcc ecc : {QrEcc::kLow, QrEcc::kMedium, QrEcc::kQuartile, QrEcc::kHigh}) {
+    for (int mask = 0; mask < kQrMaskCount; ++mask) {
+      const std::uint32_t code = QrFormatBits(ecc, mask);
+      const int distance = std::min(BitDistance(code, first), BitDistance(code, second));
+      if (distance < best_distance) {
+        best_distance = distance;
+        info->ecc = ecc;
+        info->mask = mask;
+      }
+    }
+  }
+  if (best_distance > kMaxCodeDistance) {
+    return QrDecodeStatus::kFormatUnreadable;
+  }
+  info->version = version;
+  info->corrected_bytes = 0;
+
+  if (function_version_ != version) {
+    MarkFunctionModules(version, function_.data());
+    function_version_ = version;
+  }
+
+  // Zigzag read, unmasking, and de-interleaving straight into per-block
+  // [data | parity] runs.
+  const QrBlockLayout layout = QrLayout(version, info->ecc);
+  const std::size_t block_length = layout.short_block_data + layout.ecc_per_block;
+  const std::size_t short_data_total = layout.short_block_data * layout.blocks;
+  auto block_start = [&](std::size_t block) {
+    return block * block_length + (block > layout.short_blocks ? block - layout.short_blocks : 0);
+  };
+  auto destination = [&](std::size_t k) {
+    if (k < short_data_total) {
+      return block_start(k % layout.blocks) + k / layout.blocks;
+    }
+    if (k < layout.data_codewords) {
+      return block_start(layout.short_blocks + k - short_data_total) + layout.short_block_data;
+    }
+    const std::size_t parity = k - layout.data_codewords;
+    const std::size_t block = parity % layout.blocks;
+    const std::size_t data_length = layout.short_block_data + (block < layout.short_blocks ? 0 : 1);
+    return block_start(block) + data_length + parity / layout.blocks;
+  };
+  std::uint8_t* codewords = codewords_.data();
+  const std::size_t total_bits = layout.total_codewords * 8;
+  std::size_t bit = 0;
+  std::uint32_t current = 0;
+  for (int right = size - 1; right >= 1 && bit < total_bits; right -= 2) {
+    if (right == 6) {
+      right = 5;
+    }
+    const bool upward = ((right + 1) & 2) == 0;
+    for (int vertical = 0; vertical < size && bit < total_bits; ++vertical) {
+      const int y = upward ? size - 1 - vertical : vertical;
+      for (int x = right; x >= right - 1 && bit < total_bits; --x) {
+        if (QrBitmapModule(function_.data(), stride, x, y)) {
+          continue;
+        }
+        const bool dark = QrBitmapModule(grid, stride, x, y) != QrMaskBit(info->mask, x, y);
+        current = (current << 1) | (dark ? 1u : 0u);
+        if (++bit % 8 == 0) {
+          codewords[destination(bit / 8 - 1)] = static_cast<std::uint8_t>(current);
+          current = 0;
+        }
+      }
+    }
+  }
+
+  // Correct each block, then pack the data bytes together at the front.
+  std::size_t data_size = 0;
+  for (std::size_t block = 0; block < layout.blocks; ++block) {
+    const std::size_t data_length = layout.short_block_data + (block < layout.short_blocks ? 0 : 1);
+    std::uint8_t* start = codewords + block_start(block);
+    std::size_t corrected = 0;
+    if (!ReedSolomonCorrect(start, data_length + layout.ecc_per_block, layout.ecc_per_block, &corrected)) {
+      return QrDecodeStatus::kUncorrectable;
+    }
+    info->corrected_bytes += corrected;
+    std::memmove(codewords + data_size, start, data_length);
+    data_size += data_length;
+  }
+
+  // Byte-mode segments up to the terminator or the end of the data.
+  const std::size_t data_bits = data_size * 8;
+  std::size_t position = 0;
+  auto read_bits = [&](int count) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < count; ++i, ++position) {
+      value = (value << 1) | ((codewords[position / 8] >> (7 - position % 8)) & 1u);
+    }
+    return value;
+  };
+  std::size_t written = 0;
+  while (position + 4 <= data_bits) {
+    const std::uint32_t mode = read_bits(4);
+    if (mode == 0) {
+      break;
+    }
+    if (mode != 0x4) {
+      return QrDecodeStatus::kUnsupportedMode;
+    }
+    const int count_bits = version < 10 ? 8 : 16;
+    if (position + static_cast<std::size_t>(count_bits) > data_bits) {
+      return QrDecodeStatus::kUncorrectable;
+    }
+    const std::size_t count = read_bits(count_bits);
+    if (position + count * 8 > data_bits) {
+      return QrDecodeStatus::kUncorrectable;
+    }
+    if (written + count > capacity) {
+      return QrDecodeStatus::kBufferTooSmall;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      payload[written++] = static_cast<std::uint8_t>(read_bits(8));
+    }
+  }
+  *size_out = written;
+  return QrDecodeStatus::kOk;
+}
+
+}  // namespace offline_wallet
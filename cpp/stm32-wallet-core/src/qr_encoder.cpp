@@ -0,0 +1,495 @@
+#include "offline_wallet/qr_encoder.hpp"
+
+#include <array>
+
+#include "offline_wallet/gf256.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+constexpr int kWords = 3;
+constexpr int kMaskRowPeriod = 12;  // lcm of the row periods of all eight masks
+
+using Row = std::array<std::uint64_t, kWords>;
+using MaskRowTable = std::array<std::array<Row, kMaskRowPeriod>, kQrMaskCount>;
+
+constexpr MaskRowTable BuildMaskRows() {
+  MaskRowTable table{};
+  for (int mask = 0; mask < kQrMaskCount; ++mask) {
+    for (int y = 0; y < kMaskRowPeriod; ++y) {
+      for (int x = 0; x < kQrMaxSize; ++x) {
+        if (QrMaskBit(mask, x, y)) {
+          table[mask][y][x >> 6] |= std::uint64_t{1} << (x & 63);
+        }
+      }
+    }
+  }
+  return table;
+}
+
+constexpr std::array<std::uint8_t, 256> BuildBitReverse() {
+  std::array<std::uint8_t, 256> table{};
+  for (int i = 0; i < 256; ++i) {
+    int reversed = 0;
+    for (int bit = 0; bit < 8; ++bit) {
+      reversed |= ((i >> bit) & 1) << (7 - bit);
+    }
+    table[i] = static_cast<std::uint8_t>(reversed);
+  }
+  return table;
+}
+
+constexpr MaskRowTable kMaskRows = BuildMaskRows();
+constexpr std::array<std::uint8_t, 256> kBitReverse = BuildBitReverse();
+
+// Penalty weights N1-N4 and the finder-like run 1:1:3:1:1.
+constexpr std::uint32_t kPenaltyRun = 3;
+constexpr std::uint32_t kPenaltyBlock = 3;
+constexpr std::uint32_t kPenaltyFinder = 40;
+constexpr std::uint32_t kPenaltyBalance = 10;
+constexpr bool kFinderRun[7] = {true, false, true, true, true, false, true};
+
+inline std::uint32_t PopCount(std::uint64_t value) {
+#if defined(__GNUC__)
+  return static_cast<std::uint32_t>(__builtin_popcountll(value));
+#else
+  value -= (value >> 1) & 0x5555555555555555ULL;
+  value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+  value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<std::uint32_t>((value * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Rows of the penalty evaluator, W = 1..3 words wide. Symbols up to version
+// 11 fit one word and up to version 27 two, so small symbols pay for no more.
+template <int W>
+struct Bits {
+  std::uint64_t word[W];
+};
+
+template <int W>
+inline Bits<W> operator&(Bits<W> a, const Bits<W>& b) {
+  for (int i = 0; i < W; ++i) {
+    a.word[i] &= b.word[i];
+  }
+  return a;
+}
+
+template <int W>
+inline Bits<W> operator|(Bits<W> a, const Bits<W>& b) {
+  for (int i = 0; i < W; ++i) {
+    a.word[i] |= b.word[i];
+  }
+  return a;
+}
+
+template <int W>
+inline Bits<W> operator~(Bits<W> a) {
+  for (int i = 0; i < W; ++i) {
+    a.word[i] = ~a.word[i];
+  }
+  return a;
+}
+
+// Bit x set where bit x of `a` equals bit x of `b`.
+template <int W>
+inline Bits<W> Same(Bits<W> a, const Bits<W>& b) {
+  for (int i = 0; i < W; ++i) {
+    a.word[i] = ~(a.word[i] ^ b.word[i]);
+  }
+  return a;
+}
+
+// Bit x of the result is bit x + k of `row` (k in 1..63).
+template <int W>
+inline Bits<W> Next(const Bits<W>& row, int k) {
+  Bits<W> out;
+  for (int i = 0; i < W; ++i) {
+    out.word[i] = (row.word[i] >> k) | (i + 1 < W ? row.word[i + 1] << (64 - k) : 0);
+  }
+  return out;
+}
+
+// Bit x of the result is bit x - k of `row` (k in 1..63).
+template <int W>
+inline Bits<W> Previous(const Bits<W>& row, int k) {
+  Bits<W> out;
+  for (int i = 0; i < W; ++i) {
+    out.word[i] = (row.word[i] << k) | (i > 0 ? row.word[i - 1] >> (64 - k) : 0);
+  }
+  return out;
+}
+
+template <int W>
+inline std::uint32_t PopCount(const Bits<W>& row) {
+  std::uint32_t count = 0;
+  for (int i = 0; i < W; ++i) {
+    count += PopCount(row.word[i]);
+  }
+  return count;
+}
+
+// Bits [0, count).
+template <int W>
+inline Bits<W> LowBits(int count) {
+  Bits<W> row;
+  for (int i = 0; i < W; ++i) {
+    const int bits = count - 64 * i;
+    row.word[i] = bits >= 64 ? ~std::uint64_t{0} : bits <= 0 ? 0 : (std::uint64_t{1} << bits) - 1;
+  }
+  return row;
+}
+
+template <int W>
+inline Bits<W> Load(const std::uint64_t* words) {
+  Bits<W> row;
+  for (int i = 0; i < W; ++i) {
+    row.word[i] = words[i];
+  }
+  return row;
+}
+
+// N1 score given bit x set where modules x..x+4 agree: a run of length 5 + i
+// has 1 + i such bits and scores 3 + i.
+template <int W>
+inline std::uint32_t RunPenalty(const Bits<W>& run4, const Bits<W>& previous_run4) {
+  return PopCount(run4) + (kPenaltyRun - 1) * PopCount(run4 & ~previous_run4);
+}
+
+// 1011101 starting at each bit, given the line shifted by 0..6, where four
+// light modules precede or follow it.
+template <int W>
+inline Bits<W> FinderMatches(const Bits<W>* shifted,
+                             const Bits<W>& light_before,
+                             const Bits<W>& light_after) {
+  Bits<W> match = light_before | light_after;
+  for (int k = 0; k < 7; ++k) {
+    match = match & (kFinderRun[k] ? shifted[k] : ~shifted[k]);
+  }
+  return match;
+}
+
+// Rules follow the common reading of ISO/IEC 18004 7.8.3 (as in ZXing): N1
+// scores each run of five or more, N2 every 2x2 same-colour square
+// (overlapping), N3 each 1011101 with four light modules on either side
+// (outside the symbol counts as light), N4 each 5% step away from half dark.
+template <int W>
+std::uint32_t MaskPenalty(const std::uint64_t (*modules)[kWords], int size) {
+  using Row = Bits<W>;
+  const Row inside = LowBits<W>(size);
+  const Row pairs = LowBits<W>(size - 1);
+  const Row finder_starts = LowBits<W>(size - 6);
+  const Row empty = LowBits<W>(0);
+  std::uint32_t penalty = 0;
+  std::uint32_t dark = 0;
+
+  // Horizontal N1, N2 and N3 per row.
+  for (int y = 0; y < size; ++y) {
+    const Row row = Load<W>(modules[y]);
+    dark += PopCount(row);
+    Row shifted[11];
+    shifted[0] = row;
+    for (int k = 1; k < 11; ++k) {
+      shifted[k] = Next(row, k);
+    }
+    const Row same = Same(row, shifted[1]) & pairs;
+    const Row run4 = same & Next(same, 1) & Next(same, 2) & Next(same, 3);
+    penalty += RunPenalty(run4, Previous(run4, 1));
+
+    if (y + 1 < size) {
+      const Row vertical_same = Same(row, Load<W>(modules[y + 1]));
+      penalty += kPenaltyBlock * PopCount(same & vertical_same & Next(vertical_same, 1));
+    }
+
+    const Row light_before = ~(Previous(row, 1) | Previous(row, 2) | Previous(row, 3) | Previous(row, 4));
+    const Row light_after = ~(shifted[7] | shifted[8] | shifted[9] | shifted[10]);
+    penalty += kPenaltyFinder * PopCount(FinderMatches(shifted, light_before, light_after) & finder_starts);
+  }
+
+  // Vertical N1: the same run arithmetic, all columns at once.
+  Row same_window[3] = {empty, empty, empty};
+  Row previous_run4 = empty;
+  for (int y = 0; y + 1 < size; ++y) {
+    const Row same = Same(Load<W>(modules[y]), Load<W>(modules[y + 1])) & inside;
+    const Row run4 = y >= 3 ? same_window[0] & same_window[1] & same_window[2] & same : empty;
+    penalty += RunPenalty(run4, previous_run4);
+    previous_run4 = run4;
+    same_window[0] = same_window[1];
+    same_window[1] = same_window[2];
+    same_window[2] = same;
+  }
+
+  // Vertical N3, all columns at once; rows outside the symbol are light.
+  auto row_at = [&](int y) { return y >= 0 && y < size ? Load<W>(modules[y]) : empty; };
+  for (int y = 0; y + 7 <= size; ++y) {
+    Row shifted[7];
+    for (int k = 0; k < 7; ++k) {
+      shifted[k] = row_at(y + k);
+    }
+    const Row light_before = ~(row_at(y - 1) | row_at(y - 2) | row_at(y - 3) | row_at(y - 4));
+    const Row light_after = ~(row_at(y + 7) | row_at(y + 8) | row_at(y + 9) | row_at(y + 10));
+    penalty += kPenaltyFinder * PopCount(FinderMatches(shifted, light_before, light_after) & inside);
+  }
+
+  const std::uint32_t total = static_cast<std::uint32_t>(size * size);
+  const std::uint32_t imbalance = dark * 2 > total ? dark * 2 - total : total - dark * 2;
+  return penalty + imbalance * 10 / total * kPenaltyBalance;
+}
+
+}  // namespace
+
+QrStatus QrEncoder::Encode(const std::uint8_t* payload,
+                           std::size_t size,
+                           const QrEncodeOptions& options,
+                           std::uint8_t* bitmap,
+                           std::size_t capacity,
+                           QrSymbolInfo* info_out) {
+  if ((payload == nullptr && size > 0) || bitmap == nullptr || options.min_version < kQrMinVersion ||
+      options.max_version > kQrMaxVersion || options.min_version > options.max_version ||
+      options.mask < kQrAutoMask || options.mask >= kQrMaskCount) {
+    return QrStatus::kInvalidArgument;
+  }
+  int version = 0;
+  for (int candidate = options.min_version; candidate <= options.max_version; ++candidate) {
+    if (size <= QrByteCapacity(candidate, options.ecc)) {
+      version = candidate;
+      break;
+    }
+  }
+  if (version == 0) {
+    return QrStatus::kDataTooLong;
+  }
+  const int symbol_size = QrSymbolSize(version);
+  const std::size_t stride = QrBitmapStride(symbol_size);
+  if (capacity < stride * static_cast<std::size_t>(symbol_size)) {
+    return QrStatus::kBufferTooSmall;
+  }
+
+  const QrBlockLayout layout = QrLayout(version, options.ecc);
+  WriteDataCodewords(payload, size, version, layout.data_codewords);
+  WriteParity(layout);
+  DrawFunctionPatterns(version, symbol_size);
+  PlaceCodewords(layout, symbol_size);
+
+  int mask = options.mask;
+  if (mask == kQrAutoMask) {
+    std::uint32_t best = 0;
+    for (int candidate = 0; candidate < kQrMaskCount; ++candidate) {
+      ApplyMask(candidate, symbol_size);
+      DrawFormat(options.ecc, candidate, symbol_size);
+      const std::uint32_t penalty = Penalty(symbol_size);
+      if (mask == kQrAutoMask || penalty < best) {
+        mask = candidate;
+        best = penalty;
+      }
+      ApplyMask(candidate, symbol_size);  // XOR again to undo
+    }
+  }
+  ApplyMask(mask, symbol_size);
+  DrawFormat(options.ecc, mask, symbol_size);
+
+  for (int y = 0; y < symbol_size; ++y) {
+    std::uint8_t* out = bitmap + static_cast<std::size_t>(y) * stride;
+    for (std::size_t byte = 0; byte < stride; ++byte) {
+      out[byte] = kBitReverse[(modules_[y][byte / 8] >> (8 * (byte % 8))) & 0xFF];
+    }
+  }
+  if (info_out != nullptr) {
+    info_out->version = version;
+    info_out->size = symbol_size;
+    info_out->ecc = options.ecc;
+    info_out->mask = mask;
+    info_out->stride = stride;
+    info_out->penalty = Penalty(symbol_size);
+  }
+  return QrStatus::kOk;
+}
+
+void QrEncoder::WriteDataCodewords(const std::uint8_t* payload,
+                                   std::size_t size,
+                                   int version,
+                                   std::size_t data_codewords) {
+  // Mode 0100 and an 8- or 16-bit count leave the payload nibble-aligned; the
+  // low nibble of the final byte doubles as the terminator.
+  std::size_t out = 0;
+  if (version < 10) {
+    codewords_[out++] = static_cast<std::uint8_t>(0x40 | (size >> 4));
+  } else {
+    codewords_[out++] = static_cast<std::uint8_t>(0x40 | (size >> 12));
+    codewords_[out++] = static_cast<std::uint8_t>(size >> 4);
+  }
+  std::uint8_t carry = static_cast<std::uint8_t>((size & 0x0F) << 4);
+  for (std::size_t i = 0; i < size; ++i) {
+    codewords_[out++] = static_cast<std::uint8_t>(carry | (payload[i] >> 4));
+    carry = static_cast<std::uint8_t>((payload[i] & 0x0F) << 4);
+  }
+  codewords_[out++] = carry;
+  for (std::uint8_t pad = 0xEC; out < data_codewords; pad ^= 0xEC ^ 0x11) {
+    codewords_[out++] = pad;
+  }
+}
+
+void QrEncoder::WriteParity(const QrBlockLayout& layout) {
+  std::size_t offset = 0;
+  for (std::size_t block = 0; block < layout.blocks; ++block) {
+    const std::size_t length = layout.short_block_data + (block < layout.short_blocks ? 0 : 1);
+    ReedSolomonEncode(codewords_ + offset,
+                      length,
+                      layout.ecc_per_block,
+                      codewords_ + layout.data_codewords + block * layout.ecc_per_block);
+    offset += length;
+  }
+}
+
+void QrEncoder::SetFunctionModule(int x, int y, bool dark) {
+  const std::uint64_t bit = std::uint64_t{1} << (x & 63);
+  modules_[y][x >> 6] = dark ? modules_[y][x >> 6] | bit : modules_[y][x >> 6] & ~bit;
+  function_[y][x >> 6] |= bit;
+}
+
+void QrEncoder::DrawFunctionPatterns(int version, int size) {
+  const Bits<kWords> outside = ~LowBits<kWords>(size);
+  for (int y = 0; y < size; ++y) {
+    for (int word = 0; word < kRowWords; ++word) {
+      modules_[y][word] = 0;
+      function_[y][word] = outside.word[word];
+    }
+  }
+  for (int i = 0; i < size; ++i) {
+    SetFunctionModule(6, i, i % 2 == 0);
+    SetFunctionModule(i, 6, i % 2 == 0);
+  }
+  const int finders[3][2] = {{3, 3}, {size - 4, 3}, {3, size - 4}};
+  for (const auto& centre : finders) {
+    for (int dy = -4; dy <= 4; ++dy) {
+      for (int dx = -4; dx <= 4; ++dx) {
+        const int x = centre[0] + dx;
+        const int y = centre[1] + dy;
+        const int distance = dx * dx > dy * dy ? (dx < 0 ? -dx : dx) : (dy < 0 ? -dy : dy);
+        if (x >= 0 && x < size && y >= 0 && y < size) {
+          SetFunctionModule(x, y, distance != 2 && distance != 4);
+        }
+      }
+    }
+  }
+  int positions[kQrMaxAlignmentPositions];
+  const int count = QrAlignmentPositions(version, positions);
+  for (int i = 0; i < count; ++i) {
+    for (int j = 0; j < count; ++j) {
+      if ((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0)) {
+        continue;  // overlaps a finder
+      }
+      for (int dy = -2; dy <= 2; ++dy) {
+        for (int dx = -2; dx <= 2; ++dx) {
+          const int distance_squared = dx * dx > dy * dy ? dx * dx : dy * dy;
+          SetFunctionModule(positions[i] + dx, positions[j] + dy, distance_squared != 1);
+        }
+      }
+    }
+  }
+  DrawFormat(QrEcc::kMedium, 0, size);  // reserves the area; redrawn once the mask is known
+  if (version >= 7) {
+    const std::uint32_t bits = QrVersionBits(version);
+    for (int i = 0; i < 18; ++i) {
+      const bool dark = (bits >> i) & 1;
+      SetFunctionModule(size - 11 + i % 3, i / 3, dark);
+      SetFunctionModule(i / 3, size - 11 + i % 3, dark);
+    }
+  }
+}
+
+void QrEncoder::DrawFormat(QrEcc ecc, int mask, int size) {
+  const std::uint16_t bits = QrFormatBits(ecc, mask);
+  auto bit = [bits](int i) { return ((bits >> i) & 1) != 0; };
+  // Copy around the top-left finder.
+  for (int i = 0; i <= 5; ++i) {
+    SetFunctionModule(8, i, bit(i));
+  }
+  SetFunctionModule(8, 7, bit(6));
+  SetFunctionModule(8, 8, bit(7));
+  SetFunctionModule(7, 8, bit(8));
+  for (int i = 9; i < 15; ++i) {
+    SetFunctionModule(14 - i, 8, bit(i));
+  }
+  // Copy split between the other two finders, plus the dark module.
+  for (int i = 0; i < 8; ++i) {
+    SetFunctionModule(size - 1 - i, 8, bit(i));
+  }
+  for (int i = 8; i < 15; ++i) {
+    SetFunctionModule(8, size - 15 + i, bit(i));
+  }
+  SetFunctionModule(8, size - 8, true);
+}
+
+void QrEncoder::PlaceCodewords(const QrBlockLayout& layout, int size) {
+  // Interleave on the fly: data codeword i of every block in turn (short
+  // blocks have none at the last index), then parity likewise.
+  const std::size_t long_data = layout.short_block_data + 1;
+  std::size_t index = 0;
+  std::size_t block = 0;
+  auto next_codeword = [&]() -> std::uint8_t {
+    for (;;) {
+      const std::size_t current_block = block;
+      const std::size_t current_index = index;
+      if (++block == layout.blocks) {
+        block = 0;
+        ++index;
+      }
+      if (current_index < long_data) {
+        if (current_index == layout.short_block_data && current_block < layout.short_blocks) {
+          continue;
+        }
+        const std::size_t long_before =
+            current_block > layout.short_blocks ? current_block - layout.short_blocks : 0;
+        return codewords_[current_block * layout.short_block_data + long_before + current_index];
+      }
+      const std::size_t parity_index = current_index - long_data;
+      return codewords_[layout.data_codewords + current_block * layout.ecc_per_block + parity_index];
+    }
+  };
+
+  const std::size_t total_bits = layout.total_codewords * 8;
+  std::size_t placed = 0;
+  std::uint8_t codeword = 0;
+  for (int right = size - 1; right >= 1; right -= 2) {
+    if (right == 6) {
+      right = 5;  // skip the vertical timing column
+    }
+    const bool upward = ((right + 1) & 2) == 0;
+    for (int vertical = 0; vertical < size; ++vertical) {
+      const int y = upward ? size - 1 - vertical : vertical;
+      for (int x = right; x >= right - 1; --x) {
+        const std::uint64_t bit = std::uint64_t{1} << (x & 63);
+        if ((function_[y][x >> 6] & bit) != 0 || placed == total_bits) {
+          continue;  // remainder bits stay light
+        }
+        if (placed % 8 == 0) {
+          codeword = next_codeword();
+        }
+        if ((codeword >> (7 - placed % 8)) & 1) {
+          modules_[y][x >> 6] |= bit;
+        }
+        ++placed;
+      }
+    }
+  }
+}
+
+void QrEncoder::ApplyMask(int mask, int size) {
+  for (int y = 0; y < size; ++y) {
+    const Row& pattern = kMaskRows[mask][y % kMaskRowPeriod];
+    for (int word = 0; word < kRowWords; ++word) {
+      modules_[y][word] ^= pattern[word] & ~function_[y][word];
+    }
+  }
+}
+
+std::uint32_t QrEncoder::Penalty(int size) const {
+  if (size <= 64) {
+    return MaskPenalty<1>(modules_, size);
+  }
+  return size <= 128 ? MaskPenalty<2>(modules_, size) : MaskPenalty<3>(modules_, size);
+}
+
+}  // namespace offline_wallet
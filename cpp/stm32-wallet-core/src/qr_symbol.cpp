@@ -0,0 +1,113 @@
+#include "offline_wallet/qr_symbol.hpp"
+
+#include <array>
+
+namespace offline_wallet {
+
+namespace {
+
+// ISO/IEC 18004 Table 9, indexed [ecc][version]; column 0 is unused.
+constexpr std::uint8_t kEccCodewordsPerBlock[4][kQrMaxVersion + 1] = {
+    {0,  7,  10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28,
+     28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {0,  10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26,
+     26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},
+    {0,  13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30,
+     28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {0,  17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28,
+     30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+};
+
+constexpr std::uint8_t kErrorCorrectionBlocks[4][kQrMaxVersion + 1] = {
+    {0,  1,  1,  1,  1,  1,  2,  2,  2,  2,  4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,
+     8,  9,  9,  10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},
+    {0,  1,  1,  1,  2,  2,  4,  4,  4,  5,  5,  5,  8,  9,  9,  10, 10, 11, 13, 14, 16,
+     17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},
+    {0,  1,  1,  2,  2,  4,  4,  6,  6,  8,  8,  8,  10, 12, 16, 12, 17, 16, 18, 21, 20,
+     23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},
+    {0,  1,  1,  2,  4,  4,  4,  5,  6,  8,  8,  11, 11, 16, 16, 18, 16, 19, 21, 25, 25,
+     25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},
+};
+
+// Format information encodes the level as L=01, M=00, Q=11, H=10.
+constexpr std::uint16_t kEccFormatCode[4] = {1, 0, 3, 2};
+
+constexpr std::array<std::uint16_t, 32> BuildFormatTable() {
+  std::array<std::uint16_t, 32> table{};
+  for (std::uint32_t data = 0; data < 32; ++data) {
+    std::uint32_t remainder = data;
+    for (int bit = 0; bit < 10; ++bit) {
+      remainder = (remainder << 1) ^ ((remainder >> 9) * 0x537);
+    }
+    table[data] = static_cast<std::uint16_t>(((data << 10) | remainder) ^ 0x5412);
+  }
+  return table;
+}
+
+constexpr std::array<std::uint32_t, kQrMaxVersion + 1> BuildVersionTable() {
+  std::array<std::uint32_t, kQrMaxVersion + 1> table{};
+  for (std::uint32_t version = 7; version <= kQrMaxVersion; ++version) {
+    std::uint32_t remainder = version;
+    for (int bit = 0; bit < 12; ++bit) {
+      remainder = (remainder << 1) ^ ((remainder >> 11) * 0x1F25);
+    }
+    table[version] = (version << 12) | remainder;
+  }
+  return table;
+}
+
+constexpr std::array<std::uint16_t, 32> kFormatTable = BuildFormatTable();
+constexpr std::array<std::uint32_t, kQrMaxVersion + 1> kVersionTable = BuildVersionTable();
+
+std::size_t RawDataModules(int version) {
+  std::size_t modules = static_cast<std::size_t>((16 * version + 128) * version + 64);
+  if (version >= 2) {
+    const int count = version / 7 + 2;
+    modules -= static_cast<std::size_t>((25 * count - 10) * count - 55);
+    if (version >= 7) {
+      modules -= 36;
+    }
+  }
+  return modules;
+}
+
+}  // namespace
+
+QrBlockLayout QrLayout(int version, QrEcc ecc) {
+  const auto level = static_cast<std::size_t>(ecc);
+  QrBlockLayout layout;
+  layout.total_codewords = RawDataModules(version) / 8;
+  layout.ecc_per_block = kEccCodewordsPerBlock[level][version];
+  layout.blocks = kErrorCorrectionBlocks[level][version];
+  layout.data_codewords = layout.total_codewords - layout.ecc_per_block * layout.blocks;
+  layout.short_blocks = layout.blocks - layout.total_codewords % layout.blocks;
+  layout.short_block_data = layout.total_codewords / layout.blocks - layout.ecc_per_block;
+  return layout;
+}
+
+std::size_t QrByteCapacity(int version, QrEcc ecc) {
+  const std::size_t header_bits = 4 + (version < 10 ? 8 : 16);
+  return (QrLayout(version, ecc).data_codewords * 8 - header_bits) / 8;
+}
+
+int QrAlignmentPositions(int version, int positions_out[kQrMaxAlignmentPositions]) {
+  if (version < 2) {
+    return 0;
+  }
+  const int count = version / 7 + 2;
+  const int step = (version * 8 + count * 3 + 5) / (count * 4 - 4) * 2;
+  positions_out[0] = 6;
+  for (int i = count - 1, position = QrSymbolSize(version) - 7; i >= 1; --i, position -= step) {
+    positions_out[i] = position;
+  }
+  return count;
+}
+
+std::uint16_t QrFormatBits(QrEcc ecc, int mask) {
+  const std::uint32_t level = kEccFormatCode[static_cast<std::size_t>(ecc)];
+  return kFormatTable[(level << 3) | static_cast<std::uint32_t>(mask)];
+}
+
+std::uint32_t QrVersionBits(int version) { return kVersionTable[static_cast<std::size_t>(version)]; }
+
+}  // namespace offline_wallet
@@ -0,0 +1,190 @@
+#include "offline_wallet/receipt_chain.hpp"
+
+#include <utility>
+
+namespace offline_wallet {
+
+namespace {
+
+constexpr std::uint8_t kLeafPrefix = 0x00;
+constexpr std::uint8_t kNodePrefix = 0x01;
+
+class DigestSink : public StreamingSignatureProvider {
+ public:
+  void BeginSign(const std::string& /*key_id*/) override {}
+  void BeginVerify(const std::string& /*public_key_or_id*/) override {}
+  void Update(const char* data, std::size_t size) override { hash.Update(data, size); }
+  void FinishSign(std::string* /*signature_out*/) override {}
+  bool FinishVerify(const std::string& /*signature*/) override { return false; }
+
+  Sha256 hash;
+};
+
+Sha256Digest Node(const Sha256Digest& left, const Sha256Digest& right) {
+  Sha256 hash;
+  hash.Update(&kNodePrefix, 1);
+  hash.Update(left.data(), left.size());
+  hash.Update(right.data(), right.size());
+  Sha256Digest digest;
+  hash.Finish(&digest);
+  return digest;
+}
+
+// Replaces the first `size` nodes of `level` with the level above and returns
+// its size; the last node of an odd level moves up unchanged.
+std::size_t Fold(std::vector<Sha256Digest>* level, std::size_t size) {
+  for (std::size_t i = 0; i + 1 < size; i += 2) {
+    (*level)[i / 2] = Node((*level)[i], (*level)[i + 1]);
+  }
+  if (size % 2 != 0) {
+    (*level)[size / 2] = (*level)[size - 1];
+  }
+  return (size + 1) / 2;
+}
+
+std::string_view Hex(const Sha256Digest& digest, char (&text)[64]) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  for (std::size_t i = 0; i < digest.size(); ++i) {
+    text[2 * i] = kHex[digest[i] >> 4];
+    text[2 * i + 1] = kHex[digest[i] & 0x0F];
+  }
+  return std::string_view(text, sizeof(text));
+}
+
+}  // namespace
+
+ReceiptChain::ReceiptChain(ReceiptChainOptions options) : options_(options) {
+  open_.reserve(options_.checkpoint_receipts);
+  closed_leaves_.reserve(options_.checkpoint_receipts);
+  last_leaves_.reserve(options_.checkpoint_receipts);
+  level_.reserve(options_.checkpoint_receipts);
+}
+
+void ReceiptChain::Restore(const ReceiptCheckpoint& last) {
+  last_ = last;
+  last_leaves_.clear();
+  open_.clear();
+  closing_ = false;
+  next_position_ = last.first_position + last.count;
+}
+
+std::uint64_t ReceiptChain::Append(const Sha256Digest& leaf, std::uint64_t now) {
+  if (open_.empty()) {
+    open_since_ = now;
+  }
+  open_.push_back(leaf);
+  return next_position_++;
+}
+
+bool ReceiptChain::CheckpointDue(std::uint64_t now) const {
+  return !closing_ && !open_.empty() &&
+         (open_.size() >= options_.checkpoint_receipts || now >= open_since_ + options_.max_checkpoint_age_seconds);
+}
+
+bool ReceiptChain::CloseCheckpoint(ReceiptCheckpoint* checkpoint_out) {
+  if (closing_ || open_.empty() || checkpoint_out == nullptr) {
+    return false;
+  }
+  closed_.sequence = last_.sequence + 1;
+  closed_.first_position = next_position_ - open_.size();
+  closed_.count = static_cast<std::uint32_t>(open_.size());
+  closed_.root = Root(open_);
+  closed_.previous = last_.sequence == 0 ? Sha256Digest{} : CheckpointDigest(last_);
+  closed_.signature.clear();
+  closed_leaves_.swap(open_);
+  open_.clear();
+  closing_ = true;
+  *checkpoint_out = closed_;
+  return true;
+}
+
+bool ReceiptChain::SignCheckpoint(std::string signature) {
+  if (!closing_) {
+    return false;
+  }
+  closed_.signature = std::move(signature);
+  std::swap(last_, closed_);
+  last_leaves_.swap(closed_leaves_);
+  closing_ = false;
+  return true;
+}
+
+bool ReceiptChain::Prove(std::uint64_t position, ReceiptProof* proof_out) const {
+  if (proof_out == nullptr || last_leaves_.empty() || position < last_.first_position ||
+      position - last_.first_position >= last_leaves_.size()) {
+    return false;
+  }
+  proof_out->position = position;
+  proof_out->checkpoint = last_.sequence;
+  proof_out->path.clear();
+  level_.assign(last_leaves_.begin(), last_leaves_.end());
+  std::size_t index = position - last_.first_position;
+  for (std::size_t size = level_.size(); size > 1; index /= 2) {
+    if (index % 2 != 0) {
+      proof_out->path.push_back(level_[index - 1]);
+    } else if (index + 1 < size) {
+      proof_out->path.push_back(level_[index + 1]);
+    }
+    size = Fold(&level_, size);
+  }
+  return true;
+}
+
+Sha256Digest ReceiptChain::Root(const std::vector<Sha256Digest>& leaves) {
+  level_.assign(leaves.begin(), leaves.end());
+  for (std::size_t size = level_.size(); size > 1;) {
+    size = Fold(&level_, size);
+  }
+  return level_.front();
+}
+
+Sha256Digest ReceiptLeaf(const PaymentReceipt& receipt, std::string_view payer_authorization_id) {
+  DigestSink sink;
+  sink.hash.Update(&kLeafPrefix, 1);
+  SignatureFieldWriter(&sink).Field(receipt.tx_id).Field(payer_authorization_id).Field("pending_sync");
+  Sha256Digest digest;
+  sink.hash.Finish(&digest);
+  return digest;
+}
+
+void WriteCheckpointFields(const ReceiptCheckpoint& checkpoint, StreamingSignatureProvider* sink) {
+  char root[64];
+  char previous[64];
+  SignatureFieldWriter(sink)
+      .Field("receipt_checkpoint")
+      .Field(checkpoint.sequence)
+      .Field(checkpoint.first_position)
+      .Field(checkpoint.count)
+      .Field(Hex(checkpoint.root, root))
+      .Field(Hex(checkpoint.previous, previous));
+}
+
+Sha256Digest CheckpointDigest(const ReceiptCheckpoint& checkpoint) {
+  DigestSink sink;
+  WriteCheckpointFields(checkpoint, &sink);
+  Sha256Digest digest;
+  sink.hash.Finish(&digest);
+  return digest;
+}
+
+bool VerifyReceiptProof(const Sha256Digest& leaf, const ReceiptProof& proof, const ReceiptCheckpoint& checkpoint) {
+  if (proof.checkpoint != checkpoint.sequence || proof.position < checkpoint.first_position ||
+      proof.position - checkpoint.first_position >= checkpoint.count) {
+    return false;
+  }
+  Sha256Digest node = leaf;
+  std::size_t used = 0;
+  std::uint64_t index = proof.position - checkpoint.first_position;
+  for (std::uint64_t size = checkpoint.count; size > 1; index /= 2, size = (size + 1) / 2) {
+    if (index % 2 != 0 || index + 1 < size) {
+      if (used == proof.path.size()) {
+        return false;
+      }
+      const Sha256Digest& sibling = proof.path[used++];
+      node = index % 2 != 0 ? Node(sibling, node) : Node(node, sibling);
+    }
+  }
+  return used == proof.path.size() && node == checkpoint.root;
+}
+
+}  // namespace offline_wallet
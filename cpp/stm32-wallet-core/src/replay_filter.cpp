@@ -0,0 +1,186 @@
+#include "offline_wallet/replay_filter.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "offline_wallet/byte_codec.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+constexpr std::size_t kWays = 4;
+
+// SplitMix64 finalizer; spreads FNV output over all bits for double hashing.
+std::uint64_t Mix(std::uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+  return value ^ (value >> 31);
+}
+
+}  // namespace
+
+ReplayFilter::ReplayFilter(const RiskPolicy& policy, ReplayFilterOptions options)
+    : window_seconds_(static_cast<std::uint64_t>(policy.intent_ttl_seconds) +
+                      2 * static_cast<std::uint64_t>(policy.max_clock_skew_seconds)),
+      max_future_seconds_(policy.max_clock_skew_seconds),
+      options_(options) {
+  options_.hash_count = std::max<std::uint32_t>(options_.hash_count, 1);
+  const std::size_t words = std::max<std::size_t>(options_.bloom_bytes / 8, 1);
+  bloom_bits_ = words * 64;
+  bloom_words_.assign(words * 2, 0);
+  const std::size_t sets = std::max<std::size_t>((options_.device_slots + kWays - 1) / kWays, 1);
+  devices_.assign(sets * kWays, DeviceSlot{});
+}
+
+ReplayVerdict ReplayFilter::Check(const PaymentAuthorization& authorization, std::uint64_t now) const {
+  return CheckKey(MakeKey(authorization.payer_device_id.data(), authorization.payer_device_id.size(),
+                          authorization.payer_counter, authorization.payer_nonce.data(),
+                          authorization.payer_nonce.size(), authorization.authorized_at_epoch_seconds),
+                  now);
+}
+
+ReplayVerdict ReplayFilter::Check(const FixedPaymentAuthorization& authorization, std::uint64_t now) const {
+  return CheckKey(MakeKey(authorization.payer_device_id.data(), authorization.payer_device_id.size(),
+                          authorization.payer_counter, authorization.payer_nonce.data(),
+                          authorization.payer_nonce.size(), authorization.authorized_at_epoch_seconds),
+                  now);
+}
+
+void ReplayFilter::Record(const PaymentAuthorization& authorization, std::uint64_t now) {
+  RecordKey(MakeKey(authorization.payer_device_id.data(), authorization.payer_device_id.size(),
+                    authorization.payer_counter, authorization.payer_nonce.data(),
+                    authorization.payer_nonce.size(), authorization.authorized_at_epoch_seconds),
+            now);
+}
+
+void ReplayFilter::Record(const FixedPaymentAuthorization& authorization, std::uint64_t now) {
+  RecordKey(MakeKey(authorization.payer_device_id.data(), authorization.payer_device_id.size(),
+                    authorization.payer_counter, authorization.payer_nonce.data(),
+                    authorization.payer_nonce.size(), authorization.authorized_at_epoch_seconds),
+            now);
+}
+
+void ReplayFilter::Clear() {
+  std::fill(bloom_words_.begin(), bloom_words_.end(), 0);
+  std::fill(devices_.begin(), devices_.end(), DeviceSlot{});
+  current_ = 0;
+  generation_started_ = 0;
+  started_ = false;
+  clock_ = 0;
+}
+
+std::size_t ReplayFilter::MemoryBytes() const {
+  return sizeof(*this) + bloom_words_.size() * sizeof(std::uint64_t) + devices_.size() * sizeof(DeviceSlot);
+}
+
+ReplayFilter::Key ReplayFilter::MakeKey(const char* device_id,
+                                        std::size_t device_id_size,
+                                        std::uint32_t counter,
+                                        const char* nonce,
+                                        std::size_t nonce_size,
+                                        std::uint64_t authorized_at) {
+  Key key{};
+  key.device_hash = Fnv1a(device_id, device_id_size);
+  const unsigned char counter_bytes[5] = {0, static_cast<unsigned char>(counter),
+                                          static_cast<unsigned char>(counter >> 8),
+                                          static_cast<unsigned char>(counter >> 16),
+                                          static_cast<unsigned char>(counter >> 24)};
+  const std::uint64_t counter_hash = Fnv1a(counter_bytes, sizeof(counter_bytes), key.device_hash);
+  key.entry_hash = Mix(Fnv1a(nonce, nonce_size, counter_hash));
+  key.device_hash = key.device_hash == 0 ? 1 : key.device_hash;
+  key.counter = counter;
+  key.authorized_at = authorized_at;
+  return key;
+}
+
+ReplayVerdict ReplayFilter::CheckKey(const Key& key, std::uint64_t now) const {
+  if (key.authorized_at + window_seconds_ < now || key.authorized_at > now + max_future_seconds_) {
+    return ReplayVerdict::kOutsideWindow;
+  }
+  const DeviceSlot* device = FindDevice(key.device_hash);
+  if (device != nullptr &&
+      static_cast<std::uint64_t>(key.counter) + options_.max_counter_lag < device->high_water) {
+    return ReplayVerdict::kCounterRegressed;
+  }
+  if (BloomContains(0, key.entry_hash) || BloomContains(1, key.entry_hash)) {
+    return ReplayVerdict::kReplayed;
+  }
+  return ReplayVerdict::kFresh;
+}
+
+void ReplayFilter::RecordKey(const Key& key, std::uint64_t now) {
+  // An entry recorded at time t may be replayed until its authorized_at (at
+  // most t + skew) plus the window, so a generation is kept that long after
+  // it stops receiving inserts.
+  const std::uint64_t period = window_seconds_ + max_future_seconds_;
+  if (!started_) {
+    started_ = true;
+    generation_started_ = now;
+  } else if (now >= generation_started_ + period) {
+    const auto words = static_cast<std::ptrdiff_t>(bloom_words_.size() / 2);
+    if (now >= generation_started_ + 2 * period) {
+      std::fill(bloom_words_.begin(), bloom_words_.end(), 0);
+    } else {
+      current_ ^= 1;
+      const auto first = bloom_words_.begin() + static_cast<std::ptrdiff_t>(current_) * words;
+      std::fill(first, first + words, 0);
+    }
+    generation_started_ = now;
+  }
+  BloomInsert(current_, key.entry_hash);
+
+  const std::size_t set = key.device_hash % (devices_.size() / kWays) * kWays;
+  DeviceSlot* victim = &devices_[set];
+  for (std::size_t way = 0; way < kWays; ++way) {
+    DeviceSlot& slot = devices_[set + way];
+    if (slot.device_hash == key.device_hash) {
+      victim = &slot;
+      break;
+    }
+    if (slot.device_hash == 0 || (victim->device_hash != 0 && slot.last_used < victim->last_used)) {
+      victim = &slot;
+    }
+  }
+  if (victim->device_hash != key.device_hash) {
+    *victim = DeviceSlot{};
+    victim->device_hash = key.device_hash;
+  }
+  victim->high_water = std::max(victim->high_water, key.counter);
+  victim->last_used = ++clock_;
+}
+
+bool ReplayFilter::BloomContains(std::size_t generation, std::uint64_t entry_hash) const {
+  const std::uint64_t* words = bloom_words_.data() + generation * (bloom_words_.size() / 2);
+  const std::uint64_t step = (entry_hash >> 32 | entry_hash << 32) | 1;
+  std::uint64_t probe = entry_hash;
+  for (std::uint32_t i = 0; i < options_.hash_count; ++i, probe += step) {
+    const std::size_t bit = static_cast<std::size_t>(probe % bloom_bits_);
+    if ((words[bit / 64] & (std::uint64_t{1} << (bit % 64))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ReplayFilter::BloomInsert(std::size_t generation, std::uint64_t entry_hash) {
+  std::uint64_t* words = bloom_words_.data() + generation * (bloom_words_.size() / 2);
+  const std::uint64_t step = (entry_hash >> 32 | entry_hash << 32) | 1;
+  std::uint64_t probe = entry_hash;
+  for (std::uint32_t i = 0; i < options_.hash_count; ++i, probe += step) {
+    const std::size_t bit = static_cast<std::size_t>(probe % bloom_bits_);
+    words[bit / 64] |= std::uint64_t{1} << (bit % 64);
+  }
+}
+
+const ReplayFilter::DeviceSlot* ReplayFilter::FindDevice(std::uint64_t device_hash) const {
+  const std::size_t set = device_hash % (devices_.size() / kWays) * kWays;
+  for (std::size_t way = 0; way < kWays; ++way) {
+    if (devices_[set + way].device_hash == device_hash) {
+      return &devices_[set + way];
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace offline_wallet
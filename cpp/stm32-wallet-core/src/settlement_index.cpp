@@ -0,0 +1,578 @@
+#include "offline_wallet/settlement_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "offline_wallet/byte_codec.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// Image: [magic:u32][rows:u32][payers:u32][currencies:u32], the payer and
+// currency names as [length:u16][bytes], then the columns in row order:
+// hashes (u64), amounts (i32), creation times (u32), payer ids (u32), states
+// (u8), currency ids (u8). Little-endian throughout.
+constexpr std::uint32_t kImageMagic = 0x3149534F;  // "OSI1"
+constexpr std::size_t kImageHeaderSize = 16;
+constexpr std::size_t kRowImageSize = 8 + 4 + 4 + 4 + 1 + 1;
+constexpr std::size_t kMaxCurrencies = 256;
+constexpr std::size_t kNoRow = 0;
+
+std::uint32_t ClampSeconds(std::uint64_t epoch_seconds) {
+  return static_cast<std::uint32_t>(std::min<std::uint64_t>(epoch_seconds, 0xFFFFFFFFu));
+}
+
+void PutBytes(std::vector<std::uint8_t>* out, std::uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out->push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+  }
+}
+
+class ImageReader {
+ public:
+  explicit ImageReader(const std::vector<std::uint8_t>& image) : data_(image.data()), size_(image.size()) {}
+
+  bool Get(int bytes, std::uint64_t* value_out) {
+    if (size_ - offset_ < static_cast<std::size_t>(bytes)) {
+      return false;
+    }
+    std::uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+      value |= static_cast<std::uint64_t>(data_[offset_ + i]) << (8 * i);
+    }
+    offset_ += bytes;
+    *value_out = value;
+    return true;
+  }
+
+  bool GetString(std::string* out) {
+    std::uint64_t length = 0;
+    if (!Get(2, &length) || size_ - offset_ < length) {
+      return false;
+    }
+    out->assign(reinterpret_cast<const char*>(data_ + offset_), length);
+    offset_ += length;
+    return true;
+  }
+
+  std::size_t remaining() const { return size_ - offset_; }
+
+ private:
+  const std::uint8_t* data_;
+  std::size_t size_;
+  std::size_t offset_ = 0;
+};
+
+}  // namespace
+
+std::uint32_t SettlementIndex::Dictionary::Intern(std::string_view name) {
+  const auto it = ids.find(name);
+  if (it != ids.end()) {
+    return it->second;
+  }
+  names.emplace_back(name);
+  const auto id = static_cast<std::uint32_t>(names.size() - 1);
+  ids.emplace(names.back(), id);
+  return id;
+}
+
+void SettlementIndex::Dictionary::Clear() {
+  ids.clear();
+  names.clear();
+}
+
+SettlementIndex::SettlementIndex(TransactionJournal* journal, SettlementIndexOptions options)
+    : journal_(journal), options_(options) {
+  std::size_t capacity = 8;
+  while (capacity < options_.max_rows * 2) {
+    capacity <<= 1;
+  }
+  slots_.assign(capacity, 0);
+}
+
+bool SettlementIndex::Save(const LocalTransaction& tx) {
+  // A Save with a batch open commits the staged records with it.
+  if (!journal_->Save(tx)) {
+    ReconcileStaged();
+    Reconcile(tx.tx_id);
+    return false;
+  }
+  ApplyStaged();
+  Upsert(tx);
+  return true;
+}
+
+bool SettlementIndex::Load(const std::string& tx_id, LocalTransaction* tx_out) const {
+  return journal_->Load(tx_id, tx_out);
+}
+
+bool SettlementIndex::UpdateState(const std::string& tx_id, TransactionState state, const std::string& reason) {
+  if (!journal_->UpdateState(tx_id, state, reason)) {
+    return false;
+  }
+  SetState(tx_id, state);
+  return true;
+}
+
+bool SettlementIndex::BeginBatch() { return journal_->BeginBatch(); }
+
+bool SettlementIndex::Stage(const LocalTransaction& tx) {
+  Row row;
+  if (!journal_->Stage(tx)) {
+    return false;
+  }
+  if (!MakeRow(tx, &row)) {
+    ++unindexed_;
+    return true;
+  }
+  if (staged_count_ == staged_ids_.size()) {
+    staged_ids_.emplace_back();
+  }
+  staged_ids_[staged_count_].assign(tx.tx_id.data(), tx.tx_id.size());
+  staged_rows_.push_back(row);
+  ++staged_count_;
+  return true;
+}
+
+bool SettlementIndex::CommitBatch() {
+  if (!journal_->CommitBatch()) {
+    ReconcileStaged();
+    return false;
+  }
+  ApplyStaged();
+  return true;
+}
+
+void SettlementIndex::AbortBatch() {
+  journal_->AbortBatch();
+  // Journals without real batches wrote the staged records already.
+  ReconcileStaged();
+}
+
+bool SettlementIndex::UpdateStates(const StateUpdate* updates, std::size_t count) {
+  if (!journal_->UpdateStates(updates, count)) {
+    for (std::size_t i = 0; i < count; ++i) {
+      Reconcile(updates[i].tx_id);
+    }
+    return false;
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    SetState(updates[i].tx_id, updates[i].state);
+  }
+  return true;
+}
+
+bool SettlementIndex::Reserve(std::size_t records) { return journal_->Reserve(records); }
+
+bool SettlementIndex::ForEach(JournalVisitor* visitor) const { return journal_->ForEach(visitor); }
+
+bool SettlementIndex::CatchUp() {
+  class Merger : public JournalVisitor {
+   public:
+    explicit Merger(SettlementIndex* index) : index_(index) {}
+    void Visit(const LocalTransaction& tx) override { index_->Upsert(tx); }
+
+   private:
+    SettlementIndex* index_;
+  };
+  Merger merger(this);
+  return journal_->ForEach(&merger);
+}
+
+bool SettlementIndex::Persist(SnapshotStore* store) {
+  const std::size_t rows = hashes_.size();
+  image_.clear();
+  image_.reserve(kImageHeaderSize + rows * kRowImageSize);
+  PutBytes(&image_, kImageMagic, 4);
+  PutBytes(&image_, rows, 4);
+  PutBytes(&image_, payer_names_.names.size(), 4);
+  PutBytes(&image_, currency_names_.names.size(), 4);
+  for (const Dictionary* dictionary : {&payer_names_, &currency_names_}) {
+    for (const std::string& name : dictionary->names) {
+      const std::size_t length = std::min<std::size_t>(name.size(), 0xFFFF);
+      PutBytes(&image_, length, 2);
+      image_.insert(image_.end(), name.begin(), name.begin() + static_cast<std::ptrdiff_t>(length));
+    }
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    PutBytes(&image_, hashes_[i], 8);
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    PutBytes(&image_, static_cast<std::uint32_t>(amounts_[i]), 4);
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    PutBytes(&image_, created_at_[i], 4);
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    PutBytes(&image_, payers_[i], 4);
+  }
+  image_.insert(image_.end(), states_.begin(), states_.end());
+  image_.insert(image_.end(), currencies_.begin(), currencies_.end());
+  return store != nullptr && store->Write(image_.data(), image_.size());
+}
+
+bool SettlementIndex::Restore(const SnapshotStore& store) {
+  Clear();
+  if (!store.Read(&image_)) {
+    return false;
+  }
+  ImageReader reader(image_);
+  std::uint64_t magic = 0;
+  std::uint64_t rows = 0;
+  std::uint64_t payer_count = 0;
+  std::uint64_t currency_count = 0;
+  if (!reader.Get(4, &magic) || magic != kImageMagic || !reader.Get(4, &rows) || !reader.Get(4, &payer_count) ||
+      !reader.Get(4, &currency_count) || rows > options_.max_rows || currency_count > kMaxCurrencies) {
+    return false;
+  }
+  std::string name;
+  for (std::uint64_t i = 0; i < payer_count + currency_count; ++i) {
+    if (!reader.GetString(&name)) {
+      Clear();
+      return false;
+    }
+    Dictionary& dictionary = i < payer_count ? payer_names_ : currency_names_;
+    if (dictionary.Intern(name) != dictionary.names.size() - 1) {
+      Clear();  // Duplicate name.
+      return false;
+    }
+  }
+  if (reader.remaining() != rows * kRowImageSize) {
+    Clear();
+    return false;
+  }
+
+  hashes_.resize(rows);
+  amounts_.resize(rows);
+  created_at_.resize(rows);
+  payers_.resize(rows);
+  states_.resize(rows);
+  currencies_.resize(rows);
+  std::uint64_t value = 0;
+  bool ok = true;
+  for (std::size_t i = 0; i < rows; ++i) {
+    ok = ok && reader.Get(8, &value);
+    hashes_[i] = value;
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    ok = ok && reader.Get(4, &value);
+    amounts_[i] = static_cast<std::int32_t>(static_cast<std::uint32_t>(value));
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    ok = ok && reader.Get(4, &value);
+    created_at_[i] = static_cast<std::uint32_t>(value);
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    ok = ok && reader.Get(4, &value) && value < payer_count;
+    payers_[i] = static_cast<std::uint32_t>(value);
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    ok = ok && reader.Get(1, &value) && value < kTransactionStateCount;
+    states_[i] = static_cast<std::uint8_t>(value);
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    ok = ok && reader.Get(1, &value) && value < currency_count;
+    currencies_[i] = static_cast<std::uint8_t>(value);
+  }
+  if (!ok) {
+    Clear();
+    return false;
+  }
+  RebuildSlots();
+  // Two rows for one tx_id would double count.
+  for (std::size_t i = 0; i < rows; ++i) {
+    if (slots_[FindSlot(hashes_[i])] != i + 1) {
+      Clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+void SettlementIndex::Trim(std::uint64_t epoch_seconds) {
+  const std::uint32_t cutoff = ClampSeconds(epoch_seconds);
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < hashes_.size(); ++i) {
+    if (created_at_[i] < cutoff) {
+      continue;
+    }
+    hashes_[kept] = hashes_[i];
+    amounts_[kept] = amounts_[i];
+    created_at_[kept] = created_at_[i];
+    payers_[kept] = payers_[i];
+    states_[kept] = states_[i];
+    currencies_[kept] = currencies_[i];
+    ++kept;
+  }
+  hashes_.resize(kept);
+  amounts_.resize(kept);
+  created_at_.resize(kept);
+  payers_.resize(kept);
+  states_.resize(kept);
+  currencies_.resize(kept);
+  RebuildSlots();
+}
+
+void SettlementIndex::Clear() {
+  hashes_.clear();
+  amounts_.clear();
+  created_at_.clear();
+  payers_.clear();
+  states_.clear();
+  currencies_.clear();
+  std::fill(slots_.begin(), slots_.end(), 0);
+  payer_names_.Clear();
+  currency_names_.Clear();
+  staged_rows_.clear();
+  staged_count_ = 0;
+  unindexed_ = 0;
+}
+
+SettlementTotals SettlementIndex::Total(const SettlementFilter& filter) const {
+  SettlementTotals totals;
+  if (!Select(filter)) {
+    return totals;
+  }
+  const std::size_t rows = amounts_.size();
+  const std::int32_t* amounts = amounts_.data();
+  const std::uint8_t* selected = selected_.data();
+  std::int64_t cents = 0;
+  std::uint64_t count = 0;
+  for (std::size_t i = 0; i < rows; ++i) {
+    cents += static_cast<std::int64_t>(amounts[i]) * selected[i];
+    count += selected[i];
+  }
+  totals.amount_cents = cents;
+  totals.count = count;
+  return totals;
+}
+
+std::array<SettlementTotals, kTransactionStateCount> SettlementIndex::TotalsByState(
+    const SettlementFilter& filter) const {
+  std::array<SettlementTotals, kTransactionStateCount> totals{};
+  if (!Select(filter)) {
+    return totals;
+  }
+  // One pass per state keeps each loop a branch-free sum the compiler
+  // vectorizes; with six states that beats one scattering pass.
+  const std::size_t rows = amounts_.size();
+  const std::int32_t* amounts = amounts_.data();
+  const std::uint8_t* states = states_.data();
+  const std::uint8_t* selected = selected_.data();
+  for (std::size_t state = 0; state < kTransactionStateCount; ++state) {
+    if ((filter.state_mask >> state & 1) == 0) {
+      continue;
+    }
+    std::int64_t cents = 0;
+    std::uint64_t count = 0;
+    for (std::size_t i = 0; i < rows; ++i) {
+      const std::uint8_t hit = selected[i] & static_cast<std::uint8_t>(states[i] == state);
+      cents += static_cast<std::int64_t>(amounts[i]) * hit;
+      count += hit;
+    }
+    totals[state] = {cents, count};
+  }
+  return totals;
+}
+
+std::array<SettlementTotals, 24> SettlementIndex::TotalsByHour(const SettlementFilter& filter) const {
+  std::array<SettlementTotals, 24> totals{};
+  if (!Select(filter)) {
+    return totals;
+  }
+  // Shift into [0, 86400) once, so the hour is one division per row.
+  const std::int64_t shift = ((filter.utc_offset_seconds % 86400) + 86400) % 86400;
+  for (std::size_t i = 0; i < amounts_.size(); ++i) {
+    if (selected_[i] != 0) {
+      const std::size_t hour = static_cast<std::size_t>((created_at_[i] + shift) % 86400 / 3600);
+      totals[hour].amount_cents += amounts_[i];
+      ++totals[hour].count;
+    }
+  }
+  return totals;
+}
+
+void SettlementIndex::TotalsByCurrency(const SettlementFilter& filter,
+                                       std::vector<SettlementGroup>* groups_out) const {
+  groups_out->clear();
+  if (!Select(filter)) {
+    return;
+  }
+  // Few currencies: a vectorized pass each, as in TotalsByState().
+  const std::size_t rows = amounts_.size();
+  const std::int32_t* amounts = amounts_.data();
+  const std::uint8_t* currencies = currencies_.data();
+  const std::uint8_t* selected = selected_.data();
+  for (std::size_t currency = 0; currency < currency_names_.names.size(); ++currency) {
+    std::int64_t cents = 0;
+    std::uint64_t count = 0;
+    for (std::size_t i = 0; i < rows; ++i) {
+      const std::uint8_t hit = selected[i] & static_cast<std::uint8_t>(currencies[i] == currency);
+      cents += static_cast<std::int64_t>(amounts[i]) * hit;
+      count += hit;
+    }
+    if (count > 0) {
+      groups_out->push_back({currency_names_.names[currency], {cents, count}});
+    }
+  }
+}
+
+void SettlementIndex::TotalsByPayer(const SettlementFilter& filter,
+                                    std::vector<SettlementGroup>* groups_out) const {
+  groups_out->clear();
+  if (!Select(filter)) {
+    return;
+  }
+  group_totals_.assign(payer_names_.names.size(), SettlementTotals{});
+  for (std::size_t i = 0; i < amounts_.size(); ++i) {
+    SettlementTotals& totals = group_totals_[payers_[i]];
+    totals.amount_cents += static_cast<std::int64_t>(amounts_[i]) * selected_[i];
+    totals.count += selected_[i];
+  }
+  for (std::size_t payer = 0; payer < group_totals_.size(); ++payer) {
+    if (group_totals_[payer].count > 0) {
+      groups_out->push_back({payer_names_.names[payer], group_totals_[payer]});
+    }
+  }
+}
+
+SettlementIndexStats SettlementIndex::stats() const {
+  SettlementIndexStats stats;
+  stats.rows = hashes_.size();
+  stats.payers = payer_names_.names.size();
+  stats.unindexed = unindexed_;
+  return stats;
+}
+
+bool SettlementIndex::MakeRow(const LocalTransaction& tx, Row* row_out) {
+  const std::string_view currency(tx.currency);
+  if (currency_names_.ids.find(currency) == currency_names_.ids.end() &&
+      currency_names_.names.size() >= kMaxCurrencies) {
+    return false;
+  }
+  row_out->hash = HashTxId(tx.tx_id);
+  row_out->amount_cents = tx.amount_cents;
+  row_out->created_at = ClampSeconds(tx.created_at_epoch_seconds);
+  row_out->payer = payer_names_.Intern(tx.payer_account_id);
+  row_out->state = static_cast<std::uint8_t>(tx.state);
+  row_out->currency = static_cast<std::uint8_t>(currency_names_.Intern(currency));
+  return true;
+}
+
+void SettlementIndex::PutRow(const Row& row) {
+  const std::size_t slot = FindSlot(row.hash);
+  std::size_t index = slots_[slot];
+  if (index == kNoRow) {
+    if (hashes_.size() >= options_.max_rows) {
+      ++unindexed_;
+      return;
+    }
+    hashes_.push_back(row.hash);
+    amounts_.push_back(0);
+    created_at_.push_back(0);
+    payers_.push_back(0);
+    states_.push_back(0);
+    currencies_.push_back(0);
+    index = hashes_.size();
+    slots_[slot] = static_cast<std::uint32_t>(index);
+  }
+  const std::size_t i = index - 1;
+  amounts_[i] = row.amount_cents;
+  created_at_[i] = row.created_at;
+  payers_[i] = row.payer;
+  states_[i] = row.state;
+  currencies_[i] = row.currency;
+}
+
+void SettlementIndex::Upsert(const LocalTransaction& tx) {
+  Row row;
+  if (!MakeRow(tx, &row)) {
+    ++unindexed_;
+    return;
+  }
+  PutRow(row);
+}
+
+void SettlementIndex::SetState(std::string_view tx_id, TransactionState state) {
+  const std::size_t index = slots_[FindSlot(HashTxId(tx_id))];
+  if (index != kNoRow) {
+    states_[index - 1] = static_cast<std::uint8_t>(state);
+  }
+}
+
+void SettlementIndex::ApplyStaged() {
+  for (const Row& row : staged_rows_) {
+    PutRow(row);
+  }
+  staged_rows_.clear();
+  staged_count_ = 0;
+}
+
+void SettlementIndex::Reconcile(std::string_view tx_id) {
+  LocalTransaction tx;
+  if (journal_->Load(std::string(tx_id), &tx)) {
+    Upsert(tx);
+  }
+}
+
+void SettlementIndex::ReconcileStaged() {
+  for (std::size_t i = 0; i < staged_count_; ++i) {
+    Reconcile(staged_ids_[i]);
+  }
+  staged_rows_.clear();
+  staged_count_ = 0;
+}
+
+std::size_t SettlementIndex::FindSlot(std::uint64_t hash) const {
+  const std::size_t mask = slots_.size() - 1;
+  std::size_t slot = hash & mask;
+  while (slots_[slot] != kNoRow && hashes_[slots_[slot] - 1] != hash) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void SettlementIndex::RebuildSlots() {
+  std::fill(slots_.begin(), slots_.end(), 0);
+  for (std::size_t i = 0; i < hashes_.size(); ++i) {
+    const std::size_t slot = FindSlot(hashes_[i]);
+    if (slots_[slot] == kNoRow) {
+      slots_[slot] = static_cast<std::uint32_t>(i + 1);
+    }
+  }
+}
+
+bool SettlementIndex::Select(const SettlementFilter& filter) const {
+  const std::size_t rows = hashes_.size();
+  std::uint8_t currency = 0;
+  const bool any_currency = filter.currency.empty();
+  if (!any_currency) {
+    const auto it = currency_names_.ids.find(filter.currency);
+    if (it == currency_names_.ids.end()) {
+      return false;
+    }
+    currency = static_cast<std::uint8_t>(it->second);
+  }
+  if (rows == 0 || filter.to_epoch_seconds == 0 || filter.from_epoch_seconds >= filter.to_epoch_seconds ||
+      filter.from_epoch_seconds > 0xFFFFFFFFu) {
+    return false;
+  }
+  const auto from = static_cast<std::uint32_t>(filter.from_epoch_seconds);
+  const std::uint32_t last = ClampSeconds(filter.to_epoch_seconds - 1);
+  const std::uint32_t state_mask = filter.state_mask;
+
+  selected_.resize(rows);
+  const std::uint32_t* created_at = created_at_.data();
+  const std::uint8_t* states = states_.data();
+  const std::uint8_t* currencies = currencies_.data();
+  std::uint8_t* selected = selected_.data();
+  for (std::size_t i = 0; i < rows; ++i) {
+    selected[i] = static_cast<std::uint8_t>((created_at[i] >= from) & (created_at[i] <= last) &
+                                            (state_mask >> states[i] & 1) &
+                                            (any_currency | (currencies[i] == currency)));
+  }
+  return true;
+}
+
+}  // namespace offline_wallet
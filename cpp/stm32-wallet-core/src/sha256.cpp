@@ -0,0 +1,122 @@
+#include "offline_wallet/sha256.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace offline_wallet {
+
+namespace {
+
+constexpr std::array<std::uint32_t, 64> kRoundConstants = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr std::uint32_t Rotr(std::uint32_t value, int bits) { return value >> bits | value << (32 - bits); }
+
+}  // namespace
+
+void Sha256::Reset() {
+  state_ = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  block_size_ = 0;
+  total_bytes_ = 0;
+}
+
+void Sha256::Update(const void* data, std::size_t size) {
+  if (size == 0) {
+    return;  // An empty message may come with a null `data`.
+  }
+  const auto* bytes = static_cast<const std::uint8_t*>(data);
+  total_bytes_ += size;
+  if (block_size_ > 0) {
+    const std::size_t take = std::min(size, block_.size() - block_size_);
+    std::memcpy(block_.data() + block_size_, bytes, take);
+    block_size_ += take;
+    bytes += take;
+    size -= take;
+    if (block_size_ < block_.size()) {
+      return;
+    }
+    Compress(block_.data());
+    block_size_ = 0;
+  }
+  for (; size >= block_.size(); bytes += block_.size(), size -= block_.size()) {
+    Compress(bytes);
+  }
+  std::memcpy(block_.data(), bytes, size);
+  block_size_ = size;
+}
+
+void Sha256::Finish(Sha256Digest* digest_out) {
+  const std::uint64_t total_bits = total_bytes_ * 8;
+  block_[block_size_++] = 0x80;
+  if (block_size_ > block_.size() - 8) {
+    std::memset(block_.data() + block_size_, 0, block_.size() - block_size_);
+    Compress(block_.data());
+    block_size_ = 0;
+  }
+  std::memset(block_.data() + block_size_, 0, block_.size() - 8 - block_size_);
+  for (int i = 0; i < 8; ++i) {
+    block_[block_.size() - 1 - i] = static_cast<std::uint8_t>(total_bits >> (8 * i));
+  }
+  Compress(block_.data());
+  for (std::size_t i = 0; i < state_.size(); ++i) {
+    (*digest_out)[4 * i] = static_cast<std::uint8_t>(state_[i] >> 24);
+    (*digest_out)[4 * i + 1] = static_cast<std::uint8_t>(state_[i] >> 16);
+    (*digest_out)[4 * i + 2] = static_cast<std::uint8_t>(state_[i] >> 8);
+    (*digest_out)[4 * i + 3] = static_cast<std::uint8_t>(state_[i]);
+  }
+}
+
+Sha256Digest Sha256::Hash(const void* data, std::size_t size) {
+  Sha256 hash;
+  hash.Update(data, size);
+  Sha256Digest digest;
+  hash.Finish(&digest);
+  return digest;
+}
+
+void Sha256::Compress(const std::uint8_t* block) {
+  std::uint32_t w[64];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = static_cast<std::uint32_t>(block[4 * i]) << 24 | static_cast<std::uint32_t>(block[4 * i + 1]) << 16 |
+           static_cast<std::uint32_t>(block[4 * i + 2]) << 8 | static_cast<std::uint32_t>(block[4 * i + 3]);
+  }
+  for (int i = 16; i < 64; ++i) {
+    const std::uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    const std::uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  std::uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+  std::uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+  for (int i = 0; i < 64; ++i) {
+    const std::uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+                             kRoundConstants[static_cast<std::size_t>(i)] + w[i];
+    const std::uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  state_[4] += e;
+  state_[5] += f;
+  state_[6] += g;
+  state_[7] += h;
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,72 @@
+#include "offline_wallet/sharded_journal.hpp"
+
+#include <cstdint>
+
+#include "offline_wallet/byte_codec.hpp"
+
+namespace offline_wallet {
+
+ShardedJournal::ShardedJournal(const std::vector<TransactionJournal*>& shards)
+    : shards_(new Shard[shards.size()]), shard_count_(shards.size()) {
+  for (std::size_t i = 0; i < shard_count_; ++i) {
+    shards_[i].journal = shards[i];
+  }
+}
+
+bool ShardedJournal::Save(const LocalTransaction& tx) {
+  if (shard_count_ == 0) {
+    return false;
+  }
+  Shard& shard = shards_[ShardOf(tx.tx_id)];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.journal->Save(tx);
+}
+
+bool ShardedJournal::Load(const std::string& tx_id, LocalTransaction* tx_out) const {
+  if (shard_count_ == 0) {
+    return false;
+  }
+  const Shard& shard = shards_[ShardOf(tx_id)];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.journal->Load(tx_id, tx_out);
+}
+
+bool ShardedJournal::UpdateState(const std::string& tx_id,
+                                 TransactionState state,
+                                 const std::string& reason) {
+  if (shard_count_ == 0) {
+    return false;
+  }
+  Shard& shard = shards_[ShardOf(tx_id)];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.journal->UpdateState(tx_id, state, reason);
+}
+
+bool ShardedJournal::Reserve(std::size_t records) {
+  bool reserved = true;
+  for (std::size_t i = 0; i < shard_count_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    reserved = shards_[i].journal->Reserve(records) && reserved;
+  }
+  return reserved;
+}
+
+bool ShardedJournal::ForEach(JournalVisitor* visitor) const {
+  for (std::size_t i = 0; i < shard_count_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    if (!shards_[i].journal->ForEach(visitor)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::size_t ShardedJournal::ShardOf(std::string_view tx_id) const {
+  if (shard_count_ == 0) {
+    return 0;
+  }
+  // tx_ids end in random hex, so the low bits of the FNV-1a hash spread evenly.
+  return static_cast<std::size_t>(HashTxId(tx_id) % shard_count_);
+}
+
+}  // namespace offline_wallet
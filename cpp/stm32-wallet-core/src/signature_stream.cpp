@@ -0,0 +1,63 @@
+#include "offline_wallet/signature_stream.hpp"
+
+#include <charconv>
+#include <cstring>
+
+namespace offline_wallet {
+
+SignatureFieldWriter& SignatureFieldWriter::Field(std::string_view value) {
+  Separator();
+  signer_->Update(value.data(), value.size());
+  return *this;
+}
+
+SignatureFieldWriter& SignatureFieldWriter::Field(const char* value) {
+  Separator();
+  signer_->Update(value, std::strlen(value));
+  return *this;
+}
+
+SignatureFieldWriter& SignatureFieldWriter::Field(std::uint64_t value) {
+  char digits[20];
+  const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+  Separator();
+  signer_->Update(digits, static_cast<std::size_t>(result.ptr - digits));
+  return *this;
+}
+
+SignatureFieldWriter& SignatureFieldWriter::Field(std::int64_t value) {
+  char digits[20];
+  const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+  Separator();
+  signer_->Update(digits, static_cast<std::size_t>(result.ptr - digits));
+  return *this;
+}
+
+void SignatureFieldWriter::Separator() {
+  if (!first_) {
+    signer_->Update("|", 1);
+  }
+  first_ = false;
+}
+
+void SignatureProviderBridge::BeginSign(const std::string& key_id) {
+  key_.assign(key_id);
+  message_.clear();
+}
+
+void SignatureProviderBridge::BeginVerify(const std::string& public_key_or_id) {
+  key_.assign(public_key_or_id);
+  message_.clear();
+}
+
+void SignatureProviderBridge::Update(const char* data, std::size_t size) { message_.append(data, size); }
+
+void SignatureProviderBridge::FinishSign(std::string* signature_out) {
+  *signature_out = provider_->Sign(message_, key_);
+}
+
+bool SignatureProviderBridge::FinishVerify(const std::string& signature) {
+  return provider_->Verify(signature, message_, key_);
+}
+
+}  // namespace offline_wallet
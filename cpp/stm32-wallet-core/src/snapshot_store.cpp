@@ -0,0 +1,122 @@
+#include "offline_wallet/snapshot_store.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "offline_wallet/byte_codec.hpp"
+#include "offline_wallet/crc32.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+constexpr std::uint32_t kSnapshotMagic = 0x3153574F;  // "OWS1"
+constexpr std::size_t kHeaderSize = 16;
+constexpr std::size_t kNoSlot = static_cast<std::size_t>(-1);
+
+// The first 12 header bytes; the payload CRC continues from their CRC.
+void EncodeHeaderPrefix(std::uint32_t generation, std::uint32_t size, std::uint8_t* out) {
+  Put32(out, kSnapshotMagic);
+  Put32(out + 4, generation);
+  Put32(out + 8, size);
+}
+
+}  // namespace
+
+SnapshotStore::SnapshotStore(BlockDevice* device)
+    : device_(device), slot_sectors_(device != nullptr ? device->SectorCount() / 2 : 0) {}
+
+std::size_t SnapshotStore::Capacity() const {
+  if (slot_sectors_ == 0 || device_->ProgramSize() == 0 || kHeaderSize % device_->ProgramSize() != 0 ||
+      slot_sectors_ * device_->SectorSize() <= kHeaderSize) {
+    return 0;
+  }
+  return slot_sectors_ * device_->SectorSize() - kHeaderSize;
+}
+
+bool SnapshotStore::Write(const std::uint8_t* data, std::size_t size) {
+  if (Capacity() == 0 || size > Capacity() || (size > 0 && data == nullptr)) {
+    return false;
+  }
+  const std::size_t current = FindCurrent(nullptr);
+  const std::size_t target = current == kNoSlot ? 0 : 1 - current;
+  const std::uint32_t generation = current == kNoSlot ? 1 : generation_ + 1;
+
+  for (std::size_t sector = 0; sector < slot_sectors_; ++sector) {
+    if (!device_->Erase(target * slot_sectors_ + sector)) {
+      return false;
+    }
+  }
+
+  // Header space, payload, and padding to whole program units.
+  const std::size_t unit = device_->ProgramSize();
+  const std::size_t image_size = (kHeaderSize + size + unit - 1) / unit * unit;
+  scratch_.assign(image_size, 0xFF);
+  if (size > 0) {
+    std::memcpy(scratch_.data() + kHeaderSize, data, size);
+  }
+  const std::size_t sector_size = device_->SectorSize();
+  const std::size_t base = SlotBase(target);
+  for (std::size_t offset = kHeaderSize; offset < image_size;) {
+    const std::size_t chunk = std::min(image_size - offset, sector_size - offset % sector_size);
+    if (!device_->Program(base + offset, scratch_.data() + offset, chunk)) {
+      return false;
+    }
+    offset += chunk;
+  }
+  if (!device_->Sync()) {
+    return false;
+  }
+
+  std::uint8_t* header = scratch_.data();
+  EncodeHeaderPrefix(generation, static_cast<std::uint32_t>(size), header);
+  Put32(header + 12, Crc32(data, size, Crc32(header, 12)));
+  if (!device_->Program(base, header, kHeaderSize) || !device_->Sync()) {
+    return false;
+  }
+  generation_ = generation;
+  return true;
+}
+
+bool SnapshotStore::Read(std::vector<std::uint8_t>* data_out) const {
+  return data_out != nullptr && Capacity() != 0 && FindCurrent(data_out) != kNoSlot;
+}
+
+bool SnapshotStore::ReadHeader(std::size_t slot, SlotHeader* header_out) const {
+  std::uint8_t header[kHeaderSize];
+  if (!device_->Read(SlotBase(slot), header, sizeof(header)) || Get32(header) != kSnapshotMagic) {
+    return false;
+  }
+  header_out->generation = Get32(header + 4);
+  header_out->size = Get32(header + 8);
+  header_out->crc = Get32(header + 12);
+  return header_out->size <= Capacity();
+}
+
+bool SnapshotStore::ReadPayload(std::size_t slot,
+                                const SlotHeader& header,
+                                std::vector<std::uint8_t>* data_out) const {
+  data_out->resize(header.size);
+  if (header.size > 0 && !device_->Read(SlotBase(slot) + kHeaderSize, data_out->data(), header.size)) {
+    return false;
+  }
+  std::uint8_t prefix[12];
+  EncodeHeaderPrefix(header.generation, header.size, prefix);
+  return Crc32(data_out->data(), header.size, Crc32(prefix, sizeof(prefix))) == header.crc;
+}
+
+std::size_t SnapshotStore::FindCurrent(std::vector<std::uint8_t>* data_out) const {
+  SlotHeader headers[2];
+  const bool valid[2] = {ReadHeader(0, &headers[0]), ReadHeader(1, &headers[1])};
+  // Newest first; a damaged newer image falls back to the older one.
+  const std::size_t first = valid[1] && (!valid[0] || headers[1].generation > headers[0].generation) ? 1 : 0;
+  for (std::size_t slot : {first, 1 - first}) {
+    if (valid[slot] && ReadPayload(slot, headers[slot], data_out != nullptr ? data_out : &scratch_)) {
+      generation_ = headers[slot].generation;
+      return slot;
+    }
+  }
+  return kNoSlot;
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,251 @@
+#include "offline_wallet/spend_tracker.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "offline_wallet/byte_codec.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+constexpr std::size_t kWays = 4;
+
+// Image: [slots][bucket_count][bucket_seconds][clock][occupied], then per
+// occupied slot [slot][payer_hash:u64][newest_bucket:u64][total:i64]
+// [last_used] and its bucket ring. Little-endian u32 unless noted.
+constexpr std::size_t kImageHeaderSize = 20;
+constexpr std::size_t kImageSlotSize = 32;
+
+std::uint64_t HashPayer(const char* data, std::size_t size) {
+  const std::uint64_t hash = Fnv1a(data, size);
+  return hash == 0 ? 1 : hash;
+}
+
+bool CountsAsSpend(TransactionState state) {
+  return state == TransactionState::kAuthorized || state == TransactionState::kPendingSync ||
+         state == TransactionState::kSynced;
+}
+
+class RebuildVisitor : public JournalVisitor {
+ public:
+  RebuildVisitor(SpendTracker* tracker, std::uint64_t now) : tracker_(tracker), now_(now) {}
+
+  void Visit(const LocalTransaction& tx) override { tracker_->Count(tx, now_); }
+
+ private:
+  SpendTracker* tracker_;
+  std::uint64_t now_;
+};
+
+}  // namespace
+
+SpendTracker::SpendTracker(SpendTrackerOptions options) : options_(options) {
+  options_.bucket_count = std::max<std::uint32_t>(options_.bucket_count, 1);
+  options_.bucket_seconds = std::max<std::uint32_t>(options_.bucket_seconds, 1);
+  const std::size_t sets = std::max<std::size_t>((options_.payer_slots + kWays - 1) / kWays, 1);
+  slots_.assign(sets * kWays, PayerSlot{});
+  buckets_.assign(slots_.size() * options_.bucket_count, 0);
+}
+
+std::int64_t SpendTracker::SpendInWindow(std::string_view payer_account_id, std::uint64_t now) const {
+  return SpendForHash(HashPayer(payer_account_id.data(), payer_account_id.size()), now);
+}
+
+std::int64_t SpendTracker::SpendInWindow(const FixedId& payer_account_id, std::uint64_t now) const {
+  return SpendForHash(HashPayer(payer_account_id.data(), payer_account_id.size()), now);
+}
+
+void SpendTracker::Add(std::string_view payer_account_id,
+                       std::int64_t amount_cents,
+                       std::uint64_t at,
+                       std::uint64_t now) {
+  AddForHash(HashPayer(payer_account_id.data(), payer_account_id.size()), amount_cents, at, now);
+}
+
+void SpendTracker::Add(const FixedId& payer_account_id,
+                       std::int64_t amount_cents,
+                       std::uint64_t at,
+                       std::uint64_t now) {
+  AddForHash(HashPayer(payer_account_id.data(), payer_account_id.size()), amount_cents, at, now);
+}
+
+bool SpendTracker::Rebuild(const TransactionJournal& journal, std::uint64_t now) {
+  Clear();
+  RebuildVisitor visitor(this, now);
+  return journal.ForEach(&visitor);
+}
+
+void SpendTracker::Count(const LocalTransaction& tx, std::uint64_t now) {
+  if (!tx.payer_account_id.empty() && CountsAsSpend(tx.state)) {
+    Add(tx.payer_account_id, tx.amount_cents, tx.created_at_epoch_seconds, now);
+  }
+}
+
+void SpendTracker::AppendImage(std::vector<std::uint8_t>* image_out) const {
+  const std::size_t slot_size = kImageSlotSize + options_.bucket_count * sizeof(std::int32_t);
+  std::size_t occupied = 0;
+  for (const PayerSlot& payer : slots_) {
+    occupied += payer.payer_hash != 0 ? 1 : 0;
+  }
+  const std::size_t start = image_out->size();
+  image_out->resize(start + kImageHeaderSize + occupied * slot_size);
+  std::uint8_t* out = image_out->data() + start;
+  Put32(out, static_cast<std::uint32_t>(slots_.size()));
+  Put32(out + 4, options_.bucket_count);
+  Put32(out + 8, options_.bucket_seconds);
+  Put32(out + 12, clock_);
+  Put32(out + 16, static_cast<std::uint32_t>(occupied));
+  out += kImageHeaderSize;
+  for (std::size_t slot = 0; slot < slots_.size(); ++slot) {
+    const PayerSlot& payer = slots_[slot];
+    if (payer.payer_hash == 0) {
+      continue;
+    }
+    Put32(out, static_cast<std::uint32_t>(slot));
+    Put64(out + 4, payer.payer_hash);
+    Put64(out + 12, payer.newest_bucket);
+    Put64(out + 20, static_cast<std::uint64_t>(payer.total));
+    Put32(out + 28, payer.last_used);
+    const std::int32_t* ring = buckets_.data() + slot * options_.bucket_count;
+    for (std::uint32_t bucket = 0; bucket < options_.bucket_count; ++bucket) {
+      Put32(out + kImageSlotSize + bucket * sizeof(std::int32_t), static_cast<std::uint32_t>(ring[bucket]));
+    }
+    out += slot_size;
+  }
+}
+
+bool SpendTracker::RestoreImage(const std::uint8_t* image, std::size_t size) {
+  Clear();
+  const std::size_t slot_size = kImageSlotSize + options_.bucket_count * sizeof(std::int32_t);
+  if (image == nullptr || size < kImageHeaderSize || Get32(image) != slots_.size() ||
+      Get32(image + 4) != options_.bucket_count || Get32(image + 8) != options_.bucket_seconds ||
+      size != kImageHeaderSize + Get32(image + 16) * slot_size) {
+    return false;
+  }
+  clock_ = Get32(image + 12);
+  const std::uint8_t* in = image + kImageHeaderSize;
+  for (std::uint32_t entry = 0; entry < Get32(image + 16); ++entry, in += slot_size) {
+    const std::size_t slot = Get32(in);
+    const std::uint64_t payer_hash = Get64(in + 4);
+    if (slot >= slots_.size() || payer_hash == 0 || slots_[slot].payer_hash != 0 ||
+        SetBase(payer_hash) != slot / kWays * kWays) {
+      Clear();
+      return false;
+    }
+    PayerSlot& payer = slots_[slot];
+    payer.payer_hash = payer_hash;
+    payer.newest_bucket = Get64(in + 12);
+    payer.total = static_cast<std::int64_t>(Get64(in + 20));
+    payer.last_used = Get32(in + 28);
+    std::int32_t* ring = buckets_.data() + slot * options_.bucket_count;
+    for (std::uint32_t bucket = 0; bucket < options_.bucket_count; ++bucket) {
+      ring[bucket] = static_cast<std::int32_t>(Get32(in + kImageSlotSize + bucket * sizeof(std::int32_t)));
+    }
+  }
+  return true;
+}
+
+void SpendTracker::Clear() {
+  std::fill(slots_.begin(), slots_.end(), PayerSlot{});
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  clock_ = 0;
+}
+
+std::size_t SpendTracker::MemoryBytes() const {
+  return sizeof(*this) + slots_.size() * sizeof(PayerSlot) + buckets_.size() * sizeof(std::int32_t);
+}
+
+std::int64_t SpendTracker::SpendForHash(std::uint64_t payer_hash, std::uint64_t now) const {
+  const std::size_t base = SetBase(payer_hash);
+  for (std::size_t slot = base; slot < base + kWays; ++slot) {
+    const PayerSlot& payer = slots_[slot];
+    if (payer.payer_hash != payer_hash) {
+      continue;
+    }
+    // Subtract the buckets that `now` has pushed out of the window without
+    // mutating the ring; Add() performs the same expiry for real.
+    const std::uint64_t bucket = now / options_.bucket_seconds;
+    if (bucket <= payer.newest_bucket) {
+      return payer.total;
+    }
+    if (bucket - payer.newest_bucket >= options_.bucket_count) {
+      return 0;
+    }
+    std::int64_t total = payer.total;
+    const std::int32_t* ring = buckets_.data() + slot * options_.bucket_count;
+    for (std::uint64_t expired = payer.newest_bucket + 1; expired <= bucket; ++expired) {
+      total -= ring[expired % options_.bucket_count];
+    }
+    return total;
+  }
+  return 0;
+}
+
+void SpendTracker::AddForHash(std::uint64_t payer_hash,
+                              std::int64_t amount_cents,
+                              std::uint64_t at,
+                              std::uint64_t now) {
+  const std::uint64_t now_bucket = now / options_.bucket_seconds;
+  const std::uint64_t bucket = std::min(at / options_.bucket_seconds, now_bucket);
+  if (amount_cents <= 0 || bucket + options_.bucket_count <= now_bucket) {
+    return;
+  }
+
+  const std::size_t base = SetBase(payer_hash);
+  std::size_t chosen = base;
+  for (std::size_t slot = base; slot < base + kWays; ++slot) {
+    if (slots_[slot].payer_hash == payer_hash) {
+      chosen = slot;
+      break;
+    }
+    if (slots_[slot].payer_hash == 0 ||
+        (slots_[chosen].payer_hash != 0 && slots_[slot].last_used < slots_[chosen].last_used)) {
+      chosen = slot;
+    }
+  }
+  PayerSlot& payer = slots_[chosen];
+  std::int32_t* ring = buckets_.data() + chosen * options_.bucket_count;
+  if (payer.payer_hash != payer_hash) {
+    payer = PayerSlot{};
+    payer.payer_hash = payer_hash;
+    payer.newest_bucket = now_bucket;
+    std::fill(ring, ring + options_.bucket_count, 0);
+  }
+  Advance(chosen, now_bucket);
+  payer.last_used = ++clock_;
+
+  // A bucket older than the newest one belongs to a clock that moved back.
+  if (bucket + options_.bucket_count <= payer.newest_bucket) {
+    return;
+  }
+  std::int32_t& cell = ring[bucket % options_.bucket_count];
+  const std::int64_t room = std::numeric_limits<std::int32_t>::max() - static_cast<std::int64_t>(cell);
+  const std::int64_t added = std::min(amount_cents, room);
+  cell = static_cast<std::int32_t>(cell + added);
+  payer.total += added;
+}
+
+void SpendTracker::Advance(std::size_t slot, std::uint64_t bucket) {
+  PayerSlot& payer = slots_[slot];
+  if (bucket <= payer.newest_bucket) {
+    return;
+  }
+  std::int32_t* ring = buckets_.data() + slot * options_.bucket_count;
+  if (bucket - payer.newest_bucket >= options_.bucket_count) {
+    std::fill(ring, ring + options_.bucket_count, 0);
+    payer.total = 0;
+  } else {
+    for (std::uint64_t expired = payer.newest_bucket + 1; expired <= bucket; ++expired) {
+      payer.total -= ring[expired % options_.bucket_count];
+      ring[expired % options_.bucket_count] = 0;
+    }
+  }
+  payer.newest_bucket = bucket;
+}
+
+std::size_t SpendTracker::SetBase(std::uint64_t payer_hash) const {
+  return static_cast<std::size_t>(payer_hash % (slots_.size() / kWays)) * kWays;
+}
+
+}  // namespace offline_wallet
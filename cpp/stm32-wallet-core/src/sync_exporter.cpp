@@ -0,0 +1,237 @@
+#include "offline_wallet/sync_exporter.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+#include "offline_wallet/iso_time.hpp"
+
+namespace offline_wallet {
+
+namespace {
+
+// Keeps the `slots->size()` oldest pending writes past the cursor.
+class PendingVisitor : public JournalVisitor {
+ public:
+  PendingVisitor(std::vector<LocalTransaction>* slots, std::uint64_t cursor) : slots_(slots), cursor_(cursor) {}
+
+  void Visit(const LocalTransaction& tx) override {
+    if (tx.state != TransactionState::kPendingSync || (tx.sequence != 0 && tx.sequence <= cursor_)) {
+      return;
+    }
+    if (count_ < slots_->size()) {
+      (*slots_)[count_++] = tx;
+      return;
+    }
+    std::size_t newest = 0;
+    for (std::size_t i = 1; i < count_; ++i) {
+      if ((*slots_)[i].sequence > (*slots_)[newest].sequence) {
+        newest = i;
+      }
+    }
+    if (tx.sequence < (*slots_)[newest].sequence) {
+      (*slots_)[newest] = tx;
+    }
+  }
+
+  std::size_t count() const { return count_; }
+
+ private:
+  std::vector<LocalTransaction>* slots_;
+  std::uint64_t cursor_;
+  std::size_t count_ = 0;
+};
+
+// Appends to a caller buffer; an overflow is latched until Truncate().
+class JsonWriter {
+ public:
+  JsonWriter(char* buffer, std::size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+  void Raw(std::string_view text) {
+    if (text.size() > capacity_ - size_) {
+      overflow_ = true;
+      return;
+    }
+    std::memcpy(buffer_ + size_, text.data(), text.size());
+    size_ += text.size();
+  }
+
+  void String(std::string_view value) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    Raw("\"");
+    for (char c : value) {
+      const auto byte = static_cast<unsigned char>(c);
+      if (c == '"' || c == '\\') {
+        const char escaped[2] = {'\\', c};
+        Raw(std::string_view(escaped, sizeof(escaped)));
+      } else if (byte < 0x20) {
+        const char escaped[6] = {'\\', 'u', '0', '0', kHex[byte >> 4], kHex[byte & 0x0F]};
+        Raw(std::string_view(escaped, sizeof(escaped)));
+      } else {
+        Raw(std::string_view(&c, 1));
+      }
+    }
+    Raw("\"");
+  }
+
+  template <typename Int>
+  void Number(Int value) {
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    Raw(std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)));
+  }
+
+  void Timestamp(std::uint64_t epoch_seconds) {
+    char text[kIsoTimestampSize + 2];
+    text[0] = '"';
+    FormatIsoTimestamp(epoch_seconds, text + 1);
+    text[kIsoTimestampSize + 1] = '"';
+    Raw(std::string_view(text, sizeof(text)));
+  }
+
+  std::size_t size() const { return size_; }
+  bool overflow() const { return overflow_; }
+  void Truncate(std::size_t size) {
+    size_ = size;
+    overflow_ = false;
+  }
+
+ private:
+  char* buffer_;
+  std::size_t capacity_;
+  std::size_t size_ = 0;
+  bool overflow_ = false;
+};
+
+void WriteTransaction(const LocalTransaction& tx, JsonWriter* json) {
+  json->Raw("{\"txId\":");
+  json->String(tx.tx_id);
+  json->Raw(",\"idempotencyKey\":");
+  json->String(tx.idempotency_key);
+  json->Raw(",\"merchantIntentId\":");
+  json->String(tx.merchant_intent_id);
+  json->Raw(",\"payerAuthorizationId\":");
+  json->String(tx.payer_authorization_id);
+  json->Raw(",\"merchantAccountId\":");
+  json->String(tx.merchant_account_id);
+  json->Raw(",\"payerAccountId\":");
+  json->String(tx.payer_account_id);
+  json->Raw(",\"merchantDeviceId\":");
+  json->String(tx.merchant_device_id);
+  json->Raw(",\"payerDeviceId\":");
+  json->String(tx.payer_device_id);
+  json->Raw(",\"amountCents\":");
+  json->Number(tx.amount_cents);
+  json->Raw(",\"currency\":");
+  json->String(tx.currency);
+  json->Raw(",\"merchantNonce\":");
+  json->String(tx.merchant_nonce);
+  json->Raw(",\"payerNonce\":");
+  json->String(tx.payer_nonce);
+  json->Raw(",\"merchantCounter\":");
+  json->Number(tx.merchant_counter);
+  json->Raw(",\"payerCounter\":");
+  json->Number(tx.payer_counter);
+  json->Raw(",\"intentIssuedAt\":");
+  json->Timestamp(tx.intent_issued_at_epoch_seconds);
+  json->Raw(",\"authorizationIssuedAt\":");
+  json->Timestamp(tx.authorized_at_epoch_seconds);
+  json->Raw(",\"expiresAt\":");
+  json->Timestamp(tx.expires_at_epoch_seconds);
+  json->Raw(",\"merchantSignature\":");
+  json->String(tx.merchant_signature);
+  json->Raw(",\"payerSignature\":");
+  json->String(tx.payer_signature);
+  json->Raw("}");
+}
+
+}  // namespace
+
+SyncExporter::SyncExporter(TransactionJournal* journal,
+                           const ClockProvider* clock,
+                           std::string merchant_device_id,
+                           SyncExportOptions options)
+    : journal_(journal),
+      clock_(clock),
+      merchant_device_id_(std::move(merchant_device_id)),
+      options_(options),
+      selected_(std::max<std::size_t>(options.max_transactions, 1)) {}
+
+SyncExportStatus SyncExporter::NextChunk(char* buffer, std::size_t capacity, SyncChunk* chunk_out) {
+  if (buffer == nullptr || chunk_out == nullptr) {
+    return SyncExportStatus::kBufferTooSmall;
+  }
+  PendingVisitor visitor(&selected_, cursor_);
+  if (!journal_->ForEach(&visitor)) {
+    return SyncExportStatus::kJournalFailure;
+  }
+  if (visitor.count() == 0) {
+    return SyncExportStatus::kNothingPending;
+  }
+  const auto first = selected_.begin();
+  const auto last = first + static_cast<std::ptrdiff_t>(visitor.count());
+  std::sort(first, last, [](const LocalTransaction& a, const LocalTransaction& b) {
+    return a.sequence < b.sequence;
+  });
+
+  JsonWriter json(buffer, capacity);
+  json.Raw("{\"merchantDeviceId\":");
+  json.String(merchant_device_id_);
+  json.Raw(",\"submittedAt\":");
+  json.Timestamp(clock_->NowUnixSeconds());
+  json.Raw(",\"transactions\":[");
+
+  SyncChunk chunk;
+  chunk.last_sequence = cursor_;
+  constexpr std::string_view kClose = "]}";
+  for (auto it = first; it != last; ++it) {
+    const std::size_t mark = json.size();
+    if (chunk.transactions > 0) {
+      json.Raw(",");
+    }
+    WriteTransaction(*it, &json);
+    if (json.overflow() || capacity - json.size() < kClose.size()) {
+      json.Truncate(mark);
+      break;
+    }
+    ++chunk.transactions;
+    chunk.last_sequence = std::max(chunk.last_sequence, it->sequence);
+  }
+  if (chunk.transactions == 0) {
+    return SyncExportStatus::kBufferTooSmall;
+  }
+  json.Raw(kClose);
+  chunk.bytes = json.size();
+  *chunk_out = chunk;
+  return SyncExportStatus::kOk;
+}
+
+void SyncExporter::Acknowledge(const SyncChunk& chunk) { cursor_ = std::max(cursor_, chunk.last_sequence); }
+
+SyncExportStatus SyncExporter::ApplyResults(const SyncChunk& chunk,
+                                            const SyncResult* results,
+                                            std::size_t count) {
+  if (count > 0 && results == nullptr) {
+    return SyncExportStatus::kJournalFailure;
+  }
+  updates_.resize(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const bool rejected = results[i].status == SyncResultStatus::kRejected;
+    updates_[i].tx_id = results[i].tx_id;
+    updates_[i].state = rejected ? TransactionState::kRejected : TransactionState::kSynced;
+    if (rejected) {
+      updates_[i].reason = results[i].reason;
+    } else {
+      updates_[i].reason.clear();
+    }
+  }
+  if (!journal_->UpdateStates(updates_.data(), count)) {
+    return SyncExportStatus::kJournalFailure;
+  }
+  Acknowledge(chunk);
+  return SyncExportStatus::kOk;
+}
+
+}  // namespace offline_wallet
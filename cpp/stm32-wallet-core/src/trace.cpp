@@ -0,0 +1,134 @@
+#include "offline_wallet/trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+namespace offline_wallet {
+
+namespace {
+
+std::size_t HistogramBucket(std::uint32_t ticks) {
+  std::size_t bucket = 0;
+  while (ticks != 0 && bucket + 1 < kTraceHistogramBuckets) {
+    ticks >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+}  // namespace
+
+const char* TraceStageName(TraceStage stage) {
+  switch (stage) {
+    case TraceStage::kBuildMerchantIntent:
+      return "build_merchant_intent";
+    case TraceStage::kBuildPayerAuthorization:
+      return "build_payer_authorization";
+    case TraceStage::kAcceptAuthorization:
+      return "accept_authorization";
+    case TraceStage::kSign:
+      return "sign";
+    case TraceStage::kRandom:
+      return "random";
+    case TraceStage::kJournalLoad:
+      return "journal_load";
+    case TraceStage::kJournalWrite:
+      return "journal_write";
+    case TraceStage::kVerify:
+      return "verify";
+  }
+  return "unknown";
+}
+
+std::uint32_t HostTraceTicks() {
+  const auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+TraceCounters::TraceCounters(TraceClock clock, TraceSink* next) : clock_(clock), next_(next) {}
+
+void TraceCounters::OnBegin(TraceStage stage) {
+  if (depth_ < kMaxDepth) {
+    open_[depth_] = OpenSpan{stage, clock_(), 0};
+  }
+  ++depth_;
+  if (next_ != nullptr) {
+    next_->OnBegin(stage);
+  }
+}
+
+void TraceCounters::OnEnd(TraceStage stage, std::int32_t status) {
+  const std::uint32_t now = clock_();
+  if (next_ != nullptr) {
+    next_->OnEnd(stage, status);
+  }
+  if (depth_ == 0) {
+    return;
+  }
+  --depth_;
+  // Spans nested deeper than kMaxDepth, or mismatched, are not timed.
+  if (depth_ >= kMaxDepth || open_[depth_].stage != stage) {
+    return;
+  }
+
+  const std::uint32_t span = now - open_[depth_].start;
+  TraceStageStats& stats = stats_[static_cast<std::size_t>(stage)];
+  ++stats.count;
+  stats.failures += status != 0 ? 1 : 0;
+  stats.total_ticks += span;
+  stats.self_ticks += span > open_[depth_].child_ticks ? span - open_[depth_].child_ticks : 0;
+  stats.max_ticks = span > stats.max_ticks ? span : stats.max_ticks;
+  ++stats.histogram[HistogramBucket(span)];
+  if (depth_ > 0 && depth_ - 1 < kMaxDepth) {
+    open_[depth_ - 1].child_ticks += span;
+  }
+}
+
+const TraceStageStats& TraceCounters::stats(TraceStage stage) const {
+  return stats_[static_cast<std::size_t>(stage)];
+}
+
+void TraceCounters::Reset() {
+  for (TraceStageStats& stats : stats_) {
+    stats = TraceStageStats{};
+  }
+  depth_ = 0;
+}
+
+std::size_t TraceCounters::Format(char* out, std::size_t capacity) const {
+  std::size_t length = 0;
+  const auto append = [&](int written) {
+    if (written > 0 && capacity > 0) {
+      length += static_cast<std::size_t>(written);
+      length = length < capacity ? length : capacity - 1;
+    }
+  };
+  if (capacity > 0) {
+    out[0] = '\0';
+  }
+  for (std::size_t index = 0; index < kTraceStageCount; ++index) {
+    const TraceStageStats& stats = stats_[index];
+    if (stats.count == 0) {
+      continue;
+    }
+    append(std::snprintf(out + length, capacity - length,
+                         "%s count=%lu failures=%lu total=%llu self=%llu max=%lu hist=",
+                         TraceStageName(static_cast<TraceStage>(index)),
+                         static_cast<unsigned long>(stats.count), static_cast<unsigned long>(stats.failures),
+                         static_cast<unsigned long long>(stats.total_ticks),
+                         static_cast<unsigned long long>(stats.self_ticks),
+                         static_cast<unsigned long>(stats.max_ticks)));
+    std::size_t last = kTraceHistogramBuckets;
+    while (last > 0 && stats.histogram[last - 1] == 0) {
+      --last;
+    }
+    for (std::size_t bucket = 0; bucket < last; ++bucket) {
+      append(std::snprintf(out + length, capacity - length, bucket == 0 ? "%lu" : ",%lu",
+                           static_cast<unsigned long>(stats.histogram[bucket])));
+    }
+    append(std::snprintf(out + length, capacity - length, "\n"));
+  }
+  return length;
+}
+
+}  // namespace offline_wallet
@@ -0,0 +1,699 @@
+#include "offline_wallet/wire_codec.hpp"
+
+#include <cstring>
+#include <string>
+
+namespace offline_wallet {
+
+namespace {
+
+enum TextMode : std::uint8_t {
+  kVerbatim = 0,
+  kHex = 1,
+  kPrefixedHex = 2,
+  kUuid = 3,
+};
+
+constexpr std::size_t kUuidTextLength = 36;
+constexpr std::size_t kUuidBytes = 16;
+constexpr std::size_t kMaxDecodedText = 600;
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+bool IsLowerHex(const char* text, std::size_t size) {
+  if (size == 0 || size % 2 != 0) {
+    return false;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    if (HexValue(text[i]) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IsDashPosition(std::size_t index) { return index == 8 || index == 13 || index == 18 || index == 23; }
+
+bool IsCanonicalUuid(const char* text, std::size_t size) {
+  if (size != kUuidTextLength) {
+    return false;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    if (IsDashPosition(i) ? text[i] != '-' : HexValue(text[i]) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+class WireWriter {
+ public:
+  WireWriter(std::uint8_t* buffer, std::size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+  void Byte(std::uint8_t value) {
+    if (size_ >= capacity_) {
+      overflow_ = true;
+      return;
+    }
+    buffer_[size_++] = value;
+  }
+
+  void Varint(std::uint64_t value) {
+    while (value >= 0x80) {
+      Byte(static_cast<std::uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    Byte(static_cast<std::uint8_t>(value));
+  }
+
+  void Raw(const char* data, std::size_t size) {
+    if (size > capacity_ - size_) {
+      overflow_ = true;
+      size_ = capacity_;
+      return;
+    }
+    std::memcpy(buffer_ + size_, data, size);
+    size_ += size;
+  }
+
+  void PackHex(const char* text, std::size_t size) {
+    for (std::size_t i = 0; i + 1 < size; i += 2) {
+      Byte(static_cast<std::uint8_t>(HexValue(text[i]) << 4 | HexValue(text[i + 1])));
+    }
+  }
+
+  template <typename Value>
+  void Text(const Value& value, const char* prefix) {
+    const char* data = value.data();
+    const std::size_t size = value.size();
+    const std::size_t prefix_size = prefix ? std::strlen(prefix) : 0;
+    if (prefix_size > 0 && size > prefix_size && std::memcmp(data, prefix, prefix_size) == 0 &&
+        IsLowerHex(data + prefix_size, size - prefix_size)) {
+      Varint((size - prefix_size) / 2 << 2 | kPrefixedHex);
+      PackHex(data + prefix_size, size - prefix_size);
+    } else if (IsLowerHex(data, size)) {
+      Varint(size / 2 << 2 | kHex);
+      PackHex(data, size);
+    } else if (IsCanonicalUuid(data, size)) {
+      Varint(kUuidBytes << 2 | kUuid);
+      for (std::size_t i = 0; i < size; i += IsDashPosition(i) ? 1 : 2) {
+        if (!IsDashPosition(i)) {
+          PackHex(data + i, 2);
+        }
+      }
+    } else {
+      Varint(size << 2 | kVerbatim);
+      Raw(data, size);
+    }
+  }
+
+  std::size_t size() const { return size_; }
+  bool overflow() const { return overflow_; }
+
+ private:
+  std::uint8_t* buffer_;
+  std::size_t capacity_;
+  std::size_t size_ = 0;
+  bool overflow_ = false;
+};
+
+bool AssignText(const char* data, std::size_t size, std::pmr::string* out) {
+  out->assign(data, size);
+  return true;
+}
+
+template <std::size_t Capacity>
+bool AssignText(const char* data, std::size_t size, FixedString<Capacity>* out) {
+  return out->Assign(data, size);
+}
+
+// Each read returns false once anything has failed; the first failure is
+// latched and reported by Finish().
+class WireReader {
+ public:
+  WireReader(const std::uint8_t* buffer, std::size_t size) : buffer_(buffer), size_(size) {}
+
+  bool Byte(std::uint8_t* value) {
+    if (!Ok()) {
+      return false;
+    }
+    if (offset_ >= size_) {
+      return Fail(WireStatus::kTruncated);
+    }
+    *value = buffer_[offset_++];
+    return true;
+  }
+
+  bool Varint(std::uint64_t* value) {
+    std::uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      std::uint8_t byte = 0;
+      if (!Byte(&byte)) {
+        return false;
+      }
+      result |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        *value = result;
+        return true;
+      }
+    }
+    return Fail(WireStatus::kMalformed);
+  }
+
+  template <typename Int>
+  bool Unsigned(Int* value) {
+    std::uint64_t raw = 0;
+    if (!Varint(&raw)) {
+      return false;
+    }
+    if (raw > static_cast<std::uint64_t>(static_cast<Int>(~static_cast<Int>(0)))) {
+      return Fail(WireStatus::kMalformed);
+    }
+    *value = static_cast<Int>(raw);
+    return true;
+  }
+
+  bool Amount(std::int32_t* value) {
+    std::uint32_t zigzag = 0;
+    if (!Unsigned(&zigzag)) {
+      return false;
+    }
+    *value = static_cast<std::int32_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+    return true;
+  }
+
+  template <typename Value>
+  bool Currency(Value* out) {
+    if (!Ok()) {
+      return false;
+    }
+    if (kWireCurrencyBytes > size_ - offset_) {
+      return Fail(WireStatus::kTruncated);
+    }
+    const char* data = reinterpret_cast<const char*>(buffer_ + offset_);
+    offset_ += kWireCurrencyBytes;
+    return AssignText(data, kWireCurrencyBytes, out) || Fail(WireStatus::kInvalidField);
+  }
+
+  template <typename Value>
+  bool Text(const char* prefix, Value* out) {
+    std::uint64_t header = 0;
+    if (!Varint(&header)) {
+      return false;
+    }
+    const std::uint8_t mode = static_cast<std::uint8_t>(header & 0x03);
+    const std::uint64_t length = header >> 2;
+    const std::size_t prefix_size = prefix ? std::strlen(prefix) : 0;
+    const std::uint64_t decoded = mode == kVerbatim      ? length
+                                  : mode == kHex         ? length * 2
+                                  : mode == kPrefixedHex ? prefix_size + length * 2
+                                                         : kUuidTextLength;
+    if ((mode == kPrefixedHex && prefix_size == 0) || (mode == kUuid && length != kUuidBytes) ||
+        decoded > kMaxDecodedText) {
+      return Fail(WireStatus::kMalformed);
+    }
+    if (length > size_ - offset_) {
+      return Fail(WireStatus::kTruncated);
+    }
+    const std::uint8_t* bytes = buffer_ + offset_;
+    offset_ += static_cast<std::size_t>(length);
+    if (mode == kVerbatim) {
+      return AssignText(reinterpret_cast<const char*>(bytes), static_cast<std::size_t>(length), out) ||
+             Fail(WireStatus::kInvalidField);
+    }
+
+    char scratch[kMaxDecodedText];
+    std::size_t used = 0;
+    if (mode == kPrefixedHex) {
+      std::memcpy(scratch, prefix, prefix_size);
+      used = prefix_size;
+    }
+    for (std::size_t i = 0; i < length; ++i) {
+      if (mode == kUuid && IsDashPosition(used)) {
+        scratch[used++] = '-';
+      }
+      scratch[used++] = kHexDigits[bytes[i] >> 4];
+      scratch[used++] = kHexDigits[bytes[i] & 0x0F];
+    }
+    return AssignText(scratch, used, out) || Fail(WireStatus::kInvalidField);
+  }
+
+  bool Header(WireMessageType expected) {
+    std::uint8_t version = 0;
+    std::uint8_t type = 0;
+    if (!Byte(&version) || !Byte(&type)) {
+      return false;
+    }
+    if (version != kWireFormatVersion) {
+      return Fail(WireStatus::kUnsupportedVersion);
+    }
+    if (type != static_cast<std::uint8_t>(expected)) {
+      return Fail(WireStatus::kWrongType);
+    }
+    return true;
+  }
+
+  // True while unread bytes remain and nothing has failed.
+  bool More() const { return Ok() && offset_ < size_; }
+  void SkipRest() { offset_ = size_; }
+
+  WireStatus Finish() {
+    if (Ok() && offset_ != size_) {
+      Fail(WireStatus::kMalformed);
+    }
+    return status_;
+  }
+
+  bool Fail(WireStatus status) {
+    if (Ok()) {
+      status_ = status;
+    }
+    return false;
+  }
+
+ private:
+  bool Ok() const { return status_ == WireStatus::kOk; }
+
+  const std::uint8_t* buffer_;
+  std::size_t size_;
+  std::size_t offset_ = 0;
+  WireStatus status_ = WireStatus::kOk;
+};
+
+std::uint32_t ZigZag(std::int32_t value) {
+  return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+}
+
+WireStatus FinishEncode(const WireWriter& writer, std::size_t* written_out) {
+  if (writer.overflow()) {
+    return WireStatus::kBufferTooSmall;
+  }
+  *written_out = writer.size();
+  return WireStatus::kOk;
+}
+
+void WriteHeader(WireWriter* writer, WireMessageType type) {
+  writer->Byte(kWireFormatVersion);
+  writer->Byte(static_cast<std::uint8_t>(type));
+}
+
+template <typename Intent>
+WireStatus EncodeIntentImpl(const Intent& intent,
+                            std::uint8_t* buffer,
+                            std::size_t capacity,
+                            std::size_t* written_out) {
+  if (!buffer || !written_out) {
+    return WireStatus::kBufferTooSmall;
+  }
+  if (intent.currency.size() != kWireCurrencyBytes ||
+      intent.expires_at_epoch_seconds < intent.issued_at_epoch_seconds) {
+    return WireStatus::kInvalidField;
+  }
+
+  WireWriter writer(buffer, capacity);
+  WriteHeader(&writer, WireMessageType::kIntent);
+  writer.Text(intent.tx_id, "tx-");
+  writer.Text(intent.merchant_intent_id, "mi-");
+  writer.Text(intent.merchant_account_id, nullptr);
+  writer.Text(intent.merchant_device_id, nullptr);
+  writer.Varint(ZigZag(intent.amount_cents));
+  writer.Raw(intent.currency.data(), kWireCurrencyBytes);
+  writer.Text(intent.merchant_nonce, nullptr);
+  writer.Varint(intent.merchant_counter);
+  writer.Varint(intent.issued_at_epoch_seconds);
+  writer.Varint(intent.expires_at_epoch_seconds - intent.issued_at_epoch_seconds);
+  writer.Text(intent.merchant_signature, nullptr);
+  return FinishEncode(writer, written_out);
+}
+
+template <typename Authorization>
+WireStatus EncodeAuthorizationImpl(const Authorization& authorization,
+                                   std::uint8_t* buffer,
+                                   std::size_t capacity,
+                                   std::size_t* written_out) {
+  if (!buffer || !written_out) {
+    return WireStatus::kBufferTooSmall;
+  }
+  if (authorization.currency.size() != kWireCurrencyBytes) {
+    return WireStatus::kInvalidField;
+  }
+
+  WireWriter writer(buffer, capacity);
+  WriteHeader(&writer, WireMessageType::kAuthorization);
+  writer.Text(authorization.tx_id, "tx-");
+  writer.Text(authorization.merchant_intent_id, "mi-");
+  writer.Text(authorization.payer_authorization_id, "pa-");
+  writer.Text(authorization.payer_account_id, nullptr);
+  writer.Text(authorization.payer_device_id, nullptr);
+  writer.Varint(ZigZag(authorization.amount_cents));
+  writer.Raw(authorization.currency.data(), kWireCurrencyBytes);
+  writer.Text(authorization.payer_nonce, nullptr);
+  writer.Varint(authorization.payer_counter);
+  writer.Varint(authorization.authorized_at_epoch_seconds);
+  writer.Text(authorization.payer_signature, nullptr);
+  return FinishEncode(writer, written_out);
+}
+
+// A PaymentReceipt covered by a ReceiptChain checkpoint appends its chain
+// position; signed receipts encode exactly as before.
+void WriteChainTail(WireWriter* writer, const PaymentReceipt& receipt) {
+  if (receipt.chain_position != 0) {
+    writer->Varint(receipt.chain_position);
+  }
+}
+
+void WriteChainTail(WireWriter* /*writer*/, const FixedPaymentReceipt& /*receipt*/) {}
+
+void ReadChainTail(WireReader* reader, PaymentReceipt* receipt) {
+  if (reader->More()) {
+    reader->Varint(&receipt->chain_position);
+  }
+}
+
+void ReadChainTail(WireReader* reader, FixedPaymentReceipt* /*receipt*/) { reader->SkipRest(); }
+
+template <typename Receipt>
+WireStatus EncodeReceiptImpl(const Receipt& receipt,
+                             std::uint8_t* buffer,
+                             std::size_t capacity,
+                             std::size_t* written_out) {
+  if (!buffer || !written_out) {
+    return WireStatus::kBufferTooSmall;
+  }
+  if (receipt.currency.size() != kWireCurrencyBytes) {
+    return WireStatus::kInvalidField;
+  }
+
+  WireWriter writer(buffer, capacity);
+  WriteHeader(&writer, WireMessageType::kReceipt);
+  writer.Text(receipt.tx_id, "tx-");
+  writer.Text(receipt.receipt_id, "r-");
+  writer.Text(receipt.merchant_account_id, nullptr);
+  writer.Text(receipt.payer_account_id, nullptr);
+  writer.Varint(ZigZag(receipt.amount_cents));
+  writer.Raw(receipt.currency.data(), kWireCurrencyBytes);
+  writer.Byte(static_cast<std::uint8_t>(receipt.status));
+  writer.Varint(receipt.created_at_epoch_seconds);
+  writer.Text(receipt.merchant_signature, nullptr);
+  WriteChainTail(&writer, receipt);
+  return FinishEncode(writer, written_out);
+}
+
+// LocalTransaction appends a sync tail after the fields it shares with
+// FixedLocalTransaction. Records without one (journaled before the tail
+// existed, or by the fixed model) still decode; the fixed model skips it.
+void WriteSyncTail(WireWriter* writer, const LocalTransaction& tx, std::uint64_t sequence) {
+  writer->Varint(sequence);
+  writer->Varint(tx.intent_issued_at_epoch_seconds);
+  writer->Varint(tx.authorized_at_epoch_seconds);
+  writer->Varint(tx.expires_at_epoch_seconds);
+  writer->Text(tx.merchant_signature, nullptr);
+  writer->Text(tx.payer_signature, nullptr);
+}
+
+void WriteSyncTail(WireWriter* /*writer*/, const FixedLocalTransaction& /*tx*/, std::uint64_t /*sequence*/) {}
+
+void ReadSyncTail(WireReader* reader, LocalTransaction* tx) {
+  if (reader->More()) {
+    reader->Varint(&tx->sequence) && reader->Varint(&tx->intent_issued_at_epoch_seconds) &&
+        reader->Varint(&tx->authorized_at_epoch_seconds) && reader->Varint(&tx->expires_at_epoch_seconds) &&
+        reader->Text(nullptr, &tx->merchant_signature) && reader->Text(nullptr, &tx->payer_signature);
+  }
+}
+
+void ReadSyncTail(WireReader* reader, FixedLocalTransaction* /*tx*/) { reader->SkipRest(); }
+
+template <typename Transaction>
+WireStatus EncodeLocalTransactionImpl(const Transaction& tx,
+                                      std::uint64_t sequence,
+                                      std::uint8_t* buffer,
+                                      std::size_t capacity,
+                                      std::size_t* written_out) {
+  if (!buffer || !written_out) {
+    return WireStatus::kBufferTooSmall;
+  }
+  if (tx.currency.size() != kWireCurrencyBytes) {
+    return WireStatus::kInvalidField;
+  }
+
+  WireWriter writer(buffer, capacity);
+  WriteHeader(&writer, WireMessageType::kLocalTransaction);
+  writer.Text(tx.tx_id, "tx-");
+  writer.Text(tx.merchant_account_id, nullptr);
+  writer.Text(tx.payer_account_id, nullptr);
+  writer.Text(tx.merchant_device_id, nullptr);
+  writer.Text(tx.payer_device_id, nullptr);
+  writer.Varint(ZigZag(tx.amount_cents));
+  writer.Raw(tx.currency.data(), kWireCurrencyBytes);
+  writer.Text(tx.merchant_intent_id, "mi-");
+  writer.Text(tx.payer_authorization_id, "pa-");
+  writer.Text(tx.merchant_nonce, nullptr);
+  writer.Text(tx.payer_nonce, nullptr);
+  writer.Varint(tx.merchant_counter);
+  writer.Varint(tx.payer_counter);
+  writer.Byte(static_cast<std::uint8_t>(tx.state));
+  writer.Text(tx.failure_reason, nullptr);
+  writer.Varint(tx.created_at_epoch_seconds);
+  writer.Varint(tx.updated_at_epoch_seconds);
+  writer.Text(tx.idempotency_key, nullptr);
+  WriteSyncTail(&writer, tx, sequence);
+  return FinishEncode(writer, written_out);
+}
+
+template <typename Intent>
+WireStatus DecodeIntentImpl(const std::uint8_t* buffer, std::size_t size, Intent* intent_out) {
+  if (!buffer || !intent_out) {
+    return WireStatus::kInvalidField;
+  }
+  WireReader reader(buffer, size);
+  Intent intent{};
+  std::uint64_t ttl = 0;
+  if (reader.Header(WireMessageType::kIntent) && reader.Text("tx-", &intent.tx_id) &&
+      reader.Text("mi-", &intent.merchant_intent_id) && reader.Text(nullptr, &intent.merchant_account_id) &&
+      reader.Text(nullptr, &intent.merchant_device_id) && reader.Amount(&intent.amount_cents) &&
+      reader.Currency(&intent.currency) && reader.Text(nullptr, &intent.merchant_nonce) &&
+      reader.Unsigned(&intent.merchant_counter) && reader.Varint(&intent.issued_at_epoch_seconds) &&
+      reader.Varint(&ttl) && reader.Text(nullptr, &intent.merchant_signature)) {
+    intent.expires_at_epoch_seconds = intent.issued_at_epoch_seconds + ttl;
+    if (intent.expires_at_epoch_seconds < intent.issued_at_epoch_seconds) {
+      reader.Fail(WireStatus::kMalformed);
+    }
+  }
+  const WireStatus status = reader.Finish();
+  if (status == WireStatus::kOk) {
+    *intent_out = intent;
+  }
+  return status;
+}
+
+template <typename Authorization>
+WireStatus DecodeAuthorizationImpl(const std::uint8_t* buffer,
+                                   std::size_t size,
+                                   Authorization* authorization_out) {
+  if (!buffer || !authorization_out) {
+    return WireStatus::kInvalidField;
+  }
+  WireReader reader(buffer, size);
+  Authorization authorization{};
+  reader.Header(WireMessageType::kAuthorization) && reader.Text("tx-", &authorization.tx_id) &&
+      reader.Text("mi-", &authorization.merchant_intent_id) &&
+      reader.Text("pa-", &authorization.payer_authorization_id) &&
+      reader.Text(nullptr, &authorization.payer_account_id) &&
+      reader.Text(nullptr, &authorization.payer_device_id) && reader.Amount(&authorization.amount_cents) &&
+      reader.Currency(&authorization.currency) && reader.Text(nullptr, &authorization.payer_nonce) &&
+      reader.Unsigned(&authorization.payer_counter) &&
+      reader.Varint(&authorization.authorized_at_epoch_seconds) &&
+      reader.Text(nullptr, &authorization.payer_signature);
+  const WireStatus status = reader.Finish();
+  if (status == WireStatus::kOk) {
+    *authorization_out = authorization;
+  }
+  return status;
+}
+
+template <typename Receipt>
+WireStatus DecodeReceiptImpl(const std::uint8_t* buffer, std::size_t size, Receipt* receipt_out) {
+  if (!buffer || !receipt_out) {
+    return WireStatus::kInvalidField;
+  }
+  WireReader reader(buffer, size);
+  Receipt receipt{};
+  std::uint8_t status_byte = 0;
+  if (reader.Header(WireMessageType::kReceipt) && reader.Text("tx-", &receipt.tx_id) &&
+      reader.Text("r-", &receipt.receipt_id) && reader.Text(nullptr, &receipt.merchant_account_id) &&
+      reader.Text(nullptr, &receipt.payer_account_id) && reader.Amount(&receipt.amount_cents) &&
+      reader.Currency(&receipt.currency) && reader.Byte(&status_byte)) {
+    if (status_byte > static_cast<std::uint8_t>(TransactionState::kExpired)) {
+      reader.Fail(WireStatus::kInvalidField);
+    }
+    receipt.status = static_cast<TransactionState>(status_byte);
+    if (reader.Varint(&receipt.created_at_epoch_seconds) && reader.Text(nullptr, &receipt.merchant_signature)) {
+      ReadChainTail(&reader, &receipt);
+    }
+  }
+  const WireStatus status = reader.Finish();
+  if (status == WireStatus::kOk) {
+    *receipt_out = receipt;
+  }
+  return status;
+}
+
+template <typename Transaction>
+WireStatus DecodeLocalTransactionImpl(const std::uint8_t* buffer, std::size_t size, Transaction* tx_out) {
+  if (!buffer || !tx_out) {
+    return WireStatus::kInvalidField;
+  }
+  WireReader reader(buffer, size);
+  Transaction tx{};
+  std::uint8_t state_byte = 0;
+  if (reader.Header(WireMessageType::kLocalTransaction) && reader.Text("tx-", &tx.tx_id) &&
+      reader.Text(nullptr, &tx.merchant_account_id) && reader.Text(nullptr, &tx.payer_account_id) &&
+      reader.Text(nullptr, &tx.merchant_device_id) && reader.Text(nullptr, &tx.payer_device_id) &&
+      reader.Amount(&tx.amount_cents) && reader.Currency(&tx.currency) &&
+      reader.Text("mi-", &tx.merchant_intent_id) && reader.Text("pa-", &tx.payer_authorization_id) &&
+      reader.Text(nullptr, &tx.merchant_nonce) && reader.Text(nullptr, &tx.payer_nonce) &&
+      reader.Unsigned(&tx.merchant_counter) && reader.Unsigned(&tx.payer_counter) &&
+      reader.Byte(&state_byte)) {
+    if (state_byte > static_cast<std::uint8_t>(TransactionState::kExpired)) {
+      reader.Fail(WireStatus::kInvalidField);
+    }
+    tx.state = static_cast<TransactionState>(state_byte);
+    if (reader.Text(nullptr, &tx.failure_reason) && reader.Varint(&tx.created_at_epoch_seconds) &&
+        reader.Varint(&tx.updated_at_epoch_seconds) && reader.Text(nullptr, &tx.idempotency_key)) {
+      ReadSyncTail(&reader, &tx);
+    }
+  }
+  const WireStatus status = reader.Finish();
+  if (status == WireStatus::kOk) {
+    *tx_out = tx;
+  }
+  return status;
+}
+
+}  // namespace
+
+WireStatus PeekWireMessageType(const std::uint8_t* buffer, std::size_t size, WireMessageType* type_out) {
+  if (!buffer || !type_out || size < kWireHeaderBytes) {
+    return WireStatus::kTruncated;
+  }
+  if (buffer[0] != kWireFormatVersion) {
+    return WireStatus::kUnsupportedVersion;
+  }
+  if (buffer[1] < static_cast<std::uint8_t>(WireMessageType::kIntent) ||
+      buffer[1] > static_cast<std::uint8_t>(WireMessageType::kLocalTransaction)) {
+    return WireStatus::kWrongType;
+  }
+  *type_out = static_cast<WireMessageType>(buffer[1]);
+  return WireStatus::kOk;
+}
+
+WireStatus EncodeIntent(const PaymentIntent& intent,
+                        std::uint8_t* buffer,
+                        std::size_t capacity,
+                        std::size_t* written_out) {
+  return EncodeIntentImpl(intent, buffer, capacity, written_out);
+}
+
+WireStatus EncodeAuthorization(const PaymentAuthorization& authorization,
+                               std::uint8_t* buffer,
+                               std::size_t capacity,
+                               std::size_t* written_out) {
+  return EncodeAuthorizationImpl(authorization, buffer, capacity, written_out);
+}
+
+WireStatus EncodeReceipt(const PaymentReceipt& receipt,
+                         std::uint8_t* buffer,
+                         std::size_t capacity,
+                         std::size_t* written_out) {
+  return EncodeReceiptImpl(receipt, buffer, capacity, written_out);
+}
+
+WireStatus DecodeIntent(const std::uint8_t* buffer, std::size_t size, PaymentIntent* intent_out) {
+  return DecodeIntentImpl(buffer, size, intent_out);
+}
+
+WireStatus DecodeAuthorization(const std::uint8_t* buffer,
+                               std::size_t size,
+                               PaymentAuthorization* authorization_out) {
+  return DecodeAuthorizationImpl(buffer, size, authorization_out);
+}
+
+WireStatus DecodeReceipt(const std::uint8_t* buffer, std::size_t size, PaymentReceipt* receipt_out) {
+  return DecodeReceiptImpl(buffer, size, receipt_out);
+}
+
+WireStatus EncodeLocalTransaction(const LocalTransaction& tx,
+                                  std::uint8_t* buffer,
+                                  std::size_t capacity,
+                                  std::size_t* written_out) {
+  return EncodeLocalTransactionImpl(tx, tx.sequence, buffer, capacity, written_out);
+}
+
+WireStatus EncodeLocalTransaction(const LocalTransaction& tx,
+                                  std::uint64_t sequence,
+                                  std::uint8_t* buffer,
+                                  std::size_t capacity,
+                                  std::size_t* written_out) {
+  return EncodeLocalTransactionImpl(tx, sequence, buffer, capacity, written_out);
+}
+
+WireStatus DecodeLocalTransaction(const std::uint8_t* buffer, std::size_t size, LocalTransaction* tx_out) {
+  return DecodeLocalTransactionImpl(buffer, size, tx_out);
+}
+
+WireStatus EncodeIntent(const FixedPaymentIntent& intent,
+                        std::uint8_t* buffer,
+                        std::size_t capacity,
+                        std::size_t* written_out) {
+  return EncodeIntentImpl(intent, buffer, capacity, written_out);
+}
+
+WireStatus EncodeAuthorization(const FixedPaymentAuthorization& authorization,
+                               std::uint8_t* buffer,
+                               std::size_t capacity,
+                               std::size_t* written_out) {
+  return EncodeAuthorizationImpl(authorization, buffer, capacity, written_out);
+}
+
+WireStatus EncodeReceipt(const FixedPaymentReceipt& receipt,
+                         std::uint8_t* buffer,
+                         std::size_t capacity,
+                         std::size_t* written_out) {
+  return EncodeReceiptImpl(receipt, buffer, capacity, written_out);
+}
+
+WireStatus DecodeIntent(const std::uint8_t* buffer, std::size_t size, FixedPaymentIntent* intent_out) {
+  return DecodeIntentImpl(buffer, size, intent_out);
+}
+
+WireStatus DecodeAuthorization(const std::uint8_t* buffer,
+                               std::size_t size,
+                               FixedPaymentAuthorization* authorization_out) {
+  return DecodeAuthorizationImpl(buffer, size, authorization_out);
+}
+
+WireStatus DecodeReceipt(const std::uint8_t* buffer, std::size_t size, FixedPaymentReceipt* receipt_out) {
+  return DecodeReceiptImpl(buffer, size, receipt_out);
+}
+
+WireStatus EncodeLocalTransaction(const FixedLocalTransaction& tx,
+                                  std::uint8_t* buffer,
+                                  std::size_t capacity,
+                                  std::size_t* written_out) {
+  return EncodeLocalTransactionImpl(tx, 0, buffer, capacity, written_out);
+}
+
+WireStatus DecodeLocalTransaction(const std::uint8_t* buffer, std::size_t size, FixedLocalTransaction* tx_out) {
+  return DecodeLocalTransactionImpl(buffer, size, tx_out);
+}
+
+}  // namespace offline_wallet
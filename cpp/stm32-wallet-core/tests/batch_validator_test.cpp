@@ -0,0 +1,300 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/batch_input.hpp"
+#include "offline_wallet/batch_validator.hpp"
+#include "offline_wallet/iso_time.hpp"
+#include "offline_wallet/sync_exporter.hpp"
+
+namespace {
+
+using offline_wallet::BatchTransaction;
+using offline_wallet::SyncBatch;
+using offline_wallet::SyncResult;
+using offline_wallet::SyncResultStatus;
+
+constexpr std::uint64_t kNow = 1'700'000'000;  // 2023-11-14T22:13:20Z
+
+// Valid signatures are "<public key>/<digest>".
+class KeyedVerifier : public offline_wallet::SignatureProvider {
+ public:
+  std::string Sign(const std::string& message, const std::string& key_id) override { return key_id + "/" + message; }
+  bool Verify(const std::string& signature, const std::string& message, const std::string& public_key) override {
+    return signature == public_key + "/" + message;
+  }
+};
+
+class KeyedVerifierFactory : public offline_wallet::BatchVerifierFactory {
+ public:
+  std::unique_ptr<offline_wallet::SignatureProvider> Create(std::size_t /*worker*/) override {
+    return std::make_unique<KeyedVerifier>();
+  }
+};
+
+BatchTransaction MakeTransaction(const std::string& id, std::int32_t amount, const std::string& payer = "payer-1") {
+  BatchTransaction input;
+  offline_wallet::LocalTransaction& tx = input.tx;
+  tx.tx_id = "tx-" + id;
+  tx.idempotency_key = "merchant:" + std::string(tx.tx_id);
+  tx.merchant_intent_id = "mi-" + id;
+  tx.payer_authorization_id = "pa-" + id;
+  tx.merchant_account_id = "merchant-1";
+  tx.payer_account_id = payer;
+  tx.merchant_device_id = "merchant-device-1";
+  tx.payer_device_id = payer + "-device";
+  tx.amount_cents = amount;
+  tx.merchant_nonce = "mn-" + id;
+  tx.payer_nonce = "pn-" + id;
+  tx.intent_issued_at_epoch_seconds = kNow - 20;
+  tx.authorized_at_epoch_seconds = kNow - 10;
+  tx.expires_at_epoch_seconds = kNow + 10;
+  return input;
+}
+
+void Sign(BatchTransaction* input) {
+  const std::string digest = offline_wallet::SyncDigestHex(*input);
+  input->tx.merchant_signature = "merchant-key/" + digest;
+  input->tx.payer_signature = std::string(input->tx.payer_account_id) + "-key/" + digest;
+}
+
+void Seed(offline_wallet::BatchValidator* validator) {
+  offline_wallet::BatchAccount merchant;
+  validator->AddAccount("merchant-1", merchant);
+  offline_wallet::BatchAccount payer;
+  payer.available_cents = 100'000;
+  validator->AddAccount("payer-1", payer);
+  payer.available_cents = 700;
+  validator->AddAccount("payer-2", payer);
+  offline_wallet::BatchDevice device;
+  device.account_id = "merchant-1";
+  device.public_key = "merchant-key";
+  device.last_sync_at_epoch_seconds = kNow - 3'600;
+  validator->AddDevice("merchant-device-1", device);
+  for (const char* payer_id : {"payer-1", "payer-2"}) {
+    device.account_id = payer_id;
+    device.public_key = std::string(payer_id) + "-key";
+    validator->AddDevice(std::string(payer_id) + "-device", device);
+  }
+}
+
+void Expect(const SyncResult& result, std::string_view tx_id, SyncResultStatus status, std::string_view reason) {
+  assert(result.tx_id == tx_id);
+  assert(result.status == status);
+  assert(result.reason == reason);
+}
+
+void TestDigestMatchesBackend() {
+  BatchTransaction input = MakeTransaction("1", 500);
+  // sha256("tx-1|mi-1|pa-1|500|CNY|mn-1|pn-1|2023-11-14T22:13:00.000Z|...") as node:crypto prints it.
+  assert(offline_wallet::SyncDigestHex(input) == "e11ad4126035d3df950553b94b4f2dc0ad7f4050fa3b3d90bca5e2a739906464");
+  // The backend digests timestamps as uploaded, not as parsed.
+  input.intent_issued_at = "2023-11-14T22:13:00Z";
+  assert(offline_wallet::SyncDigestHex(input) == "8fd4ad0bd7514ede3d354680fc88091bd035958b8e48e0ddd492fab00115f900");
+
+  std::uint64_t parsed = 0;
+  bool ok = offline_wallet::ParseIsoTimestamp("2023-11-14T22:13:20.000Z", &parsed);
+  assert(ok && parsed == kNow);
+  ok = offline_wallet::ParseIsoTimestamp("2024-02-29T00:00:00Z", &parsed);
+  assert(ok && parsed == 1'709'164'800);
+  ok = offline_wallet::ParseIsoTimestamp("2023-11-14T22:13:20+01:00", &parsed);
+  assert(!ok);
+  ok = offline_wallet::ParseIsoTimestamp("2023-13-14T22:13:20Z", &parsed);
+  assert(!ok);
+  char text[offline_wallet::kIsoTimestampSize];
+  offline_wallet::FormatIsoTimestamp(1'709'164'800, text);
+  assert(std::string_view(text, sizeof(text)) == "2024-02-29T00:00:00.000Z");
+}
+
+// Every rule of OfflineTransactionSyncService.sync(), in its order, with the
+// same answers whatever the worker count.
+void TestResultsFollowBackendOrder() {
+  std::vector<BatchTransaction> transactions;
+  const auto add = [&transactions](BatchTransaction input, bool sign = true) {
+    if (sign) {
+      Sign(&input);
+    }
+    transactions.push_back(std::move(input));
+  };
+  add(MakeTransaction("ok", 9'000));
+  add(MakeTransaction("ok", 100));  // tx_id_seen, although it differs.
+  BatchTransaction same_key = MakeTransaction("key", 100);
+  same_key.tx.idempotency_key = "merchant:tx-ok";
+  add(same_key);
+  add(MakeTransaction("stranger", 100, "payer-9"));
+  BatchTransaction wrong_merchant = MakeTransaction("wrong-merchant", 100);
+  wrong_merchant.tx.merchant_account_id = "payer-1";
+  add(wrong_merchant);
+  add(MakeTransaction("too-large", 10'001));
+  BatchTransaction skewed = MakeTransaction("skewed", 100);
+  skewed.tx.authorized_at_epoch_seconds = kNow - 301;
+  add(skewed);
+  BatchTransaction expired = MakeTransaction("expired", 100);
+  expired.tx.expires_at_epoch_seconds = kNow - 1;
+  add(expired);
+  BatchTransaction forged = MakeTransaction("forged", 100);
+  Sign(&forged);
+  forged.tx.amount_cents = 200;
+  add(forged, false);
+  for (int i = 0; i < 4; ++i) {
+    add(MakeTransaction("day-" + std::to_string(i), 10'000));  // 9'000 + 4 x 10'000 ...
+  }
+  add(MakeTransaction("over-day", 1'001));  // ... + 1'001 > 50'000.
+  add(MakeTransaction("poor", 800, "payer-2"));
+  add(MakeTransaction("poor", 100, "payer-2"));  // The rejected row is stored.
+  add(MakeTransaction("afford", 700, "payer-2"));
+
+  std::vector<SyncBatch> batches(1);
+  batches[0].merchant_device_id = "merchant-device-1";
+  batches[0].submitted_at_epoch_seconds = kNow;
+  batches[0].count = transactions.size();
+
+  for (std::size_t workers : {1, 4}) {
+    KeyedVerifierFactory factory;
+    offline_wallet::BatchValidator validator(offline_wallet::BatchPolicy{}, workers, &factory);
+    Seed(&validator);
+    std::vector<SyncResult> results;
+    validator.Validate(batches, transactions, kNow, &results);
+    assert(results.size() == transactions.size());
+    std::size_t i = 0;
+    Expect(results[i++], "tx-ok", SyncResultStatus::kAccepted, "");
+    Expect(results[i++], "tx-ok", SyncResultStatus::kDuplicate, "tx_id_seen");
+    Expect(results[i++], "tx-key", SyncResultStatus::kDuplicate, "idempotency_key_seen");
+    Expect(results[i++], "tx-stranger", SyncResultStatus::kRejected, "unknown_identity");
+    Expect(results[i++], "tx-wrong-merchant", SyncResultStatus::kRejected, "merchant_device_mismatch");
+    Expect(results[i++], "tx-too-large", SyncResultStatus::kRejected, "tx_amount_out_of_policy");
+    Expect(results[i++], "tx-skewed", SyncResultStatus::kRejected, "clock_skew_exceeded");
+    Expect(results[i++], "tx-expired", SyncResultStatus::kRejected, "intent_expired");
+    Expect(results[i++], "tx-forged", SyncResultStatus::kRejected, "signature_invalid");
+    for (int day = 0; day < 4; ++day) {
+      Expect(results[i++], "tx-day-" + std::to_string(day), SyncResultStatus::kAccepted, "");
+    }
+    Expect(results[i++], "tx-over-day", SyncResultStatus::kRejected, "daily_limit_exceeded");
+    Expect(results[i++], "tx-poor", SyncResultStatus::kRejected, "insufficient_funds");
+    Expect(results[i++], "tx-poor", SyncResultStatus::kDuplicate, "tx_id_seen");
+    Expect(results[i++], "tx-afford", SyncResultStatus::kAccepted, "");
+    assert(validator.account("payer-1")->available_cents == 100'000 - 49'000);
+    assert(validator.account("payer-2")->available_cents == 0);
+    assert(validator.account("merchant-1")->available_cents == 49'700);
+
+    // A later run remembers what this one stored.
+    std::vector<SyncResult> again;
+    validator.Validate(batches, transactions, kNow, &again);
+    assert(again[0].status == SyncResultStatus::kDuplicate && again[3].reason == "unknown_identity");
+  }
+}
+
+void TestUploadLevelRejections() {
+  std::vector<BatchTransaction> transactions;
+  for (int i = 0; i < 5; ++i) {
+    transactions.push_back(MakeTransaction(std::to_string(i), 100));
+    Sign(&transactions.back());
+  }
+  std::vector<SyncBatch> batches(4);
+  batches[0].merchant_device_id = "merchant-device-9";  // Unknown.
+  batches[0].count = 1;
+  batches[1].merchant_device_id = "merchant-device-1";  // Over max_unsynced_per_merchant.
+  batches[1].first = 1;
+  batches[1].count = 3;
+  batches[2].merchant_device_id = "merchant-device-1";  // Last sync too old.
+  batches[2].first = 1;
+  batches[2].count = 1;
+  batches[3].merchant_device_id = "merchant-device-1";  // Fresh: batch 2 moved lastSyncAt.
+  batches[3].first = 4;
+  batches[3].count = 1;
+  for (SyncBatch& batch : batches) {
+    batch.submitted_at_epoch_seconds = kNow;
+  }
+
+  KeyedVerifierFactory factory;
+  offline_wallet::BatchPolicy policy;
+  policy.max_unsynced_per_merchant = 2;
+  policy.max_sync_age_seconds = 1'800;
+  offline_wallet::BatchValidator validator(policy, 2, &factory);
+  Seed(&validator);
+  std::vector<SyncResult> results;
+  validator.Validate(batches, transactions, kNow, &results);
+  assert(results.size() == 6);
+  Expect(results[0], "tx-0", SyncResultStatus::kRejected, "merchant_device_inactive");
+  for (std::size_t i = 1; i < 4; ++i) {
+    Expect(results[i], "tx-" + std::to_string(i), SyncResultStatus::kRejected, "unsynced_limit_exceeded");
+  }
+  Expect(results[4], "tx-1", SyncResultStatus::kRejected, "merchant_sync_stale");
+  Expect(results[5], "tx-4", SyncResultStatus::kAccepted, "");
+}
+
+void TestParsesExporterJsonAndBinary() {
+  BatchTransaction input = MakeTransaction("1", 500);
+  Sign(&input);
+  input.tx.merchant_counter = 7;
+  input.tx.payer_counter = 9;
+  const std::string json =
+      "{\"merchantDeviceId\":\"merchant-device-1\",\"submittedAt\":\"2023-11-14T22:13:20.000Z\","
+      "\"transactions\":[{\"txId\":\"tx-1\",\"idempotencyKey\":\"merchant:tx-1\",\"merchantIntentId\":\"mi-1\","
+      "\"payerAuthorizationId\":\"pa-1\",\"merchantAccountId\":\"merchant-1\",\"payerAccountId\":\"payer-1\","
+      "\"merchantDeviceId\":\"merchant-device-1\",\"payerDeviceId\":\"payer-1-device\",\"amountCents\":500,"
+      "\"currency\":\"CNY\",\"merchantNonce\":\"mn-1\",\"payerNonce\":\"pn-1\",\"merchantCounter\":7,"
+      "\"payerCounter\":9,\"intentIssuedAt\":\"2023-11-14T22:13:00.000Z\","
+      "\"authorizationIssuedAt\":\"2023-11-14T22:13:10.000Z\",\"expiresAt\":\"2023-11-14T22:13:30.000Z\","
+      "\"merchantSignature\":\"" +
+      std::string(input.tx.merchant_signature) + "\",\"payerSignature\":\"" + std::string(input.tx.payer_signature) +
+      "\",\"note\":{\"skip\":[1,true,null,\"\\u00e9\"]}}]}";
+
+  std::vector<SyncBatch> batches;
+  std::vector<BatchTransaction> transactions;
+  bool ok = offline_wallet::ParseSyncUploadJson(json, &batches, &transactions);
+  assert(ok);
+  assert(batches.size() == 1 && transactions.size() == 1);
+  assert(batches[0].merchant_device_id == "merchant-device-1" && batches[0].submitted_at_epoch_seconds == kNow);
+  const offline_wallet::LocalTransaction& parsed = transactions[0].tx;
+  assert(parsed.tx_id == "tx-1" && parsed.payer_device_id == "payer-1-device" && parsed.amount_cents == 500);
+  assert(parsed.merchant_counter == 7 && parsed.payer_counter == 9);
+  assert(parsed.expires_at_epoch_seconds == kNow + 10);
+  assert(offline_wallet::SyncDigestHex(transactions[0]) == offline_wallet::SyncDigestHex(input));
+
+  // Malformed documents append nothing.
+  ok = offline_wallet::ParseSyncUploadJson(json.substr(0, json.size() - 1), &batches, &transactions);
+  assert(!ok);
+  ok = offline_wallet::ParseSyncUploadJson("{\"merchantDeviceId\":\"m\",\"transactions\":[]}", &batches,
+                                           &transactions);
+  assert(!ok);
+  assert(batches.size() == 1 && transactions.size() == 1);
+
+  std::vector<std::uint8_t> binary;
+  ok = offline_wallet::AppendSyncUploadBinary("merchant-device-1", kNow, &input.tx, 1, &binary) &&
+       offline_wallet::AppendSyncUploadBinary("merchant-device-1", kNow + 60, nullptr, 0, &binary);
+  assert(ok);
+  ok = offline_wallet::ParseSyncUploadsBinary(binary.data(), binary.size(), &batches, &transactions);
+  assert(ok);
+  assert(batches.size() == 3 && transactions.size() == 2);
+  assert(batches[1].first == 1 && batches[1].count == 1 && batches[2].count == 0);
+  assert(batches[2].submitted_at_epoch_seconds == kNow + 60);
+  assert(transactions[1].tx.payer_signature == input.tx.payer_signature);
+  assert(offline_wallet::SyncDigestHex(transactions[1]) == offline_wallet::SyncDigestHex(input));
+  ok = offline_wallet::ParseSyncUploadsBinary(binary.data(), binary.size() - 1, &batches, &transactions);
+  assert(!ok);
+  assert(batches.size() == 3 && transactions.size() == 2);
+
+  KeyedVerifierFactory factory;
+  offline_wallet::BatchValidator validator(offline_wallet::BatchPolicy{}, 2, &factory);
+  Seed(&validator);
+  std::vector<SyncResult> results;
+  validator.Validate(batches, transactions, kNow, &results);
+  assert(results.size() == 2);
+  Expect(results[0], "tx-1", SyncResultStatus::kAccepted, "");
+  Expect(results[1], "tx-1", SyncResultStatus::kDuplicate, "tx_id_seen");
+}
+
+}  // namespace
+
+int main() {
+  TestDigestMatchesBackend();
+  TestResultsFollowBackendOrder();
+  TestUploadLevelRejections();
+  TestParsesExporterJsonAndBinary();
+  return 0;
+}
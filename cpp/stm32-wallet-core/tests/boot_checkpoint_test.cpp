@@ -0,0 +1,295 @@
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/boot_checkpoint.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/snapshot_store.hpp"
+#include "offline_wallet/spend_tracker.hpp"
+#include "offline_wallet/sync_exporter.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::TransactionState;
+using offline_wallet::testing::ManualClock;
+
+constexpr std::uint64_t kNow = 1'700'050'000;
+constexpr std::size_t kPayers = 5;
+
+// 16 journal sectors of 1 KiB hold about 64 records, so the workload below
+// compacts, drops synced records, and recycles sectors after the checkpoint.
+constexpr std::size_t kSectorSize = 1024;
+constexpr std::size_t kJournalSectors = 16;
+constexpr std::size_t kSnapshotSectors = 8;
+
+offline_wallet::FlashJournalOptions JournalOptions() {
+  offline_wallet::FlashJournalOptions options;
+  options.max_records = 64;
+  return options;
+}
+
+offline_wallet::LocalTransaction MakeTransaction(std::uint32_t n) {
+  offline_wallet::LocalTransaction tx;
+  tx.tx_id = "tx-" + std::to_string(1000 + n);
+  tx.merchant_account_id = "merchant-1";
+  tx.payer_account_id = "payer-" + std::to_string(n % kPayers);
+  tx.merchant_device_id = "merchant-device-1";
+  tx.amount_cents = 100 + n;
+  tx.state = TransactionState::kPendingSync;
+  tx.created_at_epoch_seconds = kNow - 3600 + n;
+  tx.idempotency_key = "merchant:" + std::string(tx.tx_id);
+  return tx;
+}
+
+using Contents = std::map<std::string, std::tuple<std::uint64_t, TransactionState, std::string>>;
+
+class ContentsVisitor : public offline_wallet::JournalVisitor {
+ public:
+  void Visit(const offline_wallet::LocalTransaction& tx) override {
+    contents[tx.tx_id] = {tx.sequence, tx.state, std::string(tx.failure_reason)};
+  }
+
+  Contents contents;
+};
+
+Contents Read(const offline_wallet::FlashJournal& journal) {
+  ContentsVisitor visitor;
+  const bool visited = journal.ForEach(&visitor);
+  assert(visited);
+  return visitor.contents;
+}
+
+// Recovered windows hold at least what a rebuild from the journal finds and
+// at most what was counted live: a sale written and then dropped by
+// compaction between checkpoint and reboot is missed, as Rebuild() misses it.
+void CheckSpend(const offline_wallet::SpendTracker& recovered,
+                const offline_wallet::SpendTracker& live,
+                const offline_wallet::FlashJournal& journal,
+                bool exact) {
+  offline_wallet::SpendTracker rebuilt;
+  const bool ok = rebuilt.Rebuild(journal, kNow);
+  assert(ok);
+  for (std::size_t payer = 0; payer < kPayers; ++payer) {
+    const std::string id = "payer-" + std::to_string(payer);
+    const std::int64_t spend = recovered.SpendInWindow(id, kNow);
+    assert(spend >= rebuilt.SpendInWindow(id, kNow) && spend <= live.SpendInWindow(id, kNow));
+    assert(!exact || spend == live.SpendInWindow(id, kNow));
+  }
+}
+
+// Step `step` of a workload of new sales, bulk sync results, small batches
+// and idle-loop compaction. New sales are counted into `tracker` the way the
+// engine adds them.
+void RunStep(offline_wallet::FlashJournal* journal, offline_wallet::SpendTracker* tracker, std::uint32_t step) {
+  const offline_wallet::LocalTransaction tx = MakeTransaction(step);
+  bool ok = journal->Save(tx);
+  assert(ok);
+  tracker->Count(tx, kNow);
+  if (step % 3 == 2 && step >= 5) {
+    std::vector<offline_wallet::StateUpdate> updates;
+    for (std::uint32_t n = step - 5; n < step - 2; ++n) {
+      updates.push_back({std::string(MakeTransaction(n).tx_id), TransactionState::kSynced, ""});
+    }
+    ok = journal->UpdateStates(updates.data(), updates.size());
+    assert(ok);
+  }
+  if (step % 7 == 6) {
+    offline_wallet::LocalTransaction rejected = MakeTransaction(step - 1);
+    rejected.state = TransactionState::kRejected;
+    rejected.failure_reason = "limit";
+    ok = journal->BeginBatch() && journal->Stage(rejected) && journal->Stage(MakeTransaction(step)) &&
+         journal->CommitBatch();
+    assert(ok);
+  }
+  while (journal->NeedsCompaction() && journal->CompactStep()) {
+  }
+}
+
+// Checkpoints after `checkpoint_step` steps of the workload, runs the rest,
+// reboots through a BootCheckpoint, and compares with a full Mount().
+void CheckRecoveryFrom(std::uint32_t checkpoint_step, std::uint32_t steps) {
+  offline_wallet::RamBlockDevice flash(kSectorSize, kJournalSectors + kSnapshotSectors);
+  offline_wallet::BlockDeviceRegion journal_flash(&flash, 0, kJournalSectors);
+  offline_wallet::BlockDeviceRegion snapshot_flash(&flash, kJournalSectors, kSnapshotSectors);
+  ManualClock clock(kNow);
+
+  offline_wallet::SpendTracker live_tracker;
+  std::uint64_t cursor = 0;
+  {
+    offline_wallet::FlashJournal journal(&journal_flash, JournalOptions());
+    offline_wallet::SnapshotStore store(&snapshot_flash);
+    offline_wallet::SyncExporter exporter(&journal, &clock, "merchant-device-1");
+    offline_wallet::BootCheckpoint checkpoint(&journal, &store, &exporter, &live_tracker);
+    const offline_wallet::BootRecovery recovery = checkpoint.Recover(kNow);
+    assert(recovery == offline_wallet::BootRecovery::kFullReplay);
+    assert(checkpoint.CheckpointDue());
+    for (std::uint32_t step = 0; step < steps; ++step) {
+      if (step == checkpoint_step) {
+        exporter.Seek(1000 + step);
+        cursor = exporter.cursor();
+        const bool written = checkpoint.WriteCheckpoint();
+        assert(written);
+        assert(!checkpoint.CheckpointDue());
+      }
+      RunStep(&journal, &live_tracker, step);
+    }
+    if (checkpoint_step == steps) {
+      exporter.Seek(1000 + steps);
+      cursor = exporter.cursor();
+      const bool written = checkpoint.WriteCheckpoint();
+      assert(written);
+    }
+  }
+
+  offline_wallet::FlashJournal journal(&journal_flash, JournalOptions());
+  offline_wallet::SnapshotStore store(&snapshot_flash);
+  offline_wallet::SyncExporter exporter(&journal, &clock, "merchant-device-1");
+  offline_wallet::SpendTracker tracker;
+  offline_wallet::BootCheckpoint checkpoint(&journal, &store, &exporter, &tracker);
+  const offline_wallet::BootRecovery recovery = checkpoint.Recover(kNow);
+  assert(recovery == offline_wallet::BootRecovery::kFromCheckpoint);
+  assert(exporter.cursor() == cursor);
+  assert(checkpoint_step < steps || checkpoint.replayed_records() == 0);
+
+  offline_wallet::FlashJournal reference(&journal_flash, JournalOptions());
+  bool ok = reference.Mount();
+  assert(ok);
+  const Contents contents = Read(journal);
+  assert(contents == Read(reference));
+  assert(journal.stats().live_records == reference.stats().live_records);
+  assert(checkpoint.replayed_records() <= reference.stats().replayed_records);
+  CheckSpend(tracker, live_tracker, reference, checkpoint_step == steps);
+
+  // The recovered journal resumes above every sequence it ever wrote.
+  offline_wallet::LocalTransaction next = MakeTransaction(steps);
+  ok = journal.Save(next) && journal.Load(next.tx_id, &next);
+  assert(ok);
+  for (const auto& entry : contents) {
+    assert(next.sequence > std::get<0>(entry.second));
+  }
+}
+
+void TestRecoveryMatchesFullMount() {
+  constexpr std::uint32_t kSteps = 90;
+  for (std::uint32_t checkpoint_step : {0u, 1u, 6u, 17u, 33u, 50u, 71u, 88u, kSteps}) {
+    CheckRecoveryFrom(checkpoint_step, kSteps);
+  }
+}
+
+void TestTornTailAndStaleCheckpoint() {
+  offline_wallet::RamBlockDevice ram(kSectorSize, kJournalSectors + kSnapshotSectors);
+  offline_wallet::SpendTracker tracker;
+  {
+    offline_wallet::FaultInjectingBlockDevice flash(&ram);
+    offline_wallet::BlockDeviceRegion journal_flash(&flash, 0, kJournalSectors);
+    offline_wallet::BlockDeviceRegion snapshot_flash(&flash, kJournalSectors, kSnapshotSectors);
+    offline_wallet::FlashJournal journal(&journal_flash, JournalOptions());
+    offline_wallet::SnapshotStore store(&snapshot_flash);
+    offline_wallet::BootCheckpoint checkpoint(&journal, &store, nullptr, &tracker);
+    const offline_wallet::BootRecovery recovery = checkpoint.Recover(kNow);
+    assert(recovery == offline_wallet::BootRecovery::kFullReplay);
+    for (std::uint32_t step = 0; step < 30; ++step) {
+      RunStep(&journal, &tracker, step);
+      if (step == 10 || step == 20) {
+        const bool written = checkpoint.WriteCheckpoint();
+        assert(written);
+      }
+    }
+    // Power fails halfway through the next record.
+    flash.ArmPowerCut(40);
+    const bool saved = journal.Save(MakeTransaction(30));
+    assert(!saved);
+  }
+  offline_wallet::BlockDeviceRegion journal_flash(&ram, 0, kJournalSectors);
+  offline_wallet::BlockDeviceRegion snapshot_flash(&ram, kJournalSectors, kSnapshotSectors);
+
+  // The tail behind the torn record is skipped, as Mount() skips it.
+  offline_wallet::FlashJournal journal(&journal_flash, JournalOptions());
+  offline_wallet::SnapshotStore store(&snapshot_flash);
+  offline_wallet::SpendTracker recovered;
+  offline_wallet::BootCheckpoint checkpoint(&journal, &store, nullptr, &recovered);
+  offline_wallet::BootRecovery recovery = checkpoint.Recover(kNow);
+  assert(recovery == offline_wallet::BootRecovery::kFromCheckpoint);
+  assert(store.generation() == 2);
+  offline_wallet::FlashJournal reference(&journal_flash, JournalOptions());
+  const bool mounted = reference.Mount();
+  assert(mounted);
+  assert(Read(journal) == Read(reference));
+  CheckSpend(recovered, tracker, reference, false);
+  offline_wallet::LocalTransaction tx;
+  const bool found = journal.Load(MakeTransaction(30).tx_id, &tx);
+  assert(!found);
+
+  // A damaged newest checkpoint falls back to the one before, which still
+  // recovers the same journal from a longer tail.
+  const std::uint64_t short_tail = checkpoint.replayed_records();
+  ram.bytes()[(kJournalSectors + kSnapshotSectors / 2) * kSectorSize + 40] ^= 0x01;
+  offline_wallet::FlashJournal older(&journal_flash, JournalOptions());
+  offline_wallet::SpendTracker older_tracker;
+  offline_wallet::BootCheckpoint older_checkpoint(&older, &store, nullptr, &older_tracker);
+  recovery = older_checkpoint.Recover(kNow);
+  assert(recovery == offline_wallet::BootRecovery::kFromCheckpoint);
+  assert(store.generation() == 1);
+  assert(older_checkpoint.replayed_records() > short_tail);
+  assert(Read(older) == Read(reference));
+  CheckSpend(older_tracker, tracker, reference, false);
+
+  // With both images damaged, the whole log is replayed.
+  ram.bytes()[kJournalSectors * kSectorSize + 40] ^= 0x01;
+  offline_wallet::FlashJournal replayed(&journal_flash, JournalOptions());
+  offline_wallet::SpendTracker rebuilt;
+  offline_wallet::BootCheckpoint fallback(&replayed, &store, nullptr, &rebuilt);
+  recovery = fallback.Recover(kNow);
+  assert(recovery == offline_wallet::BootRecovery::kFullReplay);
+  assert(fallback.CheckpointDue());
+  assert(Read(replayed) == Read(reference));
+}
+
+void TestCheckpointDue() {
+  offline_wallet::RamBlockDevice flash(kSectorSize, kJournalSectors + kSnapshotSectors);
+  offline_wallet::BlockDeviceRegion journal_flash(&flash, 0, kJournalSectors);
+  offline_wallet::BlockDeviceRegion snapshot_flash(&flash, kJournalSectors, kSnapshotSectors);
+  offline_wallet::FlashJournal journal(&journal_flash, JournalOptions());
+  offline_wallet::SnapshotStore store(&snapshot_flash);
+  ManualClock clock(kNow);
+  offline_wallet::SyncExporter exporter(&journal, &clock, "merchant-device-1");
+  offline_wallet::BootCheckpointOptions options;
+  options.checkpoint_records = 4;
+  offline_wallet::BootCheckpoint checkpoint(&journal, &store, &exporter, nullptr, options);
+  const offline_wallet::BootRecovery recovery = checkpoint.Recover(kNow);
+  assert(recovery == offline_wallet::BootRecovery::kFullReplay);
+  assert(checkpoint.CheckpointDue());
+  bool ok = checkpoint.WriteCheckpoint();
+  assert(ok && !checkpoint.CheckpointDue());
+
+  for (std::uint32_t n = 0; n < 3; ++n) {
+    ok = journal.Save(MakeTransaction(n));
+    assert(ok);
+  }
+  assert(!checkpoint.CheckpointDue());
+  ok = journal.Save(MakeTransaction(3));
+  assert(ok && checkpoint.CheckpointDue());
+  ok = checkpoint.WriteCheckpoint();
+  assert(ok && !checkpoint.CheckpointDue());
+
+  // An acknowledged sync moves the cursor, which the checkpoint must keep.
+  exporter.Seek(7);
+  assert(checkpoint.CheckpointDue());
+  ok = checkpoint.WriteCheckpoint();
+  assert(ok && !checkpoint.CheckpointDue());
+}
+
+}  // namespace
+
+int main() {
+  TestRecoveryMatchesFullMount();
+  TestTornTailAndStaleCheckpoint();
+  TestCheckpointDue();
+  return 0;
+}
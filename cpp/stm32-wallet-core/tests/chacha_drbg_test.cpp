@@ -0,0 +1,276 @@
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/chacha_drbg.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+using offline_wallet::testing::TestSignatureProvider;
+
+std::string ToHex(const std::uint8_t* bytes, std::size_t size) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string hex;
+  for (std::size_t i = 0; i < size; ++i) {
+    hex.push_back(kHex[bytes[i] >> 4]);
+    hex.push_back(kHex[bytes[i] & 0x0F]);
+  }
+  return hex;
+}
+
+offline_wallet::ChaCha20Key CountingKey() {
+  offline_wallet::ChaCha20Key key;
+  for (std::size_t i = 0; i < key.size(); ++i) {
+    key[i] = static_cast<std::uint8_t>(i);
+  }
+  return key;
+}
+
+std::string Draw(offline_wallet::ChaChaDrbg* drbg, std::size_t size) {
+  std::vector<std::uint8_t> bytes(size);
+  drbg->NextBytes(bytes.data(), bytes.size());
+  return ToHex(bytes.data(), bytes.size());
+}
+
+class ScriptedEntropy : public offline_wallet::EntropySource {
+ public:
+  bool Gather(std::uint8_t* out, std::size_t size) override {
+    ++calls;
+    if (fail) {
+      return false;
+    }
+    std::memset(out, fill, size);
+    return true;
+  }
+
+  std::uint8_t fill = 0x5a;
+  bool fail = false;
+  int calls = 0;
+};
+
+class LegacyRandomProvider : public offline_wallet::RandomProvider {
+ public:
+  std::string NextHex(std::size_t /*bytes*/) override { return text; }
+
+  std::string text;
+};
+
+bool IsLowerHex(const std::string& text) {
+  return text.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+void TestChaCha20Rfc8439Block() {
+  offline_wallet::ChaCha20Nonce nonce{};
+  nonce[3] = 0x09;
+  nonce[7] = 0x4a;
+  offline_wallet::ChaCha20Block block;
+  offline_wallet::ChaCha20Generate(CountingKey(), 1, nonce, &block);
+  assert(ToHex(block.data(), block.size()) ==
+         "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+         "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e");
+}
+
+void TestSeededStreamIsReproducible() {
+  offline_wallet::ChaChaDrbg drbg(CountingKey());
+  assert(drbg.seeded());
+  const std::string first = Draw(&drbg, 32);
+  assert(first == "2b23cce7a26023ab3f0eef693ac87f64258235eab1f7a32dc22762a0485b410c");
+
+  // The split of the draws, across buffer refills too, does not matter.
+  offline_wallet::ChaChaDrbg whole(CountingKey());
+  offline_wallet::ChaChaDrbg pieces(CountingKey());
+  const std::string expected = Draw(&whole, 1016);
+  std::string joined;
+  for (std::size_t size : {1, 7, 16, 300, 2, 480, 200, 10}) {
+    joined += Draw(&pieces, size);
+  }
+  assert(joined == expected);
+  assert(expected.substr(2000) == "ed84636dcd709055b9ebada581a4e207");
+
+  // Hex output is the same stream, encoded.
+  offline_wallet::ChaChaDrbg hex(CountingKey());
+  char buffer[64];
+  const std::size_t filled = hex.FillHex(16, buffer);
+  assert(filled == 32);
+  assert(std::string(buffer, 32) == expected.substr(0, 32));
+  const std::string next = hex.NextHex(16);
+  assert(next == expected.substr(32, 32));
+
+  offline_wallet::ChaChaDrbg mixed(CountingKey());
+  mixed.Mix("serial-42", 9);
+  const std::string mixed_draw = Draw(&mixed, 16);
+  assert(mixed_draw == "70ea25e7a532bcad37a4c891476ef928");
+  const bool reseeded = mixed.Reseed();
+  assert(!reseeded);
+}
+
+void TestEntropySeedingAndPeriodicReseed() {
+  ScriptedEntropy entropy;
+  offline_wallet::ChaChaDrbgOptions options;
+  options.reseed_interval_bytes = 1000;
+  offline_wallet::ChaChaDrbg drbg(&entropy, options);
+  assert(drbg.seeded() && drbg.reseed_count() == 1 && entropy.calls == 1);
+  // key = SHA-256(zero key || 32 x 0x5a).
+  const std::string first = Draw(&drbg, 16);
+  assert(first == "74e508dcdf6fff8faec570210131381a");
+
+  Draw(&drbg, 1500);
+  assert(drbg.reseed_count() == 2);
+  assert(entropy.calls == 2);
+
+  // A failing source keeps the current key and is retried on the next refill.
+  entropy.fail = true;
+  Draw(&drbg, 2000);
+  assert(drbg.reseed_count() == 2 && drbg.reseed_failures() > 0);
+  entropy.fail = false;
+  Draw(&drbg, 480);
+  assert(drbg.reseed_count() == 3);
+
+  // Reseeding drops buffered output, so two generators part ways at once.
+  offline_wallet::ChaChaDrbg twin(&entropy, options);
+  offline_wallet::ChaChaDrbg other(&entropy, options);
+  std::string twin_draw = Draw(&twin, 8);
+  std::string other_draw = Draw(&other, 8);
+  assert(twin_draw == other_draw);
+  entropy.fill = 0x11;
+  const bool reseeded = other.Reseed();
+  assert(reseeded);
+  twin_draw = Draw(&twin, 8);
+  other_draw = Draw(&other, 8);
+  assert(twin_draw != other_draw);
+
+  ScriptedEntropy dead;
+  dead.fail = true;
+  offline_wallet::ChaChaDrbg unseeded(&dead);
+  assert(!unseeded.seeded());
+  dead.fail = false;
+  Draw(&unseeded, 1);
+  assert(unseeded.seeded());
+}
+
+void TestUnseededDrbgFailsClosed() {
+  ScriptedEntropy dead;
+  dead.fail = true;
+  offline_wallet::ChaChaDrbg unseeded(&dead);
+  // What an unseeded generator would serve if it ran on its all-zero key.
+  offline_wallet::ChaChaDrbg zero_key(offline_wallet::ChaCha20Key{});
+  const std::string zero_stream = Draw(&zero_key, 64);
+
+  const std::string drawn = Draw(&unseeded, 64);
+  assert(drawn == std::string(128, '0') && drawn != zero_stream);
+  char buffer[16];
+  const std::size_t filled = unseeded.FillHex(8, buffer);
+  assert(filled == 0);
+  const std::string hex = unseeded.NextHex(8);
+  assert(hex.empty());
+  const bool ready = unseeded.Ready();
+  assert(!ready && !unseeded.seeded());
+  // The constructor and every draw retried the source.
+  assert(dead.calls == 5 && unseeded.reseed_failures() == 5);
+
+  // The engine refuses handshakes, and the pool stays empty, until a seed holds.
+  TestSignatureProvider signer;
+  ManualClock clock;
+  TestJournal journal;
+  offline_wallet::OfflineEngine engine(offline_wallet::RiskPolicy{}, &signer, &unseeded, &clock, &journal);
+  offline_wallet::IntentPool pool(&unseeded, &journal, 4);
+  engine.SetIntentPool(&pool);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 1};
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::LocalTransaction tx;
+  std::size_t added = pool.Refill();
+  assert(added == 0);
+  auto result = engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kRandomUnavailable);
+  assert(intent.tx_id.empty());
+
+  dead.fail = false;
+  added = pool.Refill();
+  assert(added == 4);
+  result = engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(unseeded.seeded() && intent.tx_id.size() == 3 + 16);
+}
+
+void TestLegacyProvidersStillFillHex() {
+  LegacyRandomProvider legacy;
+  legacy.text = "x12";
+  char buffer[16];
+  std::size_t filled = legacy.FillHex(8, buffer);
+  assert(filled == 3);
+  assert(std::string(buffer, 3) == "x12");
+  legacy.text = std::string(40, 'a');
+  filled = legacy.FillHex(8, buffer);
+  assert(filled == 16);
+}
+
+void TestEngineIdsFromDrbg() {
+  TestSignatureProvider signer;
+  ManualClock clock;
+  TestJournal merchant_journal;
+  TestJournal payer_journal;
+  offline_wallet::ChaChaDrbg merchant_random(CountingKey());
+  offline_wallet::ChaCha20Key payer_seed = CountingKey();
+  payer_seed[0] = 0xFF;
+  offline_wallet::ChaChaDrbg payer_random(payer_seed);
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signer, &merchant_random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signer, &payer_random, &clock,
+                                             &payer_journal);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 1};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 1};
+
+  std::set<std::string> seen;
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  for (int i = 0; i < 20; ++i) {
+    const auto intent_result = merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+    assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+    const auto auth_result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+    assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+    const auto accept_result = merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+    assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+    const std::string ids[] = {std::string(intent.tx_id).substr(3),
+                               std::string(intent.merchant_intent_id).substr(3),
+                               std::string(intent.merchant_nonce),
+                               std::string(authorization.payer_authorization_id).substr(3),
+                               std::string(authorization.payer_nonce),
+                               std::string(receipt.receipt_id).substr(2)};
+    for (const std::string& id : ids) {
+      assert(id.size() == 16 && IsLowerHex(id));
+      const bool fresh = seen.insert(id).second;
+      assert(fresh);
+    }
+  }
+
+  // The first tx_id is the first eight bytes of the seeded stream.
+  offline_wallet::ChaChaDrbg replay(CountingKey());
+  offline_wallet::OfflineEngine replay_engine(offline_wallet::RiskPolicy{}, &signer, &replay, &clock,
+                                              &merchant_journal);
+  const auto replay_result = replay_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+  assert(replay_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(std::string(intent.tx_id) == "tx-2b23cce7a26023ab");
+  assert(std::string(intent.merchant_intent_id) == "mi-3f0eef693ac87f64");
+}
+
+}  // namespace
+
+int main() {
+  TestChaCha20Rfc8439Block();
+  TestSeededStreamIsReproducible();
+  TestEntropySeedingAndPeriodicReseed();
+  TestUnseededDrbgFailsClosed();
+  TestLegacyProvidersStillFillHex();
+  TestEngineIdsFromDrbg();
+  return 0;
+}
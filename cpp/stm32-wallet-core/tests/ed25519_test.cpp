@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/ed25519.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/sha512.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::Ed25519PublicKey;
+using offline_wallet::Ed25519Seed;
+using offline_wallet::Ed25519Signature;
+using offline_wallet::Ed25519SigningKey;
+using offline_wallet::HandshakeStatus;
+using offline_wallet::Sha512;
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::ManualClock;
+
+template <std::size_t N>
+std::string Hex(const std::array<std::uint8_t, N>& bytes) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string text;
+  for (std::uint8_t byte : bytes) {
+    text.push_back(kHex[byte >> 4]);
+    text.push_back(kHex[byte & 0x0F]);
+  }
+  return text;
+}
+
+std::vector<std::uint8_t> Bytes(const std::string& hex) {
+  std::vector<std::uint8_t> bytes;
+  for (std::size_t i = 0; i + 1 < hex.size(); i += 2) {
+    bytes.push_back(static_cast<std::uint8_t>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+  }
+  return bytes;
+}
+
+template <std::size_t N>
+std::array<std::uint8_t, N> Array(const std::string& hex) {
+  const std::vector<std::uint8_t> bytes = Bytes(hex);
+  assert(bytes.size() == N);
+  std::array<std::uint8_t, N> out;
+  std::copy(bytes.begin(), bytes.end(), out.begin());
+  return out;
+}
+
+Ed25519Seed SeedFor(int n) {
+  Ed25519Seed seed{};
+  seed[0] = static_cast<std::uint8_t>(n);
+  seed[1] = static_cast<std::uint8_t>(n >> 8);
+  seed[31] = 0x5A;
+  return seed;
+}
+
+void TestSha512Vectors() {
+  assert(Hex(Sha512::Hash("", 0)) ==
+         "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+         "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e");
+  assert(Hex(Sha512::Hash("abc", 3)) ==
+         "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+         "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f");
+
+  // One million 'a's in uneven pieces, crossing block boundaries.
+  Sha512 hash;
+  const std::string chunk(997, 'a');
+  std::size_t fed = 0;
+  while (fed < 1'000'000) {
+    const std::size_t size = std::min(chunk.size(), 1'000'000 - fed);
+    hash.Update(chunk.data(), size);
+    fed += size;
+  }
+  offline_wallet::Sha512Digest digest;
+  hash.Finish(&digest);
+  assert(Hex(digest) ==
+         "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+         "de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b");
+}
+
+// RFC 8032 section 7.1, tests 1 to 3.
+void TestRfc8032Vectors() {
+  struct Vector {
+    const char* seed;
+    const char* public_key;
+    const char* message;
+    const char* signature;
+  };
+  const Vector vectors[] = {
+      {"9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+       "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a", "",
+       "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e06522490155"
+       "5fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b"},
+      {"4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+       "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c", "72",
+       "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da"
+       "085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00"},
+      {"c5aa8df43f9f837bedb7442f31dcb7b166d38535076f094b85ce3a2e0b4458f7",
+       "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025", "af82",
+       "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac"
+       "18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a"},
+  };
+  for (const Vector& vector : vectors) {
+    Ed25519SigningKey key;
+    offline_wallet::Ed25519ExpandSeed(Array<32>(vector.seed), &key);
+    assert(Hex(key.public_key) == vector.public_key);
+    std::vector<std::uint8_t> message = Bytes(vector.message);
+    Ed25519Signature signature;
+    offline_wallet::Ed25519Sign(key, message.data(), message.size(), &signature);
+    assert(Hex(signature) == vector.signature);
+    assert(offline_wallet::Ed25519Verify(key.public_key, message.data(), message.size(), signature));
+
+    message.push_back(0x00);
+    assert(!offline_wallet::Ed25519Verify(key.public_key, message.data(), message.size(), signature));
+    message.pop_back();
+    Ed25519Signature bad = signature;
+    bad[40] ^= 0x04;
+    assert(!offline_wallet::Ed25519Verify(key.public_key, message.data(), message.size(), bad));
+    bad = signature;
+    bad[3] ^= 0x01;
+    assert(!offline_wallet::Ed25519Verify(key.public_key, message.data(), message.size(), bad));
+  }
+}
+
+void TestRejectsNonCanonicalEncodings() {
+  Ed25519SigningKey key;
+  offline_wallet::Ed25519ExpandSeed(SeedFor(1), &key);
+  const std::string message = "non-canonical";
+  Ed25519Signature signature;
+  offline_wallet::Ed25519Sign(key, message.data(), message.size(), &signature);
+  assert(offline_wallet::Ed25519Verify(key.public_key, message.data(), message.size(), signature));
+
+  // S + L is the same scalar but must be refused (signature malleability).
+  static constexpr std::uint8_t kOrder[32] = {0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+                                              0xa2, 0xde, 0xf9, 0xde, 0x14, 0,    0,    0,    0,    0,    0,
+                                              0,    0,    0,    0,    0,    0,    0,    0,    0,    0x10};
+  Ed25519Signature malleated = signature;
+  int carry = 0;
+  for (int i = 0; i < 32; ++i) {
+    const int sum = malleated[static_cast<std::size_t>(32 + i)] + kOrder[i] + carry;
+    malleated[static_cast<std::size_t>(32 + i)] = static_cast<std::uint8_t>(sum);
+    carry = sum >> 8;
+  }
+  assert(carry == 0);
+  assert(!offline_wallet::Ed25519Verify(key.public_key, message.data(), message.size(), malleated));
+
+  // y = p for the public key and for R.
+  Ed25519PublicKey unreduced;
+  unreduced.fill(0xFF);
+  unreduced[0] = 0xED;
+  unreduced[31] = 0x7F;
+  assert(!offline_wallet::Ed25519Verify(unreduced, message.data(), message.size(), signature));
+  Ed25519Signature unreduced_r = signature;
+  std::copy(unreduced.begin(), unreduced.end(), unreduced_r.begin());
+  assert(!offline_wallet::Ed25519Verify(key.public_key, message.data(), message.size(), unreduced_r));
+}
+
+void TestBatchVerification() {
+  constexpr int kCount = 24;
+  std::vector<Ed25519SigningKey> keys(kCount);
+  std::vector<std::string> messages(kCount);
+  std::vector<Ed25519Signature> signatures(kCount);
+  std::vector<offline_wallet::Ed25519BatchItem> items(kCount);
+  for (int i = 0; i < kCount; ++i) {
+    offline_wallet::Ed25519ExpandSeed(SeedFor(i), &keys[i]);
+    messages[i] = "tx-" + std::to_string(i) + "|mi-" + std::to_string(i) + "|" + std::to_string(100 + i);
+    offline_wallet::Ed25519Sign(keys[i], messages[i].data(), messages[i].size(), &signatures[i]);
+    items[i] = {&keys[i].public_key, messages[i].data(), messages[i].size(), &signatures[i]};
+  }
+  bool valid[kCount];
+  bool all_valid = offline_wallet::Ed25519VerifyBatch(items.data(), kCount, valid);
+  assert(all_valid);
+  assert(std::all_of(valid, valid + kCount, [](bool v) { return v; }));
+  assert(offline_wallet::Ed25519VerifyBatch(items.data(), 0, nullptr));
+  assert(offline_wallet::Ed25519VerifyBatch(items.data(), 1, nullptr));
+
+  // A wrong key, a tampered message, and a malformed R are each singled out.
+  items[3].public_key = &keys[4].public_key;
+  messages[10][0] = 'T';
+  signatures[17][31] = 0x7F;
+  std::fill(signatures[17].begin() + 1, signatures[17].begin() + 31, 0xFF);
+  signatures[17][0] = 0xEE;
+  all_valid = offline_wallet::Ed25519VerifyBatch(items.data(), kCount, valid);
+  assert(!all_valid);
+  for (int i = 0; i < kCount; ++i) {
+    assert(valid[i] == (i != 3 && i != 10 && i != 17));
+  }
+  assert(!offline_wallet::Ed25519VerifyBatch(items.data(), kCount, nullptr));
+}
+
+void TestProvider() {
+  offline_wallet::Ed25519SignatureProvider provider;
+  provider.AddSigningKey("m-key", SeedFor(7));
+  Ed25519SigningKey payer;
+  offline_wallet::Ed25519ExpandSeed(SeedFor(8), &payer);
+  provider.AddPublicKey("payer-device-1", payer.public_key);
+
+  const std::string message = "tx-1|mi-1|500|CNY";
+  const std::string signature = provider.Sign(message, "m-key");
+  assert(signature.size() == 128);
+  const std::string unknown = provider.Sign(message, "unknown");
+  assert(unknown.empty());
+  Ed25519PublicKey merchant_key;
+  const bool found = provider.FindPublicKey("m-key", &merchant_key);
+  assert(found);
+  assert(provider.Verify(signature, message, "m-key"));
+  assert(provider.Verify(signature, message, Hex(merchant_key)));
+  assert(!provider.Verify(signature, message + "0", "m-key"));
+  assert(!provider.Verify(signature, message, "payer-device-1"));
+  assert(!provider.Verify(signature, message, "unknown"));
+  assert(!provider.Verify(signature.substr(2), message, "m-key"));
+
+  Ed25519Signature raw;
+  offline_wallet::Ed25519Sign(payer, message.data(), message.size(), &raw);
+  const std::string payer_signature = Hex(raw);
+  assert(provider.Verify(payer_signature, message, "payer-device-1"));
+
+  const offline_wallet::Ed25519SignatureProvider::Check checks[] = {
+      {signature, message, "m-key"},
+      {payer_signature, message, "payer-device-1"},
+      {payer_signature, message, "unknown"},
+      {"zz", message, "m-key"},
+  };
+  bool valid[4];
+  bool all_valid = provider.VerifyBatch(checks, 2, valid);
+  assert(all_valid && valid[0] && valid[1]);
+  all_valid = provider.VerifyBatch(checks, 4, valid);
+  assert(!all_valid);
+  assert(valid[0] && valid[1] && !valid[2] && !valid[3]);
+}
+
+void TestEngineVerifiesPeerSignatures() {
+  offline_wallet::RamBlockDevice merchant_device(4096, 8);
+  offline_wallet::FlashJournal merchant_journal(&merchant_device);
+  offline_wallet::RamBlockDevice payer_device(4096, 8);
+  offline_wallet::FlashJournal payer_journal(&payer_device);
+  const bool mounted = merchant_journal.Mount() && payer_journal.Mount();
+  assert(mounted);
+  ManualClock clock;
+  CounterRandomProvider random;
+
+  // Each side holds its own seed and the other's public key by device id.
+  offline_wallet::Ed25519SignatureProvider merchant_signer;
+  offline_wallet::Ed25519SignatureProvider payer_signer;
+  merchant_signer.AddSigningKey("m-key", SeedFor(100));
+  payer_signer.AddSigningKey("p-key", SeedFor(200));
+  Ed25519PublicKey key;
+  bool found = merchant_signer.FindPublicKey("m-key", &key);
+  assert(found);
+  payer_signer.AddPublicKey("merchant-device-1", key);
+  found = payer_signer.FindPublicKey("p-key", &key);
+  assert(found);
+  merchant_signer.AddPublicKey("payer-device-1", key);
+
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &merchant_signer, &random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &payer_signer, &random, &clock,
+                                             &payer_journal);
+  merchant_engine.SetVerifyPeerSignatures(true);
+  payer_engine.SetVerifyPeerSignatures(true);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 1};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 1};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  offline_wallet::HandshakeResult result = merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+  assert(intent.merchant_signature.size() == 128);
+
+  // A relabelled amount or an intent from an unknown device is refused
+  // before the payer records anything.
+  offline_wallet::PaymentIntent forged = intent;
+  forged.amount_cents = 50;
+  result = payer_engine.BuildPayerAuthorization(payer, forged, &authorization, &tx);
+  assert(result.status == HandshakeStatus::kSignatureInvalid);
+  forged = intent;
+  forged.merchant_device_id = "merchant-device-2";
+  result = payer_engine.BuildPayerAuthorization(payer, forged, &authorization, &tx);
+  assert(result.status == HandshakeStatus::kSignatureInvalid);
+  offline_wallet::HandshakeSession session;
+  forged.merchant_device_id = intent.merchant_device_id;
+  forged.merchant_nonce = "replaced";
+  payer_engine.StartPayerAuthorization(payer, forged, &session);
+  assert(session.done() && session.result().status == HandshakeStatus::kSignatureInvalid);
+  found = payer_journal.Load(intent.tx_id, &tx);
+  assert(!found);
+
+  result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+
+  offline_wallet::PaymentAuthorization tampered = authorization;
+  tampered.payer_counter += 1;
+  result = merchant_engine.AcceptAuthorization(merchant, tampered, &receipt, &tx);
+  assert(result.status == HandshakeStatus::kSignatureInvalid);
+  tampered = authorization;
+  tampered.payer_device_id = "payer-device-2";
+  result = merchant_engine.AcceptAuthorization(merchant, tampered, &receipt, &tx);
+  assert(result.status == HandshakeStatus::kSignatureInvalid);
+  found = merchant_journal.Load(intent.tx_id, &tx);
+  assert(found);
+  assert(tx.state == offline_wallet::TransactionState::kInitiated);
+
+  result = merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+  assert(tx.state == offline_wallet::TransactionState::kPendingSync);
+  assert(payer_signer.Verify(std::string(receipt.merchant_signature),
+                             std::string(receipt.tx_id) + "|" + std::string(authorization.payer_authorization_id) +
+                                 "|pending_sync",
+                             "merchant-device-1"));
+}
+
+}  // namespace
+
+int main() {
+  TestSha512Vectors();
+  TestRfc8032Vectors();
+  TestRejectsNonCanonicalEncodings();
+  TestBatchVerification();
+  TestProvider();
+  TestEngineVerifiesPeerSignatures();
+  return 0;
+}
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/expiry_sweeper.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::TransactionState;
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::FnvStreamingSigner;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+
+constexpr std::uint64_t kNow = 1'700'000'000;
+
+// Counts loads and can refuse state updates.
+class CountingJournal : public TestJournal {
+ public:
+  bool Load(const std::string& tx_id, offline_wallet::LocalTransaction* tx_out) const override {
+    ++loads;
+    return TestJournal::Load(tx_id, tx_out);
+  }
+
+  bool UpdateState(const std::string& tx_id, TransactionState state, const std::string& reason) override {
+    return !fail_updates && TestJournal::UpdateState(tx_id, state, reason);
+  }
+
+  TransactionState StateOf(const std::string& tx_id) const {
+    offline_wallet::LocalTransaction tx;
+    const bool found = TestJournal::Load(tx_id, &tx);
+    return found ? tx.state : TransactionState::kInitiated;
+  }
+
+  void Add(const std::string& tx_id, TransactionState state, std::uint64_t created_at = kNow) {
+    offline_wallet::LocalTransaction tx;
+    tx.tx_id = tx_id;
+    tx.state = state;
+    tx.created_at_epoch_seconds = created_at;
+    Save(tx);
+  }
+
+  mutable std::size_t loads = 0;
+  bool fail_updates = false;
+};
+
+void TestWheelFiresOnTimeAndOnlyWhatIsDue() {
+  ManualClock clock;
+  CountingJournal journal;
+  offline_wallet::ExpirySweeperOptions options;
+  options.grace_seconds = 5;
+  offline_wallet::ExpirySweeper sweeper(&journal, &clock, options);
+
+  // Near, far and past-the-horizon deadlines, plus one already overdue.
+  const std::uint64_t expiries[] = {kNow + 10, kNow + 300, kNow + 1'000, kNow + 100'000, kNow - 50};
+  for (std::size_t i = 0; i < 5; ++i) {
+    const std::string tx_id = "tx-" + std::to_string(i);
+    journal.Add(tx_id, TransactionState::kInitiated);
+    const bool tracked = sweeper.Track(tx_id, expiries[i]);
+    assert(tracked);
+  }
+  // Filler the sweeper never looks at.
+  for (int i = 0; i < 500; ++i) {
+    journal.Add("tx-idle-" + std::to_string(i), TransactionState::kPendingSync);
+  }
+  assert(sweeper.stats().tracked == 5 && sweeper.HasDue());
+
+  std::uint64_t fired_at[5] = {};
+  for (clock.now = kNow; clock.now <= kNow + 1'200; ++clock.now) {
+    const std::size_t loads = journal.loads;
+    const std::size_t expired = sweeper.Tick();
+    assert(journal.loads - loads == expired);
+    for (std::size_t i = 0; i < 5; ++i) {
+      if (fired_at[i] == 0 && journal.StateOf("tx-" + std::to_string(i)) == TransactionState::kExpired) {
+        fired_at[i] = clock.now;
+      }
+    }
+  }
+  assert(fired_at[0] == kNow + 15 && fired_at[1] == kNow + 305 && fired_at[2] == kNow + 1'005);
+  assert(fired_at[3] == 0 && fired_at[4] == kNow);
+  assert(journal.StateOf("tx-4") == TransactionState::kExpired);
+  assert(sweeper.stats().expired == 4 && sweeper.stats().tracked == 1);
+
+  // A long jump (device asleep) re-files once and still fires on the deadline.
+  clock.now = kNow + 100'004;
+  std::size_t expired = sweeper.Tick();
+  assert(expired == 0);
+  clock.now = kNow + 100'005;
+  expired = sweeper.Tick();
+  assert(expired == 1);
+  assert(sweeper.stats().tracked == 0 && journal.StateOf("tx-3") == TransactionState::kExpired);
+
+  // A clock set back does nothing.
+  clock.now = kNow;
+  expired = sweeper.Tick();
+  assert(expired == 0);
+}
+
+void TestAnsweredBudgetAndCapacity() {
+  ManualClock clock;
+  CountingJournal journal;
+  offline_wallet::ExpirySweeperOptions options;
+  options.max_tracked = 8;
+  options.grace_seconds = 0;
+  options.max_due_per_tick = 3;
+  offline_wallet::ExpirySweeper sweeper(&journal, &clock, options);
+
+  // An id longer than a FixedId is refused, and counted, with room to spare.
+  const bool long_id_tracked = sweeper.Track(std::string(offline_wallet::kFixedIdCapacity + 1, 'x'), kNow + 30);
+  assert(!long_id_tracked && sweeper.stats().refused == 1);
+
+  for (int i = 0; i < 8; ++i) {
+    const std::string tx_id = "tx-" + std::to_string(i);
+    journal.Add(tx_id, i < 6 ? TransactionState::kInitiated : TransactionState::kPendingSync);
+    const bool tracked = sweeper.Track(tx_id, kNow + 30);
+    assert(tracked);
+  }
+  bool tracked = sweeper.Track("tx-8", kNow + 30);
+  assert(!tracked);
+  assert(sweeper.stats().refused == 2);
+
+  // Journal failures leave the entry due for a retry.
+  clock.now = kNow + 30;
+  journal.fail_updates = true;
+  const std::size_t failed = sweeper.Tick();
+  assert(failed == 0 && sweeper.HasDue());
+  journal.fail_updates = false;
+  std::size_t expired = 0;
+  int ticks = 0;
+  while (sweeper.HasDue()) {
+    expired += sweeper.Tick();
+    ++ticks;
+  }
+  assert(expired == 6 && ticks == 3);
+  assert(sweeper.stats().answered == 2 && sweeper.stats().tracked == 0);
+  assert(journal.StateOf("tx-7") == TransactionState::kPendingSync);
+
+  // Freed entries are reused; a rebuild picks up initiated records only.
+  journal.Add("tx-boot", TransactionState::kInitiated, kNow + 100);
+  offline_wallet::RiskPolicy policy;
+  const bool rebuilt = sweeper.Rebuild(policy);
+  assert(rebuilt);
+  assert(sweeper.stats().tracked == 1);
+  clock.now = kNow + 100 + policy.intent_ttl_seconds;
+  expired = sweeper.Tick();
+  assert(expired == 1);
+  assert(journal.StateOf("tx-boot") == TransactionState::kExpired);
+}
+
+// A cashier terminal where two of three customers walk away after the QR is
+// shown. With the sweeper the abandoned intents expire and compaction drops
+// them, so a small flash journal keeps up; without it the journal fills.
+std::size_t RunTerminal(bool sweep, std::size_t* peak_live) {
+  offline_wallet::RamBlockDevice device(4096, 12);
+  offline_wallet::FlashJournalOptions journal_options;
+  journal_options.max_records = 96;
+  offline_wallet::FlashJournal merchant_journal(&device, journal_options);
+  const bool mounted = merchant_journal.Mount();
+  assert(mounted);
+  CountingJournal payer_journal;
+  ManualClock clock;
+  FnvStreamingSigner signer;
+  CounterRandomProvider random;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signer, &random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signer, &random, &clock,
+                                             &payer_journal);
+  offline_wallet::ExpirySweeperOptions sweeper_options;
+  sweeper_options.grace_seconds = 10;
+  offline_wallet::ExpirySweeper sweeper(&merchant_journal, &clock, sweeper_options);
+  if (sweep) {
+    merchant_engine.SetExpirySweeper(&sweeper);
+  }
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 1};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 1};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  std::size_t sales = 0;
+  for (int second = 0; second < 1'500; ++second, ++clock.now) {
+    if (sweep) {
+      sweeper.Tick();
+    }
+    while (merchant_journal.NeedsCompaction() && merchant_journal.CompactStep()) {
+    }
+    if (merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx).status !=
+        offline_wallet::HandshakeStatus::kOk) {
+      break;
+    }
+    if (second % 3 == 0) {
+      const auto auth_result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+      const auto accept_result = merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+      assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+      assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+      // Uploaded straight away; synced records are droppable too.
+      const bool synced = merchant_journal.UpdateState(tx.tx_id, TransactionState::kSynced, "");
+      assert(synced);
+    }
+    ++sales;
+    *peak_live = std::max(*peak_live, merchant_journal.stats().live_records);
+  }
+
+  if (sweep) {
+    // An answer that arrives after expiry is refused.
+    clock.now += offline_wallet::RiskPolicy{}.intent_ttl_seconds + sweeper_options.grace_seconds;
+    const auto intent_result = merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+    assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+    clock.now -= 1;
+    const auto auth_result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+    assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+    clock.now += 200;
+    while (sweeper.Tick() > 0) {
+    }
+    const auto late = merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+    assert(late.status == offline_wallet::HandshakeStatus::kExpired);
+  }
+  return sales;
+}
+
+void TestEngineExpiresAbandonedIntents() {
+  std::size_t peak_with = 0;
+  std::size_t peak_without = 0;
+  const std::size_t sales_with = RunTerminal(true, &peak_with);
+  assert(sales_with == 1'500);
+  assert(peak_with < 96);
+  const std::size_t sales_without = RunTerminal(false, &peak_without);
+  assert(sales_without < 1'500);
+  assert(peak_without == 96);
+}
+
+}  // namespace
+
+int main() {
+  TestWheelFiresOnTimeAndOnlyWhatIsDue();
+  TestAnsweredBudgetAndCapacity();
+  TestEngineExpiresAbandonedIntents();
+  return 0;
+}
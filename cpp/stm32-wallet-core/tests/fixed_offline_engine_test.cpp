@@ -0,0 +1,297 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "offline_wallet/chacha_drbg.hpp"
+#include "offline_wallet/fixed_offline_engine.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+std::size_t g_allocations = 0;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  ++g_allocations;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t /*size*/) noexcept { std::free(ptr); }
+
+namespace {
+
+using offline_wallet::testing::FnvDigest;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+
+constexpr char kHex[] = "0123456789abcdef";
+
+std::uint8_t NextSeedByte(std::uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return static_cast<std::uint8_t>(*state >> 24);
+}
+
+class FixedTestSignatureProvider : public offline_wallet::FixedSignatureProvider {
+ public:
+  bool Sign(const char* message,
+            std::size_t message_size,
+            const offline_wallet::FixedKeyId& key_id,
+            offline_wallet::FixedSignature* signature_out) override {
+    char digest[16];
+    FnvDigest(key_id.data(), key_id.size(), message, message_size, digest);
+    return signature_out->Assign(digest, sizeof(digest));
+  }
+
+  bool Verify(const offline_wallet::FixedSignature& signature,
+              const char* message,
+              std::size_t message_size,
+              const offline_wallet::FixedKeyId& public_key_or_id) override {
+    char digest[16];
+    FnvDigest(public_key_or_id.data(), public_key_or_id.size(), message, message_size, digest);
+    return signature.Equals(digest, sizeof(digest));
+  }
+};
+
+class FixedTestRandomProvider : public offline_wallet::FixedRandomProvider {
+ public:
+  void NextBytes(std::uint8_t* out, std::size_t size) override {
+    for (std::size_t i = 0; i < size; ++i) {
+      out[i] = NextSeedByte(&state_);
+    }
+  }
+
+ private:
+  std::uint32_t state_ = 7;
+};
+
+class FixedTestJournal : public offline_wallet::FixedTransactionJournal {
+ public:
+  bool Save(const offline_wallet::FixedLocalTransaction& tx) override {
+    for (std::size_t i = 0; i < count_; ++i) {
+      if (rows_[i].tx_id == tx.tx_id) {
+        rows_[i] = tx;
+        return true;
+      }
+    }
+    if (count_ == kSlots) {
+      return false;
+    }
+    rows_[count_++] = tx;
+    return true;
+  }
+
+  bool Load(const offline_wallet::FixedId& tx_id,
+            offline_wallet::FixedLocalTransaction* tx_out) const override {
+    for (std::size_t i = 0; i < count_; ++i) {
+      if (rows_[i].tx_id == tx_id && tx_out != nullptr) {
+        *tx_out = rows_[i];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool UpdateState(const offline_wallet::FixedId& tx_id,
+                   offline_wallet::TransactionState state,
+                   const offline_wallet::FixedReason& reason) override {
+    for (std::size_t i = 0; i < count_; ++i) {
+      if (rows_[i].tx_id == tx_id) {
+        rows_[i].state = state;
+        rows_[i].failure_reason = reason;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  static constexpr std::size_t kSlots = 4;
+  offline_wallet::FixedLocalTransaction rows_[kSlots];
+  std::size_t count_ = 0;
+};
+
+// An entropy source that has not come up; flip `ready` to let it seed.
+class PendingEntropy : public offline_wallet::EntropySource {
+ public:
+  bool Gather(std::uint8_t* out, std::size_t size) override {
+    for (std::size_t i = 0; i < size && ready; ++i) {
+      out[i] = static_cast<std::uint8_t>(i);
+    }
+    return ready;
+  }
+
+  bool ready = false;
+};
+
+class StdTestSignatureProvider : public offline_wallet::SignatureProvider {
+ public:
+  std::string Sign(const std::string& message, const std::string& key_id) override {
+    char digest[16];
+    FnvDigest(key_id.data(), key_id.size(), message.data(), message.size(), digest);
+    return std::string(digest, sizeof(digest));
+  }
+
+  bool Verify(const std::string& signature,
+              const std::string& message,
+              const std::string& public_key_or_id) override {
+    return signature == Sign(message, public_key_or_id);
+  }
+};
+
+class StdTestRandomProvider : public offline_wallet::RandomProvider {
+ public:
+  std::string NextHex(std::size_t bytes) override {
+    std::string out;
+    for (std::size_t i = 0; i < bytes; ++i) {
+      const std::uint8_t byte = NextSeedByte(&state_);
+      out.push_back(kHex[byte >> 4]);
+      out.push_back(kHex[byte & 0x0F]);
+    }
+    return out;
+  }
+
+ private:
+  std::uint32_t state_ = 7;
+};
+
+}  // namespace
+
+int main() {
+  FixedTestSignatureProvider signature;
+  FixedTestRandomProvider random;
+  ManualClock clock;
+  FixedTestJournal journal;
+
+  offline_wallet::FixedOfflineEngine engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock, &journal);
+
+  offline_wallet::FixedDeviceContext merchant;
+  merchant.account_id = "merchant-1";
+  merchant.device_id = "merchant-device-1";
+  merchant.signing_key_id = "m-key";
+  merchant.local_counter = 2;
+
+  offline_wallet::FixedDeviceContext payer;
+  payer.account_id = "payer-1";
+  payer.device_id = "payer-device-1";
+  payer.signing_key_id = "p-key";
+  payer.local_counter = 9;
+
+  offline_wallet::FixedPaymentIntent intent;
+  offline_wallet::FixedLocalTransaction merchant_tx;
+  offline_wallet::FixedPaymentAuthorization authorization;
+  offline_wallet::FixedLocalTransaction payer_tx;
+  offline_wallet::FixedPaymentReceipt receipt;
+  offline_wallet::FixedLocalTransaction accepted;
+
+  const std::size_t allocations_before = g_allocations;
+  auto intent_result = engine.BuildMerchantIntent(merchant, 400, "CNY", &intent, &merchant_tx);
+  auto auth_result = engine.BuildPayerAuthorization(payer, intent, &authorization, &payer_tx);
+  auto accept_result = engine.AcceptAuthorization(merchant, authorization, &receipt, &accepted);
+  const std::size_t handshake_allocations = g_allocations - allocations_before;
+
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(handshake_allocations == 0);
+  assert(accepted.state == offline_wallet::TransactionState::kPendingSync);
+  assert(receipt.amount_cents == 400);
+  assert(intent.tx_id.size() == 19);
+
+  offline_wallet::FixedPaymentAuthorization tampered = authorization;
+  tampered.amount_cents = 401;
+  auto mismatch = engine.AcceptAuthorization(merchant, tampered, &receipt, &accepted);
+  assert(mismatch.status == offline_wallet::HandshakeStatus::kMismatch);
+
+  // The std::string engine, fed the same random stream and signer, must agree
+  // field for field once the fixed outputs go through the adapter.
+  StdTestSignatureProvider std_signature;
+  StdTestRandomProvider std_random;
+  TestJournal std_journal;
+  offline_wallet::OfflineEngine std_engine(offline_wallet::RiskPolicy{}, &std_signature, &std_random, &clock,
+                                           &std_journal);
+
+  offline_wallet::DeviceContext std_merchant;
+  offline_wallet::DeviceContext std_payer;
+  offline_wallet::FromFixed(merchant, &std_merchant);
+  offline_wallet::FromFixed(payer, &std_payer);
+
+  offline_wallet::PaymentIntent std_intent;
+  offline_wallet::LocalTransaction std_tx;
+  offline_wallet::PaymentAuthorization std_authorization;
+  offline_wallet::PaymentReceipt std_receipt;
+  auto std_intent_result = std_engine.BuildMerchantIntent(std_merchant, 400, "CNY", &std_intent, &std_tx);
+  auto std_auth_result = std_engine.BuildPayerAuthorization(std_payer, std_intent, &std_authorization, &std_tx);
+  auto std_accept_result = std_engine.AcceptAuthorization(std_merchant, std_authorization, &std_receipt, &std_tx);
+  assert(std_intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(std_auth_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(std_accept_result.status == offline_wallet::HandshakeStatus::kOk);
+
+  offline_wallet::PaymentIntent adapted_intent;
+  offline_wallet::PaymentAuthorization adapted_authorization;
+  offline_wallet::PaymentReceipt adapted_receipt;
+  offline_wallet::LocalTransaction adapted_tx;
+  offline_wallet::FromFixed(intent, &adapted_intent);
+  offline_wallet::FromFixed(authorization, &adapted_authorization);
+  offline_wallet::FromFixed(receipt, &adapted_receipt);
+  offline_wallet::FromFixed(accepted, &adapted_tx);
+  assert(adapted_intent.tx_id == std_intent.tx_id);
+  assert(adapted_intent.merchant_nonce == std_intent.merchant_nonce);
+  assert(adapted_intent.merchant_signature == std_intent.merchant_signature);
+  assert(adapted_authorization.payer_signature == std_authorization.payer_signature);
+  assert(adapted_receipt.receipt_id == std_receipt.receipt_id);
+  assert(adapted_receipt.merchant_signature == std_receipt.merchant_signature);
+  assert(adapted_tx.idempotency_key == std_tx.idempotency_key);
+  assert(adapted_tx.payer_nonce == std_tx.payer_nonce);
+
+  offline_wallet::FixedLocalTransaction round_trip;
+  const bool converted = offline_wallet::ToFixed(std_tx, &round_trip);
+  assert(converted);
+  assert(round_trip.tx_id == accepted.tx_id && round_trip.idempotency_key == accepted.idempotency_key);
+
+  offline_wallet::PaymentIntent oversized = std_intent;
+  oversized.tx_id.assign(offline_wallet::kFixedIdCapacity + 1, 'a');
+  offline_wallet::FixedPaymentIntent rejected;
+  const bool truncated = offline_wallet::ToFixed(oversized, &rejected);
+  assert(!truncated);
+
+  // Over an unseeded DRBG every step refuses before drawing an id or nonce,
+  // so nothing is journaled under an all-zero tx_id.
+  PendingEntropy entropy;
+  offline_wallet::ChaChaDrbg unseeded(&entropy);
+  FixedTestJournal unseeded_journal;
+  offline_wallet::FixedOfflineEngine unseeded_engine(offline_wallet::RiskPolicy{}, &signature, &unseeded, &clock,
+                                                     &unseeded_journal);
+  offline_wallet::FixedPaymentIntent unseeded_intent;
+  offline_wallet::FixedLocalTransaction unseeded_tx;
+  intent_result = unseeded_engine.BuildMerchantIntent(merchant, 400, "CNY", &unseeded_intent, &unseeded_tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kRandomUnavailable);
+  assert(unseeded_intent.tx_id.empty());
+  offline_wallet::FixedLocalTransaction stored;
+  const bool zero_id_saved = unseeded_journal.Load("tx-0000000000000000", &stored);
+  assert(!zero_id_saved);
+  auth_result = unseeded_engine.BuildPayerAuthorization(payer, intent, &authorization, &payer_tx);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kRandomUnavailable);
+  const bool merchant_saved = unseeded_journal.Save(merchant_tx);
+  assert(merchant_saved);
+  accept_result = unseeded_engine.AcceptAuthorization(merchant, authorization, &receipt, &accepted);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kRandomUnavailable);
+  const bool loaded = unseeded_journal.Load(merchant_tx.tx_id, &stored);
+  assert(loaded && stored.state == offline_wallet::TransactionState::kInitiated);
+
+  entropy.ready = true;
+  intent_result = unseeded_engine.BuildMerchantIntent(merchant, 400, "CNY", &unseeded_intent, &unseeded_tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(unseeded.seeded() && !unseeded_intent.tx_id.Equals("tx-0000000000000000", 19));
+
+  return 0;
+}
@@ -0,0 +1,259 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/flash_journal.hpp"
+
+namespace {
+
+offline_wallet::LocalTransaction MakeTransaction(std::uint32_t n, offline_wallet::TransactionState state) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string suffix;
+  for (int shift = 28; shift >= 0; shift -= 4) {
+    suffix.push_back(kHex[(n >> shift) & 0x0F]);
+  }
+  offline_wallet::LocalTransaction tx;
+  tx.tx_id = "tx-" + suffix + suffix;
+  tx.merchant_account_id = "merchant-1";
+  tx.payer_account_id = "payer-" + std::to_string(n % 7);
+  tx.merchant_device_id = "merchant-device-1";
+  tx.payer_device_id = "payer-device-1";
+  tx.amount_cents = static_cast<std::int32_t>(100 + n);
+  tx.merchant_intent_id = "mi-" + suffix + suffix;
+  tx.merchant_nonce = suffix + suffix;
+  tx.merchant_counter = n;
+  tx.state = state;
+  tx.created_at_epoch_seconds = 1'700'000'000 + n;
+  tx.updated_at_epoch_seconds = tx.created_at_epoch_seconds;
+  tx.idempotency_key = "merchant:" + tx.tx_id;
+  return tx;
+}
+
+void TestRoundTripAndRemount() {
+  offline_wallet::RamBlockDevice device(1024, 8);
+  offline_wallet::FlashJournal journal(&device);
+  const bool mounted = journal.Mount();
+  assert(mounted);
+
+  for (std::uint32_t n = 0; n < 40; ++n) {
+    const bool saved = journal.Save(MakeTransaction(n, offline_wallet::TransactionState::kInitiated));
+    assert(saved);
+  }
+  const bool updated = journal.UpdateState(MakeTransaction(3, {}).tx_id,
+                                           offline_wallet::TransactionState::kRejected, "insufficient_funds");
+  assert(updated);
+
+  offline_wallet::LocalTransaction loaded;
+  bool found = journal.Load(MakeTransaction(17, {}).tx_id, &loaded);
+  assert(found);
+  assert(loaded.amount_cents == 117 && loaded.idempotency_key == "merchant:" + loaded.tx_id);
+  found = journal.Load("tx-missing", &loaded);
+  assert(!found);
+
+  // One program and one sync per Save: the log only ever appends.
+  assert(device.program_calls() >= 41);
+
+  offline_wallet::FlashJournal remounted(&device);
+  const bool remounted_ok = remounted.Mount();
+  assert(remounted_ok);
+  assert(remounted.stats().live_records == 40);
+  found = remounted.Load(MakeTransaction(3, {}).tx_id, &loaded);
+  assert(found);
+  assert(loaded.state == offline_wallet::TransactionState::kRejected);
+  assert(loaded.failure_reason == "insufficient_funds");
+  const bool saved = remounted.Save(MakeTransaction(40, offline_wallet::TransactionState::kPendingSync));
+  assert(saved);
+}
+
+void TestCompactionDropsSyncedAndSpreadsWear() {
+  offline_wallet::RamBlockDevice device(512, 6);
+  offline_wallet::FlashJournalOptions options;
+  options.max_records = 64;
+  offline_wallet::FlashJournal journal(&device, options);
+  const bool mounted = journal.Mount();
+  assert(mounted);
+
+  // A long-lived pending record must survive every compaction.
+  const offline_wallet::LocalTransaction pinned =
+      MakeTransaction(9'999, offline_wallet::TransactionState::kPendingSync);
+  bool saved = journal.Save(pinned);
+  assert(saved);
+
+  for (std::uint32_t n = 0; n < 2'000; ++n) {
+    offline_wallet::LocalTransaction tx = MakeTransaction(n, offline_wallet::TransactionState::kInitiated);
+    saved = journal.Save(tx);
+    assert(saved);
+    tx.state = offline_wallet::TransactionState::kPendingSync;
+    saved = journal.Save(tx);
+    assert(saved);
+    const bool updated = journal.UpdateState(tx.tx_id, offline_wallet::TransactionState::kSynced, "");
+    assert(updated);
+    while (journal.NeedsCompaction()) {
+      const bool compacted = journal.CompactStep();
+      assert(compacted);
+    }
+  }
+
+  const offline_wallet::FlashJournalStats stats = journal.stats();
+  assert(stats.compacted_sectors > 100);
+  assert(stats.dropped_records > 0);
+  assert(stats.live_records < options.max_records);
+  assert(stats.max_erase_count - stats.min_erase_count <= 8);
+
+  offline_wallet::LocalTransaction loaded;
+  bool found = journal.Load(pinned.tx_id, &loaded);
+  assert(found);
+  assert(loaded.state == offline_wallet::TransactionState::kPendingSync);
+
+  offline_wallet::FlashJournal remounted(&device, options);
+  const bool remounted_ok = remounted.Mount();
+  assert(remounted_ok);
+  found = remounted.Load(pinned.tx_id, &loaded);
+  assert(found);
+  assert(remounted.stats().live_records == stats.live_records);
+}
+
+void TestTornRecordIsIgnored() {
+  offline_wallet::RamBlockDevice device(1024, 4);
+  offline_wallet::FlashJournal journal(&device);
+  const bool mounted = journal.Mount();
+  assert(mounted);
+  const auto first = MakeTransaction(1, offline_wallet::TransactionState::kInitiated);
+  auto second = MakeTransaction(2, offline_wallet::TransactionState::kInitiated);
+  bool saved = journal.Save(first) && journal.Save(second);
+  assert(saved);
+  second.state = offline_wallet::TransactionState::kPendingSync;
+  saved = journal.Save(second);
+  assert(saved);
+
+  // Simulate power loss mid-program of the last record: clear its tail bits.
+  // Every sector carries a 32-byte header, so only look past it, and skip
+  // bytes that are already zero.
+  std::size_t last = 0;
+  for (std::size_t i = 0; i < device.bytes().size(); ++i) {
+    if (i % device.SectorSize() >= 32 && device.bytes()[i] != 0xFF && device.bytes()[i] != 0x00) {
+      last = i;
+    }
+  }
+  device.bytes()[last] = 0x00;
+
+  offline_wallet::FlashJournal remounted(&device);
+  const bool remounted_ok = remounted.Mount();
+  assert(remounted_ok);
+  offline_wallet::LocalTransaction loaded;
+  bool found = remounted.Load(first.tx_id, &loaded) && remounted.Load(second.tx_id, &loaded);
+  assert(found);
+  assert(loaded.state == offline_wallet::TransactionState::kInitiated);
+  saved = remounted.Save(MakeTransaction(3, offline_wallet::TransactionState::kInitiated));
+  found = remounted.Load(MakeTransaction(3, {}).tx_id, &loaded);
+  assert(saved && found);
+}
+
+void TestFileBackedDevicePersists() {
+  const char* path = "flash_journal_test.img";
+  std::remove(path);
+  {
+    offline_wallet::FileBlockDevice device(path, 1024, 4);
+    assert(device.IsOpen());
+    offline_wallet::FlashJournal journal(&device);
+    const bool mounted = journal.Mount();
+    const bool saved = journal.Save(MakeTransaction(5, offline_wallet::TransactionState::kPendingSync));
+    assert(mounted && saved);
+  }
+  {
+    offline_wallet::FileBlockDevice device(path, 1024, 4);
+    offline_wallet::FlashJournal journal(&device);
+    const bool mounted = journal.Mount();
+    assert(mounted);
+    offline_wallet::LocalTransaction loaded;
+    const bool found = journal.Load(MakeTransaction(5, {}).tx_id, &loaded);
+    assert(found);
+    assert(loaded.state == offline_wallet::TransactionState::kPendingSync);
+  }
+  std::remove(path);
+}
+
+// Two tx_ids with the same 64-bit FNV-1a hash; a peer can pick ids like these.
+void TestCollidingIdsKeepTheirOwnRecords() {
+  offline_wallet::RamBlockDevice device(1024, 8);
+  offline_wallet::FlashJournalOptions options;
+  options.max_records = 64;
+  offline_wallet::FlashJournal journal(&device, options);
+  const bool mounted = journal.Mount();
+  assert(mounted);
+
+  auto first = MakeTransaction(1, offline_wallet::TransactionState::kInitiated);
+  auto second = MakeTransaction(2, offline_wallet::TransactionState::kInitiated);
+  first.tx_id = "tx-lGkCJbwkjE2";
+  second.tx_id = "tx-ftWgIVzRsx6";
+  bool saved = journal.Save(first) && journal.Save(second);
+  assert(saved && journal.stats().live_records == 2);
+
+  const auto expect = [](const offline_wallet::FlashJournal& j, const offline_wallet::LocalTransaction& tx,
+                         offline_wallet::TransactionState state) {
+    offline_wallet::LocalTransaction loaded;
+    const bool found = j.Load(tx.tx_id, &loaded);
+    assert(found && loaded.amount_cents == tx.amount_cents && loaded.state == state);
+  };
+  expect(journal, first, offline_wallet::TransactionState::kInitiated);
+  expect(journal, second, offline_wallet::TransactionState::kInitiated);
+
+  // A plain update, a batch and a state-update group each touch one id only.
+  const bool updated = journal.UpdateState(first.tx_id, offline_wallet::TransactionState::kAuthorized, "");
+  assert(updated);
+  const bool batched = journal.BeginBatch() && journal.Stage(second) && journal.CommitBatch();
+  assert(batched);
+  const offline_wallet::StateUpdate updates[] = {{second.tx_id, offline_wallet::TransactionState::kPendingSync, ""}};
+  const bool grouped = journal.UpdateStates(updates, 1);
+  assert(grouped && journal.stats().live_records == 2);
+  expect(journal, first, offline_wallet::TransactionState::kAuthorized);
+  expect(journal, second, offline_wallet::TransactionState::kPendingSync);
+
+  // Replay keeps them apart, and so does a checkpoint plus its tail.
+  std::vector<std::uint8_t> image;
+  journal.AppendCheckpoint(&image);
+  saved = journal.Save(MakeTransaction(3, offline_wallet::TransactionState::kInitiated));
+  assert(saved);
+  offline_wallet::FlashJournal remounted(&device, options);
+  const bool remounted_ok = remounted.Mount();
+  assert(remounted_ok && remounted.stats().live_records == 3);
+  expect(remounted, first, offline_wallet::TransactionState::kAuthorized);
+  expect(remounted, second, offline_wallet::TransactionState::kPendingSync);
+  offline_wallet::FlashJournal restored(&device, options);
+  const bool restored_ok = restored.MountFromCheckpoint(image.data(), image.size());
+  assert(restored_ok && restored.stats().live_records == 3);
+  expect(restored, first, offline_wallet::TransactionState::kAuthorized);
+  expect(restored, second, offline_wallet::TransactionState::kPendingSync);
+
+  // Compaction drops the synced one and relocates the other.
+  const bool synced = restored.UpdateState(first.tx_id, offline_wallet::TransactionState::kSynced, "");
+  assert(synced);
+  for (std::uint32_t n = 10; n < 400; ++n) {
+    auto tx = MakeTransaction(n, offline_wallet::TransactionState::kSynced);
+    saved = restored.Save(tx);
+    assert(saved);
+    while (restored.NeedsCompaction()) {
+      const bool compacted = restored.CompactStep();
+      assert(compacted);
+    }
+  }
+  assert(restored.stats().dropped_records > 0);
+  offline_wallet::LocalTransaction loaded;
+  const bool found = restored.Load(first.tx_id, &loaded);
+  assert(!found);
+  expect(restored, second, offline_wallet::TransactionState::kPendingSync);
+}
+
+}  // namespace
+
+int main() {
+  TestRoundTripAndRemount();
+  TestCompactionDropsSyncedAndSpreadsWear();
+  TestTornRecordIsIgnored();
+  TestFileBackedDevicePersists();
+  TestCollidingIdsKeepTheirOwnRecords();
+  return 0;
+}
@@ -0,0 +1,252 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/handshake_arena.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::FnvStreamingSigner;
+using offline_wallet::testing::ManualClock;
+
+std::size_t g_allocations = 0;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  ++g_allocations;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+// std::pmr::new_delete_resource() allocates through the aligned form.
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  ++g_allocations;
+  const auto align = static_cast<std::size_t>(alignment);
+  if (void* ptr = std::aligned_alloc(align, (size / align + 1) * align)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t /*size*/) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t /*alignment*/) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t /*size*/, std::align_val_t /*alignment*/) noexcept { std::free(ptr); }
+
+namespace {
+
+// Overwrites a fixed set of rows in place, so their strings keep capacity.
+class RingJournal : public offline_wallet::TransactionJournal {
+ public:
+  bool Save(const offline_wallet::LocalTransaction& tx) override {
+    std::size_t slot = Find(tx.tx_id);
+    if (slot == kSlots) {
+      slot = next_++ % kSlots;
+    }
+    rows_[slot] = tx;
+    return true;
+  }
+
+  bool Load(const std::string& tx_id, offline_wallet::LocalTransaction* tx_out) const override {
+    const std::size_t slot = Find(tx_id);
+    if (slot == kSlots || tx_out == nullptr) {
+      return false;
+    }
+    *tx_out = rows_[slot];
+    return true;
+  }
+
+  bool UpdateState(const std::string& tx_id,
+                   offline_wallet::TransactionState state,
+                   const std::string& reason) override {
+    const std::size_t slot = Find(tx_id);
+    if (slot == kSlots) {
+      return false;
+    }
+    rows_[slot].state = state;
+    rows_[slot].failure_reason = reason;
+    return true;
+  }
+
+ private:
+  static constexpr std::size_t kSlots = 4;
+
+  std::size_t Find(std::string_view tx_id) const {
+    for (std::size_t slot = 0; slot < kSlots; ++slot) {
+      if (std::string_view(rows_[slot].tx_id) == tx_id) {
+        return slot;
+      }
+    }
+    return kSlots;
+  }
+
+  offline_wallet::LocalTransaction rows_[kSlots];
+  std::size_t next_ = 0;
+};
+
+class RecordingListener : public offline_wallet::ArenaListener {
+ public:
+  void OnReset(const offline_wallet::ArenaUsage& usage) override { resets.push_back(usage); }
+
+  std::vector<offline_wallet::ArenaUsage> resets;
+};
+
+void TestArenaBumpsAndResets() {
+  alignas(std::max_align_t) unsigned char buffer[256];
+  offline_wallet::HandshakeArena arena(buffer, sizeof(buffer));
+  RecordingListener listener;
+  listener.resets.reserve(4);
+  arena.SetListener(&listener);
+
+  void* first = arena.allocate(40, 8);
+  auto* second = static_cast<unsigned char*>(arena.allocate(10, 16));
+  assert(first == buffer);
+  assert(reinterpret_cast<std::uintptr_t>(second) % 16 == 0);
+  assert(second >= buffer + 40 && second < buffer + 64);
+  arena.deallocate(first, 40, 8);  // No-op; the space comes back on Reset.
+  assert(arena.usage().allocations == 2 && arena.usage().bytes == 58 && arena.usage().overflow_bytes == 0);
+
+  // Past the buffer, requests go upstream and are counted as overflow.
+  void* large = arena.allocate(1'000, 8);
+  assert(large != nullptr && (large < buffer || large >= buffer + sizeof(buffer)));
+  assert(arena.usage().overflow_bytes == 1'000 && arena.usage().bytes == 1'058);
+
+  arena.Reset();
+  assert(listener.resets.size() == 1 && listener.resets[0].bytes == 1'058);
+  assert(arena.usage().bytes == 0 && arena.peak().bytes == 1'058);
+  void* reused = arena.allocate(16, 8);
+  assert(reused == buffer);
+
+  arena.Reset();
+  assert(listener.resets.size() == 2 && listener.resets[1].bytes == 16);
+  assert(arena.peak().bytes == 1'058 && arena.peak().overflow_bytes == 1'000);
+
+  // A null upstream turns overflow into an allocation failure.
+  offline_wallet::HandshakeArena bounded(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+  bool threw = false;
+  try {
+    static_cast<void>(bounded.allocate(sizeof(buffer) + 1, 1));
+  } catch (const std::bad_alloc&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+void TestModelsTakeAllocator() {
+  alignas(std::max_align_t) unsigned char buffer[512];
+  offline_wallet::HandshakeArena arena(buffer, sizeof(buffer));
+  offline_wallet::LocalTransaction tx(&arena);
+  tx.merchant_device_id = "merchant-device-with-a-long-name";
+  assert(tx.currency == "CNY");
+  assert(tx.merchant_device_id.get_allocator().resource() == &arena);
+  assert(arena.usage().bytes > 0 && arena.usage().overflow_bytes == 0);
+
+  // Plain copies leave the arena, so they survive its reset.
+  const offline_wallet::LocalTransaction copy = tx;
+  assert(copy.merchant_device_id.get_allocator().resource() == std::pmr::get_default_resource());
+  const offline_wallet::LocalTransaction placed(copy, &arena);
+  assert(placed.merchant_device_id.get_allocator().resource() == &arena);
+  assert(placed.merchant_device_id == copy.merchant_device_id);
+
+  // Fields still pass as std::string, as they did before the models took an
+  // allocator.
+  const std::string device_id = placed.merchant_device_id;
+  std::vector<std::string> ids;
+  ids.push_back(placed.merchant_device_id);
+  assert(device_id == placed.merchant_device_id && placed.merchant_device_id == ids.front());
+  assert(placed.merchant_device_id != std::string("merchant-device-2"));
+}
+
+// After warm-up the engine's own scratch models are the only heap users in a
+// handshake with these providers; an arena takes all of them.
+void TestEngineHandshakeStaysInArena() {
+  FnvStreamingSigner signer;
+  CounterRandomProvider random("x");
+  ManualClock clock;
+  RingJournal merchant_journal;
+  RingJournal payer_journal;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signer, &random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signer, &random, &clock,
+                                             &payer_journal);
+  const offline_wallet::DeviceContext merchant{"merchant-account-0001", "merchant-device-0001", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-account-000001", "payer-device-000001", "p-key", 9};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  const auto round = [&] {
+    return merchant_engine.BuildMerchantIntent(merchant, 1'250, "CNY", &intent, &tx).status ==
+               offline_wallet::HandshakeStatus::kOk &&
+           payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx).status ==
+               offline_wallet::HandshakeStatus::kOk &&
+           merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx).status ==
+               offline_wallet::HandshakeStatus::kOk;
+  };
+  for (int i = 0; i < 8; ++i) {
+    const bool ok = round();
+    assert(ok);
+  }
+  std::size_t before = g_allocations;
+  bool ok = round();
+  assert(ok);
+  const std::size_t heap_allocations = g_allocations - before;
+  assert(heap_allocations > 0);
+
+  alignas(std::max_align_t) unsigned char merchant_buffer[2048];
+  alignas(std::max_align_t) unsigned char payer_buffer[2048];
+  offline_wallet::HandshakeArena merchant_arena(merchant_buffer, sizeof(merchant_buffer));
+  offline_wallet::HandshakeArena payer_arena(payer_buffer, sizeof(payer_buffer));
+  RecordingListener listener;
+  listener.resets.reserve(16);
+  merchant_arena.SetListener(&listener);
+  merchant_engine.SetHandshakeArena(&merchant_arena);
+  payer_engine.SetHandshakeArena(&payer_arena);
+  for (int i = 0; i < 2; ++i) {
+    ok = round();
+    assert(ok);
+  }
+  before = g_allocations;
+  ok = round();
+  assert(ok && g_allocations == before);
+
+  // Each merchant call resets its arena once, and the outputs outlive it.
+  assert(listener.resets.size() == 6);
+  for (const offline_wallet::ArenaUsage& usage : listener.resets) {
+    assert(usage.bytes > 0 && usage.overflow_bytes == 0);
+  }
+  assert(merchant_arena.usage().bytes == 0 && payer_arena.usage().bytes == 0);
+  assert(merchant_arena.peak().bytes > 0 && payer_arena.peak().bytes > 0);
+  assert(receipt.merchant_account_id == "merchant-account-0001");
+  assert(tx.payer_device_id == "payer-device-000001");
+  assert(tx.state == offline_wallet::TransactionState::kPendingSync);
+  assert(tx.merchant_device_id.get_allocator().resource() == std::pmr::get_default_resource());
+
+  // Failed calls reset the arena as well.
+  const auto denied = merchant_engine.BuildMerchantIntent(merchant, 0, "CNY", &intent, &tx);
+  assert(denied.status == offline_wallet::HandshakeStatus::kPolicyDenied);
+  assert(listener.resets.size() == 7);
+}
+
+}  // namespace
+
+int main() {
+  TestArenaBumpsAndResets();
+  TestModelsTakeAllocator();
+  TestEngineHandshakeStaysInArena();
+  return 0;
+}
@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/replay_filter.hpp"
+#include "offline_wallet/spend_tracker.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::HandshakeSession;
+using offline_wallet::HandshakeStatus;
+using offline_wallet::SessionWait;
+using offline_wallet::testing::FnvDigest;
+using offline_wallet::testing::LcgRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+
+constexpr std::uint64_t kNow = 1'700'000'000;
+
+class DigestSigner : public offline_wallet::SignatureProvider {
+ public:
+  std::string Sign(const std::string& message, const std::string& key_id) override {
+    return FnvDigest(key_id, message);
+  }
+
+  bool Verify(const std::string& signature,
+              const std::string& message,
+              const std::string& public_key_or_id) override {
+    return signature == FnvDigest(public_key_or_id, message);
+  }
+};
+
+// Performs whatever a session waits for, the blocking way.
+void Drive(HandshakeSession* session, offline_wallet::TransactionJournal* journal) {
+  while (!session->done()) {
+    if (session->wait() == SessionWait::kSignature) {
+      const bool completed = session->CompleteSignature(FnvDigest(session->key_id(), session->message()));
+      assert(completed);
+    } else {
+      const bool completed = session->CompleteJournalWrite(journal->Save(session->record()));
+      assert(completed);
+    }
+  }
+}
+
+void TestStepsMatchBlockingCalls() {
+  DigestSigner signer;
+  ManualClock clock(kNow);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+
+  LcgRandomProvider blocking_random(7);
+  TestJournal blocking_merchant_journal;
+  TestJournal blocking_payer_journal;
+  offline_wallet::OfflineEngine blocking_merchant(offline_wallet::RiskPolicy{}, &signer, &blocking_random,
+                                                  &clock, &blocking_merchant_journal);
+  offline_wallet::OfflineEngine blocking_payer(offline_wallet::RiskPolicy{}, &signer, &blocking_random,
+                                               &clock, &blocking_payer_journal);
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction intent_tx;
+  offline_wallet::LocalTransaction payer_tx;
+  offline_wallet::LocalTransaction accepted_tx;
+  auto intent_result = blocking_merchant.BuildMerchantIntent(merchant, 1'250, "CNY", &intent, &intent_tx);
+  assert(intent_result.status == HandshakeStatus::kOk);
+  auto auth_result = blocking_payer.BuildPayerAuthorization(payer, intent, &authorization, &payer_tx);
+  assert(auth_result.status == HandshakeStatus::kOk);
+  auto accept_result = blocking_merchant.AcceptAuthorization(merchant, authorization, &receipt, &accepted_tx);
+  assert(accept_result.status == HandshakeStatus::kOk);
+
+  LcgRandomProvider step_random(7);
+  TestJournal merchant_journal;
+  TestJournal payer_journal;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signer, &step_random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signer, &step_random, &clock,
+                                             &payer_journal);
+  HandshakeSession session;
+  assert(session.wait() == SessionWait::kNone && !session.done());
+  merchant_engine.StartMerchantIntent(merchant, 1'250, "CNY", &session);
+  assert(session.wait() == SessionWait::kSignature && session.key_id() == "m-key");
+  const bool out_of_turn = session.CompleteJournalWrite(true);  // Not what it waits for.
+  assert(!out_of_turn);
+  assert(merchant_journal.size() == 0);
+  Drive(&session, &merchant_journal);
+  assert(session.result().status == HandshakeStatus::kOk);
+  assert(session.intent().merchant_signature == intent.merchant_signature);
+  assert(session.intent().tx_id == intent.tx_id);
+  assert(session.transaction().idempotency_key == intent_tx.idempotency_key);
+  const bool late = session.CompleteSignature("late");
+  assert(!late);
+
+  payer_engine.StartPayerAuthorization(payer, session.intent(), &session);
+  Drive(&session, &payer_journal);
+  assert(session.result().status == HandshakeStatus::kOk);
+  assert(session.authorization().payer_signature == authorization.payer_signature);
+  assert(session.transaction().idempotency_key == payer_tx.idempotency_key);
+  const offline_wallet::PaymentAuthorization step_authorization = session.authorization();
+
+  merchant_engine.StartAcceptAuthorization(merchant, step_authorization, &session);
+  assert(session.wait() == SessionWait::kJournalWrite);
+  assert(session.record().state == offline_wallet::TransactionState::kPendingSync);
+  Drive(&session, &merchant_journal);
+  assert(session.result().status == HandshakeStatus::kOk);
+  assert(session.receipt().receipt_id == receipt.receipt_id);
+  assert(session.receipt().merchant_signature == receipt.merchant_signature);
+  assert(session.transaction().payer_authorization_id == accepted_tx.payer_authorization_id);
+
+  // A failed check ends the session at once, a failed flush at its completion.
+  offline_wallet::PaymentAuthorization unknown = step_authorization;
+  unknown.tx_id = "tx-missing";
+  merchant_engine.StartAcceptAuthorization(merchant, unknown, &session);
+  assert(session.done() && session.result().status == HandshakeStatus::kUnknownTransaction);
+  merchant_engine.StartMerchantIntent(merchant, 500, "CNY", &session);
+  Drive(&session, &merchant_journal);
+  payer_engine.StartPayerAuthorization(payer, session.intent(), &session);
+  const bool signed_ok = session.CompleteSignature(FnvDigest(session.key_id(), session.message()));
+  const bool flushed = session.CompleteJournalWrite(false);
+  assert(signed_ok && flushed);
+  assert(session.result().status == HandshakeStatus::kJournalFailure);
+}
+
+void TestInFlightSessionsCountAgainstChecks() {
+  DigestSigner signer;
+  LcgRandomProvider random(11);
+  ManualClock clock(kNow);
+  TestJournal payer_journal;
+  TestJournal merchant_journal;
+  offline_wallet::RiskPolicy policy;
+  policy.max_per_day_per_payer_cents = 1'000;
+  offline_wallet::SpendTracker payer_tracker;
+  offline_wallet::SpendTracker merchant_tracker;
+  offline_wallet::ReplayFilter replay_filter(policy);
+  offline_wallet::OfflineEngine payer_engine(policy, &signer, &random, &clock, &payer_journal);
+  offline_wallet::OfflineEngine merchant_engine(policy, &signer, &random, &clock, &merchant_journal);
+  payer_engine.SetSpendTracker(&payer_tracker);
+  merchant_engine.SetSpendTracker(&merchant_tracker);
+  merchant_engine.SetReplayFilter(&replay_filter);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+
+  HandshakeSession intents[3];
+  for (HandshakeSession& session : intents) {
+    merchant_engine.StartMerchantIntent(merchant, 400, "CNY", &session);
+    Drive(&session, &merchant_journal);
+  }
+
+  // Two unfinished authorizations already hold 800 of the 1,000 allowed.
+  HandshakeSession first;
+  HandshakeSession second;
+  HandshakeSession third;
+  payer_engine.StartPayerAuthorization(payer, intents[0].intent(), &first);
+  payer_engine.StartPayerAuthorization(payer, intents[1].intent(), &second);
+  payer_engine.StartPayerAuthorization(payer, intents[2].intent(), &third);
+  assert(first.wait() == SessionWait::kSignature && second.wait() == SessionWait::kSignature);
+  assert(third.done() && third.result().status == HandshakeStatus::kPolicyDenied);
+  offline_wallet::PaymentAuthorization blocked;
+  offline_wallet::LocalTransaction tx;
+  auto blocked_result = payer_engine.BuildPayerAuthorization(payer, intents[2].intent(), &blocked, &tx);
+  assert(blocked_result.status == HandshakeStatus::kPolicyDenied);
+
+  // A failed flush releases its share; an abandoned session does too.
+  const bool signed_ok = first.CompleteSignature(FnvDigest(first.key_id(), first.message()));
+  const bool flushed = first.CompleteJournalWrite(false);
+  assert(signed_ok && flushed);
+  {
+    HandshakeSession abandoned;
+    payer_engine.StartPayerAuthorization(payer, intents[0].intent(), &abandoned);
+    assert(abandoned.wait() == SessionWait::kSignature);
+  }
+  payer_engine.StartPayerAuthorization(payer, intents[2].intent(), &third);
+  assert(third.wait() == SessionWait::kSignature);
+  Drive(&second, &payer_journal);
+  Drive(&third, &payer_journal);
+  assert(second.result().status == HandshakeStatus::kOk && third.result().status == HandshakeStatus::kOk);
+  assert(payer_tracker.SpendInWindow(std::string("payer-1"), kNow) == 800);
+
+  // The same authorization cannot be accepted twice while the first
+  // acceptance is still flushing, by either API.
+  HandshakeSession accept;
+  HandshakeSession duplicate;
+  merchant_engine.StartAcceptAuthorization(merchant, second.authorization(), &accept);
+  assert(accept.wait() == SessionWait::kJournalWrite);
+  merchant_engine.StartAcceptAuthorization(merchant, second.authorization(), &duplicate);
+  assert(duplicate.result().status == HandshakeStatus::kReplayDetected);
+  offline_wallet::PaymentReceipt receipt;
+  auto replay_result = merchant_engine.AcceptAuthorization(merchant, second.authorization(), &receipt, &tx);
+  assert(replay_result.status == HandshakeStatus::kReplayDetected);
+  Drive(&accept, &merchant_journal);
+  assert(accept.result().status == HandshakeStatus::kOk);
+  // Afterwards the replay filter takes over.
+  merchant_engine.StartAcceptAuthorization(merchant, second.authorization(), &duplicate);
+  assert(duplicate.result().status == HandshakeStatus::kReplayDetected);
+  assert(duplicate.result().message == "authorization replayed");
+  assert(merchant_tracker.SpendInWindow(std::string("payer-1"), kNow) == 400);
+}
+
+// A single-core device: one crypto accelerator and one flash controller, each
+// finishing one job at a time after a few ticks, shared by many concurrent
+// checkouts. No engine call in the loop blocks on either peripheral.
+struct Lane {
+  offline_wallet::DeviceContext merchant;
+  offline_wallet::DeviceContext payer;
+  HandshakeSession session;
+  int phase = 0;  // 0 intent, 1 authorization, 2 acceptance, 3 finished.
+  bool queued = false;
+};
+
+struct Job {
+  Lane* lane;
+  std::uint64_t ready_at;
+};
+
+class Peripheral {
+ public:
+  explicit Peripheral(std::uint64_t seed) : state_(seed) {}
+
+  void Submit(Lane* lane, std::uint64_t now) {
+    const std::uint64_t start = std::max(now, busy_until_);
+    busy_until_ = start + 1 + Next() % 4;
+    jobs_.push_back({lane, busy_until_});
+  }
+
+  Lane* Poll(std::uint64_t now) {
+    if (jobs_.empty() || jobs_.front().ready_at > now) {
+      return nullptr;
+    }
+    Lane* lane = jobs_.front().lane;
+    jobs_.pop_front();
+    return lane;
+  }
+
+  bool idle() const { return jobs_.empty(); }
+
+ private:
+  std::uint64_t Next() {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state_ >> 33;
+  }
+
+  std::deque<Job> jobs_;
+  std::uint64_t busy_until_ = 0;
+  std::uint64_t state_;
+};
+
+void TestInterleavedSessionsSimulator() {
+  constexpr std::size_t kLanes = 64;
+  DigestSigner signer;
+  LcgRandomProvider random(23);
+  ManualClock clock(kNow);
+  TestJournal merchant_journal;
+  TestJournal payer_journal;
+  offline_wallet::RiskPolicy policy;
+  offline_wallet::SpendTracker payer_tracker;
+  offline_wallet::SpendTracker merchant_tracker;
+  offline_wallet::ReplayFilter replay_filter(policy);
+  offline_wallet::OfflineEngine merchant_engine(policy, &signer, &random, &clock, &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(policy, &signer, &random, &clock, &payer_journal);
+  merchant_engine.SetSpendTracker(&merchant_tracker);
+  merchant_engine.SetReplayFilter(&replay_filter);
+  payer_engine.SetSpendTracker(&payer_tracker);
+
+  std::vector<std::unique_ptr<Lane>> lanes;
+  for (std::size_t i = 0; i < kLanes; ++i) {
+    auto lane = std::make_unique<Lane>();
+    const std::string n = std::to_string(i);
+    lane->merchant.account_id = "merchant-" + n;
+    lane->merchant.device_id = "merchant-device-" + n;
+    lane->merchant.signing_key_id = "m-key-" + n;
+    lane->merchant.local_counter = static_cast<std::uint32_t>(i);
+    // Four lanes per payer, so daily-limit checks see each other's sessions.
+    lane->payer.account_id = "payer-" + std::to_string(i % 16);
+    lane->payer.device_id = "payer-device-" + n;
+    lane->payer.signing_key_id = "p-key-" + n;
+    lane->payer.local_counter = 1;
+    lanes.push_back(std::move(lane));
+  }
+
+  Peripheral crypto(3);
+  Peripheral flash(5);
+  std::size_t max_waiting = 0;
+  std::size_t finished = 0;
+  std::uint64_t tick = 0;
+  for (; finished < kLanes; ++tick) {
+    assert(tick < 100'000);
+    // Scanning and display refresh would run here, between engine steps.
+    std::size_t waiting = 0;
+    for (std::size_t i = 0; i < kLanes; ++i) {
+      Lane& lane = *lanes[(i + tick) % kLanes];
+      HandshakeSession& session = lane.session;
+      if (lane.phase < 3 && (session.done() || session.wait() == SessionWait::kNone)) {
+        if (session.done()) {
+          assert(session.result().status == HandshakeStatus::kOk);
+          if (++lane.phase == 3) {
+            ++finished;
+            continue;
+          }
+        }
+        // Each call returns promptly with the session parked on a peripheral.
+        if (lane.phase == 0) {
+          merchant_engine.StartMerchantIntent(lane.merchant, 1'000, "CNY", &session);
+        } else if (lane.phase == 1) {
+          payer_engine.StartPayerAuthorization(lane.payer, session.intent(), &session);
+        } else {
+          merchant_engine.StartAcceptAuthorization(lane.merchant, session.authorization(), &session);
+        }
+        assert(!session.done());
+      }
+      if (lane.phase < 3 && !lane.queued) {
+        (session.wait() == SessionWait::kSignature ? crypto : flash).Submit(&lane, tick);
+        lane.queued = true;
+      }
+      waiting += lane.phase < 3 ? 1 : 0;
+    }
+    max_waiting = std::max(max_waiting, waiting);
+
+    while (Lane* lane = crypto.Poll(tick)) {
+      HandshakeSession& session = lane->session;
+      lane->queued = false;
+      const bool completed = session.CompleteSignature(FnvDigest(session.key_id(), session.message()));
+      assert(completed);
+    }
+    while (Lane* lane = flash.Poll(tick)) {
+      HandshakeSession& session = lane->session;
+      lane->queued = false;
+      TestJournal* journal =
+          session.record().state == offline_wallet::TransactionState::kAuthorized ? &payer_journal
+                                                                                   : &merchant_journal;
+      const bool completed = session.CompleteJournalWrite(journal->Save(session.record()));
+      assert(completed);
+    }
+  }
+
+  assert(crypto.idle() && flash.idle());
+  assert(max_waiting == kLanes);
+  assert(merchant_journal.size() == kLanes && payer_journal.size() == kLanes);
+  for (const auto& lane : lanes) {
+    const HandshakeSession& session = lane->session;
+    assert(session.done() && session.result().status == HandshakeStatus::kOk);
+    offline_wallet::LocalTransaction row;
+    const bool loaded = merchant_journal.Load(session.receipt().tx_id, &row);
+    assert(loaded);
+    assert(row.state == offline_wallet::TransactionState::kPendingSync);
+    assert(row.payer_device_id == lane->payer.device_id);
+    assert(std::string(session.receipt().merchant_signature) ==
+           FnvDigest(std::string(lane->merchant.signing_key_id),
+                  std::string(session.receipt().tx_id) + "|" +
+                      std::string(session.authorization().payer_authorization_id) + "|pending_sync"));
+  }
+  for (int payer = 0; payer < 16; ++payer) {
+    assert(payer_tracker.SpendInWindow("payer-" + std::to_string(payer), kNow) == 4'000);
+    assert(merchant_tracker.SpendInWindow("payer-" + std::to_string(payer), kNow) == 4'000);
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestStepsMatchBlockingCalls();
+  TestInFlightSessionsCountAgainstChecks();
+  TestInterleavedSessionsSimulator();
+  return 0;
+}
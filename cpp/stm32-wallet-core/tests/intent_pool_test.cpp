@@ -0,0 +1,154 @@
+#include <cassert>
+#include <cstdint>
+#include <set>
+#include <string>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/intent_pool.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+using offline_wallet::testing::TestSignatureProvider;
+
+void TestRefillRespectsDepthAndBudget() {
+  CounterRandomProvider random("x");
+  TestJournal journal;
+  offline_wallet::IntentPool pool(&random, &journal, 4);
+  assert(pool.size() == 0 && pool.NeedsRefill());
+
+  std::size_t added = pool.Refill(1);
+  assert(added == 1);
+  assert(random.calls() == 3 && journal.last_reserve == 1);
+  added = pool.Refill();
+  assert(added == 3);
+  assert(pool.size() == 4 && !pool.NeedsRefill() && journal.last_reserve == 4);
+  added = pool.Refill();
+  assert(added == 0 && random.calls() == 12);
+
+  offline_wallet::PaymentIntent intent;
+  bool taken = pool.Take(&intent);
+  assert(taken);
+  assert(intent.tx_id == "tx-x1" && intent.merchant_intent_id == "mi-x2" && intent.merchant_nonce == "x3");
+  taken = pool.Take(&intent);
+  assert(taken && intent.tx_id == "tx-x4");
+  added = pool.Refill(1);
+  assert(added == 1 && pool.size() == 3);
+  taken = pool.Take(&intent);
+  assert(taken && intent.tx_id == "tx-x7");
+  taken = pool.Take(&intent);
+  assert(taken && intent.tx_id == "tx-x10");
+  taken = pool.Take(&intent);
+  assert(taken && intent.tx_id == "tx-x13");
+  taken = pool.Take(&intent);
+  assert(!taken);
+
+  offline_wallet::IntentPool empty(&random, nullptr, 0);
+  added = empty.Refill();
+  taken = empty.Take(&intent);
+  assert(added == 0 && !taken && !empty.NeedsRefill());
+}
+
+void TestEngineDrawsFromPoolThenFallsBack() {
+  TestSignatureProvider signature;
+  CounterRandomProvider random("x");
+  ManualClock clock;
+  TestJournal journal;
+  offline_wallet::OfflineEngine engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock, &journal);
+  offline_wallet::IntentPool pool(&random, &journal, 2);
+  engine.SetIntentPool(&pool);
+  pool.Refill();
+
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::LocalTransaction tx;
+  std::set<std::string> tx_ids;
+
+  // A denied request leaves the pool untouched.
+  auto result = engine.BuildMerchantIntent(merchant, 0, "CNY", &intent, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kPolicyDenied);
+  assert(pool.size() == 2);
+
+  const std::uint32_t calls = random.calls();
+  for (int i = 0; i < 2; ++i) {
+    result = engine.BuildMerchantIntent(merchant, 400, "CNY", &intent, &tx);
+    assert(result.status == offline_wallet::HandshakeStatus::kOk);
+    tx_ids.insert(intent.tx_id);
+    offline_wallet::LocalTransaction stored;
+    const bool found = journal.Load(intent.tx_id, &stored);
+    assert(found && stored.merchant_nonce == intent.merchant_nonce);
+  }
+  assert(random.calls() == calls && pool.size() == 0);
+
+  result = engine.BuildMerchantIntent(merchant, 400, "CNY", &intent, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kOk);
+  tx_ids.insert(intent.tx_id);
+  assert(random.calls() == calls + 3);
+  assert(tx_ids.size() == 3);
+  assert(intent.tx_id.rfind("tx-", 0) == 0 && intent.merchant_intent_id.rfind("mi-", 0) == 0);
+}
+
+offline_wallet::LocalTransaction MakeSynced(std::uint32_t n) {
+  offline_wallet::LocalTransaction tx;
+  tx.tx_id = "tx-" + std::to_string(100'000 + n);
+  tx.merchant_account_id = "merchant-1";
+  tx.amount_cents = 100;
+  tx.currency = "CNY";
+  tx.merchant_intent_id = "mi-" + std::to_string(n);
+  tx.state = offline_wallet::TransactionState::kSynced;
+  tx.idempotency_key = "merchant:" + tx.tx_id;
+  return tx;
+}
+
+std::uint32_t TotalErases(const offline_wallet::RamBlockDevice& device) {
+  std::uint32_t total = 0;
+  for (std::size_t sector = 0; sector < device.SectorCount(); ++sector) {
+    total += device.EraseCount(sector);
+  }
+  return total;
+}
+
+void TestFlashJournalReserveMovesCompactionOffCriticalPath() {
+  offline_wallet::RamBlockDevice device(512, 6);
+  offline_wallet::FlashJournal journal(&device);
+  const bool mounted = journal.Mount();
+  assert(mounted);
+  std::uint32_t n = 0;
+  while (journal.stats().free_sectors > 1) {
+    const bool saved = journal.Save(MakeSynced(n++));
+    assert(saved);
+  }
+
+  // Without preparation the next sector rollover compacts in the foreground;
+  // after Reserve() a burst of appends erases nothing.
+  bool reserved = journal.Reserve(8);
+  assert(reserved);
+  assert(journal.stats().free_sectors >= 2);
+  const std::uint32_t erases = TotalErases(device);
+  for (int i = 0; i < 8; ++i) {
+    const bool saved = journal.Save(MakeSynced(n++));
+    assert(saved);
+  }
+  assert(TotalErases(device) == erases);
+
+  // Impossible requests report failure but leave the journal usable.
+  reserved = journal.Reserve(10'000);
+  assert(!reserved);
+  const bool saved = journal.Save(MakeSynced(n++));
+  assert(saved);
+}
+
+}  // namespace
+
+int main() {
+  TestRefillRespectsDepthAndBudget();
+  TestEngineDrawsFromPoolThenFallsBack();
+  TestFlashJournalReserveMovesCompactionOffCriticalPath();
+  return 0;
+}
@@ -0,0 +1,370 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/offline_engine.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::TransactionState;
+using offline_wallet::testing::LcgRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+using offline_wallet::testing::TestSignatureProvider;
+
+// What the workload was promised. A state is acknowledged once the call that
+// wrote it returned true; any state it tried to write may have landed.
+struct Expectation {
+  bool acknowledged = false;
+  TransactionState state = TransactionState::kInitiated;
+  std::set<TransactionState> attempted;
+};
+
+struct Model {
+  std::map<std::string, Expectation> transactions;
+  // Transactions first written together in one batch.
+  std::vector<std::pair<std::string, std::string>> groups;
+
+  void Attempt(std::string_view tx_id, TransactionState state) {
+    transactions[std::string(tx_id)].attempted.insert(state);
+  }
+
+  void Acknowledge(std::string_view tx_id, TransactionState state) {
+    Expectation& expectation = transactions[std::string(tx_id)];
+    expectation.acknowledged = true;
+    expectation.state = state;
+    expectation.attempted.clear();
+    expectation.attempted.insert(state);
+  }
+};
+
+constexpr std::size_t kSectorSize = 1024;
+constexpr std::size_t kSectorCount = 6;
+constexpr int kSales = 16;
+
+offline_wallet::FlashJournalOptions JournalOptions() {
+  offline_wallet::FlashJournalOptions options;
+  options.max_records = 32;
+  return options;
+}
+
+offline_wallet::LocalTransaction MakeStandalone(int n) {
+  offline_wallet::LocalTransaction tx;
+  tx.tx_id = "tx-standalone-" + std::to_string(n);
+  tx.merchant_account_id = "merchant-1";
+  tx.amount_cents = 50 + n;
+  tx.state = TransactionState::kPendingSync;
+  tx.idempotency_key = "merchant:" + tx.tx_id;
+  return tx;
+}
+
+// A merchant's day: group-committed sales, background sync acknowledgements
+// that make records droppable, batches spanning two transactions, and idle-loop
+// compaction. Returns as soon as any write fails, i.e. once power is gone.
+void RunWorkload(offline_wallet::FlashJournal* journal_ptr, Model* model) {
+  offline_wallet::FlashJournal& journal = *journal_ptr;
+  if (!journal.Mount()) {
+    return;
+  }
+
+  TestSignatureProvider signature;
+  LcgRandomProvider random(1);
+  ManualClock clock;
+  TestJournal payer_journal;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                                &journal);
+  merchant_engine.SetGroupCommit(true);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                             &payer_journal);
+
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+  std::vector<std::string> sold;
+
+  for (int sale = 0; sale < kSales; ++sale) {
+    offline_wallet::PaymentIntent intent;
+    offline_wallet::LocalTransaction tx;
+    if (merchant_engine.BuildMerchantIntent(merchant, 100 + sale, "CNY", &intent, &tx).status !=
+        offline_wallet::HandshakeStatus::kOk) {
+      return;
+    }
+    model->Attempt(tx.tx_id, TransactionState::kInitiated);
+
+    offline_wallet::PaymentAuthorization authorization;
+    offline_wallet::LocalTransaction payer_tx;
+    auto auth_result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &payer_tx);
+    assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+
+    offline_wallet::PaymentReceipt receipt;
+    model->Attempt(tx.tx_id, TransactionState::kPendingSync);
+    if (merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx).status !=
+        offline_wallet::HandshakeStatus::kOk) {
+      return;
+    }
+    model->Acknowledge(tx.tx_id, TransactionState::kPendingSync);
+    sold.emplace_back(tx.tx_id);
+
+    if (sale >= 2) {
+      const std::string& synced = sold[sale - 2];
+      model->Attempt(synced, TransactionState::kSynced);
+      if (!journal.UpdateState(synced, TransactionState::kSynced, "")) {
+        return;
+      }
+      model->Acknowledge(synced, TransactionState::kSynced);
+    }
+
+    if (sale % 4 == 3) {
+      const offline_wallet::LocalTransaction first = MakeStandalone(sale);
+      const offline_wallet::LocalTransaction second = MakeStandalone(sale + 1000);
+      model->groups.emplace_back(first.tx_id, second.tx_id);
+      model->Attempt(first.tx_id, first.state);
+      model->Attempt(second.tx_id, second.state);
+      if (!journal.BeginBatch() || !journal.Stage(first) || !journal.Stage(second) ||
+          !journal.CommitBatch()) {
+        return;
+      }
+      model->Acknowledge(first.tx_id, first.state);
+      model->Acknowledge(second.tx_id, second.state);
+    }
+
+    while (journal.NeedsCompaction()) {
+      if (!journal.CompactStep()) {
+        return;
+      }
+    }
+  }
+}
+
+void VerifyRecovery(offline_wallet::RamBlockDevice* flash, const Model& model, std::uint64_t cut) {
+  offline_wallet::FlashJournal journal(flash, JournalOptions());
+  if (!journal.Mount()) {
+    std::fprintf(stderr, "mount failed after power cut at byte %llu\n", static_cast<unsigned long long>(cut));
+    assert(false);
+  }
+
+  for (const auto& entry : model.transactions) {
+    const Expectation& expectation = entry.second;
+    offline_wallet::LocalTransaction loaded;
+    const bool found = journal.Load(entry.first, &loaded);
+    const bool consistent =
+        found ? expectation.attempted.count(loaded.state) > 0 ||
+                    (expectation.acknowledged && loaded.state == expectation.state)
+              : !expectation.acknowledged || expectation.state == TransactionState::kSynced;
+    if (!consistent) {
+      std::fprintf(stderr, "inconsistent %s after power cut at byte %llu\n", entry.first.c_str(),
+                   static_cast<unsigned long long>(cut));
+      assert(false);
+    }
+  }
+
+  // Batches land whole or not at all.
+  for (const auto& group : model.groups) {
+    offline_wallet::LocalTransaction loaded;
+    const bool first_found = journal.Load(group.first, &loaded);
+    const bool second_found = journal.Load(group.second, &loaded);
+    assert(first_found == second_found);
+  }
+
+  // The recovered journal keeps working, and what it writes survives a reboot.
+  const offline_wallet::LocalTransaction probe = MakeStandalone(-1);
+  while (journal.NeedsCompaction()) {
+    const bool compacted = journal.CompactStep();
+    assert(compacted);
+  }
+  const bool saved = journal.Save(probe);
+  assert(saved);
+  offline_wallet::FlashJournal remounted(flash, JournalOptions());
+  const bool mounted = remounted.Mount();
+  offline_wallet::LocalTransaction loaded;
+  const bool found = mounted && remounted.Load(probe.tx_id, &loaded);
+  assert(found);
+}
+
+void TestPowerCutAtEveryWriteOffset() {
+  std::uint64_t total = 0;
+  {
+    offline_wallet::RamBlockDevice flash(kSectorSize, kSectorCount);
+    offline_wallet::FaultInjectingBlockDevice device(&flash);
+    offline_wallet::FlashJournal journal(&device, JournalOptions());
+    Model model;
+    RunWorkload(&journal, &model);
+    total = device.bytes_written();
+    VerifyRecovery(&flash, model, total);
+
+    // The uninterrupted run covers every write path worth cutting.
+    assert(model.transactions.size() == kSales + kSales / 2);
+    const offline_wallet::FlashJournalStats stats = journal.stats();
+    assert(stats.committed_batches >= kSales + kSales / 4);
+    assert(stats.compacted_sectors > 0 && stats.dropped_records > 0);
+  }
+
+  for (std::uint64_t cut = 0; cut < total; ++cut) {
+    offline_wallet::RamBlockDevice flash(kSectorSize, kSectorCount);
+    offline_wallet::FaultInjectingBlockDevice device(&flash);
+    device.ArmPowerCut(cut);
+    offline_wallet::FlashJournal journal(&device, JournalOptions());
+    Model model;
+    RunWorkload(&journal, &model);
+    assert(!device.powered());
+    VerifyRecovery(&flash, model, cut);
+  }
+}
+
+void TestGroupCommitHalvesJournalWrites() {
+  std::uint64_t programs[2] = {0, 0};
+  for (int group_commit = 0; group_commit < 2; ++group_commit) {
+    offline_wallet::RamBlockDevice flash(4096, 8);
+    offline_wallet::FlashJournal journal(&flash);
+    const bool mounted = journal.Mount();
+    assert(mounted);
+
+    TestSignatureProvider signature;
+    LcgRandomProvider random(1);
+    ManualClock clock;
+    TestJournal payer_journal;
+    offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                                  &journal);
+    merchant_engine.SetGroupCommit(group_commit == 1);
+    offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                               &payer_journal);
+    const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+    const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+
+    const std::uint64_t before = flash.program_calls();
+    for (int sale = 0; sale < 20; ++sale) {
+      offline_wallet::PaymentIntent intent;
+      offline_wallet::LocalTransaction tx;
+      auto intent_result = merchant_engine.BuildMerchantIntent(merchant, 100, "CNY", &intent, &tx);
+      assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+
+      // Until the acceptance commits, the staged intent is readable but not on flash.
+      offline_wallet::FlashJournal rebooted(&flash);
+      const bool rebooted_ok = rebooted.Mount();
+      assert(rebooted_ok);
+      offline_wallet::LocalTransaction loaded;
+      const bool staged = journal.Load(tx.tx_id, &loaded);
+      const bool on_flash = rebooted.Load(tx.tx_id, &loaded);
+      assert(staged && on_flash == (group_commit == 0));
+
+      offline_wallet::PaymentAuthorization authorization;
+      offline_wallet::LocalTransaction payer_tx;
+      auto auth_result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &payer_tx);
+      assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+      offline_wallet::PaymentReceipt receipt;
+      auto accept_result = merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+      assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+    }
+    programs[group_commit] = flash.program_calls() - before;
+
+    offline_wallet::FlashJournal rebooted(&flash);
+    const bool rebooted_ok = rebooted.Mount();
+    assert(rebooted_ok);
+    assert(rebooted.stats().live_records == 20);
+  }
+
+  // Two records per sale without batching, one group per sale with it, plus
+  // the occasional new head sector.
+  assert(programs[0] >= 40);
+  assert(programs[1] <= 20 + 8);
+}
+
+void TestRejectedAcceptanceClosesBatch() {
+  offline_wallet::RamBlockDevice flash(4096, 8);
+  offline_wallet::FlashJournal journal(&flash);
+  const bool mounted = journal.Mount();
+  assert(mounted);
+
+  TestSignatureProvider signature;
+  LcgRandomProvider random(1);
+  ManualClock clock;
+  TestJournal payer_journal;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock, &journal);
+  merchant_engine.SetGroupCommit(true);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock,
+                                             &payer_journal);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+
+  // A relabelled amount is rejected; the intent it answered goes to flash on its own.
+  offline_wallet::PaymentIntent first;
+  offline_wallet::LocalTransaction tx;
+  auto result = merchant_engine.BuildMerchantIntent(merchant, 100, "CNY", &first, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kOk);
+  offline_wallet::PaymentAuthorization first_authorization;
+  offline_wallet::LocalTransaction payer_tx;
+  result = payer_engine.BuildPayerAuthorization(payer, first, &first_authorization, &payer_tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kOk);
+  offline_wallet::PaymentAuthorization tampered = first_authorization;
+  tampered.amount_cents = 1;
+  offline_wallet::PaymentReceipt receipt;
+  result = merchant_engine.AcceptAuthorization(merchant, tampered, &receipt, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kMismatch);
+  {
+    offline_wallet::FlashJournal rebooted(&flash);
+    offline_wallet::LocalTransaction loaded;
+    const bool found = rebooted.Mount() && rebooted.Load(first.tx_id, &loaded);
+    assert(found && loaded.state == TransactionState::kInitiated);
+  }
+
+  // The next sale commits as its own group, and the first intent can still be answered.
+  offline_wallet::PaymentIntent second;
+  result = merchant_engine.BuildMerchantIntent(merchant, 200, "CNY", &second, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kOk);
+  offline_wallet::PaymentAuthorization second_authorization;
+  result = payer_engine.BuildPayerAuthorization(payer, second, &second_authorization, &payer_tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kOk);
+  result = merchant_engine.AcceptAuthorization(merchant, second_authorization, &receipt, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kOk);
+  result = merchant_engine.AcceptAuthorization(merchant, first_authorization, &receipt, &tx);
+  assert(result.status == offline_wallet::HandshakeStatus::kOk);
+
+  offline_wallet::FlashJournal rebooted(&flash);
+  const bool rebooted_ok = rebooted.Mount();
+  assert(rebooted_ok);
+  assert(rebooted.stats().live_records == 2);
+  offline_wallet::LocalTransaction loaded;
+  bool found = rebooted.Load(second.tx_id, &loaded);
+  assert(found && loaded.state == TransactionState::kPendingSync && loaded.amount_cents == 200);
+  found = rebooted.Load(first.tx_id, &loaded);
+  assert(found && loaded.state == TransactionState::kPendingSync && loaded.amount_cents == 100);
+}
+
+}  // namespace
+
+// A cut program touches only the bytes that landed, rounded up to program
+// units, and reads nothing past the caller's buffer.
+void TestTornProgramStaysInBounds() {
+  offline_wallet::RamBlockDevice flash(256, 2);
+  offline_wallet::FaultInjectingBlockDevice device(&flash);
+  const std::uint8_t record[5] = {0x11, 0x22, 0x33, 0x44, 0x55};
+  device.ArmPowerCut(3);
+  bool programmed = device.Program(0, record, sizeof(record));
+  assert(!programmed && !device.powered());
+  const std::uint8_t expected[8] = {0x11, 0x22, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  for (std::size_t i = 0; i < sizeof(expected); ++i) {
+    assert(flash.bytes()[i] == expected[i]);
+  }
+
+  // Re-arming restores power; a cut before the first byte writes nothing.
+  device.ArmPowerCut(0);
+  programmed = device.Program(8, record, sizeof(record));
+  assert(!programmed && flash.program_calls() == 1);
+}
+
+int main() {
+  TestGroupCommitHalvesJournalWrites();
+  TestTornProgramStaysInBounds();
+  TestRejectedAcceptanceClosesBatch();
+  TestPowerCutAtEveryWriteOffset();
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "offline_wallet/multi_lane_engine.hpp"
+#include "offline_wallet/sharded_journal.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::HandshakeStatus;
+using offline_wallet::testing::FnvStreamingSigner;
+using offline_wallet::testing::LcgRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+
+class SeededFactory : public offline_wallet::LaneProviderFactory {
+ public:
+  explicit SeededFactory(std::uint64_t seed) : seed_(seed) {}
+
+  offline_wallet::LaneProviders Create(std::size_t lane) override {
+    offline_wallet::LaneProviders providers;
+    providers.streaming_signer = std::make_unique<FnvStreamingSigner>();
+    providers.random = std::make_unique<LcgRandomProvider>(seed_ * 1'000 + lane);
+    return providers;
+  }
+
+ private:
+  std::uint64_t seed_;
+};
+
+class CollectingVisitor : public offline_wallet::JournalVisitor {
+ public:
+  void Visit(const offline_wallet::LocalTransaction& tx) override { rows.push_back(tx); }
+
+  std::vector<offline_wallet::LocalTransaction> rows;
+};
+
+void TestShardedJournalRoutesByTxId() {
+  TestJournal shards[4];
+  offline_wallet::ShardedJournal journal({&shards[0], &shards[1], &shards[2], &shards[3]});
+  assert(journal.shard_count() == 4);
+
+  for (int i = 0; i < 200; ++i) {
+    offline_wallet::LocalTransaction tx;
+    tx.tx_id = "tx-" + std::to_string(i);
+    tx.amount_cents = i;
+    const bool saved = journal.Save(tx);
+    assert(saved);
+  }
+  for (std::size_t i = 0; i < 4; ++i) {
+    assert(shards[i].size() > 20);  // Roughly 50 each.
+  }
+
+  offline_wallet::LocalTransaction tx;
+  bool ok = journal.Load("tx-17", &tx);
+  assert(ok && tx.amount_cents == 17);
+  offline_wallet::LocalTransaction direct;
+  ok = shards[journal.ShardOf("tx-17")].Load("tx-17", &direct);
+  assert(ok);
+  ok = journal.UpdateState("tx-17", offline_wallet::TransactionState::kRejected, "void");
+  assert(ok);
+  ok = journal.Load("tx-17", &tx);
+  assert(ok && tx.state == offline_wallet::TransactionState::kRejected);
+  ok = journal.Load("tx-missing", &tx);
+  assert(!ok);
+  ok = journal.UpdateState("tx-missing", offline_wallet::TransactionState::kRejected, "void");
+  assert(!ok);
+
+  ok = journal.Reserve(8);
+  assert(ok);
+  for (const TestJournal& shard : shards) {
+    assert(shard.reserved == 8);
+  }
+  CollectingVisitor visitor;
+  ok = journal.ForEach(&visitor);
+  assert(ok && visitor.rows.size() == 200);
+
+  offline_wallet::ShardedJournal empty({});
+  const bool saved = empty.Save(tx);
+  const bool loaded = empty.Load("tx-1", &tx);
+  assert(!saved && !loaded);
+}
+
+// Threads each drive their own lanes through full handshakes against shared
+// sharded journals; every record must land exactly once and intact.
+void TestLanesRunConcurrently() {
+  constexpr std::size_t kThreads = 4;
+  constexpr int kRounds = 300;
+  TestJournal merchant_shards[8];
+  TestJournal payer_shards[8];
+  std::vector<offline_wallet::TransactionJournal*> merchant_parts;
+  std::vector<offline_wallet::TransactionJournal*> payer_parts;
+  for (std::size_t i = 0; i < 8; ++i) {
+    merchant_parts.push_back(&merchant_shards[i]);
+    payer_parts.push_back(&payer_shards[i]);
+  }
+  offline_wallet::ShardedJournal merchant_journal(merchant_parts);
+  offline_wallet::ShardedJournal payer_journal(payer_parts);
+  ManualClock clock;
+  SeededFactory merchant_factory(1);
+  SeededFactory payer_factory(2);
+  const offline_wallet::RiskPolicy policy;
+  offline_wallet::MultiLaneEngine merchant_hub(policy, kThreads, &merchant_factory, &clock, &merchant_journal);
+  offline_wallet::MultiLaneEngine payer_hub(policy, kThreads, &payer_factory, &clock, &payer_journal);
+  assert(merchant_hub.lane_count() == kThreads);
+
+  std::vector<int> failures(kThreads, 0);
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      offline_wallet::DeviceContext merchant;
+      merchant.account_id = "merchant-" + std::to_string(t);
+      merchant.device_id = "lane-" + std::to_string(t);
+      merchant.signing_key_id = "m-key";
+      offline_wallet::DeviceContext payer;
+      payer.account_id = "payer-" + std::to_string(t);
+      payer.device_id = "payer-device-" + std::to_string(t);
+      payer.signing_key_id = "p-key";
+      offline_wallet::PaymentIntent intent;
+      offline_wallet::PaymentAuthorization authorization;
+      offline_wallet::PaymentReceipt receipt;
+      offline_wallet::LocalTransaction tx;
+      for (int i = 0; i < kRounds; ++i) {
+        if (merchant_hub.lane(t).BuildMerchantIntent(merchant, 100 + i, "CNY", &intent, &tx).status !=
+                HandshakeStatus::kOk ||
+            payer_hub.lane(t).BuildPayerAuthorization(payer, intent, &authorization, &tx).status !=
+                HandshakeStatus::kOk ||
+            merchant_hub.lane(t).AcceptAuthorization(merchant, authorization, &receipt, &tx).status !=
+                HandshakeStatus::kOk) {
+          ++failures[t];
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int failed : failures) {
+    assert(failed == 0);
+  }
+
+  CollectingVisitor merchant_rows;
+  bool visited = merchant_journal.ForEach(&merchant_rows);
+  assert(visited && merchant_rows.rows.size() == kThreads * kRounds);
+  std::set<std::string> tx_ids;
+  for (const offline_wallet::LocalTransaction& row : merchant_rows.rows) {
+    assert(row.state == offline_wallet::TransactionState::kPendingSync);
+    assert(row.merchant_device_id.substr(5) == row.payer_device_id.substr(13));
+    tx_ids.emplace(row.tx_id);
+  }
+  assert(tx_ids.size() == kThreads * kRounds);
+  CollectingVisitor payer_rows;
+  visited = payer_journal.ForEach(&payer_rows);
+  assert(visited && payer_rows.rows.size() == kThreads * kRounds);
+}
+
+}  // namespace
+
+int main() {
+  TestShardedJournalRoutesByTxId();
+  TestLanesRunConcurrently();
+  return 0;
+}
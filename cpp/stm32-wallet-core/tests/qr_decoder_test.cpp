@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/gf256.hpp"
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/qr_decoder.hpp"
+#include "offline_wallet/qr_encoder.hpp"
+#include "offline_wallet/wire_codec.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::QrDecodeStatus;
+using offline_wallet::QrEcc;
+using offline_wallet::testing::LcgRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+using offline_wallet::testing::TestSignatureProvider;
+
+struct Symbol {
+  std::vector<std::uint8_t> bitmap = std::vector<std::uint8_t>(offline_wallet::kQrMaxBitmapBytes);
+  offline_wallet::QrSymbolInfo info;
+};
+
+Symbol EncodeSymbol(const std::vector<std::uint8_t>& payload, QrEcc ecc, int min_version = 1) {
+  offline_wallet::QrEncoder encoder;
+  offline_wallet::QrEncodeOptions options;
+  options.ecc = ecc;
+  options.min_version = min_version;
+  Symbol symbol;
+  const auto status = encoder.Encode(
+      payload.data(), payload.size(), options, symbol.bitmap.data(), symbol.bitmap.size(), &symbol.info);
+  assert(status == offline_wallet::QrStatus::kOk);
+  (void)status;
+  return symbol;
+}
+
+// How the camera sees the symbol.
+struct Scene {
+  int width = 320;
+  int height = 240;
+  double module_pixels = 3.0;
+  double angle_degrees = 0.0;
+  int blur_radius = 0;
+  int noise = 0;
+  // Illumination falling off to this fraction at the right edge.
+  double shading = 1.0;
+};
+
+struct Frame {
+  std::vector<std::uint8_t> pixels;
+  offline_wallet::QrFrame view;
+};
+
+// Renders with 4x4 supersampling (antialiased module edges), then applies a
+// box blur, shading, and uniform noise.
+Frame Render(const Symbol& symbol, const Scene& scene, std::uint32_t seed = 1) {
+  const int size = symbol.info.size;
+  const double radians = scene.angle_degrees * 3.14159265358979323846 / 180.0;
+  const double c = std::cos(radians);
+  const double s = std::sin(radians);
+  std::vector<double> image(static_cast<std::size_t>(scene.width * scene.height));
+  for (int py = 0; py < scene.height; ++py) {
+    for (int px = 0; px < scene.width; ++px) {
+      int dark = 0;
+      for (int sy = 0; sy < 4; ++sy) {
+        for (int sx = 0; sx < 4; ++sx) {
+          const double dx = px + (sx + 0.5) / 4 - scene.width / 2.0;
+          const double dy = py + (sy + 0.5) / 4 - scene.height / 2.0;
+          const double mx = (c * dx + s * dy) / scene.module_pixels + size / 2.0;
+          const double my = (-s * dx + c * dy) / scene.module_pixels + size / 2.0;
+          if (mx >= 0 && my >= 0 && mx < size && my < size &&
+              offline_wallet::QrBitmapModule(
+                  symbol.bitmap.data(), symbol.info.stride, static_cast<int>(mx), static_cast<int>(my))) {
+            ++dark;
+          }
+        }
+      }
+      image[static_cast<std::size_t>(py * scene.width + px)] = 210.0 - 170.0 * dark / 16.0;
+    }
+  }
+  for (int pass = 0; pass < 2 && scene.blur_radius > 0; ++pass) {
+    std::vector<double> blurred(image.size());
+    for (int y = 0; y < scene.height; ++y) {
+      for (int x = 0; x < scene.width; ++x) {
+        double sum = 0;
+        int count = 0;
+        for (int k = -scene.blur_radius; k <= scene.blur_radius; ++k) {
+          const int xx = pass == 0 ? x + k : x;
+          const int yy = pass == 0 ? y : y + k;
+          if (xx >= 0 && yy >= 0 && xx < scene.width && yy < scene.height) {
+            sum += image[static_cast<std::size_t>(yy * scene.width + xx)];
+            ++count;
+          }
+        }
+        blurred[static_cast<std::size_t>(y * scene.width + x)] = sum / count;
+      }
+    }
+    image.swap(blurred);
+  }
+  Frame frame;
+  frame.pixels.resize(image.size());
+  for (int y = 0; y < scene.height; ++y) {
+    for (int x = 0; x < scene.width; ++x) {
+      seed = seed * 1664525u + 1013904223u;
+      const double noise =
+          scene.noise == 0 ? 0 : static_cast<int>(seed >> 16) % (2 * scene.noise + 1) - scene.noise;
+      const double light = 1.0 - (1.0 - scene.shading) * x / scene.width;
+      const double value = image[static_cast<std::size_t>(y * scene.width + x)] * light + noise;
+      frame.pixels[static_cast<std::size_t>(y * scene.width + x)] =
+          static_cast<std::uint8_t>(std::min(255.0, std::max(0.0, value)));
+    }
+  }
+  frame.view = offline_wallet::QrFrame{frame.pixels.data(), scene.width, scene.height,
+                                       static_cast<std::size_t>(scene.width)};
+  return frame;
+}
+
+std::vector<std::uint8_t> Bytes(std::size_t size, std::uint32_t seed) {
+  std::vector<std::uint8_t> bytes(size);
+  for (auto& byte : bytes) {
+    seed = seed * 1664525u + 1013904223u;
+    byte = static_cast<std::uint8_t>(seed >> 24);
+  }
+  return bytes;
+}
+
+std::vector<std::uint8_t> DecodeFrame(offline_wallet::QrDecoder* decoder,
+                                      const Frame& frame,
+                                      offline_wallet::QrDecodeInfo* info = nullptr) {
+  std::vector<std::uint8_t> payload(offline_wallet::kQrMaxCodewords);
+  std::size_t size = 0;
+  const QrDecodeStatus status = decoder->Decode(frame.view, payload.data(), payload.size(), &size, info);
+  assert(status == QrDecodeStatus::kOk);
+  (void)status;
+  payload.resize(size);
+  return payload;
+}
+
+void TestReedSolomonCorrectsUpToHalfTheParity() {
+  constexpr std::size_t kData = 100;
+  constexpr std::size_t kParity = 20;
+  std::uint32_t seed = 99;
+  for (std::size_t errors = 0; errors <= kParity / 2 + 1; ++errors) {
+    std::vector<std::uint8_t> codeword = Bytes(kData + kParity, static_cast<std::uint32_t>(errors));
+    const bool encoded = offline_wallet::ReedSolomonEncode(codeword.data(), kData, kParity, codeword.data() + kData);
+    assert(encoded);
+    const std::vector<std::uint8_t> original = codeword;
+    for (std::size_t e = 0; e < errors; ++e) {
+      seed = seed * 1664525u + 1013904223u;
+      const std::size_t position = (e * 37 + 5) % codeword.size();  // distinct: 37 is coprime to 120
+      codeword[position] ^= static_cast<std::uint8_t>(1 + (seed >> 8) % 255);
+    }
+    std::size_t corrected = 0;
+    const bool ok = offline_wallet::ReedSolomonCorrect(codeword.data(), codeword.size(), kParity, &corrected);
+    if (errors <= kParity / 2) {
+      assert(ok && corrected == errors && codeword == original);
+    } else {
+      assert(!ok && corrected == 0);
+    }
+  }
+}
+
+void TestDecodesCleanSymbolsAtEveryLevel() {
+  offline_wallet::QrDecoder decoder;
+  std::uint32_t seed = 5;
+  for (int version : {1, 2, 6, 7, 10}) {
+    for (QrEcc ecc : {QrEcc::kLow, QrEcc::kMedium, QrEcc::kQuartile, QrEcc::kHigh}) {
+      const std::vector<std::uint8_t> payload = Bytes(offline_wallet::QrByteCapacity(version, ecc), seed++);
+      const Symbol symbol = EncodeSymbol(payload, ecc);
+      assert(symbol.info.version == version);
+      Scene scene;
+      scene.module_pixels = version <= 2 ? 5.0 : 3.0;
+      offline_wallet::QrDecodeInfo info;
+      const std::vector<std::uint8_t> decoded = DecodeFrame(&decoder, Render(symbol, scene), &info);
+      assert(decoded == payload);
+      assert(info.version == version && info.ecc == ecc && info.mask == symbol.info.mask);
+      assert(info.corrected_bytes == 0);
+    }
+  }
+}
+
+void TestDecodesRotatedBlurredNoisyFrames() {
+  offline_wallet::QrDecoder decoder;
+  const std::vector<std::uint8_t> payload = Bytes(120, 42);
+  const Symbol symbol = EncodeSymbol(payload, QrEcc::kMedium);
+  for (double angle : {0.0, 9.0, 30.0, 45.0, 90.0, 137.0, 180.0, 226.0, 270.0, 333.0}) {
+    Scene scene;
+    scene.width = 480;
+    scene.height = 360;
+    scene.module_pixels = 4.0;
+    scene.angle_degrees = angle;
+    scene.blur_radius = 1;
+    scene.noise = 20;
+    scene.shading = 0.55;
+    const std::vector<std::uint8_t> decoded =
+        DecodeFrame(&decoder, Render(symbol, scene, static_cast<std::uint32_t>(angle) + 1));
+    assert(decoded == payload);
+  }
+}
+
+void TestCorrectsDamagedModules() {
+  offline_wallet::QrDecoder decoder;
+  const std::vector<std::uint8_t> payload = Bytes(180, 7);
+  const Symbol symbol = EncodeSymbol(payload, QrEcc::kHigh);
+  Scene scene;
+  scene.width = 400;
+  scene.height = 400;
+  scene.module_pixels = 4.0;
+  Frame frame = Render(symbol, scene);
+  // A light smudge across a few data modules near the centre.
+  for (int y = 190; y < 206; ++y) {
+    for (int x = 180; x < 220; ++x) {
+      frame.pixels[static_cast<std::size_t>(y * scene.width + x)] = 210;
+    }
+  }
+  offline_wallet::QrDecodeInfo info;
+  const std::vector<std::uint8_t> decoded = DecodeFrame(&decoder, frame, &info);
+  assert(decoded == payload);
+  assert(info.corrected_bytes > 0);
+}
+
+void TestReportsErrors() {
+  offline_wallet::QrDecoderOptions options;
+  options.max_width = 320;
+  options.max_height = 240;
+  offline_wallet::QrDecoder decoder(options);
+  std::uint8_t payload[64];
+  std::size_t size = 0;
+
+  Scene scene;
+  const Symbol empty_symbol = EncodeSymbol({}, QrEcc::kLow);
+  Symbol blank = empty_symbol;
+  std::fill(blank.bitmap.begin(), blank.bitmap.end(), std::uint8_t{0});
+  scene.noise = 30;
+  scene.shading = 0.5;
+  const Frame nothing = Render(blank, scene);
+  QrDecodeStatus status = decoder.Decode(nothing.view, payload, sizeof(payload), &size);
+  assert(status == QrDecodeStatus::kNotFound);
+
+  scene.noise = 0;
+  scene.shading = 1.0;
+  const Frame empty = Render(empty_symbol, scene);
+  status = decoder.Decode(empty.view, payload, sizeof(payload), &size);
+  assert(status == QrDecodeStatus::kOk && size == 0);
+
+  const Frame full = Render(EncodeSymbol(Bytes(65, 3), QrEcc::kLow), scene);
+  status = decoder.Decode(full.view, payload, sizeof(payload), &size);
+  assert(status == QrDecodeStatus::kBufferTooSmall);
+
+  scene.width = 321;
+  const Frame wide = Render(empty_symbol, scene);
+  status = decoder.Decode(wide.view, payload, sizeof(payload), &size);
+  assert(status == QrDecodeStatus::kFrameTooLarge);
+  offline_wallet::QrFrame bad = empty.view;
+  bad.stride = 10;
+  status = decoder.Decode(bad, payload, sizeof(payload), &size);
+  assert(status == QrDecodeStatus::kInvalidArgument);
+  status = decoder.Decode(empty.view, payload, sizeof(payload), nullptr);
+  assert(status == QrDecodeStatus::kInvalidArgument);
+}
+
+void TestScannedAuthorizationIsAccepted() {
+  TestSignatureProvider signature;
+  LcgRandomProvider random(7);
+  ManualClock clock;
+  TestJournal journal;
+  offline_wallet::OfflineEngine engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock, &journal);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 300};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::LocalTransaction tx;
+  auto intent_result = engine.BuildMerchantIntent(merchant, 1'250, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  auto auth_result = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+
+  std::vector<std::uint8_t> wire(offline_wallet::kWireAuthorizationMaxBytes);
+  std::size_t written = 0;
+  offline_wallet::WireStatus wire_status =
+      offline_wallet::EncodeAuthorization(authorization, wire.data(), wire.size(), &written);
+  assert(wire_status == offline_wallet::WireStatus::kOk);
+  wire.resize(written);
+  Scene scene;
+  scene.width = 640;
+  scene.height = 480;
+  scene.module_pixels = 5.0;
+  scene.angle_degrees = 12.0;
+  scene.blur_radius = 1;
+  scene.noise = 16;
+  scene.shading = 0.7;
+  const Frame frame = Render(EncodeSymbol(wire, QrEcc::kMedium), scene);
+
+  offline_wallet::QrDecoder decoder;
+  offline_wallet::PaymentAuthorization scanned;
+  QrDecodeStatus status = decoder.DecodeAuthorization(frame.view, &scanned);
+  assert(status == QrDecodeStatus::kOk);
+  assert(scanned.tx_id == authorization.tx_id && scanned.payer_signature == authorization.payer_signature);
+  offline_wallet::FixedPaymentAuthorization fixed;
+  status = decoder.DecodeAuthorization(frame.view, &fixed);
+  assert(status == QrDecodeStatus::kOk);
+  assert(fixed.amount_cents == authorization.amount_cents);
+
+  offline_wallet::PaymentReceipt receipt;
+  auto accept_result = engine.AcceptAuthorization(merchant, scanned, &receipt, &tx);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(receipt.tx_id == intent.tx_id);
+
+  // A merchant intent is a valid QR but not an authorization.
+  std::vector<std::uint8_t> intent_wire(offline_wallet::kWireIntentMaxBytes);
+  wire_status = offline_wallet::EncodeIntent(intent, intent_wire.data(), intent_wire.size(), &written);
+  assert(wire_status == offline_wallet::WireStatus::kOk);
+  intent_wire.resize(written);
+  const Frame intent_frame = Render(EncodeSymbol(intent_wire, QrEcc::kMedium), scene);
+  status = decoder.DecodeAuthorization(intent_frame.view, &scanned);
+  assert(status == QrDecodeStatus::kWrongPayload);
+}
+
+}  // namespace
+
+int main() {
+  TestReedSolomonCorrectsUpToHalfTheParity();
+  TestDecodesCleanSymbolsAtEveryLevel();
+  TestDecodesRotatedBlurredNoisyFrames();
+  TestCorrectsDamagedModules();
+  TestReportsErrors();
+  TestScannedAuthorizationIsAccepted();
+  return 0;
+}
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/gf256.hpp"
+#include "offline_wallet/qr_encoder.hpp"
+
+namespace {
+
+using offline_wallet::QrEcc;
+
+constexpr QrEcc kLevels[] = {QrEcc::kLow, QrEcc::kMedium, QrEcc::kQuartile, QrEcc::kHigh};
+
+struct Symbol {
+  std::vector<std::uint8_t> bitmap = std::vector<std::uint8_t>(offline_wallet::kQrMaxBitmapBytes);
+  offline_wallet::QrSymbolInfo info;
+
+  bool At(int x, int y) const { return offline_wallet::QrBitmapModule(bitmap.data(), info.stride, x, y); }
+};
+
+std::vector<std::uint8_t> Payload(std::size_t size, std::uint32_t seed) {
+  std::vector<std::uint8_t> payload(size);
+  for (auto& byte : payload) {
+    seed = seed * 1664525u + 1013904223u;
+    byte = static_cast<std::uint8_t>(seed >> 24);
+  }
+  return payload;
+}
+
+Symbol Encode(offline_wallet::QrEncoder* encoder,
+              const std::vector<std::uint8_t>& payload,
+              const offline_wallet::QrEncodeOptions& options) {
+  Symbol symbol;
+  const auto status = encoder->Encode(
+      payload.data(), payload.size(), options, symbol.bitmap.data(), symbol.bitmap.size(), &symbol.info);
+  assert(status == offline_wallet::QrStatus::kOk);
+  (void)status;
+  return symbol;
+}
+
+// Modules reserved for function patterns, derived from the standard's
+// drawings rather than from the encoder.
+std::vector<bool> ReservedModules(int version) {
+  const int size = offline_wallet::QrSymbolSize(version);
+  std::vector<bool> reserved(static_cast<std::size_t>(size * size));
+  auto mark = [&](int x0, int y0, int width, int height) {
+    for (int y = y0; y < y0 + height; ++y) {
+      for (int x = x0; x < x0 + width; ++x) {
+        reserved[static_cast<std::size_t>(y * size + x)] = true;
+      }
+    }
+  };
+  mark(0, 0, 9, 9);  // finder, separator and format
+  mark(size - 8, 0, 8, 9);
+  mark(0, size - 8, 9, 8);
+  mark(6, 0, 1, size);  // timing
+  mark(0, 6, size, 1);
+  int positions[offline_wallet::kQrMaxAlignmentPositions];
+  const int count = offline_wallet::QrAlignmentPositions(version, positions);
+  for (int i = 0; i < count; ++i) {
+    for (int j = 0; j < count; ++j) {
+      if (!((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0))) {
+        mark(positions[i] - 2, positions[j] - 2, 5, 5);
+      }
+    }
+  }
+  if (version >= 7) {
+    mark(size - 11, 0, 3, 6);
+    mark(0, size - 11, 6, 3);
+  }
+  return reserved;
+}
+
+std::uint8_t EvaluatePolynomial(const std::uint8_t* coefficients, std::size_t size, std::uint8_t x) {
+  std::uint8_t value = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    value = static_cast<std::uint8_t>(offline_wallet::Gf256Multiply(value, x) ^ coefficients[i]);
+  }
+  return value;
+}
+
+// Reads the symbol back the way a scanner would and returns the byte-mode
+// payload; asserts on every structural rule along the way.
+std::vector<std::uint8_t> ReadBack(const Symbol& symbol) {
+  const int size = symbol.info.size;
+  const int version = symbol.info.version;
+  assert(size == 4 * version + 17);
+
+  // Finder patterns with light separators.
+  const int corners[3][2] = {{0, 0}, {size - 7, 0}, {0, size - 7}};
+  for (const auto& corner : corners) {
+    for (int dy = -1; dy <= 7; ++dy) {
+      for (int dx = -1; dx <= 7; ++dx) {
+        const int x = corner[0] + dx;
+        const int y = corner[1] + dy;
+        if (x < 0 || y < 0 || x >= size || y >= size) {
+          continue;
+        }
+        const int ring = std::max(std::abs(2 * dx - 6), std::abs(2 * dy - 6)) / 2;
+        assert(symbol.At(x, y) == (ring != 2 && ring != 4));
+      }
+    }
+  }
+  for (int i = 8; i < size - 8; ++i) {
+    assert(symbol.At(i, 6) == (i % 2 == 0));
+    assert(symbol.At(6, i) == (i % 2 == 0));
+  }
+  assert(symbol.At(8, size - 8));
+
+  // Both format copies, MSB first along the reading order.
+  std::uint32_t first = 0;
+  std::uint32_t second = 0;
+  const int first_order[15][2] = {{8, 0}, {8, 1}, {8, 2}, {8, 3}, {8, 4}, {8, 5}, {8, 7}, {8, 8},
+                                  {7, 8}, {5, 8}, {4, 8}, {3, 8}, {2, 8}, {1, 8}, {0, 8}};
+  for (int i = 0; i < 15; ++i) {
+    first |= static_cast<std::uint32_t>(symbol.At(first_order[i][0], first_order[i][1])) << i;
+    const bool module = i < 8 ? symbol.At(size - 1 - i, 8) : symbol.At(8, size - 15 + i);
+    second |= static_cast<std::uint32_t>(module) << i;
+  }
+  assert(first == second);
+  assert(first == offline_wallet::QrFormatBits(symbol.info.ecc, symbol.info.mask));
+
+  if (version >= 7) {
+    std::uint32_t top_right = 0;
+    std::uint32_t bottom_left = 0;
+    for (int i = 0; i < 18; ++i) {
+      top_right |= static_cast<std::uint32_t>(symbol.At(size - 11 + i % 3, i / 3)) << i;
+      bottom_left |= static_cast<std::uint32_t>(symbol.At(i / 3, size - 11 + i % 3)) << i;
+    }
+    assert(top_right == offline_wallet::QrVersionBits(version));
+    assert(bottom_left == top_right && (top_right >> 12) == static_cast<std::uint32_t>(version));
+  }
+
+  // Unmask and collect the codeword stream along the zigzag.
+  const std::vector<bool> reserved = ReservedModules(version);
+  const auto layout = offline_wallet::QrLayout(version, symbol.info.ecc);
+  std::vector<std::uint8_t> stream(layout.total_codewords);
+  std::size_t bit = 0;
+  for (int right = size - 1; right >= 1; right -= 2) {
+    if (right == 6) {
+      right = 5;
+    }
+    for (int vertical = 0; vertical < size; ++vertical) {
+      const int y = ((right + 1) & 2) == 0 ? size - 1 - vertical : vertical;
+      for (int x = right; x >= right - 1; --x) {
+        if (reserved[static_cast<std::size_t>(y * size + x)]) {
+          continue;
+        }
+        const bool dark = symbol.At(x, y) != offline_wallet::QrMaskBit(symbol.info.mask, x, y);
+        if (bit < stream.size() * 8 && dark) {
+          stream[bit / 8] |= static_cast<std::uint8_t>(0x80 >> (bit % 8));
+        }
+        assert(bit < stream.size() * 8 || !dark);  // remainder bits are light
+        ++bit;
+      }
+    }
+  }
+  assert(bit >= stream.size() * 8 && bit - stream.size() * 8 < 8);
+
+  // De-interleave, check every block is a codeword, concatenate the data.
+  std::vector<std::uint8_t> data;
+  for (std::size_t block = 0; block < layout.blocks; ++block) {
+    const std::size_t data_length = layout.short_block_data + (block < layout.short_blocks ? 0 : 1);
+    std::vector<std::uint8_t> codeword;
+    for (std::size_t i = 0; i < data_length; ++i) {
+      const std::size_t skipped = i == layout.short_block_data ? layout.short_blocks : 0;
+      codeword.push_back(stream[i * layout.blocks + block - skipped]);
+    }
+    for (std::size_t i = 0; i < layout.ecc_per_block; ++i) {
+      codeword.push_back(stream[layout.data_codewords + i * layout.blocks + block]);
+    }
+    for (std::size_t root = 0; root < layout.ecc_per_block; ++root) {
+      assert(EvaluatePolynomial(codeword.data(), codeword.size(), offline_wallet::Gf256Exp(root)) == 0);
+    }
+    data.insert(data.end(), codeword.begin(), codeword.begin() + static_cast<std::ptrdiff_t>(data_length));
+  }
+  assert(data.size() == layout.data_codewords);
+
+  // Single byte-mode segment, terminator, then alternating pad bytes.
+  std::size_t position = 0;
+  auto read_bits = [&](int count) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < count; ++i, ++position) {
+      value = (value << 1) | ((data[position / 8] >> (7 - position % 8)) & 1);
+    }
+    return value;
+  };
+  const std::uint32_t mode = read_bits(4);
+  assert(mode == 0x4);
+  const std::size_t length = read_bits(version < 10 ? 8 : 16);
+  std::vector<std::uint8_t> payload;
+  for (std::size_t i = 0; i < length; ++i) {
+    payload.push_back(static_cast<std::uint8_t>(read_bits(8)));
+  }
+  if (position + 4 <= data.size() * 8) {
+    const std::uint32_t terminator = read_bits(4);
+    assert(terminator == 0);
+  }
+  position = (position + 7) / 8 * 8;
+  for (std::uint8_t pad = 0xEC; position < data.size() * 8; pad ^= 0xEC ^ 0x11) {
+    const std::uint32_t padding = read_bits(8);
+    assert(padding == pad);
+  }
+  return payload;
+}
+
+// Straightforward per-module evaluation of the same penalty rules.
+std::uint32_t NaivePenalty(const Symbol& symbol) {
+  const int size = symbol.info.size;
+  auto at = [&](int x, int y, bool transpose) { return transpose ? symbol.At(y, x) : symbol.At(x, y); };
+  auto light = [&](int x, int y, bool transpose) {
+    return x < 0 || x >= size || y < 0 || y >= size || !at(x, y, transpose);
+  };
+  std::uint32_t penalty = 0;
+  for (bool transpose : {false, true}) {
+    for (int y = 0; y < size; ++y) {
+      int run = 0;
+      for (int x = 0; x < size; ++x) {
+        run = x > 0 && at(x, y, transpose) == at(x - 1, y, transpose) ? run + 1 : 1;
+        if (run == 5) {
+          penalty += 3;
+        } else if (run > 5) {
+          penalty += 1;
+        }
+        static constexpr bool kPattern[7] = {true, false, true, true, true, false, true};
+        bool match = x + 7 <= size;
+        for (int k = 0; match && k < 7; ++k) {
+          match = at(x + k, y, transpose) == kPattern[k];
+        }
+        if (match) {
+          bool before = true;
+          bool after = true;
+          for (int k = 1; k <= 4; ++k) {
+            before = before && light(x - k, y, transpose);
+            after = after && light(x + 6 + k, y, transpose);
+          }
+          penalty += before || after ? 40 : 0;
+        }
+      }
+    }
+  }
+  int dark = 0;
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      dark += symbol.At(x, y) ? 1 : 0;
+      if (x + 1 < size && y + 1 < size && symbol.At(x, y) == symbol.At(x + 1, y) &&
+          symbol.At(x, y) == symbol.At(x, y + 1) && symbol.At(x, y) == symbol.At(x + 1, y + 1)) {
+        penalty += 3;
+      }
+    }
+  }
+  const int total = size * size;
+  penalty += static_cast<std::uint32_t>(std::abs(dark * 2 - total) * 10 / total * 10);
+  return penalty;
+}
+
+void TestCodeTables() {
+  // Byte-mode capacities from ISO/IEC 18004 Table 7.
+  const std::size_t capacities[][4] = {
+      {17, 14, 11, 7}, {106, 84, 60, 44}, {271, 213, 151, 119}, {858, 666, 482, 382}, {1732, 1370, 982, 742},
+      {2953, 2331, 1663, 1273}};
+  const int versions[] = {1, 5, 10, 20, 30, 40};
+  for (int i = 0; i < 6; ++i) {
+    for (int level = 0; level < 4; ++level) {
+      assert(offline_wallet::QrByteCapacity(versions[i], kLevels[level]) == capacities[i][level]);
+    }
+  }
+  for (int version = offline_wallet::kQrMinVersion; version <= offline_wallet::kQrMaxVersion; ++version) {
+    for (QrEcc ecc : kLevels) {
+      const auto layout = offline_wallet::QrLayout(version, ecc);
+      assert(layout.short_blocks * layout.short_block_data +
+                 (layout.blocks - layout.short_blocks) * (layout.short_block_data + 1) ==
+             layout.data_codewords);
+    }
+  }
+  assert(offline_wallet::QrLayout(40, QrEcc::kLow).total_codewords == offline_wallet::kQrMaxCodewords);
+
+  int positions[offline_wallet::kQrMaxAlignmentPositions];
+  int count = offline_wallet::QrAlignmentPositions(1, positions);
+  assert(count == 0);
+  count = offline_wallet::QrAlignmentPositions(7, positions);
+  assert(count == 3);
+  assert(positions[0] == 6 && positions[1] == 22 && positions[2] == 38);
+  count = offline_wallet::QrAlignmentPositions(32, positions);
+  assert(count == 6);
+  assert(positions[1] == 34 && positions[5] == 138);
+  count = offline_wallet::QrAlignmentPositions(40, positions);
+  assert(count == 7);
+  assert(positions[1] == 30 && positions[6] == 170);
+
+  // Format and version strings from Annex C and D.
+  assert(offline_wallet::QrFormatBits(QrEcc::kLow, 0) == 0x77C4);
+  assert(offline_wallet::QrFormatBits(QrEcc::kMedium, 0) == 0x5412);
+  assert(offline_wallet::QrFormatBits(QrEcc::kQuartile, 0) == 0x355F);
+  assert(offline_wallet::QrFormatBits(QrEcc::kHigh, 0) == 0x1689);
+  assert(offline_wallet::QrVersionBits(6) == 0);
+  assert(offline_wallet::QrVersionBits(7) == 0x07C94);
+  assert(offline_wallet::QrVersionBits(40) == 0x28C69);
+}
+
+void TestReedSolomonMatchesAnnexI() {
+  // Version 1-M "01234567" worked example.
+  const std::uint8_t data[16] = {0x10, 0x20, 0x0C, 0x56, 0x61, 0x80, 0xEC, 0x11,
+                                 0xEC, 0x11, 0xEC, 0x11, 0xEC, 0x11, 0xEC, 0x11};
+  const std::uint8_t expected[10] = {0xA5, 0x24, 0xD4, 0xC1, 0xED, 0x36, 0xC7, 0x87, 0x2C, 0x55};
+  std::uint8_t parity[10];
+  bool encoded = offline_wallet::ReedSolomonEncode(data, sizeof(data), sizeof(parity), parity);
+  assert(encoded);
+  for (int i = 0; i < 10; ++i) {
+    assert(parity[i] == expected[i]);
+  }
+  encoded = offline_wallet::ReedSolomonEncode(data, sizeof(data), 0, parity);
+  assert(!encoded);
+  const std::size_t too_many = offline_wallet::kReedSolomonMaxDegree + 1;
+  encoded = offline_wallet::ReedSolomonEncode(data, sizeof(data), too_many, parity);
+  assert(!encoded);
+  assert(offline_wallet::Gf256Multiply(offline_wallet::Gf256Divide(0x53, 0xCA), 0xCA) == 0x53);
+}
+
+void TestSymbolsFollowTheStandard() {
+  offline_wallet::QrEncoder encoder;
+  std::uint32_t seed = 1;
+  for (int version = offline_wallet::kQrMinVersion; version <= offline_wallet::kQrMaxVersion; ++version) {
+    for (QrEcc ecc : kLevels) {
+      // Both a full symbol and one padded with 0xEC/0x11.
+      const std::size_t capacity = offline_wallet::QrByteCapacity(version, ecc);
+      for (std::size_t size : {capacity, capacity * 2 / 3}) {
+        const std::vector<std::uint8_t> payload = Payload(size, seed++);
+        offline_wallet::QrEncodeOptions options;
+        options.ecc = ecc;
+        options.min_version = version;
+        options.max_version = version;
+        const Symbol symbol = Encode(&encoder, payload, options);
+        assert(symbol.info.version == version && symbol.info.ecc == ecc);
+        assert(ReadBack(symbol) == payload);
+        assert(symbol.info.penalty == NaivePenalty(symbol));
+      }
+    }
+  }
+}
+
+void TestAutomaticMaskHasLowestPenalty() {
+  offline_wallet::QrEncoder encoder;
+  for (int version : {1, 4, 7, 15}) {
+    const std::vector<std::uint8_t> payload =
+        Payload(offline_wallet::QrByteCapacity(version, QrEcc::kMedium), static_cast<std::uint32_t>(version));
+    offline_wallet::QrEncodeOptions options;
+    options.min_version = version;
+    const Symbol best = Encode(&encoder, payload, options);
+    assert(best.info.version == version);
+    for (int mask = 0; mask < offline_wallet::kQrMaskCount; ++mask) {
+      options.mask = mask;
+      const Symbol forced = Encode(&encoder, payload, options);
+      assert(forced.info.mask == mask && ReadBack(forced) == payload);
+      assert(forced.info.penalty == NaivePenalty(forced));
+      assert(best.info.penalty <= forced.info.penalty);
+      if (mask == best.info.mask) {
+        assert(forced.bitmap == best.bitmap);
+      }
+    }
+  }
+}
+
+void TestPicksSmallestVersionAndReportsErrors() {
+  offline_wallet::QrEncoder encoder;
+  const std::string text = "offline-wallet";
+  const std::vector<std::uint8_t> payload(text.begin(), text.end());
+  offline_wallet::QrEncodeOptions options;
+  Symbol symbol = Encode(&encoder, payload, options);
+  assert(symbol.info.version == 1 && symbol.info.size == 21 && symbol.info.stride == 3);
+  assert(ReadBack(symbol) == payload);
+
+  options.ecc = QrEcc::kHigh;
+  symbol = Encode(&encoder, payload, options);
+  assert(symbol.info.version == 2);
+
+  std::uint8_t bitmap[offline_wallet::QrBitmapBytes(2)];
+  offline_wallet::QrStatus status =
+      encoder.Encode(payload.data(), payload.size(), options, bitmap, sizeof(bitmap) - 1);
+  assert(status == offline_wallet::QrStatus::kBufferTooSmall);
+  status = encoder.Encode(payload.data(), payload.size(), options, bitmap, sizeof(bitmap));
+  assert(status == offline_wallet::QrStatus::kOk);
+  options.max_version = 1;
+  status = encoder.Encode(payload.data(), payload.size(), options, bitmap, sizeof(bitmap));
+  assert(status == offline_wallet::QrStatus::kDataTooLong);
+  options.max_version = offline_wallet::kQrMaxVersion;
+  options.mask = 8;
+  status = encoder.Encode(payload.data(), payload.size(), options, bitmap, sizeof(bitmap));
+  assert(status == offline_wallet::QrStatus::kInvalidArgument);
+  options.mask = offline_wallet::kQrAutoMask;
+  options.min_version = 0;
+  status = encoder.Encode(payload.data(), payload.size(), options, bitmap, sizeof(bitmap));
+  assert(status == offline_wallet::QrStatus::kInvalidArgument);
+
+  const std::vector<std::uint8_t> too_long(offline_wallet::QrByteCapacity(40, QrEcc::kLow) + 1);
+  options = offline_wallet::QrEncodeOptions{};
+  options.ecc = QrEcc::kLow;
+  std::vector<std::uint8_t> large(offline_wallet::kQrMaxBitmapBytes);
+  status = encoder.Encode(too_long.data(), too_long.size(), options, large.data(), large.size());
+  assert(status == offline_wallet::QrStatus::kDataTooLong);
+}
+
+}  // namespace
+
+int main() {
+  TestCodeTables();
+  TestReedSolomonMatchesAnnexI();
+  TestSymbolsFollowTheStandard();
+  TestAutomaticMaskHasLowestPenalty();
+  TestPicksSmallestVersionAndReportsErrors();
+  return 0;
+}
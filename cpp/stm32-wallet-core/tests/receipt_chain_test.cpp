@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/receipt_chain.hpp"
+#include "offline_wallet/sha256.hpp"
+#include "offline_wallet/wire_codec.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::HandshakeStatus;
+using offline_wallet::ReceiptChain;
+using offline_wallet::ReceiptCheckpoint;
+using offline_wallet::ReceiptProof;
+using offline_wallet::Sha256;
+using offline_wallet::Sha256Digest;
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::FnvStreamingSigner;
+using offline_wallet::testing::ManualClock;
+
+std::string Hex(const Sha256Digest& digest) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string text;
+  for (std::uint8_t byte : digest) {
+    text.push_back(kHex[byte >> 4]);
+    text.push_back(kHex[byte & 0x0F]);
+  }
+  return text;
+}
+
+void TestSha256Vectors() {
+  assert(Hex(Sha256::Hash("", 0)) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  assert(Hex(Sha256::Hash("abc", 3)) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  const std::string two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  assert(Hex(Sha256::Hash(two_blocks.data(), two_blocks.size())) ==
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+  // One million 'a's in uneven pieces, crossing block boundaries.
+  Sha256 hash;
+  const std::string chunk(997, 'a');
+  std::size_t fed = 0;
+  while (fed < 1'000'000) {
+    const std::size_t size = std::min(chunk.size(), 1'000'000 - fed);
+    hash.Update(chunk.data(), size);
+    fed += size;
+  }
+  Sha256Digest digest;
+  hash.Finish(&digest);
+  assert(Hex(digest) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+Sha256Digest Leaf(int n) {
+  const std::string text = "receipt-" + std::to_string(n);
+  return Sha256::Hash(text.data(), text.size());
+}
+
+Sha256Digest Node(const Sha256Digest& left, const Sha256Digest& right) {
+  Sha256 hash;
+  const std::uint8_t prefix = 0x01;
+  hash.Update(&prefix, 1);
+  hash.Update(left.data(), left.size());
+  hash.Update(right.data(), right.size());
+  Sha256Digest digest;
+  hash.Finish(&digest);
+  return digest;
+}
+
+void TestProofsForEveryTreeShape() {
+  for (int count = 1; count <= 17; ++count) {
+    ReceiptChain chain;
+    for (int n = 0; n < count; ++n) {
+      const std::uint64_t position = chain.Append(Leaf(n), 0);
+      assert(position == static_cast<std::uint64_t>(n + 1));
+    }
+    ReceiptCheckpoint checkpoint;
+    const bool signed_ok = chain.CloseCheckpoint(&checkpoint) && chain.SignCheckpoint("sig");
+    assert(signed_ok);
+    assert(checkpoint.count == static_cast<std::uint32_t>(count) && checkpoint.first_position == 1);
+    if (count == 3) {
+      assert(checkpoint.root == Node(Node(Leaf(0), Leaf(1)), Leaf(2)));
+    }
+    for (int n = 0; n < count; ++n) {
+      ReceiptProof proof;
+      const bool proved = chain.Prove(static_cast<std::uint64_t>(n + 1), &proof);
+      assert(proved);
+      assert(offline_wallet::VerifyReceiptProof(Leaf(n), proof, checkpoint));
+      assert(!offline_wallet::VerifyReceiptProof(Leaf(n + 100), proof, checkpoint));
+      if (!proof.path.empty()) {
+        proof.path.back()[0] ^= 0x01;
+        assert(!offline_wallet::VerifyReceiptProof(Leaf(n), proof, checkpoint));
+      }
+    }
+    ReceiptProof proof;
+    const bool proved = chain.Prove(static_cast<std::uint64_t>(count + 1), &proof) || chain.Prove(0, &proof);
+    assert(!proved);
+  }
+}
+
+void TestCheckpointsAreLinked() {
+  offline_wallet::ReceiptChainOptions options;
+  options.checkpoint_receipts = 3;
+  options.max_checkpoint_age_seconds = 60;
+  ReceiptChain chain(options);
+  ReceiptCheckpoint first;
+  bool ok = chain.CloseCheckpoint(&first);
+  assert(!ok && !chain.CheckpointDue(0));
+
+  chain.Append(Leaf(1), 1'000);
+  chain.Append(Leaf(2), 1'001);
+  assert(!chain.CheckpointDue(1'001) && chain.CheckpointDue(1'060));
+  chain.Append(Leaf(3), 1'002);
+  assert(chain.CheckpointDue(1'002));
+  ok = chain.CloseCheckpoint(&first);
+  assert(ok);
+  assert(first.sequence == 1 && first.previous == Sha256Digest{});
+
+  // Receipts arriving while the signature is pending open the next checkpoint.
+  ReceiptCheckpoint second;
+  std::uint64_t position = chain.Append(Leaf(4), 1'003);
+  assert(position == 4);
+  ok = chain.CloseCheckpoint(&second);
+  assert(!chain.CheckpointDue(2'000) && !ok);
+  ok = chain.SignCheckpoint("sig-1");
+  assert(ok);
+  ok = chain.SignCheckpoint("again");
+  assert(!ok);
+  assert(chain.last_checkpoint().signature == "sig-1");
+  ok = chain.CloseCheckpoint(&second) && chain.SignCheckpoint("sig-2");
+  assert(ok);
+  assert(second.sequence == 2 && second.first_position == 4 && second.count == 1);
+  assert(second.previous == offline_wallet::CheckpointDigest(first));
+
+  // Editing a signed checkpoint breaks the link from its successor.
+  ReceiptCheckpoint edited = first;
+  edited.count = 2;
+  assert(offline_wallet::CheckpointDigest(edited) != second.previous);
+
+  // After a reboot the chain continues from the persisted checkpoint.
+  ReceiptChain rebooted(options);
+  rebooted.Restore(chain.last_checkpoint());
+  position = rebooted.Append(Leaf(5), 3'000);
+  assert(position == 5);
+  ReceiptCheckpoint third;
+  ok = rebooted.CloseCheckpoint(&third);
+  assert(ok);
+  assert(third.sequence == 3 && third.previous == offline_wallet::CheckpointDigest(chain.last_checkpoint()));
+}
+
+// Counts signing operations; verification does not count.
+class CountingSigner : public FnvStreamingSigner {
+ public:
+  void BeginSign(const std::string& key_id) override {
+    ++signs;
+    FnvStreamingSigner::BeginSign(key_id);
+  }
+
+  int signs = 0;
+};
+
+void TestEngineSignsCheckpointsOnly() {
+  offline_wallet::RamBlockDevice merchant_device(4096, 16);
+  offline_wallet::FlashJournal merchant_journal(&merchant_device);
+  offline_wallet::RamBlockDevice payer_device(4096, 16);
+  offline_wallet::FlashJournal payer_journal(&payer_device);
+  const bool mounted = merchant_journal.Mount() && payer_journal.Mount();
+  assert(mounted);
+  ManualClock clock;
+  CountingSigner merchant_signer;
+  CountingSigner payer_signer;
+  CounterRandomProvider random;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &merchant_signer, &random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &payer_signer, &random, &clock,
+                                             &payer_journal);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 1};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 1};
+  offline_wallet::ReceiptChainOptions options;
+  options.checkpoint_receipts = 4;
+  ReceiptChain chain(options);
+  merchant_engine.SetReceiptChain(&chain);
+
+  std::vector<offline_wallet::PaymentReceipt> receipts;
+  std::vector<std::string> authorization_ids;
+  const auto sell = [&] {
+    offline_wallet::PaymentIntent intent;
+    offline_wallet::PaymentAuthorization authorization;
+    offline_wallet::PaymentReceipt receipt;
+    offline_wallet::LocalTransaction tx;
+    const auto intent_result = merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+    assert(intent_result.status == HandshakeStatus::kOk);
+    const auto auth_result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+    assert(auth_result.status == HandshakeStatus::kOk);
+    const auto accept_result = merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+    assert(accept_result.status == HandshakeStatus::kOk);
+    receipts.push_back(receipt);
+    authorization_ids.push_back(std::string(authorization.payer_authorization_id));
+  };
+
+  // Ten sales: one signature per intent, plus a checkpoint after every fourth receipt.
+  for (int i = 0; i < 10; ++i) {
+    sell();
+  }
+  assert(merchant_signer.signs == 10 + 2);
+  assert(chain.last_checkpoint().sequence == 2 && chain.open_receipts() == 2);
+  for (std::size_t i = 0; i < receipts.size(); ++i) {
+    assert(receipts[i].merchant_signature.empty() && receipts[i].chain_position == i + 1);
+  }
+
+  // The second checkpoint covers receipts 5..8; each proves against it.
+  const ReceiptCheckpoint& checkpoint = chain.last_checkpoint();
+  merchant_signer.BeginVerify("m-key");
+  offline_wallet::WriteCheckpointFields(checkpoint, &merchant_signer);
+  const bool verified = merchant_signer.FinishVerify(checkpoint.signature);
+  assert(verified);
+  for (std::size_t i = 4; i < 8; ++i) {
+    ReceiptProof proof;
+    const bool proved = chain.Prove(receipts[i].chain_position, &proof);
+    assert(proved);
+    const Sha256Digest leaf = offline_wallet::ReceiptLeaf(receipts[i], authorization_ids[i]);
+    assert(offline_wallet::VerifyReceiptProof(leaf, proof, checkpoint));
+    assert(!offline_wallet::VerifyReceiptProof(offline_wallet::ReceiptLeaf(receipts[i], "forged"), proof,
+                                               checkpoint));
+  }
+
+  // An idle checkpoint signs the rest; a quiet period also makes one due.
+  bool sealed = merchant_engine.SealReceiptCheckpoint(merchant);
+  assert(sealed);
+  sealed = merchant_engine.SealReceiptCheckpoint(merchant);
+  assert(!sealed);
+  assert(chain.last_checkpoint().sequence == 3 && chain.last_checkpoint().count == 2);
+  sell();
+  clock.now += options.max_checkpoint_age_seconds;
+  sell();
+  assert(chain.last_checkpoint().sequence == 4 && chain.open_receipts() == 0);
+
+  // The chain position travels with the receipt; signed receipts encode as before.
+  std::uint8_t buffer[offline_wallet::kWireReceiptMaxBytes];
+  std::size_t written = 0;
+  offline_wallet::PaymentReceipt decoded;
+  offline_wallet::WireStatus status = offline_wallet::EncodeReceipt(receipts[5], buffer, sizeof(buffer), &written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  status = offline_wallet::DecodeReceipt(buffer, written, &decoded);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(decoded.chain_position == 6 && decoded.merchant_signature.empty());
+
+  merchant_engine.SetReceiptChain(nullptr);
+  sell();
+  assert(!receipts.back().merchant_signature.empty() && receipts.back().chain_position == 0);
+  status = offline_wallet::EncodeReceipt(receipts.back(), buffer, sizeof(buffer), &written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  status = offline_wallet::DecodeReceipt(buffer, written, &decoded);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(decoded.chain_position == 0 && decoded.merchant_signature == receipts.back().merchant_signature);
+}
+
+void TestSessionsAppendWithoutSigning() {
+  offline_wallet::RamBlockDevice merchant_device(4096, 8);
+  offline_wallet::FlashJournal merchant_journal(&merchant_device);
+  offline_wallet::RamBlockDevice payer_device(4096, 8);
+  offline_wallet::FlashJournal payer_journal(&payer_device);
+  const bool mounted = merchant_journal.Mount() && payer_journal.Mount();
+  assert(mounted);
+  ManualClock clock;
+  CountingSigner signer;
+  CounterRandomProvider random;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signer, &random, &clock,
+                                                &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signer, &random, &clock,
+                                             &payer_journal);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 1};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 1};
+  ReceiptChain chain;
+  merchant_engine.SetReceiptChain(&chain);
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::LocalTransaction tx;
+  const auto intent_result = merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+  assert(intent_result.status == HandshakeStatus::kOk);
+  const auto auth_result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(auth_result.status == HandshakeStatus::kOk);
+
+  offline_wallet::HandshakeSession session;
+  merchant_engine.StartAcceptAuthorization(merchant, authorization, &session);
+  assert(session.wait() == offline_wallet::SessionWait::kJournalWrite);
+  const bool saved = merchant_journal.Save(session.record());
+  assert(saved);
+  const bool completed = session.CompleteJournalWrite(true);
+  assert(completed);
+  assert(session.done() && session.result().status == HandshakeStatus::kOk);
+  assert(session.receipt().chain_position == 1 && session.receipt().merchant_signature.empty());
+  assert(chain.open_receipts() == 1);
+}
+
+}  // namespace
+
+int main() {
+  TestSha256Vectors();
+  TestProofsForEveryTreeShape();
+  TestCheckpointsAreLinked();
+  TestEngineSignsCheckpointsOnly();
+  TestSessionsAppendWithoutSigning();
+  return 0;
+}
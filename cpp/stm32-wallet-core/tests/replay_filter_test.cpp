@@ -0,0 +1,192 @@
+#include <cassert>
+#include <cstdint>
+#include <string>
+
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/replay_filter.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::ReplayVerdict;
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+using offline_wallet::testing::TestSignatureProvider;
+
+constexpr std::uint64_t kNow = 1'700'000'000;
+
+offline_wallet::PaymentAuthorization MakeAuthorization(const std::string& device,
+                                                       std::uint32_t counter,
+                                                       const std::string& nonce,
+                                                       std::uint64_t authorized_at = kNow) {
+  offline_wallet::PaymentAuthorization authorization;
+  authorization.payer_device_id = device;
+  authorization.payer_counter = counter;
+  authorization.payer_nonce = nonce;
+  authorization.authorized_at_epoch_seconds = authorized_at;
+  return authorization;
+}
+
+void TestReplayIsDetected() {
+  offline_wallet::ReplayFilter filter{offline_wallet::RiskPolicy{}};
+  const auto authorization = MakeAuthorization("payer-device-1", 9, "a1b2c3d4e5f60718");
+  assert(filter.Check(authorization, kNow) == ReplayVerdict::kFresh);
+  filter.Record(authorization, kNow);
+  assert(filter.Check(authorization, kNow + 1) == ReplayVerdict::kReplayed);
+
+  // Same counter, different nonce or device: a distinct authorization.
+  assert(filter.Check(MakeAuthorization("payer-device-1", 9, "a1b2c3d4e5f60719"), kNow) ==
+         ReplayVerdict::kFresh);
+  assert(filter.Check(MakeAuthorization("payer-device-2", 9, "a1b2c3d4e5f60718"), kNow) ==
+         ReplayVerdict::kFresh);
+}
+
+void TestCounterHighWaterMark() {
+  offline_wallet::ReplayFilterOptions options;
+  options.max_counter_lag = 64;
+  offline_wallet::ReplayFilter filter{offline_wallet::RiskPolicy{}, options};
+  filter.Record(MakeAuthorization("payer-device-1", 500, "n-500"), kNow);
+  assert(filter.Check(MakeAuthorization("payer-device-1", 436, "n-436"), kNow) == ReplayVerdict::kFresh);
+  assert(filter.Check(MakeAuthorization("payer-device-1", 435, "n-435"), kNow) ==
+         ReplayVerdict::kCounterRegressed);
+  assert(filter.Check(MakeAuthorization("payer-device-2", 1, "n-1"), kNow) == ReplayVerdict::kFresh);
+}
+
+void TestWindowBoundsMemory() {
+  offline_wallet::RiskPolicy policy;
+  policy.intent_ttl_seconds = 30;
+  policy.max_clock_skew_seconds = 300;
+  offline_wallet::ReplayFilter filter{policy};
+  const std::uint64_t window = filter.window_seconds();
+  assert(window == 30 + 2 * 300);
+
+  assert(filter.Check(MakeAuthorization("d", 1, "n", kNow - window - 1), kNow) ==
+         ReplayVerdict::kOutsideWindow);
+  assert(filter.Check(MakeAuthorization("d", 1, "n", kNow + 301), kNow) == ReplayVerdict::kOutsideWindow);
+
+  // A payer clock running a full skew ahead keeps its authorization admissible
+  // until authorized_at + window; the filter must remember it that long, across
+  // a generation rotation.
+  const auto ahead = MakeAuthorization("payer-device-1", 1, "ahead", kNow + 300);
+  filter.Record(ahead, kNow);
+  const std::uint64_t last_admissible = ahead.authorized_at_epoch_seconds + window;
+  filter.Record(MakeAuthorization("payer-device-2", 1, "rotates", last_admissible), last_admissible);
+  assert(filter.Check(ahead, last_admissible) == ReplayVerdict::kReplayed);
+  assert(filter.Check(ahead, last_admissible + 1) == ReplayVerdict::kOutsideWindow);
+}
+
+void TestDeviceTableEvictsLeastRecentlyUsed() {
+  offline_wallet::ReplayFilterOptions options;
+  options.device_slots = 4;
+  options.max_counter_lag = 0;
+  offline_wallet::ReplayFilter filter{offline_wallet::RiskPolicy{}, options};
+  for (int device = 0; device < 5; ++device) {
+    filter.Record(MakeAuthorization("device-" + std::to_string(device), 100, "n"), kNow);
+  }
+  // device-0 was least recently used and lost its high-water mark.
+  assert(filter.Check(MakeAuthorization("device-0", 50, "m"), kNow) == ReplayVerdict::kFresh);
+  assert(filter.Check(MakeAuthorization("device-4", 50, "m"), kNow) == ReplayVerdict::kCounterRegressed);
+}
+
+void TestFalseReplayRateAndBudget() {
+  offline_wallet::ReplayFilterOptions options;
+  options.bloom_bytes = 2048;
+  options.device_slots = 64;
+  offline_wallet::ReplayFilter filter{offline_wallet::RiskPolicy{}, options};
+  assert(filter.MemoryBytes() < 2 * 2048 + 64 * 16 + 256);
+
+  for (int i = 0; i < 200; ++i) {
+    filter.Record(MakeAuthorization("payer-device-" + std::to_string(i % 50), i, "seen-" + std::to_string(i)),
+                  kNow);
+  }
+  int false_replays = 0;
+  for (int i = 0; i < 10'000; ++i) {
+    const auto fresh =
+        MakeAuthorization("payer-device-" + std::to_string(i % 50), 200, "new-" + std::to_string(i));
+    false_replays += filter.Check(fresh, kNow) == ReplayVerdict::kFresh ? 0 : 1;
+  }
+  assert(false_replays <= 2);
+
+  filter.Clear();
+  assert(filter.Check(MakeAuthorization("payer-device-0", 0, "seen-0"), kNow) == ReplayVerdict::kFresh);
+}
+
+// Advances one second on every read.
+class TickingClockProvider : public offline_wallet::ClockProvider {
+ public:
+  std::uint64_t NowUnixSeconds() const override { return kNow + reads_++; }
+
+ private:
+  mutable std::uint64_t reads_ = 0;
+};
+
+void TestEngineRefusesReplayedAuthorization() {
+  TestSignatureProvider signature;
+  CounterRandomProvider random("x");
+  ManualClock clock(kNow);
+  TestJournal journal;
+  offline_wallet::ReplayFilter filter{offline_wallet::RiskPolicy{}};
+  offline_wallet::OfflineEngine engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock, &journal);
+  engine.SetReplayFilter(&filter);
+
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::LocalTransaction tx;
+  auto intent_result = engine.BuildMerchantIntent(merchant, 400, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  offline_wallet::PaymentAuthorization authorization;
+  auto auth_result = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+
+  offline_wallet::PaymentReceipt receipt;
+  auto accept_result = engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+  const auto replay = engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(replay.status == offline_wallet::HandshakeStatus::kReplayDetected);
+  assert(replay.message == "authorization replayed");
+}
+
+void TestAcceptanceReadsClockOnce() {
+  TestSignatureProvider signature;
+  CounterRandomProvider random("x");
+  TickingClockProvider clock;
+  TestJournal journal;
+  offline_wallet::ReplayFilter filter{offline_wallet::RiskPolicy{}};
+  offline_wallet::OfflineEngine engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock, &journal);
+  engine.SetReplayFilter(&filter);
+
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::LocalTransaction tx;
+  const auto intent_result = engine.BuildMerchantIntent(merchant, 400, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  offline_wallet::PaymentAuthorization authorization;
+  const auto auth_result = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+
+  // The replay check, the journal row and the receipt share one reading.
+  const std::uint64_t before = clock.NowUnixSeconds();
+  offline_wallet::PaymentReceipt receipt;
+  const auto accept_result = engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(tx.updated_at_epoch_seconds == before + 1);
+  assert(receipt.created_at_epoch_seconds == tx.updated_at_epoch_seconds);
+  assert(clock.NowUnixSeconds() == before + 2);
+}
+
+}  // namespace
+
+int main() {
+  TestReplayIsDetected();
+  TestCounterHighWaterMark();
+  TestWindowBoundsMemory();
+  TestDeviceTableEvictsLeastRecentlyUsed();
+  TestFalseReplayRateAndBudget();
+  TestEngineRefusesReplayedAuthorization();
+  TestAcceptanceReadsClockOnce();
+  return 0;
+}
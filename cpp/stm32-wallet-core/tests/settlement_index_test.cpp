@@ -0,0 +1,295 @@
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/settlement_index.hpp"
+#include "offline_wallet/snapshot_store.hpp"
+
+namespace {
+
+using offline_wallet::TransactionState;
+
+constexpr std::uint64_t kDayStart = 1'700'006'400;  // 00:00 UTC.
+
+offline_wallet::LocalTransaction MakeTransaction(std::uint32_t n, TransactionState state) {
+  offline_wallet::LocalTransaction tx;
+  tx.tx_id = "tx-" + std::to_string(100000 + n);
+  tx.merchant_account_id = "merchant-1";
+  tx.payer_account_id = "payer-" + std::to_string(n % 5);
+  tx.merchant_device_id = "merchant-device-1";
+  tx.payer_device_id = "payer-device-" + std::to_string(n % 5);
+  tx.amount_cents = static_cast<std::int32_t>(100 + n * 7 % 900);
+  tx.currency = n % 4 == 3 ? "USD" : "CNY";
+  tx.state = state;
+  tx.created_at_epoch_seconds = kDayStart + n * 997 % 86400;
+  tx.updated_at_epoch_seconds = tx.created_at_epoch_seconds;
+  tx.idempotency_key = "merchant:" + std::string(tx.tx_id);
+  return tx;
+}
+
+// Reference totals from the full records.
+struct Expected {
+  std::array<offline_wallet::SettlementTotals, offline_wallet::kTransactionStateCount> by_state{};
+  std::array<offline_wallet::SettlementTotals, 24> by_hour{};
+  std::map<std::string, offline_wallet::SettlementTotals> by_payer;
+  std::map<std::string, offline_wallet::SettlementTotals> by_currency;
+};
+
+void Add(offline_wallet::SettlementTotals* totals, std::int32_t amount_cents) {
+  totals->amount_cents += amount_cents;
+  ++totals->count;
+}
+
+Expected Reference(const std::map<std::string, offline_wallet::LocalTransaction>& rows,
+                   const offline_wallet::SettlementFilter& filter) {
+  Expected expected;
+  for (const auto& entry : rows) {
+    const offline_wallet::LocalTransaction& tx = entry.second;
+    if (tx.created_at_epoch_seconds < filter.from_epoch_seconds ||
+        tx.created_at_epoch_seconds >= filter.to_epoch_seconds ||
+        (filter.state_mask >> static_cast<int>(tx.state) & 1) == 0 ||
+        (!filter.currency.empty() && tx.currency != filter.currency)) {
+      continue;
+    }
+    Add(&expected.by_state[static_cast<std::size_t>(tx.state)], tx.amount_cents);
+    const std::int64_t local = static_cast<std::int64_t>(tx.created_at_epoch_seconds) + filter.utc_offset_seconds;
+    Add(&expected.by_hour[static_cast<std::size_t>((local % 86400 + 86400) % 86400 / 3600)], tx.amount_cents);
+    Add(&expected.by_payer[std::string(tx.payer_account_id)], tx.amount_cents);
+    Add(&expected.by_currency[std::string(tx.currency)], tx.amount_cents);
+  }
+  return expected;
+}
+
+bool Same(const offline_wallet::SettlementTotals& a, const offline_wallet::SettlementTotals& b) {
+  return a.amount_cents == b.amount_cents && a.count == b.count;
+}
+
+void CheckReports(const offline_wallet::SettlementIndex& index,
+                  const std::map<std::string, offline_wallet::LocalTransaction>& rows,
+                  const offline_wallet::SettlementFilter& filter) {
+  const Expected expected = Reference(rows, filter);
+  const auto by_state = index.TotalsByState(filter);
+  offline_wallet::SettlementTotals all;
+  for (std::size_t state = 0; state < by_state.size(); ++state) {
+    assert(Same(by_state[state], expected.by_state[state]));
+    all.amount_cents += by_state[state].amount_cents;
+    all.count += by_state[state].count;
+  }
+  assert(Same(index.Total(filter), all));
+  const auto by_hour = index.TotalsByHour(filter);
+  for (std::size_t hour = 0; hour < by_hour.size(); ++hour) {
+    assert(Same(by_hour[hour], expected.by_hour[hour]));
+  }
+  std::vector<offline_wallet::SettlementGroup> groups;
+  index.TotalsByPayer(filter, &groups);
+  assert(groups.size() == expected.by_payer.size());
+  for (const offline_wallet::SettlementGroup& group : groups) {
+    assert(Same(group.totals, expected.by_payer.at(std::string(group.key))));
+  }
+  index.TotalsByCurrency(filter, &groups);
+  assert(groups.size() == expected.by_currency.size());
+  for (const offline_wallet::SettlementGroup& group : groups) {
+    assert(Same(group.totals, expected.by_currency.at(std::string(group.key))));
+  }
+}
+
+void CheckAllReports(const offline_wallet::SettlementIndex& index,
+                     const std::map<std::string, offline_wallet::LocalTransaction>& rows) {
+  offline_wallet::SettlementFilter filter;
+  CheckReports(index, rows, filter);
+  filter.currency = "CNY";
+  filter.state_mask = 1u << static_cast<int>(TransactionState::kPendingSync) |
+                      1u << static_cast<int>(TransactionState::kSynced);
+  CheckReports(index, rows, filter);
+  filter.from_epoch_seconds = kDayStart + 6 * 3600;
+  filter.to_epoch_seconds = kDayStart + 18 * 3600;
+  filter.utc_offset_seconds = 8 * 3600;
+  CheckReports(index, rows, filter);
+  filter.utc_offset_seconds = -5 * 3600 - 1800;
+  filter.currency = "USD";
+  CheckReports(index, rows, filter);
+}
+
+void TestIndexFollowsEveryJournalWrite() {
+  offline_wallet::RamBlockDevice device(4096, 16);
+  offline_wallet::FlashJournal journal(&device);
+  bool ok = journal.Mount();
+  assert(ok);
+  offline_wallet::SettlementIndex index(&journal);
+  std::map<std::string, offline_wallet::LocalTransaction> rows;
+
+  for (std::uint32_t n = 0; n < 60; ++n) {
+    const auto tx = MakeTransaction(n, TransactionState::kPendingSync);
+    ok = index.Save(tx);
+    assert(ok);
+    rows[tx.tx_id] = tx;
+  }
+  CheckAllReports(index, rows);
+
+  // Group commit: staged rows count once committed, never when aborted.
+  ok = index.BeginBatch();
+  assert(ok);
+  for (std::uint32_t n = 60; n < 66; ++n) {
+    const auto tx = MakeTransaction(n, TransactionState::kAuthorized);
+    ok = index.Stage(tx);
+    assert(ok);
+    rows[tx.tx_id] = tx;
+  }
+  ok = index.CommitBatch() && index.BeginBatch() && index.Stage(MakeTransaction(90, TransactionState::kPendingSync));
+  assert(ok);
+  index.AbortBatch();
+  assert(index.stats().rows == 66);
+  CheckAllReports(index, rows);
+
+  ok = index.UpdateState(std::string(rows.begin()->first), TransactionState::kRejected, "declined");
+  assert(ok);
+  rows.begin()->second.state = TransactionState::kRejected;
+  std::vector<offline_wallet::StateUpdate> updates;
+  for (std::uint32_t n = 10; n < 40; ++n) {
+    const std::string tx_id(MakeTransaction(n, {}).tx_id);
+    updates.push_back({tx_id, TransactionState::kSynced, ""});
+    rows[tx_id].state = TransactionState::kSynced;
+  }
+  ok = index.UpdateStates(updates.data(), updates.size());
+  assert(ok);
+  CheckAllReports(index, rows);
+
+  // Compaction drops the synced records; the day's totals keep them.
+  while (journal.CompactStep()) {
+  }
+  offline_wallet::LocalTransaction loaded;
+  bool found = index.Load(MakeTransaction(10, {}).tx_id, &loaded);
+  assert(!found);
+  found = index.Load(MakeTransaction(50, {}).tx_id, &loaded);
+  assert(found);
+  CheckAllReports(index, rows);
+
+  // Trim forgets what was created before the cutoff.
+  index.Trim(kDayStart + 12 * 3600);
+  for (auto it = rows.begin(); it != rows.end();) {
+    it = it->second.created_at_epoch_seconds < kDayStart + 12 * 3600 ? rows.erase(it) : std::next(it);
+  }
+  assert(index.stats().rows == rows.size());
+  CheckAllReports(index, rows);
+}
+
+void TestPersistRestoreAndCatchUp() {
+  // One flash part: 12 sectors of journal, 4 of index snapshots.
+  offline_wallet::RamBlockDevice flash(4096, 16);
+  offline_wallet::BlockDeviceRegion journal_region(&flash, 0, 12);
+  offline_wallet::BlockDeviceRegion snapshot_region(&flash, 12, 4);
+  offline_wallet::SnapshotStore store(&snapshot_region);
+  std::map<std::string, offline_wallet::LocalTransaction> rows;
+  {
+    offline_wallet::FlashJournal journal(&journal_region);
+    bool ok = journal.Mount();
+    assert(ok);
+    offline_wallet::SettlementIndex index(&journal);
+    for (std::uint32_t n = 0; n < 40; ++n) {
+      const auto tx = MakeTransaction(n, n < 20 ? TransactionState::kSynced : TransactionState::kPendingSync);
+      ok = index.Save(tx);
+      assert(ok);
+      rows[tx.tx_id] = tx;
+    }
+    while (journal.CompactStep()) {
+    }
+    ok = index.Persist(&store);
+    assert(ok);
+    assert(store.generation() == 1);
+    // Written after the snapshot: only the journal has these.
+    for (std::uint32_t n = 40; n < 50; ++n) {
+      const auto tx = MakeTransaction(n, TransactionState::kPendingSync);
+      ok = index.Save(tx);
+      assert(ok);
+      rows[tx.tx_id] = tx;
+    }
+    ok = index.UpdateState(MakeTransaction(25, {}).tx_id, TransactionState::kRejected, "x");
+    assert(ok);
+    rows[MakeTransaction(25, {}).tx_id].state = TransactionState::kRejected;
+  }
+
+  // Reboot.
+  offline_wallet::FlashJournal journal(&journal_region);
+  bool ok = journal.Mount();
+  assert(ok);
+  offline_wallet::SettlementIndex index(&journal);
+  ok = index.Restore(store);
+  assert(ok);
+  assert(index.stats().rows == 40);
+  ok = index.CatchUp();
+  assert(ok);
+  assert(index.stats().rows == 50);
+  CheckAllReports(index, rows);
+
+  // A second snapshot goes to the other slot; either survives the other's loss.
+  ok = index.Persist(&store);
+  assert(ok);
+  assert(store.generation() == 2);
+  offline_wallet::SettlementIndex small(&journal, offline_wallet::SettlementIndexOptions{10});
+  ok = small.Restore(store);
+  assert(!ok);
+  assert(small.stats().rows == 0);
+}
+
+void TestSnapshotStoreSurvivesPowerCut() {
+  offline_wallet::RamBlockDevice flash(1024, 6);
+  std::vector<std::uint8_t> first(1500, 0x11);
+  std::vector<std::uint8_t> second(2000, 0x22);
+  std::vector<std::uint8_t> read;
+  {
+    offline_wallet::SnapshotStore store(&flash);
+    assert(store.Capacity() == 3 * 1024 - 16);
+    bool ok = store.Read(&read);
+    assert(!ok);
+    ok = store.Write(first.data(), first.size());
+    assert(ok);
+    ok = store.Write(second.data(), store.Capacity() + 1);
+    assert(!ok);
+  }
+
+  // Cut power throughout the second write: the first image stays readable.
+  offline_wallet::FaultInjectingBlockDevice probe(&flash);
+  const std::vector<std::uint8_t> saved = flash.bytes();
+  {
+    offline_wallet::SnapshotStore store(&probe);
+    const bool written = store.Write(second.data(), second.size());
+    assert(written);
+  }
+  const std::uint64_t total = probe.bytes_written();
+  for (std::uint64_t cut = 0; cut < total; cut += 97) {
+    flash.bytes() = saved;
+    offline_wallet::FaultInjectingBlockDevice device(&flash);
+    device.ArmPowerCut(cut);
+    offline_wallet::SnapshotStore store(&device);
+    const bool written = store.Write(second.data(), second.size());
+    assert(!written);
+    offline_wallet::SnapshotStore rebooted(&flash);
+    const bool found = rebooted.Read(&read);
+    assert(found);
+    // The header goes last, so any cut short of the end keeps the old image.
+    assert(read == first);
+  }
+
+  // A flipped payload bit falls back to the older image.
+  flash.bytes() = saved;
+  offline_wallet::SnapshotStore store(&flash);
+  bool ok = store.Write(second.data(), second.size()) && store.Read(&read);
+  assert(ok && read == second && store.generation() == 2);
+  flash.bytes()[3 * 1024 + 16 + 100] ^= 0x01;
+  ok = store.Read(&read);
+  assert(ok && read == first && store.generation() == 1);
+}
+
+}  // namespace
+
+int main() {
+  TestIndexFollowsEveryJournalWrite();
+  TestPersistRestoreAndCatchUp();
+  TestSnapshotStoreSurvivesPowerCut();
+  return 0;
+}
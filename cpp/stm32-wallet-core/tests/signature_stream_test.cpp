@@ -0,0 +1,138 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/signature_stream.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::FnvStreamingSigner;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+
+std::size_t g_allocations = 0;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  ++g_allocations;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t /*size*/) noexcept { std::free(ptr); }
+
+namespace {
+
+class LegacySignatureProvider : public offline_wallet::SignatureProvider {
+ public:
+  std::string Sign(const std::string& message, const std::string& key_id) override {
+    return key_id + "|" + message;
+  }
+
+  bool Verify(const std::string& signature,
+              const std::string& message,
+              const std::string& public_key_or_id) override {
+    return signature == (public_key_or_id + "|" + message);
+  }
+};
+
+class RecordingSigner : public offline_wallet::StreamingSignatureProvider {
+ public:
+  void BeginSign(const std::string& /*key_id*/) override { bytes.clear(); }
+  void BeginVerify(const std::string& /*public_key_or_id*/) override { bytes.clear(); }
+  void Update(const char* data, std::size_t size) override { bytes.append(data, size); }
+  void FinishSign(std::string* signature_out) override { *signature_out = bytes; }
+  bool FinishVerify(const std::string& signature) override { return signature == bytes; }
+
+  std::string bytes;
+};
+
+}  // namespace
+
+int main() {
+  // The canonical encoding is byte-identical to the historical ostringstream
+  // layout, including negative amounts and 64-bit timestamps.
+  RecordingSigner recorder;
+  recorder.BeginSign("k");
+  offline_wallet::SignatureFieldWriter(&recorder)
+      .Field(std::string("tx-1"))
+      .Field(std::int32_t{-250})
+      .Field("CNY")
+      .Field(std::uint32_t{4'294'967'295u})
+      .Field(std::uint64_t{18'446'744'073'709'551'615ULL});
+  std::ostringstream legacy;
+  legacy << "tx-1" << "|" << -250 << "|" << "CNY" << "|" << 4'294'967'295u << "|"
+         << 18'446'744'073'709'551'615ULL;
+  assert(recorder.bytes == legacy.str());
+
+  // Existing whole-message providers keep producing the same signatures
+  // through the bridge.
+  LegacySignatureProvider legacy_signer;
+  CounterRandomProvider random("x");
+  ManualClock clock;
+  TestJournal journal;
+  offline_wallet::OfflineEngine bridged(offline_wallet::RiskPolicy{}, &legacy_signer, &random, &clock, &journal);
+
+  offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  auto intent_result = bridged.BuildMerchantIntent(merchant, 400, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(intent.merchant_signature == "m-key|tx-x1|mi-x2|400|CNY|x3|2|1700000030");
+  auto auth_result = bridged.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(authorization.payer_signature == "p-key|tx-x1|mi-x2|400|CNY|x5|9|1700000000");
+  auto accept_result = bridged.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(receipt.merchant_signature == "m-key|tx-x1|pa-x4|pending_sync");
+
+  // A native streaming provider plugs in directly and verifies its own output.
+  FnvStreamingSigner fnv;
+  offline_wallet::OfflineEngine streaming(offline_wallet::RiskPolicy{}, &fnv, &random, &clock, &journal);
+  intent_result = streaming.BuildMerchantIntent(merchant, 400, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(intent.merchant_signature.size() == 16);
+  fnv.BeginVerify(merchant.signing_key_id);
+  offline_wallet::SignatureFieldWriter(&fnv)
+      .Field(intent.tx_id)
+      .Field(intent.merchant_intent_id)
+      .Field(intent.amount_cents)
+      .Field(intent.currency)
+      .Field(intent.merchant_nonce)
+      .Field(intent.merchant_counter)
+      .Field(intent.expires_at_epoch_seconds);
+  const bool verified = fnv.FinishVerify(intent.merchant_signature);
+  assert(verified);
+
+  // Streaming fields into a native signer allocates nothing once the output
+  // string has capacity.
+  std::string signature;
+  signature.reserve(32);
+  const std::string key_id(merchant.signing_key_id);
+  const std::size_t before = g_allocations;
+  fnv.BeginSign(key_id);
+  offline_wallet::SignatureFieldWriter(&fnv)
+      .Field(intent.tx_id)
+      .Field(intent.amount_cents)
+      .Field(intent.expires_at_epoch_seconds);
+  fnv.FinishSign(&signature);
+  assert(g_allocations == before);
+
+  return 0;
+}
@@ -0,0 +1,306 @@
+#include <cassert>
+#include <cstdint>
+#include <string>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/fixed_offline_engine.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/spend_tracker.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+using offline_wallet::testing::TestSignatureProvider;
+
+constexpr std::uint64_t kNow = 1'700'000'000;
+constexpr std::uint64_t kHour = 3600;
+const std::string kPayer1 = "payer-1";
+const std::string kPayer2 = "payer-2";
+const std::string kPayer9 = "payer-9";
+
+void TestRollingWindowExpires() {
+  offline_wallet::SpendTracker tracker;
+  tracker.Add(kPayer1, 1'000, kNow, kNow);
+  tracker.Add(kPayer1, 2'000, kNow + 5 * kHour, kNow + 5 * kHour);
+  assert(tracker.SpendInWindow(kPayer1, kNow + 5 * kHour) == 3'000);
+  assert(tracker.SpendInWindow(kPayer2, kNow + 5 * kHour) == 0);
+
+  // The first payment leaves the window 24 buckets later; queries do not mutate.
+  assert(tracker.SpendInWindow(kPayer1, kNow + 24 * kHour) == 2'000);
+  assert(tracker.SpendInWindow(kPayer1, kNow + 23 * kHour) == 3'000);
+  assert(tracker.SpendInWindow(kPayer1, kNow + 29 * kHour) == 0);
+
+  tracker.Add(kPayer1, 500, kNow + 24 * kHour, kNow + 24 * kHour);
+  assert(tracker.SpendInWindow(kPayer1, kNow + 24 * kHour) == 2'500);
+  tracker.Add(kPayer1, 700, kNow + 60 * kHour, kNow + 60 * kHour);
+  assert(tracker.SpendInWindow(kPayer1, kNow + 60 * kHour) == 700);
+}
+
+void TestBackdatedAndFutureAdds() {
+  offline_wallet::SpendTracker tracker;
+  tracker.Add(kPayer1, 1'000, kNow - 30 * kHour, kNow);  // Already outside the window.
+  tracker.Add(kPayer1, 400, kNow - 2 * kHour, kNow);
+  tracker.Add(kPayer1, 100, kNow + kHour, kNow);  // Clamped to the current bucket.
+  tracker.Add(kPayer1, -50, kNow, kNow);
+  assert(tracker.SpendInWindow(kPayer1, kNow) == 500);
+  assert(tracker.SpendInWindow(kPayer1, kNow + 22 * kHour) == 100);
+
+  const offline_wallet::FixedId fixed_payer{"payer-1"};
+  tracker.Add(fixed_payer, 25, kNow, kNow);
+  assert(tracker.SpendInWindow(fixed_payer, kNow) == 525);
+}
+
+void TestLeastRecentlyUsedPayerIsEvicted() {
+  offline_wallet::SpendTrackerOptions options;
+  options.payer_slots = 4;
+  offline_wallet::SpendTracker tracker{options};
+  for (int payer = 0; payer < 5; ++payer) {
+    tracker.Add("payer-" + std::to_string(payer), 100 + payer, kNow, kNow);
+  }
+  assert(tracker.SpendInWindow(std::string("payer-0"), kNow) == 0);
+  assert(tracker.SpendInWindow(std::string("payer-4"), kNow) == 104);
+  assert(tracker.SpendInWindow(kPayer1, kNow) == 101);
+  assert(tracker.MemoryBytes() < 512 + 4 * 24 * sizeof(std::int32_t) + 4 * 32);
+
+  tracker.Clear();
+  assert(tracker.SpendInWindow(std::string("payer-4"), kNow) == 0);
+}
+
+offline_wallet::LocalTransaction MakeTransaction(std::uint32_t n,
+                                                 const std::string& payer,
+                                                 std::int32_t amount,
+                                                 std::uint64_t created_at,
+                                                 offline_wallet::TransactionState state) {
+  offline_wallet::LocalTransaction tx;
+  tx.tx_id = "tx-" + std::to_string(n);
+  tx.merchant_account_id = "merchant-1";
+  tx.payer_account_id = payer;
+  tx.amount_cents = amount;
+  tx.currency = "CNY";
+  tx.state = state;
+  tx.created_at_epoch_seconds = created_at;
+  tx.updated_at_epoch_seconds = created_at + 30 * kHour;
+  tx.idempotency_key = "merchant:" + tx.tx_id;
+  return tx;
+}
+
+void TestRebuildStreamsJournalOnce() {
+  using offline_wallet::TransactionState;
+  offline_wallet::RamBlockDevice device(1024, 8);
+  offline_wallet::FlashJournal journal(&device);
+  bool ok = journal.Mount();
+  ok = ok && journal.Save(MakeTransaction(1, "payer-1", 1'000, kNow - kHour, TransactionState::kPendingSync));
+  ok = ok && journal.Save(MakeTransaction(2, "payer-1", 2'000, kNow - 2 * kHour, TransactionState::kSynced));
+  ok = ok && journal.Save(MakeTransaction(3, "payer-1", 4'000, kNow - 30 * kHour, TransactionState::kSynced));
+  ok = ok && journal.Save(MakeTransaction(4, "payer-1", 8'000, kNow, TransactionState::kRejected));
+  ok = ok && journal.Save(MakeTransaction(5, "", 300, kNow, TransactionState::kInitiated));
+  ok = ok && journal.Save(MakeTransaction(6, "payer-2", 600, kNow, TransactionState::kAuthorized));
+  // Only the newest version of a transaction counts.
+  ok = ok && journal.UpdateState("tx-1", TransactionState::kSynced, "");
+  ok = ok && journal.UpdateState("tx-6", TransactionState::kRejected, "insufficient_funds");
+  // Staged records are visible too.
+  ok = ok && journal.BeginBatch();
+  ok = ok && journal.Stage(MakeTransaction(7, "payer-2", 50, kNow, TransactionState::kPendingSync));
+  assert(ok);
+
+  offline_wallet::SpendTracker tracker;
+  tracker.Add(kPayer9, 1, kNow, kNow);
+  ok = tracker.Rebuild(journal, kNow);
+  assert(ok);
+  assert(tracker.SpendInWindow(kPayer1, kNow) == 3'000);
+  assert(tracker.SpendInWindow(kPayer2, kNow) == 50);
+  assert(tracker.SpendInWindow(kPayer9, kNow) == 0);
+  ok = journal.CommitBatch();
+  assert(ok);
+
+  offline_wallet::FlashJournal remounted(&device);
+  ok = remounted.Mount() && tracker.Rebuild(remounted, kNow + kHour);
+  assert(ok);
+  assert(tracker.SpendInWindow(kPayer1, kNow + kHour) == 3'000);
+}
+
+void TestEngineEnforcesDailyLimit() {
+  offline_wallet::RiskPolicy policy;
+  policy.max_per_transaction_cents = 20'000;
+  policy.max_per_day_per_payer_cents = 50'000;
+  TestSignatureProvider signature;
+  CounterRandomProvider random("x");
+  ManualClock clock(kNow);
+  TestJournal merchant_journal;
+  TestJournal payer_journal;
+  offline_wallet::SpendTracker merchant_tracker;
+  offline_wallet::SpendTracker payer_tracker;
+  offline_wallet::OfflineEngine merchant_engine(policy, &signature, &random, &clock, &merchant_journal);
+  offline_wallet::OfflineEngine payer_engine(policy, &signature, &random, &clock, &payer_journal);
+  merchant_engine.SetSpendTracker(&merchant_tracker);
+  payer_engine.SetSpendTracker(&payer_tracker);
+
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+  const auto pay = [&](std::int32_t amount) {
+    offline_wallet::PaymentIntent intent;
+    offline_wallet::LocalTransaction tx;
+    const auto intended = merchant_engine.BuildMerchantIntent(merchant, amount, "CNY", &intent, &tx);
+    assert(intended.status == offline_wallet::HandshakeStatus::kOk);
+    offline_wallet::PaymentAuthorization authorization;
+    const auto authorized = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+    if (authorized.status != offline_wallet::HandshakeStatus::kOk) {
+      return authorized;
+    }
+    offline_wallet::PaymentReceipt receipt;
+    return merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  };
+
+  const auto first = pay(20'000);
+  const auto second = pay(20'000);
+  assert(first.status == offline_wallet::HandshakeStatus::kOk && second.status == offline_wallet::HandshakeStatus::kOk);
+  const auto denied = pay(10'001);
+  assert(denied.status == offline_wallet::HandshakeStatus::kPolicyDenied);
+  assert(denied.message == "daily limit exceeded");
+  const auto last = pay(10'000);
+  assert(last.status == offline_wallet::HandshakeStatus::kOk);
+  assert(payer_tracker.SpendInWindow(kPayer1, clock.now) == 50'000);
+  assert(merchant_tracker.SpendInWindow(kPayer1, clock.now) == 50'000);
+
+  // The merchant side enforces the limit on its own history as well.
+  offline_wallet::SpendTracker fresh_payer_tracker;
+  payer_engine.SetSpendTracker(&fresh_payer_tracker);
+  const auto merchant_denied = pay(100);
+  assert(merchant_denied.status == offline_wallet::HandshakeStatus::kPolicyDenied);
+  assert(merchant_denied.message == "daily limit exceeded");
+
+  clock.now += 24 * kHour;
+  payer_engine.SetSpendTracker(&payer_tracker);
+  const auto next_day = pay(20'000);
+  assert(next_day.status == offline_wallet::HandshakeStatus::kOk);
+}
+
+class TestFixedSignatureProvider : public offline_wallet::FixedSignatureProvider {
+ public:
+  bool Sign(const char* message,
+            std::size_t message_size,
+            const offline_wallet::FixedKeyId& key_id,
+            offline_wallet::FixedSignature* signature_out) override {
+    *signature_out = key_id.c_str();
+    return signature_out->Append('|') && signature_out->Append(message, message_size);
+  }
+
+  bool Verify(const offline_wallet::FixedSignature& signature,
+              const char* message,
+              std::size_t message_size,
+              const offline_wallet::FixedKeyId& public_key_or_id) override {
+    offline_wallet::FixedSignature expected;
+    return Sign(message, message_size, public_key_or_id, &expected) && expected == signature;
+  }
+};
+
+class TestFixedRandomProvider : public offline_wallet::FixedRandomProvider {
+ public:
+  void NextBytes(std::uint8_t* out, std::size_t bytes) override {
+    for (std::size_t i = 0; i < bytes; ++i) {
+      out[i] = static_cast<std::uint8_t>(++counter_);
+    }
+  }
+
+ private:
+  std::uint8_t counter_ = 0;
+};
+
+class TestFixedJournal : public offline_wallet::FixedTransactionJournal {
+ public:
+  bool Save(const offline_wallet::FixedLocalTransaction& tx) override {
+    for (std::size_t i = 0; i < size_; ++i) {
+      if (rows_[i].tx_id == tx.tx_id) {
+        rows_[i] = tx;
+        return true;
+      }
+    }
+    if (size_ == kCapacity) {
+      return false;
+    }
+    rows_[size_++] = tx;
+    return true;
+  }
+
+  bool Load(const offline_wallet::FixedId& tx_id, offline_wallet::FixedLocalTransaction* tx_out) const override {
+    for (std::size_t i = 0; i < size_; ++i) {
+      if (rows_[i].tx_id == tx_id) {
+        *tx_out = rows_[i];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool UpdateState(const offline_wallet::FixedId& tx_id,
+                   offline_wallet::TransactionState state,
+                   const offline_wallet::FixedReason& reason) override {
+    for (std::size_t i = 0; i < size_; ++i) {
+      if (rows_[i].tx_id == tx_id) {
+        rows_[i].state = state;
+        rows_[i].failure_reason = reason;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  static constexpr std::size_t kCapacity = 8;
+  offline_wallet::FixedLocalTransaction rows_[kCapacity];
+  std::size_t size_ = 0;
+};
+
+void TestFixedEngineEnforcesDailyLimit() {
+  offline_wallet::RiskPolicy policy;
+  policy.max_per_transaction_cents = 30'000;
+  policy.max_per_day_per_payer_cents = 50'000;
+  TestFixedSignatureProvider signature;
+  TestFixedRandomProvider random;
+  ManualClock clock(kNow);
+  TestFixedJournal journal;
+  offline_wallet::SpendTracker tracker;
+  offline_wallet::FixedOfflineEngine engine(policy, &signature, &random, &clock, &journal);
+  engine.SetSpendTracker(&tracker);
+
+  offline_wallet::FixedDeviceContext merchant;
+  merchant.account_id = "merchant-1";
+  merchant.device_id = "merchant-device-1";
+  merchant.signing_key_id = "m-key";
+  offline_wallet::FixedDeviceContext payer;
+  payer.account_id = "payer-1";
+  payer.device_id = "payer-device-1";
+  payer.signing_key_id = "p-key";
+
+  offline_wallet::FixedPaymentIntent intent;
+  offline_wallet::FixedLocalTransaction tx;
+  offline_wallet::FixedPaymentAuthorization authorization;
+  auto intent_result = engine.BuildMerchantIntent(merchant, 30'000, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  const auto auth_result = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+  assert(tracker.SpendInWindow(payer.account_id, clock.now) == 30'000);
+
+  intent_result = engine.BuildMerchantIntent(merchant, 25'000, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  const auto denied = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(denied.status == offline_wallet::HandshakeStatus::kPolicyDenied);
+  assert(std::string(denied.message) == "daily limit exceeded");
+}
+
+}  // namespace
+
+int main() {
+  TestRollingWindowExpires();
+  TestBackdatedAndFutureAdds();
+  TestLeastRecentlyUsedPayerIsEvicted();
+  TestRebuildStreamsJournalOnce();
+  TestEngineEnforcesDailyLimit();
+  TestFixedEngineEnforcesDailyLimit();
+  return 0;
+}
@@ -0,0 +1,381 @@
+// Built with -fno-exceptions -fno-rtti against offline_wallet_firmware only,
+// the way a firmware image links the engine.
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "offline_wallet/byte_codec.hpp"
+#include "offline_wallet/fixed_offline_engine.hpp"
+#include "offline_wallet/static_offline_engine.hpp"
+
+namespace {
+
+using offline_wallet::FixedHandshakeResult;
+using offline_wallet::HandshakeStatus;
+
+constexpr std::uint64_t kStart = 1'700'000'000;
+
+// Concrete providers with no virtual functions at all: the static engine only
+// needs the member functions to exist.
+class PlainSigner {
+ public:
+  bool Sign(const char* message,
+            std::size_t message_size,
+            const offline_wallet::FixedKeyId& key_id,
+            offline_wallet::FixedSignature* signature_out) {
+    char digest[16];
+    Digest(key_id.data(), key_id.size(), message, message_size, digest);
+    return signature_out->Assign(digest, sizeof(digest));
+  }
+
+  bool Verify(const offline_wallet::FixedSignature& signature,
+              const char* message,
+              std::size_t message_size,
+              const offline_wallet::FixedKeyId& public_key_or_id) {
+    char digest[16];
+    Digest(public_key_or_id.data(), public_key_or_id.size(), message, message_size, digest);
+    return signature.Equals(digest, sizeof(digest));
+  }
+
+ private:
+  // FNV-1a over key and message as 16 hex characters, like the fakes in
+  // test_support.hpp, which this image does not link.
+  static void Digest(const char* key, std::size_t key_size, const char* message, std::size_t size, char out[16]) {
+    constexpr char kHex[] = "0123456789abcdef";
+    std::uint64_t hash = offline_wallet::Fnv1a(key, key_size);
+    hash = offline_wallet::Fnv1a("|", 1, hash);
+    hash = offline_wallet::Fnv1a(message, size, hash);
+    for (int i = 15; i >= 0; --i) {
+      out[i] = kHex[hash & 0x0F];
+      hash >>= 4;
+    }
+  }
+};
+
+class PlainRandom {
+ public:
+  bool Ready() { return true; }
+
+  void NextBytes(std::uint8_t* out, std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i) {
+      state_ = state_ * 1664525u + 1013904223u;
+      out[i] = static_cast<std::uint8_t>(state_ >> 24);
+    }
+  }
+
+ private:
+  std::uint32_t state_ = 7;
+};
+
+class PlainClock {
+ public:
+  std::uint64_t NowUnixSeconds() const { return now; }
+
+  std::uint64_t now = kStart;
+};
+
+// Advances one second on every read.
+class TickingClock {
+ public:
+  std::uint64_t NowUnixSeconds() const { return kStart + reads_++; }
+
+ private:
+  mutable std::uint64_t reads_ = 0;
+};
+
+class PlainJournal {
+ public:
+  bool Save(const offline_wallet::FixedLocalTransaction& tx) {
+    for (std::size_t i = 0; i < count_; ++i) {
+      if (rows_[i].tx_id == tx.tx_id) {
+        rows_[i] = tx;
+        return true;
+      }
+    }
+    if (count_ == kSlots) {
+      return false;
+    }
+    rows_[count_++] = tx;
+    return true;
+  }
+
+  bool Load(const offline_wallet::FixedId& tx_id, offline_wallet::FixedLocalTransaction* tx_out) const {
+    for (std::size_t i = 0; i < count_; ++i) {
+      if (rows_[i].tx_id == tx_id && tx_out != nullptr) {
+        *tx_out = rows_[i];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool UpdateState(const offline_wallet::FixedId& tx_id,
+                   offline_wallet::TransactionState state,
+                   const offline_wallet::FixedReason& reason) {
+    for (std::size_t i = 0; i < count_; ++i) {
+      if (rows_[i].tx_id == tx_id) {
+        rows_[i].state = state;
+        rows_[i].failure_reason = reason;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  static constexpr std::size_t kSlots = 32;
+  offline_wallet::FixedLocalTransaction rows_[kSlots];
+  std::size_t count_ = 0;
+};
+
+static_assert(!std::is_polymorphic<PlainSigner>::value && !std::is_polymorphic<PlainJournal>::value,
+              "static providers carry no vtable");
+
+// The same providers behind the virtual interfaces, for FixedOfflineEngine.
+class VirtualSigner : public offline_wallet::FixedSignatureProvider {
+ public:
+  bool Sign(const char* message,
+            std::size_t message_size,
+            const offline_wallet::FixedKeyId& key_id,
+            offline_wallet::FixedSignature* signature_out) override {
+    return plain_.Sign(message, message_size, key_id, signature_out);
+  }
+
+  bool Verify(const offline_wallet::FixedSignature& signature,
+              const char* message,
+              std::size_t message_size,
+              const offline_wallet::FixedKeyId& public_key_or_id) override {
+    return plain_.Verify(signature, message, message_size, public_key_or_id);
+  }
+
+ private:
+  PlainSigner plain_;
+};
+
+class VirtualRandom : public offline_wallet::FixedRandomProvider {
+ public:
+  void NextBytes(std::uint8_t* out, std::size_t size) override { plain_.NextBytes(out, size); }
+
+ private:
+  PlainRandom plain_;
+};
+
+class VirtualClock : public offline_wallet::ClockProvider {
+ public:
+  std::uint64_t NowUnixSeconds() const override { return now; }
+
+  std::uint64_t now = kStart;
+};
+
+class VirtualJournal : public offline_wallet::FixedTransactionJournal {
+ public:
+  bool Save(const offline_wallet::FixedLocalTransaction& tx) override { return plain_.Save(tx); }
+  bool Load(const offline_wallet::FixedId& tx_id, offline_wallet::FixedLocalTransaction* tx_out) const override {
+    return plain_.Load(tx_id, tx_out);
+  }
+  bool UpdateState(const offline_wallet::FixedId& tx_id,
+                   offline_wallet::TransactionState state,
+                   const offline_wallet::FixedReason& reason) override {
+    return plain_.UpdateState(tx_id, state, reason);
+  }
+
+ private:
+  PlainJournal plain_;
+};
+
+using DailyPolicy = offline_wallet::StaticRiskPolicy<10'000, 30'000>;
+using StaticEngine =
+    offline_wallet::StaticOfflineEngine<PlainSigner, PlainRandom, PlainClock, PlainJournal, DailyPolicy>;
+
+offline_wallet::FixedDeviceContext Device(const char* account, const char* device, const char* key) {
+  offline_wallet::FixedDeviceContext context;
+  context.account_id = account;
+  context.device_id = device;
+  context.signing_key_id = key;
+  context.local_counter = 3;
+  return context;
+}
+
+bool SameResult(const FixedHandshakeResult& a, const FixedHandshakeResult& b) {
+  return a.status == b.status && std::strcmp(a.message, b.message) == 0;
+}
+
+bool SameTransaction(const offline_wallet::FixedLocalTransaction& a, const offline_wallet::FixedLocalTransaction& b) {
+  return a.tx_id == b.tx_id && a.merchant_account_id == b.merchant_account_id &&
+         a.payer_account_id == b.payer_account_id && a.amount_cents == b.amount_cents &&
+         a.merchant_intent_id == b.merchant_intent_id && a.payer_authorization_id == b.payer_authorization_id &&
+         a.merchant_nonce == b.merchant_nonce && a.payer_nonce == b.payer_nonce && a.state == b.state &&
+         a.created_at_epoch_seconds == b.created_at_epoch_seconds &&
+         a.updated_at_epoch_seconds == b.updated_at_epoch_seconds && a.idempotency_key == b.idempotency_key;
+}
+
+// Drives both engines through the same sequence of handshakes, including
+// every rejection path the policy, replay filter and spend tracker produce,
+// and requires identical results and outputs at each step.
+void TestMatchesFixedEngine() {
+  offline_wallet::RiskPolicy policy;
+  policy.max_per_transaction_cents = DailyPolicy::max_per_transaction_cents;
+  policy.max_per_day_per_payer_cents = DailyPolicy::max_per_day_per_payer_cents;
+
+  PlainSigner plain_signer;
+  PlainRandom plain_random;
+  PlainClock plain_clock;
+  PlainJournal plain_journal;
+  offline_wallet::ReplayFilter plain_filter(policy);
+  offline_wallet::SpendTracker plain_tracker;
+  StaticEngine fast(DailyPolicy{}, &plain_signer, &plain_random, &plain_clock, &plain_journal);
+  fast.SetReplayFilter(&plain_filter);
+  fast.SetSpendTracker(&plain_tracker);
+
+  VirtualSigner virtual_signer;
+  VirtualRandom virtual_random;
+  VirtualClock virtual_clock;
+  VirtualJournal virtual_journal;
+  offline_wallet::ReplayFilter virtual_filter(policy);
+  offline_wallet::SpendTracker virtual_tracker;
+  offline_wallet::FixedOfflineEngine reference(policy, &virtual_signer, &virtual_random, &virtual_clock,
+                                               &virtual_journal);
+  reference.SetReplayFilter(&virtual_filter);
+  reference.SetSpendTracker(&virtual_tracker);
+
+  const auto merchant = Device("merchant-1", "merchant-device-1", "m-key");
+  auto payer = Device("payer-1", "payer-device-1", "p-key");
+  int accepted = 0;
+  int denied = 0;
+  for (int round = 0; round < 8; ++round) {
+    const std::int32_t amount = round == 2 ? 10'001 : 7'500;
+    offline_wallet::FixedPaymentIntent intents[2];
+    offline_wallet::FixedPaymentAuthorization authorizations[2];
+    offline_wallet::FixedPaymentReceipt receipts[2];
+    offline_wallet::FixedLocalTransaction txs[2];
+
+    auto fast_result = fast.BuildMerchantIntent(merchant, amount, "CNY", &intents[0], &txs[0]);
+    auto reference_result = reference.BuildMerchantIntent(merchant, amount, "CNY", &intents[1], &txs[1]);
+    assert(SameResult(fast_result, reference_result));
+    if (fast_result.status != HandshakeStatus::kOk) {
+      ++denied;
+      continue;
+    }
+    assert(intents[0].merchant_signature == intents[1].merchant_signature);
+    assert(intents[0].expires_at_epoch_seconds == intents[1].expires_at_epoch_seconds);
+    assert(SameTransaction(txs[0], txs[1]));
+
+    if (round == 5) {
+      plain_clock.now += 31;  // past the intent TTL
+      virtual_clock.now += 31;
+    }
+    fast_result = fast.BuildPayerAuthorization(payer, intents[0], &authorizations[0], &txs[0]);
+    reference_result = reference.BuildPayerAuthorization(payer, intents[1], &authorizations[1], &txs[1]);
+    assert(SameResult(fast_result, reference_result));
+    if (fast_result.status != HandshakeStatus::kOk) {
+      ++denied;
+      continue;
+    }
+    assert(authorizations[0].payer_signature == authorizations[1].payer_signature);
+    assert(SameTransaction(txs[0], txs[1]));
+
+    fast_result = fast.AcceptAuthorization(merchant, authorizations[0], &receipts[0], &txs[0]);
+    reference_result = reference.AcceptAuthorization(merchant, authorizations[1], &receipts[1], &txs[1]);
+    assert(SameResult(fast_result, reference_result));
+    if (fast_result.status != HandshakeStatus::kOk) {
+      ++denied;
+      continue;
+    }
+    assert(receipts[0].receipt_id == receipts[1].receipt_id);
+    assert(receipts[0].merchant_signature == receipts[1].merchant_signature);
+    assert(SameTransaction(txs[0], txs[1]));
+    ++accepted;
+
+    // Presenting the same authorization again is a replay for both.
+    fast_result = fast.AcceptAuthorization(merchant, authorizations[0], &receipts[0], &txs[0]);
+    reference_result = reference.AcceptAuthorization(merchant, authorizations[1], &receipts[1], &txs[1]);
+    assert(SameResult(fast_result, reference_result));
+    assert(fast_result.status == HandshakeStatus::kReplayDetected);
+    ++payer.local_counter;
+  }
+  // Over-limit amount, expired intent, and the 30'000 daily cap after two
+  // accepted payments on each side (payer authorization and merchant accept
+  // share one tracker per engine here).
+  assert(accepted == 2);
+  assert(denied == 6);
+}
+
+void TestStaticPolicyLimits() {
+  using TightPolicy = offline_wallet::StaticRiskPolicy<500, 1'000, 10, 5>;
+  PlainSigner signer;
+  PlainRandom random;
+  PlainClock clock;
+  PlainJournal journal;
+  offline_wallet::StaticOfflineEngine<PlainSigner, PlainRandom, PlainClock, PlainJournal, TightPolicy> engine(
+      TightPolicy{}, &signer, &random, &clock, &journal);
+  const auto merchant = Device("merchant-1", "merchant-device-1", "m-key");
+  const auto payer = Device("payer-1", "payer-device-1", "p-key");
+
+  offline_wallet::FixedPaymentIntent intent;
+  offline_wallet::FixedLocalTransaction tx;
+  auto result = engine.BuildMerchantIntent(merchant, 501, "CNY", &intent, &tx);
+  assert(result.status == HandshakeStatus::kPolicyDenied);
+  result = engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+  assert(intent.expires_at_epoch_seconds == kStart + 5);
+
+  offline_wallet::FixedPaymentAuthorization authorization;
+  offline_wallet::FixedPaymentIntent skewed = intent;
+  skewed.issued_at_epoch_seconds = kStart + 11;
+  skewed.expires_at_epoch_seconds = kStart + 20;
+  result = engine.BuildPayerAuthorization(payer, skewed, &authorization, &tx);
+  assert(result.status == HandshakeStatus::kPolicyDenied);
+  result = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+
+  offline_wallet::FixedPaymentReceipt receipt;
+  result = engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+  assert(receipt.amount_cents == 500 && tx.state == offline_wallet::TransactionState::kPendingSync);
+
+  // The limits are compile-time constants: no policy storage beyond the empty
+  // tag, unlike the run-time RiskPolicy instantiation.
+  static_assert(sizeof(engine) < sizeof(offline_wallet::StaticOfflineEngine<PlainSigner, PlainRandom, PlainClock,
+                                                                            PlainJournal>),
+                "static policy occupies no RiskPolicy storage");
+}
+
+void TestAcceptanceReadsClockOnce() {
+  PlainSigner signer;
+  PlainRandom random;
+  TickingClock clock;
+  PlainJournal journal;
+  offline_wallet::StaticOfflineEngine<PlainSigner, PlainRandom, TickingClock, PlainJournal> engine(
+      offline_wallet::RiskPolicy{}, &signer, &random, &clock, &journal);
+  const auto merchant = Device("merchant-1", "merchant-device-1", "m-key");
+  const auto payer = Device("payer-1", "payer-device-1", "p-key");
+
+  offline_wallet::FixedPaymentIntent intent;
+  offline_wallet::FixedLocalTransaction tx;
+  auto result = engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+  offline_wallet::FixedPaymentAuthorization authorization;
+  result = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+
+  // The journal row and the receipt carry the reading the checks ran against.
+  const std::uint64_t before = clock.NowUnixSeconds();
+  offline_wallet::FixedPaymentReceipt receipt;
+  result = engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(result.status == HandshakeStatus::kOk);
+  assert(tx.updated_at_epoch_seconds == before + 1);
+  assert(receipt.created_at_epoch_seconds == tx.updated_at_epoch_seconds);
+  assert(clock.NowUnixSeconds() == before + 2);
+}
+
+}  // namespace
+
+int main() {
+  TestMatchesFixedEngine();
+  TestStaticPolicyLimits();
+  TestAcceptanceReadsClockOnce();
+  return 0;
+}
@@ -0,0 +1,429 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "offline_wallet/block_device.hpp"
+#include "offline_wallet/flash_journal.hpp"
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/sync_exporter.hpp"
+#include "offline_wallet/wire_codec.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::SyncExportStatus;
+using offline_wallet::TransactionState;
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::FnvStreamingSigner;
+using offline_wallet::testing::ManualClock;
+
+constexpr std::uint64_t kNow = 1'700'000'000;  // 2023-11-14T22:13:20Z
+
+offline_wallet::LocalTransaction MakeTransaction(int n, TransactionState state) {
+  offline_wallet::LocalTransaction tx;
+  tx.tx_id = "tx-" + std::to_string(n);
+  tx.merchant_account_id = "merchant-1";
+  tx.amount_cents = 100 + n;
+  tx.state = state;
+  tx.idempotency_key = "merchant:" + tx.tx_id;
+  return tx;
+}
+
+std::uint64_t SequenceOf(const offline_wallet::FlashJournal& journal, int n) {
+  offline_wallet::LocalTransaction tx;
+  const bool found = journal.Load("tx-" + std::to_string(n), &tx);
+  assert(found);
+  return tx.sequence;
+}
+
+void TestFlashJournalSequencesSurviveReboots() {
+  offline_wallet::RamBlockDevice device(1024, 4);
+  offline_wallet::FlashJournalOptions options;
+  options.max_records = 16;
+  std::uint64_t newest = 0;
+  {
+    offline_wallet::FlashJournal journal(&device, options);
+    bool ok = journal.Mount();
+    assert(ok);
+    auto caller_stamped = MakeTransaction(1, TransactionState::kPendingSync);
+    caller_stamped.sequence = 1'000'000;  // Ignored; the journal stamps its own.
+    ok = journal.Save(caller_stamped) && journal.Save(MakeTransaction(2, TransactionState::kPendingSync));
+    assert(ok);
+    assert(SequenceOf(journal, 1) > 0 && SequenceOf(journal, 1) < caller_stamped.sequence);
+    assert(SequenceOf(journal, 2) > SequenceOf(journal, 1));
+    ok = journal.UpdateState("tx-1", TransactionState::kSynced, "");
+    assert(ok);
+    assert(SequenceOf(journal, 1) > SequenceOf(journal, 2));
+
+    // Group commits stamp every member, in staging order.
+    ok = journal.BeginBatch() && journal.Stage(MakeTransaction(3, TransactionState::kPendingSync)) &&
+         journal.Stage(MakeTransaction(4, TransactionState::kPendingSync)) && journal.CommitBatch();
+    assert(ok);
+    assert(SequenceOf(journal, 3) > SequenceOf(journal, 1) && SequenceOf(journal, 4) > SequenceOf(journal, 3));
+    newest = SequenceOf(journal, 4);
+  }
+  {
+    offline_wallet::FlashJournal journal(&device, options);
+    bool ok = journal.Mount();
+    assert(ok);
+    assert(SequenceOf(journal, 4) == newest);
+    ok = journal.Save(MakeTransaction(5, TransactionState::kPendingSync));
+    assert(ok);
+    assert(SequenceOf(journal, 5) > newest);
+
+    // Sync everything and keep writing until compaction has dropped it all.
+    for (int n = 2; n <= 5; ++n) {
+      ok = journal.UpdateState("tx-" + std::to_string(n), TransactionState::kSynced, "");
+      assert(ok);
+    }
+    newest = SequenceOf(journal, 5);
+    offline_wallet::LocalTransaction loaded;
+    for (int i = 0; i < 64 && journal.Load("tx-5", &loaded); ++i) {
+      ok = journal.Save(MakeTransaction(100 + i, TransactionState::kSynced));
+      assert(ok);
+      while (journal.CompactStep()) {
+      }
+    }
+    const bool found = journal.Load("tx-1", &loaded) || journal.Load("tx-5", &loaded);
+    assert(!found);
+  }
+  offline_wallet::FlashJournal journal(&device, options);
+  const bool ok = journal.Mount() && journal.Save(MakeTransaction(6, TransactionState::kPendingSync));
+  assert(ok);
+  assert(SequenceOf(journal, 6) > newest);
+}
+
+void TestRecordsWithoutSyncTailStillDecode() {
+  // Records journaled before the sync tail existed have the fixed model's layout.
+  offline_wallet::FixedLocalTransaction fixed;
+  fixed.tx_id = "tx-00000000000000aa";
+  fixed.merchant_account_id = "merchant-1";
+  fixed.amount_cents = 250;
+  fixed.state = TransactionState::kPendingSync;
+  std::uint8_t buffer[offline_wallet::kWireLocalTransactionMaxBytes];
+  std::size_t written = 0;
+  offline_wallet::WireStatus status = offline_wallet::EncodeLocalTransaction(fixed, buffer, sizeof(buffer), &written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  offline_wallet::LocalTransaction tx;
+  status = offline_wallet::DecodeLocalTransaction(buffer, written, &tx);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(tx.tx_id == "tx-00000000000000aa" && tx.sequence == 0 && tx.payer_signature.empty());
+
+  // The tail round-trips, and the fixed model skips it.
+  tx.sequence = 42;
+  tx.intent_issued_at_epoch_seconds = kNow;
+  tx.authorized_at_epoch_seconds = kNow + 5;
+  tx.expires_at_epoch_seconds = kNow + 30;
+  tx.merchant_signature = "merchant-signature";
+  tx.payer_signature = "0123456789abcdef";
+  std::uint8_t tail_buffer[512];
+  status = offline_wallet::EncodeLocalTransaction(tx, tail_buffer, sizeof(tail_buffer), &written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  offline_wallet::LocalTransaction decoded;
+  status = offline_wallet::DecodeLocalTransaction(tail_buffer, written, &decoded);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(decoded.sequence == 42 && decoded.authorized_at_epoch_seconds == kNow + 5 &&
+         decoded.expires_at_epoch_seconds == kNow + 30 && decoded.merchant_signature == "merchant-signature" &&
+         decoded.payer_signature == "0123456789abcdef");
+  status = offline_wallet::DecodeLocalTransaction(tail_buffer, written, &fixed);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(fixed.amount_cents == 250);
+}
+
+offline_wallet::StateUpdate Update(int n, TransactionState state, std::string reason = "") {
+  return {"tx-" + std::to_string(n), state, std::move(reason)};
+}
+
+TransactionState StateOf(const offline_wallet::TransactionJournal& journal, int n) {
+  offline_wallet::LocalTransaction tx;
+  const bool found = journal.Load("tx-" + std::to_string(n), &tx);
+  assert(found);
+  return tx.state;
+}
+
+void TestBulkUpdateIsOneFlashWrite() {
+  offline_wallet::RamBlockDevice device(4096, 8);
+  {
+    offline_wallet::FlashJournal journal(&device);
+    bool ok = journal.Mount();
+    assert(ok);
+    for (int n = 1; n <= 6; ++n) {
+      ok = journal.Save(MakeTransaction(n, TransactionState::kPendingSync));
+      assert(ok);
+    }
+    // Staged records are written ahead of the updates, not lost under them.
+    ok = journal.BeginBatch() && journal.Stage(MakeTransaction(7, TransactionState::kPendingSync));
+    assert(ok);
+
+    const std::vector<offline_wallet::StateUpdate> updates = {
+        Update(1, TransactionState::kSynced),
+        Update(2, TransactionState::kSynced),
+        Update(3, TransactionState::kRejected, "signature_invalid"),
+        Update(99, TransactionState::kSynced),  // Unknown: skipped.
+        Update(4, TransactionState::kSynced),
+        Update(7, TransactionState::kSynced),
+    };
+    const std::uint64_t syncs = device.sync_calls();
+    const std::uint64_t batches = journal.stats().committed_batches;
+    ok = journal.UpdateStates(updates.data(), updates.size());
+    assert(ok);
+    assert(device.sync_calls() == syncs + 2 && journal.stats().committed_batches == batches + 2);
+    ok = journal.CommitBatch();
+    assert(ok);
+
+    // Results already applied cost nothing the second time.
+    const std::uint64_t after = device.sync_calls();
+    ok = journal.UpdateStates(updates.data(), updates.size());
+    assert(ok);
+    assert(device.sync_calls() == after);
+  }
+  offline_wallet::FlashJournal remounted(&device);
+  const bool mounted = remounted.Mount();
+  assert(mounted);
+  assert(StateOf(remounted, 1) == TransactionState::kSynced && StateOf(remounted, 4) == TransactionState::kSynced);
+  assert(StateOf(remounted, 5) == TransactionState::kPendingSync && StateOf(remounted, 7) == TransactionState::kSynced);
+  offline_wallet::LocalTransaction rejected;
+  const bool found = remounted.Load("tx-3", &rejected);
+  assert(found && rejected.state == TransactionState::kRejected);
+  assert(std::string(rejected.failure_reason) == "signature_invalid");
+}
+
+void TestBulkUpdateSplitsBySector() {
+  offline_wallet::RamBlockDevice device(1024, 16);
+  offline_wallet::FlashJournal journal(&device);
+  bool ok = journal.Mount();
+  assert(ok);
+  std::vector<offline_wallet::StateUpdate> updates;
+  for (int n = 1; n <= 24; ++n) {
+    ok = journal.Save(MakeTransaction(n, TransactionState::kPendingSync));
+    assert(ok);
+    updates.push_back(Update(n, TransactionState::kSynced));
+  }
+  const std::uint64_t syncs = device.sync_calls();
+  const std::uint64_t batches = journal.stats().committed_batches;
+  ok = journal.UpdateStates(updates.data(), updates.size());
+  assert(ok);
+  const std::uint64_t groups = journal.stats().committed_batches - batches;
+  assert(groups > 1 && groups < updates.size() / 4);
+  assert(device.sync_calls() - syncs >= groups);
+
+  offline_wallet::FlashJournal remounted(&device);
+  ok = remounted.Mount();
+  assert(ok);
+  for (int n = 1; n <= 24; ++n) {
+    assert(StateOf(remounted, n) == TransactionState::kSynced);
+  }
+}
+
+// Journal on the TransactionJournal defaults, failing writes on request.
+class MapJournal : public offline_wallet::TransactionJournal {
+ public:
+  bool Save(const offline_wallet::LocalTransaction& tx) override {
+    if (fail_writes) {
+      return false;
+    }
+    rows_[tx.tx_id] = tx;
+    rows_[tx.tx_id].sequence = ++sequence_;
+    return true;
+  }
+  bool Load(const std::string& tx_id, offline_wallet::LocalTransaction* tx_out) const override {
+    const auto it = rows_.find(tx_id);
+    if (it == rows_.end()) {
+      return false;
+    }
+    *tx_out = it->second;
+    return true;
+  }
+  bool UpdateState(const std::string& tx_id, TransactionState state, const std::string& reason) override {
+    offline_wallet::LocalTransaction tx;
+    if (!Load(tx_id, &tx)) {
+      return false;
+    }
+    tx.state = state;
+    tx.failure_reason = reason;
+    return Save(tx);
+  }
+  bool ForEach(offline_wallet::JournalVisitor* visitor) const override {
+    for (const auto& row : rows_) {
+      visitor->Visit(row.second);
+    }
+    return true;
+  }
+
+  bool fail_writes = false;
+
+ private:
+  std::map<std::string, offline_wallet::LocalTransaction> rows_;
+  std::uint64_t sequence_ = 0;
+};
+
+void TestApplyResultsAcknowledges() {
+  MapJournal journal;
+  for (int n = 1; n <= 4; ++n) {
+    const bool saved = journal.Save(MakeTransaction(n, TransactionState::kPendingSync));
+    assert(saved);
+  }
+  ManualClock clock;
+  offline_wallet::SyncExporter exporter(&journal, &clock, "merchant-device-1");
+  char buffer[4096];
+  offline_wallet::SyncChunk chunk;
+  SyncExportStatus status = exporter.NextChunk(buffer, sizeof(buffer), &chunk);
+  assert(status == SyncExportStatus::kOk);
+  assert(chunk.transactions == 4);
+
+  using offline_wallet::SyncResultStatus;
+  const std::vector<offline_wallet::SyncResult> results = {
+      {"tx-1", SyncResultStatus::kAccepted, ""},
+      {"tx-2", SyncResultStatus::kDuplicate, "tx_id_seen"},
+      {"tx-3", SyncResultStatus::kRejected, "daily_limit_exceeded"},
+      {"tx-4", SyncResultStatus::kAccepted, ""},
+  };
+  journal.fail_writes = true;
+  status = exporter.ApplyResults(chunk, results.data(), results.size());
+  assert(status == SyncExportStatus::kJournalFailure);
+  assert(exporter.cursor() == 0 && StateOf(journal, 1) == TransactionState::kPendingSync);
+
+  journal.fail_writes = false;
+  status = exporter.ApplyResults(chunk, results.data(), results.size());
+  assert(status == SyncExportStatus::kOk);
+  assert(exporter.cursor() == chunk.last_sequence);
+  assert(StateOf(journal, 1) == TransactionState::kSynced && StateOf(journal, 2) == TransactionState::kSynced);
+  assert(StateOf(journal, 4) == TransactionState::kSynced);
+  offline_wallet::LocalTransaction rejected;
+  const bool found = journal.Load("tx-3", &rejected);
+  assert(found && rejected.state == TransactionState::kRejected);
+  assert(std::string(rejected.failure_reason) == "daily_limit_exceeded");
+  status = exporter.NextChunk(buffer, sizeof(buffer), &chunk);
+  assert(status == SyncExportStatus::kNothingPending);
+}
+
+bool Contains(std::string_view haystack, std::string_view needle) {
+  return haystack.find(needle) != std::string_view::npos;
+}
+
+std::size_t Count(std::string_view haystack, std::string_view needle) {
+  std::size_t count = 0;
+  for (std::size_t at = haystack.find(needle); at != std::string_view::npos; at = haystack.find(needle, at + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+void TestExporterResumesFromCursor() {
+  offline_wallet::RamBlockDevice device(4096, 6);
+  offline_wallet::FlashJournal journal(&device);
+  offline_wallet::RamBlockDevice payer_device(4096, 6);
+  offline_wallet::FlashJournal payer_journal(&payer_device);
+  const bool mounted = journal.Mount() && payer_journal.Mount();
+  assert(mounted);
+  ManualClock clock;
+  FnvStreamingSigner signer;
+  CounterRandomProvider random;
+  offline_wallet::OfflineEngine merchant_engine(offline_wallet::RiskPolicy{}, &signer, &random, &clock,
+                                                &journal);
+  offline_wallet::OfflineEngine payer_engine(offline_wallet::RiskPolicy{}, &signer, &random, &clock,
+                                             &payer_journal);
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 1};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 1};
+
+  std::vector<std::string> sold;
+  const auto sell = [&](bool answered) {
+    offline_wallet::PaymentIntent intent;
+    offline_wallet::PaymentAuthorization authorization;
+    offline_wallet::PaymentReceipt receipt;
+    offline_wallet::LocalTransaction tx;
+    const auto intent_result = merchant_engine.BuildMerchantIntent(merchant, 500, "CNY", &intent, &tx);
+    assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+    if (answered) {
+      const auto auth_result = payer_engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+      assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+      const auto accept_result = merchant_engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+      assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+      sold.push_back(tx.tx_id);
+    }
+  };
+  for (int i = 0; i < 5; ++i) {
+    sell(i != 2);
+  }
+
+  offline_wallet::SyncExportOptions options;
+  options.max_transactions = 3;
+  offline_wallet::SyncExporter exporter(&journal, &clock, "merchant-device-1", options);
+  char buffer[4096];
+  offline_wallet::SyncChunk chunk;
+  SyncExportStatus status = exporter.NextChunk(buffer, sizeof(buffer), &chunk);
+  assert(status == SyncExportStatus::kOk);
+  const std::string first(buffer, chunk.bytes);
+  assert(chunk.transactions == 3);
+  assert(first.rfind("{\"merchantDeviceId\":\"merchant-device-1\",\"submittedAt\":\"2023-11-14T22:13:20.000Z\","
+                     "\"transactions\":[{\"txId\":\"" + sold[0] + "\"",
+                     0) == 0);
+  assert(first.size() > 2 && first.compare(first.size() - 3, 3, "}]}") == 0);
+  assert(Contains(first, sold[1]) && Contains(first, sold[2]) && !Contains(first, sold[3]));
+  assert(Count(first, "\"payerSignature\":\"") == 3 && !Contains(first, "\"payerSignature\":\"\""));
+  assert(Contains(first, "\"expiresAt\":\"2023-11-14T22:13:50.000Z\""));
+  assert(Contains(first, "\"amountCents\":500,\"currency\":\"CNY\""));
+
+  // Unacknowledged, the same chunk comes back, e.g. after the link dropped.
+  clock.now += 60;
+  status = exporter.NextChunk(buffer, sizeof(buffer), &chunk);
+  assert(status == SyncExportStatus::kOk);
+  assert(chunk.transactions == 3 && Contains(std::string_view(buffer, chunk.bytes), sold[2]));
+  exporter.Acknowledge(chunk);
+  for (int i = 0; i < 3; ++i) {
+    const bool synced = journal.UpdateState(sold[static_cast<std::size_t>(i)], TransactionState::kSynced, "");
+    assert(synced);
+  }
+
+  // Later sales join the next chunk; synced records never come back.
+  sell(true);
+  status = exporter.NextChunk(buffer, sizeof(buffer), &chunk);
+  assert(status == SyncExportStatus::kOk);
+  std::string_view second(buffer, chunk.bytes);
+  assert(chunk.transactions == 2 && Contains(second, sold[3]) && Contains(second, sold[4]));
+  assert(!Contains(second, sold[0]) && !Contains(second, sold[2]));
+
+  // A chunk that would overflow the buffer is cut short instead.
+  const std::size_t whole = chunk.bytes;
+  status = exporter.NextChunk(buffer, whole - 1, &chunk);
+  assert(status == SyncExportStatus::kOk);
+  assert(chunk.transactions == 1 && chunk.bytes < whole);
+  assert(std::string_view(buffer, chunk.bytes).compare(chunk.bytes - 2, 2, "]}") == 0);
+  status = exporter.NextChunk(buffer, 64, &chunk);
+  assert(status == SyncExportStatus::kBufferTooSmall);
+
+  // The cursor survives a reboot of both the journal and the exporter.
+  status = exporter.NextChunk(buffer, sizeof(buffer), &chunk);
+  assert(status == SyncExportStatus::kOk);
+  exporter.Acknowledge(chunk);
+  const std::uint64_t cursor = exporter.cursor();
+  offline_wallet::FlashJournal remounted(&device);
+  const bool remounted_ok = remounted.Mount();
+  assert(remounted_ok);
+  offline_wallet::SyncExporter rebooted(&remounted, &clock, "merchant-device-1", options);
+  rebooted.Seek(cursor);
+  status = rebooted.NextChunk(buffer, sizeof(buffer), &chunk);
+  assert(status == SyncExportStatus::kNothingPending);
+  rebooted.Seek(0);
+  status = rebooted.NextChunk(buffer, sizeof(buffer), &chunk);
+  assert(status == SyncExportStatus::kOk);
+  assert(chunk.transactions == 2);
+}
+
+}  // namespace
+
+int main() {
+  TestFlashJournalSequencesSurviveReboots();
+  TestRecordsWithoutSyncTailStillDecode();
+  TestExporterResumesFromCursor();
+  TestBulkUpdateIsOneFlashWrite();
+  TestBulkUpdateSplitsBySector();
+  TestApplyResultsAcknowledges();
+  return 0;
+}
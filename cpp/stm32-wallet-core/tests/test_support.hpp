@@ -0,0 +1,175 @@
+#pragma once
+
+// Fakes shared by the tests and benches: deterministic providers and an
+// in-memory journal. Header-only; each test pulls in the ones it names.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "offline_wallet/byte_codec.hpp"
+#include "offline_wallet/interfaces.hpp"
+#include "offline_wallet/signature_stream.hpp"
+
+namespace offline_wallet::testing {
+
+constexpr std::uint64_t kTestNow = 1'700'000'000;
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+// Renders `hash` as 16 lowercase hex characters.
+inline void HashToHex(std::uint64_t hash, char out[16]) {
+  for (int i = 15; i >= 0; --i) {
+    out[i] = kHexDigits[hash & 0x0F];
+    hash >>= 4;
+  }
+}
+
+// FNV-1a over key, "|" and message as 16 hex characters. Every fake signer
+// produces this, so signatures from different engines can be compared.
+inline void FnvDigest(const char* key, std::size_t key_size, const char* message, std::size_t size, char out[16]) {
+  std::uint64_t hash = Fnv1a(key, key_size);
+  hash = Fnv1a("|", 1, hash);
+  HashToHex(Fnv1a(message, size, hash), out);
+}
+
+inline std::string FnvDigest(const std::string& key_id, const std::string& message) {
+  std::string out(16, '0');
+  FnvDigest(key_id.data(), key_id.size(), message.data(), message.size(), &out[0]);
+  return out;
+}
+
+// Signs as "key|message"; readable in assertion failures.
+class TestSignatureProvider : public SignatureProvider {
+ public:
+  std::string Sign(const std::string& message, const std::string& key_id) override {
+    return key_id + "|" + message;
+  }
+
+  bool Verify(const std::string& signature,
+              const std::string& message,
+              const std::string& public_key_or_id) override {
+    return signature == (public_key_or_id + "|" + message);
+  }
+};
+
+// Streams into FnvDigest. Writes into the caller's string, so signing
+// allocates nothing once that string has grown to 16 characters.
+class FnvStreamingSigner : public StreamingSignatureProvider {
+ public:
+  void BeginSign(const std::string& key_id) override { Reset(key_id); }
+  void BeginVerify(const std::string& public_key_or_id) override { Reset(public_key_or_id); }
+
+  void Update(const char* data, std::size_t size) override { hash_ = Fnv1a(data, size, hash_); }
+
+  void FinishSign(std::string* signature_out) override {
+    signature_out->resize(16);
+    HashToHex(hash_, &(*signature_out)[0]);
+  }
+
+  bool FinishVerify(const std::string& signature) override {
+    char expected[16];
+    HashToHex(hash_, expected);
+    return std::string_view(signature) == std::string_view(expected, sizeof(expected));
+  }
+
+ private:
+  void Reset(const std::string& key) { hash_ = Fnv1a("|", 1, Fnv1a(key.data(), key.size())); }
+
+  std::uint64_t hash_ = 0;
+};
+
+// Returns prefix + "1", prefix + "2", ... regardless of the requested size.
+// Short enough to stay in the small-string buffer.
+class CounterRandomProvider : public RandomProvider {
+ public:
+  explicit CounterRandomProvider(const char* prefix = "") : prefix_(prefix) {}
+
+  std::string NextHex(std::size_t /*bytes*/) override { return prefix_ + std::to_string(++calls_); }
+
+  std::uint32_t calls() const { return calls_; }
+
+ private:
+  const char* prefix_;
+  std::uint32_t calls_ = 0;
+};
+
+// Real hex of the requested size from a 64-bit LCG; reproducible per seed.
+class LcgRandomProvider : public RandomProvider {
+ public:
+  explicit LcgRandomProvider(std::uint64_t seed) : state_(seed) {}
+
+  std::string NextHex(std::size_t bytes) override {
+    std::string out(bytes * 2, '0');
+    for (char& c : out) {
+      state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+      c = kHexDigits[(state_ >> 59) & 0x0F];
+    }
+    return out;
+  }
+
+ private:
+  std::uint64_t state_;
+};
+
+// Time only moves when the test sets `now`.
+class ManualClock : public ClockProvider {
+ public:
+  explicit ManualClock(std::uint64_t start = kTestNow) : now(start) {}
+
+  std::uint64_t NowUnixSeconds() const override { return now; }
+
+  std::uint64_t now;
+};
+
+// Unordered in-memory journal. Records what the engine asked to reserve.
+class TestJournal : public TransactionJournal {
+ public:
+  bool Save(const LocalTransaction& tx) override {
+    rows_[tx.tx_id] = tx;
+    return true;
+  }
+
+  bool Load(const std::string& tx_id, LocalTransaction* tx_out) const override {
+    auto it = rows_.find(tx_id);
+    if (it == rows_.end() || tx_out == nullptr) {
+      return false;
+    }
+    *tx_out = it->second;
+    return true;
+  }
+
+  bool UpdateState(const std::string& tx_id, TransactionState state, const std::string& reason) override {
+    auto it = rows_.find(tx_id);
+    if (it == rows_.end()) {
+      return false;
+    }
+    it->second.state = state;
+    it->second.failure_reason = reason;
+    return true;
+  }
+
+  bool Reserve(std::size_t records) override {
+    reserved += records;
+    last_reserve = records;
+    return true;
+  }
+
+  bool ForEach(JournalVisitor* visitor) const override {
+    for (const auto& row : rows_) {
+      visitor->Visit(row.second);
+    }
+    return true;
+  }
+
+  std::size_t size() const { return rows_.size(); }
+
+  std::size_t reserved = 0;
+  std::size_t last_reserve = 0;
+
+ private:
+  std::unordered_map<std::string, LocalTransaction> rows_;
+};
+
+}  // namespace offline_wallet::testing
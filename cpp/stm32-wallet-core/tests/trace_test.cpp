@@ -0,0 +1,223 @@
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/trace.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::TraceStage;
+using offline_wallet::testing::CounterRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+using offline_wallet::testing::TestSignatureProvider;
+
+std::uint32_t g_ticks = 0;
+
+// Every reading advances the clock by 10 ticks, so spans are deterministic.
+std::uint32_t StepClock() {
+  g_ticks += 10;
+  return g_ticks;
+}
+
+std::uint32_t StoppedClock() { return 0; }
+
+void TestRingKeepsOrderAndCountsDrops() {
+  offline_wallet::TraceRing<4> ring(&StepClock);
+  offline_wallet::TraceEvent event;
+  bool popped = ring.Pop(&event);
+  assert(!popped);
+
+  ring.OnBegin(TraceStage::kSign);
+  ring.OnEnd(TraceStage::kSign, 0);
+  ring.OnBegin(TraceStage::kRandom);
+  ring.OnEnd(TraceStage::kRandom, 1);
+  ring.OnBegin(TraceStage::kJournalLoad);
+  assert(ring.dropped() == 1);
+
+  popped = ring.Pop(&event);
+  assert(popped && event.stage == TraceStage::kSign && !event.end);
+  const std::uint32_t begin_ticks = event.ticks;
+  popped = ring.Pop(&event);
+  assert(popped && event.stage == TraceStage::kSign && event.end && event.ticks == begin_ticks + 10);
+  popped = ring.Pop(&event);
+  assert(popped && event.stage == TraceStage::kRandom && !event.end);
+  popped = ring.Pop(&event);
+  assert(popped && event.stage == TraceStage::kRandom && event.end && event.status == 1);
+  popped = ring.Pop(&event);
+  assert(!popped);
+
+  // Wraps around once drained.
+  ring.OnBegin(TraceStage::kJournalWrite);
+  popped = ring.Pop(&event);
+  assert(popped && event.stage == TraceStage::kJournalWrite);
+}
+
+void TestRingAcrossThreads() {
+  constexpr std::uint32_t kEvents = 200'000;
+  static offline_wallet::TraceRing<64> ring(&StepClock);
+  std::atomic<bool> done{false};
+  std::thread producer([&done] {
+    for (std::uint32_t i = 0; i < kEvents; ++i) {
+      ring.OnEnd(TraceStage::kRandom, static_cast<std::int32_t>(i));
+    }
+    done.store(true, std::memory_order_release);
+  });
+  // Every event the consumer sees arrives intact and in order; the producer
+  // never waits, so whatever did not fit is counted as dropped.
+  std::uint32_t received = 0;
+  std::int32_t last = -1;
+  offline_wallet::TraceEvent event;
+  for (;;) {
+    const bool finished = done.load(std::memory_order_acquire);
+    if (ring.Pop(&event)) {
+      assert(event.end && event.stage == TraceStage::kRandom && event.status > last);
+      last = event.status;
+      ++received;
+    } else if (finished) {
+      break;
+    }
+  }
+  producer.join();
+  assert(received + ring.dropped() == kEvents);
+}
+
+void TestCountersSplitSelfTime() {
+  // The forwarded-to ring reads a clock of its own, so only the counters
+  // advance the step clock.
+  offline_wallet::TraceRing<8> ring(&StoppedClock);
+  offline_wallet::TraceCounters counters(&StepClock, &ring);
+  counters.OnBegin(TraceStage::kAcceptAuthorization);  // t=10
+  counters.OnBegin(TraceStage::kJournalLoad);          // t=20
+  counters.OnEnd(TraceStage::kJournalLoad, 0);         // t=30
+  counters.OnBegin(TraceStage::kSign);                 // t=40
+  counters.OnEnd(TraceStage::kSign, 0);                // t=50
+  counters.OnEnd(TraceStage::kAcceptAuthorization, 6);  // t=60
+
+  const auto& accept = counters.stats(TraceStage::kAcceptAuthorization);
+  assert(accept.count == 1 && accept.failures == 1);
+  assert(accept.total_ticks == 50 && accept.self_ticks == 30 && accept.max_ticks == 50);
+  assert(accept.histogram[6] == 1);  // 50 is in [32, 64).
+  assert(counters.stats(TraceStage::kJournalLoad).total_ticks == 10);
+  assert(counters.stats(TraceStage::kSign).self_ticks == 10);
+
+  // Events were forwarded to the ring as well.
+  offline_wallet::TraceEvent event;
+  int forwarded = 0;
+  while (ring.Pop(&event)) {
+    ++forwarded;
+  }
+  assert(forwarded == 6);
+
+  char text[512];
+  const std::size_t length = counters.Format(text, sizeof(text));
+  assert(length == std::strlen(text));
+  assert(std::strstr(text, "accept_authorization count=1 failures=1 total=50 self=30 max=50 hist=0,0,0,0,0,0,1\n"));
+  assert(std::strstr(text, "journal_load count=1"));
+  assert(!std::strstr(text, "random"));
+
+  char small[8];
+  const std::size_t truncated = counters.Format(small, sizeof(small));
+  assert(truncated == 7 && small[7] == '\0');
+
+  counters.Reset();
+  assert(counters.stats(TraceStage::kAcceptAuthorization).count == 0);
+  const std::size_t empty = counters.Format(text, sizeof(text));
+  assert(empty == 0 && text[0] == '\0');
+}
+
+#if OFFLINE_WALLET_TRACING
+
+std::string Drain(offline_wallet::TraceRing<64>* ring) {
+  std::string trace;
+  offline_wallet::TraceEvent event;
+  while (ring->Pop(&event)) {
+    trace += event.end ? "-" : "+";
+    trace += offline_wallet::TraceStageName(event.stage);
+    if (event.end && event.status != 0) {
+      trace += "!" + std::to_string(event.status);
+    }
+    trace += " ";
+  }
+  return trace;
+}
+
+void TestEngineEmitsNestedStages() {
+  TestSignatureProvider signature;
+  CounterRandomProvider random("x");
+  ManualClock clock;
+  TestJournal journal;
+  offline_wallet::OfflineEngine engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock, &journal);
+  offline_wallet::TraceRing<64> ring(&StepClock);
+  offline_wallet::TraceCounters counters(&StepClock, &ring);
+  engine.SetTraceSink(&counters);
+
+  const offline_wallet::DeviceContext merchant{"merchant-1", "merchant-device-1", "m-key", 2};
+  const offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 9};
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::LocalTransaction tx;
+  auto intent_result = engine.BuildMerchantIntent(merchant, 400, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  std::string trace = Drain(&ring);
+  assert(trace ==
+         "+build_merchant_intent +random -random +random -random +random -random +sign -sign "
+         "+journal_write -journal_write -build_merchant_intent ");
+
+  offline_wallet::PaymentAuthorization authorization;
+  auto auth_result = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+  offline_wallet::PaymentReceipt receipt;
+  auto accept_result = engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+  Drain(&ring);
+
+  // Failures carry the handshake status and the failing provider call.
+  intent_result = engine.BuildMerchantIntent(merchant, 0, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kPolicyDenied);
+  authorization.tx_id = "tx-missing";
+  accept_result = engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kUnknownTransaction);
+  trace = Drain(&ring);
+  assert(trace ==
+         "+build_merchant_intent -build_merchant_intent!1 "
+         "+accept_authorization +journal_load -journal_load!1 -accept_authorization!5 ");
+
+  assert(counters.stats(TraceStage::kBuildMerchantIntent).count == 2);
+  assert(counters.stats(TraceStage::kBuildMerchantIntent).failures == 1);
+  assert(counters.stats(TraceStage::kSign).count == 3);
+  assert(counters.stats(TraceStage::kRandom).count == 6);
+  assert(counters.stats(TraceStage::kJournalWrite).count == 3);
+  assert(counters.stats(TraceStage::kJournalLoad).count == 2);
+  for (TraceStage stage : {TraceStage::kBuildMerchantIntent, TraceStage::kBuildPayerAuthorization,
+                           TraceStage::kAcceptAuthorization}) {
+    const auto& stats = counters.stats(stage);
+    assert(stats.self_ticks > 0 && stats.self_ticks < stats.total_ticks);
+  }
+
+  engine.SetTraceSink(nullptr);
+  intent_result = engine.BuildMerchantIntent(merchant, 400, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  trace = Drain(&ring);
+  assert(trace.empty());
+}
+
+#endif  // OFFLINE_WALLET_TRACING
+
+}  // namespace
+
+int main() {
+  TestRingKeepsOrderAndCountsDrops();
+  TestRingAcrossThreads();
+  TestCountersSplitSelfTime();
+#if OFFLINE_WALLET_TRACING
+  TestEngineEmitsNestedStages();
+#endif
+  return 0;
+}
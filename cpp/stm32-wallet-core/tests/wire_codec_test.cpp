@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "offline_wallet/offline_engine.hpp"
+#include "offline_wallet/wire_codec.hpp"
+
+#include "test_support.hpp"
+
+namespace {
+
+using offline_wallet::testing::LcgRandomProvider;
+using offline_wallet::testing::ManualClock;
+using offline_wallet::testing::TestJournal;
+
+constexpr char kHex[] = "0123456789abcdef";
+
+// Emits 64 pseudo-random bytes as hex, matching the size of an Ed25519
+// signature so payload sizes are representative.
+class HexSignatureProvider : public offline_wallet::SignatureProvider {
+ public:
+  std::string Sign(const std::string& message, const std::string& key_id) override {
+    const std::string input = key_id + "|" + message;
+    std::uint64_t hash = offline_wallet::Fnv1a(input.data(), input.size());
+    std::string out;
+    for (int i = 0; i < 128; ++i) {
+      hash = hash * 6364136223846793005ULL + 1442695040888963407ULL;
+      out.push_back(kHex[hash >> 60]);
+    }
+    return out;
+  }
+
+  bool Verify(const std::string& signature,
+              const std::string& message,
+              const std::string& public_key_or_id) override {
+    return signature == Sign(message, public_key_or_id);
+  }
+};
+
+// Pipe-joined text form of every field, the format the engine signs today.
+std::string IntentText(const offline_wallet::PaymentIntent& intent) {
+  std::ostringstream stream;
+  stream << intent.tx_id << "|" << intent.merchant_intent_id << "|" << intent.merchant_account_id << "|"
+         << intent.merchant_device_id << "|" << intent.amount_cents << "|" << intent.currency << "|"
+         << intent.merchant_nonce << "|" << intent.merchant_counter << "|" << intent.issued_at_epoch_seconds
+         << "|" << intent.expires_at_epoch_seconds << "|" << intent.merchant_signature;
+  return stream.str();
+}
+
+std::string AuthorizationText(const offline_wallet::PaymentAuthorization& authorization) {
+  std::ostringstream stream;
+  stream << authorization.tx_id << "|" << authorization.merchant_intent_id << "|"
+         << authorization.payer_authorization_id << "|" << authorization.payer_account_id << "|"
+         << authorization.payer_device_id << "|" << authorization.amount_cents << "|" << authorization.currency
+         << "|" << authorization.payer_nonce << "|" << authorization.payer_counter << "|"
+         << authorization.authorized_at_epoch_seconds << "|" << authorization.payer_signature;
+  return stream.str();
+}
+
+std::string ReceiptText(const offline_wallet::PaymentReceipt& receipt) {
+  std::ostringstream stream;
+  stream << receipt.tx_id << "|" << receipt.receipt_id << "|" << receipt.merchant_account_id << "|"
+         << receipt.payer_account_id << "|" << receipt.amount_cents << "|" << receipt.currency << "|"
+         << static_cast<int>(receipt.status) << "|" << receipt.created_at_epoch_seconds << "|"
+         << receipt.merchant_signature;
+  return stream.str();
+}
+
+}  // namespace
+
+int main() {
+  HexSignatureProvider signature;
+  LcgRandomProvider random(11);
+  ManualClock clock;
+  TestJournal journal;
+
+  offline_wallet::OfflineEngine engine(offline_wallet::RiskPolicy{}, &signature, &random, &clock, &journal);
+
+  offline_wallet::DeviceContext merchant{"6f1c2a9e-3b4d-4e5f-8a7b-1c2d3e4f5a6b",
+                                         "0a1b2c3d-4e5f-4a6b-8c7d-9e0f1a2b3c4d", "m-key", 2};
+  offline_wallet::DeviceContext payer{"payer-1", "payer-device-1", "p-key", 300};
+
+  offline_wallet::PaymentIntent intent;
+  offline_wallet::PaymentAuthorization authorization;
+  offline_wallet::PaymentReceipt receipt;
+  offline_wallet::LocalTransaction tx;
+  auto intent_result = engine.BuildMerchantIntent(merchant, 4'250, "CNY", &intent, &tx);
+  assert(intent_result.status == offline_wallet::HandshakeStatus::kOk);
+  auto auth_result = engine.BuildPayerAuthorization(payer, intent, &authorization, &tx);
+  assert(auth_result.status == offline_wallet::HandshakeStatus::kOk);
+  auto accept_result = engine.AcceptAuthorization(merchant, authorization, &receipt, &tx);
+  assert(accept_result.status == offline_wallet::HandshakeStatus::kOk);
+
+  std::uint8_t buffer[offline_wallet::kWireAuthorizationMaxBytes];
+  std::size_t written = 0;
+
+  offline_wallet::WireStatus status = offline_wallet::EncodeIntent(intent, buffer, sizeof(buffer), &written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  const std::size_t intent_bytes = written;
+  offline_wallet::WireMessageType type{};
+  status = offline_wallet::PeekWireMessageType(buffer, written, &type);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(type == offline_wallet::WireMessageType::kIntent);
+  offline_wallet::PaymentIntent decoded_intent;
+  status = offline_wallet::DecodeIntent(buffer, written, &decoded_intent);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(IntentText(decoded_intent) == IntentText(intent));
+  status = offline_wallet::DecodeAuthorization(buffer, written, &authorization);
+  assert(status == offline_wallet::WireStatus::kWrongType);
+  for (std::size_t cut = 0; cut < written; ++cut) {
+    status = offline_wallet::DecodeIntent(buffer, cut, &decoded_intent);
+    assert(status != offline_wallet::WireStatus::kOk);
+  }
+  std::size_t ignored = 0;
+  status = offline_wallet::EncodeIntent(intent, buffer, intent_bytes - 1, &ignored);
+  assert(status == offline_wallet::WireStatus::kBufferTooSmall);
+
+  status = offline_wallet::EncodeAuthorization(authorization, buffer, sizeof(buffer), &written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  const std::size_t authorization_bytes = written;
+  offline_wallet::PaymentAuthorization decoded_authorization;
+  status = offline_wallet::DecodeAuthorization(buffer, written, &decoded_authorization);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(AuthorizationText(decoded_authorization) == AuthorizationText(authorization));
+
+  // The fixed-capacity models decode the very same bytes without allocating.
+  offline_wallet::FixedPaymentAuthorization fixed_authorization;
+  status = offline_wallet::DecodeAuthorization(buffer, written, &fixed_authorization);
+  assert(status == offline_wallet::WireStatus::kOk);
+  std::uint8_t fixed_buffer[offline_wallet::kWireAuthorizationMaxBytes];
+  std::size_t fixed_written = 0;
+  status = offline_wallet::EncodeAuthorization(fixed_authorization, fixed_buffer, sizeof(fixed_buffer),
+                                               &fixed_written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(fixed_written == written && std::equal(buffer, buffer + written, fixed_buffer));
+
+  buffer[0] = offline_wallet::kWireFormatVersion + 1;
+  status = offline_wallet::DecodeAuthorization(buffer, written, &decoded_authorization);
+  assert(status == offline_wallet::WireStatus::kUnsupportedVersion);
+
+  status = offline_wallet::EncodeReceipt(receipt, buffer, sizeof(buffer), &written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  const std::size_t receipt_bytes = written;
+  offline_wallet::PaymentReceipt decoded_receipt;
+  status = offline_wallet::DecodeReceipt(buffer, written, &decoded_receipt);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(ReceiptText(decoded_receipt) == ReceiptText(receipt));
+
+  // Non-hex and mixed-case values survive verbatim.
+  offline_wallet::PaymentIntent odd = intent;
+  odd.tx_id = "TX-ABC";
+  odd.merchant_nonce = "not hex";
+  odd.amount_cents = -7;
+  status = offline_wallet::EncodeIntent(odd, buffer, sizeof(buffer), &written);
+  assert(status == offline_wallet::WireStatus::kOk);
+  status = offline_wallet::DecodeIntent(buffer, written, &decoded_intent);
+  assert(status == offline_wallet::WireStatus::kOk);
+  assert(IntentText(decoded_intent) == IntentText(odd));
+
+  odd.currency = "RMB1";
+  status = offline_wallet::EncodeIntent(odd, buffer, sizeof(buffer), &written);
+  assert(status == offline_wallet::WireStatus::kInvalidField);
+
+  const std::size_t intent_text = IntentText(intent).size();
+  const std::size_t authorization_text = AuthorizationText(authorization).size();
+  const std::size_t receipt_text = ReceiptText(receipt).size();
+  std::cout << "intent: binary=" << intent_bytes << " text=" << intent_text << "\n"
+            << "authorization: binary=" << authorization_bytes << " text=" << authorization_text << "\n"
+            << "receipt: binary=" << receipt_bytes << " text=" << receipt_text << "\n";
+  assert(intent_bytes * 10 < intent_text * 6);
+  assert(authorization_bytes * 10 < authorization_text * 6);
+  assert(receipt_bytes * 10 < receipt_text * 6);
+
+  return 0;
+}